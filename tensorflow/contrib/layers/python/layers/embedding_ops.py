@@ -32,6 +32,7 @@ from tensorflow.python.ops import clip_ops
 from tensorflow.python.ops import control_flow_ops
 from tensorflow.python.ops import data_flow_ops
 from tensorflow.python.ops import embedding_ops
+from tensorflow.python.ops import gen_math_ops
 from tensorflow.python.ops import math_ops
 from tensorflow.python.ops import resource_variable_ops
 from tensorflow.python.ops import sparse_ops
@@ -41,7 +42,8 @@ from tensorflow.python.platform import tf_logging as logging
 __all__ = [
     "safe_embedding_lookup_sparse", "scattered_embedding_lookup",
     "scattered_embedding_lookup_sparse", "embedding_lookup_unique",
-    "embedding_lookup_sparse_with_distributed_aggregation"
+    "embedding_lookup_sparse_with_distributed_aggregation",
+    "fused_embedding_lookup_sparse"
 ]
 
 
@@ -704,6 +706,69 @@ def embedding_lookup_sparse_with_distributed_aggregation(
     return embeddings
 
 
+def fused_embedding_lookup_sparse(params,
+                                  sp_ids,
+                                  sp_weights=None,
+                                  combiner="mean",
+                                  name=None):
+  """Computes embeddings for the given ids and weights with a single op.
+
+  Computes the same result as `tf.nn.embedding_lookup_sparse` for a single
+  unpartitioned `params` tensor, but gathers, weights and combines the
+  embeddings in one CPU kernel without materializing the gathered embeddings.
+  The gradient with respect to `params` is an `IndexedSlices` with a row per
+  id. There is no gradient with respect to `sp_weights`.
+
+  Args:
+    params: A single `Tensor` or `Variable` of float or double embeddings.
+    sp_ids: N x M SparseTensor of int32 or int64 ids, where N is typically
+      batch size and M is arbitrary. Its indices must be in canonical row-major
+      order.
+    sp_weights: either a SparseTensor of weights of the same type as `params`,
+      or None to indicate all weights should be taken to be 1. If specified,
+      sp_weights must have exactly the same shape and indices as sp_ids.
+    combiner: A string specifying the reduction op. Currently "mean", "sqrtn"
+      and "sum" are supported.
+      "sum" computes the weighted sum of the embedding results for each row.
+      "mean" is the weighted sum divided by the total weight.
+      "sqrtn" is the weighted sum divided by the square root of the sum of the
+      squares of the weights.
+    name: Optional name for the op.
+
+  Returns:
+    A dense tensor representing the combined embeddings for the sparse ids,
+    with as many rows as the last row of `sp_ids` that has an id, plus one.
+
+  Raises:
+    TypeError: If sp_ids is not a SparseTensor, or if sp_weights is neither
+      None nor SparseTensor.
+    ValueError: If combiner is not one of {"mean", "sqrtn", "sum"}.
+  """
+  if combiner not in ("mean", "sqrtn", "sum"):
+    raise ValueError("combiner must be one of 'mean', 'sqrtn' or 'sum'")
+  if not isinstance(sp_ids, sparse_tensor.SparseTensor):
+    raise TypeError("sp_ids must be SparseTensor")
+  if sp_weights is not None:
+    if not isinstance(sp_weights, sparse_tensor.SparseTensor):
+      raise TypeError("sp_weights must be either None or SparseTensor")
+    sp_ids.values.get_shape().assert_is_compatible_with(
+        sp_weights.values.get_shape())
+    sp_ids.indices.get_shape().assert_is_compatible_with(
+        sp_weights.indices.get_shape())
+
+  with ops.name_scope(name, "fused_embedding_lookup_sparse",
+                      [params, sp_ids]) as name:
+    params = ops.convert_to_tensor(params, name="params")
+    segment_ids = math_ops.cast(sp_ids.indices[:, 0], dtypes.int32)
+    if sp_weights is None:
+      weights = array_ops.zeros([0], dtype=params.dtype)
+    else:
+      weights = math_ops.cast(sp_weights.values, params.dtype)
+    return gen_math_ops.fused_embedding_lookup_sparse(
+        params, sp_ids.values, weights, segment_ids, combiner=combiner,
+        name=name)
+
+
 def _do_gather(params, ids, name=None):
   """Deals with doing gather differently for resource variables."""
   if isinstance(params, resource_variable_ops.ResourceVariable):
@@ -29,11 +29,14 @@ from tensorflow.contrib.layers.python.layers import embedding_ops
 from tensorflow.python.framework import constant_op
 from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import errors_impl
+from tensorflow.python.framework import ops
 from tensorflow.python.framework import random_seed
 from tensorflow.python.framework import sparse_tensor as sparse_tensor_lib
 from tensorflow.python.framework import test_util
 from tensorflow.python.ops import array_ops
+from tensorflow.python.ops import embedding_ops as core_embedding_ops
 from tensorflow.python.ops import gradient_checker
+from tensorflow.python.ops import gradients_impl
 from tensorflow.python.ops import init_ops
 from tensorflow.python.ops import math_ops
 from tensorflow.python.ops import partitioned_variables
@@ -784,5 +787,58 @@ class EmbeddingLookupSparseWithDistributedAggregationTest(test.TestCase):
             x, sp_ids, sp_weights, combiner="mean")
 
 
+class FusedEmbeddingLookupSparseTest(test.TestCase):
+
+  def _SparseIdsAndWeights(self, dtype):
+    indices = [[0, 0], [0, 1], [0, 2], [2, 0], [3, 0], [3, 1]]
+    shape = [4, 3]
+    sp_ids = sparse_tensor_lib.SparseTensor(
+        constant_op.constant(indices, dtypes.int64),
+        constant_op.constant([3, 0, 3, 5, 1, 2], dtypes.int64),
+        constant_op.constant(shape, dtypes.int64))
+    sp_weights = sparse_tensor_lib.SparseTensor(
+        constant_op.constant(indices, dtypes.int64),
+        constant_op.constant([1.0, 2.0, 0.5, 4.0, 1.5, 3.0], dtype),
+        constant_op.constant(shape, dtypes.int64))
+    return sp_ids, sp_weights
+
+  def testMatchesEmbeddingLookupSparse(self):
+    for combiner, dtype, ignore_weights in itertools.product(
+        ["sum", "mean", "sqrtn"], [dtypes.float32, dtypes.float64],
+        [True, False]):
+      with self.test_session():
+        params = constant_op.constant(
+            np.random.rand(6, 2, 3), dtype=dtype)
+        sp_ids, sp_weights = self._SparseIdsAndWeights(dtype)
+        sp_weights = None if ignore_weights else sp_weights
+        fused = embedding_ops.fused_embedding_lookup_sparse(
+            params, sp_ids, sp_weights, combiner=combiner)
+        unfused = core_embedding_ops.embedding_lookup_sparse(
+            params, sp_ids, sp_weights, combiner=combiner)
+        self.assertAllClose(unfused.eval(), fused.eval())
+
+        fused_grad, = gradients_impl.gradients(fused, params)
+        unfused_grad, = gradients_impl.gradients(unfused, params)
+        self.assertAllClose(
+            ops.convert_to_tensor(unfused_grad).eval(),
+            ops.convert_to_tensor(fused_grad).eval())
+
+  def testGradient(self):
+    with self.test_session():
+      params = constant_op.constant(
+          np.random.rand(6, 3), dtype=dtypes.float64)
+      sp_ids, sp_weights = self._SparseIdsAndWeights(dtypes.float64)
+      y = embedding_ops.fused_embedding_lookup_sparse(
+          params, sp_ids, sp_weights, combiner="sqrtn")
+      err = gradient_checker.compute_gradient_error(params, [6, 3], y, [4, 3])
+    self.assertLess(err, 1e-5)
+
+  def testBadCombiner(self):
+    sp_ids, _ = self._SparseIdsAndWeights(dtypes.float32)
+    with self.assertRaises(ValueError):
+      embedding_ops.fused_embedding_lookup_sparse(
+          constant_op.constant([[1.0]]), sp_ids, combiner="max")
+
+
 if __name__ == "__main__":
   test.main()
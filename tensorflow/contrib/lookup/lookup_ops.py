@@ -671,3 +671,121 @@ class MutableDenseHashTable(LookupInterface):
       with ops.colocate_with(self.op._table_ref):
         return gen_lookup_ops.lookup_table_import_v2(
             self.op._table_ref, restored_tensors[0], restored_tensors[1])
+
+
+class MemmappedHashTable(LookupInterface):
+  """A read-only hash table that memory maps a prebuilt table file.
+
+  The file is built offline by the `build_memmapped_lookup_table` tool, e.g.
+  from a vocabulary file. Creating the table only checks the header of the
+  file, so it takes constant time however large the file is; the rest of the
+  file is checked as lookups read it. Processes on the same host that map the
+  same file share its pages. Keys must be `int64` or `string`, and values
+  `int64`, `float32`, `float64` or `string`.
+
+  Example usage:
+
+  ```python
+  table = tf.contrib.lookup.MemmappedHashTable("/path/to/vocab.table",
+                                               key_dtype=tf.string,
+                                               value_dtype=tf.int64,
+                                               default_value=-1)
+  out = table.lookup(query_keys)
+  print(out.eval())
+  ```
+  """
+
+  def __init__(self,
+               filename,
+               key_dtype,
+               value_dtype,
+               default_value,
+               shared_name=None,
+               name="MemmappedHashTable"):
+    """Creates a `MemmappedHashTable` object.
+
+    Args:
+      filename: A scalar `string` tensor with the path of the table file.
+      key_dtype: the type of the key tensors.
+      value_dtype: the type of the value tensors.
+      default_value: The value to use if a key is missing in the table.
+      shared_name: If non-empty, this table will be shared under
+        the given name across multiple sessions.
+      name: A name for the operation (optional).
+
+    Returns:
+      A `MemmappedHashTable` object.
+    """
+    self._default_value = ops.convert_to_tensor(
+        default_value, dtype=value_dtype)
+    self._table_ref = gen_lookup_ops.memmapped_hash_table(
+        filename=filename,
+        shared_name=shared_name,
+        key_dtype=key_dtype,
+        value_dtype=value_dtype,
+        name=name)
+    super(MemmappedHashTable, self).__init__(
+        key_dtype, value_dtype, self._table_ref.op.name.split("/")[-1])
+
+  def size(self, name=None):
+    """Compute the number of elements in this table.
+
+    Args:
+      name: A name for the operation (optional).
+
+    Returns:
+      A scalar tensor containing the number of elements in this table.
+    """
+    with ops.name_scope(name, "%s_Size" % self._name,
+                        [self._table_ref]) as name:
+      with ops.colocate_with(self._table_ref):
+        return gen_lookup_ops.lookup_table_size_v2(self._table_ref, name=name)
+
+  def lookup(self, keys, name=None):
+    """Looks up `keys` in a table, outputs the corresponding values.
+
+    The `default_value` is used for keys not present in the table.
+
+    Args:
+      keys: Keys to look up. Can be a tensor of any shape. Must match the
+        table's key_dtype.
+      name: A name for the operation (optional).
+
+    Returns:
+      A tensor containing the values in the same shape as `keys` using the
+        table's value type.
+
+    Raises:
+      TypeError: when `keys` do not match the table data types.
+    """
+    if keys.dtype.base_dtype != self._key_dtype:
+      raise TypeError("Signature mismatch. Keys must be dtype %s, got %s." %
+                      (self._key_dtype, keys.dtype))
+
+    with ops.name_scope(name, "%s_lookup_table_find" % self._name,
+                        [self._table_ref, keys]) as name:
+      with ops.colocate_with(self._table_ref):
+        values = gen_lookup_ops.lookup_table_find_v2(
+            self._table_ref, keys, self._default_value, name=name)
+
+    values.set_shape(keys.get_shape())
+    return values
+
+  def export(self, name=None):
+    """Returns tensors of all keys and values in the table.
+
+    Args:
+      name: A name for the operation (optional).
+
+    Returns:
+      A pair of tensors with the first tensor containing all keys and the
+        second tensors containing all values in the table.
+    """
+    with ops.name_scope(name, "%s_lookup_table_export_values" % self._name,
+                        [self._table_ref]) as name:
+      with ops.colocate_with(self._table_ref):
+        exported_keys, exported_values = gen_lookup_ops.lookup_table_export_v2(
+            self._table_ref, self._key_dtype, self._value_dtype, name=name)
+
+    exported_values.set_shape(exported_keys.get_shape())
+    return exported_keys, exported_values
@@ -0,0 +1,126 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/contrib/shm/shm_memory_manager.h"
+
+#include <unistd.h>
+
+#include <cstring>
+
+#include "tensorflow/contrib/shm/shm.pb.h"
+#include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+namespace {
+
+// How long a chunk waits for its client before the server reclaims it. The
+// client reads the chunk as soon as it receives the RecvTensorResponse, so
+// this only expires chunks whose response or client was lost.
+constexpr int64 kChunkLeaseMicros = 60 * 1000 * 1000;
+
+}  // namespace
+
+constexpr uint64 ShmMemoryManager::kMinTensorBytes;
+
+/* static */
+Status ShmMemoryManager::Create(uint64 capacity,
+                                std::unique_ptr<ShmMemoryManager>* out) {
+  // The random suffix keeps a restarted server from being confused with the
+  // previous incarnation by peers that still have its ring mapped.
+  const string name = strings::StrCat("/tf_shm_", getpid(), "_",
+                                      strings::Hex(random::New64()));
+  std::unique_ptr<ShmRingBuffer> ring;
+  TF_RETURN_IF_ERROR(
+      ShmRingBuffer::Create(name, capacity, kChunkLeaseMicros, &ring));
+  out->reset(new ShmMemoryManager(std::move(ring), ShmHostKey()));
+  return Status::OK();
+}
+
+ShmMemoryManager::ShmMemoryManager(std::unique_ptr<ShmRingBuffer> ring,
+                                   const string& host_key)
+    : ring_(std::move(ring)), host_key_(host_key) {}
+
+void ShmMemoryManager::TransportOptionsForRequest(
+    ::google::protobuf::Any* mutable_transport_options) const {
+  ShmTransportRequest request;
+  request.set_host_key(host_key_);
+  mutable_transport_options->PackFrom(request);
+}
+
+bool ShmMemoryManager::IsColocated(
+    const ::google::protobuf::Any& transport_options) const {
+  ShmTransportRequest request;
+  return transport_options.UnpackTo(&request) &&
+         request.host_key() == host_key_;
+}
+
+bool ShmMemoryManager::TransportOptionsFromTensor(
+    const Tensor& tensor, ::google::protobuf::Any* mutable_transport_options) {
+  const uint64 length = tensor.TotalBytes();
+  uint64 offset;
+  uint64 sequence;
+  char* data;
+  if (!ring_->Allocate(length, &offset, &sequence, &data)) {
+    VLOG(1) << "Shared memory ring " << ring_->name() << " is full, sending "
+            << length << " bytes in-band";
+    return false;
+  }
+  memcpy(data, DMAHelper::base(&tensor), length);
+  ring_->Commit(offset);
+
+  ShmTensorLocation location;
+  location.set_region(ring_->name());
+  location.set_offset(offset);
+  location.set_length(length);
+  location.set_sequence(sequence);
+  mutable_transport_options->PackFrom(location);
+  return true;
+}
+
+Status ShmMemoryManager::TensorFromTransportOptions(
+    const ::google::protobuf::Any& transport_options, Tensor* tensor) {
+  ShmTensorLocation location;
+  if (!transport_options.UnpackTo(&location)) {
+    return errors::Internal("Cannot parse shared memory tensor location");
+  }
+  if (location.length() != tensor->TotalBytes()) {
+    return errors::Internal("Shared memory tensor has ", location.length(),
+                            " bytes, expected ", tensor->TotalBytes());
+  }
+  ShmRingBuffer* peer;
+  TF_RETURN_IF_ERROR(GetPeer(location.region(), &peer));
+  return peer->Read(location.offset(), location.length(), location.sequence(),
+                    static_cast<char*>(DMAHelper::base(tensor)));
+}
+
+Status ShmMemoryManager::GetPeer(const string& region, ShmRingBuffer** peer) {
+  mutex_lock l(mu_);
+  auto iter = peers_.find(region);
+  if (iter == peers_.end()) {
+    std::unique_ptr<ShmRingBuffer> ring;
+    TF_RETURN_IF_ERROR(ShmRingBuffer::Open(region, &ring));
+    iter = peers_.emplace(region, std::move(ring)).first;
+  }
+  *peer = iter->second.get();
+  return Status::OK();
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,83 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CONTRIB_SHM_SHM_MEMORY_MANAGER_H_
+#define TENSORFLOW_CONTRIB_SHM_SHM_MEMORY_MANAGER_H_
+
+#include <memory>
+#include <unordered_map>
+
+#include "google/protobuf/any.pb.h"
+#include "tensorflow/contrib/shm/shm_ring_buffer.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace tensorflow {
+
+class Tensor;
+
+// Moves tensor contents between co-located tasks through shared memory.
+//
+// Every server owns one ShmRingBuffer that it writes the tensors it sends
+// into, and maps the rings of the peers it receives from on first use. The
+// transport options are exchanged through RecvTensorRequest and
+// RecvTensorResponse, see tensorflow/core/protobuf/worker.proto.
+class ShmMemoryManager {
+ public:
+  // Creates a manager whose own ring holds `capacity` bytes.
+  static Status Create(uint64 capacity, std::unique_ptr<ShmMemoryManager>* out);
+
+  // Tensors smaller than this are cheaper to send in-band.
+  static constexpr uint64 kMinTensorBytes = 4096;
+
+  // Client side: encodes a request for shared memory transport.
+  void TransportOptionsForRequest(
+      ::google::protobuf::Any* mutable_transport_options) const;
+
+  // Server side: returns true if the client that sent `transport_options`
+  // can read from this server's ring.
+  bool IsColocated(const ::google::protobuf::Any& transport_options) const;
+
+  // Server side: copies the contents of the host-memory `tensor` into the
+  // ring and encodes their location. Returns false if the ring is full, in
+  // which case the tensor has to be sent in-band.
+  bool TransportOptionsFromTensor(
+      const Tensor& tensor,
+      ::google::protobuf::Any* mutable_transport_options);
+
+  // Client side: fills the allocated, host-memory `tensor` from the location
+  // encoded in `transport_options`.
+  Status TensorFromTransportOptions(
+      const ::google::protobuf::Any& transport_options, Tensor* tensor);
+
+ private:
+  ShmMemoryManager(std::unique_ptr<ShmRingBuffer> ring, const string& host_key);
+
+  Status GetPeer(const string& region, ShmRingBuffer** peer);
+
+  const std::unique_ptr<ShmRingBuffer> ring_;
+  const string host_key_;
+
+  mutex mu_;
+  std::unordered_map<string, std::unique_ptr<ShmRingBuffer>> peers_
+      GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ShmMemoryManager);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CONTRIB_SHM_SHM_MEMORY_MANAGER_H_
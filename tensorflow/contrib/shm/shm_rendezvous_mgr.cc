@@ -0,0 +1,196 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/contrib/shm/shm_rendezvous_mgr.h"
+
+#include "tensorflow/contrib/shm/shm_memory_manager.h"
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/distributed_runtime/request_id.h"
+#include "tensorflow/core/distributed_runtime/tensor_coding.h"
+#include "tensorflow/core/distributed_runtime/worker_cache.h"
+#include "tensorflow/core/distributed_runtime/worker_interface.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+namespace {
+
+class ShmRecvTensorCall : public BaseRecvTensorCall {
+ public:
+  ShmRecvTensorCall(WorkerInterface* wi, Device* dst_device,
+                    ShmMemoryManager* shm_memory_manager,
+                    const Rendezvous::Args& recv_args, int64 step_id,
+                    StringPiece key)
+      : wi_(wi),
+        dst_device_(dst_device),
+        shm_memory_manager_(shm_memory_manager),
+        recv_args_(recv_args) {
+    req_.set_step_id(step_id);
+    req_.set_rendezvous_key(key.data(), key.size());
+    req_.set_request_id(GetUniqueRequestId());
+    req_.set_priority(recv_args.priority);
+  }
+
+  ~ShmRecvTensorCall() override {}
+
+  void Start(std::function<void()> recv_done) override {
+    // The tensor contents are copied out of shared memory on the CPU, so
+    // only ask for it when the destination buffer lives in host memory.
+    const bool on_host = (dst_device_->tensorflow_gpu_device_info() ==
+                          nullptr) ||
+                         recv_args_.alloc_attrs.on_host();
+    if (on_host) {
+      req_.set_dma_ok(true);
+      shm_memory_manager_->TransportOptionsForRequest(
+          req_.mutable_transport_options());
+    }
+    resp_.InitAlloc(dst_device_, recv_args_.alloc_attrs);
+    StatusCallback cb = [this, recv_done](const Status& s) {
+      Status status = s;
+      if (status.ok() && resp_.metadata().has_transport_options()) {
+        status = shm_memory_manager_->TensorFromTransportOptions(
+            resp_.metadata().transport_options(),
+            const_cast<Tensor*>(&tensor()));
+      }
+      if (!status.ok()) {
+        mutex_lock l(mu_);
+        status_.Update(status);
+      }
+      recv_done();
+    };
+    wi_->RecvTensorAsync(&opts_, &req_, &resp_, std::move(cb));
+  }
+
+  void StartAbort(const Status& s) override {
+    {
+      mutex_lock l(mu_);
+      status_.Update(s);
+    }
+    opts_.StartCancel();
+  }
+
+  Status status() const override {
+    mutex_lock l(mu_);
+    return status_;
+  }
+
+  const Tensor& tensor() const { return resp_.tensor(); }
+
+  bool is_dead() const { return resp_.metadata().is_dead(); }
+
+  const Rendezvous::Args& recv_args() const { return recv_args_; }
+
+ private:
+  WorkerInterface* wi_;
+  Device* dst_device_;
+  ShmMemoryManager* shm_memory_manager_;
+  CallOptions opts_;
+  RecvTensorRequest req_;
+  TensorResponse resp_;
+  Rendezvous::Args recv_args_;
+
+  mutable mutex mu_;
+  Status status_ GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ShmRecvTensorCall);
+};
+
+class ShmRemoteRendezvous : public BaseRemoteRendezvous {
+ public:
+  ShmRemoteRendezvous(const WorkerEnv* env, int64 step_id,
+                      ShmMemoryManager* shm_memory_manager)
+      : BaseRemoteRendezvous(env, step_id),
+        shm_memory_manager_(shm_memory_manager) {}
+
+ protected:
+  void RecvFromRemoteAsync(const Rendezvous::ParsedKey& parsed,
+                           const Rendezvous::Args& recv_args,
+                           DoneCallback done) override {
+    CHECK(is_initialized());
+
+    string src_worker;
+    string src_rel_device;
+    if (!DeviceNameUtils::SplitDeviceName(parsed.src_device, &src_worker,
+                                          &src_rel_device)) {
+      Status s = errors::Internal(parsed.src_device,
+                                  " is invalid remote source device.");
+      done(s, Args(), recv_args, Tensor{}, false);
+      return;
+    }
+
+    WorkerSession* sess = session();
+    WorkerInterface* rwi = sess->worker_cache->CreateWorker(src_worker);
+    if (rwi == nullptr) {
+      Status s = errors::Internal("No worker known as ", src_worker);
+      done(s, Args(), recv_args, Tensor{}, false);
+      return;
+    }
+
+    Device* dst_device;
+    Status s = sess->device_mgr()->LookupDevice(parsed.dst_device, &dst_device);
+    if (!s.ok()) {
+      sess->worker_cache->ReleaseWorker(src_worker, rwi);
+      done(s, Args(), recv_args, Tensor{}, false);
+      return;
+    }
+
+    // Prepare a RecvTensor call that can handle being aborted.
+    ShmRecvTensorCall* call =
+        new ShmRecvTensorCall(rwi, dst_device, shm_memory_manager_, recv_args,
+                              step_id_, parsed.FullKey());
+
+    // Record "call" in active_ so that it can be aborted cleanly.
+    RegisterCall(call);
+
+    // Start "call".
+    Ref();
+    call->Start([this, call, src_worker, rwi, done]() {
+      // Removes "call" from active_. Prevent StartAbort().
+      DeregisterCall(call);
+      // If StartAbort was called prior to DeregisterCall, then the
+      // current status should be bad.
+      Status s = call->status();
+      done(s, Args(), call->recv_args(), call->tensor(), call->is_dead());
+      session()->worker_cache->ReleaseWorker(src_worker, rwi);
+      delete call;
+      Unref();
+    });
+  }
+
+ private:
+  ~ShmRemoteRendezvous() override {}
+
+  ShmMemoryManager* shm_memory_manager_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ShmRemoteRendezvous);
+};
+
+}  // namespace
+
+ShmRendezvousMgr::ShmRendezvousMgr(const WorkerEnv* env,
+                                   ShmMemoryManager* shm_memory_manager)
+    : BaseRendezvousMgr(env), shm_memory_manager_(shm_memory_manager) {}
+
+BaseRemoteRendezvous* ShmRendezvousMgr::Create(int64 step_id,
+                                               const WorkerEnv* worker_env) {
+  return new ShmRemoteRendezvous(worker_env, step_id, shm_memory_manager_);
+}
+
+}  // end namespace tensorflow
@@ -0,0 +1,277 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/contrib/shm/shm_ring_buffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/host_info.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+namespace {
+
+// Chunks and the data area are aligned to a cache line so that the chunk
+// headers written by different processes never share one.
+constexpr uint64 kAlignment = 64;
+constexpr uint64 kMagic = 0x7466736d72696e67ull;  // "tfsmring"
+
+enum ChunkState : uint64 {
+  kFree = 0,
+  kAllocated = 1,
+  kWritten = 2,
+  kReleased = 3,
+};
+
+// The state of a chunk is kept together with its sequence number, so that
+// the reader and the writer can only change the state of the chunk they
+// expect, even if the space has since been reused.
+uint64 ChunkTag(uint64 sequence, ChunkState state) {
+  return (sequence << 2) | state;
+}
+
+// Lives at the start of the mapping; the chunk area follows it.
+struct RegionHeader {
+  uint64 magic;
+  uint64 capacity;
+};
+
+uint64 RoundUp(uint64 n) { return (n + kAlignment - 1) & ~(kAlignment - 1); }
+
+// Bytes taken up in the ring by a chunk holding `length` payload bytes.
+uint64 ChunkSize(uint64 length) { return kAlignment + RoundUp(length); }
+
+Status ErrnoError(const string& context, const string& name) {
+  return errors::Internal(context, " ", name, ": ", strerror(errno));
+}
+
+}  // namespace
+
+struct ShmRingBuffer::ChunkHeader {
+  std::atomic<uint64> tag;  // See ChunkTag().
+  uint64 size;  // Total bytes taken by the chunk, header included.
+  // When the writer may reclaim the chunk if it has not been read, in
+  // microseconds of the writer's Env::NowMicros().
+  uint64 lease_deadline;
+};
+
+/* static */
+Status ShmRingBuffer::Create(const string& name, uint64 capacity,
+                             int64 lease_micros,
+                             std::unique_ptr<ShmRingBuffer>* out) {
+  if (capacity == 0 || capacity % kAlignment != 0) {
+    return errors::InvalidArgument("Shared memory capacity ", capacity,
+                                   " is not a positive multiple of ",
+                                   kAlignment);
+  }
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) return ErrnoError("shm_open", name);
+  const uint64 mapped_size = kAlignment + capacity;
+  if (ftruncate(fd, mapped_size) != 0) {
+    Status s = ErrnoError("ftruncate", name);
+    close(fd);
+    shm_unlink(name.c_str());
+    return s;
+  }
+  void* base =
+      mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    Status s = ErrnoError("mmap", name);
+    shm_unlink(name.c_str());
+    return s;
+  }
+  // ftruncate() zero-fills the region, so every chunk header starts out as
+  // kFree; publishing the magic number marks the region as initialized.
+  RegionHeader* header = static_cast<RegionHeader*>(base);
+  header->capacity = capacity;
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = kMagic;
+  out->reset(new ShmRingBuffer(name, true, static_cast<char*>(base), capacity,
+                               lease_micros));
+  return Status::OK();
+}
+
+/* static */
+Status ShmRingBuffer::Open(const string& name,
+                           std::unique_ptr<ShmRingBuffer>* out) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd < 0) return ErrnoError("shm_open", name);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    Status s = ErrnoError("fstat", name);
+    close(fd);
+    return s;
+  }
+  const uint64 mapped_size = st.st_size;
+  if (mapped_size <= kAlignment) {
+    close(fd);
+    return errors::DataLoss("Shared memory region ", name, " is too small");
+  }
+  void* base =
+      mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return ErrnoError("mmap", name);
+  const RegionHeader* header = static_cast<const RegionHeader*>(base);
+  if (header->magic != kMagic ||
+      header->capacity != mapped_size - kAlignment) {
+    munmap(base, mapped_size);
+    return errors::DataLoss("Shared memory region ", name,
+                            " is not a tensor ring buffer");
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  out->reset(new ShmRingBuffer(name, false, static_cast<char*>(base),
+                               mapped_size - kAlignment, 0));
+  return Status::OK();
+}
+
+ShmRingBuffer::ShmRingBuffer(const string& name, bool owner, char* base,
+                             uint64 capacity, int64 lease_micros)
+    : name_(name),
+      owner_(owner),
+      base_(base),
+      capacity_(capacity),
+      lease_micros_(lease_micros) {
+  static_assert(sizeof(ChunkHeader) <= kAlignment,
+                "ChunkHeader must fit in one alignment unit");
+}
+
+ShmRingBuffer::~ShmRingBuffer() {
+  munmap(base_, kAlignment + capacity_);
+  if (owner_) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+ShmRingBuffer::ChunkHeader* ShmRingBuffer::chunk(uint64 offset) const {
+  return reinterpret_cast<ChunkHeader*>(base_ + kAlignment + offset);
+}
+
+void ShmRingBuffer::ReclaimLocked() {
+  uint64 now = 0;
+  while (tail_ < head_) {
+    ChunkHeader* h = chunk(tail_ % capacity_);
+    uint64 tag = h->tag.load(std::memory_order_acquire);
+    if ((tag & 3) == kWritten) {
+      if (now == 0) now = Env::Default()->NowMicros();
+      if (now < h->lease_deadline) break;
+      // Takes the chunk back from its reader, unless it is just being
+      // released.
+      if (!h->tag.compare_exchange_strong(tag, ChunkTag(0, kFree),
+                                          std::memory_order_acq_rel)) {
+        continue;
+      }
+      VLOG(1) << "Reclaiming chunk " << (tag >> 2) << " of " << name_
+              << ", which was not read within " << lease_micros_ << "us";
+    } else if ((tag & 3) != kReleased) {
+      break;
+    }
+    h->tag.store(ChunkTag(0, kFree), std::memory_order_relaxed);
+    tail_ += h->size;
+  }
+}
+
+bool ShmRingBuffer::Allocate(uint64 length, uint64* offset, uint64* sequence,
+                             char** data) {
+  CHECK(owner_) << "Only the creator of " << name_ << " may write to it";
+  const uint64 size = ChunkSize(length);
+  if (size > capacity_) return false;
+
+  mutex_lock l(mu_);
+  ReclaimLocked();
+  uint64 pos = head_ % capacity_;
+  // Chunks never wrap around the end of the ring; the space left there is
+  // skipped over with a padding chunk.
+  const uint64 padding = (capacity_ - pos < size) ? capacity_ - pos : 0;
+  if (head_ + padding + size - tail_ > capacity_) return false;
+  if (padding > 0) {
+    ChunkHeader* h = chunk(pos);
+    h->size = padding;
+    h->tag.store(ChunkTag(0, kReleased), std::memory_order_release);
+    head_ += padding;
+    pos = 0;
+  }
+  ChunkHeader* h = chunk(pos);
+  h->size = size;
+  h->tag.store(ChunkTag(next_sequence_, kAllocated),
+               std::memory_order_release);
+  head_ += size;
+
+  *offset = pos;
+  *sequence = next_sequence_++;
+  *data = reinterpret_cast<char*>(h) + kAlignment;
+  return true;
+}
+
+void ShmRingBuffer::Commit(uint64 offset) {
+  ChunkHeader* h = chunk(offset);
+  h->lease_deadline = Env::Default()->NowMicros() + lease_micros_;
+  const uint64 sequence = h->tag.load(std::memory_order_relaxed) >> 2;
+  h->tag.store(ChunkTag(sequence, kWritten), std::memory_order_release);
+}
+
+Status ShmRingBuffer::Read(uint64 offset, uint64 length, uint64 sequence,
+                           char* dst) {
+  if (offset % kAlignment != 0 || offset >= capacity_ ||
+      ChunkSize(length) > capacity_ - offset) {
+    return errors::InvalidArgument("Chunk [", offset, ", +", length,
+                                   ") is out of bounds for ", name_);
+  }
+  ChunkHeader* h = chunk(offset);
+  uint64 tag = ChunkTag(sequence, kWritten);
+  if (h->tag.load(std::memory_order_acquire) != tag ||
+      h->size < ChunkSize(length)) {
+    return errors::DataLoss("Chunk ", sequence, " at offset ", offset, " of ",
+                            name_, " is not available");
+  }
+  memcpy(dst, reinterpret_cast<const char*>(h) + kAlignment, length);
+  // The writer may have reclaimed the chunk and overwritten it during the
+  // copy, in which case the tag has changed.
+  if (!h->tag.compare_exchange_strong(tag, ChunkTag(sequence, kReleased),
+                                      std::memory_order_acq_rel)) {
+    return errors::DataLoss("Chunk ", sequence, " at offset ", offset, " of ",
+                            name_, " was reclaimed while it was read");
+  }
+  return Status::OK();
+}
+
+string ShmHostKey() {
+  // POSIX shared memory objects live on the /dev/shm mount, so two processes
+  // can share them iff they run under the same kernel and mount namespace.
+  string boot_id;
+  char mnt_ns[64];
+  const ssize_t n = readlink("/proc/self/ns/mnt", mnt_ns, sizeof(mnt_ns));
+  if (n <= 0 || !ReadFileToString(Env::Default(),
+                                   "/proc/sys/kernel/random/boot_id", &boot_id)
+                     .ok()) {
+    return port::Hostname();
+  }
+  str_util::StripTrailingWhitespace(&boot_id);
+  return strings::StrCat(boot_id, "/", StringPiece(mnt_ns, n));
+}
+
+}  // namespace tensorflow
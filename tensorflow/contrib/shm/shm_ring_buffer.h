@@ -0,0 +1,106 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CONTRIB_SHM_SHM_RING_BUFFER_H_
+#define TENSORFLOW_CONTRIB_SHM_SHM_RING_BUFFER_H_
+
+#include <memory>
+
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// A ring buffer in POSIX shared memory, used to hand tensor contents from a
+// server process to clients running on the same host.
+//
+// The process that creates the region is its only writer. It carves chunks
+// off the head of the ring and publishes them by (offset, sequence). A reader
+// maps the same region, copies a chunk out and marks it released. The writer
+// reclaims released chunks lazily, in ring order, when it needs space.
+//
+// A chunk that is never released (e.g. because its reader died, or never
+// learned about it) stalls reclamation until its lease runs out: the writer
+// then reclaims it too, and a reader that comes late gets an error instead of
+// the contents. While the ring is full, Allocate() fails and callers are
+// expected to fall back to another transport.
+class ShmRingBuffer {
+ public:
+  // Creates a new region called `name` that can hold `capacity` bytes of
+  // chunks, which are reclaimed if they are not read within `lease_micros`
+  // of being committed. The region is unlinked when the returned object is
+  // destroyed.
+  static Status Create(const string& name, uint64 capacity,
+                       int64 lease_micros,
+                       std::unique_ptr<ShmRingBuffer>* out);
+
+  // Maps an existing region created by ShmRingBuffer::Create().
+  static Status Open(const string& name, std::unique_ptr<ShmRingBuffer>* out);
+
+  ~ShmRingBuffer();
+
+  const string& name() const { return name_; }
+  uint64 capacity() const { return capacity_; }
+
+  // Writer side. Reserves a chunk for `length` bytes and returns its location
+  // in `*offset` and `*sequence`, and a pointer to its payload in `*data`.
+  // Returns false if the ring does not have enough free space.
+  //
+  // The chunk becomes visible to readers once Commit(*offset) is called.
+  bool Allocate(uint64 length, uint64* offset, uint64* sequence, char** data);
+  void Commit(uint64 offset);
+
+  // Reader side. Copies the `length` bytes of the chunk at (offset, sequence)
+  // into `dst` and releases the chunk back to the writer. Returns DataLoss if
+  // the chunk was already read or reclaimed, in which case `dst` may have
+  // been partially overwritten.
+  Status Read(uint64 offset, uint64 length, uint64 sequence, char* dst);
+
+ private:
+  struct ChunkHeader;
+
+  ShmRingBuffer(const string& name, bool owner, char* base, uint64 capacity,
+                int64 lease_micros);
+
+  ChunkHeader* chunk(uint64 offset) const;
+  void ReclaimLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const string name_;
+  const bool owner_;
+  char* const base_;  // Start of the mapping.
+  const uint64 capacity_;
+  const int64 lease_micros_;
+
+  // Writer state. Positions grow monotonically and are taken modulo
+  // capacity_; the ring holds the chunks in [tail_, head_).
+  mutex mu_;
+  uint64 head_ GUARDED_BY(mu_) = 0;
+  uint64 tail_ GUARDED_BY(mu_) = 0;
+  uint64 next_sequence_ GUARDED_BY(mu_) = 1;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ShmRingBuffer);
+};
+
+// Returns a string identifying the shared memory namespace this process
+// lives in. Two processes that return the same key can exchange data through
+// ShmRingBuffer.
+string ShmHostKey();
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CONTRIB_SHM_SHM_RING_BUFFER_H_
@@ -0,0 +1,203 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/contrib/shm/shm_ring_buffer.h"
+
+#include <unistd.h>
+
+#include <cstring>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+// Long enough for no chunk to expire unless a test waits for it.
+constexpr int64 kLeaseMicros = 60 * 1000 * 1000;
+
+string UniqueName() {
+  static int counter = 0;
+  return strings::StrCat("/tf_shm_test_", getpid(), "_", counter++);
+}
+
+// Writes `contents` into a new chunk of `writer`, returning its location.
+bool Write(ShmRingBuffer* writer, const string& contents, uint64* offset,
+           uint64* sequence) {
+  char* data;
+  if (!writer->Allocate(contents.size(), offset, sequence, &data)) {
+    return false;
+  }
+  memcpy(data, contents.data(), contents.size());
+  writer->Commit(*offset);
+  return true;
+}
+
+Status Read(ShmRingBuffer* reader, uint64 offset, uint64 sequence,
+            uint64 length, string* contents) {
+  contents->resize(length);
+  return reader->Read(offset, length, sequence, &(*contents)[0]);
+}
+
+TEST(ShmRingBufferTest, RoundTrip) {
+  std::unique_ptr<ShmRingBuffer> writer;
+  TF_ASSERT_OK(
+      ShmRingBuffer::Create(UniqueName(), 4096, kLeaseMicros, &writer));
+  std::unique_ptr<ShmRingBuffer> reader;
+  TF_ASSERT_OK(ShmRingBuffer::Open(writer->name(), &reader));
+  EXPECT_EQ(4096, reader->capacity());
+
+  uint64 offset, sequence;
+  ASSERT_TRUE(Write(writer.get(), "hello, world", &offset, &sequence));
+  string contents;
+  TF_EXPECT_OK(Read(reader.get(), offset, sequence, 12, &contents));
+  EXPECT_EQ("hello, world", contents);
+
+  // A chunk can only be read once.
+  EXPECT_TRUE(errors::IsDataLoss(
+      Read(reader.get(), offset, sequence, 12, &contents)));
+}
+
+TEST(ShmRingBufferTest, RejectsBadLocations) {
+  std::unique_ptr<ShmRingBuffer> writer;
+  TF_ASSERT_OK(
+      ShmRingBuffer::Create(UniqueName(), 4096, kLeaseMicros, &writer));
+  std::unique_ptr<ShmRingBuffer> reader;
+  TF_ASSERT_OK(ShmRingBuffer::Open(writer->name(), &reader));
+
+  uint64 offset, sequence;
+  ASSERT_TRUE(Write(writer.get(), "abc", &offset, &sequence));
+  string contents;
+  EXPECT_TRUE(errors::IsDataLoss(
+      Read(reader.get(), offset, sequence + 1, 3, &contents)));
+  EXPECT_TRUE(errors::IsDataLoss(
+      Read(reader.get(), offset, sequence, 1024, &contents)));
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      Read(reader.get(), offset + 1, sequence, 3, &contents)));
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      Read(reader.get(), 1 << 20, sequence, 3, &contents)));
+  TF_EXPECT_OK(Read(reader.get(), offset, sequence, 3, &contents));
+  EXPECT_EQ("abc", contents);
+}
+
+TEST(ShmRingBufferTest, FullRingIsReclaimedAfterRead) {
+  std::unique_ptr<ShmRingBuffer> writer;
+  TF_ASSERT_OK(
+      ShmRingBuffer::Create(UniqueName(), 1024, kLeaseMicros, &writer));
+  std::unique_ptr<ShmRingBuffer> reader;
+  TF_ASSERT_OK(ShmRingBuffer::Open(writer->name(), &reader));
+
+  // Each 192-byte payload takes 256 bytes of ring with its header.
+  const string payload(192, 'x');
+  uint64 offsets[4], sequences[4];
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(Write(writer.get(), payload, &offsets[i], &sequences[i]));
+  }
+  uint64 offset, sequence;
+  EXPECT_FALSE(Write(writer.get(), payload, &offset, &sequence));
+
+  // Releasing a chunk out of order does not free space...
+  string contents;
+  TF_EXPECT_OK(Read(reader.get(), offsets[1], sequences[1], 192, &contents));
+  EXPECT_FALSE(Write(writer.get(), payload, &offset, &sequence));
+
+  // ...until every chunk before it has been released too.
+  TF_EXPECT_OK(Read(reader.get(), offsets[0], sequences[0], 192, &contents));
+  ASSERT_TRUE(Write(writer.get(), payload, &offset, &sequence));
+  ASSERT_TRUE(Write(writer.get(), payload, &offset, &sequence));
+  EXPECT_FALSE(Write(writer.get(), payload, &offset, &sequence));
+}
+
+TEST(ShmRingBufferTest, AbandonedChunksAreReclaimedAfterTheirLease) {
+  std::unique_ptr<ShmRingBuffer> writer;
+  TF_ASSERT_OK(ShmRingBuffer::Create(UniqueName(), 1024, /*lease_micros=*/1000,
+                                     &writer));
+  std::unique_ptr<ShmRingBuffer> reader;
+  TF_ASSERT_OK(ShmRingBuffer::Open(writer->name(), &reader));
+
+  // Chunk 0 is never read, and pins the rest of the ring until it expires.
+  const string payload(192, 'x');
+  uint64 offsets[4], sequences[4];
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(Write(writer.get(), payload, &offsets[i], &sequences[i]));
+  }
+  string contents;
+  for (int i = 1; i < 4; ++i) {
+    TF_EXPECT_OK(Read(reader.get(), offsets[i], sequences[i], 192, &contents));
+  }
+  Env::Default()->SleepForMicroseconds(2000);
+
+  // The ring recovers completely, and the late reader gets an error.
+  uint64 offset, sequence;
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(Write(writer.get(), string(192, 'a' + i), &offset, &sequence));
+    TF_EXPECT_OK(Read(reader.get(), offset, sequence, 192, &contents));
+    EXPECT_EQ(string(192, 'a' + i), contents);
+  }
+  EXPECT_TRUE(errors::IsDataLoss(
+      Read(reader.get(), offsets[0], sequences[0], 192, &contents)));
+}
+
+TEST(ShmRingBufferTest, ChunksDoNotStraddleTheEnd) {
+  std::unique_ptr<ShmRingBuffer> writer;
+  TF_ASSERT_OK(
+      ShmRingBuffer::Create(UniqueName(), 1024, kLeaseMicros, &writer));
+  std::unique_ptr<ShmRingBuffer> reader;
+  TF_ASSERT_OK(ShmRingBuffer::Open(writer->name(), &reader));
+
+  string contents;
+  uint64 offset, sequence;
+  // Three 320-byte chunks leave 64 bytes at the end of the ring.
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(Write(writer.get(), string(256, 'a' + i), &offset, &sequence));
+    TF_EXPECT_OK(Read(reader.get(), offset, sequence, 256, &contents));
+  }
+  ASSERT_TRUE(Write(writer.get(), string(256, 'z'), &offset, &sequence));
+  EXPECT_EQ(0, offset);
+  TF_EXPECT_OK(Read(reader.get(), offset, sequence, 256, &contents));
+  EXPECT_EQ(string(256, 'z'), contents);
+}
+
+TEST(ShmRingBufferTest, OversizedChunk) {
+  std::unique_ptr<ShmRingBuffer> writer;
+  TF_ASSERT_OK(
+      ShmRingBuffer::Create(UniqueName(), 1024, kLeaseMicros, &writer));
+  uint64 offset, sequence;
+  EXPECT_FALSE(Write(writer.get(), string(1024, 'x'), &offset, &sequence));
+}
+
+TEST(ShmRingBufferTest, InvalidRegions) {
+  std::unique_ptr<ShmRingBuffer> ring;
+  EXPECT_FALSE(
+      ShmRingBuffer::Create(UniqueName(), 1000, kLeaseMicros, &ring).ok());
+  EXPECT_FALSE(ShmRingBuffer::Open(UniqueName(), &ring).ok());
+
+  // The region is removed when its creator goes away.
+  const string name = UniqueName();
+  TF_ASSERT_OK(ShmRingBuffer::Create(name, 1024, kLeaseMicros, &ring));
+  ring.reset();
+  EXPECT_FALSE(ShmRingBuffer::Open(name, &ring).ok());
+}
+
+TEST(ShmRingBufferTest, HostKeyIsStable) {
+  EXPECT_FALSE(ShmHostKey().empty());
+  EXPECT_EQ(ShmHostKey(), ShmHostKey());
+}
+
+}  // namespace
+}  // namespace tensorflow
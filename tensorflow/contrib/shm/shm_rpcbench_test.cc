@@ -0,0 +1,163 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Compares tensor transfers between two tasks on the same host through
+// loopback gRPC ("grpc") and through shared memory ("grpc+shm").
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/distributed_runtime/server_lib.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/protobuf/cluster.pb.h"
+#include "tensorflow/core/protobuf/tensorflow_server.pb.h"
+#include "tensorflow/core/public/session.h"
+
+namespace tensorflow {
+namespace {
+
+const char* const kPsDevice = "/job:ps/replica:0/task:0/device:CPU:0";
+const char* const kWorkerDevice = "/job:worker/replica:0/task:0/device:CPU:0";
+
+// A "ps" and a "worker" task in this process, talking over `protocol`.
+struct Cluster {
+  std::vector<std::unique_ptr<ServerInterface>> servers;
+  string target;
+
+  explicit Cluster(const string& protocol) {
+    const int ps_port = testing::PickUnusedPortOrDie();
+    const int worker_port = testing::PickUnusedPortOrDie();
+    ClusterDef cluster_def;
+    auto* ps_job = cluster_def.add_job();
+    ps_job->set_name("ps");
+    (*ps_job->mutable_tasks())[0] = strings::StrCat("localhost:", ps_port);
+    auto* worker_job = cluster_def.add_job();
+    worker_job->set_name("worker");
+    (*worker_job->mutable_tasks())[0] =
+        strings::StrCat("localhost:", worker_port);
+
+    for (const string& job : {"ps", "worker"}) {
+      ServerDef server_def;
+      server_def.set_protocol(protocol);
+      server_def.set_job_name(job);
+      server_def.set_task_index(0);
+      *server_def.mutable_cluster() = cluster_def;
+      auto* config = server_def.mutable_default_session_config();
+      (*config->mutable_device_count())["CPU"] = 1;
+      std::unique_ptr<ServerInterface> server;
+      TF_CHECK_OK(NewServer(server_def, &server));
+      TF_CHECK_OK(server->Start());
+      servers.push_back(std::move(server));
+    }
+    target = strings::StrCat("grpc://localhost:", worker_port);
+  }
+};
+
+const Cluster* GetCluster(const string& protocol) {
+  static std::map<string, Cluster*>* clusters = new std::map<string, Cluster*>;
+  Cluster*& cluster = (*clusters)[protocol];
+  if (cluster == nullptr) cluster = new Cluster(protocol);
+  return cluster;
+}
+
+// Creates a session in which running "y" moves a `num_floats` variable from
+// the ps task to the worker task.
+std::unique_ptr<Session> CreateSession(const string& protocol,
+                                       int64 num_floats) {
+  using namespace ::tensorflow::ops;  // NOLINT(build/namespaces)
+  Scope s = Scope::NewRootScope();
+  Output var = Variable(s.WithOpName("var").WithDevice(kPsDevice),
+                        {num_floats}, DT_FLOAT);
+  Assign(s.WithOpName("init").WithDevice(kPsDevice), var,
+         Fill(s.WithDevice(kPsDevice), {num_floats}, 1.0f));
+  Identity(s.WithOpName("y").WithDevice(kWorkerDevice), var);
+  GraphDef def;
+  TF_CHECK_OK(s.ToGraphDef(&def));
+
+  SessionOptions options;
+  options.target = GetCluster(protocol)->target;
+  std::unique_ptr<Session> session(NewSession(options));
+  TF_CHECK_OK(session->Create(def));
+  TF_CHECK_OK(session->Run({}, {}, {"init"}, nullptr));
+  return session;
+}
+
+TEST(ShmRpcTest, TransfersMatchGrpc) {
+  for (int64 num_floats : {1, 1024, 1 << 20}) {
+    std::vector<Tensor> outputs;
+    std::unique_ptr<Session> session = CreateSession("grpc+shm", num_floats);
+    // Run more than once, so the ring is reused after the first step.
+    for (int i = 0; i < 3; ++i) {
+      outputs.clear();
+      TF_ASSERT_OK(session->Run({}, {"y"}, {}, &outputs));
+      ASSERT_EQ(1, outputs.size());
+      test::ExpectTensorEqual<float>(
+          test::AsTensor<float>(std::vector<float>(num_floats, 1.0f)),
+          outputs[0]);
+    }
+    TF_ASSERT_OK(session->Close());
+  }
+}
+
+void BM_Transfer(int iters, const string& protocol, int64 num_floats) {
+  testing::StopTiming();
+  std::unique_ptr<Session> session = CreateSession(protocol, num_floats);
+  // Warm up the channels (and the peer ring mapping for "grpc+shm").
+  for (int i = 0; i < 3; ++i) {
+    TF_CHECK_OK(session->Run({}, {}, {"y"}, nullptr));
+  }
+  testing::BytesProcessed(static_cast<int64>(iters) * num_floats *
+                          sizeof(float));
+  testing::SetLabel(protocol);
+  testing::StartTiming();
+  for (int i = 0; i < iters; ++i) {
+    TF_CHECK_OK(session->Run({}, {}, {"y"}, nullptr));
+  }
+  testing::StopTiming();
+  TF_CHECK_OK(session->Close());
+}
+
+void BM_Grpc(int iters, int num_floats) {
+  BM_Transfer(iters, "grpc", num_floats);
+}
+void BM_Shm(int iters, int num_floats) {
+  BM_Transfer(iters, "grpc+shm", num_floats);
+}
+
+// From 4KB (latency bound) to 64MB (bandwidth bound).
+BENCHMARK(BM_Grpc)
+    ->Arg(1 << 10)
+    ->Arg(1 << 14)
+    ->Arg(1 << 18)
+    ->Arg(1 << 22)
+    ->Arg(1 << 24);
+BENCHMARK(BM_Shm)
+    ->Arg(1 << 10)
+    ->Arg(1 << 14)
+    ->Arg(1 << 18)
+    ->Arg(1 << 22)
+    ->Arg(1 << 24);
+
+}  // namespace
+}  // namespace tensorflow
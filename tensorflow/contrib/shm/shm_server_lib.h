@@ -0,0 +1,45 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CONTRIB_SHM_SHM_SERVER_LIB_H_
+#define TENSORFLOW_CONTRIB_SHM_SHM_SERVER_LIB_H_
+
+#include "tensorflow/contrib/shm/shm_memory_manager.h"
+#include "tensorflow/core/distributed_runtime/rpc/grpc_server_lib.h"
+
+namespace tensorflow {
+
+// A GrpcServer that exchanges tensor contents with co-located tasks through
+// shared memory. Selected with the "grpc+shm" protocol.
+class ShmServer : public GrpcServer {
+ protected:
+  ShmServer(const ServerDef& server_def, Env* env);
+
+ public:
+  static Status Create(const ServerDef& server_def, Env* env,
+                       std::unique_ptr<ServerInterface>* out_server);
+
+  ~ShmServer() override;
+
+ protected:
+  Status Init();
+
+ private:
+  std::unique_ptr<ShmMemoryManager> shm_memory_manager_;
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CONTRIB_SHM_SHM_SERVER_LIB_H_
@@ -0,0 +1,137 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/contrib/shm/shm_worker.h"
+
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/distributed_runtime/rendezvous_mgr_interface.h"
+#include "tensorflow/core/distributed_runtime/rpc/grpc_tensor_coding.h"
+#include "tensorflow/core/distributed_runtime/worker_env.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/tracing.h"
+#include "tensorflow/core/protobuf/worker.pb.h"
+
+namespace tensorflow {
+
+ShmWorker::ShmWorker(WorkerEnv* worker_env,
+                     ShmMemoryManager* shm_memory_manager)
+    : GrpcWorker(worker_env),
+      shm_memory_manager_(shm_memory_manager),
+      recv_tensor_recent_request_ids_(100000) {}
+
+void ShmWorker::GrpcRecvTensorAsync(CallOptions* opts,
+                                    const RecvTensorRequest* request,
+                                    ::grpc::ByteBuffer* response,
+                                    StatusCallback done) {
+  if (!request->dma_ok() ||
+      !shm_memory_manager_->IsColocated(request->transport_options())) {
+    GrpcWorker::GrpcRecvTensorAsync(opts, request, response, std::move(done));
+    return;
+  }
+
+  Status s = recv_tensor_recent_request_ids_.TrackUnique(
+      request->request_id(), "RecvTensor (ShmWorker)", *request);
+  if (!s.ok()) {
+    done(s);
+    return;
+  }
+
+  const int64 step_id = request->step_id();
+  const string& key = request->rendezvous_key();
+  TRACEPRINTF("RecvTensor: %lld %s", step_id, key.c_str());
+  Rendezvous::ParsedKey parsed;
+  s = Rendezvous::ParseKey(key, &parsed);
+  Device* src_dev = nullptr;
+  if (s.ok()) {
+    s = PrepareRecvTensor(parsed, &src_dev);
+  }
+  if (!s.ok()) {
+    done(s);
+    return;
+  }
+
+  // Request the tensor associated with the rendezvous key. Any time
+  // while waiting for the tensor to be produced, up until the start
+  // of execution of the callback lambda body below, an RPC
+  // cancellation should abort the rendezvous.
+  opts->SetCancelCallback([this, step_id]() { AbortStep(step_id); });
+  env_->rendezvous_mgr->RecvLocalAsync(
+      step_id, parsed,
+      [this, opts, response, done, src_dev, request](
+          const Status& status, const Rendezvous::Args& send_args,
+          const Rendezvous::Args&, const Tensor& val, const bool is_dead) {
+        opts->ClearCancelCallback();
+        if (!status.ok()) {
+          done(status);
+          return;
+        }
+        const bool on_host = (src_dev->tensorflow_gpu_device_info() ==
+                              nullptr) ||
+                             send_args.alloc_attrs.on_host();
+        if (on_host) {
+          EncodeTensor(is_dead, val, response);
+          done(Status::OK());
+          return;
+        }
+        // "val" is on an accelerator device. Uses the device_context to
+        // fill a copy on host, which is then sent like any host tensor.
+        DeviceContext* send_dev_context = send_args.device_context;
+        AllocatorAttributes alloc_attrs;
+        alloc_attrs.set_gpu_compatible(true);
+        alloc_attrs.set_on_host(true);
+        Allocator* alloc = src_dev->GetAllocator(alloc_attrs);
+        Tensor* copy = new Tensor(alloc, val.dtype(), val.shape());
+        CHECK(send_dev_context)
+            << "send dev name: " << src_dev->name()
+            << " gpu_info: " << src_dev->tensorflow_gpu_device_info();
+        StatusCallback copy_ready = [this, response, done, copy,
+                                     is_dead](const Status& s) {
+          if (s.ok()) {
+            EncodeTensor(is_dead, *copy, response);
+          }
+          done(s);
+          delete copy;
+        };
+        send_dev_context->CopyDeviceTensorToCPU(
+            &val, request->rendezvous_key(), src_dev, copy, copy_ready);
+      });
+}
+
+void ShmWorker::EncodeTensor(bool is_dead, const Tensor& val,
+                             ::grpc::ByteBuffer* response) {
+  // Shared memory is only worth it for tensors that are big enough to
+  // amortize the extra round through the ring, and can only carry tensors
+  // whose buffers can be copied as raw bytes.
+  if (!is_dead && DMAHelper::CanUseDMA(&val) &&
+      val.TotalBytes() >= ShmMemoryManager::kMinTensorBytes) {
+    RecvTensorResponse proto;
+    proto.set_send_start_micros(Env::Default()->NowMicros());
+    TensorProto* tensor_proto = proto.mutable_tensor();
+    tensor_proto->set_dtype(val.dtype());
+    val.shape().AsProto(tensor_proto->mutable_tensor_shape());
+    if (shm_memory_manager_->TransportOptionsFromTensor(
+            val, proto.mutable_transport_options())) {
+      grpc::EncodeRecvTensorResponseToByteBuffer(proto, response);
+      return;
+    }
+  }
+  grpc::EncodeTensorToByteBuffer(is_dead, val, response);
+}
+
+}  // namespace tensorflow
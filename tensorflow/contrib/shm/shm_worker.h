@@ -0,0 +1,50 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CONTRIB_SHM_SHM_WORKER_H_
+#define TENSORFLOW_CONTRIB_SHM_SHM_WORKER_H_
+
+#include "tensorflow/contrib/shm/shm_memory_manager.h"
+
+#include "tensorflow/core/distributed_runtime/recent_request_ids.h"
+#include "tensorflow/core/distributed_runtime/rpc/grpc_worker_service.h"
+
+namespace tensorflow {
+
+class ShmWorker : public GrpcWorker {
+ public:
+  ShmWorker(WorkerEnv* env, ShmMemoryManager* shm_memory_manager);
+
+  // Serve the RecvTensorRequest of a co-located client by writing the tensor
+  // content into shared memory and returning only its location over gRPC.
+  // Requests from other hosts, and tensors that are small or not memcpy-able,
+  // are served in-band like GrpcWorker does.
+  void GrpcRecvTensorAsync(CallOptions* opts, const RecvTensorRequest* request,
+                           ::grpc::ByteBuffer* response,
+                           StatusCallback done) override;
+
+ private:
+  // Encodes the host-memory tensor `val` into `response`, out-of-band if
+  // possible.
+  void EncodeTensor(bool is_dead, const Tensor& val,
+                    ::grpc::ByteBuffer* response);
+
+  ShmMemoryManager* shm_memory_manager_;  // Not owned
+  RecentRequestIds recv_tensor_recent_request_ids_;
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CONTRIB_SHM_SHM_WORKER_H_
@@ -0,0 +1,201 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Utility that converts a text vocabulary file into a table file that the
+// MemmappedHashTable op maps into memory instead of parsing it.
+//
+//  tensorflow/contrib/util/build_memmapped_lookup_table
+//        --input=vocab.txt --output=vocab.table
+//
+// Parameters:
+// input - name of the text file. Lines are read the same way as
+// InitializeTableFromTextFile (and tf.contrib.lookup.index_table_from_file)
+// read them.
+// output - name of the table file to write.
+// key_dtype, value_dtype - types of the table: keys are int64 or string, and
+// values are int64, float, double or string.
+// key_index, value_index - column of the line the key and value come from. -2
+// means the whole line, -1 the line number.
+// delimiter - delimiter of the columns of a line.
+
+#include <vector>
+
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/kernels/initializable_lookup_table.h"
+#include "tensorflow/core/kernels/lookup_util.h"
+#include "tensorflow/core/kernels/memmapped_lookup_table.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/command_line_flags.h"
+
+namespace tensorflow {
+namespace {
+
+// Collects the entries that InitializeTableFromTextFile inserts into a
+// MemmappedTableBuilder.
+template <class K, class V>
+class TableBuilderAdapter : public lookup::InitializableLookupTable {
+ public:
+  size_t size() const override { return builder_.size(); }
+
+  Status ExportValues(OpKernelContext* context) override {
+    return errors::Unimplemented("TableBuilderAdapter can't be exported");
+  }
+
+  DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
+
+  DataType value_dtype() const override { return DataTypeToEnum<V>::v(); }
+
+  Status Write(const string& filename) {
+    return builder_.Write(Env::Default(), filename);
+  }
+
+ protected:
+  Status DoPrepare(size_t unused) override { return Status::OK(); }
+
+  Status DoInsert(const Tensor& keys, const Tensor& values) override {
+    const auto key_values = keys.flat<K>();
+    const auto value_values = values.flat<V>();
+    for (int64 i = 0; i < key_values.size(); ++i) {
+      builder_.Add(key_values(i), value_values(i));
+    }
+    return Status::OK();
+  }
+
+  Status DoFind(const Tensor& keys, Tensor* values,
+                const Tensor& default_value) override {
+    return errors::Unimplemented("TableBuilderAdapter can't be looked up");
+  }
+
+ private:
+  lookup::MemmappedTableBuilder<K, V> builder_;
+};
+
+template <class K, class V>
+Status BuildTable(const string& input, const string& output, char delimiter,
+                  int32 key_index, int32 value_index) {
+  TableBuilderAdapter<K, V>* table = new TableBuilderAdapter<K, V>;
+  core::ScopedUnref unref(table);
+  TF_RETURN_IF_ERROR(lookup::InitializeTableFromTextFile(
+      input, /*vocab_size=*/-1, delimiter, key_index, value_index,
+      Env::Default(), table));
+  LOG(INFO) << "Writing " << table->size() << " entries to " << output;
+  return table->Write(output);
+}
+
+template <class K>
+Status BuildTableWithKeyType(const string& input, const string& output,
+                             DataType value_dtype, char delimiter,
+                             int32 key_index, int32 value_index) {
+  switch (value_dtype) {
+    case DT_INT64:
+      return BuildTable<K, int64>(input, output, delimiter, key_index,
+                                  value_index);
+    case DT_FLOAT:
+      return BuildTable<K, float>(input, output, delimiter, key_index,
+                                  value_index);
+    case DT_DOUBLE:
+      return BuildTable<K, double>(input, output, delimiter, key_index,
+                                   value_index);
+    case DT_STRING:
+      return BuildTable<K, string>(input, output, delimiter, key_index,
+                                   value_index);
+    default:
+      return errors::InvalidArgument("Unsupported value_dtype ",
+                                     DataTypeString(value_dtype));
+  }
+}
+
+int ParseFlagsAndBuildTable(int argc, char* argv[]) {
+  string input = "";
+  string output = "";
+  string key_dtype_name = "string";
+  string value_dtype_name = "int64";
+  int32 key_index = -2;
+  int32 value_index = -1;
+  string delimiter = "\t";
+  std::vector<Flag> flag_list = {
+      Flag("input", &input, "input text file"),
+      Flag("output", &output, "output table file"),
+      Flag("key_dtype", &key_dtype_name, "type of the keys"),
+      Flag("value_dtype", &value_dtype_name, "type of the values"),
+      Flag("key_index", &key_index,
+           "column of the keys, -2 for the whole line, -1 for the line number"),
+      Flag("value_index", &value_index,
+           "column of the values, -2 for the whole line, -1 for the line "
+           "number"),
+      Flag("delimiter", &delimiter, "delimiter of the columns of a line"),
+  };
+  string usage = Flags::Usage(argv[0], flag_list);
+  const bool parse_result = Flags::Parse(&argc, argv, flag_list);
+  // We need to call this to set up global state for TensorFlow.
+  port::InitMain(usage.c_str(), &argc, &argv);
+  if (!parse_result) {
+    LOG(ERROR) << "\n" << usage;
+    return -1;
+  }
+  if (argc > 1) {
+    LOG(ERROR) << "Unknown argument " << argv[1] << "\n" << usage;
+    return -1;
+  }
+  if (input.empty()) {
+    LOG(ERROR) << "input can't be empty";
+    return -1;
+  }
+  if (output.empty()) {
+    LOG(ERROR) << "output can't be empty";
+    return -1;
+  }
+  if (delimiter.size() != 1) {
+    LOG(ERROR) << "delimiter must be a single character";
+    return -1;
+  }
+  DataType key_dtype;
+  DataType value_dtype;
+  if (!DataTypeFromString(key_dtype_name, &key_dtype) ||
+      !DataTypeFromString(value_dtype_name, &value_dtype)) {
+    LOG(ERROR) << "Unknown key_dtype or value_dtype\n" << usage;
+    return -1;
+  }
+  Status result;
+  switch (key_dtype) {
+    case DT_INT64:
+      result = BuildTableWithKeyType<int64>(input, output, value_dtype,
+                                            delimiter[0], key_index,
+                                            value_index);
+      break;
+    case DT_STRING:
+      result = BuildTableWithKeyType<string>(input, output, value_dtype,
+                                             delimiter[0], key_index,
+                                             value_index);
+      break;
+    default:
+      result = errors::InvalidArgument("Unsupported key_dtype ",
+                                       DataTypeString(key_dtype));
+  }
+  if (!result.ok()) {
+    LOG(ERROR) << "Building the table failed " << result.error_message();
+    return -1;
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace tensorflow
+
+int main(int argc, char* argv[]) {
+  return tensorflow::ParseFlagsAndBuildTable(argc, argv);
+}
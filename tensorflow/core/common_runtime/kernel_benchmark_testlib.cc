@@ -19,6 +19,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/device.h"
 #include "tensorflow/core/common_runtime/device_factory.h"
 #include "tensorflow/core/common_runtime/local_device.h"
+#include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/op_segment.h"
@@ -43,7 +44,7 @@ namespace test {
 // TODO(hongm): Convert `g` and `init` to using std::unique_ptr.
 Benchmark::Benchmark(const string& device, Graph* g,
                      const SessionOptions* options, Graph* init,
-                     Rendezvous* rendez) {
+                     Rendezvous* rendez, bool use_inter_op_threads) {
   SessionOptions default_options;
   if (!options) {
     options = &default_options;
@@ -58,8 +59,10 @@ Benchmark::Benchmark(const string& device, Graph* g,
       DeviceFactory::NewDevice(t, *options, "/job:localhost/replica:0/task:0");
   CHECK(device_) << "Could not create a " << device << " device";
 
-  pool_ = new thread::ThreadPool(options->env, "blocking",
-                                 port::NumSchedulableCPUs());
+  pool_ = new thread::ThreadPool(
+      options->env, "blocking",
+      use_inter_op_threads ? NumInterOpThreadsFromSessionOptions(*options)
+                           : port::NumSchedulableCPUs());
 
   auto runner = [this](std::function<void()> closure) {
     pool_->Schedule(closure);
@@ -36,10 +36,13 @@ namespace test {
 class Benchmark {
  public:
   // "device" must be either "cpu" or "gpu".  Takes ownership of "g",
-  // "init", and one reference on "rendez" (if not null).
+  // "init", and one reference on "rendez" (if not null). The executor
+  // schedules nodes on one thread per CPU, or on as many threads as the
+  // inter-op pool of a session created with "options" if
+  // "use_inter_op_threads" is true.
   Benchmark(const string& device, Graph* g,
             const SessionOptions* options = nullptr, Graph* init = nullptr,
-            Rendezvous* rendez = nullptr);
+            Rendezvous* rendez = nullptr, bool use_inter_op_threads = false);
   ~Benchmark();
 
   // Executes the graph for "iters" times.
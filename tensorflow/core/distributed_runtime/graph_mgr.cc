@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/graph_mgr.h"
 
+#include <algorithm>
 #include <vector>
 
 #include "tensorflow/core/common_runtime/constant_folding.h"
@@ -34,6 +35,7 @@ limitations under the License.
 #include "tensorflow/core/framework/node_def.pb.h"
 #include "tensorflow/core/framework/node_def_util.h"
 #include "tensorflow/core/framework/versions.pb.h"
+#include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/graph/graph.h"
 #include "tensorflow/core/graph/graph_constructor.h"
 #include "tensorflow/core/graph/graph_partition.h"
@@ -45,10 +47,42 @@ limitations under the License.
 #include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/protobuf/worker.pb.h"
+#include "tensorflow/core/util/device_name_utils.h"
 #include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
+namespace {
+
+// Sets "_recv_priority" on the Recv nodes of "g" that receive from other
+// processes. It is the length of the longest path from the Recv node to the
+// sink: a static estimate of how critical the tensor is, since the longer the
+// chain of work that depends on it, the sooner it is needed.
+void SetRecvPriorities(Graph* g) {
+  std::vector<Node*> order;
+  GetPostOrder(*g, &order);
+  // Back edges of loops point to nodes that come later in "order", and
+  // count as leading nowhere.
+  std::vector<int64> height(g->num_node_ids(), 0);
+  for (Node* n : order) {
+    int64 h = 0;
+    for (const Edge* e : n->out_edges()) {
+      h = std::max(h, height[e->dst()->id()] + 1);
+    }
+    height[n->id()] = h;
+    if (!n->IsRecv()) continue;
+    string send_device;
+    string recv_device;
+    if (GetNodeAttr(n->attrs(), "send_device", &send_device).ok() &&
+        GetNodeAttr(n->attrs(), "recv_device", &recv_device).ok() &&
+        !DeviceNameUtils::IsSameAddressSpace(send_device, recv_device)) {
+      n->AddAttr("_recv_priority", h);
+    }
+  }
+}
+
+}  // namespace
+
 GraphMgr::GraphMgr(const WorkerEnv* worker_env, DeviceMgr* device_mgr)
     : worker_env_(worker_env), device_mgr_(device_mgr), table_(5) {
   // The default value of sync_on_finish will be flipped soon and this
@@ -266,6 +300,7 @@ Status GraphMgr::InitItem(const string& session, const GraphDef& gdef,
     TF_RETURN_IF_ERROR(
         EnsureMemoryTypes(DeviceType(unit->device->device_type()),
                           unit->device->name(), subgraph.get()));
+    SetRecvPriorities(subgraph.get());
     unit->graph = subgraph.get();
     unit->build_cost_model = graph_options.build_cost_model();
     if (unit->build_cost_model > 0) {
@@ -0,0 +1,78 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/recv_tensor_scheduler.h"
+
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+RecvTensorScheduler::RecvTensorScheduler(int64 max_bytes_in_flight,
+                                         int64 min_scheduled_bytes)
+    : max_bytes_in_flight_(max_bytes_in_flight),
+      min_scheduled_bytes_(min_scheduled_bytes) {}
+
+void RecvTensorScheduler::Schedule(int64 priority, int64 num_bytes,
+                                   std::function<void()> send) {
+  if (IsSmall(num_bytes)) {
+    send();
+    return;
+  }
+  std::vector<std::function<void()>> ready;
+  {
+    mutex_lock l(mu_);
+    waiting_.push({priority, next_sequence_++, num_bytes, std::move(send)});
+    TakeReadyLocked(&ready);
+  }
+  for (auto& send_ready : ready) {
+    send_ready();
+  }
+}
+
+void RecvTensorScheduler::Release(int64 num_bytes) {
+  DCHECK(!IsSmall(num_bytes));
+  std::vector<std::function<void()>> ready;
+  {
+    mutex_lock l(mu_);
+    bytes_in_flight_ -= num_bytes;
+    DCHECK_GE(bytes_in_flight_, 0);
+    TakeReadyLocked(&ready);
+  }
+  for (auto& send_ready : ready) {
+    send_ready();
+  }
+}
+
+int64 RecvTensorScheduler::num_waiting() const {
+  mutex_lock l(mu_);
+  return waiting_.size();
+}
+
+void RecvTensorScheduler::TakeReadyLocked(
+    std::vector<std::function<void()>>* ready) {
+  // Only the most urgent response may go next, so that a stream of smaller,
+  // less urgent responses cannot starve it.
+  while (!waiting_.empty() &&
+         (bytes_in_flight_ == 0 ||
+          bytes_in_flight_ + waiting_.top().num_bytes <=
+              max_bytes_in_flight_)) {
+    bytes_in_flight_ += waiting_.top().num_bytes;
+    // priority_queue::top() is const, so the callback is copied out.
+    ready->push_back(waiting_.top().send);
+    waiting_.pop();
+  }
+}
+
+}  // namespace tensorflow
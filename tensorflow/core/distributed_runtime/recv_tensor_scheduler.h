@@ -0,0 +1,99 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RECV_TENSOR_SCHEDULER_H_
+#define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RECV_TENSOR_SCHEDULER_H_
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// RecvTensorScheduler decides when the responses of RecvTensor and RecvTensors
+// calls are handed to the transport. Thread safe.
+//
+// A worker serving many RecvTensor calls at once would otherwise send every
+// response as soon as its tensor is ready. A large tensor that nobody needs
+// yet then competes for the network with a small one on the critical path.
+// Instead, at most `max_bytes_in_flight` bytes of large responses are handed
+// to the transport at a time, and the others wait, highest
+// `RecvTensorRequest.priority` first. Small responses are always sent right
+// away, since they do not hold up the others for long.
+class RecvTensorScheduler {
+ public:
+  // Responses of at least `min_scheduled_bytes` bytes are scheduled. Any
+  // response is sent right away when nothing else is in flight, even if it
+  // is larger than `max_bytes_in_flight`.
+  RecvTensorScheduler(int64 max_bytes_in_flight, int64 min_scheduled_bytes);
+
+  // Calls `send` once a response of `num_bytes` bytes can be sent, perhaps
+  // from within this call. Unless the response is small, the caller must
+  // call Release(num_bytes) once the transport is done with it. Responses
+  // that wait are sent in decreasing order of `priority`, and in the order
+  // they were scheduled among equal priorities.
+  void Schedule(int64 priority, int64 num_bytes, std::function<void()> send);
+
+  // Returns true if a response of `num_bytes` bytes bypasses the scheduler,
+  // and must not be released.
+  bool IsSmall(int64 num_bytes) const {
+    return num_bytes < min_scheduled_bytes_;
+  }
+
+  // Marks `num_bytes` bytes of scheduled responses as delivered, and sends
+  // the waiting responses that now fit.
+  void Release(int64 num_bytes);
+
+  // Returns the number of responses waiting to be sent.
+  int64 num_waiting() const;
+
+ private:
+  struct Pending {
+    int64 priority;
+    int64 sequence;
+    int64 num_bytes;
+    std::function<void()> send;
+
+    // Orders a priority_queue by decreasing priority, then by increasing
+    // sequence number.
+    bool operator<(const Pending& other) const {
+      if (priority != other.priority) return priority < other.priority;
+      return sequence > other.sequence;
+    }
+  };
+
+  // Moves the waiting responses that fit into `ready`.
+  void TakeReadyLocked(std::vector<std::function<void()>>* ready)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const int64 max_bytes_in_flight_;
+  const int64 min_scheduled_bytes_;
+
+  mutable mutex mu_;
+  int64 bytes_in_flight_ GUARDED_BY(mu_) = 0;
+  int64 next_sequence_ GUARDED_BY(mu_) = 0;
+  std::priority_queue<Pending> waiting_ GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(RecvTensorScheduler);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RECV_TENSOR_SCHEDULER_H_
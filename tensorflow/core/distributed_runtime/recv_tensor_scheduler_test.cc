@@ -0,0 +1,84 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/recv_tensor_scheduler.h"
+
+#include <vector>
+
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+class RecvTensorSchedulerTest : public ::testing::Test {
+ protected:
+  RecvTensorSchedulerTest() : scheduler_(100, 10) {}
+
+  // Schedules a response named `name`, recording when it is sent.
+  void Schedule(int64 priority, int64 num_bytes, int name) {
+    scheduler_.Schedule(priority, num_bytes,
+                        [this, name]() { sent_.push_back(name); });
+  }
+
+  RecvTensorScheduler scheduler_;
+  std::vector<int> sent_;
+};
+
+TEST_F(RecvTensorSchedulerTest, SmallResponsesAreNotScheduled) {
+  Schedule(0, 100, 1);
+  Schedule(0, 9, 2);
+  EXPECT_EQ(std::vector<int>({1, 2}), sent_);
+  EXPECT_TRUE(scheduler_.IsSmall(9));
+  EXPECT_FALSE(scheduler_.IsSmall(10));
+}
+
+TEST_F(RecvTensorSchedulerTest, LimitsBytesInFlight) {
+  Schedule(0, 60, 1);
+  Schedule(0, 40, 2);
+  Schedule(0, 10, 3);
+  EXPECT_EQ(std::vector<int>({1, 2}), sent_);
+  EXPECT_EQ(1, scheduler_.num_waiting());
+  scheduler_.Release(40);
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), sent_);
+  EXPECT_EQ(0, scheduler_.num_waiting());
+}
+
+TEST_F(RecvTensorSchedulerTest, OversizedResponseGoesAlone) {
+  Schedule(0, 500, 1);
+  Schedule(0, 10, 2);
+  EXPECT_EQ(std::vector<int>({1}), sent_);
+  scheduler_.Release(500);
+  EXPECT_EQ(std::vector<int>({1, 2}), sent_);
+}
+
+TEST_F(RecvTensorSchedulerTest, WaitingResponsesGoByPriority) {
+  Schedule(0, 100, 1);
+  Schedule(1, 50, 2);
+  Schedule(5, 50, 3);
+  Schedule(1, 50, 4);
+  Schedule(3, 100, 5);
+  EXPECT_EQ(std::vector<int>({1}), sent_);
+  scheduler_.Release(100);
+  EXPECT_EQ(std::vector<int>({1, 3}), sent_);
+  // The most urgent waiting response does not fit yet, and is not overtaken
+  // by less urgent ones that would.
+  scheduler_.Release(50);
+  EXPECT_EQ(std::vector<int>({1, 3, 5}), sent_);
+  scheduler_.Release(100);
+  EXPECT_EQ(std::vector<int>({1, 3, 5, 2, 4}), sent_);
+}
+
+}  // namespace
+}  // namespace tensorflow
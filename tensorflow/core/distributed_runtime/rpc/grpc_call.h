@@ -151,7 +151,11 @@ class Call : public UntypedCall<Service> {
   Call(HandleRequestFunction handle_request_function)
       : handle_request_function_(handle_request_function), responder_(&ctx_) {}
 
-  virtual ~Call() {}
+  virtual ~Call() {
+    if (done_callback_) {
+      done_callback_();
+    }
+  }
 
   void RequestReceived(Service* service, bool ok) override {
     if (ok) {
@@ -188,6 +192,13 @@ class Call : public UntypedCall<Service> {
     cancel_callback_ = nullptr;
   }
 
+  // Registers `callback` as the function that should be called once grpc no
+  // longer needs this call, e.g. after the response has been sent. Must be
+  // called before `SendResponse()`.
+  void SetDoneCallback(std::function<void()> callback) {
+    done_callback_ = std::move(callback);
+  }
+
   // Enqueues a new request for the given service on the given
   // completion queue, using the given `enqueue_function`.
   //
@@ -261,6 +272,7 @@ class Call : public UntypedCall<Service> {
 
   mutex mu_;
   std::function<void()> cancel_callback_ GUARDED_BY(mu_);
+  std::function<void()> done_callback_;
 };
 
 }  // namespace tensorflow
@@ -28,6 +28,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
 #include "tensorflow/core/distributed_runtime/graph_mgr.h"
+#include "tensorflow/core/distributed_runtime/recv_tensor_scheduler.h"
 #include "tensorflow/core/distributed_runtime/rendezvous_mgr_interface.h"
 #include "tensorflow/core/distributed_runtime/rpc/async_service_interface.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_call.h"
@@ -41,10 +42,12 @@ limitations under the License.
 #include "tensorflow/core/framework/collective.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/refcount.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/tracing.h"
 #include "tensorflow/core/protobuf/transport_options.pb.h"
 #include "tensorflow/core/protobuf/worker.pb.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
@@ -58,9 +61,25 @@ class GrpcWorkerService : public AsyncServiceInterface {
   GrpcWorkerService(GrpcWorker* worker, ::grpc::ServerBuilder* builder)
       : is_shutdown_(false) {
     builder->RegisterService(&worker_service_);
+    // RecvTensor responses are sent as soon as they are ready, unless
+    // TF_GRPC_WORKER_RECV_TENSOR_INFLIGHT_BYTES limits the bytes of large
+    // responses (at least TF_GRPC_WORKER_RECV_TENSOR_MIN_SCHEDULED_BYTES
+    // each) that are being sent at once. Responses that wait for their turn
+    // go out in order of RecvTensorRequest.priority.
+    int64 max_bytes_in_flight;
+    int64 min_scheduled_bytes;
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_GRPC_WORKER_RECV_TENSOR_INFLIGHT_BYTES",
+                                    0, &max_bytes_in_flight));
+    TF_CHECK_OK(
+        ReadInt64FromEnvVar("TF_GRPC_WORKER_RECV_TENSOR_MIN_SCHEDULED_BYTES",
+                            64 << 10, &min_scheduled_bytes));
+    if (max_bytes_in_flight > 0) {
+      recv_tensor_scheduler_.reset(
+          new RecvTensorScheduler(max_bytes_in_flight, min_scheduled_bytes));
+    }
     for (int i = 0; i < kGrpcWorkerServiceThreadCount; i++) {
-      threads_.emplace_back(
-          new GrpcWorkerServiceThread(worker, builder, &worker_service_));
+      threads_.emplace_back(new GrpcWorkerServiceThread(
+          worker, builder, &worker_service_, recv_tensor_scheduler_.get()));
     }
   }
 
@@ -122,9 +141,11 @@ class GrpcWorkerService : public AsyncServiceInterface {
    public:
     explicit GrpcWorkerServiceThread(
         GrpcWorker* worker, ::grpc::ServerBuilder* builder,
-        grpc::WorkerService::AsyncService* worker_service)
+        grpc::WorkerService::AsyncService* worker_service,
+        RecvTensorScheduler* recv_tensor_scheduler)
         : worker_(worker),
           worker_service_(worker_service),
+          recv_tensor_scheduler_(recv_tensor_scheduler),
           is_shutdown_(false) {
       cq_ = builder->AddCompletionQueue();
     }
@@ -165,6 +186,9 @@ class GrpcWorkerService : public AsyncServiceInterface {
       for (int i = 0; i < 500; ++i) {
         ENQUEUE_REQUEST(RecvBuf, true);
       }
+      for (int i = 0; i < 100; ++i) {
+        ENQUEUE_REQUEST(RecvTensors, true);
+      }
       for (int i = 0; i < 100; ++i) {
         ENQUEUE_REQUEST(RunGraph, true);
       }
@@ -294,15 +318,56 @@ class GrpcWorkerService : public AsyncServiceInterface {
         CallOptions* call_opts = new CallOptions;
         call->SetCancelCallback([call_opts]() { call_opts->StartCancel(); });
         worker_->GrpcRecvTensorAsync(call_opts, &call->request, &call->response,
-                                     [call, call_opts](const Status& s) {
+                                     [this, call, call_opts](const Status& s) {
                                        call->ClearCancelCallback();
                                        delete call_opts;
-                                       call->SendResponse(ToGrpcStatus(s));
+                                       SendRecvTensorResponse(
+                                           call, call->response.Length(), s);
                                      });
       });
       EnqueueRecvTensorRequestRaw();
     }
 
+    // Sends the `num_bytes` bytes response of a RecvTensor or RecvTensors
+    // call, once `recv_tensor_scheduler_` (if any) lets it go.
+    template <typename RequestMessage, typename ResponseMessage>
+    void SendRecvTensorResponse(
+        WorkerCall<RequestMessage, ResponseMessage>* call, int64 num_bytes,
+        const Status& s) {
+      if (recv_tensor_scheduler_ == nullptr ||
+          recv_tensor_scheduler_->IsSmall(num_bytes)) {
+        call->SendResponse(ToGrpcStatus(s));
+        return;
+      }
+      RecvTensorScheduler* scheduler = recv_tensor_scheduler_;
+      scheduler->Schedule(
+          call->request.priority(), num_bytes,
+          [call, scheduler, num_bytes, s]() {
+            // Only the bytes of responses that the scheduler let go are
+            // released, once grpc is done with them.
+            call->SetDoneCallback(
+                [scheduler, num_bytes]() { scheduler->Release(num_bytes); });
+            call->SendResponse(ToGrpcStatus(s));
+          });
+    }
+
+    void RecvTensorsHandler(
+        WorkerCall<RecvTensorsRequest, RecvTensorsResponse>* call) {
+      Schedule([this, call]() {
+        CallOptions* call_opts = new CallOptions;
+        call->SetCancelCallback([call_opts]() { call_opts->StartCancel(); });
+        worker_->RecvTensorsAsync(call_opts, &call->request, &call->response,
+                                  [this, call, call_opts](const Status& s) {
+                                    call->ClearCancelCallback();
+                                    delete call_opts;
+                                    SendRecvTensorResponse(
+                                        call, call->response.ByteSizeLong(),
+                                        s);
+                                  });
+      });
+      ENQUEUE_REQUEST(RecvTensors, true);
+    }
+
     void CleanupGraphHandler(
         WorkerCall<CleanupGraphRequest, CleanupGraphResponse>* call) {
       Schedule([this, call]() {
@@ -401,6 +466,7 @@ class GrpcWorkerService : public AsyncServiceInterface {
     std::unique_ptr<::grpc::ServerCompletionQueue> cq_;
     std::unique_ptr<Thread> thread_;
     grpc::WorkerService::AsyncService* const worker_service_;
+    RecvTensorScheduler* const recv_tensor_scheduler_;  // Not owned.
 
     mutex shutdown_mu_;
     bool is_shutdown_ GUARDED_BY(shutdown_mu_);
@@ -408,6 +474,7 @@ class GrpcWorkerService : public AsyncServiceInterface {
   };  // GrpcWorkerServiceThread
 
   grpc::WorkerService::AsyncService worker_service_;
+  std::unique_ptr<RecvTensorScheduler> recv_tensor_scheduler_;
   std::vector<std::unique_ptr<GrpcWorkerServiceThread>> threads_;
 
   mutex service_shutdown_mu_;
@@ -505,6 +572,233 @@ void GrpcWorker::GrpcRecvTensorAsync(CallOptions* opts,
       });
 }
 
+namespace {
+
+// Collects the tensors of one RecvTensors call as the worker produces them.
+// Once the response has been sent, tensors that arrive later are handed back
+// to the step's rendezvous, where the caller's follow-up request finds them.
+class RecvTensorsCall : public core::RefCounted {
+ public:
+  RecvTensorsCall(WorkerEnv* env, CallOptions* opts,
+                  const RecvTensorsRequest* request,
+                  RecvTensorsResponse* response, StatusCallback done)
+      : env_(env),
+        step_id_(request->step_id()),
+        max_wait_micros_(request->max_wait_micros()),
+        max_response_bytes_(request->max_response_bytes()),
+        opts_(opts),
+        response_(response),
+        done_(std::move(done)),
+        num_pending_(request->rendezvous_key_size()) {}
+
+  // Asks the rendezvous for every key in `parsed`, whose source devices
+  // are `src_devs`.
+  void Start(std::vector<Rendezvous::ParsedKey> parsed,
+             std::vector<Device*> src_devs) {
+    parsed_ = std::move(parsed);
+    for (int i = 0; i < parsed_.size(); ++i) {
+      Ref();
+      Device* src_dev = src_devs[i];
+      env_->rendezvous_mgr->RecvLocalAsync(
+          step_id_, parsed_[i],
+          [this, i, src_dev](const Status& status,
+                             const Rendezvous::Args& send_args,
+                             const Rendezvous::Args& recv_args,
+                             const Tensor& val, const bool is_dead) {
+            TensorReady(i, src_dev, status, send_args, val, is_dead);
+            Unref();
+          });
+    }
+    // Tensors that were already available are sent back together.
+    bool respond;
+    {
+      mutex_lock l(mu_);
+      started_ = true;
+      respond = ShouldRespondLocked();
+    }
+    if (respond) Respond();
+  }
+
+ private:
+  ~RecvTensorsCall() override {}
+
+  void TensorReady(int index, Device* src_dev, const Status& status,
+                   const Rendezvous::Args& send_args, const Tensor& val,
+                   bool is_dead) {
+    bool responded;
+    bool copy_to_host = false;
+    bool respond = false;
+    {
+      mutex_lock l(mu_);
+      responded = responded_;
+      if (!responded) {
+        --num_pending_;
+        copy_to_host = status.ok() && src_dev->tensorflow_gpu_device_info() &&
+                       !send_args.alloc_attrs.on_host();
+        if (!status.ok()) {
+          status_.Update(status);
+        } else if (copy_to_host) {
+          ++num_copies_;
+        } else {
+          AddLocked(index, val, is_dead);
+        }
+        respond = ShouldRespondLocked();
+      }
+    }
+    if (respond) Respond();
+    if (responded) {
+      // The response has been sent without this tensor, so hand it back to
+      // the rendezvous. The send fails only if the step has been aborted,
+      // in which case the caller sees the abort too.
+      if (status.ok()) {
+        Rendezvous* rendez = env_->rendezvous_mgr->Find(step_id_);
+        rendez->Send(parsed_[index], send_args, val, is_dead).IgnoreError();
+        rendez->Unref();
+      }
+      return;
+    }
+    if (!copy_to_host) return;
+
+    // "val" is on an accelerator device. Uses the device_context to fill a
+    // copy on host, and holds the response until it is done.
+    DeviceContext* send_dev_context = send_args.device_context;
+    AllocatorAttributes alloc_attrs;
+    alloc_attrs.set_gpu_compatible(true);
+    alloc_attrs.set_on_host(true);
+    Allocator* alloc = src_dev->GetAllocator(alloc_attrs);
+    Tensor* copy = new Tensor(alloc, val.dtype(), val.shape());
+    CHECK(send_dev_context)
+        << "send dev name: " << src_dev->name()
+        << " gpu_info: " << src_dev->tensorflow_gpu_device_info();
+    Ref();
+    send_dev_context->CopyDeviceTensorToCPU(
+        &val, parsed_[index].FullKey(), src_dev, copy,
+        [this, index, copy, is_dead](const Status& s) {
+          bool respond;
+          {
+            mutex_lock l(mu_);
+            --num_copies_;
+            if (s.ok()) {
+              AddLocked(index, *copy, is_dead);
+            } else {
+              status_.Update(s);
+            }
+            respond = ShouldRespondLocked();
+          }
+          delete copy;
+          if (respond) Respond();
+          Unref();
+        });
+  }
+
+  void AddLocked(int index, const Tensor& val, bool is_dead)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    RecvTensorResponse* tensor = response_->add_tensor();
+    val.AsProtoTensorContent(tensor->mutable_tensor());
+    tensor->set_is_dead(is_dead);
+    tensor->set_send_start_micros(env_->env->NowMicros());
+    response_->add_key_index(index);
+    response_bytes_ += val.TotalBytes();
+  }
+
+  // Returns true if the response should be sent now: every tensor is in, or
+  // holding on to the tensors collected so far could delay them past the
+  // caller's limits. Starts the `max_wait_micros` timer when needed.
+  bool ShouldRespondLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (responded_ || !started_ || num_copies_ > 0) return false;
+    if (status_.ok() && num_pending_ > 0) {
+      if (response_->tensor_size() == 0) return false;
+      const bool full =
+          max_response_bytes_ > 0 && response_bytes_ >= max_response_bytes_;
+      if (!full && !deadline_passed_ && max_wait_micros_ > 0) {
+        if (!deadline_scheduled_) {
+          deadline_scheduled_ = true;
+          Ref();
+          SchedNonBlockingClosureAfter(max_wait_micros_, [this]() {
+            bool respond;
+            {
+              mutex_lock l(mu_);
+              deadline_passed_ = true;
+              respond = ShouldRespondLocked();
+            }
+            if (respond) Respond();
+            Unref();
+          });
+        }
+        return false;
+      }
+    }
+    responded_ = true;
+    return true;
+  }
+
+  // Called once, after ShouldRespondLocked() has returned true. No other
+  // method touches `status_` or `response_` from then on.
+  void Respond() NO_THREAD_SAFETY_ANALYSIS {
+    opts_->ClearCancelCallback();
+    done_(status_);
+  }
+
+  WorkerEnv* const env_;
+  const int64 step_id_;
+  const int64 max_wait_micros_;
+  const int64 max_response_bytes_;
+  CallOptions* const opts_;
+  RecvTensorsResponse* const response_;
+  const StatusCallback done_;
+  std::vector<Rendezvous::ParsedKey> parsed_;
+
+  mutex mu_;
+  Status status_ GUARDED_BY(mu_);
+  int num_pending_ GUARDED_BY(mu_);
+  int num_copies_ GUARDED_BY(mu_) = 0;
+  int64 response_bytes_ GUARDED_BY(mu_) = 0;
+  bool started_ GUARDED_BY(mu_) = false;
+  bool deadline_scheduled_ GUARDED_BY(mu_) = false;
+  bool deadline_passed_ GUARDED_BY(mu_) = false;
+  bool responded_ GUARDED_BY(mu_) = false;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(RecvTensorsCall);
+};
+
+}  // namespace
+
+void GrpcWorker::RecvTensorsAsync(CallOptions* opts,
+                                  const RecvTensorsRequest* request,
+                                  RecvTensorsResponse* response,
+                                  StatusCallback done) {
+  Status s = recv_tensor_recent_request_ids_.TrackUnique(
+      request->request_id(), "RecvTensors (GrpcWorker)", *request);
+  if (!s.ok()) {
+    done(s);
+    return;
+  }
+
+  const int64 step_id = request->step_id();
+  std::vector<Rendezvous::ParsedKey> parsed(request->rendezvous_key_size());
+  std::vector<Device*> src_devs(request->rendezvous_key_size(), nullptr);
+  for (int i = 0; s.ok() && i < request->rendezvous_key_size(); ++i) {
+    s = Rendezvous::ParseKey(request->rendezvous_key(i), &parsed[i]);
+    if (s.ok()) {
+      s = PrepareRecvTensor(parsed[i], &src_devs[i]);
+    }
+  }
+  if (!s.ok()) {
+    done(s);
+    return;
+  }
+  TRACEPRINTF("RecvTensors: %lld %d keys", step_id,
+              request->rendezvous_key_size());
+
+  // As in GrpcRecvTensorAsync, an RPC cancellation while waiting for the
+  // tensors aborts the step.
+  opts->SetCancelCallback([this, step_id]() { AbortStep(step_id); });
+  RecvTensorsCall* call =
+      new RecvTensorsCall(env_, opts, request, response, std::move(done));
+  call->Start(std::move(parsed), std::move(src_devs));
+  call->Unref();
+}
+
 void GrpcWorker::RecvBufAsync(CallOptions* opts, const RecvBufRequest* request,
                               RecvBufResponse* response, StatusCallback done) {
   // This is a generic, low performance implementation appropriate for grpc.
@@ -15,6 +15,9 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/rpc/rpc_rendezvous_mgr.h"
 
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "tensorflow/core/common_runtime/device.h"
@@ -27,20 +30,152 @@ limitations under the License.
 #include "tensorflow/core/distributed_runtime/worker_interface.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
 #include "tensorflow/core/lib/strings/numbers.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/protobuf/worker.pb.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
 namespace {
 
+// Counts the RPCs issued to receive tensors from remote workers.
+auto* recv_tensor_rpcs = monitoring::Counter<1>::New(
+    "/tensorflow/core/rpc_recv_tensor_rpcs",
+    "The number of RPCs issued to receive tensors, by method.", "method");
+
+}  // namespace
+
+// Holds the batching knobs documented in rpc_rendezvous_mgr.h, and flushes
+// pending batches once their window has passed.
+class RpcRecvBatcher {
+ public:
+  explicit RpcRecvBatcher(const WorkerEnv* env) : env_(env) {
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_RPC_RECV_BATCH_SIZE", 1,
+                                    &max_batch_size_));
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_RPC_RECV_BATCH_WINDOW_MICROS", 50,
+                                    &window_micros_));
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_RPC_RECV_BATCH_MAX_WAIT_MICROS", 0,
+                                    &max_wait_micros_));
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_RPC_RECV_BATCH_MAX_BYTES", 4 << 20,
+                                    &max_response_bytes_));
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_RPC_RECV_BATCH_MAX_TENSOR_BYTES",
+                                    64 << 10, &max_tensor_bytes_));
+  }
+
+  ~RpcRecvBatcher() {
+    {
+      mutex_lock l(mu_);
+      shutdown_ = true;
+    }
+    cond_var_.notify_all();
+    // Blocks until the timer thread has run the remaining flushes.
+    thread_.reset();
+  }
+
+  bool enabled() const { return max_batch_size_ > 1; }
+  int64 max_batch_size() const { return max_batch_size_; }
+  int64 max_wait_micros() const { return max_wait_micros_; }
+  int64 max_response_bytes() const { return max_response_bytes_; }
+
+  // Returns whether the tensor of `key` was larger than max_tensor_bytes the
+  // last time it was received. Such tensors are received on their own, with a
+  // RecvTensor call that doesn't copy them into a proto.
+  bool IsLarge(const string& key) {
+    mutex_lock l(keys_mu_);
+    return large_keys_.count(key) > 0;
+  }
+
+  // Records the size of the tensor received for `key`.
+  void RecordTensorBytes(const string& key, int64 bytes) {
+    const bool large = bytes > max_tensor_bytes_;
+    mutex_lock l(keys_mu_);
+    if (large) {
+      large_keys_.insert(key);
+    } else {
+      large_keys_.erase(key);
+    }
+  }
+
+  // Runs `flush` once the batching window has passed.
+  void ScheduleFlush(std::function<void()> flush) {
+    if (window_micros_ <= 0) {
+      env_->compute_pool->Schedule(std::move(flush));
+      return;
+    }
+    const uint64 deadline = env_->env->NowMicros() + window_micros_;
+    mutex_lock l(mu_);
+    if (thread_ == nullptr) {
+      thread_.reset(env_->env->StartThread(ThreadOptions(), "rpc_recv_batcher",
+                                           [this]() { TimerLoop(); }));
+    }
+    // Flushes are scheduled with the same window, so they are due in the
+    // order they are added.
+    flushes_.emplace_back(deadline, std::move(flush));
+    cond_var_.notify_one();
+  }
+
+ private:
+  void TimerLoop() {
+    while (true) {
+      std::function<void()> flush;
+      {
+        mutex_lock l(mu_);
+        while (flush == nullptr) {
+          if (flushes_.empty()) {
+            if (shutdown_) return;
+            cond_var_.wait(l);
+            continue;
+          }
+          const uint64 now = env_->env->NowMicros();
+          const uint64 deadline = flushes_.front().first;
+          if (!shutdown_ && now < deadline) {
+            cond_var_.wait_for(l, std::chrono::microseconds(deadline - now));
+            continue;
+          }
+          flush = std::move(flushes_.front().second);
+          flushes_.pop_front();
+        }
+      }
+      // Flushing only issues an asynchronous call.
+      flush();
+    }
+  }
+
+  const WorkerEnv* const env_;
+  int64 max_batch_size_;
+  int64 window_micros_;
+  int64 max_wait_micros_;
+  int64 max_response_bytes_;
+  int64 max_tensor_bytes_;
+
+  mutex keys_mu_;
+  // Keys whose tensor last took more than max_tensor_bytes_. Keys are stable
+  // across steps, and only the large tensors are tracked.
+  std::unordered_set<string> large_keys_ GUARDED_BY(keys_mu_);
+
+  mutex mu_;
+  condition_variable cond_var_;
+  std::deque<std::pair<uint64, std::function<void()>>> flushes_
+      GUARDED_BY(mu_);
+  bool shutdown_ GUARDED_BY(mu_) = false;
+  // Started on the first flush with a non-zero window.
+  std::unique_ptr<Thread> thread_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(RpcRecvBatcher);
+};
+
+namespace {
+
 class RpcRemoteRendezvous : public BaseRemoteRendezvous {
  public:
-  RpcRemoteRendezvous(const WorkerEnv* env, int64 step_id)
-      : BaseRemoteRendezvous(env, step_id) {}
+  RpcRemoteRendezvous(const WorkerEnv* env, int64 step_id,
+                      RpcRecvBatcher* batcher)
+      : BaseRemoteRendezvous(env, step_id), batcher_(batcher) {}
 
  protected:
   void RecvFromRemoteAsync(const Rendezvous::ParsedKey& parsed,
@@ -50,6 +185,31 @@ class RpcRemoteRendezvous : public BaseRemoteRendezvous {
  private:
   ~RpcRemoteRendezvous() override {}
 
+  // A receive waiting to be sent as part of a batch.
+  struct PendingRecv {
+    string key;
+    Device* dst_device;
+    Rendezvous::Args recv_args;
+    DoneCallback done;
+  };
+
+  // Adds `recv` to the batch for `src_worker`, and sends the batch if it is
+  // full.
+  void EnqueueRecv(const string& src_worker, PendingRecv recv);
+
+  // Sends whatever is pending for `src_worker`.
+  void FlushRecvs(const string& src_worker);
+
+  // Receives `batch` from `src_worker` with RecvTensors calls.
+  void RecvBatchAsync(const string& src_worker,
+                      std::vector<PendingRecv> batch);
+
+  RpcRecvBatcher* const batcher_;  // Not owned. Null if disabled.
+
+  mutex batch_mu_;
+  std::unordered_map<string, std::vector<PendingRecv>> pending_recvs_
+      GUARDED_BY(batch_mu_);
+
   TF_DISALLOW_COPY_AND_ASSIGN(RpcRemoteRendezvous);
 };
 
@@ -69,6 +229,7 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
     req_.set_step_id(step_id);
     req_.set_rendezvous_key(key.data(), key.size());
     req_.set_request_id(GetUniqueRequestId());
+    req_.set_priority(recv_args.priority);
   }
 
   void Reset(WorkerCacheInterface* wc) {
@@ -199,6 +360,68 @@ class RpcRecvTensorFreeList {
   std::vector<RpcRecvTensorCall*> objects_ GUARDED_BY(mu_);
 };
 
+// Used to retrieve a batch of tensors from one remote process.
+class RpcRecvTensorsCall : public BaseRecvTensorCall {
+ public:
+  RpcRecvTensorsCall(WorkerInterface* wi, int64 step_id,
+                     const std::vector<string>& keys, int64 priority,
+                     const RpcRecvBatcher& batcher)
+      : wi_(wi) {
+    req_.set_step_id(step_id);
+    for (const string& key : keys) {
+      req_.add_rendezvous_key(key);
+    }
+    req_.set_max_wait_micros(batcher.max_wait_micros());
+    req_.set_max_response_bytes(batcher.max_response_bytes());
+    req_.set_request_id(GetUniqueRequestId());
+    req_.set_priority(priority);
+  }
+
+  void Start(std::function<void()> recv_done) override {
+    recv_tensor_rpcs->GetCell("RecvTensors")->IncrementBy(1);
+    using namespace std::placeholders;
+    StatusCallback cb = std::bind(
+        [this](std::function<void()> recv_done,
+               // Begin unbound arguments.
+               const Status& s) {
+          if (!s.ok()) {
+            mutex_lock l(mu_);
+            status_.Update(s);
+          }
+          recv_done();
+        },
+        std::move(recv_done), _1);
+    wi_->RecvTensorsAsync(&opts_, &req_, &resp_, std::move(cb));
+  }
+
+  void StartAbort(const Status& s) override {
+    {
+      mutex_lock l(mu_);
+      status_.Update(s);
+    }
+    opts_.StartCancel();
+  }
+
+  Status status() const override {
+    mutex_lock l(mu_);
+    return status_;
+  }
+
+  WorkerInterface* wi() const { return wi_; }
+  const RecvTensorsResponse& response() const { return resp_; }
+
+ private:
+  WorkerInterface* wi_;
+  CallOptions opts_;
+  RecvTensorsRequest req_;
+  RecvTensorsResponse resp_;
+
+  mutable mutex mu_;
+  Status status_ GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(RpcRecvTensorsCall);
+};
+
 static RpcRecvTensorFreeList* get_call_freelist() {
   static RpcRecvTensorFreeList* call_freelist = new RpcRecvTensorFreeList();
   return call_freelist;
@@ -238,6 +461,25 @@ void RpcRemoteRendezvous::RecvFromRemoteAsync(
     return;
   }
 
+  // Batched tensors are parsed from protos, which is only done into host
+  // memory. The sizes of the tensors that could be batched are tracked, so
+  // that the large ones keep being received without a copy.
+  string batchable_key;
+  if (batcher_ != nullptr &&
+      (dst_device->tensorflow_gpu_device_info() == nullptr ||
+       recv_args.alloc_attrs.on_host())) {
+    batchable_key = parsed.FullKey().ToString();
+    if (!batcher_->IsLarge(batchable_key)) {
+      const string src_worker = call->src_worker_;
+      sess->worker_cache->ReleaseWorker(src_worker, rwi);
+      get_call_freelist()->Release(call, sess->worker_cache.get());
+      EnqueueRecv(src_worker, {std::move(batchable_key), dst_device,
+                               recv_args, std::move(done)});
+      return;
+    }
+  }
+
+  recv_tensor_rpcs->GetCell("RecvTensor")->IncrementBy(1);
   call->Init(rwi, step_id_, parsed.FullKey(), recv_args.alloc_attrs, dst_device,
              recv_args, std::move(done));
 
@@ -246,12 +488,15 @@ void RpcRemoteRendezvous::RecvFromRemoteAsync(
 
   // Start "call".
   Ref();
-  call->Start([this, call]() {
+  call->Start([this, call, batchable_key]() {
     // Removes "call" from active_. Prevent StartAbort().
     DeregisterCall(call);
     // If StartAbort was called prior to DeregisterCall, then the
     // current status should be bad.
     Status s = call->status();
+    if (s.ok() && !batchable_key.empty()) {
+      batcher_->RecordTensorBytes(batchable_key, call->tensor().TotalBytes());
+    }
     call->done()(s, Args(), call->recv_args(), call->tensor(), call->is_dead());
     session()->worker_cache->ReleaseWorker(call->src_worker_, call->wi_);
     call->wi_ = nullptr;
@@ -260,14 +505,134 @@ void RpcRemoteRendezvous::RecvFromRemoteAsync(
   });
 }
 
+void RpcRemoteRendezvous::EnqueueRecv(const string& src_worker,
+                                      PendingRecv recv) {
+  std::vector<PendingRecv> batch;
+  bool schedule_flush = false;
+  {
+    mutex_lock l(batch_mu_);
+    std::vector<PendingRecv>& pending = pending_recvs_[src_worker];
+    pending.push_back(std::move(recv));
+    if (pending.size() >= batcher_->max_batch_size()) {
+      batch.swap(pending);
+    } else {
+      schedule_flush = (pending.size() == 1);
+    }
+  }
+  if (!batch.empty()) {
+    RecvBatchAsync(src_worker, std::move(batch));
+  } else if (schedule_flush) {
+    Ref();
+    batcher_->ScheduleFlush([this, src_worker]() {
+      FlushRecvs(src_worker);
+      Unref();
+    });
+  }
+}
+
+void RpcRemoteRendezvous::FlushRecvs(const string& src_worker) {
+  std::vector<PendingRecv> batch;
+  {
+    mutex_lock l(batch_mu_);
+    auto it = pending_recvs_.find(src_worker);
+    if (it == pending_recvs_.end()) return;
+    batch.swap(it->second);
+  }
+  if (!batch.empty()) {
+    RecvBatchAsync(src_worker, std::move(batch));
+  }
+}
+
+void RpcRemoteRendezvous::RecvBatchAsync(const string& src_worker,
+                                         std::vector<PendingRecv> batch) {
+  WorkerSession* sess = session();
+  WorkerInterface* rwi = sess->worker_cache->CreateWorker(src_worker);
+  if (rwi == nullptr) {
+    Status s = errors::Internal("No worker known as ", src_worker);
+    for (PendingRecv& recv : batch) {
+      recv.done(s, Args(), recv.recv_args, Tensor{}, false);
+    }
+    return;
+  }
+
+  std::vector<string> keys;
+  keys.reserve(batch.size());
+  int64 priority = batch[0].recv_args.priority;
+  for (const PendingRecv& recv : batch) {
+    keys.push_back(recv.key);
+    priority = std::max(priority, recv.recv_args.priority);
+  }
+  RpcRecvTensorsCall* call =
+      new RpcRecvTensorsCall(rwi, step_id_, keys, priority, *batcher_);
+
+  // Record "call" in active_ so that it can be aborted cleanly.
+  RegisterCall(call);
+
+  // The callback owns "batch" until the call is done.
+  std::vector<PendingRecv>* recvs =
+      new std::vector<PendingRecv>(std::move(batch));
+  Ref();
+  call->Start([this, call, recvs, src_worker]() {
+    // Removes "call" from active_. Prevent StartAbort().
+    DeregisterCall(call);
+    Status s = call->status();
+    const RecvTensorsResponse& resp = call->response();
+    std::vector<bool> received(recvs->size(), false);
+    for (int i = 0; s.ok() && i < resp.tensor_size(); ++i) {
+      const int index =
+          i < resp.key_index_size() ? resp.key_index(i) : recvs->size();
+      if (index < 0 || index >= recvs->size() || received[index]) {
+        s = errors::Internal("Invalid key index in RecvTensors response");
+        break;
+      }
+      received[index] = true;
+      PendingRecv& recv = (*recvs)[index];
+      Tensor val;
+      Status val_status;
+      if (!val.FromProto(
+              recv.dst_device->GetAllocator(recv.recv_args.alloc_attrs),
+              resp.tensor(i).tensor())) {
+        val_status = errors::InvalidArgument("Cannot parse tensor for ",
+                                             recv.key, " from proto");
+      } else {
+        batcher_->RecordTensorBytes(recv.key, val.TotalBytes());
+      }
+      recv.done(val_status, Args(), recv.recv_args, val,
+                resp.tensor(i).is_dead());
+    }
+    // Asks again for the tensors that did not make it into the response, or
+    // fails them if the call failed.
+    std::vector<PendingRecv> remaining;
+    for (int i = 0; i < recvs->size(); ++i) {
+      if (received[i]) continue;
+      if (s.ok()) {
+        remaining.push_back(std::move((*recvs)[i]));
+      } else {
+        (*recvs)[i].done(s, Args(), (*recvs)[i].recv_args, Tensor{}, false);
+      }
+    }
+    session()->worker_cache->ReleaseWorker(src_worker, call->wi());
+    delete call;
+    delete recvs;
+    if (!remaining.empty()) {
+      RecvBatchAsync(src_worker, std::move(remaining));
+    }
+    Unref();
+  });
+}
+
 }  // namespace
 
 RpcRendezvousMgr::RpcRendezvousMgr(const WorkerEnv* env)
-    : BaseRendezvousMgr(env) {}
+    : BaseRendezvousMgr(env), batcher_(new RpcRecvBatcher(env)) {
+  if (!batcher_->enabled()) batcher_.reset();
+}
+
+RpcRendezvousMgr::~RpcRendezvousMgr() {}
 
 BaseRemoteRendezvous* RpcRendezvousMgr::Create(int64 step_id,
                                                const WorkerEnv* worker_env) {
-  return new RpcRemoteRendezvous(worker_env, step_id);
+  return new RpcRemoteRendezvous(worker_env, step_id, batcher_.get());
 }
 
 }  // end namespace tensorflow
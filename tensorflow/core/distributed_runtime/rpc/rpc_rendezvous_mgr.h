@@ -16,6 +16,8 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_RPC_RENDEZVOUS_MGR_H_
 #define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_RPC_RENDEZVOUS_MGR_H_
 
+#include <memory>
+
 #include "tensorflow/core/distributed_runtime/base_rendezvous_mgr.h"
 #include "tensorflow/core/distributed_runtime/worker_env.h"
 #include "tensorflow/core/platform/macros.h"
@@ -23,6 +25,7 @@ limitations under the License.
 namespace tensorflow {
 
 class DeviceMgr;
+class RpcRecvBatcher;
 
 // RendezvousMgr keeps track of a set of local rendezvous instances.
 // All tensors sent by this worker are buffered in a RendezvousMgr
@@ -42,14 +45,36 @@ class DeviceMgr;
 //
 // Tensors sent and recved through rendezvous managed by this
 // RendezvousMgr must have keys generated by Rendezvous::CreateKey.
+//
+// Receives of host-memory tensors from the same remote worker can be
+// coalesced into one RecvTensors call per step. This is controlled by the
+// following environment variables, read when the manager is created:
+//
+//   TF_RPC_RECV_BATCH_SIZE: Receives are sent as soon as this many are
+//     pending for one worker. Batching is disabled if this is 1 (the
+//     default) or less.
+//   TF_RPC_RECV_BATCH_WINDOW_MICROS: ...or once the first of them has been
+//     pending for this long. Defaults to 50.
+//   TF_RPC_RECV_BATCH_MAX_WAIT_MICROS: How long the remote worker may hold
+//     tensors that are ready while waiting for the rest of the batch. See
+//     `RecvTensorsRequest.max_wait_micros`. Defaults to 0.
+//   TF_RPC_RECV_BATCH_MAX_BYTES: See `RecvTensorsRequest.max_response_bytes`.
+//     Defaults to 4MB.
+//   TF_RPC_RECV_BATCH_MAX_TENSOR_BYTES: Tensors that were larger than this
+//     when last received are received on their own with RecvTensor, which
+//     doesn't copy them into a proto. Defaults to 64KB.
 class RpcRendezvousMgr : public BaseRendezvousMgr {
  public:
   explicit RpcRendezvousMgr(const WorkerEnv* env);
+  ~RpcRendezvousMgr() override;
 
  protected:
   BaseRemoteRendezvous* Create(int64 step_id, const WorkerEnv* worker_env);
 
  private:
+  // Null when batching is disabled.
+  std::unique_ptr<RpcRecvBatcher> batcher_;
+
   TF_DISALLOW_COPY_AND_ASSIGN(RpcRendezvousMgr);
 };
 
@@ -14,7 +14,10 @@ limitations under the License.
 ==============================================================================*/
 
 #include <cstdio>
+#include <cstdlib>
 #include <functional>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,7 +28,9 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/graph/default_device.h"
 #include "tensorflow/core/graph/graph_def_builder.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/monitoring/collection_registry.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/platform/logging.h"
@@ -248,4 +253,185 @@ BENCHMARK(BM_SingleDevice)
     ->ArgPair(4, 10000)
     ->ArgPair(1, 1000000);
 
+// A "ps" and a "worker" task, where the worker batches its receives from the
+// ps as configured by the TF_RPC_RECV_BATCH_* variables of `batching_env`.
+struct PsCluster {
+  std::vector<std::unique_ptr<ServerInterface>> servers;
+  string target;
+
+  explicit PsCluster(const std::map<string, string>& batching_env) {
+    // Read by the rendezvous managers of the servers created below.
+    for (const auto& var : batching_env) {
+      setenv(var.first.c_str(), var.second.c_str(), 1 /* overwrite */);
+    }
+    ClusterDef cluster_def;
+    for (const string& job : {"ps", "worker"}) {
+      auto* job_def = cluster_def.add_job();
+      job_def->set_name(job);
+      (*job_def->mutable_tasks())[0] =
+          strings::StrCat("localhost:", testing::PickUnusedPortOrDie());
+    }
+    for (const auto& job_def : cluster_def.job()) {
+      ServerDef server_def;
+      server_def.set_protocol("grpc");
+      server_def.set_job_name(job_def.name());
+      server_def.set_task_index(0);
+      *server_def.mutable_cluster() = cluster_def;
+      std::unique_ptr<ServerInterface> server;
+      TF_CHECK_OK(NewServer(server_def, &server));
+      TF_CHECK_OK(server->Start());
+      servers.push_back(std::move(server));
+      target = strings::StrCat("grpc://", job_def.tasks().at(0));
+    }
+    for (const auto& var : batching_env) {
+      unsetenv(var.first.c_str());
+    }
+  }
+};
+
+// Returns a cluster whose worker coalesces receives from the ps into
+// RecvTensors calls of up to `recv_batch_size` tensors.
+static const PsCluster* GetPsCluster(int recv_batch_size) {
+  static std::map<int, PsCluster*>* clusters = new std::map<int, PsCluster*>;
+  PsCluster*& cluster = (*clusters)[recv_batch_size];
+  if (cluster == nullptr) {
+    cluster = new PsCluster(
+        {{"TF_RPC_RECV_BATCH_SIZE", strings::StrCat(recv_batch_size)}});
+  }
+  return cluster;
+}
+
+// Returns the number of RPCs issued so far to receive tensors, with the
+// given method or with any method if `method` is empty.
+static int64 RecvTensorRpcs(const string& method = "") {
+  std::unique_ptr<monitoring::CollectedMetrics> metrics =
+      monitoring::CollectionRegistry::Default()->CollectMetrics(
+          monitoring::CollectionRegistry::CollectMetricsOptions());
+  auto it =
+      metrics->point_set_map.find("/tensorflow/core/rpc_recv_tensor_rpcs");
+  int64 total = 0;
+  if (it != metrics->point_set_map.end()) {
+    for (const auto& point : it->second->points) {
+      if (method.empty() || point->labels[0].value == method) {
+        total += point->int64_value;
+      }
+    }
+  }
+  return total;
+}
+
+// Small tensors are batched, while tensors over
+// TF_RPC_RECV_BATCH_MAX_TENSOR_BYTES are received on their own once their
+// size is known.
+TEST(RecvBatchingTest, LargeTensorsBypassTheBatch) {
+  using namespace ::tensorflow::ops;  // NOLINT(build/namespaces)
+  // The cluster is leaked, as the servers can't be stopped.
+  const PsCluster* cluster =
+      new PsCluster({{"TF_RPC_RECV_BATCH_SIZE", "4"},
+                     {"TF_RPC_RECV_BATCH_WINDOW_MICROS", "100000"},
+                     {"TF_RPC_RECV_BATCH_MAX_TENSOR_BYTES", "1024"}});
+  const char* const kPsDevice = "/job:ps/replica:0/task:0/device:CPU:0";
+  Scope s = Scope::NewRootScope();
+  std::vector<Output> small_vars;
+  std::vector<Output> large_vars;
+  std::vector<string> init_targets;
+  for (int i = 0; i < 6; ++i) {
+    // 64 bytes, or 4KB.
+    const int64 size = i < 4 ? 16 : 1024;
+    Output var = Variable(s.WithDevice(kPsDevice), {size}, DT_FLOAT);
+    const string init = strings::StrCat("init", i);
+    Assign(s.WithOpName(init).WithDevice(kPsDevice), var,
+           Fill(s.WithDevice(kPsDevice), {size}, 1.0f));
+    init_targets.push_back(init);
+    (i < 4 ? small_vars : large_vars).push_back(var);
+  }
+  const Scope worker = s.WithDevice("/job:worker/replica:0/task:0/cpu:0");
+  AddN(worker.WithOpName("small"), small_vars);
+  AddN(worker.WithOpName("large"), large_vars);
+  GraphDef def;
+  TF_ASSERT_OK(s.ToGraphDef(&def));
+
+  SessionOptions options;
+  options.target = cluster->target;
+  std::unique_ptr<Session> session(NewSession(options));
+  TF_ASSERT_OK(session->Create(def));
+  TF_ASSERT_OK(session->Run({}, {}, init_targets, nullptr));
+
+  std::vector<Tensor> outputs;
+  // The first step learns the sizes of the tensors.
+  TF_ASSERT_OK(session->Run({}, {"small:0", "large:0"}, {}, &outputs));
+  const int64 batched_before = RecvTensorRpcs("RecvTensors");
+  const int64 single_before = RecvTensorRpcs("RecvTensor");
+  const int kSteps = 3;
+  for (int i = 0; i < kSteps; ++i) {
+    outputs.clear();
+    TF_ASSERT_OK(session->Run({}, {"small:0", "large:0"}, {}, &outputs));
+    EXPECT_EQ(4.0f, outputs[0].flat<float>()(0));
+    EXPECT_EQ(2.0f, outputs[1].flat<float>()(1023));
+  }
+  // The 4 small tensors fill one batch, and each large one is received alone.
+  EXPECT_EQ(kSteps, RecvTensorRpcs("RecvTensors") - batched_before);
+  EXPECT_EQ(2 * kSteps, RecvTensorRpcs("RecvTensor") - single_before);
+  TF_ASSERT_OK(session->Close());
+}
+
+// Each step reads `num_vars` small variables from the ps, as a worker
+// fetching its parameters does.
+static void BM_ManySmallVariables(int iters, int num_vars,
+                                  int recv_batch_size) {
+  testing::StopTiming();
+  using namespace ::tensorflow::ops;  // NOLINT(build/namespaces)
+  const char* const kPsDevice = "/job:ps/replica:0/task:0/device:CPU:0";
+  Scope s = Scope::NewRootScope();
+  std::vector<Output> vars;
+  for (int i = 0; i < num_vars; ++i) {
+    Output var = Variable(s.WithDevice(kPsDevice), {16}, DT_FLOAT);
+    Assign(s.WithOpName(strings::StrCat("init", i)).WithDevice(kPsDevice), var,
+           Fill(s.WithDevice(kPsDevice), {16}, 1.0f));
+    vars.push_back(var);
+  }
+  AddN(s.WithOpName("y").WithDevice("/job:worker/replica:0/task:0/cpu:0"),
+       vars);
+  GraphDef def;
+  TF_CHECK_OK(s.ToGraphDef(&def));
+
+  SessionOptions options;
+  options.target = GetPsCluster(recv_batch_size)->target;
+  std::unique_ptr<Session> session(NewSession(options));
+  TF_CHECK_OK(session->Create(def));
+  std::vector<string> init_targets;
+  for (int i = 0; i < num_vars; ++i) {
+    init_targets.push_back(strings::StrCat("init", i));
+  }
+  TF_CHECK_OK(session->Run({}, {}, init_targets, nullptr));
+
+  std::vector<Tensor> outputs;
+  for (int i = 0; i < 3; i++) {
+    outputs.clear();
+    TF_CHECK_OK(session->Run({}, {"y:0"}, {}, &outputs));
+    CHECK_EQ(static_cast<float>(num_vars), outputs[0].flat<float>()(0));
+  }
+
+  const int64 rpcs_before = RecvTensorRpcs();
+  testing::StartTiming();
+  for (int i = 0; i < iters; i++) {
+    outputs.clear();
+    TF_CHECK_OK(session->Run({}, {"y:0"}, {}, &outputs));
+  }
+  testing::StopTiming();
+  testing::SetLabel(strings::StrCat(
+      num_vars, " vars; ",
+      static_cast<double>(RecvTensorRpcs() - rpcs_before) / iters,
+      " recv RPCs/step"));
+  TF_CHECK_OK(session->Close());
+}
+BENCHMARK(BM_ManySmallVariables)
+    ->ArgPair(10, 1)
+    ->ArgPair(10, 16)
+    ->ArgPair(100, 1)
+    ->ArgPair(100, 16)
+    ->ArgPair(100, 128)
+    ->ArgPair(1000, 1)
+    ->ArgPair(1000, 128);
+
 }  // namespace tensorflow
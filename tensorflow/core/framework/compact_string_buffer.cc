@@ -0,0 +1,78 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/framework/compact_string_buffer.h"
+
+#include "tensorflow/core/lib/core/coding.h"
+
+namespace tensorflow {
+
+void CompactStringBuffer::AppendTensor(const Tensor& t) {
+  CHECK_EQ(t.dtype(), DT_STRING);
+  const auto strings = t.flat<string>();
+  int64 num_bytes = 0;
+  for (int64 i = 0; i < strings.size(); ++i) num_bytes += strings(i).size();
+  Reserve(strings.size(), num_bytes);
+  for (int64 i = 0; i < strings.size(); ++i) Append(strings(i));
+}
+
+void CompactStringBuffer::CopyToTensor(Tensor* t) const {
+  CHECK_EQ(t->dtype(), DT_STRING);
+  CHECK_EQ(t->NumElements(), size());
+  auto strings = t->flat<string>();
+  for (int64 i = 0; i < size(); ++i) {
+    strings(i).assign(arena_.data() + offsets_[i],
+                      offsets_[i + 1] - offsets_[i]);
+  }
+}
+
+void CompactStringBuffer::EncodeTo(string* out) const {
+  const int64 n = size();
+  int64 table_bytes = 0;
+  for (int64 i = 0; i < n; ++i) {
+    table_bytes += core::VarintLength(offsets_[i + 1] - offsets_[i]);
+  }
+  out->reserve(out->size() + table_bytes + bytes());
+  for (int64 i = 0; i < n; ++i) {
+    core::PutVarint32(out, offsets_[i + 1] - offsets_[i]);
+  }
+  out->append(arena_.data(), bytes());
+}
+
+bool CompactStringBuffer::DecodeFrom(StringPiece in, int64 n) {
+  if (n < 0 || static_cast<uint64>(n) > in.size()) return false;
+  const size_t old_offsets = offsets_.size();
+  offsets_.reserve(old_offsets + n);
+  int64 end = offsets_.back();
+  for (int64 i = 0; i < n; ++i) {
+    uint32 length;
+    if (!core::GetVarint32(&in, &length)) {
+      offsets_.resize(old_offsets);
+      return false;
+    }
+    end += length;
+    offsets_.push_back(end);
+  }
+  if (end - offsets_[old_offsets - 1] != static_cast<int64>(in.size())) {
+    offsets_.resize(old_offsets);
+    return false;
+  }
+  // Drop any pending bytes; the decoded strings start where they did.
+  arena_.resize(offsets_[old_offsets - 1]);
+  arena_.append(in.data(), in.size());
+  return true;
+}
+
+}  // namespace tensorflow
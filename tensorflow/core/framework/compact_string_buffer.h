@@ -0,0 +1,114 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_FRAMEWORK_COMPACT_STRING_BUFFER_H_
+#define TENSORFLOW_CORE_FRAMEWORK_COMPACT_STRING_BUFFER_H_
+
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// A list of strings stored as one contiguous byte arena plus an offsets
+// array, read through StringPiece views.
+//
+// A DT_STRING tensor holds one std::string per element, each with its own
+// heap allocation once it outgrows the small string buffer. Kernels that
+// produce or consume many strings (tokenizers, parsers, serialization) can
+// build their intermediate results here instead: appending is amortized
+// O(1) with no per-string allocation, Clear() keeps the capacity for reuse,
+// and destruction frees two buffers regardless of the number of strings.
+//
+// The buffer converts to and from DT_STRING tensors and from and to the
+// encoding of DT_STRING tensors in TensorProto::tensor_content, which is
+// itself a length table followed by the concatenated bytes.
+class CompactStringBuffer {
+ public:
+  CompactStringBuffer() : offsets_(1, 0) {}
+
+  // Number of strings in the buffer.
+  int64 size() const { return offsets_.size() - 1; }
+  bool empty() const { return size() == 0; }
+
+  // Total number of bytes of all strings.
+  int64 bytes() const { return offsets_.back(); }
+
+  // Returns a view of the i-th string. The view is invalidated by any call
+  // that modifies the buffer.
+  StringPiece operator[](int64 i) const {
+    DCHECK_GE(i, 0);
+    DCHECK_LT(i, size());
+    return StringPiece(arena_.data() + offsets_[i],
+                       offsets_[i + 1] - offsets_[i]);
+  }
+
+  // Reserves room for `num_strings` more strings of `num_bytes` total bytes.
+  void Reserve(int64 num_strings, int64 num_bytes) {
+    offsets_.reserve(offsets_.size() + num_strings);
+    arena_.reserve(arena_.size() + num_bytes);
+  }
+
+  // Appends `s` as a new string.
+  void Append(StringPiece s) {
+    AppendToPending(s);
+    FinishPending();
+  }
+
+  // Builds a string piece by piece: AppendToPending() adds bytes to the
+  // string in progress and FinishPending() adds it to the buffer. Bytes
+  // appended since the last FinishPending() are not visible through
+  // operator[].
+  void AppendToPending(StringPiece s) { arena_.append(s.data(), s.size()); }
+  void AppendToPending(char c) { arena_.push_back(c); }
+  int64 pending_bytes() const { return arena_.size() - offsets_.back(); }
+  void FinishPending() { offsets_.push_back(arena_.size()); }
+  void DiscardPending() { arena_.resize(offsets_.back()); }
+
+  // Removes all strings, keeping the allocated capacity.
+  void Clear() {
+    arena_.clear();
+    offsets_.resize(1);
+  }
+
+  // Appends every element of the DT_STRING tensor `t` in row-major order.
+  void AppendTensor(const Tensor& t);
+
+  // Copies the strings into `t`, which must be a DT_STRING tensor with
+  // size() elements.
+  void CopyToTensor(Tensor* t) const;
+
+  // Appends the strings to `out` in the format of port::EncodeStringList, as
+  // used for TensorProto::tensor_content: the bytes are copied with a single
+  // append after the length table.
+  void EncodeTo(string* out) const;
+
+  // Appends `n` strings decoded from the port::EncodeStringList format.
+  // Returns false and leaves the buffer unchanged if `in` is malformed.
+  bool DecodeFrom(StringPiece in, int64 n);
+
+ private:
+  string arena_;
+  // offsets_[i] is where string i starts; offsets_.back() == bytes() is the
+  // end of the last finished string.
+  std::vector<int64> offsets_;
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_FRAMEWORK_COMPACT_STRING_BUFFER_H_
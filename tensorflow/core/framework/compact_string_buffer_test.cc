@@ -0,0 +1,192 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/framework/compact_string_buffer.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/tensor_coding.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+TEST(CompactStringBufferTest, AppendAndView) {
+  CompactStringBuffer buffer;
+  EXPECT_TRUE(buffer.empty());
+  buffer.Append("hello");
+  buffer.Append("");
+  buffer.AppendToPending("wor");
+  buffer.AppendToPending('l');
+  EXPECT_EQ(4, buffer.pending_bytes());
+  EXPECT_EQ(2, buffer.size());
+  buffer.AppendToPending("d");
+  buffer.FinishPending();
+  buffer.AppendToPending("dropped");
+  buffer.DiscardPending();
+
+  ASSERT_EQ(3, buffer.size());
+  EXPECT_EQ(10, buffer.bytes());
+  EXPECT_EQ("hello", buffer[0]);
+  EXPECT_EQ("", buffer[1]);
+  EXPECT_EQ("world", buffer[2]);
+
+  buffer.Clear();
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_EQ(0, buffer.bytes());
+  buffer.Append("again");
+  EXPECT_EQ("again", buffer[0]);
+}
+
+TEST(CompactStringBufferTest, TensorRoundTrip) {
+  Tensor input = test::AsTensor<string>({"a", "", "bcd", "efgh"}, {2, 2});
+  CompactStringBuffer buffer;
+  buffer.AppendTensor(input);
+  ASSERT_EQ(4, buffer.size());
+  EXPECT_EQ("bcd", buffer[2]);
+
+  Tensor output(DT_STRING, TensorShape({2, 2}));
+  buffer.CopyToTensor(&output);
+  test::ExpectTensorEqual<string>(input, output);
+}
+
+TEST(CompactStringBufferTest, EncodingMatchesTensorContent) {
+  std::vector<string> strings = {"x", "", string(300, 'y'), "zz"};
+  string expected;
+  port::EncodeStringList(strings.data(), strings.size(), &expected);
+
+  CompactStringBuffer buffer;
+  for (const string& s : strings) buffer.Append(s);
+  string encoded;
+  buffer.EncodeTo(&encoded);
+  EXPECT_EQ(expected, encoded);
+
+  CompactStringBuffer decoded;
+  decoded.Append("prefix");
+  ASSERT_TRUE(decoded.DecodeFrom(encoded, strings.size()));
+  ASSERT_EQ(5, decoded.size());
+  EXPECT_EQ("prefix", decoded[0]);
+  for (size_t i = 0; i < strings.size(); ++i) {
+    EXPECT_EQ(strings[i], decoded[i + 1]);
+  }
+}
+
+TEST(CompactStringBufferTest, DecodeRejectsMalformedInput) {
+  CompactStringBuffer buffer;
+  buffer.Append("a");
+  buffer.Append("bc");
+  string encoded;
+  buffer.EncodeTo(&encoded);
+
+  CompactStringBuffer decoded;
+  decoded.Append("keep");
+  EXPECT_FALSE(decoded.DecodeFrom(encoded, 3));
+  EXPECT_FALSE(decoded.DecodeFrom(encoded.substr(0, encoded.size() - 1), 2));
+  EXPECT_FALSE(decoded.DecodeFrom(encoded + "x", 2));
+  EXPECT_FALSE(decoded.DecodeFrom(encoded, -1));
+  ASSERT_EQ(1, decoded.size());
+  EXPECT_EQ("keep", decoded[0]);
+}
+
+// Returns `num_sentences` sentences of 32 short words.
+std::vector<string> MakeSentences(int num_sentences) {
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  std::vector<string> sentences(num_sentences);
+  for (string& sentence : sentences) {
+    for (int w = 0; w < 32; ++w) {
+      if (w > 0) sentence.push_back(' ');
+      sentence.append(2 + rnd.Uniform(20), 'a' + rnd.Uniform(26));
+    }
+  }
+  return sentences;
+}
+
+// Splits a sentence into words, the way a text input pipeline does before
+// looking up its vocabulary.
+template <typename Fn>
+void ForEachWord(StringPiece sentence, Fn fn) {
+  while (!sentence.empty()) {
+    const size_t end = std::min(sentence.find(' '), sentence.size());
+    fn(sentence.substr(0, end));
+    sentence.remove_prefix(std::min(end + 1, sentence.size()));
+  }
+}
+
+static void BM_TokenizeToStrings(int iters) {
+  testing::StopTiming();
+  const std::vector<string> sentences = MakeSentences(1024);
+  testing::StartTiming();
+  int64 tokens = 0;
+  for (int i = 0; i < iters; ++i) {
+    std::vector<string> words;
+    for (const string& sentence : sentences) {
+      ForEachWord(sentence, [&words](StringPiece word) {
+        words.emplace_back(word.data(), word.size());
+      });
+    }
+    tokens += words.size();
+  }
+  testing::ItemsProcessed(tokens);
+}
+BENCHMARK(BM_TokenizeToStrings);
+
+static void BM_TokenizeToCompactBuffer(int iters) {
+  testing::StopTiming();
+  const std::vector<string> sentences = MakeSentences(1024);
+  testing::StartTiming();
+  int64 tokens = 0;
+  for (int i = 0; i < iters; ++i) {
+    CompactStringBuffer words;
+    for (const string& sentence : sentences) {
+      ForEachWord(sentence, [&words](StringPiece word) { words.Append(word); });
+    }
+    tokens += words.size();
+  }
+  testing::ItemsProcessed(tokens);
+}
+BENCHMARK(BM_TokenizeToCompactBuffer);
+
+static void BM_EncodeStringTensor(int iters) {
+  testing::StopTiming();
+  const std::vector<string> sentences = MakeSentences(1024);
+  testing::StartTiming();
+  string out;
+  for (int i = 0; i < iters; ++i) {
+    port::EncodeStringList(sentences.data(), sentences.size(), &out);
+  }
+  testing::BytesProcessed(static_cast<int64>(iters) * out.size());
+}
+BENCHMARK(BM_EncodeStringTensor);
+
+static void BM_EncodeCompactBuffer(int iters) {
+  testing::StopTiming();
+  CompactStringBuffer buffer;
+  for (const string& sentence : MakeSentences(1024)) buffer.Append(sentence);
+  testing::StartTiming();
+  string out;
+  for (int i = 0; i < iters; ++i) {
+    out.clear();
+    buffer.EncodeTo(&out);
+  }
+  testing::BytesProcessed(static_cast<int64>(iters) * out.size());
+}
+BENCHMARK(BM_EncodeCompactBuffer);
+
+}  // namespace
+}  // namespace tensorflow
@@ -48,6 +48,9 @@ class Rendezvous : public core::RefCounted {
   struct Args {
     DeviceContext* device_context = nullptr;
     AllocatorAttributes alloc_attrs;
+    // How urgently a Recv needs its tensor. Rendezvous that receive tensors
+    // from other processes may pass this on to the sender.
+    int64 priority = 0;
   };
 
   // Constructs a rendezvous key for the tensor of "name" sent from
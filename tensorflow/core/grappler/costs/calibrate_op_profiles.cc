@@ -0,0 +1,252 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Measures common ops on the local CPU over a range of shapes and stores their
+// execution times in an OpProfileDatabase, for the OpLevelCostEstimator to
+// use instead of its analytical estimates, e.g.
+//
+//   bazel run -c opt //tensorflow/core/grappler/costs:calibrate_op_profiles \
+//     -- --output=/tmp/op_profiles.pb
+//   TF_OP_PROFILE_DATABASE=/tmp/op_profiles.pb python model.py
+//
+// Profiles depend on the number of intra-op threads the ops run with, so
+// calibrate with the settings the models are deployed with.
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/cc/framework/scope.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/grappler/costs/op_profile_database.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/public/session.h"
+#include "tensorflow/core/util/command_line_flags.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+// Adds the op to calibrate to a graph, given its inputs.
+typedef std::function<Output(const Scope&, const std::vector<Output>&)>
+    OpBuilder;
+
+struct OpCase {
+  OpBuilder build;
+  std::vector<TensorShape> input_shapes;
+};
+
+std::vector<OpCase> CalibrationSuite() {
+  std::vector<OpCase> suite;
+  // Number of elements of the inputs of elementwise ops and reductions.
+  const std::vector<int64> kSizes = {1 << 10, 1 << 14, 1 << 18, 1 << 22};
+  auto matrix = [](int64 size) { return TensorShape({size / 64, 64}); };
+
+  const std::vector<OpBuilder> unary_ops = {
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Relu(s, x[0]);
+      },
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Tanh(s, x[0]);
+      },
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Sigmoid(s, x[0]);
+      },
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Exp(s, x[0]);
+      },
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Square(s, x[0]);
+      },
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Sum(s, x[0], 1);
+      },
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Transpose(s, x[0], {1, 0});
+      },
+  };
+  const std::vector<OpBuilder> binary_ops = {
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Add(s, x[0], x[1]);
+      },
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Mul(s, x[0], x[1]);
+      },
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Maximum(s, x[0], x[1]);
+      },
+      [](const Scope& s, const std::vector<Output>& x) {
+        return ops::Concat(s, {x[0], x[1]}, 0);
+      },
+  };
+  for (int64 size : kSizes) {
+    for (const auto& op : unary_ops) {
+      suite.push_back({op, {matrix(size)}});
+    }
+    for (const auto& op : binary_ops) {
+      suite.push_back({op, {matrix(size), matrix(size)}});
+    }
+    suite.push_back({[](const Scope& s, const std::vector<Output>& x) {
+                       return ops::BiasAdd(s, x[0], x[1]);
+                     },
+                     {matrix(size), TensorShape({64})}});
+  }
+
+  for (int64 batch : {1, 16, 256}) {
+    suite.push_back({[](const Scope& s, const std::vector<Output>& x) {
+                       return ops::Softmax(s, x[0]);
+                     },
+                     {TensorShape({batch, 1000})}});
+  }
+
+  const OpBuilder matmul = [](const Scope& s, const std::vector<Output>& x) {
+    return ops::MatMul(s, x[0], x[1]);
+  };
+  for (int64 n : {32, 64, 128, 256, 512, 1024}) {
+    suite.push_back({matmul, {TensorShape({n, n}), TensorShape({n, n})}});
+  }
+  for (int64 batch : {1, 32}) {
+    suite.push_back(
+        {matmul, {TensorShape({batch, 1024}), TensorShape({1024, 1024})}});
+  }
+
+  const OpBuilder conv = [](const Scope& s, const std::vector<Output>& x) {
+    return ops::Conv2D(s, x[0], x[1], {1, 1, 1, 1}, "SAME");
+  };
+  const std::vector<std::pair<TensorShape, TensorShape>> conv_shapes = {
+      {TensorShape({1, 56, 56, 64}), TensorShape({3, 3, 64, 64})},
+      {TensorShape({8, 56, 56, 64}), TensorShape({3, 3, 64, 64})},
+      {TensorShape({1, 56, 56, 64}), TensorShape({1, 1, 64, 256})},
+      {TensorShape({1, 28, 28, 128}), TensorShape({3, 3, 128, 128})},
+      {TensorShape({1, 14, 14, 256}), TensorShape({3, 3, 256, 256})},
+      {TensorShape({1, 7, 7, 512}), TensorShape({3, 3, 512, 512})},
+  };
+  for (const auto& shapes : conv_shapes) {
+    suite.push_back({conv, {shapes.first, shapes.second}});
+  }
+
+  for (int64 batch : {1, 8}) {
+    const TensorShape input({batch, 56, 56, 64});
+    suite.push_back({[](const Scope& s, const std::vector<Output>& x) {
+                       return ops::MaxPool(s, x[0], {1, 3, 3, 1}, {1, 2, 2, 1},
+                                           "SAME");
+                     },
+                     {input}});
+    suite.push_back({[](const Scope& s, const std::vector<Output>& x) {
+                       return ops::AvgPool(s, x[0], {1, 3, 3, 1}, {1, 2, 2, 1},
+                                           "SAME");
+                     },
+                     {input}});
+  }
+  return suite;
+}
+
+// Runs `op_case` on random inputs and records the traced op times of
+// `iterations` runs, after `warmup` untraced ones.
+Status Calibrate(const OpCase& op_case, const SessionOptions& options,
+                 int warmup, int iterations, OpProfileDatabase* profiles) {
+  Scope root = Scope::NewRootScope();
+  std::vector<Output> inputs;
+  for (const TensorShape& shape : op_case.input_shapes) {
+    Tensor dims(DT_INT64, TensorShape({shape.dims()}));
+    for (int d = 0; d < shape.dims(); ++d) {
+      dims.vec<int64>()(d) = shape.dim_size(d);
+    }
+    inputs.push_back(
+        ops::RandomUniform(root, ops::Const(root, dims), DT_FLOAT));
+  }
+  const Output op = op_case.build(root, inputs);
+  GraphDef graph;
+  TF_RETURN_IF_ERROR(root.ToGraphDef(&graph));
+
+  std::unique_ptr<Session> session(NewSession(options));
+  if (session == nullptr) {
+    return errors::Internal("Failed to create a session");
+  }
+  TF_RETURN_IF_ERROR(session->Create(graph));
+  const std::vector<string> targets = {op.node()->name()};
+  for (int i = 0; i < warmup; ++i) {
+    TF_RETURN_IF_ERROR(session->Run({}, {}, targets, nullptr));
+  }
+  RunOptions run_options;
+  run_options.set_trace_level(RunOptions::FULL_TRACE);
+  for (int i = 0; i < iterations; ++i) {
+    RunMetadata run_metadata;
+    TF_RETURN_IF_ERROR(
+        session->Run(run_options, {}, {}, targets, nullptr, &run_metadata));
+    profiles->AddStepStats(graph, run_metadata.step_stats());
+  }
+  return session->Close();
+}
+
+int Main(int argc, char** argv) {
+  string output;
+  bool append = false;
+  int32 warmup = 3;
+  int32 iterations = 20;
+  int32 intra_op_threads = 0;
+  std::vector<Flag> flag_list = {
+      Flag("output", &output, "file to write the op profiles to"),
+      Flag("append", &append,
+           "whether to add to the profiles already stored in --output"),
+      Flag("warmup", &warmup, "untraced runs before measuring each op"),
+      Flag("iterations", &iterations, "measured runs of each op"),
+      Flag("intra_op_parallelism_threads", &intra_op_threads,
+           "intra-op threads to run the ops with, 0 for the default"),
+  };
+  const string usage = Flags::Usage(argv[0], flag_list);
+  const bool parse_result = Flags::Parse(&argc, argv, flag_list);
+  port::InitMain(argv[0], &argc, &argv);
+  if (!parse_result || output.empty()) {
+    LOG(ERROR) << usage;
+    return -1;
+  }
+
+  OpProfileDatabase profiles;
+  if (append && Env::Default()->FileExists(output).ok()) {
+    TF_CHECK_OK(profiles.Load(output));
+  }
+  SessionOptions options;
+  options.config.set_intra_op_parallelism_threads(intra_op_threads);
+  options.config.set_inter_op_parallelism_threads(1);
+
+  const std::vector<OpCase> suite = CalibrationSuite();
+  for (int i = 0; i < suite.size(); ++i) {
+    const Status s =
+        Calibrate(suite[i], options, warmup, iterations, &profiles);
+    if (!s.ok()) {
+      LOG(ERROR) << "Failed to calibrate case " << i << ": " << s;
+      return -1;
+    }
+  }
+  TF_CHECK_OK(profiles.Save(output));
+  LOG(INFO) << "Wrote " << profiles.size() << " op profiles to " << output;
+  return 0;
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
+
+int main(int argc, char** argv) {
+  return tensorflow::grappler::Main(argc, argv);
+}
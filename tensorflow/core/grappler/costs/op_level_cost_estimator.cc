@@ -32,6 +32,8 @@ constexpr char kConv2d[] = "Conv2D";
 constexpr char kConv2dBackpropFilter[] = "Conv2DBackpropFilter";
 constexpr char kConv2dBackpropInput[] = "Conv2DBackpropInput";
 constexpr char kFusedConv2dBiasActivation[] = "FusedConv2DBiasActivation";
+constexpr char kFusedConv2d[] = "_FusedConv2D";
+constexpr char kBlockedConv2d[] = "_BlockedConv2D";
 constexpr char kDepthwiseConv2dNative[] = "DepthwiseConv2dNative";
 constexpr char kDepthwiseConv2dNativeBackpropFilter[] =
     "DepthwiseConv2dNativeBackpropFilter";
@@ -62,6 +64,11 @@ constexpr char kMaxPool[] = "MaxPool";
 constexpr char kMaxPoolGrad[] = "MaxPoolGrad";
 constexpr char kAvgPool[] = "AvgPool";
 constexpr char kAvgPoolGrad[] = "AvgPoolGrad";
+constexpr char kBlockedMaxPool[] = "_BlockedMaxPool";
+constexpr char kBlockedAvgPool[] = "_BlockedAvgPool";
+constexpr char kToBlockedLayout[] = "_ToBlockedLayout";
+constexpr char kFromBlockedLayout[] = "_FromBlockedLayout";
+constexpr char kToBlockedFilter[] = "_ToBlockedFilter";
 constexpr char kFusedBatchNorm[] = "FusedBatchNorm";
 constexpr char kFusedBatchNormGrad[] = "FusedBatchNormGrad";
 
@@ -158,6 +165,39 @@ int64 CwiseOutputElementCount(const TensorShapeProto& input_shape_1,
   return count;
 }
 
+// Describes the blocked activation `blocked`, [N, C / b, H, W, b], as the
+// NHWC tensor of all its channels, padding included, which the cost model
+// can handle like any other activation.
+OpInfo::TensorProperties UnblockedActivation(
+    const OpInfo::TensorProperties& blocked, bool* found_unknown_shapes) {
+  const TensorShapeProto shape =
+      MaybeGetMinimumShape(blocked.shape(), 5, found_unknown_shapes);
+  OpInfo::TensorProperties nhwc;
+  nhwc.set_dtype(blocked.dtype());
+  for (int64 size : {shape.dim(0).size(), shape.dim(2).size(),
+                     shape.dim(3).size(),
+                     shape.dim(1).size() * shape.dim(4).size()}) {
+    nhwc.mutable_shape()->add_dim()->set_size(size);
+  }
+  return nhwc;
+}
+
+// Same as UnblockedActivation for a blocked filter, [O / b, I / b, H, W, b,
+// b], described as an HWIO filter.
+OpInfo::TensorProperties UnblockedFilter(
+    const OpInfo::TensorProperties& blocked, bool* found_unknown_shapes) {
+  const TensorShapeProto shape =
+      MaybeGetMinimumShape(blocked.shape(), 6, found_unknown_shapes);
+  OpInfo::TensorProperties hwio;
+  hwio.set_dtype(blocked.dtype());
+  for (int64 size : {shape.dim(2).size(), shape.dim(3).size(),
+                     shape.dim(1).size() * shape.dim(4).size(),
+                     shape.dim(0).size() * shape.dim(5).size()}) {
+    hwio.mutable_shape()->add_dim()->set_size(size);
+  }
+  return hwio;
+}
+
 }  // namespace
 
 // Return a minimum shape if the shape is unknown. If known, return the original
@@ -206,6 +246,8 @@ OpLevelCostEstimator::OpLevelCostEstimator() {
        wrap(&OpLevelCostEstimator::PredictConv2DBackpropInput)},
       {kFusedConv2dBiasActivation,
        wrap(&OpLevelCostEstimator::PredictFusedConv2DBiasActivation)},
+      {kFusedConv2d, wrap(&OpLevelCostEstimator::PredictFusedConv2D)},
+      {kBlockedConv2d, wrap(&OpLevelCostEstimator::PredictBlockedConv2D)},
       // reuse Conv2D for DepthwiseConv2dNative because the caculation is the
       // same although the actual meaning of the parameters are different. See
       // comments in PredictConv2D and related functions
@@ -246,6 +288,11 @@ OpLevelCostEstimator::OpLevelCostEstimator() {
       {kMaxPoolGrad, wrap(&OpLevelCostEstimator::PredictMaxPoolGrad)},
       {kAvgPool, wrap(&OpLevelCostEstimator::PredictAvgPool)},
       {kAvgPoolGrad, wrap(&OpLevelCostEstimator::PredictAvgPoolGrad)},
+      {kBlockedMaxPool, wrap(&OpLevelCostEstimator::PredictBlockedPool)},
+      {kBlockedAvgPool, wrap(&OpLevelCostEstimator::PredictBlockedPool)},
+      {kToBlockedLayout, wrap(&OpLevelCostEstimator::PredictDataMovement)},
+      {kFromBlockedLayout, wrap(&OpLevelCostEstimator::PredictDataMovement)},
+      {kToBlockedFilter, wrap(&OpLevelCostEstimator::PredictDataMovement)},
       {kFusedBatchNorm, wrap(&OpLevelCostEstimator::PredictFusedBatchNorm)},
       {kFusedBatchNormGrad,
        wrap(&OpLevelCostEstimator::PredictFusedBatchNormGrad)},
@@ -287,6 +334,8 @@ OpLevelCostEstimator::OpLevelCostEstimator() {
                       {"Square", EIGEN_COST(scalar_square_op<float>)},
                       {"Tanh", EIGEN_COST(scalar_tanh_op<float>)},
                       {"Relu", EIGEN_COST(scalar_max_op<float>)},
+                      {"Relu6", EIGEN_COST(scalar_max_op<float>) +
+                                    EIGEN_COST(scalar_min_op<float>)},
                       {"Sigmoid", EIGEN_COST(scalar_sigmoid_op<float>)},
                       {"Sign", EIGEN_COST(scalar_sign_op<float>)},
                       {"Sin", EIGEN_COST(scalar_sin_op<float>)},
@@ -324,23 +373,34 @@ OpLevelCostEstimator::OpLevelCostEstimator() {
 
   // By default, use sum of memory_time and compute_time for execution_time.
   compute_memory_overlap_ = false;
+  profiles_ = OpProfileDatabase::FromEnvironment();
 }
 
 Costs OpLevelCostEstimator::PredictCosts(const OpContext& op_context) const {
   const auto& op_features = op_context.op_info;
+  Costs costs;
   auto it = device_cost_impl_.find(op_features.op());
-  if (it == device_cost_impl_.end()) {
-    if (elementwise_ops_.find(op_features.op()) != elementwise_ops_.end()) {
-      return PredictCwiseOp(op_context);
-    }
-
+  if (it != device_cost_impl_.end()) {
+    std::function<Costs(const OpContext&)> estimator = it->second;
+    costs = estimator(op_context);
+  } else if (elementwise_ops_.find(op_features.op()) !=
+             elementwise_ops_.end()) {
+    costs = PredictCwiseOp(op_context);
+  } else {
     VLOG(1) << "Missing accurate estimator for op: " << op_features.op();
-
-    return PredictCostOfAnUnknownOp(op_context);
+    costs = PredictCostOfAnUnknownOp(op_context);
   }
 
-  std::function<Costs(const OpContext&)> estimator = it->second;
-  Costs costs = estimator(op_context);
+  // Measured times take precedence over the roofline model, which doesn't
+  // know the actual efficiency of the kernels on this hardware.
+  Costs::Duration measured_time;
+  if (profiles_ != nullptr &&
+      profiles_->Lookup(op_features, &measured_time)) {
+    costs.execution_time = measured_time;
+    costs.compute_time = measured_time;
+    costs.memory_time = Costs::Duration::zero();
+    costs.inaccurate = false;
+  }
   VLOG(1) << "Operation " << op_features.op() << " takes "
           << costs.execution_time.count() << " ns.";
   return costs;
@@ -1117,6 +1177,122 @@ Costs OpLevelCostEstimator::PredictFusedConv2DBiasActivation(
   return costs;
 }
 
+Costs OpLevelCostEstimator::PredictConv2DWithFusedOps(
+    const OpContext& op_context, const OpInfo::TensorProperties& input,
+    const OpInfo::TensorProperties& filter) const {
+  // The convolution is followed by the ops listed in the fused_ops attr, e.g.
+  // BiasAdd and Relu, which are applied to its output before it is stored:
+  //
+  // Input -> Conv2D  ->  BiasAdd  ->  Relu
+  //            ^            ^
+  //          Filter       Bias
+  const auto& op_info = op_context.op_info;
+  bool found_unknown_shapes = false;
+  const auto dims = ConvolutionDimensionsFromInputs(
+      input.shape(), filter.shape(), op_info, &found_unknown_shapes);
+  const OpInfo::TensorProperties output = DescribeTensor(
+      input.dtype(), {dims.batch, dims.ox, dims.oy, dims.oz});
+
+  std::vector<OpContext> component_ops = {
+      FusedChildContext(op_context, "Conv2D", output, {input, filter})};
+  std::vector<string> fused_ops;
+  if (op_info.attr().count("fused_ops") > 0) {
+    for (const string& fused_op : op_info.attr().at("fused_ops").list().s()) {
+      fused_ops.push_back(fused_op);
+    }
+  }
+  for (const string& fused_op : fused_ops) {
+    if (fused_op == "BiasAdd" && op_info.inputs_size() > 2) {
+      component_ops.push_back(FusedChildContext(op_context, fused_op, output,
+                                                {output, op_info.inputs(2)}));
+    } else {
+      component_ops.push_back(
+          FusedChildContext(op_context, fused_op, output, {output}));
+    }
+  }
+
+  // Construct an op_context which definitely has our input and output shapes.
+  auto op_context_with_shapes = op_context;
+  auto* inputs = op_context_with_shapes.op_info.mutable_inputs();
+  *inputs->Mutable(0) = input;
+  *inputs->Mutable(1) = filter;
+  op_context_with_shapes.op_info.mutable_outputs()->Clear();
+  *op_context_with_shapes.op_info.mutable_outputs()->Add() = output;
+
+  auto costs = PredictFusedOp(op_context_with_shapes, component_ops);
+  costs.inaccurate |= found_unknown_shapes;
+  return costs;
+}
+
+Costs OpLevelCostEstimator::PredictFusedConv2D(
+    const OpContext& op_context) const {
+  // _FusedConv2D computes the convolution as a matrix multiplication of the
+  // patches of the input (im2col), which it writes and reads back in chunks
+  // unless the convolution is pointwise.
+  const auto& op_info = op_context.op_info;
+  Costs costs = PredictConv2DWithFusedOps(op_context, op_info.inputs(0),
+                                          op_info.inputs(1));
+  bool found_unknown_shapes = false;
+  const auto dims = ConvolutionDimensionsFromInputs(
+      op_info.inputs(0).shape(), op_info.inputs(1).shape(), op_info,
+      &found_unknown_shapes);
+  if (dims.kx != 1 || dims.ky != 1 || dims.sx != 1 || dims.sy != 1) {
+    const double patches_size =
+        DataTypeSize(BaseType(op_info.inputs(0).dtype())) * dims.batch *
+        dims.ox * dims.oy * dims.kx * dims.ky * dims.iz;
+    const DeviceInfo device_info = GetDeviceInfo(op_info.device());
+    costs.memory_time += Costs::NanoSeconds(
+        std::ceil(2 * patches_size / device_info.gb_per_sec));
+    CombineCostsAndUpdateExecutionTime(&costs);
+  }
+  return costs;
+}
+
+Costs OpLevelCostEstimator::PredictBlockedConv2D(
+    const OpContext& op_context) const {
+  // _BlockedConv2D convolves blocked tensors directly. It computes the padding
+  // channels of its blocks like the others.
+  const auto& op_info = op_context.op_info;
+  bool found_unknown_shapes = false;
+  const auto input =
+      UnblockedActivation(op_info.inputs(0), &found_unknown_shapes);
+  const auto filter = UnblockedFilter(op_info.inputs(1), &found_unknown_shapes);
+  auto costs = PredictConv2DWithFusedOps(op_context, input, filter);
+  costs.inaccurate |= found_unknown_shapes;
+  return costs;
+}
+
+Costs OpLevelCostEstimator::PredictBlockedPool(
+    const OpContext& op_context) const {
+  // The blocked pooling ops cost as much as MaxPool or AvgPool on all the
+  // channels of their blocks.
+  bool found_unknown_shapes = false;
+  OpContext nhwc_context = op_context;
+  OpInfo& op_info = nhwc_context.op_info;
+  *op_info.mutable_inputs(0) =
+      UnblockedActivation(op_info.inputs(0), &found_unknown_shapes);
+  for (auto& output : *op_info.mutable_outputs()) {
+    output = UnblockedActivation(output, &found_unknown_shapes);
+  }
+  Costs costs;
+  if (op_info.op() == kBlockedMaxPool) {
+    op_info.set_op(kMaxPool);
+    costs = PredictMaxPool(nhwc_context);
+  } else {
+    op_info.set_op(kAvgPool);
+    costs = PredictAvgPool(nhwc_context);
+  }
+  costs.inaccurate |= found_unknown_shapes;
+  return costs;
+}
+
+Costs OpLevelCostEstimator::PredictDataMovement(
+    const OpContext& op_context) const {
+  // Ops that only copy or reorder their input are bound by the memory they
+  // read and write.
+  return PredictOpCountBasedCost(0, op_context.op_info);
+}
+
 Costs OpLevelCostEstimator::PredictMatMul(const OpContext& op_context) const {
   const auto& op_features = op_context.op_info;
   bool found_unknown_shapes = false;
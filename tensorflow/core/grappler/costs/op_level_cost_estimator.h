@@ -22,6 +22,7 @@ limitations under the License.
 
 #include "tensorflow/core/grappler/costs/cost_estimator.h"
 #include "tensorflow/core/grappler/costs/op_context.h"
+#include "tensorflow/core/grappler/costs/op_profile_database.h"
 #include "tensorflow/core/grappler/costs/op_performance_data.pb.h"
 #include "tensorflow/core/util/padding.h"
 
@@ -40,6 +41,13 @@ class OpLevelCostEstimator {
 
   virtual Costs PredictCosts(const OpContext& op_context) const;
 
+  // Makes PredictCosts() use the measured execution times of `profiles` for
+  // the ops it has profiled, instead of the analytical estimates. Defaults to
+  // OpProfileDatabase::FromEnvironment(). Does not take ownership.
+  void set_profile_database(const OpProfileDatabase* profiles) {
+    profiles_ = profiles;
+  }
+
   // Basic device performance info, sufficient for roofline estimate.
   struct DeviceInfo {
     double gigaops;     // Billions of operations executed per second.
@@ -161,6 +169,16 @@ class OpLevelCostEstimator {
   Costs PredictAvgPoolGrad(const OpContext& op_context) const;
   Costs PredictFusedBatchNorm(const OpContext& op_context) const;
   Costs PredictFusedBatchNormGrad(const OpContext& op_context) const;
+  Costs PredictFusedConv2D(const OpContext& op_context) const;
+  Costs PredictBlockedConv2D(const OpContext& op_context) const;
+  Costs PredictBlockedPool(const OpContext& op_context) const;
+  Costs PredictDataMovement(const OpContext& op_context) const;
+
+  // Predicts the costs of the convolution of `input` by `filter` (NHWC and
+  // HWIO), followed by the ops in the fused_ops attr of `op_context`.
+  Costs PredictConv2DWithFusedOps(const OpContext& op_context,
+                                  const OpInfo::TensorProperties& input,
+                                  const OpInfo::TensorProperties& filter) const;
 
   // Generic cost prediction method for fused operations.
   Costs PredictFusedOp(const OpContext& op_context,
@@ -213,6 +231,8 @@ class OpLevelCostEstimator {
   // If true, assume compute and memory overlap; hence, the op cost is max of
   // compute_time and memory_time, insteaf of sum of those two.
   bool compute_memory_overlap_;
+  // Measured op execution times, may be null.
+  const OpProfileDatabase* profiles_;
 
  private:
   friend class OpLevelCostEstimatorTest;
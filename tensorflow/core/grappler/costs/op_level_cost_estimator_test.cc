@@ -177,6 +177,31 @@ OpContext DescribeFusedConv2DBiasActivation(int batch, int ix, int iy, int iz1,
   return op_context;
 }
 
+// Describes a tensor of arbitrary rank, e.g. in a blocked layout.
+void DescribeTensor(const std::vector<int>& dims,
+                    OpInfo::TensorProperties* tensor) {
+  for (int dim : dims) {
+    tensor->mutable_shape()->add_dim()->set_size(dim);
+  }
+  tensor->set_dtype(DT_FLOAT);
+}
+
+// DescribeFusedConv2D constructs an OpContext for a _FusedConv2D of an input
+// (batch, ix, iy, iz) by a kernel (kx, ky, iz, oz), followed by a BiasAdd and
+// a Relu.
+OpContext DescribeFusedConv2D(int batch, int ix, int iy, int iz, int kx,
+                              int ky, int oz) {
+  OpContext op_context;
+  SetCpuDevice(&op_context.op_info);
+  op_context.op_info.set_op("_FusedConv2D");
+  DescribeTensor4D(batch, ix, iy, iz, op_context.op_info.add_inputs());
+  DescribeTensor4D(kx, ky, iz, oz, op_context.op_info.add_inputs());
+  DescribeTensor1D(oz, op_context.op_info.add_inputs());
+  SetAttrValue(std::vector<string>{"BiasAdd", "Relu"},
+               &(*op_context.op_info.mutable_attr())["fused_ops"]);
+  return op_context;
+}
+
 // DescribeUnaryOp constructs an OpContext for the given operation applied to
 // a 4-tensor with shape (size1, 1, 1, 1).
 OpContext DescribeUnaryOp(const string& op, int size1) {
@@ -568,6 +593,67 @@ TEST_F(OpLevelCostEstimatorTest,
   EXPECT_FALSE(cost.inaccurate);
 }
 
+TEST_F(OpLevelCostEstimatorTest, FusedConv2DExecutionTime) {
+  // The Conv2D of Conv2DExecutionTime, followed by BiasAdd and Relu.
+  auto cost = PredictCosts(DescribeFusedConv2D(16, 19, 19, 48, 5, 5, 256));
+  // The input, filter, bias and output, plus the patches of the input written
+  // and read back.
+  EXPECT_EQ(Costs::Duration(825344 + 5544960), cost.memory_time);
+  EXPECT_EQ(Costs::Duration(354877440 + 2 * 147866), cost.compute_time);
+  EXPECT_EQ(Costs::Duration(361543476), cost.execution_time);
+  EXPECT_FALSE(cost.inaccurate);
+
+  // Pointwise convolutions don't need patches.
+  cost = PredictCosts(DescribeFusedConv2D(16, 19, 19, 48, 1, 1, 256));
+  EXPECT_EQ(Costs::Duration(707380), cost.memory_time);
+}
+
+TEST_F(OpLevelCostEstimatorTest, BlockedConv2DExecutionTime) {
+  // The Conv2D of Conv2DExecutionTime on 40 input channels, in 3 blocks of 16
+  // that cost as much as 48 channels.
+  OpContext op_context;
+  SetCpuDevice(&op_context.op_info);
+  op_context.op_info.set_op("_BlockedConv2D");
+  DescribeTensor({16, 3, 19, 19, 16}, op_context.op_info.add_inputs());
+  DescribeTensor({16, 3, 5, 5, 16, 16}, op_context.op_info.add_inputs());
+  auto cost = PredictCosts(op_context);
+  // Unlike DescribeConvolution, the prediction includes the output.
+  EXPECT_EQ(Costs::Duration(825242), cost.memory_time);
+  EXPECT_EQ(Costs::Duration(354877440), cost.compute_time);
+  EXPECT_EQ(Costs::Duration(355702682), cost.execution_time);
+  EXPECT_FALSE(cost.inaccurate);
+}
+
+TEST_F(OpLevelCostEstimatorTest, BlockedPoolingAndConversions) {
+  // The 3x3 MaxPool with 2x2 stride of PredictMaxPool, on 24 blocks of 16
+  // channels.
+  OpContext op_context;
+  SetCpuDevice(&op_context.op_info);
+  op_context.op_info.set_op("_BlockedMaxPool");
+  DescribeTensor({10, 24, 20, 20, 16}, op_context.op_info.add_inputs());
+  DescribeTensor({10, 24, 10, 10, 16}, op_context.op_info.add_outputs());
+  auto* attr = op_context.op_info.mutable_attr();
+  SetAttrValue("SAME", &(*attr)["padding"]);
+  SetAttrValue(std::vector<int>{1, 2, 2, 1}, &(*attr)["strides"]);
+  SetAttrValue(std::vector<int>{1, 3, 3, 1}, &(*attr)["ksize"]);
+  auto cost = PredictCosts(op_context);
+  EXPECT_EQ(Costs::Duration(1075200), cost.execution_time);
+  EXPECT_EQ(Costs::Duration(307200), cost.compute_time);
+  EXPECT_EQ(Costs::Duration(768000), cost.memory_time);
+  EXPECT_FALSE(cost.inaccurate);
+
+  // Layout conversions only cost the memory they read and write.
+  op_context = OpContext();
+  SetCpuDevice(&op_context.op_info);
+  op_context.op_info.set_op("_ToBlockedLayout");
+  DescribeTensor4D(1, 56, 56, 64, op_context.op_info.add_inputs());
+  DescribeTensor({1, 4, 56, 56, 16}, op_context.op_info.add_outputs());
+  cost = PredictCosts(op_context);
+  EXPECT_EQ(Costs::Duration(160564), cost.memory_time);
+  EXPECT_EQ(Costs::Duration(0), cost.compute_time);
+  EXPECT_FALSE(cost.inaccurate);
+}
+
 TEST_F(OpLevelCostEstimatorTest, MulExecutionTime) {
   auto cost = PredictCosts(DescribeBinaryOp("Mul", 1000, 1));
   EXPECT_EQ(Costs::Duration(2000), cost.memory_time);
@@ -932,5 +1018,29 @@ TEST_F(OpLevelCostEstimatorTest, PredictFusedBatchNormGrad) {
     EXPECT_FALSE(costs.inaccurate);
   }
 }
+
+TEST_F(OpLevelCostEstimatorTest, MeasuredProfilesOverrideEstimates) {
+  OpProfileDatabase profiles;
+  profiles.Add(DescribeMatMul(2, 4, 7, 7).op_info, Costs::Duration(12345));
+  // Unknown to the roofline model.
+  OpContext unknown_op = DescribeUnaryOp("Erfc", 1000);
+  profiles.Add(unknown_op.op_info, Costs::Duration(4000));
+  estimator_.set_profile_database(&profiles);
+
+  auto cost = PredictCosts(DescribeMatMul(2, 4, 7, 7));
+  EXPECT_EQ(Costs::Duration(12345), cost.execution_time);
+  EXPECT_EQ(Costs::Duration(12345), cost.compute_time);
+  EXPECT_EQ(Costs::Duration(0), cost.memory_time);
+  EXPECT_FALSE(cost.inaccurate);
+
+  cost = PredictCosts(DescribeUnaryOp("Erfc", 2000));
+  EXPECT_EQ(Costs::Duration(8000), cost.execution_time);
+  EXPECT_FALSE(cost.inaccurate);
+
+  // Ops without profiles still use the analytical model.
+  cost = PredictCosts(DescribeUnaryOp("Relu", 1000));
+  EXPECT_EQ(Costs::Duration(900), cost.execution_time);
+  estimator_.set_profile_database(nullptr);
+}
 }  // end namespace grappler
 }  // end namespace tensorflow
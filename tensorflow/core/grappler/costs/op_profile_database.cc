@@ -0,0 +1,347 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/costs/op_profile_database.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/tensor_id.h"
+#include "tensorflow/core/grappler/costs/utils.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/device_name_utils.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tensorflow/core/util/overflow.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+
+// Constant inputs with at most this many integer values (e.g. reduction
+// axes or permutations) are part of the op signature.
+constexpr int kMaxSignatureValues = 8;
+
+// Bounds on the log-log slope used to extrapolate beyond the profiled sizes:
+// time never decreases with size, and grows at most quadratically.
+constexpr double kMinSlope = 0.0;
+constexpr double kMaxSlope = 2.0;
+
+// The tensors whose shapes identify a profile: the inputs, or the outputs of
+// ops without inputs.
+const protobuf::RepeatedPtrField<OpInfo::TensorProperties>& ProfiledTensors(
+    const OpInfo& op_info) {
+  return op_info.inputs_size() > 0 ? op_info.inputs() : op_info.outputs();
+}
+
+bool IsSignatureValue(const OpInfo::TensorProperties& tensor) {
+  return tensor.has_value() && DataTypeIsInteger(tensor.dtype()) &&
+         tensor.value().tensor_shape().dim_size() <= 1;
+}
+
+// Computes the signature of `op_info` (everything but its shapes), the key of
+// its exact shapes, and its total input size. Returns false if some shape
+// isn't fully defined, or the total size overflows.
+bool GetProfileKeys(const OpInfo& op_info, string* signature, string* shapes,
+                    int64* size) {
+  *signature = strings::StrCat(op_info.op(), ";", op_info.device().type());
+  std::vector<string> attr_names;
+  for (const auto& attr : op_info.attr()) {
+    if (!str_util::StartsWith(attr.first, "_") &&
+        attr.second.value_case() != AttrValue::kTensor) {
+      attr_names.push_back(attr.first);
+    }
+  }
+  std::sort(attr_names.begin(), attr_names.end());
+  for (const string& name : attr_names) {
+    strings::StrAppend(signature, ";", name, "=",
+                       SummarizeAttrValue(op_info.attr().at(name)));
+  }
+
+  shapes->clear();
+  *size = 0;
+  for (const auto& tensor : ProfiledTensors(op_info)) {
+    if (tensor.shape().unknown_rank()) {
+      return false;
+    }
+    int64 num_elements = 1;
+    for (const auto& dim : tensor.shape().dim()) {
+      if (dim.size() < 0) {
+        return false;
+      }
+      num_elements = MultiplyWithoutOverflow(num_elements, dim.size());
+      if (num_elements < 0) {
+        return false;
+      }
+    }
+    if (*size > std::numeric_limits<int64>::max() - num_elements) {
+      return false;
+    }
+    *size += num_elements;
+    strings::StrAppend(signature, ";", DataTypeString(tensor.dtype()), "/",
+                       tensor.shape().dim_size());
+    if (IsSignatureValue(tensor)) {
+      Tensor value;
+      if (value.FromProto(tensor.value()) &&
+          value.NumElements() <= kMaxSignatureValues) {
+        strings::StrAppend(signature, "=",
+                           value.SummarizeValue(kMaxSignatureValues));
+      }
+    }
+    strings::StrAppend(shapes, PartialTensorShape::DebugString(tensor.shape()));
+  }
+  return true;
+}
+
+// Time at `x` of the power law going through (x0, y0) and (x1, y1), i.e. the
+// linear interpolation of the two points on a log-log scale.
+double LogLogInterpolate(double x0, double y0, double x1, double y1, double x,
+                         double min_slope, double max_slope) {
+  x0 = std::max(x0, 1.0);
+  x1 = std::max(x1, 1.0);
+  x = std::max(x, 1.0);
+  double slope = 1.0;
+  if (x0 != x1 && y0 > 0 && y1 > 0) {
+    slope = std::log(y1 / y0) / std::log(x1 / x0);
+  }
+  slope = std::min(std::max(slope, min_slope), max_slope);
+  return y0 * std::pow(x / x0, slope);
+}
+
+}  // namespace
+
+void OpProfileDatabase::Add(const OpInfo& op_info, Costs::Duration time) {
+  Add(op_info, time.count(), 1);
+}
+
+void OpProfileDatabase::Add(const OpPerformanceList& performance) {
+  for (const auto& perf : performance.op_performance()) {
+    Add(perf.op(), perf.compute_cost(), 1);
+  }
+}
+
+void OpProfileDatabase::Add(const OpInfo& op_info, double ns, int64 count) {
+  string signature;
+  string shapes;
+  int64 size;
+  if (!GetProfileKeys(op_info, &signature, &shapes, &size)) {
+    VLOG(2) << "Not profiling " << op_info.op() << " with unknown shapes";
+    return;
+  }
+  Profile& profile = profiles_[strings::StrCat(signature, "@", shapes)];
+  if (profile.sample.count == 0) {
+    // Keep the description of the op, without the tensors that aren't part of
+    // its signature, to save it later.
+    profile.op_info = op_info;
+    auto* attrs = profile.op_info.mutable_attr();
+    for (auto it = attrs->begin(); it != attrs->end();) {
+      if (it->second.value_case() == AttrValue::kTensor) {
+        it = attrs->erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (auto& input : *profile.op_info.mutable_inputs()) {
+      if (!IsSignatureValue(input)) {
+        input.clear_value();
+      }
+    }
+    for (auto& output : *profile.op_info.mutable_outputs()) {
+      output.clear_value();
+    }
+  }
+  profile.sample.Add(ns * count, count);
+  profiles_by_size_[signature][size].Add(ns * count, count);
+}
+
+void OpProfileDatabase::AddStepStats(const GraphDef& graph,
+                                     const StepStats& step_stats) {
+  std::unordered_map<string, const NodeDef*> name_to_node;
+  for (const NodeDef& node : graph.node()) {
+    name_to_node[node.name()] = &node;
+  }
+  std::unordered_map<string, std::vector<OpInfo::TensorProperties>> outputs;
+  for (const auto& dev_stats : step_stats.dev_stats()) {
+    for (const auto& node_stats : dev_stats.node_stats()) {
+      auto& node_outputs = outputs[node_stats.node_name()];
+      for (const auto& output : node_stats.output()) {
+        if (output.slot() < 0) {
+          continue;
+        }
+        if (output.slot() >= node_outputs.size()) {
+          node_outputs.resize(output.slot() + 1);
+        }
+        node_outputs[output.slot()].set_dtype(
+            output.tensor_description().dtype());
+        *node_outputs[output.slot()].mutable_shape() =
+            output.tensor_description().shape();
+      }
+    }
+  }
+
+  for (const auto& dev_stats : step_stats.dev_stats()) {
+    DeviceNameUtils::ParsedName device;
+    if (!DeviceNameUtils::ParseFullName(dev_stats.device(), &device) ||
+        !device.has_type) {
+      continue;
+    }
+    for (const auto& node_stats : dev_stats.node_stats()) {
+      auto node_it = name_to_node.find(node_stats.node_name());
+      if (node_it == name_to_node.end()) {
+        continue;
+      }
+      const NodeDef& node = *node_it->second;
+      std::vector<OpInfo::TensorProperties> inputs;
+      bool known_inputs = true;
+      for (const string& input : node.input()) {
+        if (IsControlInput(input)) {
+          continue;
+        }
+        const TensorId id = ParseTensorName(input);
+        auto it = outputs.find(id.first.ToString());
+        if (it == outputs.end() || id.second >= it->second.size()) {
+          known_inputs = false;
+          break;
+        }
+        inputs.push_back(it->second[id.second]);
+      }
+      if (!known_inputs) {
+        VLOG(2) << "Not profiling " << node.name()
+                << ": the shapes of its inputs weren't traced";
+        continue;
+      }
+      OpInfo op_info = BuildOpInfoWithoutDevice(node, name_to_node, inputs);
+      op_info.mutable_device()->set_type(device.type);
+      for (const auto& output : outputs[node.name()]) {
+        *op_info.add_outputs() = output;
+      }
+      const int64 micros = std::max<int64>(
+          0, node_stats.op_end_rel_micros() - node_stats.op_start_rel_micros());
+      Add(op_info, Costs::NanoSeconds(1e3 * micros));
+    }
+  }
+}
+
+bool OpProfileDatabase::Lookup(const OpInfo& op_info,
+                               Costs::Duration* time) const {
+  string signature;
+  string shapes;
+  int64 size;
+  if (!GetProfileKeys(op_info, &signature, &shapes, &size)) {
+    return false;
+  }
+  auto profile = profiles_.find(strings::StrCat(signature, "@", shapes));
+  if (profile != profiles_.end()) {
+    *time = Costs::NanoSeconds(std::round(profile->second.sample.Mean()));
+    return true;
+  }
+  auto by_size = profiles_by_size_.find(signature);
+  if (by_size == profiles_by_size_.end()) {
+    return false;
+  }
+  const std::map<int64, Sample>& samples = by_size->second;
+
+  double ns;
+  if (samples.size() == 1) {
+    // Assume the time is proportional to the input size.
+    const auto& sample = *samples.begin();
+    ns = LogLogInterpolate(sample.first, sample.second.Mean(), sample.first,
+                           sample.second.Mean(), size, 1.0, 1.0);
+  } else {
+    auto upper = samples.lower_bound(size);
+    if (upper == samples.begin()) {
+      ++upper;
+    } else if (upper == samples.end()) {
+      --upper;
+    }
+    auto lower = std::prev(upper);
+    if (size >= lower->first && size <= upper->first) {
+      ns = LogLogInterpolate(lower->first, lower->second.Mean(), upper->first,
+                             upper->second.Mean(), size,
+                             -std::numeric_limits<double>::infinity(),
+                             std::numeric_limits<double>::infinity());
+    } else {
+      ns = LogLogInterpolate(lower->first, lower->second.Mean(), upper->first,
+                             upper->second.Mean(), size, kMinSlope, kMaxSlope);
+    }
+  }
+  *time = Costs::NanoSeconds(std::round(ns));
+  return true;
+}
+
+OpPerformanceList OpProfileDatabase::ToProto() const {
+  std::vector<string> keys;
+  keys.reserve(profiles_.size());
+  for (const auto& profile : profiles_) {
+    keys.push_back(profile.first);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  OpPerformanceList performance;
+  for (const string& key : keys) {
+    const Profile& profile = profiles_.at(key);
+    OpPerformance* perf = performance.add_op_performance();
+    *perf->mutable_op() = profile.op_info;
+    perf->set_compute_cost(std::llround(profile.sample.Mean()));
+  }
+  return performance;
+}
+
+Status OpProfileDatabase::Load(const string& filename) {
+  OpPerformanceList performance;
+  TF_RETURN_IF_ERROR(ReadBinaryProto(Env::Default(), filename, &performance));
+  Add(performance);
+  return Status::OK();
+}
+
+Status OpProfileDatabase::Save(const string& filename) const {
+  return WriteBinaryProto(Env::Default(), filename, ToProto());
+}
+
+/* static */
+const OpProfileDatabase* OpProfileDatabase::FromEnvironment() {
+  static const OpProfileDatabase* database = []() -> OpProfileDatabase* {
+    string filename;
+    Status s = ReadStringFromEnvVar("TF_OP_PROFILE_DATABASE", "", &filename);
+    if (!s.ok() || filename.empty()) {
+      return nullptr;
+    }
+    OpProfileDatabase* profiles = new OpProfileDatabase;
+    s = profiles->Load(filename);
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to load the op profile database " << filename
+                   << ": " << s;
+      delete profiles;
+      return nullptr;
+    }
+    VLOG(1) << "Loaded " << profiles->size() << " op profiles from "
+            << filename;
+    return profiles;
+  }();
+  return database;
+}
+
+}  // end namespace grappler
+}  // end namespace tensorflow
@@ -0,0 +1,105 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_GRAPPLER_COSTS_OP_PROFILE_DATABASE_H_
+#define TENSORFLOW_CORE_GRAPPLER_COSTS_OP_PROFILE_DATABASE_H_
+
+#include <map>
+#include <unordered_map>
+
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/step_stats.pb.h"
+#include "tensorflow/core/grappler/costs/cost_estimator.h"
+#include "tensorflow/core/grappler/costs/op_performance_data.pb.h"
+#include "tensorflow/core/lib/core/status.h"
+
+namespace tensorflow {
+namespace grappler {
+
+// Measured execution times of ops, keyed by op type, device type, attributes
+// and input shapes.
+//
+// Profiles are looked up by exact input shapes first. Otherwise the time is
+// interpolated, on a log-log scale, between the profiled shapes of the same
+// op, attributes and input ranks that are closest in total input size, which
+// follows both linear (elementwise) and super-linear (matmul, convolution)
+// ops between the profiled sizes.
+//
+// The database is stored as an OpPerformanceList proto, one OpPerformance per
+// profiled shape with its mean compute_cost. Add() and Load() must not run
+// concurrently with Lookup().
+class OpProfileDatabase {
+ public:
+  OpProfileDatabase() {}
+
+  // Records one execution of the op described by `op_info`. The op must have
+  // fully defined input shapes (or output shapes if it has no input), and its
+  // device type set.
+  void Add(const OpInfo& op_info, Costs::Duration time);
+  // Records the compute_cost of every entry of `performance`.
+  void Add(const OpPerformanceList& performance);
+  // Records the op time of every node of `graph` found in `step_stats`, using
+  // the output shapes in the step stats to find the input shapes of the nodes.
+  // The step must have been traced, e.g. with RunOptions::FULL_TRACE.
+  void AddStepStats(const GraphDef& graph, const StepStats& step_stats);
+
+  // Returns the measured or interpolated execution time of the op described
+  // by `op_info`, or false if there is no profile for it.
+  bool Lookup(const OpInfo& op_info, Costs::Duration* time) const;
+
+  // Number of distinct profiled shapes.
+  int size() const { return profiles_.size(); }
+
+  OpPerformanceList ToProto() const;
+  // Profiles loaded from a file count as a single measurement each when more
+  // executions are added.
+  Status Load(const string& filename);
+  Status Save(const string& filename) const;
+
+  // Returns the database stored in the file named by the
+  // TF_OP_PROFILE_DATABASE environment variable, loaded once per process, or
+  // nullptr if the variable is unset or the file can't be read. Graphs that
+  // were optimized with its estimates are cached by the MetaOptimizer under a
+  // key that includes its contents.
+  static const OpProfileDatabase* FromEnvironment();
+
+ private:
+  struct Sample {
+    double total_ns = 0;
+    int64 count = 0;
+
+    void Add(double ns, int64 n) {
+      total_ns += ns;
+      count += n;
+    }
+    double Mean() const { return count > 0 ? total_ns / count : 0; }
+  };
+  struct Profile {
+    OpInfo op_info;
+    Sample sample;
+  };
+
+  void Add(const OpInfo& op_info, double ns, int64 count);
+
+  // Profiles by exact shape.
+  std::unordered_map<string, Profile> profiles_;
+  // Profiles by op signature, then by total input size.
+  std::unordered_map<string, std::map<int64, Sample>> profiles_by_size_;
+};
+
+}  // end namespace grappler
+}  // end namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_GRAPPLER_COSTS_OP_PROFILE_DATABASE_H_
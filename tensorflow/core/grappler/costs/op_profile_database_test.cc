@@ -0,0 +1,175 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/costs/op_profile_database.h"
+
+#include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/function_testlib.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+OpInfo DescribeMatMul(int64 m, int64 k, int64 n, DataType dtype = DT_FLOAT) {
+  OpInfo op_info;
+  op_info.set_op("MatMul");
+  op_info.mutable_device()->set_type("CPU");
+  SetAttrValue(dtype, &(*op_info.mutable_attr())["T"]);
+  SetAttrValue(false, &(*op_info.mutable_attr())["transpose_a"]);
+  for (const auto& dims : {std::make_pair(m, k), std::make_pair(k, n)}) {
+    auto* input = op_info.add_inputs();
+    input->set_dtype(dtype);
+    input->mutable_shape()->add_dim()->set_size(dims.first);
+    input->mutable_shape()->add_dim()->set_size(dims.second);
+  }
+  return op_info;
+}
+
+int64 LookupNanos(const OpProfileDatabase& profiles, const OpInfo& op_info) {
+  Costs::Duration time;
+  if (!profiles.Lookup(op_info, &time)) {
+    return -1;
+  }
+  return time.count();
+}
+
+TEST(OpProfileDatabaseTest, AveragesMeasurementsOfTheSameShape) {
+  OpProfileDatabase profiles;
+  profiles.Add(DescribeMatMul(64, 64, 64), Costs::Duration(100));
+  profiles.Add(DescribeMatMul(64, 64, 64), Costs::Duration(300));
+  EXPECT_EQ(1, profiles.size());
+  EXPECT_EQ(200, LookupNanos(profiles, DescribeMatMul(64, 64, 64)));
+}
+
+TEST(OpProfileDatabaseTest, InterpolatesAcrossShapes) {
+  OpProfileDatabase profiles;
+  // A single profile scales linearly with the input size.
+  profiles.Add(DescribeMatMul(64, 64, 64), Costs::Duration(1000));
+  EXPECT_EQ(4000, LookupNanos(profiles, DescribeMatMul(128, 128, 128)));
+
+  // Two profiles follow the power law between them, here n^3 for n x n
+  // matmuls, i.e. a power of 1.5 of the input size.
+  profiles.Add(DescribeMatMul(256, 256, 256), Costs::Duration(64000));
+  EXPECT_EQ(8000, LookupNanos(profiles, DescribeMatMul(128, 128, 128)));
+  EXPECT_EQ(512000, LookupNanos(profiles, DescribeMatMul(512, 512, 512)));
+  EXPECT_EQ(125, LookupNanos(profiles, DescribeMatMul(32, 32, 32)));
+  // The exact profiles are still used as they are.
+  EXPECT_EQ(1000, LookupNanos(profiles, DescribeMatMul(64, 64, 64)));
+}
+
+TEST(OpProfileDatabaseTest, OnlyMatchesTheSameSignature) {
+  OpProfileDatabase profiles;
+  profiles.Add(DescribeMatMul(64, 64, 64), Costs::Duration(1000));
+
+  EXPECT_EQ(-1, LookupNanos(profiles, DescribeMatMul(64, 64, 64, DT_DOUBLE)));
+  OpInfo transposed = DescribeMatMul(64, 64, 64);
+  SetAttrValue(true, &(*transposed.mutable_attr())["transpose_a"]);
+  EXPECT_EQ(-1, LookupNanos(profiles, transposed));
+  OpInfo on_gpu = DescribeMatMul(64, 64, 64);
+  on_gpu.mutable_device()->set_type("GPU");
+  EXPECT_EQ(-1, LookupNanos(profiles, on_gpu));
+  // Unknown shapes are never profiled nor looked up.
+  EXPECT_EQ(-1, LookupNanos(profiles, DescribeMatMul(-1, 64, 64)));
+  profiles.Add(DescribeMatMul(-1, 64, 64), Costs::Duration(1000));
+  EXPECT_EQ(1, profiles.size());
+  // Nor are shapes whose size overflows.
+  const int64 huge = int64{1} << 40;
+  EXPECT_EQ(-1, LookupNanos(profiles, DescribeMatMul(huge, huge, 64)));
+  profiles.Add(DescribeMatMul(huge, huge, 64), Costs::Duration(1000));
+  EXPECT_EQ(1, profiles.size());
+
+  // Internal attributes don't matter.
+  OpInfo annotated = DescribeMatMul(64, 64, 64);
+  SetAttrValue("loc:@x", &(*annotated.mutable_attr())["_class"]);
+  EXPECT_EQ(1000, LookupNanos(profiles, annotated));
+}
+
+TEST(OpProfileDatabaseTest, SaveAndLoad) {
+  OpProfileDatabase profiles;
+  profiles.Add(DescribeMatMul(64, 64, 64), Costs::Duration(1000));
+  profiles.Add(DescribeMatMul(256, 256, 256), Costs::Duration(64000));
+  const string filename = io::JoinPath(testing::TmpDir(), "op_profiles.pb");
+  TF_ASSERT_OK(profiles.Save(filename));
+
+  OpProfileDatabase loaded;
+  TF_ASSERT_OK(loaded.Load(filename));
+  EXPECT_EQ(2, loaded.size());
+  EXPECT_EQ(8000, LookupNanos(loaded, DescribeMatMul(128, 128, 128)));
+
+  EXPECT_FALSE(loaded.Load(io::JoinPath(testing::TmpDir(), "missing")).ok());
+}
+
+TEST(OpProfileDatabaseTest, AddStepStats) {
+  GraphDef graph;
+  *graph.add_node() = test::function::NDef("a", "Const", {}, {});
+  *graph.add_node() = test::function::NDef("b", "Const", {}, {});
+  *graph.add_node() = test::function::NDef(
+      "c", "MatMul", {"a", "b"},
+      {{"T", DT_FLOAT}, {"transpose_a", false}, {"transpose_b", false}});
+  *graph.add_node() = test::function::NDef("d", "Relu", {"c", "^a"},
+                                           {{"T", DT_FLOAT}});
+
+  StepStats step_stats;
+  DeviceStepStats* dev_stats = step_stats.add_dev_stats();
+  dev_stats->set_device("/job:localhost/replica:0/task:0/device:CPU:0");
+  auto add_node_stats = [dev_stats](const string& name, int64 micros,
+                                    const std::vector<int64>& shape) {
+    NodeExecStats* node_stats = dev_stats->add_node_stats();
+    node_stats->set_node_name(name);
+    node_stats->set_op_start_rel_micros(2);
+    node_stats->set_op_end_rel_micros(2 + micros);
+    TensorDescription* output =
+        node_stats->add_output()->mutable_tensor_description();
+    output->set_dtype(DT_FLOAT);
+    for (int64 dim : shape) {
+      output->mutable_shape()->add_dim()->set_size(dim);
+    }
+  };
+  add_node_stats("a", 0, {2, 3});
+  add_node_stats("b", 0, {3, 4});
+  add_node_stats("c", 5, {2, 4});
+  add_node_stats("d", 1, {2, 4});
+  // Nodes that aren't in the graph are ignored.
+  add_node_stats("_SOURCE", 0, {});
+
+  OpProfileDatabase profiles;
+  profiles.AddStepStats(graph, step_stats);
+  EXPECT_EQ(4, profiles.size());
+
+  OpInfo matmul = DescribeMatMul(2, 3, 4);
+  SetAttrValue(false, &(*matmul.mutable_attr())["transpose_b"]);
+  EXPECT_EQ(5000, LookupNanos(profiles, matmul));
+
+  bool found_relu = false;
+  const OpPerformanceList performance = profiles.ToProto();
+  for (const auto& perf : performance.op_performance()) {
+    if (perf.op().op() == "Relu") {
+      found_relu = true;
+      EXPECT_EQ(1000, perf.compute_cost());
+      ASSERT_EQ(1, perf.op().inputs_size());
+      EXPECT_EQ(2, perf.op().inputs(0).shape().dim(0).size());
+      EXPECT_EQ(4, perf.op().inputs(0).shape().dim(1).size());
+      ASSERT_EQ(1, perf.op().outputs_size());
+    }
+  }
+  EXPECT_TRUE(found_relu);
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
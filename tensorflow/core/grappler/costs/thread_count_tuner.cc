@@ -0,0 +1,185 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/costs/thread_count_tuner.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "tensorflow/core/framework/cost_graph.pb.h"
+#include "tensorflow/core/grappler/clusters/utils.h"
+#include "tensorflow/core/grappler/clusters/virtual_cluster.h"
+#include "tensorflow/core/grappler/costs/analytical_cost_estimator.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/grappler/utils/topological_sort.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+
+// Time the executor spends dispatching a node regardless of its computation.
+// It keeps graphs of many tiny nodes from looking free to run serially.
+constexpr double kPerNodeOverheadMicros = 1.0;
+
+// Work below which splitting a computation over one more thread doesn't pay
+// for the synchronization, in the spirit of the minimum shard cost used by
+// Shard() and Eigen's ThreadPoolDevice.
+constexpr double kMinShardMicros = 10.0;
+
+}  // namespace
+
+ThreadCountTuner::ThreadCountTuner(int num_cores)
+    : num_cores_(num_cores > 0 ? num_cores
+                               : std::max(1, port::NumSchedulableCPUs())) {}
+
+Status ThreadCountTuner::Initialize(const GrapplerItem& item) {
+  return Initialize(item, GetLocalCPUInfo());
+}
+
+Status ThreadCountTuner::Initialize(const GrapplerItem& item,
+                                    const DeviceProperties& cpu) {
+  nodes_.clear();
+  fanins_.clear();
+  costs_.clear();
+  node_index_.clear();
+
+  // Cost the graph on a single core so that the estimates measure the serial
+  // work of each node rather than its run time on the whole machine.
+  DeviceProperties single_core = cpu;
+  single_core.set_num_cores(1);
+  VirtualCluster cluster(
+      {{"/job:localhost/replica:0/task:0/cpu:0", single_core}});
+  AnalyticalCostEstimator estimator(&cluster, /*use_static_shapes=*/true);
+  TF_RETURN_IF_ERROR(estimator.Initialize(item));
+  CostGraphDef cost_graph;
+  Costs summary;
+  TF_RETURN_IF_ERROR(
+      estimator.PredictCosts(item.graph, &cost_graph, &summary));
+  std::unordered_map<string, int64> compute_cost;
+  for (const auto& node : cost_graph.node()) {
+    compute_cost[node.name()] = node.compute_cost();
+  }
+
+  std::unordered_map<const NodeDef*, int> topo_order;
+  TF_RETURN_IF_ERROR(
+      ComputeTopologicalOrder(item.graph, &topo_order, nullptr));
+  std::vector<const NodeDef*> sorted(item.graph.node_size());
+  for (const auto& entry : topo_order) {
+    sorted[entry.second] = entry.first;
+  }
+
+  nodes_.reserve(sorted.size());
+  fanins_.resize(sorted.size());
+  costs_.resize(sorted.size());
+  for (int i = 0; i < sorted.size(); ++i) {
+    const NodeDef* node = sorted[i];
+    nodes_.push_back(node->name());
+    node_index_[node->name()] = i;
+    for (const string& input : node->input()) {
+      auto it = node_index_.find(NodeName(input));
+      if (it != node_index_.end()) {
+        fanins_[i].push_back(it->second);
+      }
+    }
+    auto it = compute_cost.find(node->name());
+    if (it != compute_cost.end()) {
+      costs_[i].work = it->second;
+    }
+  }
+  VLOG(1) << "Estimated graph parallelism " << GraphParallelism()
+          << ", op parallelism " << OpParallelism() << " on " << num_cores_
+          << " cores";
+  return Status::OK();
+}
+
+void ThreadCountTuner::AddStepStats(const StepStats& step_stats,
+                                    const ThreadCounts& used) {
+  for (const auto& dev_stats : step_stats.dev_stats()) {
+    for (const auto& node_stats : dev_stats.node_stats()) {
+      auto it = node_index_.find(node_stats.node_name());
+      if (it == node_index_.end()) {
+        continue;
+      }
+      NodeCost& cost = costs_[it->second];
+      // A node that sharded its computation finished faster than its serial
+      // work by up to the number of intra-op threads it could use.
+      const double speedup =
+          std::min<double>(std::max(used.intra_op, 1), UsefulThreads(cost.work));
+      const double work = node_stats.all_end_rel_micros() * speedup;
+      if (cost.num_measurements == 0) {
+        cost.work = work;
+      } else {
+        cost.work += (work - cost.work) / (cost.num_measurements + 1);
+      }
+      ++cost.num_measurements;
+    }
+  }
+}
+
+double ThreadCountTuner::UsefulThreads(double work) const {
+  return std::min<double>(std::max(work / kMinShardMicros, 1.0), num_cores_);
+}
+
+double ThreadCountTuner::GraphParallelism() const {
+  std::vector<double> finish_time(nodes_.size());
+  double total_work = 0;
+  double critical_path = 0;
+  for (int i = 0; i < nodes_.size(); ++i) {
+    double start_time = 0;
+    for (int fanin : fanins_[i]) {
+      start_time = std::max(start_time, finish_time[fanin]);
+    }
+    const double time = costs_[i].work + kPerNodeOverheadMicros;
+    finish_time[i] = start_time + time;
+    total_work += time;
+    critical_path = std::max(critical_path, finish_time[i]);
+  }
+  return critical_path > 0 ? total_work / critical_path : 1.0;
+}
+
+double ThreadCountTuner::OpParallelism() const {
+  double total_work = 0;
+  double weighted_threads = 0;
+  for (const NodeCost& cost : costs_) {
+    total_work += cost.work;
+    weighted_threads += cost.work * UsefulThreads(cost.work);
+  }
+  return total_work > 0 ? weighted_threads / total_work : 1.0;
+}
+
+ThreadCounts ThreadCountTuner::Recommend() const {
+  ThreadCounts counts;
+  // Like the default MKL setting, keep at least two inter-op threads so that a
+  // blocking op (e.g. a queue dequeue) cannot starve the rest of the graph.
+  const int min_inter_op = std::min(2, num_cores_);
+  counts.inter_op = std::min(
+      num_cores_,
+      std::max(min_inter_op, static_cast<int>(std::ceil(GraphParallelism()))));
+  counts.intra_op = std::min(
+      num_cores_, std::max(1, static_cast<int>(std::ceil(OpParallelism()))));
+  return counts;
+}
+
+void ThreadCountTuner::ApplyTo(ConfigProto* config) const {
+  const ThreadCounts counts = Recommend();
+  config->set_inter_op_parallelism_threads(counts.inter_op);
+  config->set_intra_op_parallelism_threads(counts.intra_op);
+}
+
+}  // end namespace grappler
+}  // end namespace tensorflow
@@ -0,0 +1,111 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_GRAPPLER_COSTS_THREAD_COUNT_TUNER_H_
+#define TENSORFLOW_CORE_GRAPPLER_COSTS_THREAD_COUNT_TUNER_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/core/framework/step_stats.pb.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/protobuf/device_properties.pb.h"
+
+namespace tensorflow {
+namespace grappler {
+
+// Sizes of the inter-op and intra-op thread pools of a session.
+struct ThreadCounts {
+  int inter_op = 0;
+  int intra_op = 0;
+};
+
+// Picks inter_op_parallelism_threads and intra_op_parallelism_threads for a
+// CPU graph instead of defaulting both to the number of cores.
+//
+// The graph is costed once with the AnalyticalCostEstimator on a single-core
+// model of the CPU, which gives the serial work of every node. From that the
+// tuner derives:
+//  * the graph-level parallelism, i.e. total work divided by the length of
+//    the critical path, which sizes the inter-op pool;
+//  * the work-weighted number of threads each node could usefully shard its
+//    computation over, which sizes the intra-op pool.
+// Both are capped by the number of cores the model is allowed to use, so that
+// several models sharing a machine can each be given a slice of it.
+//
+// This is a standalone library: no session option enables it, and sessions
+// never call it themselves. Callers cost their graph with Initialize() and
+// write the recommendation into the ConfigProto of the session they are about
+// to create with ApplyTo().
+//
+// Measured step stats (e.g. from RunMetadata with FULL_TRACE) can be fed back
+// with AddStepStats() to replace the analytical estimates by observed node
+// times. Thread pools cannot be resized once a session exists, so callers
+// only benefit from the refined recommendation by applying it to a new
+// session.
+class ThreadCountTuner {
+ public:
+  // `num_cores` is the number of cores the model may use; 0 means all the
+  // schedulable cores of this machine.
+  explicit ThreadCountTuner(int num_cores);
+
+  // Estimates the cost of every node of `item.graph` on the local CPU.
+  Status Initialize(const GrapplerItem& item);
+  // Same as above, using the given CPU description instead of the local one.
+  Status Initialize(const GrapplerItem& item, const DeviceProperties& cpu);
+
+  // Replaces the estimated cost of every node found in `step_stats` with its
+  // measured run time, averaged over all the steps seen so far. `used` are the
+  // thread counts the step ran with.
+  void AddStepStats(const StepStats& step_stats, const ThreadCounts& used);
+
+  // Returns the recommended thread counts for the current cost estimates.
+  ThreadCounts Recommend() const;
+
+  // Stores the recommended thread counts in `config`. Inter-op pools are shared
+  // by all the sessions of a process unless `use_per_session_threads` is set,
+  // so this should be applied to the first session created.
+  void ApplyTo(ConfigProto* config) const;
+
+  // Total work divided by the critical path length of the graph.
+  double GraphParallelism() const;
+  // Work-weighted number of threads the nodes can shard their work over.
+  double OpParallelism() const;
+
+ private:
+  struct NodeCost {
+    // Serial work of the node, in microseconds.
+    double work = 0;
+    // Number of measured steps averaged into `work`, 0 while it is estimated.
+    int num_measurements = 0;
+  };
+
+  // Threads a node doing `work` microseconds of computation can keep busy.
+  double UsefulThreads(double work) const;
+
+  int num_cores_;
+  // Nodes in topological order, with the indices of their fanins.
+  std::vector<string> nodes_;
+  std::vector<std::vector<int>> fanins_;
+  std::vector<NodeCost> costs_;
+  std::unordered_map<string, int> node_index_;
+};
+
+}  // end namespace grappler
+}  // end namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_GRAPPLER_COSTS_THREAD_COUNT_TUNER_H_
@@ -0,0 +1,203 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/costs/thread_count_tuner.h"
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/public/session_options.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+// A chain of `depth` dim x dim matmuls.
+Graph* DeepGraph(int depth, int dim, Node** fetch) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor x(DT_FLOAT, TensorShape({dim, dim}));
+  x.flat<float>().setRandom();
+  Node* w = test::graph::Constant(g, x);
+  Node* y = w;
+  for (int i = 0; i < depth; ++i) {
+    y = test::graph::Matmul(g, y, w, false, false);
+  }
+  *fetch = y;
+  return g;
+}
+
+// `width` independent chains of `depth` dim x dim matmuls, summed at the end.
+Graph* WideGraph(int width, int depth, int dim, Node** fetch) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor x(DT_FLOAT, TensorShape({dim, dim}));
+  x.flat<float>().setRandom();
+  Node* w = test::graph::Constant(g, x);
+  std::vector<Node*> branches;
+  for (int i = 0; i < width; ++i) {
+    Node* y = w;
+    for (int j = 0; j < depth; ++j) {
+      y = test::graph::Matmul(g, y, w, false, false);
+    }
+    branches.push_back(y);
+  }
+  *fetch = test::graph::Multi(g, "AddN", branches);
+  return g;
+}
+
+GrapplerItem ToItem(const Graph& g, const Node* fetch) {
+  GrapplerItem item;
+  item.id = "test";
+  g.ToGraphDef(&item.graph);
+  item.fetch.push_back(fetch->name());
+  return item;
+}
+
+DeviceProperties TestCPU() {
+  DeviceProperties cpu;
+  cpu.set_type("CPU");
+  cpu.set_num_cores(8);
+  cpu.set_frequency(2600);
+  cpu.set_bandwidth(24 * 1024 * 1024);
+  return cpu;
+}
+
+TEST(ThreadCountTunerTest, ChainOfLargeOpsUsesIntraOpThreads) {
+  Node* fetch;
+  std::unique_ptr<Graph> g(DeepGraph(4, 1024, &fetch));
+  ThreadCountTuner tuner(8);
+  TF_ASSERT_OK(tuner.Initialize(ToItem(*g, fetch), TestCPU()));
+
+  EXPECT_NEAR(1.0, tuner.GraphParallelism(), 0.01);
+  EXPECT_NEAR(8.0, tuner.OpParallelism(), 0.01);
+  const ThreadCounts counts = tuner.Recommend();
+  EXPECT_EQ(2, counts.inter_op);
+  EXPECT_EQ(8, counts.intra_op);
+}
+
+TEST(ThreadCountTunerTest, WideGraphOfSmallOpsUsesInterOpThreads) {
+  Node* fetch;
+  std::unique_ptr<Graph> g(WideGraph(16, 2, 2, &fetch));
+  const GrapplerItem item = ToItem(*g, fetch);
+
+  ThreadCountTuner tuner(8);
+  TF_ASSERT_OK(tuner.Initialize(item, TestCPU()));
+  // 34 nodes, the longest path goes through 4 of them.
+  EXPECT_NEAR(8.5, tuner.GraphParallelism(), 0.01);
+  ThreadCounts counts = tuner.Recommend();
+  EXPECT_EQ(8, counts.inter_op);
+  EXPECT_EQ(1, counts.intra_op);
+
+  // The recommendation never exceeds the cores given to the model.
+  ThreadCountTuner small_tuner(4);
+  TF_ASSERT_OK(small_tuner.Initialize(item, TestCPU()));
+  counts = small_tuner.Recommend();
+  EXPECT_EQ(4, counts.inter_op);
+  EXPECT_EQ(1, counts.intra_op);
+
+  ConfigProto config;
+  small_tuner.ApplyTo(&config);
+  EXPECT_EQ(4, config.inter_op_parallelism_threads());
+  EXPECT_EQ(1, config.intra_op_parallelism_threads());
+}
+
+TEST(ThreadCountTunerTest, StepStatsRefineEstimates) {
+  Node* fetch;
+  std::unique_ptr<Graph> g(WideGraph(16, 2, 2, &fetch));
+  ThreadCountTuner tuner(8);
+  TF_ASSERT_OK(tuner.Initialize(ToItem(*g, fetch), TestCPU()));
+  ThreadCounts counts = tuner.Recommend();
+  EXPECT_EQ(8, counts.inter_op);
+
+  // One branch turns out to dominate the step: the graph is effectively
+  // serial, and that node is large enough to be sharded.
+  StepStats step_stats;
+  NodeExecStats* node_stats = step_stats.add_dev_stats()->add_node_stats();
+  node_stats->set_node_name((*fetch->in_nodes().begin())->name());
+  node_stats->set_all_end_rel_micros(5000);
+  tuner.AddStepStats(step_stats, counts);
+
+  EXPECT_NEAR(1.0, tuner.GraphParallelism(), 0.01);
+  counts = tuner.Recommend();
+  EXPECT_EQ(2, counts.inter_op);
+  EXPECT_EQ(8, counts.intra_op);
+
+  // A later step that ran with 8 intra-op threads took 625us, i.e. did the
+  // same serial work: the estimate stays put.
+  node_stats->set_all_end_rel_micros(625);
+  tuner.AddStepStats(step_stats, counts);
+  counts = tuner.Recommend();
+  EXPECT_EQ(2, counts.inter_op);
+  EXPECT_EQ(8, counts.intra_op);
+}
+
+// Runs the graph with the given thread counts, or with the ones picked by the
+// ThreadCountTuner if both are 0, to compare the automatic choice against a
+// sweep of configurations, e.g.
+//   bazel run -c opt :thread_count_tuner_test -- --benchmarks=.
+void RunWithThreadCounts(int iters, Graph* g, Node* fetch, int inter_op,
+                         int intra_op) {
+  SessionOptions options;
+  if (inter_op == 0 && intra_op == 0) {
+    ThreadCountTuner tuner(0);
+    TF_CHECK_OK(tuner.Initialize(ToItem(*g, fetch)));
+    tuner.ApplyTo(&options.config);
+  } else {
+    options.config.set_inter_op_parallelism_threads(inter_op);
+    options.config.set_intra_op_parallelism_threads(intra_op);
+  }
+  testing::SetLabel(strings::StrCat(
+      "inter_op=", options.config.inter_op_parallelism_threads(),
+      " intra_op=", options.config.intra_op_parallelism_threads()));
+  test::Benchmark("cpu", g, &options, nullptr /* init */, nullptr /* rendez */,
+                  true /* use_inter_op_threads */)
+      .Run(iters);
+}
+
+static void BM_DeepGraph(int iters, int inter_op, int intra_op) {
+  Node* fetch;
+  Graph* g = DeepGraph(8, 512, &fetch);
+  RunWithThreadCounts(iters, g, fetch, inter_op, intra_op);
+}
+BENCHMARK(BM_DeepGraph)
+    ->ArgPair(0, 0)
+    ->ArgPair(1, 1)
+    ->ArgPair(1, 4)
+    ->ArgPair(2, 4)
+    ->ArgPair(4, 1)
+    ->ArgPair(4, 4)
+    ->ArgPair(8, 8);
+
+static void BM_WideGraph(int iters, int inter_op, int intra_op) {
+  Node* fetch;
+  Graph* g = WideGraph(16, 4, 64, &fetch);
+  RunWithThreadCounts(iters, g, fetch, inter_op, intra_op);
+}
+BENCHMARK(BM_WideGraph)
+    ->ArgPair(0, 0)
+    ->ArgPair(1, 1)
+    ->ArgPair(1, 4)
+    ->ArgPair(2, 4)
+    ->ArgPair(4, 1)
+    ->ArgPair(4, 4)
+    ->ArgPair(8, 8);
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
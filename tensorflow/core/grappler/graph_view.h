@@ -111,13 +111,14 @@ class GraphView {
   std::unordered_set<Edge, HashEdge> GetFaninEdges(
       const NodeDef& node, bool include_controlling_edges) const;
 
- private:
+ protected:
   GraphDef* graph_;
   std::unordered_map<string, NodeDef*> nodes_;
   std::unordered_set<InputPort, HashPort> empty_set_;
   std::unordered_map<OutputPort, std::unordered_set<InputPort, HashPort>,
                      HashPort>
       fanouts_;
+  // Upper bound of the regular output port ids of a node that are used.
   std::unordered_map<const NodeDef*, int> num_regular_outputs_;
 };
 
@@ -0,0 +1,192 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/mutable_graph_view.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+
+namespace tensorflow {
+namespace grappler {
+
+NodeDef* MutableGraphView::AddNode(NodeDef&& node) {
+  NodeDef* new_node = graph_->add_node();
+  new_node->Swap(&node);
+  auto rslt = nodes_.insert(std::make_pair(new_node->name(), new_node));
+  // Check that the graph doesn't contain multiple nodes with the same name.
+  CHECK(rslt.second || rslt.first->second == nullptr)
+      << "Non unique node name detected: " << new_node->name();
+  rslt.first->second = new_node;
+  for (int i = 0; i < new_node->input_size(); ++i) {
+    AddFanoutEdge(new_node, i);
+  }
+  return new_node;
+}
+
+void MutableGraphView::AddFanin(NodeDef* node, const string& input) {
+  node->add_input(input);
+  int pos = node->input_size() - 1;
+  if (!IsControlInput(input)) {
+    // Move the new input in front of the control inputs. Control inputs are
+    // all recorded with port id -1, so their fanouts don't change.
+    while (pos > 0 && IsControlInput(node->input(pos - 1))) {
+      node->mutable_input()->SwapElements(pos, pos - 1);
+      --pos;
+    }
+  }
+  AddFanoutEdge(node, pos);
+}
+
+bool MutableGraphView::UpdateFanin(NodeDef* node, const string& old_input,
+                                   const string& new_input) {
+  CHECK_EQ(IsControlInput(old_input), IsControlInput(new_input));
+  int old_port;
+  const string old_name = ParseNodeName(old_input, &old_port);
+  bool updated = false;
+  for (int i = 0; i < node->input_size(); ++i) {
+    int port;
+    const string name = ParseNodeName(node->input(i), &port);
+    if (name == old_name && port == old_port) {
+      RemoveFanoutEdge(node, i);
+      *node->mutable_input(i) = new_input;
+      AddFanoutEdge(node, i);
+      updated = true;
+    }
+  }
+  return updated;
+}
+
+void MutableGraphView::UpdateFanouts(const string& from_node,
+                                     const string& to_node) {
+  NodeDef* from = GetNode(from_node);
+  CHECK(from != nullptr) << "Unknown node " << from_node;
+  CHECK(GetNode(to_node) != nullptr) << "Unknown node " << to_node;
+  for (const InputPort& fanout : GetFanouts(*from, true)) {
+    NodeDef* node = fanout.node;
+    for (int i = 0; i < node->input_size(); ++i) {
+      int port;
+      if (ParseNodeName(node->input(i), &port) != from_node) {
+        continue;
+      }
+      RemoveFanoutEdge(node, i);
+      if (port < 0) {
+        *node->mutable_input(i) = AsControlDependency(to_node);
+      } else if (port == 0) {
+        *node->mutable_input(i) = to_node;
+      } else {
+        *node->mutable_input(i) = strings::StrCat(to_node, ":", port);
+      }
+      AddFanoutEdge(node, i);
+    }
+  }
+}
+
+void MutableGraphView::RemoveFanins(NodeDef* node) {
+  // Remove the inputs from the back, so that the edge of a duplicated control
+  // input is forgotten along with its last copy.
+  while (node->input_size() > 0) {
+    RemoveFanoutEdge(node, node->input_size() - 1);
+    node->mutable_input()->RemoveLast();
+  }
+}
+
+void MutableGraphView::DeleteNodes(const std::set<string>& nodes_to_delete) {
+  for (const string& name : nodes_to_delete) {
+    NodeDef* node = GetNode(name);
+    if (node == nullptr) {
+      continue;
+    }
+    RemoveFanins(node);
+  }
+  for (const string& name : nodes_to_delete) {
+    NodeDef* node = GetNode(name);
+    if (node == nullptr) {
+      continue;
+    }
+    auto it = num_regular_outputs_.find(node);
+    const int last_port_id = it != num_regular_outputs_.end() ? it->second : -1;
+    for (int port_id = -1; port_id <= last_port_id; ++port_id) {
+      auto fanout = fanouts_.find(OutputPort(node, port_id));
+      if (fanout == fanouts_.end()) {
+        continue;
+      }
+      for (const InputPort& input : fanout->second) {
+        DCHECK(nodes_to_delete.count(input.node->name()))
+            << "Deleting node " << name << " which still feeds "
+            << input.node->name();
+      }
+      fanouts_.erase(fanout);
+    }
+    if (it != num_regular_outputs_.end()) {
+      num_regular_outputs_.erase(it);
+    }
+    nodes_.erase(name);
+  }
+
+  // Move the remaining nodes to the front, in order. Swapping the elements of
+  // a repeated field doesn't move the nodes themselves, so pointers to them
+  // stay valid.
+  int last = 0;
+  for (int i = 0; i < graph_->node_size(); ++i) {
+    if (nodes_to_delete.count(graph_->node(i).name()) == 0) {
+      graph_->mutable_node()->SwapElements(i, last);
+      ++last;
+    }
+  }
+  graph_->mutable_node()->DeleteSubrange(last, graph_->node_size() - last);
+}
+
+void MutableGraphView::AddFanoutEdge(NodeDef* node, int i) {
+  OutputPort fanin;
+  const string fanin_name = ParseNodeName(node->input(i), &fanin.port_id);
+  fanin.node = GetNode(fanin_name);
+  if (fanin.node == nullptr) {
+    return;
+  }
+  InputPort input(node, fanin.port_id < 0 ? -1 : i);
+  if (fanin.port_id >= 0) {
+    int& num_regular_outputs = num_regular_outputs_[fanin.node];
+    num_regular_outputs = std::max(num_regular_outputs, fanin.port_id);
+  }
+  fanouts_[fanin].insert(input);
+}
+
+void MutableGraphView::RemoveFanoutEdge(NodeDef* node, int i) {
+  OutputPort fanin;
+  const string fanin_name = ParseNodeName(node->input(i), &fanin.port_id);
+  fanin.node = GetNode(fanin_name);
+  if (fanin.node == nullptr) {
+    return;
+  }
+  if (fanin.port_id < 0) {
+    // A node can list the same control input more than once: keep the edge
+    // while another copy remains.
+    for (int j = 0; j < node->input_size(); ++j) {
+      if (j != i && node->input(j) == node->input(i)) {
+        return;
+      }
+    }
+  }
+  auto it = fanouts_.find(fanin);
+  if (it == fanouts_.end()) {
+    return;
+  }
+  it->second.erase(InputPort(node, fanin.port_id < 0 ? -1 : i));
+  if (it->second.empty()) {
+    fanouts_.erase(it);
+  }
+}
+
+}  // end namespace grappler
+}  // end namespace tensorflow
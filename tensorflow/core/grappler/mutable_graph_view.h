@@ -0,0 +1,67 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_GRAPPLER_MUTABLE_GRAPH_VIEW_H_
+#define TENSORFLOW_CORE_GRAPPLER_MUTABLE_GRAPH_VIEW_H_
+
+#include <set>
+
+#include "tensorflow/core/grappler/graph_view.h"
+
+namespace tensorflow {
+namespace grappler {
+
+// A GraphView that supports modifying the graph. All modifications go through
+// the view, which keeps its node and fanout indices up to date in time
+// proportional to the size of the change, so the view never needs to be
+// rebuilt. Pointers to nodes stay valid until the nodes are deleted.
+class MutableGraphView : public GraphView {
+ public:
+  explicit MutableGraphView(GraphDef* graph) : GraphView(graph) {}
+
+  // Adds a new node to the graph. The node name must be unique.
+  NodeDef* AddNode(NodeDef&& node);
+
+  // Adds `input` (a regular input, or a control input prefixed with '^') to
+  // the node. Regular inputs are inserted before the control inputs.
+  void AddFanin(NodeDef* node, const string& input);
+
+  // Replaces every input of the node reading `old_input` with `new_input`.
+  // Both must be regular inputs or both must be control inputs. Returns true
+  // if any input was replaced.
+  bool UpdateFanin(NodeDef* node, const string& old_input,
+                   const string& new_input);
+
+  // Makes all the fanouts of `from_node`, including the controlled nodes,
+  // read the same output ports of `to_node` instead.
+  void UpdateFanouts(const string& from_node, const string& to_node);
+
+  // Removes all the inputs of the node.
+  void RemoveFanins(NodeDef* node);
+
+  // Deletes the nodes from the graph, keeping the order of the remaining
+  // nodes. The deleted nodes must not feed any node that is kept.
+  void DeleteNodes(const std::set<string>& nodes_to_delete);
+
+ private:
+  // Record (resp. forget) the edge into the i-th input of the node.
+  void AddFanoutEdge(NodeDef* node, int i);
+  void RemoveFanoutEdge(NodeDef* node, int i);
+};
+
+}  // end namespace grappler
+}  // end namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_GRAPPLER_MUTABLE_GRAPH_VIEW_H_
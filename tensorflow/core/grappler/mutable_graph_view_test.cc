@@ -0,0 +1,151 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/mutable_graph_view.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/framework/function_testlib.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+using test::function::GDef;
+using test::function::NDef;
+
+// Returns the names of the nodes reading `port` of `node_name`, sorted.
+std::vector<string> FanoutNames(const GraphView& graph,
+                                const string& node_name, int port) {
+  std::vector<string> names;
+  for (const auto& fanout :
+       graph.GetFanout(graph.GetOutputPort(node_name, port))) {
+    names.push_back(fanout.node->name());
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+std::vector<string> Inputs(const NodeDef& node) {
+  return std::vector<string>(node.input().begin(), node.input().end());
+}
+
+TEST(MutableGraphViewTest, AddNodeAndFanin) {
+  GraphDef graph_def = GDef({NDef("a", "NotImportant", {}, {}),
+                             NDef("b", "NotImportant", {"a"}, {})},
+                            {});
+  MutableGraphView graph(&graph_def);
+
+  NodeDef* c = graph.AddNode(NDef("c", "NotImportant", {"a:1", "^b"}, {}));
+  EXPECT_EQ(c, graph.GetNode("c"));
+  EXPECT_EQ(3, graph_def.node_size());
+  EXPECT_EQ(std::vector<string>({"c"}), FanoutNames(graph, "a", 1));
+  EXPECT_EQ(std::vector<string>({"c"}), FanoutNames(graph, "b", -1));
+
+  graph.AddFanin(c, "b");
+  EXPECT_EQ(std::vector<string>({"a:1", "b", "^b"}), Inputs(*c));
+  EXPECT_EQ(std::vector<string>({"c"}), FanoutNames(graph, "b", 0));
+  EXPECT_EQ(1, graph.GetFanout(graph.GetOutputPort("b", 0)).begin()->port_id);
+
+  graph.AddFanin(c, "^a");
+  EXPECT_EQ(std::vector<string>({"c"}), FanoutNames(graph, "a", -1));
+  EXPECT_EQ(4, graph.NumFanins(*c, true));
+  EXPECT_EQ(2, graph.NumFanins(*c, false));
+
+  graph.RemoveFanins(c);
+  EXPECT_EQ(0, c->input_size());
+  EXPECT_TRUE(FanoutNames(graph, "a", 1).empty());
+  EXPECT_TRUE(FanoutNames(graph, "a", -1).empty());
+  EXPECT_TRUE(FanoutNames(graph, "b", 0).empty());
+  EXPECT_TRUE(FanoutNames(graph, "b", -1).empty());
+  EXPECT_EQ(std::vector<string>({"b"}), FanoutNames(graph, "a", 0));
+}
+
+TEST(MutableGraphViewTest, UpdateFanin) {
+  GraphDef graph_def =
+      GDef({NDef("a", "NotImportant", {}, {}),
+            NDef("b", "NotImportant", {}, {}),
+            NDef("c", "NotImportant", {"a", "a:0", "b:1", "^a", "^a"}, {})},
+           {});
+  MutableGraphView graph(&graph_def);
+  NodeDef* c = graph.GetNode("c");
+
+  EXPECT_TRUE(graph.UpdateFanin(c, "a", "b:2"));
+  EXPECT_EQ(std::vector<string>({"b:2", "b:2", "b:1", "^a", "^a"}),
+            Inputs(*c));
+  EXPECT_TRUE(FanoutNames(graph, "a", 0).empty());
+  EXPECT_EQ(2, graph.GetFanout(graph.GetOutputPort("b", 2)).size());
+
+  EXPECT_TRUE(graph.UpdateFanin(c, "^a", "^b"));
+  EXPECT_EQ(std::vector<string>({"b:2", "b:2", "b:1", "^b", "^b"}),
+            Inputs(*c));
+  EXPECT_TRUE(FanoutNames(graph, "a", -1).empty());
+  EXPECT_EQ(std::vector<string>({"c"}), FanoutNames(graph, "b", -1));
+
+  EXPECT_FALSE(graph.UpdateFanin(c, "a", "b"));
+}
+
+TEST(MutableGraphViewTest, UpdateFanouts) {
+  GraphDef graph_def =
+      GDef({NDef("a", "NotImportant", {}, {}),
+            NDef("a2", "NotImportant", {}, {}),
+            NDef("c", "NotImportant", {"a", "^a"}, {}),
+            NDef("d", "NotImportant", {"a:1", "c"}, {})},
+           {});
+  MutableGraphView graph(&graph_def);
+
+  graph.UpdateFanouts("a", "a2");
+  EXPECT_EQ(std::vector<string>({"a2", "^a2"}), Inputs(*graph.GetNode("c")));
+  EXPECT_EQ(std::vector<string>({"a2:1", "c"}), Inputs(*graph.GetNode("d")));
+  EXPECT_TRUE(graph.GetFanouts(*graph.GetNode("a"), true).empty());
+  EXPECT_EQ(std::vector<string>({"c"}), FanoutNames(graph, "a2", 0));
+  EXPECT_EQ(std::vector<string>({"d"}), FanoutNames(graph, "a2", 1));
+  EXPECT_EQ(std::vector<string>({"c"}), FanoutNames(graph, "a2", -1));
+}
+
+TEST(MutableGraphViewTest, DeleteNodes) {
+  GraphDef graph_def = GDef({NDef("a", "NotImportant", {}, {}),
+                             NDef("b", "NotImportant", {"a"}, {}),
+                             NDef("c", "NotImportant", {"b"}, {}),
+                             NDef("d", "NotImportant", {"a", "^c"}, {}),
+                             NDef("e", "NotImportant", {"d"}, {})},
+                            {});
+  MutableGraphView graph(&graph_def);
+  NodeDef* a = graph.GetNode("a");
+  NodeDef* e = graph.GetNode("e");
+
+  graph.UpdateFanin(graph.GetNode("d"), "^c", "^a");
+  graph.DeleteNodes({"b", "c"});
+
+  ASSERT_EQ(3, graph_def.node_size());
+  EXPECT_EQ("a", graph_def.node(0).name());
+  EXPECT_EQ("d", graph_def.node(1).name());
+  EXPECT_EQ("e", graph_def.node(2).name());
+  EXPECT_EQ(a, graph.GetNode("a"));
+  EXPECT_EQ(e, graph.GetNode("e"));
+  EXPECT_EQ(nullptr, graph.GetNode("b"));
+  EXPECT_EQ(nullptr, graph.GetNode("c"));
+  EXPECT_EQ(std::vector<string>({"d"}), FanoutNames(graph, "a", 0));
+  EXPECT_EQ(std::vector<string>({"d"}), FanoutNames(graph, "a", -1));
+
+  // A deleted name can be reused.
+  graph.AddNode(NDef("b", "NotImportant", {"e"}, {}));
+  EXPECT_EQ(std::vector<string>({"b"}), FanoutNames(graph, "e", 0));
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
@@ -18,6 +18,7 @@ limitations under the License.
 #include <algorithm>
 #include <deque>
 #include <limits>
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -27,10 +28,12 @@ limitations under the License.
 #include "tensorflow/core/framework/node_def.pb.h"
 #include "tensorflow/core/framework/node_def_util.h"
 #include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/grappler/costs/graph_properties.h"
 #include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/mutable_graph_view.h"
 #include "tensorflow/core/grappler/op_types.h"
 #include "tensorflow/core/grappler/optimizers/constant_folding.h"
 #include "tensorflow/core/grappler/optimizers/graph_optimizer_stage.h"
@@ -267,6 +270,35 @@ NodeDef* GetTailOfIdempotentChain(
                         is_idempotent_non_branching);
 }
 
+// Returns true if `node` only changes the shape of its first input, without
+// moving its elements.
+bool IsReshapeLike(const NodeDef& node) {
+  return IsReshape(node) || IsExpandDims(node) || IsSqueeze(node);
+}
+
+// Extracts the values of an integer Const op with at most one dimension.
+bool IntValuesFromConstNode(const NodeDef& node, std::vector<int64>* values) {
+  if (!IsConstant(node) || node.attr().count("value") == 0) {
+    return false;
+  }
+  Tensor tensor;
+  if (!tensor.FromProto(node.attr().at("value").tensor()) ||
+      tensor.dims() > 1) {
+    return false;
+  }
+  values->clear();
+  if (tensor.dtype() == DT_INT32) {
+    const auto flat = tensor.flat<int32>();
+    values->assign(flat.data(), flat.data() + flat.size());
+  } else if (tensor.dtype() == DT_INT64) {
+    const auto flat = tensor.flat<int64>();
+    values->assign(flat.data(), flat.data() + flat.size());
+  } else {
+    return false;
+  }
+  return true;
+}
+
 // Graph optimizer context extension specific to ArithmeticOptimizer.
 struct ArithmeticOptimizerContext {
   explicit ArithmeticOptimizerContext(SetVector<NodeDef*>* nodes_to_simplify)
@@ -1856,6 +1888,266 @@ class SqrtDivToRsqrtMulStage : public ArithmeticOptimizerStage {
   }
 };
 
+// Removes Reshape, ExpandDims and Squeeze nodes, and chains of them, whose
+// output has symbolically the same shape as their input. Unlike the identity
+// reshape rewrite of TrySimplifyAndReplaceUses, which gives up on shapes with
+// more than one unknown dimension, this relies on GraphProperties to tell
+// whether unknown dimensions (e.g. the batch size) are the same:
+//   Squeeze(ExpandDims(x, 1), [1]) => x
+//   Reshape(x, Shape(y)) => x if x and y have the same symbolic shape
+// A Reshape of a Reshape-like node that can't be removed reads the input of
+// that node instead:
+//   Reshape(ExpandDims(x, 1), shape) => Reshape(x, shape)
+class RemoveRedundantReshapeStage : public ArithmeticOptimizerStage {
+ public:
+  explicit RemoveRedundantReshapeStage(
+      const GraphOptimizerContext& ctx,
+      const ArithmeticOptimizerContext& ctx_ext)
+      : ArithmeticOptimizerStage("RemoveRedundantReshape", ctx, ctx_ext) {}
+  ~RemoveRedundantReshapeStage() override = default;
+
+  bool IsSupported(const NodeDef* node) const override {
+    return IsReshapeLike(*node);
+  }
+
+  Status TrySimplify(NodeDef* node, string* simplified_node_name) override {
+    TF_RETURN_IF_ERROR(EnsureNodeIsSupported(node));
+
+    // Bypass the longest chain of Reshape-like nodes ending at `node` whose
+    // input has the same shape as the output of `node`, unless `node` anchors
+    // a control dependency.
+    if (!HasControlInputs(*node)) {
+      string bypass;
+      OpInfo::TensorProperties output;
+      if (GetTensorProperties(node->name(), &output).ok() &&
+          ShapeIsSymbolicallyDefined(output)) {
+        const NodeDef* reshape = node;
+        while (true) {
+          OpInfo::TensorProperties input;
+          if (GetTensorProperties(reshape->input(0), &input).ok() &&
+              ShapesSymbolicallyEqual(output, input)) {
+            bypass = reshape->input(0);
+          }
+          NodeDef* input_node;
+          TF_RETURN_IF_ERROR(GetInputNode(reshape->input(0), &input_node));
+          if (!IsReshapeLike(*input_node) || HasControlInputs(*input_node)) {
+            break;
+          }
+          reshape = input_node;
+        }
+      }
+      if (bypass.empty() && IsReshape(*node) && ReshapesToOwnShape(*node)) {
+        bypass = node->input(0);
+      }
+      if (!bypass.empty()) {
+        *simplified_node_name = bypass;
+        return Status::OK();
+      }
+    }
+
+    if (IsReshape(*node)) {
+      NodeDef* input;
+      TF_RETURN_IF_ERROR(GetInputNode(node->input(0), &input));
+      if (IsReshapeLike(*input) && !HasControlInputs(*input)) {
+        node->set_input(0, input->input(0));
+        ctx().node_map->UpdateInput(node->name(), input->name(),
+                                    input->input(0));
+        AddToOptimizationQueue(node);
+        *simplified_node_name = node->name();
+      }
+    }
+    return Status::OK();
+  }
+
+ private:
+  // Returns true if `reshape` is Reshape(x, Shape(y)) with x and y of the same
+  // symbolic shape. The output properties of `reshape` may not tell, since the
+  // shape might have been computed differently when the graph properties were
+  // inferred (see ReplacePackWithShapeStage).
+  bool ReshapesToOwnShape(const NodeDef& reshape) const {
+    NodeDef* shape;
+    if (!GetInputNode(reshape.input(1), &shape).ok() || !IsShape(*shape) ||
+        HasControlInputs(*shape)) {
+      return false;
+    }
+    OpInfo::TensorProperties input;
+    OpInfo::TensorProperties shape_input;
+    return GetTensorProperties(reshape.input(0), &input).ok() &&
+           GetTensorProperties(shape->input(0), &shape_input).ok() &&
+           ShapesSymbolicallyEqual(input, shape_input);
+  }
+};
+
+// Removes Tile and BroadcastTo nodes whose output has symbolically the same
+// shape as their input, e.g. the broadcast of a [?, 64] tensor to the shape of
+// another [?, 64] tensor with the same batch size.
+class RemoveRedundantBroadcastStage : public ArithmeticOptimizerStage {
+ public:
+  explicit RemoveRedundantBroadcastStage(
+      const GraphOptimizerContext& ctx,
+      const ArithmeticOptimizerContext& ctx_ext)
+      : ArithmeticOptimizerStage("RemoveRedundantBroadcast", ctx, ctx_ext) {}
+  ~RemoveRedundantBroadcastStage() override = default;
+
+  bool IsSupported(const NodeDef* node) const override {
+    return (IsTile(*node) || IsBroadcastTo(*node)) && !HasControlInputs(*node);
+  }
+
+  Status TrySimplify(NodeDef* node, string* simplified_node_name) override {
+    TF_RETURN_IF_ERROR(EnsureNodeIsSupported(node));
+    OpInfo::TensorProperties input;
+    OpInfo::TensorProperties output;
+    if (GetTensorProperties(node->input(0), &input).ok() &&
+        GetTensorProperties(node->name(), &output).ok() &&
+        ShapesSymbolicallyEqual(input, output)) {
+      *simplified_node_name = node->input(0);
+    }
+    return Status::OK();
+  }
+};
+
+// Replaces a vector of the dimensions of a tensor, packed from scalars, with
+// the shape of that tensor:
+//   Pack([StridedSlice(Shape(x), [0], [1], [1], shrink_axis_mask=1),
+//         StridedSlice(Shape(x), [1], [2], [1], shrink_axis_mask=1),
+//         64]) => Shape(x) if x is a [?, ?, 64] tensor
+// The dimensions can also be sliced from the shapes of other tensors, as long
+// as they are symbolically the same. Unlike the packed vector, the shape lets
+// the Reshape, Tile and BroadcastTo nodes that consume it be recognized as
+// no-ops.
+class ReplacePackWithShapeStage : public ArithmeticOptimizerStage {
+ public:
+  explicit ReplacePackWithShapeStage(const GraphOptimizerContext& ctx,
+                                     const ArithmeticOptimizerContext& ctx_ext)
+      : ArithmeticOptimizerStage("ReplacePackWithShape", ctx, ctx_ext) {}
+  ~ReplacePackWithShapeStage() override = default;
+
+  bool IsSupported(const NodeDef* node) const override {
+    return IsPack(*node) && !HasControlInputs(*node);
+  }
+
+  Status TrySimplify(NodeDef* node, string* simplified_node_name) override {
+    TF_RETURN_IF_ERROR(EnsureNodeIsSupported(node));
+    const int64 axis = GetIntAttr(*node, "axis");
+    if (axis != 0 && axis != -1) {
+      return Status::OK();
+    }
+
+    // Find the shape the dimensions are packed from: the first one that
+    // provides a dimension in its place.
+    const NodeDef* shape = nullptr;
+    for (int i = 0; i < node->input_size() && shape == nullptr; ++i) {
+      const NodeDef* dim_shape;
+      int dim;
+      if (GetDimensionOfShape(node->input(i), &dim_shape, &dim) && dim == i) {
+        shape = dim_shape;
+      }
+    }
+    if (shape == nullptr || GetDataTypeFromAttr(*shape, "out_type") !=
+                                GetDataTypeFromAttr(*node, "T")) {
+      return Status::OK();
+    }
+    OpInfo::TensorProperties x;
+    if (!GetTensorProperties(shape->input(0), &x).ok() ||
+        x.shape().unknown_rank() ||
+        x.shape().dim_size() != node->input_size()) {
+      return Status::OK();
+    }
+
+    for (int i = 0; i < node->input_size(); ++i) {
+      const TensorShapeProto::Dim& expected = x.shape().dim(i);
+      const NodeDef* dim_shape;
+      int dim;
+      if (GetDimensionOfShape(node->input(i), &dim_shape, &dim)) {
+        if (dim_shape == shape && dim == i) {
+          continue;
+        }
+        OpInfo::TensorProperties y;
+        TF_RETURN_IF_ERROR(GetTensorProperties(dim_shape->input(0), &y));
+        const TensorShapeProto::Dim& actual = y.shape().dim(dim);
+        if (IsUnknown(expected) || IsUnknown(actual) ||
+            actual.size() != expected.size()) {
+          return Status::OK();
+        }
+        continue;
+      }
+      // Otherwise the dimension must be a known constant.
+      NodeDef* input;
+      TF_RETURN_IF_ERROR(GetInputNode(node->input(i), &input));
+      OpInfo::TensorProperties scalar;
+      std::vector<int64> value;
+      if (HasControlInputs(*input) ||
+          !GetTensorProperties(node->input(i), &scalar).ok() ||
+          scalar.shape().unknown_rank() || scalar.shape().dim_size() != 0 ||
+          !IntValuesFromConstNode(*input, &value) || !IsKnown(expected) ||
+          value[0] != expected.size()) {
+        return Status::OK();
+      }
+    }
+    *simplified_node_name = shape->name();
+    return Status::OK();
+  }
+
+ private:
+  static int64 GetIntAttr(const NodeDef& node, const string& name) {
+    const auto attr = node.attr().find(name);
+    return attr == node.attr().end() ? 0 : attr->second.i();
+  }
+
+  // Returns true if `tensor` is a single dimension of the shape of a tensor,
+  // i.e. StridedSlice(Shape(x), [dim], [dim + 1], [1], shrink_axis_mask=1).
+  bool GetDimensionOfShape(const string& tensor, const NodeDef** shape,
+                           int* dim) const {
+    NodeDef* slice;
+    if (!GetInputNode(tensor, &slice).ok() || !IsStridedSlice(*slice) ||
+        HasControlInputs(*slice)) {
+      return false;
+    }
+    for (const string& mask :
+         {"begin_mask", "end_mask", "ellipsis_mask", "new_axis_mask"}) {
+      if (GetIntAttr(*slice, mask) != 0) {
+        return false;
+      }
+    }
+    if (GetIntAttr(*slice, "shrink_axis_mask") != 1) {
+      return false;
+    }
+
+    NodeDef* shape_node;
+    NodeDef* begin;
+    NodeDef* strides;
+    if (!GetInputNode(slice->input(0), &shape_node).ok() ||
+        !IsShape(*shape_node) ||
+        !GetInputNode(slice->input(1), &begin).ok() ||
+        !GetInputNode(slice->input(3), &strides).ok()) {
+      return false;
+    }
+    // The end is ignored for shrunk axes.
+    std::vector<int64> begin_values;
+    std::vector<int64> stride_values;
+    if (!IntValuesFromConstNode(*begin, &begin_values) ||
+        begin_values.size() != 1 ||
+        !IntValuesFromConstNode(*strides, &stride_values) ||
+        stride_values.size() != 1 || stride_values[0] != 1) {
+      return false;
+    }
+    OpInfo::TensorProperties x;
+    if (!GetTensorProperties(shape_node->input(0), &x).ok() ||
+        x.shape().unknown_rank()) {
+      return false;
+    }
+    const int rank = x.shape().dim_size();
+    const int64 index =
+        begin_values[0] < 0 ? begin_values[0] + rank : begin_values[0];
+    if (index < 0 || index >= rank) {
+      return false;
+    }
+    *shape = shape_node;
+    *dim = index;
+    return true;
+  }
+};
+
 }  // namespace
 
 class UniqueNodes {
@@ -1869,14 +2161,37 @@ class UniqueNodes {
       }
     }
     candidates.push_back(node);
+    memoized_signatures_[node] = sig;
     return node;
   }
 
+  // Forgets `node` if it is a representative, e.g. because its inputs are
+  // about to change.
+  void RemoveRepresentative(NodeDef* node) {
+    auto it = memoized_signatures_.find(node);
+    if (it == memoized_signatures_.end()) return;
+    std::vector<NodeDef*>& candidates = rep_[it->second];
+    candidates.erase(std::find(candidates.begin(), candidates.end(), node));
+    memoized_signatures_.erase(it);
+  }
+
+  // Makes `new_rep`, which must be the same node as `old_rep`, the
+  // representative in its place.
+  void ReplaceRepresentative(NodeDef* old_rep, NodeDef* new_rep) {
+    auto it = memoized_signatures_.find(old_rep);
+    const uint64 sig = it->second;
+    memoized_signatures_.erase(it);
+    std::vector<NodeDef*>& candidates = rep_[sig];
+    *std::find(candidates.begin(), candidates.end(), old_rep) = new_rep;
+    memoized_signatures_[new_rep] = sig;
+  }
+
  private:
   uint64 ComputeSignature(const NodeDef& node) const;
   bool SameNode(const NodeDef& node1, const NodeDef& node2) const;
 
   std::unordered_map<uint64, std::vector<NodeDef*>> rep_;
+  std::unordered_map<const NodeDef*, uint64> memoized_signatures_;
 };
 
 uint64 UniqueNodes::ComputeSignature(const NodeDef& node) const {
@@ -1983,17 +2298,27 @@ bool ArithmeticOptimizer::OptimizedNodeExists(const NodeDef& node,
 
 namespace {
 
-bool FeedsInPlaceOp(const SimpleGraphView& graph_view, const NodeDef& node) {
+bool FeedsInPlaceOp(const GraphView& graph_view, const NodeDef& node) {
   const std::unordered_set<string> op_types_to_traverse = {
       node.op(),    "Identity", "IdentityN", "Reshape",
       "ExpandDims", "Enter",    "Switch",    "Merge"};
-  int node_idx = graph_view.index(node.name());
-  std::set<int> node_fanout;
-  graph_view.DepthFirstSearch(op_types_to_traverse, node_idx, &node_fanout);
-  for (int fanout : node_fanout) {
-    if (ModifiesInputsInPlace(graph_view.graph()->node(fanout))) {
+  std::unordered_set<const NodeDef*> visited;
+  std::vector<const NodeDef*> stack = {&node};
+  while (!stack.empty()) {
+    const NodeDef* current = stack.back();
+    stack.pop_back();
+    if (!visited.insert(current).second) {
+      continue;
+    }
+    if (ModifiesInputsInPlace(*current)) {
       return true;
     }
+    if (op_types_to_traverse.find(current->op()) !=
+        op_types_to_traverse.end()) {
+      for (const auto& fanout : graph_view.GetFanouts(*current, true)) {
+        stack.push_back(fanout.node);
+      }
+    }
   }
   return false;
 }
@@ -2018,75 +2343,76 @@ bool ArithmeticOptimizer::CanDedup(const NodeDef& node) const {
 }
 
 void ArithmeticOptimizer::DedupComputations() {
-  bool stop = true;
-  SimpleGraphView graph_view;
-  if (!graph_view.Initialize(*optimized_graph_).ok()) {
-    LOG(WARNING) << "Failed to build SimpleGraphView.";
-    return;
-  }
-  std::set<int> duplicates;
-  do {
-    stop = true;
-    UniqueNodes nodes;
-    for (int i = 0; i < optimized_graph_->node_size(); ++i) {
-      if (duplicates.find(i) != duplicates.end()) {
-        continue;
-      }
-      NodeDef* node = optimized_graph_->mutable_node(i);
-      if (!CanDedup(*node)) {
-        continue;
-      }
-      NodeDef* rep = nodes.FindOrAddRepresentative(node);
-      if (rep == node) {
-        continue;
-      }
-      // If either node feeds an inplace op, deduping them may cause data races.
-      // For example: If we dedup nodes initializing two independent inplace
-      // accumulations, they will write to the same buffer, clobbering each
-      // other's results.
-      if (FeedsInPlaceOp(graph_view, *rep) ||
-          FeedsInPlaceOp(graph_view, *node)) {
-        continue;
-      }
-      VLOG(3) << "Remove duplicated node: node=" << node->name()
-              << " representative=" << rep->name();
-      const std::set<NodeDef*>& fanouts = node_map_->GetOutputs(node->name());
-      for (NodeDef* fanout : fanouts) {
-        for (int i = 0; i < fanout->input_size(); ++i) {
-          string* name = fanout->mutable_input(i);
-          int position;
-          const string nodename = ParseNodeName(*name, &position);
-          if (nodename == node->name()) {
-            // Update name in-place.
-            if (position > 0) {
-              *name = StrCat(rep->name(), ":", position);
-            } else if (position == 0) {
-              *name = rep->name();
-            } else {
-              *name = StrCat("^", rep->name());
-            }
-            node_map_->AddOutput(rep->name(), fanout->name());
-          }
-        }
+  MutableGraphView graph_view(optimized_graph_);
+  bool graph_has_inplace_ops = false;
+  for (const NodeDef& node : optimized_graph_->node()) {
+    graph_has_inplace_ops |= ModifiesInputsInPlace(node);
+    for (const string& input : node.input()) {
+      if (graph_view.GetNode(NodeName(input)) == nullptr) {
+        LOG(WARNING) << "Skipping deduplication: non-existent input " << input
+                     << " for node " << node.name();
+        return;
       }
-      duplicates.insert(i);
-      stop = false;
     }
-  } while (!stop);
+  }
+
+  // Deduplicating a node changes the inputs of its fanouts, which may turn
+  // them into duplicates in turn. Instead of rescanning the whole graph until
+  // nothing changes, only the nodes whose inputs changed are looked at again.
+  // Nodes are visited in graph order, and the first node of a set of
+  // duplicates is the one that is kept.
+  std::unordered_map<const NodeDef*, int> node_index;
+  std::set<int> dirty_nodes;
+  for (int i = 0; i < optimized_graph_->node_size(); ++i) {
+    node_index[&optimized_graph_->node(i)] = i;
+    dirty_nodes.insert(dirty_nodes.end(), i);
+  }
+  UniqueNodes nodes;
+  std::set<string> duplicates;
+  while (!dirty_nodes.empty()) {
+    const int index = *dirty_nodes.begin();
+    dirty_nodes.erase(dirty_nodes.begin());
+    NodeDef* node = optimized_graph_->mutable_node(index);
+    if (duplicates.find(node->name()) != duplicates.end() ||
+        !CanDedup(*node)) {
+      continue;
+    }
+    NodeDef* rep = nodes.FindOrAddRepresentative(node);
+    if (rep == node) {
+      continue;
+    }
+    // If either node feeds an inplace op, deduping them may cause data races.
+    // For example: If we dedup nodes initializing two independent inplace
+    // accumulations, they will write to the same buffer, clobbering each
+    // other's results.
+    if (graph_has_inplace_ops && (FeedsInPlaceOp(graph_view, *rep) ||
+                                  FeedsInPlaceOp(graph_view, *node))) {
+      continue;
+    }
+    if (node_index[rep] > index) {
+      // `node` comes first in the graph and only became a duplicate of `rep`
+      // after its inputs changed. Keep it, like a pass in graph order would.
+      nodes.ReplaceRepresentative(rep, node);
+      std::swap(rep, node);
+    }
+    VLOG(3) << "Remove duplicated node: node=" << node->name()
+            << " representative=" << rep->name();
+    for (const auto& fanout : graph_view.GetFanouts(*node, true)) {
+      nodes.RemoveRepresentative(fanout.node);
+      dirty_nodes.insert(node_index[fanout.node]);
+    }
+    graph_view.UpdateFanouts(node->name(), rep->name());
+    duplicates.insert(node->name());
+  }
+  if (duplicates.empty()) {
+    return;
+  }
 
   // Delete duplicates
-  if (fetch_nodes_known_ && !duplicates.empty()) {
-    int last = optimized_graph_->node_size() - 1;
-    for (auto it = duplicates.rbegin(); it != duplicates.rend(); ++it) {
-      int index = *it;
-      optimized_graph_->mutable_node()->SwapElements(index, last);
-      last--;
-    }
-    optimized_graph_->mutable_node()->DeleteSubrange(last + 1,
-                                                     duplicates.size());
-    // Rebuild the NodeMap which was invalidated by the node  swapping above.
-    node_map_.reset(new NodeMap(optimized_graph_));
+  if (fetch_nodes_known_) {
+    graph_view.DeleteNodes(duplicates);
   }
+  node_map_.reset(new NodeMap(optimized_graph_));
 }
 
 void ArithmeticOptimizer::ForwardControlDependencies(
@@ -2493,6 +2819,12 @@ Status ArithmeticOptimizer::SimplifyArithmeticOps(bool can_use_shapes) {
     pipeline.AddStage<SqrtDivToRsqrtMulStage>(ctx, ctx_ext);
   if (options_.remove_idempotent)
     pipeline.AddStage<RemoveIdempotentStage>(ctx, ctx_ext);
+  if (options_.remove_redundant_reshape && can_use_shapes)
+    pipeline.AddStage<RemoveRedundantReshapeStage>(ctx, ctx_ext);
+  if (options_.remove_redundant_broadcast && can_use_shapes)
+    pipeline.AddStage<RemoveRedundantBroadcastStage>(ctx, ctx_ext);
+  if (options_.replace_pack_with_shape && can_use_shapes)
+    pipeline.AddStage<ReplacePackWithShapeStage>(ctx, ctx_ext);
 
   VLOG(1) << "Run " << pipeline.NumStages() << " arithmetic optimizer stages: "
           << str_util::Join(pipeline.StageNames(), ", ");
@@ -70,7 +70,10 @@ class ArithmeticOptimizer : public GraphOptimizer {
     bool remove_logical_not = true;
     bool remove_negation = true;
     bool remove_redundant_bitcast = true;
+    bool remove_redundant_broadcast = true;
     bool remove_redundant_cast = true;
+    bool remove_redundant_reshape = true;
+    bool replace_pack_with_shape = true;
 
     // Choose which arithmetic optimizer stages will be enabled for a given
     // optimization level by default.
@@ -15,8 +15,11 @@ limitations under the License.
 
 #include "tensorflow/core/grappler/optimizers/arithmetic_optimizer.h"
 #include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
 #include "tensorflow/core/framework/node_def.pb.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/graph_constructor.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/inputs/trivial_test_graph_input_yielder.h"
 #include "tensorflow/core/grappler/optimizers/constant_folding.h"
@@ -24,7 +27,9 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils.h"
 #include "tensorflow/core/grappler/utils/grappler_test.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 namespace grappler {
@@ -123,7 +128,10 @@ class ArithmeticOptimizerTest : public GrapplerTest {
     options.remove_involution = false;
     options.remove_idempotent = false;
     options.remove_redundant_bitcast = false;
+    options.remove_redundant_broadcast = false;
     options.remove_redundant_cast = false;
+    options.remove_redundant_reshape = false;
+    options.replace_pack_with_shape = false;
     options.remove_negation = false;
     options.remove_logical_not = false;
     optimizer->options_ = options;
@@ -133,6 +141,11 @@ class ArithmeticOptimizerTest : public GrapplerTest {
     optimizer->options_.combine_add_to_addn = false;
   }
 
+  void EnableOnlyDedupComputations(ArithmeticOptimizer* optimizer) {
+    DisableAllStages(optimizer);
+    optimizer->options_.dedup_computations = true;
+  }
+
   void EnableOnlyAddToAddNCombining(ArithmeticOptimizer* optimizer) {
     DisableAllStages(optimizer);
     optimizer->options_.combine_add_to_addn = true;
@@ -168,6 +181,21 @@ class ArithmeticOptimizerTest : public GrapplerTest {
     optimizer->options_.remove_redundant_cast = true;
   }
 
+  void EnableOnlyRemoveRedundantReshape(ArithmeticOptimizer* optimizer) {
+    DisableAllStages(optimizer);
+    optimizer->options_.remove_redundant_reshape = true;
+  }
+
+  void EnableOnlyRemoveRedundantBroadcast(ArithmeticOptimizer* optimizer) {
+    DisableAllStages(optimizer);
+    optimizer->options_.remove_redundant_broadcast = true;
+  }
+
+  void EnableOnlyReplacePackWithShape(ArithmeticOptimizer* optimizer) {
+    DisableAllStages(optimizer);
+    optimizer->options_.replace_pack_with_shape = true;
+  }
+
   void EnableOnlyRemoveNegation(ArithmeticOptimizer* optimizer) {
     DisableAllStages(optimizer);
     optimizer->options_.remove_negation = true;
@@ -317,6 +345,38 @@ TEST_F(ArithmeticOptimizerTest, OpDedupCommutative) {
   test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-6);
 }
 
+TEST_F(ArithmeticOptimizerTest, OpDedupChain) {
+  // Two identical chains only become duplicates one node at a time, starting
+  // from the constants. The second chain is listed first in the graph.
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output c2 = ops::Const(s.WithOpName("c2"), {1.0f, 2.0f}, {1, 2});
+  Output neg2 = ops::Neg(s.WithOpName("neg2"), c2);
+  Output sqrt2 = ops::Sqrt(s.WithOpName("sqrt2"), neg2);
+  Output c1 = ops::Const(s.WithOpName("c1"), {1.0f, 2.0f}, {1, 2});
+  Output neg1 = ops::Neg(s.WithOpName("neg1"), c1);
+  Output sqrt1 = ops::Sqrt(s.WithOpName("sqrt1"), neg1);
+  Output div = ops::Div(s.WithOpName("div"), sqrt1, sqrt2);
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"div"};
+
+  ArithmeticOptimizer optimizer;
+  EnableOnlyDedupComputations(&optimizer);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+  NodeMap node_map(&output);
+
+  EXPECT_EQ(4, output.node_size());
+  const NodeDef* new_neg2 = node_map.GetNode("neg2");
+  ASSERT_NE(new_neg2, nullptr);
+  EXPECT_EQ("c2", new_neg2->input(0));
+  const NodeDef* new_div = node_map.GetNode("div");
+  ASSERT_NE(new_div, nullptr);
+  EXPECT_EQ(2, new_div->input_size());
+  EXPECT_EQ("sqrt2", new_div->input(0));
+  EXPECT_EQ("sqrt2", new_div->input(1));
+}
+
 TEST_F(ArithmeticOptimizerTest, MulToSquare) {
   tensorflow::Scope s = tensorflow::Scope::NewRootScope();
   Output c = ops::Const(s.WithOpName("c"), {1.0f, 2.0f}, {1, 2});
@@ -1134,6 +1194,205 @@ TEST_F(ArithmeticOptimizerTest, CombineReshapes) {
   test::ExpectTensorEqual<int8>(tensors_expected[0], tensors[0]);
 }
 
+TEST_F(ArithmeticOptimizerTest, RemoveRedundantReshape_SymbolicShapes) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  // Both the batch size and the sequence length are unknown.
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({-1, -1, 16}));
+  Output expand = ops::ExpandDims(s.WithOpName("expand"), x, 1);
+  Output squeeze = ops::Squeeze(s.WithOpName("squeeze"), expand,
+                                ops::Squeeze::Axis({1}));
+  Output reshape = ops::Reshape(s.WithOpName("reshape"), squeeze,
+                                ops::Shape(s.WithOpName("shape"), x));
+  Output outputs = ops::Identity(s.WithOpName("outputs"), reshape);
+
+  GrapplerItem item;
+  item.fetch = {"outputs"};
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({2, 5, 16}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(1, tensors_expected.size());
+
+  GraphDef output;
+  ArithmeticOptimizer optimizer;
+  EnableOnlyRemoveRedundantReshape(&optimizer);
+  OptimizeTwiceAndPrune(&optimizer, &item, &output);
+
+  EXPECT_EQ(2, output.node_size());
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "outputs") {
+      EXPECT_EQ("x", node.input(0));
+    }
+  }
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorEqual<float>(tensors_expected[0], tensors[0]);
+}
+
+TEST_F(ArithmeticOptimizerTest, RemoveRedundantReshape_KeepShapeChanges) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({-1, -1, 16}));
+  Output expand = ops::ExpandDims(s.WithOpName("expand"), x, 0);
+  Output flatten =
+      ops::Reshape(s.WithOpName("flatten"), expand,
+                   ops::Const(s.WithOpName("flatten_shape"), {-1, 16}, {2}));
+  // The squeeze anchors a control dependency.
+  Output squeeze = ops::Squeeze(s.WithOpName("squeeze").WithControlDependencies(
+                                    ops::Const(s.WithOpName("c"), 1.0f)),
+                                expand, ops::Squeeze::Axis({0}));
+  Output outputs1 = ops::Identity(s.WithOpName("outputs1"), flatten);
+  Output outputs2 = ops::Identity(s.WithOpName("outputs2"), squeeze);
+
+  GrapplerItem item;
+  item.fetch = {"outputs1", "outputs2"};
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({2, 5, 16}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(2, tensors_expected.size());
+
+  GraphDef output;
+  ArithmeticOptimizer optimizer;
+  EnableOnlyRemoveRedundantReshape(&optimizer);
+  OptimizeTwiceAndPrune(&optimizer, &item, &output);
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "flatten") {
+      // The reshape reads its input before the ExpandDims.
+      EXPECT_EQ("x", node.input(0));
+      ++found;
+    } else if (node.name() == "outputs2") {
+      EXPECT_EQ("squeeze", node.input(0));
+      ++found;
+    }
+  }
+  EXPECT_EQ(2, found);
+
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(2, tensors.size());
+  for (int i = 0; i < tensors.size(); ++i) {
+    test::ExpectTensorEqual<float>(tensors_expected[i], tensors[i]);
+  }
+}
+
+TEST_F(ArithmeticOptimizerTest, RemoveRedundantBroadcast) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({-1, 16}));
+  Output relu = ops::Relu(s.WithOpName("relu"), x);
+  Output broadcast = ops::BroadcastTo(s.WithOpName("broadcast"), relu,
+                                      ops::Shape(s.WithOpName("shape"), x));
+  Output tile = ops::Tile(s.WithOpName("tile"), x,
+                          ops::Const(s.WithOpName("ones"), {1, 1}, {2}));
+  Output repeat = ops::Tile(s.WithOpName("repeat"), x,
+                            ops::Const(s.WithOpName("twos"), {2, 1}, {2}));
+  Output outputs1 = ops::Identity(s.WithOpName("outputs1"), broadcast);
+  Output outputs2 = ops::Identity(s.WithOpName("outputs2"), tile);
+  Output outputs3 = ops::Identity(s.WithOpName("outputs3"), repeat);
+
+  GrapplerItem item;
+  item.fetch = {"outputs1", "outputs2", "outputs3"};
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({3, 16}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(3, tensors_expected.size());
+
+  GraphDef output;
+  ArithmeticOptimizer optimizer;
+  EnableOnlyRemoveRedundantBroadcast(&optimizer);
+  OptimizeTwiceAndPrune(&optimizer, &item, &output);
+
+  EXPECT_EQ(0, CountOpNodes(output, "BroadcastTo"));
+  EXPECT_EQ(1, CountOpNodes(output, "Tile"));
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "outputs1") {
+      EXPECT_EQ("relu", node.input(0));
+      ++found;
+    } else if (node.name() == "outputs2") {
+      EXPECT_EQ("x", node.input(0));
+      ++found;
+    } else if (node.name() == "outputs3") {
+      EXPECT_EQ("repeat", node.input(0));
+      ++found;
+    }
+  }
+  EXPECT_EQ(3, found);
+
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(3, tensors.size());
+  for (int i = 0; i < tensors.size(); ++i) {
+    test::ExpectTensorEqual<float>(tensors_expected[i], tensors[i]);
+  }
+}
+
+TEST_F(ArithmeticOptimizerTest, ReplacePackWithShape) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({-1, -1, 16}));
+  Output relu = ops::Relu(s.WithOpName("relu"), x);
+  Output shape = ops::Shape(s.WithOpName("shape"), x);
+  auto dim = [&s, &shape](const string& name, int index) {
+    return ops::StridedSlice(s.WithOpName(name), shape, {index}, {index + 1},
+                             {1}, ops::StridedSlice::ShrinkAxisMask(1));
+  };
+  Output batch = dim("batch", 0);
+  Output time = dim("time", 1);
+  Output last = dim("last", -1);
+  // The last dimension of the shape of `relu` is the same as that of `x`.
+  Output relu_last =
+      ops::StridedSlice(s.WithOpName("relu_last"),
+                        ops::Shape(s.WithOpName("relu_shape"), relu), {2}, {3},
+                        {1}, ops::StridedSlice::ShrinkAxisMask(1));
+  Output packed1 = ops::Stack(s.WithOpName("packed1"), {batch, time, 16});
+  Output packed2 = ops::Stack(s.WithOpName("packed2"), {batch, time, last});
+  Output packed3 =
+      ops::Stack(s.WithOpName("packed3"), {batch, time, relu_last});
+  // The dimensions aren't in order, or don't match the shape.
+  Output packed4 = ops::Stack(s.WithOpName("packed4"), {time, batch, 16});
+  Output packed5 = ops::Stack(s.WithOpName("packed5"), {batch, time, 8, 2});
+  std::vector<Output> packed = {packed1, packed2, packed3, packed4, packed5};
+  GrapplerItem item;
+  for (int i = 0; i < packed.size(); ++i) {
+    const string name = strings::StrCat("reshape", i + 1);
+    ops::Reshape(s.WithOpName(name), relu, packed[i]);
+    item.fetch.push_back(name);
+  }
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({2, 5, 16}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(5, tensors_expected.size());
+
+  GraphDef output;
+  ArithmeticOptimizer optimizer;
+  EnableOnlyReplacePackWithShape(&optimizer);
+  OptimizeTwiceAndPrune(&optimizer, &item, &output);
+
+  EXPECT_EQ(2, CountOpNodes(output, "Pack"));
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "reshape1" || node.name() == "reshape2" ||
+        node.name() == "reshape3") {
+      EXPECT_EQ("shape", node.input(1));
+      ++found;
+    } else if (node.name() == "reshape4") {
+      EXPECT_EQ("packed4", node.input(1));
+      ++found;
+    } else if (node.name() == "reshape5") {
+      EXPECT_EQ("packed5", node.input(1));
+      ++found;
+    }
+  }
+  EXPECT_EQ(5, found);
+
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(5, tensors.size());
+  for (int i = 0; i < tensors.size(); ++i) {
+    test::ExpectTensorEqual<float>(tensors_expected[i], tensors[i]);
+  }
+}
+
 TEST_F(ArithmeticOptimizerTest, ReorderTransposeCast) {
   tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice("/gpu:0");
   Output nhwc_uint8 =
@@ -2860,5 +3119,127 @@ TEST_F(ArithmeticOptimizerTest, RemoveLogicalNot) {
   }
 }
 
+// Builds `num_layers` fully connected layers on `x`, a [?, 64] float tensor,
+// with the shape manipulations of models exported with an unknown batch size.
+// All of them are no-ops.
+static Output DynamicShapeLayers(const Scope& s, Output x, int num_layers) {
+  Output w = ops::Const(s.WithOpName("w"), 0.01f, {64, 64});
+  for (int i = 0; i < num_layers; ++i) {
+    const Scope layer = s.NewSubScope(strings::StrCat("layer", i));
+    Output batch = ops::StridedSlice(
+        layer.WithOpName("batch"), ops::Shape(layer.WithOpName("shape"), x),
+        {0}, {1}, {1}, ops::StridedSlice::ShrinkAxisMask(1));
+    Output cube =
+        ops::Reshape(layer.WithOpName("to_3d"), x,
+                     ops::Stack(layer.WithOpName("shape_3d"), {batch, 8, 8}));
+    Output flat =
+        ops::Reshape(layer.WithOpName("to_2d"), cube,
+                     ops::Stack(layer.WithOpName("shape_2d"), {batch, 64}));
+    Output squeeze = ops::Squeeze(
+        layer.WithOpName("squeeze"),
+        ops::ExpandDims(layer.WithOpName("expand"), flat, 1),
+        ops::Squeeze::Axis({1}));
+    Output broadcast = ops::BroadcastTo(
+        layer.WithOpName("broadcast"), squeeze,
+        ops::Shape(layer.WithOpName("squeeze_shape"), squeeze));
+    x = ops::Relu(layer.WithOpName("relu"),
+                  ops::MatMul(layer.WithOpName("matmul"), broadcast, w));
+  }
+  return x;
+}
+
+TEST_F(ArithmeticOptimizerTest, RemoveNoOpShapeManipulations) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({-1, 64}));
+  Output y = DynamicShapeLayers(s, x, 4);
+
+  GrapplerItem item;
+  item.fetch = {y.node()->name()};
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({3, 64}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(1, tensors_expected.size());
+
+  GraphDef output;
+  ArithmeticOptimizer optimizer;
+  OptimizeAndPrune(&optimizer, &item, &output);
+
+  // Only the placeholder, the weights and the matmuls and relus are left.
+  EXPECT_EQ(10, output.node_size());
+  EXPECT_EQ(4, CountOpNodes(output, "MatMul"));
+  EXPECT_EQ(4, CountOpNodes(output, "Relu"));
+
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-6);
+}
+
+// Optimizes a graph of `num_chains` identical chains of `chain_length` nodes,
+// which deduplication collapses into a single chain.
+static void BM_ArithmeticOptimizerDedupChains(int iters, int num_chains,
+                                              int chain_length) {
+  testing::StopTiming();
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  std::vector<Output> outputs;
+  for (int i = 0; i < num_chains; ++i) {
+    Output x = ops::Const(s.WithOpName(strings::StrCat("c", i)), 1.0f, {});
+    for (int j = 0; j < chain_length; ++j) {
+      x = ops::Neg(s.WithOpName(strings::StrCat("neg", i, "_", j)), x);
+    }
+    outputs.push_back(x);
+  }
+  Output sum = ops::AddN(s.WithOpName("sum"), outputs);
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"sum"};
+  testing::ItemsProcessed(static_cast<int64>(iters) * item.graph.node_size());
+  testing::StartTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    ArithmeticOptimizer optimizer;
+    GraphDef output;
+    TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+  }
+}
+BENCHMARK(BM_ArithmeticOptimizerDedupChains)
+    ->ArgPair(2, 256)
+    ->ArgPair(2, 1024)
+    ->ArgPair(2, 4096)
+    ->ArgPair(16, 256)
+    ->ArgPair(16, 1024);
+
+// Runs DynamicShapeLayers with or without the arithmetic optimizer, to measure
+// the cost of the no-op reshapes and broadcasts it removes. The label shows
+// the number of nodes left.
+static void BM_DynamicShapeLayers(int iters, int num_layers, int optimize) {
+  testing::StopTiming();
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::PlaceholderWithDefault(
+      s.WithOpName("x"), ops::Const(s.WithOpName("x_value"), 1.0f, {32, 64}),
+      PartialTensorShape({-1, 64}));
+  Output y = DynamicShapeLayers(s, x, num_layers);
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {y.node()->name()};
+  if (optimize) {
+    GraphDef output;
+    TF_CHECK_OK(ArithmeticOptimizer().Optimize(nullptr, item, &output));
+    item.graph.Swap(&output);
+    TF_CHECK_OK(ModelPruner().Optimize(nullptr, item, &output));
+    item.graph.Swap(&output);
+  }
+  testing::SetLabel(strings::StrCat("nodes=", item.graph.node_size()));
+
+  Graph* g = new Graph(OpRegistry::Global());
+  TF_CHECK_OK(ConvertGraphDefToGraph(GraphConstructorOptions(), item.graph, g));
+  test::Benchmark("cpu", g).Run(iters);
+}
+BENCHMARK(BM_DynamicShapeLayers)
+    ->ArgPair(8, 0)
+    ->ArgPair(8, 1)
+    ->ArgPair(32, 0)
+    ->ArgPair(32, 1);
+
 }  // namespace grappler
 }  // namespace tensorflow
@@ -17,6 +17,8 @@ limitations under the License.
 
 #include "tensorflow/core/grappler/optimizers/constant_folding.h"
 
+#include <list>
+
 #include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/attr_value.pb.h"
 #include "tensorflow/core/framework/function.pb.h"
@@ -33,18 +35,25 @@ limitations under the License.
 #include "tensorflow/core/grappler/op_types.h"
 #include "tensorflow/core/grappler/optimizers/symbolic_shapes.h"
 #include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/lib/core/blocking_counter.h"
 #include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
 #include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/denormal.h"
 #include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/setround.h"
 #include "tensorflow/core/platform/tensor_coding.h"
 #include "tensorflow/core/public/version.h"
 #include "tensorflow/core/util/bcast.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tensorflow/core/util/saved_tensor_slice_util.h"
 
 namespace tensorflow {
@@ -91,6 +100,14 @@ class DeviceSimple : public DeviceBase {
     eigen_device_.reset();
     delete eigen_worker_threads_.workers;
   }
+  // Returns the device evaluating the foldable nodes when no CPU device is
+  // provided. It is shared by the ConstantFolding instances of the process, so
+  // that they don't each start a thread per CPU.
+  static DeviceBase* Shared() {
+    static DeviceSimple* device = new DeviceSimple();
+    return device;
+  }
+
   Status MakeTensorFromProto(const TensorProto& tensor_proto,
                              const AllocatorAttributes alloc_attrs,
                              Tensor* tensor) override {
@@ -173,11 +190,159 @@ bool MaybeRemoveControlInput(const string& old_input, NodeDef* node,
   return removed_input;
 }
 
+// Runs the concurrent evaluations of foldable nodes. Kept apart from the
+// threads of the CPU device, which the kernels being evaluated may block on.
+thread::ThreadPool* EvaluationThreadPool() {
+  static thread::ThreadPool* pool =
+      new thread::ThreadPool(Env::Default(), "constant_folding_eval",
+                             std::max(1, port::NumSchedulableCPUs()));
+  return pool;
+}
+
+// Hit rate of the folded value cache.
+auto* folded_value_cache_lookups = monitoring::Counter<1>::New(
+    "/tensorflow/core/grappler/constant_folding/folded_value_cache_lookups",
+    "The number of folded value cache lookups, by result (hit or miss).",
+    "result");
+
+// Returns the number of bytes taken by the folded constants.
+int64 FoldedBytes(const std::vector<NodeDef>& const_nodes) {
+  int64 bytes = 0;
+  for (const NodeDef& node : const_nodes) {
+    bytes += node.ByteSizeLong();
+  }
+  return bytes;
+}
+
+// Returns the number of bytes of the serialized inputs.
+int64 InputBytes(const std::vector<const TensorProto*>& inputs) {
+  int64 bytes = 0;
+  for (const TensorProto* input : inputs) {
+    bytes += input->ByteSizeLong();
+  }
+  return bytes;
+}
+
+// Returns the signature of a node reading the values `inputs`: nodes with the
+// same op, attributes and input values fold into the same constants.
+Fprint128 FoldedValueSignature(const NodeDef& node,
+                               const std::vector<const TensorProto*>& inputs) {
+  NodeDef op_and_attrs;
+  op_and_attrs.set_op(node.op());
+  *op_and_attrs.mutable_attr() = node.attr();
+  string serialized;
+  SerializeToStringDeterministic(op_and_attrs, &serialized);
+  Fprint128 signature = Fingerprint128(serialized);
+  for (const TensorProto* input : inputs) {
+    SerializeToStringDeterministic(*input, &serialized);
+    const Fprint128 input_signature = Fingerprint128(serialized);
+    signature.low64 = FingerprintCat64(signature.low64, input_signature.low64);
+    signature.high64 =
+        FingerprintCat64(signature.high64, input_signature.high64);
+  }
+  return signature;
+}
+
+// Maps node signatures to the constants the nodes fold into, with the node
+// names cleared. The cache is shared by all the ConstantFolding instances of
+// the process, so that optimizing the same graph again (e.g. when a model is
+// reloaded) doesn't evaluate its foldable nodes again. The least recently used
+// entries are evicted once the cache exceeds its capacity, which is read from
+// TF_CONSTANT_FOLDING_CACHE_BYTES when the cache is first used.
+class FoldedValueCache {
+ public:
+  static FoldedValueCache* Global() {
+    static FoldedValueCache* cache = [] {
+      int64 capacity_bytes;
+      Status s = ReadInt64FromEnvVar("TF_CONSTANT_FOLDING_CACHE_BYTES",
+                                     kDefaultCapacityBytes, &capacity_bytes);
+      if (!s.ok()) {
+        LOG(WARNING) << s;
+        capacity_bytes = kDefaultCapacityBytes;
+      }
+      return new FoldedValueCache(capacity_bytes);
+    }();
+    return cache;
+  }
+
+  bool Lookup(const Fprint128& signature, std::vector<NodeDef>* const_nodes) {
+    mutex_lock l(mu_);
+    auto it = index_.find(signature);
+    if (it == index_.end()) {
+      return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    *const_nodes = it->second->const_nodes;
+    return true;
+  }
+
+  void Insert(const Fprint128& signature,
+              const std::vector<NodeDef>& const_nodes) {
+    Entry entry;
+    entry.signature = signature;
+    entry.const_nodes = const_nodes;
+    for (NodeDef& node : entry.const_nodes) {
+      node.clear_name();
+    }
+    entry.bytes = FoldedBytes(entry.const_nodes);
+    if (entry.bytes > capacity_bytes_) {
+      return;
+    }
+    mutex_lock l(mu_);
+    if (index_.find(signature) != index_.end()) {
+      return;
+    }
+    size_bytes_ += entry.bytes;
+    entries_.push_front(std::move(entry));
+    index_[signature] = entries_.begin();
+    while (size_bytes_ > capacity_bytes_) {
+      size_bytes_ -= entries_.back().bytes;
+      index_.erase(entries_.back().signature);
+      entries_.pop_back();
+    }
+  }
+
+ private:
+  static constexpr int64 kDefaultCapacityBytes = 256LL << 20;
+
+  explicit FoldedValueCache(int64 capacity_bytes)
+      : capacity_bytes_(capacity_bytes) {}
+
+  struct Entry {
+    Fprint128 signature;
+    std::vector<NodeDef> const_nodes;
+    int64 bytes;
+  };
+
+  const int64 capacity_bytes_;
+  mutex mu_;
+  // Most recently used first.
+  std::list<Entry> entries_ GUARDED_BY(mu_);
+  std::unordered_map<Fprint128, std::list<Entry>::iterator, Fprint128Hasher>
+      index_ GUARDED_BY(mu_);
+  int64 size_bytes_ GUARDED_BY(mu_) = 0;
+};
+
 }  // namespace
 
+// static
+ConstantFolding::FoldingOptions ConstantFolding::FoldingOptions::Default(
+    RewriterConfig::Toggle opt_level) {
+  FoldingOptions options;
+  options.num_threads = std::max(1, port::NumSchedulableCPUs());
+  options.cache_folded_values = opt_level == RewriterConfig::AGGRESSIVE;
+  return options;
+}
+
 ConstantFolding::ConstantFolding(RewriterConfig::Toggle opt_level,
                                  DeviceBase* cpu_device)
-    : opt_level_(opt_level), cpu_device_(cpu_device) {
+    : ConstantFolding(opt_level, cpu_device,
+                      FoldingOptions::Default(opt_level)) {}
+
+ConstantFolding::ConstantFolding(RewriterConfig::Toggle opt_level,
+                                 DeviceBase* cpu_device,
+                                 const FoldingOptions& options)
+    : opt_level_(opt_level), options_(options), cpu_device_(cpu_device) {
   resource_mgr_.reset(new ResourceMgr());
 }
 
@@ -1010,20 +1175,10 @@ Status ConstantFolding::EvaluateNode(const NodeDef& node,
 }
 
 Status ConstantFolding::EvaluateOneFoldable(const NodeDef& node,
-                                            std::vector<NodeDef>* outputs) {
-  TensorVector inputs;
-  TensorVector output_tensors;
-  auto inputs_cleanup = gtl::MakeCleanup([&inputs, &output_tensors] {
-    for (const auto& input : inputs) {
-      delete input.tensor;
-    }
-    for (const auto& output : output_tensors) {
-      if (output.tensor) {
-        delete output.tensor;
-      }
-    }
-  });
-
+                                            std::vector<NodeDef>* outputs,
+                                            bool* cache_hit) const {
+  *cache_hit = false;
+  std::vector<const TensorProto*> input_values;
   for (const auto& input : node.input()) {
     int port = 0;
     ParseNodeNameAsStringPiece(input, &port);
@@ -1037,9 +1192,53 @@ Status ConstantFolding::EvaluateOneFoldable(const NodeDef& node,
                     strings::StrCat("Can't fold ", node.name(), ", its ", input,
                                     " isn't constant"));
     }
-    const TensorProto& raw_val = input_node->attr().at("value").tensor();
-    Tensor* value = new Tensor(raw_val.dtype(), raw_val.tensor_shape());
-    CHECK(value->FromProto(raw_val));
+    input_values.push_back(&input_node->attr().at("value").tensor());
+  }
+
+  auto folded_node_name = [this, &node, outputs](int i) {
+    string node_name = OptimizedNodeName(node, "-folded");
+    if (outputs->size() > 1) {
+      node_name = strings::StrCat(node_name, "-", i);
+    }
+    return node_name;
+  };
+
+  const bool use_cache =
+      options_.cache_folded_values &&
+      InputBytes(input_values) <= options_.max_cached_input_bytes;
+  Fprint128 signature = {0, 0};
+  if (use_cache) {
+    signature = FoldedValueSignature(node, input_values);
+    if (FoldedValueCache::Global()->Lookup(signature, outputs)) {
+      folded_value_cache_lookups->GetCell("hit")->IncrementBy(1);
+      for (size_t i = 0; i < outputs->size(); i++) {
+        // Dead outputs are cached as empty NodeDefs.
+        if (!outputs->at(i).op().empty()) {
+          outputs->at(i).set_name(folded_node_name(i));
+        }
+      }
+      *cache_hit = true;
+      return Status::OK();
+    }
+    folded_value_cache_lookups->GetCell("miss")->IncrementBy(1);
+  }
+
+  TensorVector inputs;
+  TensorVector output_tensors;
+  auto inputs_cleanup = gtl::MakeCleanup([&inputs, &output_tensors] {
+    for (const auto& input : inputs) {
+      delete input.tensor;
+    }
+    for (const auto& output : output_tensors) {
+      if (output.tensor) {
+        delete output.tensor;
+      }
+    }
+  });
+
+  for (const TensorProto* raw_val : input_values) {
+    Tensor* value = new Tensor(raw_val->dtype(), raw_val->tensor_shape());
+    CHECK(value->FromProto(*raw_val));
     inputs.emplace_back(value);
   }
 
@@ -1050,119 +1249,152 @@ Status ConstantFolding::EvaluateOneFoldable(const NodeDef& node,
 
   outputs->resize(output_tensors.size());
   for (size_t i = 0; i < output_tensors.size(); i++) {
-    string node_name = OptimizedNodeName(node, "-folded");
-    if (output_tensors.size() > 1) {
-      node_name = strings::StrCat(node_name, "-", i);
-    }
     if (output_tensors[i].tensor) {
-      TF_RETURN_IF_ERROR(
-          CreateNodeDef(node_name, output_tensors[i], &outputs->at(i)));
+      TF_RETURN_IF_ERROR(CreateNodeDef(folded_node_name(i), output_tensors[i],
+                                       &outputs->at(i)));
     } else {
       // Create an empty NodeDef to identify dead outputs (e.g. the output of a
       // switch that's not selected by the switch predicate).
       outputs->at(i) = NodeDef();
     }
   }
+  if (use_cache) {
+    FoldedValueCache::Global()->Insert(signature, *outputs);
+  }
   return Status::OK();
 }
 
-Status ConstantFolding::FoldNode(NodeDef* node, GraphDef* output_graph) {
-  if (IsMerge(*node)) {
-    // Merge nodes are special, in the sense that they execute as soon as one of
-    // their input is ready. We can therefore fold a merge node iff it has at
-    // least one constant input without control dependency.
-    // We still need to ensure that the nodes in the fanin of the merge node are
-    // scheduled. We'll therefore add a control dependency from the merge node
-    // to the folded constant. We end up with:
-    //  * the merge node and its inputs are preserved as is
-    //  * a new constant node C1, driven by the merge node through a control
-    //  dependency, initialized to the value of the folded input
-    //  * a new constant node C2, driven by the merge node through a control
-    //  dependency, initialized to the index of the folded input
-    //  * the fanout of the merge nodes is rewired to be driven by either C1 or
-    //  C2.
-    for (int input_index = 0; input_index < node->input_size(); ++input_index) {
-      const auto& input = node->input(input_index);
-      if (IsControlInput(input)) {
-        // Try the next input.
-        continue;
-      }
-      NodeDef* input_node = node_map_->GetNode(input);
-      if (!IsReallyConstant(*input_node)) {
-        continue;
-      }
-      bool valid_input = true;
-      for (const string& fanin_of_input : input_node->input()) {
-        if (IsControlInput(fanin_of_input)) {
-          valid_input = false;
-          break;
-        }
-      }
-      if (!valid_input) {
-        // Try the next input
-        continue;
+void ConstantFolding::EvaluateFoldables(const std::vector<NodeDef*>& nodes,
+                                        std::vector<EvaluatedNode>* results) {
+  results->clear();
+  results->resize(nodes.size());
+  auto evaluate = [this, &nodes, results](int i) {
+    EvaluatedNode* result = &(*results)[i];
+    // Merge nodes are folded without being evaluated.
+    if (!IsMerge(*nodes[i])) {
+      result->status = EvaluateOneFoldable(*nodes[i], &result->const_nodes,
+                                           &result->cache_hit);
+    }
+  };
+  if (options_.num_threads <= 1 || nodes.size() < 2) {
+    for (int i = 0; i < nodes.size(); ++i) {
+      evaluate(i);
+    }
+    return;
+  }
+  // The callers pass at most num_threads nodes at once, which bounds how many
+  // threads of the shared pool they use.
+  BlockingCounter counter(nodes.size());
+  for (int i = 0; i < nodes.size(); ++i) {
+    EvaluationThreadPool()->Schedule([&evaluate, &counter, i]() {
+      // TensorFlow flushes denormals to zero and rounds to nearest, so we do
+      // the same here.
+      port::ScopedFlushDenormal flush;
+      port::ScopedSetRound round(FE_TONEAREST);
+      evaluate(i);
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+}
+
+Status ConstantFolding::FoldMergeNode(NodeDef* node, GraphDef* output_graph) {
+  // Merge nodes are special, in the sense that they execute as soon as one of
+  // their input is ready. We can therefore fold a merge node iff it has at
+  // least one constant input without control dependency.
+  // We still need to ensure that the nodes in the fanin of the merge node are
+  // scheduled. We'll therefore add a control dependency from the merge node
+  // to the folded constant. We end up with:
+  //  * the merge node and its inputs are preserved as is
+  //  * a new constant node C1, driven by the merge node through a control
+  //  dependency, initialized to the value of the folded input
+  //  * a new constant node C2, driven by the merge node through a control
+  //  dependency, initialized to the index of the folded input
+  //  * the fanout of the merge nodes is rewired to be driven by either C1 or
+  //  C2.
+  for (int input_index = 0; input_index < node->input_size(); ++input_index) {
+    const auto& input = node->input(input_index);
+    if (IsControlInput(input)) {
+      // Try the next input.
+      continue;
+    }
+    NodeDef* input_node = node_map_->GetNode(input);
+    if (!IsReallyConstant(*input_node)) {
+      continue;
+    }
+    bool valid_input = true;
+    for (const string& fanin_of_input : input_node->input()) {
+      if (IsControlInput(fanin_of_input)) {
+        valid_input = false;
+        break;
       }
+    }
+    if (!valid_input) {
+      // Try the next input
+      continue;
+    }
 
-      string const_out_name = OptimizedNodeName(*node, "_const");
-      string const_index_name = OptimizedNodeName(*node, "_index");
-      if (node_map_->GetNode(const_out_name) ||
-          node_map_->GetNode(const_index_name)) {
-        // Intended name already exists.
-        return errors::AlreadyExists(
-            strings::StrCat(const_out_name, " or ", const_index_name,
-                            " already present in the graph"));
-      }
-
-      NodeDef* const_out = output_graph->add_node();
-      *const_out = *input_node;
-      const_out->set_name(const_out_name);
-      const_out->set_device(node->device());
-      *const_out->add_input() = AsControlDependency(*node);
-      node_map_->AddNode(const_out->name(), const_out);
-      node_map_->AddOutput(node->name(), const_out->name());
-
-      NodeDef* const_index = output_graph->add_node();
-      const_index->set_op("Const");
-      Tensor index(DT_INT32, TensorShape({}));
-      index.flat<int32>()(0) = input_index;
-      (*const_index->mutable_attr())["dtype"].set_type(DT_INT32);
-      index.AsProtoTensorContent(
-          (*const_index->mutable_attr())["value"].mutable_tensor());
-      const_index->set_name(const_index_name);
-      const_index->set_device(node->device());
-      *const_index->add_input() = AsControlDependency(*node);
-      node_map_->AddNode(const_index->name(), const_index);
-      node_map_->AddOutput(node->name(), const_index->name());
-
-      auto outputs = node_map_->GetOutputs(node->name());
-      for (NodeDef* output : outputs) {
-        for (int i = 0; i < output->input_size(); i++) {
-          int port;
-          string node_name = ParseNodeName(output->input(i), &port);
-          if (node_name == node->name()) {
-            if (port == 0) {
-              *output->mutable_input(i) = const_out->name();
-              node_map_->AddOutput(const_out->name(), output->name());
-            } else if (port == 1) {
-              *output->mutable_input(i) = const_index->name();
-              node_map_->AddOutput(const_index->name(), output->name());
-            } else {
-              // This is a control dependency (or an invalid edge since the
-              // merge node has only 2 inputs): preserve them.
-            }
+    string const_out_name = OptimizedNodeName(*node, "_const");
+    string const_index_name = OptimizedNodeName(*node, "_index");
+    if (node_map_->GetNode(const_out_name) ||
+        node_map_->GetNode(const_index_name)) {
+      // Intended name already exists.
+      return errors::AlreadyExists(
+          strings::StrCat(const_out_name, " or ", const_index_name,
+                          " already present in the graph"));
+    }
+
+    NodeDef* const_out = output_graph->add_node();
+    *const_out = *input_node;
+    const_out->set_name(const_out_name);
+    const_out->set_device(node->device());
+    *const_out->add_input() = AsControlDependency(*node);
+    node_map_->AddNode(const_out->name(), const_out);
+    node_map_->AddOutput(node->name(), const_out->name());
+
+    NodeDef* const_index = output_graph->add_node();
+    const_index->set_op("Const");
+    Tensor index(DT_INT32, TensorShape({}));
+    index.flat<int32>()(0) = input_index;
+    (*const_index->mutable_attr())["dtype"].set_type(DT_INT32);
+    index.AsProtoTensorContent(
+        (*const_index->mutable_attr())["value"].mutable_tensor());
+    const_index->set_name(const_index_name);
+    const_index->set_device(node->device());
+    *const_index->add_input() = AsControlDependency(*node);
+    node_map_->AddNode(const_index->name(), const_index);
+    node_map_->AddOutput(node->name(), const_index->name());
+
+    auto outputs = node_map_->GetOutputs(node->name());
+    for (NodeDef* output : outputs) {
+      for (int i = 0; i < output->input_size(); i++) {
+        int port;
+        string node_name = ParseNodeName(output->input(i), &port);
+        if (node_name == node->name()) {
+          if (port == 0) {
+            *output->mutable_input(i) = const_out->name();
+            node_map_->AddOutput(const_out->name(), output->name());
+          } else if (port == 1) {
+            *output->mutable_input(i) = const_index->name();
+            node_map_->AddOutput(const_index->name(), output->name());
+          } else {
+            // This is a control dependency (or an invalid edge since the
+            // merge node has only 2 inputs): preserve them.
           }
         }
       }
-      return Status::OK();
     }
     return Status::OK();
   }
+  return Status::OK();
+}
 
-  std::vector<NodeDef> const_nodes;
-  TF_RETURN_IF_ERROR(EvaluateOneFoldable(*node, &const_nodes));
+Status ConstantFolding::FoldNode(NodeDef* node,
+                                 std::vector<NodeDef>* const_nodes,
+                                 GraphDef* output_graph) {
   NodeDef* constant_output = nullptr;
-  for (int i = 0; i < const_nodes.size(); i++) {
-    NodeDef* const_node = &const_nodes[i];
+  for (int i = 0; i < const_nodes->size(); i++) {
+    NodeDef* const_node = &const_nodes->at(i);
     if (const_node->name().empty()) {
       // Dead output: we can't create a constant to encode its value, so we'll
       // just skip it. We'll preserve the edges that originate from that
@@ -1191,7 +1423,7 @@ Status ConstantFolding::FoldNode(NodeDef* node, GraphDef* output_graph) {
 
     // We rewrite the existing node if it only has a single output, and
     // create new nodes otherwise.
-    if (const_nodes.size() == 1) {
+    if (const_nodes->size() == 1) {
       node->set_op("Const");
       // Note we need to clear the inputs in NodeMap before we clear the inputs
       // in the node, otherwise NodeMap would see empty inputs and effectively
@@ -1224,7 +1456,7 @@ Status ConstantFolding::FoldNode(NodeDef* node, GraphDef* output_graph) {
     }
   }
 
-  if (const_nodes.size() > 1) {
+  if (const_nodes->size() > 1) {
     auto outputs = node_map_->GetOutputs(node->name());
     for (NodeDef* output : outputs) {
       for (int i = 0; i < output->input_size(); i++) {
@@ -1239,12 +1471,12 @@ Status ConstantFolding::FoldNode(NodeDef* node, GraphDef* output_graph) {
                                      constant_output->name());
               *output->mutable_input(i) = AsControlDependency(*constant_output);
             }
-          } else if (port < const_nodes.size() &&
-                     !const_nodes[port].name().empty()) {
+          } else if (port < const_nodes->size() &&
+                     !(*const_nodes)[port].name().empty()) {
             // Replace alive outputs with the corresponding constant.
             node_map_->UpdateInput(output->name(), NodeName(output->input(i)),
-                                   const_nodes[port].name());
-            *output->mutable_input(i) = const_nodes[port].name();
+                                   (*const_nodes)[port].name());
+            *output->mutable_input(i) = (*const_nodes)[port].name();
           } else {
             // Leave this edge alone.
             VLOG(1) << "Preserving edge from " << node->name() << ":" << port
@@ -1265,40 +1497,75 @@ Status ConstantFolding::FoldNode(NodeDef* node, GraphDef* output_graph) {
 }
 
 Status ConstantFolding::FoldGraph(GraphDef* output) {
-  std::unordered_set<string> processed_nodes;
-  std::deque<NodeDef*> queue;
+  // The nodes are folded in waves. All the inputs of the nodes of a wave are
+  // constant, so they are independent and can be evaluated concurrently. Their
+  // fanouts that become foldable make up the next wave. The waves are
+  // evaluated in batches to bound the memory held by the computed constants.
+  std::unordered_set<string> queued_nodes;
+  std::vector<NodeDef*> wave;
   for (int i = 0; i < graph_->node_size(); i++) {
     if (IsFoldable(graph_->node(i))) {
-      queue.push_back(graph_->mutable_node(i));
-    }
-  }
-  while (!queue.empty()) {
-    NodeDef* node = queue.front();
-    queue.pop_front();
-    if (processed_nodes.count(node->name())) {
-      continue;
-    }
-    // We need to record a copy of output nodes before FoldNode() modifies it.
-    // We also need to ensure that the fanout is sorted deterministically.
-    const std::set<NodeDef*>& outputs = node_map_->GetOutputs(node->name());
-    std::vector<NodeDef*> fanout(outputs.begin(), outputs.end());
-    std::sort(fanout.begin(), fanout.end(),
-              [](const NodeDef* n1, const NodeDef* n2) {
-                return n1->name() < n2->name();
-              });
-
-    Status s = FoldNode(node, output);
-    processed_nodes.insert(node->name());
-    if (!s.ok()) {
-      VLOG(1) << "Failed to fold node " << node->DebugString()
-              << "\nError message: " << s;
-    } else {
-      for (auto& output : fanout) {
-        if (IsFoldable(*output)) {
-          queue.push_back(output);
+      wave.push_back(graph_->mutable_node(i));
+      queued_nodes.insert(graph_->node(i).name());
+    }
+  }
+  const int batch_size = std::max(1, options_.num_threads);
+  std::vector<EvaluatedNode> results;
+  while (!wave.empty() && !over_budget_) {
+    std::vector<NodeDef*> next_wave;
+    for (int begin = 0; begin < wave.size() && !over_budget_;
+         begin += batch_size) {
+      const int end = std::min<int>(wave.size(), begin + batch_size);
+      std::vector<NodeDef*> batch(wave.begin() + begin, wave.begin() + end);
+      EvaluateFoldables(batch, &results);
+      for (int i = 0; i < batch.size(); ++i) {
+        NodeDef* node = batch[i];
+        // We need to record a copy of output nodes before FoldNode() modifies
+        // it. We also need to ensure that the fanout is sorted
+        // deterministically.
+        const std::set<NodeDef*>& outputs =
+            node_map_->GetOutputs(node->name());
+        std::vector<NodeDef*> fanout(outputs.begin(), outputs.end());
+        std::sort(fanout.begin(), fanout.end(),
+                  [](const NodeDef* n1, const NodeDef* n2) {
+                    return n1->name() < n2->name();
+                  });
+
+        Status s;
+        if (IsMerge(*node)) {
+          s = FoldMergeNode(node, output);
+        } else {
+          s = results[i].status;
+          const int64 bytes = FoldedBytes(results[i].const_nodes);
+          if (s.ok() && folded_bytes_ + bytes > options_.max_folded_bytes) {
+            LOG(WARNING) << "Stopped constant folding at node " << node->name()
+                         << ": the folded constants would take more than "
+                         << options_.max_folded_bytes << " bytes.";
+            over_budget_ = true;
+            break;
+          }
+          if (s.ok()) {
+            s = FoldNode(node, &results[i].const_nodes, output);
+          }
+          if (s.ok()) {
+            folded_bytes_ += bytes;
+            num_cached_folds_ += results[i].cache_hit;
+          }
+        }
+        if (!s.ok()) {
+          VLOG(1) << "Failed to fold node " << node->DebugString()
+                  << "\nError message: " << s;
+        } else {
+          for (auto& output : fanout) {
+            if (!queued_nodes.count(output->name()) && IsFoldable(*output)) {
+              next_wave.push_back(output);
+              queued_nodes.insert(output->name());
+            }
+          }
         }
       }
     }
+    wave.swap(next_wave);
   }
 
   // Delete the newly created nodes that don't feed anything.
@@ -3025,8 +3292,7 @@ Status ConstantFolding::Optimize(Cluster* cluster, const GrapplerItem& item,
   }
 
   if (cpu_device_ == nullptr) {
-    owned_device_.reset(new DeviceSimple());
-    cpu_device_ = owned_device_.get();
+    cpu_device_ = DeviceSimple::Shared();
   }
 
   graph_contains_assign_or_inplace_op_ = false;
@@ -3038,6 +3304,9 @@ Status ConstantFolding::Optimize(Cluster* cluster, const GrapplerItem& item,
   }
 
   has_fetch_ = !item.fetch.empty();
+  folded_bytes_ = 0;
+  over_budget_ = false;
+  num_cached_folds_ = 0;
   GrapplerItem item_to_optimize = item;
   *optimized_graph = item.graph;
   int64 node_count;
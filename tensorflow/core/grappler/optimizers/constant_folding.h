@@ -38,8 +38,30 @@ class ConstantFolding : public GraphOptimizer {
   static string AddControlDependency(const string& input_name, GraphDef* graph,
                                      NodeMap* node_map);
 
+  // Granular control over the evaluation of the foldable nodes.
+  struct FoldingOptions {
+    // Number of nodes evaluated concurrently.
+    int num_threads = 1;
+    // Maximum number of bytes of constants created by one call to Optimize.
+    // Folding stops, with a warning, once the budget is spent.
+    int64 max_folded_bytes = kint64max;
+    // Reuse the values folded from identical nodes by earlier runs in this
+    // process. The cache holds up to TF_CONSTANT_FOLDING_CACHE_BYTES bytes
+    // (256MB by default) once a ConstantFolding instance uses it.
+    bool cache_folded_values = false;
+    // Nodes whose inputs take more bytes are neither looked up nor stored in
+    // the cache, since looking them up fingerprints all their inputs.
+    int64 max_cached_input_bytes = 1 << 20;
+
+    // Evaluates the nodes on all the CPUs. The folded values are only cached
+    // when opt_level is AGGRESSIVE.
+    static FoldingOptions Default(RewriterConfig::Toggle opt_level);
+  };
+
   explicit ConstantFolding(DeviceBase* cpu_device);
   ConstantFolding(RewriterConfig::Toggle opt_level, DeviceBase* cpu_device);
+  ConstantFolding(RewriterConfig::Toggle opt_level, DeviceBase* cpu_device,
+                  const FoldingOptions& options);
 
   ~ConstantFolding() override {}
 
@@ -51,6 +73,10 @@ class ConstantFolding : public GraphOptimizer {
   void Feedback(Cluster* cluster, const GrapplerItem& item,
                 const GraphDef& optimize_output, double result) override;
 
+  // Number of nodes folded by the last call to Optimize whose values were
+  // found in the folded value cache.
+  int64 num_cached_folds() const { return num_cached_folds_; }
+
  private:
   string OptimizedNodeName(const NodeDef& node, StringPiece suffix) const;
   bool OptimizedNodeExists(const NodeDef& node, StringPiece suffix) const;
@@ -71,10 +97,25 @@ class ConstantFolding : public GraphOptimizer {
                       const gtl::InlinedVector<TensorValue, 4>& inputs,
                       gtl::InlinedVector<TensorValue, 4>* output) const;
 
-  Status EvaluateOneFoldable(const NodeDef& node,
-                             std::vector<NodeDef>* outputs);
-
-  Status FoldNode(NodeDef* node, GraphDef* output_graph);
+  // Computes the constants that replace the outputs of a foldable node other
+  // than a Merge. Dead outputs are represented by an empty NodeDef. Only reads
+  // the graph, so several nodes can be evaluated concurrently.
+  Status EvaluateOneFoldable(const NodeDef& node, std::vector<NodeDef>* outputs,
+                             bool* cache_hit) const;
+
+  struct EvaluatedNode {
+    Status status;
+    std::vector<NodeDef> const_nodes;
+    bool cache_hit = false;
+  };
+  // Evaluates the nodes, concurrently if possible.
+  void EvaluateFoldables(const std::vector<NodeDef*>& nodes,
+                         std::vector<EvaluatedNode>* results);
+
+  Status FoldMergeNode(NodeDef* node, GraphDef* output_graph);
+  // Replaces the node with the constants computed by EvaluateOneFoldable.
+  Status FoldNode(NodeDef* node, std::vector<NodeDef>* const_nodes,
+                  GraphDef* output_graph);
 
   bool IsOnes(const NodeDef& node) const;
   bool IsZeros(const NodeDef& node) const;
@@ -209,10 +250,11 @@ class ConstantFolding : public GraphOptimizer {
   // Removes Split or SplitV node if possible.
   bool RemoveSplitOrSplitV(const GraphProperties& properties,
                            GraphDef* optimized_graph, NodeDef* node);
-  // Points to an externally provided device or to owned_device_;
   RewriterConfig::Toggle opt_level_;
+  FoldingOptions options_;
+  // Points to an externally provided device or to a CPU device shared by the
+  // ConstantFolding instances of the process.
   DeviceBase* cpu_device_;
-  std::unique_ptr<DeviceBase> owned_device_;
 
   std::unique_ptr<ResourceMgr> resource_mgr_;
   GraphDef* graph_;
@@ -223,6 +265,10 @@ class ConstantFolding : public GraphOptimizer {
   bool has_fetch_;
   bool graph_modified_;
   bool graph_contains_assign_or_inplace_op_;
+  // Bytes of constants created by folding in the current call to Optimize.
+  int64 folded_bytes_ = 0;
+  bool over_budget_ = false;
+  int64 num_cached_folds_ = 0;
 };
 
 }  // end namespace grappler
@@ -24,6 +24,7 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 namespace grappler {
@@ -3039,6 +3040,151 @@ TEST_F(ConstantFoldingTest, TensorArraySize) {
   test::ExpectTensorEqual<int32>(tensors_expected[1], tensors_actual[1]);
 }
 
+// Builds `num_chains` independent chains of `length` MatMuls of random
+// constant matrices of size `dim`. Each chain feeds a MatMul with the
+// placeholder "x", which is fetched.
+GrapplerItem MatMulChains(int num_chains, int length, int dim) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape(TensorShape({dim, dim})));
+  GrapplerItem item;
+  for (int c = 0; c < num_chains; ++c) {
+    Tensor a_t(DT_FLOAT, TensorShape({dim, dim}));
+    a_t.flat<float>().setRandom();
+    // Keep the values of the products close to 1.
+    a_t.flat<float>() = a_t.flat<float>() * (1.0f / dim);
+    Output a = ops::Const(s.WithOpName(strings::StrCat("a", c)), a_t);
+    Output m = a;
+    for (int l = 0; l < length; ++l) {
+      m = ops::MatMul(s.WithOpName(strings::StrCat("m", c, "_", l)), m, a);
+    }
+    const string out = strings::StrCat("out", c);
+    ops::MatMul(s.WithOpName(out), m, x);
+    item.fetch.push_back(out);
+  }
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  return item;
+}
+
+TEST_F(ConstantFoldingTest, ParallelFoldingMatchesSerial) {
+  GrapplerItem item = MatMulChains(8, 3, 4);
+  auto options =
+      ConstantFolding::FoldingOptions::Default(RewriterConfig::ON);
+  options.cache_folded_values = false;
+
+  options.num_threads = 1;
+  GraphDef serial;
+  TF_EXPECT_OK(ConstantFolding(RewriterConfig::ON, nullptr, options)
+                   .Optimize(nullptr, item, &serial));
+  options.num_threads = 4;
+  GraphDef parallel;
+  TF_EXPECT_OK(ConstantFolding(RewriterConfig::ON, nullptr, options)
+                   .Optimize(nullptr, item, &parallel));
+
+  // Each chain is folded into a single constant.
+  EXPECT_EQ(1 + 2 * 8, parallel.node_size());
+  CompareGraphs(serial, parallel);
+
+  Tensor x_t(DT_FLOAT, TensorShape({4, 4}));
+  x_t.flat<float>().setRandom();
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  auto tensors = EvaluateNodes(parallel, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(8, tensors_expected.size());
+  EXPECT_EQ(8, tensors.size());
+  for (int i = 0; i < item.fetch.size(); ++i) {
+    test::ExpectTensorNear<float>(tensors_expected[i], tensors[i], 1e-5);
+  }
+}
+
+TEST_F(ConstantFoldingTest, FoldedValuesAreCached) {
+  GrapplerItem item = MatMulChains(2, 2, 3);
+  auto options =
+      ConstantFolding::FoldingOptions::Default(RewriterConfig::AGGRESSIVE);
+  EXPECT_TRUE(options.cache_folded_values);
+  EXPECT_FALSE(ConstantFolding::FoldingOptions::Default(RewriterConfig::ON)
+                   .cache_folded_values);
+
+  ConstantFolding optimizer(RewriterConfig::AGGRESSIVE, nullptr, options);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+  EXPECT_EQ(0, optimizer.num_cached_folds());
+
+  // Another optimizer reuses the folded values.
+  ConstantFolding other_optimizer(RewriterConfig::AGGRESSIVE, nullptr, options);
+  GraphDef cached_output;
+  TF_EXPECT_OK(other_optimizer.Optimize(nullptr, item, &cached_output));
+  EXPECT_EQ(4, other_optimizer.num_cached_folds());
+  CompareGraphs(output, cached_output);
+
+  // Nodes with larger inputs aren't looked up.
+  options.max_cached_input_bytes = 8;
+  ConstantFolding large_input_optimizer(RewriterConfig::AGGRESSIVE, nullptr,
+                                        options);
+  GraphDef uncached_output;
+  TF_EXPECT_OK(large_input_optimizer.Optimize(nullptr, item, &uncached_output));
+  EXPECT_EQ(0, large_input_optimizer.num_cached_folds());
+  CompareGraphs(output, uncached_output);
+}
+
+TEST_F(ConstantFoldingTest, StopsFoldingOverBudget) {
+  // Each folded 16x16 matrix takes a little over 1KB.
+  GrapplerItem item = MatMulChains(1, 3, 16);
+  auto options =
+      ConstantFolding::FoldingOptions::Default(RewriterConfig::ON);
+  options.max_folded_bytes = 2500;
+  ConstantFolding optimizer(RewriterConfig::ON, nullptr, options);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "m0_1") {
+      ++found;
+      EXPECT_EQ("Const", node.op());
+    } else if (node.name() == "m0_2") {
+      ++found;
+      EXPECT_EQ("MatMul", node.op());
+    }
+  }
+  EXPECT_EQ(2, found);
+
+  Tensor x_t(DT_FLOAT, TensorShape({16, 16}));
+  x_t.flat<float>().setRandom();
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-4);
+}
+
+// Time it takes to fold the preprocessing of a model when it's loaded: 64
+// independent chains of 4 MatMuls of 256x256 constants.
+static void BM_ConstantFoldingLoadTime(int iters, int num_threads,
+                                       int cache_folded_values) {
+  testing::StopTiming();
+  GrapplerItem item = MatMulChains(64, 4, 256);
+  auto options =
+      ConstantFolding::FoldingOptions::Default(RewriterConfig::ON);
+  options.num_threads = num_threads;
+  options.cache_folded_values = cache_folded_values;
+  if (cache_folded_values) {
+    // Measure reloading a model that was already optimized.
+    GraphDef output;
+    TF_CHECK_OK(ConstantFolding(RewriterConfig::ON, nullptr, options)
+                    .Optimize(nullptr, item, &output));
+  }
+  testing::StartTiming();
+  for (int i = 0; i < iters; ++i) {
+    ConstantFolding optimizer(RewriterConfig::ON, nullptr, options);
+    GraphDef output;
+    TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+  }
+}
+BENCHMARK(BM_ConstantFoldingLoadTime)
+    ->ArgPair(1, 0)
+    ->ArgPair(4, 0)
+    ->ArgPair(16, 0)
+    ->ArgPair(16, 1);
+
 }  // namespace
 }  // namespace grappler
 }  // namespace tensorflow
@@ -0,0 +1,670 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/cpu_layout_optimizer.h"
+
+#include <functional>
+#include <map>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tensorflow/core/framework/attr_value.pb.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/versions.pb.h"
+#include "tensorflow/core/grappler/clusters/cluster.h"
+#include "tensorflow/core/grappler/clusters/utils.h"
+#include "tensorflow/core/grappler/costs/graph_properties.h"
+#include "tensorflow/core/grappler/costs/op_level_cost_estimator.h"
+#include "tensorflow/core/grappler/graph_view.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/op_types.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/util/blocked_layout.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+
+constexpr char kBlockedPrefix[] = "CpuLayoutOptimizer-Blocked";
+constexpr char kToBlockedPrefix[] = "CpuLayoutOptimizer-ToBlocked";
+constexpr char kBlockedFilterPrefix[] = "CpuLayoutOptimizer-BlockedFilter";
+
+// Channel block sizes of the _Blocked* kernels, in order of preference when
+// they are predicted to be as fast.
+constexpr int64 kBlockSizes[] = {16, 8};
+constexpr int64 kSmallestBlockSize = 8;
+
+bool HasNhwcDataFormat(const NodeDef& node) {
+  return node.attr().count("data_format") == 0 ||
+         node.attr().at("data_format").s() == "NHWC";
+}
+
+// Returns whether the list attr `name` of `node`, such as its strides, only
+// applies to the rows and the columns. Absent attrs default to ones.
+bool IsSpatialOnlyAttr(const NodeDef& node, const string& name) {
+  if (node.attr().count(name) == 0) return true;
+  const auto& values = node.attr().at(name).list().i();
+  return values.size() == 4 && values.Get(0) == 1 && values.Get(3) == 1;
+}
+
+// Returns the number of channels of a 4D NHWC tensor, or -1 if it has another
+// rank or an unknown number of channels.
+int64 NumChannels(const OpInfo::TensorProperties& nhwc) {
+  const TensorShapeProto& shape = nhwc.shape();
+  if (shape.unknown_rank() || shape.dim_size() != 4) return -1;
+  return shape.dim(3).size();
+}
+
+bool IsBlockedFusedOps(const NodeDef& node) {
+  if (node.op() != "_FusedConv2D") return true;
+  std::vector<string> fused_ops;
+  if (node.attr().count("fused_ops") > 0) {
+    for (const string& fused_op : node.attr().at("fused_ops").list().s()) {
+      fused_ops.push_back(fused_op);
+    }
+  }
+  const int num_args =
+      node.attr().count("num_args") > 0 ? node.attr().at("num_args").i() : 0;
+  if (fused_ops.empty()) return num_args == 0;
+  if (fused_ops[0] != "BiasAdd" || fused_ops.size() > 2 || num_args != 1) {
+    return false;
+  }
+  return fused_ops.size() == 1 || fused_ops[1] == "Relu" ||
+         fused_ops[1] == "Relu6";
+}
+
+bool IsBlockedElementwise(const NodeDef& node) {
+  static const std::unordered_set<string>* const kUnaryOps =
+      new std::unordered_set<string>({"Abs", "Elu", "Identity", "Neg", "Relu",
+                                      "Relu6", "Sigmoid", "Square", "Tanh"});
+  static const std::unordered_set<string>* const kBinaryOps =
+      new std::unordered_set<string>(
+          {"Add", "Maximum", "Minimum", "Mul", "Sub"});
+  const int num_inputs = NumNonControlInputs(node);
+  return (num_inputs == 1 && kUnaryOps->count(node.op()) > 0) ||
+         (num_inputs == 2 && kBinaryOps->count(node.op()) > 0);
+}
+
+// A node that has a _Blocked* equivalent, or that computes the same thing on
+// blocked tensors as on NHWC ones.
+struct BlockedCandidate {
+  enum Kind { kConvolution, kPooling, kElementwise };
+
+  const NodeDef* node = nullptr;
+  Kind kind = kElementwise;
+  // Channels of the output.
+  int64 channels = -1;
+
+  // Whether input `port` is an activation, which is blocked like the output,
+  // rather than a filter or a bias.
+  bool IsActivationInput(int port) const {
+    return port == 0 || (port > 0 && kind == kElementwise);
+  }
+};
+
+bool FindBlockedCandidate(const GraphProperties& properties,
+                          const std::unordered_set<string>& fed_nodes,
+                          const NodeDef& node, BlockedCandidate* candidate) {
+  if (fed_nodes.count(node.name()) > 0 || !IsPlacedOnCpu(node) ||
+      !HasNhwcDataFormat(node)) {
+    return false;
+  }
+  const DataType dtype = GetDataTypeFromAttr(node, "T");
+  if (dtype != DT_FLOAT && dtype != DT_DOUBLE) return false;
+  const auto& inputs = properties.GetInputProperties(node.name());
+  const auto& outputs = properties.GetOutputProperties(node.name());
+  if (outputs.size() != 1 || NumChannels(outputs[0]) < 0 ||
+      static_cast<int>(inputs.size()) != NumNonControlInputs(node)) {
+    return false;
+  }
+  const int64 channels = NumChannels(outputs[0]);
+
+  if (IsConv2D(node) || node.op() == "_FusedConv2D") {
+    // The filter must be HWIO with known input and output channels. Inputs
+    // with fewer channels than a block, like the images of the first layer
+    // of a model, would mostly be convolved as padding.
+    if (inputs.size() < 2 || NumChannels(inputs[1]) != channels ||
+        NumChannels(inputs[0]) < kSmallestBlockSize ||
+        inputs[1].shape().dim(2).size() != NumChannels(inputs[0]) ||
+        !IsSpatialOnlyAttr(node, "strides") ||
+        !IsSpatialOnlyAttr(node, "dilations") || !IsBlockedFusedOps(node)) {
+      return false;
+    }
+    candidate->kind = BlockedCandidate::kConvolution;
+  } else if (node.op() == "MaxPool" || node.op() == "AvgPool") {
+    if (NumChannels(inputs[0]) != channels ||
+        !IsSpatialOnlyAttr(node, "ksize") ||
+        !IsSpatialOnlyAttr(node, "strides")) {
+      return false;
+    }
+    candidate->kind = BlockedCandidate::kPooling;
+  } else if (IsBlockedElementwise(node)) {
+    // Broadcasting along the batch, the rows or the columns works the same
+    // on blocked tensors, but not along the channels.
+    for (const auto& input : inputs) {
+      if (NumChannels(input) != channels) return false;
+    }
+    candidate->kind = BlockedCandidate::kElementwise;
+  } else {
+    return false;
+  }
+  candidate->node = &node;
+  candidate->channels = channels;
+  return true;
+}
+
+string TensorName(const GraphView::OutputPort& port) {
+  return port.port_id == 0 ? port.node->name()
+                           : strings::StrCat(port.node->name(), ":",
+                                             port.port_id);
+}
+
+// Returns whether `port` is the output of a Const whose value can be folded
+// into its blocked layout.
+bool IsFoldableConstant(const GraphView::OutputPort& port) {
+  return port.port_id == 0 && IsConstant(*port.node) &&
+         port.node->attr().count("value") > 0;
+}
+
+OpInfo::TensorProperties BlockedActivation(
+    const OpInfo::TensorProperties& nhwc, int64 block_size) {
+  const TensorShapeProto& shape = nhwc.shape();
+  OpInfo::TensorProperties blocked;
+  blocked.set_dtype(nhwc.dtype());
+  auto* blocked_shape = blocked.mutable_shape();
+  blocked_shape->add_dim()->set_size(shape.dim(0).size());
+  blocked_shape->add_dim()->set_size(
+      NumChannelBlocks(shape.dim(3).size(), block_size));
+  blocked_shape->add_dim()->set_size(shape.dim(1).size());
+  blocked_shape->add_dim()->set_size(shape.dim(2).size());
+  blocked_shape->add_dim()->set_size(block_size);
+  return blocked;
+}
+
+OpInfo::TensorProperties BlockedFilter(const OpInfo::TensorProperties& hwio,
+                                       int64 block_size) {
+  const TensorShapeProto& shape = hwio.shape();
+  OpInfo::TensorProperties blocked;
+  blocked.set_dtype(hwio.dtype());
+  auto* blocked_shape = blocked.mutable_shape();
+  blocked_shape->add_dim()->set_size(
+      NumChannelBlocks(shape.dim(3).size(), block_size));
+  blocked_shape->add_dim()->set_size(
+      NumChannelBlocks(shape.dim(2).size(), block_size));
+  blocked_shape->add_dim()->set_size(shape.dim(0).size());
+  blocked_shape->add_dim()->set_size(shape.dim(1).size());
+  blocked_shape->add_dim()->set_size(block_size);
+  blocked_shape->add_dim()->set_size(block_size);
+  return blocked;
+}
+
+// Returns the name, the op and the attrs of the node computing `candidate` on
+// blocked tensors.
+NodeDef BlockedNode(const BlockedCandidate& candidate) {
+  const NodeDef& node = *candidate.node;
+  NodeDef blocked;
+  blocked.set_name(AddPrefixToNodeName(node.name(), kBlockedPrefix));
+  blocked.set_device(node.device());
+  auto* attr = blocked.mutable_attr();
+  switch (candidate.kind) {
+    case BlockedCandidate::kConvolution:
+      blocked.set_op("_BlockedConv2D");
+      for (const string name :
+           {"T", "strides", "padding", "dilations", "fused_ops", "num_args"}) {
+        if (node.attr().count(name) > 0) (*attr)[name] = node.attr().at(name);
+      }
+      if (attr->count("num_args") == 0) (*attr)["num_args"].set_i(0);
+      break;
+    case BlockedCandidate::kPooling:
+      blocked.set_op(strings::StrCat("_Blocked", node.op()));
+      for (const string name : {"T", "ksize", "strides", "padding"}) {
+        (*attr)[name] = node.attr().at(name);
+      }
+      break;
+    case BlockedCandidate::kElementwise:
+      blocked.set_op(node.op());
+      *attr = node.attr();
+      break;
+  }
+  return blocked;
+}
+
+// Picks the layout of connected blocked candidates and rewrites them.
+class BlockedLayoutRewriter {
+ public:
+  BlockedLayoutRewriter(const GraphView& graph,
+                        const GraphProperties& properties,
+                        const std::unordered_set<string>& nodes_to_preserve,
+                        const DeviceProperties& cpu,
+                        const std::vector<BlockedCandidate>& candidates)
+      : graph_(graph),
+        properties_(properties),
+        nodes_to_preserve_(nodes_to_preserve),
+        cpu_(cpu) {
+    for (const BlockedCandidate& candidate : candidates) {
+      candidates_[candidate.node->name()] = &candidate;
+    }
+  }
+
+  // Returns the candidate computing `node`, or nullptr.
+  const BlockedCandidate* Find(const NodeDef* node) const {
+    auto it = candidates_.find(node->name());
+    return it == candidates_.end() ? nullptr : it->second;
+  }
+
+  // Returns the block size that the candidates of `subgraph` are predicted to
+  // run the fastest with, or 0 to keep them NHWC.
+  int64 ChooseBlockSize(
+      const std::vector<const BlockedCandidate*>& subgraph) const;
+
+  // Adds the equivalent of `candidate` from `subgraph`, blocked by
+  // `block_size`, to `optimized_graph`, with the layout conversions it needs.
+  void Rewrite(const BlockedCandidate& candidate,
+               const std::unordered_set<string>& subgraph, int64 block_size,
+               GraphDef* optimized_graph);
+
+ private:
+  // Returns whether the input `port` of `candidate` comes from outside of
+  // `subgraph`, so that it must be converted from NHWC.
+  bool IsBoundaryInput(const BlockedCandidate& candidate, int port,
+                       const std::unordered_set<string>& subgraph) const;
+  // Returns whether the NHWC output of `candidate` is needed outside of
+  // `subgraph`.
+  bool IsBoundaryOutput(const BlockedCandidate& candidate,
+                        const std::unordered_set<string>& subgraph) const;
+
+  Costs::Duration PredictTime(
+      const string& op, const AttrValueMap& attr,
+      const std::vector<OpInfo::TensorProperties>& inputs,
+      const std::vector<OpInfo::TensorProperties>& outputs) const;
+  // Predicted time of `subgraph` in the blocked layout of `block_size`, or in
+  // NHWC if it is 0.
+  Costs::Duration PredictSubgraphTime(
+      const std::vector<const BlockedCandidate*>& subgraph,
+      int64 block_size) const;
+
+  // Return the names of the blocked input `port` and filter of `node`,
+  // adding the nodes that convert them. Inputs are converted once per block
+  // size, and constants are folded into their blocked layout.
+  string ConvertInput(const NodeDef& node, int port, int64 block_size,
+                      GraphDef* optimized_graph);
+  string ConvertFilter(const NodeDef& node, int64 block_size,
+                       GraphDef* optimized_graph);
+
+  const GraphView& graph_;
+  const GraphProperties& properties_;
+  const std::unordered_set<string>& nodes_to_preserve_;
+  const DeviceProperties cpu_;
+  OpLevelCostEstimator cost_estimator_;
+  std::unordered_map<string, const BlockedCandidate*> candidates_;
+  // Blocked NHWC tensors, by name of the NHWC tensor and block size.
+  std::map<std::pair<string, int64>, string> converted_inputs_;
+};
+
+bool BlockedLayoutRewriter::IsBoundaryInput(
+    const BlockedCandidate& candidate, int port,
+    const std::unordered_set<string>& subgraph) const {
+  const GraphView::OutputPort input =
+      graph_.GetRegularFanin(GraphView::InputPort(candidate.node, port));
+  return input.port_id != 0 || subgraph.count(input.node->name()) == 0;
+}
+
+bool BlockedLayoutRewriter::IsBoundaryOutput(
+    const BlockedCandidate& candidate,
+    const std::unordered_set<string>& subgraph) const {
+  if (nodes_to_preserve_.count(candidate.node->name()) > 0) return true;
+  for (const GraphView::InputPort& fanout :
+       graph_.GetFanouts(*candidate.node, true)) {
+    const BlockedCandidate* consumer = Find(fanout.node);
+    if (subgraph.count(fanout.node->name()) == 0 || consumer == nullptr ||
+        !consumer->IsActivationInput(fanout.port_id)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Costs::Duration BlockedLayoutRewriter::PredictTime(
+    const string& op, const AttrValueMap& attr,
+    const std::vector<OpInfo::TensorProperties>& inputs,
+    const std::vector<OpInfo::TensorProperties>& outputs) const {
+  OpContext op_context;
+  op_context.op_info.set_op(op);
+  *op_context.op_info.mutable_attr() = attr;
+  for (const auto& input : inputs) {
+    *op_context.op_info.add_inputs() = input;
+  }
+  for (const auto& output : outputs) {
+    *op_context.op_info.add_outputs() = output;
+  }
+  *op_context.op_info.mutable_device() = cpu_;
+  return cost_estimator_.PredictCosts(op_context).execution_time;
+}
+
+Costs::Duration BlockedLayoutRewriter::PredictSubgraphTime(
+    const std::vector<const BlockedCandidate*>& subgraph,
+    int64 block_size) const {
+  Costs::Duration time(0);
+  if (block_size == 0) {
+    for (const BlockedCandidate* candidate : subgraph) {
+      const NodeDef& node = *candidate->node;
+      // Conv2D computes the convolution the same way as _FusedConv2D, whose
+      // prediction accounts for the patches of the input it builds.
+      const string& op = IsConv2D(node) ? "_FusedConv2D" : node.op();
+      time += PredictTime(op, node.attr(),
+                          properties_.GetInputProperties(node.name()),
+                          properties_.GetOutputProperties(node.name()));
+    }
+    return time;
+  }
+
+  std::unordered_set<string> names;
+  for (const BlockedCandidate* candidate : subgraph) {
+    names.insert(candidate->node->name());
+  }
+  AttrValueMap conversion_attr;
+  conversion_attr["block_size"].set_i(block_size);
+  std::unordered_set<string> inputs_to_convert;
+  for (const BlockedCandidate* candidate : subgraph) {
+    const NodeDef& node = *candidate->node;
+    std::vector<OpInfo::TensorProperties> inputs =
+        properties_.GetInputProperties(node.name());
+    std::vector<OpInfo::TensorProperties> outputs =
+        properties_.GetOutputProperties(node.name());
+    for (int i = 0; i < inputs.size(); ++i) {
+      const OpInfo::TensorProperties nhwc = inputs[i];
+      if (candidate->IsActivationInput(i)) {
+        inputs[i] = BlockedActivation(nhwc, block_size);
+        const GraphView::OutputPort input =
+            graph_.GetRegularFanin(GraphView::InputPort(&node, i));
+        if (IsBoundaryInput(*candidate, i, names) &&
+            !IsFoldableConstant(input) &&
+            inputs_to_convert.insert(TensorName(input)).second) {
+          time += PredictTime("_ToBlockedLayout", conversion_attr, {nhwc},
+                              {inputs[i]});
+        }
+      } else if (i == 1 && candidate->kind == BlockedCandidate::kConvolution) {
+        inputs[i] = BlockedFilter(nhwc, block_size);
+        const GraphView::OutputPort filter =
+            graph_.GetRegularFanin(GraphView::InputPort(&node, i));
+        if (!IsFoldableConstant(filter)) {
+          time += PredictTime("_ToBlockedFilter", conversion_attr, {nhwc},
+                              {inputs[i]});
+        }
+      }
+    }
+    const OpInfo::TensorProperties nhwc_output = outputs[0];
+    outputs[0] = BlockedActivation(nhwc_output, block_size);
+    const NodeDef blocked = BlockedNode(*candidate);
+    time += PredictTime(blocked.op(), blocked.attr(), inputs, outputs);
+    if (IsBoundaryOutput(*candidate, names)) {
+      time += PredictTime("_FromBlockedLayout", AttrValueMap(), outputs,
+                          {nhwc_output});
+    }
+  }
+  return time;
+}
+
+int64 BlockedLayoutRewriter::ChooseBlockSize(
+    const std::vector<const BlockedCandidate*>& subgraph) const {
+  int64 best_block_size = 0;
+  Costs::Duration best_time = PredictSubgraphTime(subgraph, 0);
+  for (int64 block_size : kBlockSizes) {
+    const Costs::Duration time = PredictSubgraphTime(subgraph, block_size);
+    VLOG(2) << "Predicted time of " << subgraph.size()
+            << " ops blocked by " << block_size << ": " << time.count()
+            << " vs " << best_time.count();
+    if (time < best_time) {
+      best_time = time;
+      best_block_size = block_size;
+    }
+  }
+  return best_block_size;
+}
+
+string BlockedLayoutRewriter::ConvertInput(const NodeDef& node, int port,
+                                           int64 block_size,
+                                           GraphDef* optimized_graph) {
+  const GraphView::OutputPort input =
+      graph_.GetRegularFanin(GraphView::InputPort(&node, port));
+  const string tensor = TensorName(input);
+  string& converted = converted_inputs_[{tensor, block_size}];
+  if (!converted.empty()) return converted;
+  converted = AddPrefixToNodeName(
+      str_util::StringReplace(tensor, ":", "-", /*replace_all=*/true),
+      strings::StrCat(kToBlockedPrefix, block_size));
+
+  NodeDef* conversion = optimized_graph->add_node();
+  conversion->set_name(converted);
+  conversion->set_device(node.device());
+  Tensor value;
+  Tensor blocked;
+  if (IsFoldableConstant(input) &&
+      value.FromProto(input.node->attr().at("value").tensor()) &&
+      ToBlockedActivation(value, block_size, &blocked).ok()) {
+    conversion->set_op("Const");
+    (*conversion->mutable_attr())["dtype"].set_type(blocked.dtype());
+    blocked.AsProtoTensorContent(
+        (*conversion->mutable_attr())["value"].mutable_tensor());
+    // Keeps the control dependencies that put the constant in its frame.
+    for (const string& control : input.node->input()) {
+      conversion->add_input(control);
+    }
+    return converted;
+  }
+  conversion->set_op("_ToBlockedLayout");
+  conversion->add_input(node.input(port));
+  (*conversion->mutable_attr())["T"] = node.attr().at("T");
+  (*conversion->mutable_attr())["block_size"].set_i(block_size);
+  return converted;
+}
+
+string BlockedLayoutRewriter::ConvertFilter(const NodeDef& node,
+                                            int64 block_size,
+                                            GraphDef* optimized_graph) {
+  const GraphView::OutputPort filter =
+      graph_.GetRegularFanin(GraphView::InputPort(&node, 1));
+  NodeDef* conversion = optimized_graph->add_node();
+  conversion->set_name(AddPrefixToNodeName(node.name(), kBlockedFilterPrefix));
+  conversion->set_device(node.device());
+  Tensor value;
+  Tensor blocked;
+  if (IsFoldableConstant(filter) &&
+      value.FromProto(filter.node->attr().at("value").tensor()) &&
+      ToBlockedFilter(value, block_size, &blocked).ok()) {
+    conversion->set_op("Const");
+    (*conversion->mutable_attr())["dtype"].set_type(blocked.dtype());
+    blocked.AsProtoTensorContent(
+        (*conversion->mutable_attr())["value"].mutable_tensor());
+    for (const string& control : filter.node->input()) {
+      conversion->add_input(control);
+    }
+  } else {
+    conversion->set_op("_ToBlockedFilter");
+    conversion->add_input(node.input(1));
+    (*conversion->mutable_attr())["T"] = node.attr().at("T");
+    (*conversion->mutable_attr())["block_size"].set_i(block_size);
+  }
+  return conversion->name();
+}
+
+void BlockedLayoutRewriter::Rewrite(const BlockedCandidate& candidate,
+                                    const std::unordered_set<string>& subgraph,
+                                    int64 block_size,
+                                    GraphDef* optimized_graph) {
+  const NodeDef& node = *candidate.node;
+  NodeDef blocked = BlockedNode(candidate);
+  for (int i = 0; i < node.input_size(); ++i) {
+    const string& input = node.input(i);
+    if (IsControlInput(input)) {
+      blocked.add_input(input);
+    } else if (!candidate.IsActivationInput(i)) {
+      blocked.add_input(
+          i == 1 && candidate.kind == BlockedCandidate::kConvolution
+              ? ConvertFilter(node, block_size, optimized_graph)
+              : input);
+    } else if (IsBoundaryInput(candidate, i, subgraph)) {
+      blocked.add_input(ConvertInput(node, i, block_size, optimized_graph));
+    } else {
+      blocked.add_input(AddPrefixToNodeName(NodeName(input), kBlockedPrefix));
+    }
+  }
+
+  // The conversion back to NHWC takes the name of the node, so that its
+  // consumers and fetches are unchanged.
+  if (IsBoundaryOutput(candidate, subgraph)) {
+    NodeDef* nhwc = optimized_graph->add_node();
+    nhwc->set_name(node.name());
+    nhwc->set_op("_FromBlockedLayout");
+    nhwc->set_device(node.device());
+    nhwc->add_input(blocked.name());
+    (*nhwc->mutable_attr())["T"] = node.attr().at("T");
+    (*nhwc->mutable_attr())["channels"].set_i(candidate.channels);
+  }
+  *optimized_graph->add_node() = std::move(blocked);
+}
+
+// Properties of the CPU the blocked subgraphs run on.
+DeviceProperties GetCpuProperties(const Cluster* cluster) {
+  if (cluster != nullptr) {
+    for (const auto& device : cluster->GetDevices()) {
+      if (device.second.type() == "CPU") return device.second;
+    }
+  }
+  return GetLocalCPUInfo();
+}
+
+}  // namespace
+
+Status CpuLayoutOptimizer::Optimize(Cluster* cluster, const GrapplerItem& item,
+                                    GraphDef* optimized_graph) {
+  GraphProperties properties(item);
+  TF_RETURN_IF_ERROR(properties.InferStatically(false));
+  GraphView graph(const_cast<GraphDef*>(&item.graph));
+
+  const std::unordered_set<string> nodes_to_preserve = item.NodesToPreserve();
+  std::unordered_set<string> fed_nodes;
+  for (const auto& feed : item.feed) {
+    fed_nodes.insert(NodeName(feed.first));
+  }
+  std::vector<BlockedCandidate> candidates;
+  for (const NodeDef& node : item.graph.node()) {
+    BlockedCandidate candidate;
+    if (FindBlockedCandidate(properties, fed_nodes, node, &candidate)) {
+      candidates.push_back(candidate);
+    }
+  }
+  const DeviceProperties cpu = GetCpuProperties(cluster);
+  if (cpu.num_cores() <= 0 || cpu.frequency() <= 0) {
+    // The layouts can't be compared without the speed of the CPU.
+    *optimized_graph = item.graph;
+    return Status::OK();
+  }
+  BlockedLayoutRewriter rewriter(graph, properties, nodes_to_preserve, cpu,
+                                 candidates);
+
+  // Candidates that pass activations of the same type to each other on the
+  // same device form the subgraphs that are converted as a whole.
+  std::unordered_map<const NodeDef*, int> index;
+  for (int i = 0; i < candidates.size(); ++i) {
+    index[candidates[i].node] = i;
+  }
+  std::vector<int> parent(candidates.size());
+  std::iota(parent.begin(), parent.end(), 0);
+  std::function<int(int)> root = [&](int i) {
+    return parent[i] == i ? i : parent[i] = root(parent[i]);
+  };
+  for (int i = 0; i < candidates.size(); ++i) {
+    const NodeDef& node = *candidates[i].node;
+    for (int port = 0; port < NumNonControlInputs(node); ++port) {
+      if (!candidates[i].IsActivationInput(port)) continue;
+      const GraphView::OutputPort input =
+          graph.GetRegularFanin(GraphView::InputPort(&node, port));
+      auto producer = index.find(input.node);
+      if (input.port_id != 0 || producer == index.end() ||
+          input.node->device() != node.device() ||
+          GetDataTypeFromAttr(*input.node, "T") !=
+              GetDataTypeFromAttr(node, "T")) {
+        continue;
+      }
+      parent[root(i)] = root(producer->second);
+    }
+  }
+  std::map<int, std::vector<const BlockedCandidate*>> subgraphs;
+  for (int i = 0; i < candidates.size(); ++i) {
+    subgraphs[root(i)].push_back(&candidates[i]);
+  }
+
+  // Subgraphs without a convolution or a pooling have nothing to gain from
+  // the blocked layout.
+  struct BlockedSubgraph {
+    std::unordered_set<string> nodes;
+    int64 block_size;
+  };
+  std::vector<BlockedSubgraph> blocked_subgraphs;
+  for (const auto& subgraph : subgraphs) {
+    const auto& nodes = subgraph.second;
+    bool has_window_op = false;
+    for (const BlockedCandidate* candidate : nodes) {
+      has_window_op |= candidate->kind != BlockedCandidate::kElementwise;
+    }
+    if (!has_window_op) continue;
+    const int64 block_size = rewriter.ChooseBlockSize(nodes);
+    if (block_size == 0) continue;
+    VLOG(1) << "Blocking " << nodes.size() << " ops by " << block_size
+            << " from " << nodes[0]->node->name();
+    blocked_subgraphs.push_back({{}, block_size});
+    for (const BlockedCandidate* candidate : nodes) {
+      blocked_subgraphs.back().nodes.insert(candidate->node->name());
+    }
+  }
+  std::unordered_map<string, const BlockedSubgraph*> blocked_nodes;
+  for (const BlockedSubgraph& subgraph : blocked_subgraphs) {
+    for (const string& name : subgraph.nodes) {
+      blocked_nodes[name] = &subgraph;
+    }
+  }
+
+  for (const NodeDef& node : item.graph.node()) {
+    auto subgraph = blocked_nodes.find(node.name());
+    if (subgraph == blocked_nodes.end()) {
+      *optimized_graph->add_node() = node;
+      continue;
+    }
+    rewriter.Rewrite(*rewriter.Find(&node), subgraph->second->nodes,
+                     subgraph->second->block_size, optimized_graph);
+  }
+
+  *optimized_graph->mutable_library() = item.graph.library();
+  *optimized_graph->mutable_versions() = item.graph.versions();
+  return Status::OK();
+}
+
+void CpuLayoutOptimizer::Feedback(Cluster* /*cluster*/,
+                                  const GrapplerItem& /*item*/,
+                                  const GraphDef& /*optimized_graph*/,
+                                  double /*result*/) {
+  // Nothing to do for CpuLayoutOptimizer.
+}
+
+}  // end namespace grappler
+}  // end namespace tensorflow
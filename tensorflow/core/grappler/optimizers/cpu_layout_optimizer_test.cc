@@ -0,0 +1,225 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/cpu_layout_optimizer.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/grappler/clusters/virtual_cluster.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/utils/grappler_test.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace grappler {
+
+class CpuLayoutOptimizerTest : public GrapplerTest {
+ protected:
+  void SetUp() override {
+    DeviceProperties cpu_device;
+    cpu_device.set_type("CPU");
+    cpu_device.set_frequency(2000);
+    cpu_device.set_num_cores(1);
+    cluster_.reset(new VirtualCluster(
+        {{"/job:localhost/replica:0/task:0/device:CPU:0", cpu_device}}));
+  }
+
+  std::unique_ptr<VirtualCluster> cluster_;
+};
+
+namespace {
+
+constexpr char kCpu[] = "/job:localhost/replica:0/task:0/device:CPU:0";
+
+// Returns a 3x3 filter with 32 outputs, small enough for the activations to
+// stay close to 1.
+Tensor RandomFilter(int in_depth) {
+  Tensor filter(DT_FLOAT, TensorShape({3, 3, in_depth, 32}));
+  filter.flat<float>().setRandom();
+  filter.flat<float>() = filter.flat<float>() * (1.0f / (9 * in_depth));
+  return filter;
+}
+
+// Builds conv1 -> relu1 -> pool -> conv2 -> add(conv2, pool) -> relu2 on an
+// input of `channels` channels, with the output named "output". The filter of
+// conv2 is a Const if `constant_filter` and a Placeholder otherwise.
+void BuildConvolutions(int channels, bool constant_filter,
+                       const string& device, GrapplerItem* item) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice(device);
+  auto input = ops::Placeholder(s.WithOpName("input"), DT_FLOAT,
+                                ops::Placeholder::Shape({2, 16, 16, channels}));
+  auto filter1 = ops::Const(s.WithOpName("filter1"), RandomFilter(channels));
+  Output filter2 =
+      constant_filter
+          ? Output(ops::Const(s.WithOpName("filter2"), RandomFilter(32)))
+          : Output(ops::Placeholder(s.WithOpName("filter2"), DT_FLOAT,
+                                    ops::Placeholder::Shape({3, 3, 32, 32})));
+
+  auto conv1 = ops::Conv2D(s.WithOpName("conv1"), input, filter1,
+                           {1, 1, 1, 1}, "SAME");
+  auto relu1 = ops::Relu(s.WithOpName("relu1"), conv1);
+  auto pool = ops::MaxPool(s.WithOpName("pool"), relu1, {1, 3, 3, 1},
+                           {1, 2, 2, 1}, "SAME");
+  auto conv2 = ops::Conv2D(s.WithOpName("conv2"), pool, filter2,
+                           {1, 1, 1, 1}, "SAME");
+  auto add = ops::Add(s.WithOpName("add"), conv2, pool);
+  ops::Relu(s.WithOpName("output"), add);
+  TF_CHECK_OK(s.ToGraphDef(&item->graph));
+  item->fetch = {"output"};
+}
+
+std::vector<std::pair<string, Tensor>> RandomInputs(int channels) {
+  Tensor input(DT_FLOAT, TensorShape({2, 16, 16, channels}));
+  input.flat<float>().setRandom();
+  return {{"input", input}, {"filter2", RandomFilter(32)}};
+}
+
+const NodeDef* FindNode(const GraphDef& graph, const string& name) {
+  for (const NodeDef& node : graph.node()) {
+    if (node.name() == name) return &node;
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+TEST_F(CpuLayoutOptimizerTest, BlocksConvolutionsWithConstantFilters) {
+  GrapplerItem item;
+  BuildConvolutions(32, /*constant_filter=*/true, kCpu, &item);
+
+  CpuLayoutOptimizer optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(cluster_.get(), item, &output));
+
+  // Only the input and the fetched output are converted, and the filters are
+  // stored in the blocked layout.
+  EXPECT_EQ(1, CountOpNodes(output, "_ToBlockedLayout"));
+  EXPECT_EQ(1, CountOpNodes(output, "_FromBlockedLayout"));
+  EXPECT_EQ(0, CountOpNodes(output, "_ToBlockedFilter"));
+  EXPECT_EQ(2, CountOpNodes(output, "_BlockedConv2D"));
+  EXPECT_EQ(1, CountOpNodes(output, "_BlockedMaxPool"));
+  const NodeDef* conv = FindNode(output, "CpuLayoutOptimizer-Blocked/conv2");
+  ASSERT_NE(nullptr, conv);
+  EXPECT_EQ("CpuLayoutOptimizer-Blocked/pool", conv->input(0));
+  const NodeDef* filter = FindNode(output, conv->input(1));
+  ASSERT_NE(nullptr, filter);
+  EXPECT_EQ("Const", filter->op());
+  EXPECT_EQ(6, filter->attr().at("value").tensor().tensor_shape().dim_size());
+  const NodeDef* add = FindNode(output, "CpuLayoutOptimizer-Blocked/add");
+  ASSERT_NE(nullptr, add);
+  EXPECT_EQ("Add", add->op());
+  const NodeDef* nhwc = FindNode(output, "output");
+  ASSERT_NE(nullptr, nhwc);
+  EXPECT_EQ("_FromBlockedLayout", nhwc->op());
+  EXPECT_EQ(32, nhwc->attr().at("channels").i());
+
+  const auto inputs = RandomInputs(32);
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {inputs[0]});
+  auto tensors = EvaluateNodes(output, item.fetch, {inputs[0]});
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-5);
+}
+
+TEST_F(CpuLayoutOptimizerTest, ConvertsFetchedIntermediateNodes) {
+  GrapplerItem item;
+  BuildConvolutions(32, /*constant_filter=*/true, kCpu, &item);
+  item.fetch.push_back("pool");
+
+  CpuLayoutOptimizer optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(cluster_.get(), item, &output));
+
+  EXPECT_EQ(2, CountOpNodes(output, "_FromBlockedLayout"));
+  EXPECT_EQ("_FromBlockedLayout", FindNode(output, "pool")->op());
+  EXPECT_EQ("CpuLayoutOptimizer-Blocked/pool",
+            FindNode(output, "CpuLayoutOptimizer-Blocked/conv2")->input(0));
+
+  const auto inputs = RandomInputs(32);
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {inputs[0]});
+  auto tensors = EvaluateNodes(output, item.fetch, {inputs[0]});
+  EXPECT_EQ(2, tensors.size());
+  for (int i = 0; i < 2; ++i) {
+    test::ExpectTensorNear<float>(tensors_expected[i], tensors[i], 1e-5);
+  }
+}
+
+TEST_F(CpuLayoutOptimizerTest, ConvertsNonConstantFilters) {
+  GrapplerItem item;
+  BuildConvolutions(32, /*constant_filter=*/false, kCpu, &item);
+
+  CpuLayoutOptimizer optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(cluster_.get(), item, &output));
+
+  const NodeDef* filter =
+      FindNode(output, "CpuLayoutOptimizer-BlockedFilter/conv2");
+  ASSERT_NE(nullptr, filter);
+  EXPECT_EQ("_ToBlockedFilter", filter->op());
+  EXPECT_EQ("filter2", filter->input(0));
+
+  const auto inputs = RandomInputs(32);
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, inputs);
+  auto tensors = EvaluateNodes(output, item.fetch, inputs);
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-5);
+}
+
+TEST_F(CpuLayoutOptimizerTest, KeepsConvolutionOfImagesNhwc) {
+  GrapplerItem item;
+  BuildConvolutions(3, /*constant_filter=*/true, kCpu, &item);
+
+  CpuLayoutOptimizer optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(cluster_.get(), item, &output));
+
+  // Blocking 3 channels would mostly convolve padding, so the subgraph only
+  // starts after conv1.
+  EXPECT_EQ("Conv2D", FindNode(output, "conv1")->op());
+  EXPECT_EQ(1, CountOpNodes(output, "_BlockedConv2D"));
+  const NodeDef* relu = FindNode(output, "CpuLayoutOptimizer-Blocked/relu1");
+  ASSERT_NE(nullptr, relu);
+  EXPECT_EQ("_ToBlockedLayout", FindNode(output, relu->input(0))->op());
+
+  const auto inputs = RandomInputs(3);
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {inputs[0]});
+  auto tensors = EvaluateNodes(output, item.fetch, {inputs[0]});
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-5);
+}
+
+TEST_F(CpuLayoutOptimizerTest, DontBlockOnGpu) {
+  GrapplerItem item;
+  BuildConvolutions(32, /*constant_filter=*/true,
+                    "/job:localhost/replica:0/task:0/device:GPU:0", &item);
+
+  CpuLayoutOptimizer optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(cluster_.get(), item, &output));
+
+  CompareGraphs(item.graph, output);
+}
+
+TEST_F(CpuLayoutOptimizerTest, DontBlockUnplacedNodes) {
+  GrapplerItem item;
+  BuildConvolutions(32, /*constant_filter=*/true, "", &item);
+
+  CpuLayoutOptimizer optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(cluster_.get(), item, &output));
+
+  CompareGraphs(item.graph, output);
+}
+
+}  // namespace grappler
+}  // namespace tensorflow
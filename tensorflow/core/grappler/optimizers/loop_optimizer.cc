@@ -25,6 +25,7 @@ limitations under the License.
 #include "tensorflow/core/framework/attr_value.pb.h"
 #include "tensorflow/core/framework/node_def.pb.h"
 #include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/grappler/graph_view.h"
 #include "tensorflow/core/grappler/grappler_item.h"
@@ -53,6 +54,8 @@ class LoopInvariantNodeMotionOptimizer {
   Status Optimize();
 
  private:
+  bool IsLoopPivot(const NodeDef& node) const;
+  bool CanHoist(const NodeDef& node) const;
   Status FindInvariantNodes(NodeDef* node);
   Status RevertInvariantNodes();
   Status MoveInvariantNodes(const int frame_id);
@@ -70,6 +73,8 @@ class LoopInvariantNodeMotionOptimizer {
   std::map<int, int> frame_parent_;
   std::map<int, const NodeDef*> loop_cond_;
   std::map<int, std::vector<NodeDef*>> invariant_enters_;
+  std::map<int, std::vector<NodeDef*>> frame_consts_;
+  std::map<int, const NodeDef*> frame_enter_;
   int new_enter_id_;
 };
 
@@ -180,11 +185,11 @@ Status LoopInvariantNodeMotionOptimizer::HandleInvariantNode(
     NodeDef* node, const int num_outputs, const int frame_id) {
   // have to remove control inputs to the invariant node from the same frame
   // when moving this node out of this frame
-  for (int i = 0; i < node->input_size(); ++i) {
-    if (IsControlInput(node->input(i))) {
-      node->mutable_input()->SwapElements(i, node->input_size() - 1);
-      node->mutable_input()->RemoveLast();
-    }
+  while (node->input_size() > 0 &&
+         IsControlInput(node->input(node->input_size() - 1))) {
+    node_map_->RemoveOutput(NodeName(node->input(node->input_size() - 1)),
+                            node->name());
+    node->mutable_input()->RemoveLast();
   }
   if (num_outputs == 0) {
     return Status::OK();
@@ -199,9 +204,9 @@ Status LoopInvariantNodeMotionOptimizer::HandleInvariantNode(
                                        &output_types));
 
   auto consumers = node_map_->GetOutputs(node->name());
-  string fname = invariant_enters_[frame_id][0]->attr().at("frame_name").s();
-  int piterations =
-      invariant_enters_[frame_id][0]->attr().at("parallel_iterations").i();
+  const NodeDef* enter = frame_enter_[frame_id];
+  string fname = enter->attr().at("frame_name").s();
+  int piterations = enter->attr().at("parallel_iterations").i();
   for (auto* consumer : consumers) {
     if (!invariant_nodes_.count(consumer)) {
       for (int i = 0; i < consumer->input_size(); ++i) {
@@ -320,6 +325,44 @@ Status LoopInvariantNodeMotionOptimizer::RevertInvariantNodes() {
   return Status::OK();
 }
 
+// The pivot of a loop is the switch of a loop variable, or an identity of its
+// output: nodes only depend on it to run in each iteration of the loop.
+bool LoopInvariantNodeMotionOptimizer::IsLoopPivot(const NodeDef& node) const {
+  const NodeDef* switch_node = &node;
+  if (IsIdentity(node) && node.input_size() > 0) {
+    switch_node = node_map_->GetNode(node.input(0));
+  }
+  if (switch_node == nullptr || !IsSwitch(*switch_node) ||
+      switch_node->input_size() < 2) {
+    return false;
+  }
+  const NodeDef* pred = node_map_->GetNode(switch_node->input(1));
+  return pred != nullptr && pred->op() == "LoopCond";
+}
+
+// Returns true if the node computes the same value in every iteration once
+// all its data inputs are loop invariant. It must be free of side effects, and
+// only depend on invariant nodes or on the loop pivot, since a control
+// dependency on any other node in the loop orders it within an iteration.
+bool LoopInvariantNodeMotionOptimizer::CanHoist(const NodeDef& node) const {
+  if (ModifiesFrameInfo(node) || IsMerge(node) || IsSwitch(node) ||
+      node.op() == "LoopCond" || node.op() == "ControlTrigger" ||
+      !IsFreeOfSideEffect(node)) {
+    return false;
+  }
+  for (const auto& input : node.input()) {
+    if (!IsControlInput(input)) {
+      continue;
+    }
+    NodeDef* producer = node_map_->GetNode(input);
+    if (producer == nullptr ||
+        (!invariant_nodes_.count(producer) && !IsLoopPivot(*producer))) {
+      return false;
+    }
+  }
+  return true;
+}
+
 Status LoopInvariantNodeMotionOptimizer::FindInvariantNodes(
     NodeDef* start_node) {
   std::vector<NodeDef*> stack;
@@ -331,7 +374,7 @@ Status LoopInvariantNodeMotionOptimizer::FindInvariantNodes(
     auto consumers = node_map_->GetOutputs(node->name());
     invariant_nodes_.emplace(node, consumers.size());
     for (auto* consumer : consumers) {
-      if (invariant_nodes_.count(consumer) || ModifiesFrameInfo(*consumer)) {
+      if (invariant_nodes_.count(consumer) || !CanHoist(*consumer)) {
         continue;
       }
       bool is_invariant = true;
@@ -340,7 +383,7 @@ Status LoopInvariantNodeMotionOptimizer::FindInvariantNodes(
           const string name = NodeName(input);
           auto* producer = node_map_->GetNode(name);
           if (!invariant_nodes_.count(producer)) {
-            if (IsConstant(*producer)) {
+            if (IsConstant(*producer) && CanHoist(*producer)) {
               invariant_nodes_.insert(
                   std::make_pair(producer, node_map_->GetOutputs(name).size()));
             } else {
@@ -400,9 +443,15 @@ Status LoopInvariantNodeMotionOptimizer::Optimize() {
         }
         loop_cond_[frame_ids.back()] = node;
       }
-      if (IsEnter(*node) && node->attr().at("is_constant").b()) {
-        invariant_enters_[frame_ids.back()].push_back(
-            const_cast<NodeDef*>(node));
+      if (IsEnter(*node)) {
+        frame_enter_.insert(std::make_pair(frame_ids.back(), node));
+        if (node->attr().at("is_constant").b()) {
+          invariant_enters_[frame_ids.back()].push_back(
+              const_cast<NodeDef*>(node));
+        }
+      }
+      if (IsConstant(*node)) {
+        frame_consts_[frame_ids.back()].push_back(const_cast<NodeDef*>(node));
       }
     }
   }
@@ -426,22 +475,498 @@ Status LoopInvariantNodeMotionOptimizer::Optimize() {
       }
     }
 
-    if (invariant_enters_[frame_id].empty()) {
+    if (invariant_enters_[frame_id].empty() &&
+        frame_consts_[frame_id].empty()) {
       continue;
     }
     invariant_nodes_.clear();
     for (auto* enter : invariant_enters_[frame_id]) {
       TF_RETURN_IF_ERROR(FindInvariantNodes(enter));
     }
+    // Computations that only depend on constants are invariant too.
+    for (auto* const_node : frame_consts_[frame_id]) {
+      if (!invariant_nodes_.count(const_node) && CanHoist(*const_node)) {
+        TF_RETURN_IF_ERROR(FindInvariantNodes(const_node));
+      }
+    }
 
     // revert invariant nodes that have control outputs to variant nodes
     TF_RETURN_IF_ERROR(RevertInvariantNodes());
 
+    // Constants only move out of the loop along with some invariant consumer.
+    auto iter = invariant_nodes_.begin();
+    while (iter != invariant_nodes_.end()) {
+      const NodeDef* node = iter->first;
+      if (IsConstant(*node) &&
+          iter->second == node_map_->GetOutputs(node->name()).size()) {
+        iter = invariant_nodes_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+
     TF_RETURN_IF_ERROR(MoveInvariantNodes(frame_id));
   }
   return Status::OK();
 }
 
+// Loops are fully unrolled when they run at most this many iterations, and
+// their unrolled body has at most kMaxUnrolledNodes nodes.
+constexpr int kMaxUnrolledIterations = 16;
+constexpr int kMaxUnrolledNodes = 2048;
+
+// A while loop variable: its Merge node, and the Enter and NextIteration nodes
+// that feed it its initial and next values.
+struct LoopVariable {
+  const NodeDef* merge;
+  const NodeDef* enter;
+  const NodeDef* next_iteration;
+};
+
+// The nodes of the frame of a while loop, by role.
+struct WhileLoop {
+  const NodeDef* loop_cond = nullptr;
+  std::vector<LoopVariable> variables;
+  std::unordered_map<const NodeDef*, const NodeDef*> switch_to_merge;
+  std::vector<NodeDef*> exits;
+  std::unordered_set<const NodeDef*> nodes;
+};
+
+// Computes the integer and boolean scalars that control a while loop, one
+// iteration after the other, to find out statically how many iterations it
+// runs.
+class TripCountEvaluator {
+ public:
+  explicit TripCountEvaluator(const NodeMap& node_map) : node_map_(node_map) {}
+
+  // Returns the number of iterations of the loop, or -1 if its condition
+  // doesn't only depend on constants and on loop variables updated by simple
+  // arithmetic, or if the loop runs more than max_iterations.
+  int TripCount(const WhileLoop& loop, int max_iterations);
+
+ private:
+  bool Evaluate(const string& tensor, int64* value);
+
+  const NodeMap& node_map_;
+  // Values of the loop variables in the current iteration.
+  std::unordered_map<const NodeDef*, int64> variables_;
+  std::unordered_map<string, int64> values_;
+};
+
+int TripCountEvaluator::TripCount(const WhileLoop& loop, int max_iterations) {
+  variables_.clear();
+  for (const LoopVariable& var : loop.variables) {
+    int64 value;
+    if (Evaluate(var.enter->input(0), &value)) {
+      variables_[var.merge] = value;
+    }
+  }
+  for (int iteration = 0; iteration <= max_iterations; ++iteration) {
+    values_.clear();
+    int64 cond;
+    if (!Evaluate(loop.loop_cond->input(0), &cond)) {
+      return -1;
+    }
+    if (!cond) {
+      return iteration;
+    }
+    // Variables that can't be computed anymore are dropped, which makes the
+    // trip count unknown if the condition uses them.
+    std::unordered_map<const NodeDef*, int64> next_variables;
+    for (const LoopVariable& var : loop.variables) {
+      int64 value;
+      if (variables_.count(var.merge) &&
+          Evaluate(var.next_iteration->input(0), &value)) {
+        next_variables[var.merge] = value;
+      }
+    }
+    variables_.swap(next_variables);
+  }
+  return -1;
+}
+
+bool TripCountEvaluator::Evaluate(const string& tensor, int64* value) {
+  auto it = values_.find(tensor);
+  if (it != values_.end()) {
+    *value = it->second;
+    return true;
+  }
+  int port;
+  const string node_name = ParseNodeName(tensor, &port);
+  const NodeDef* node = node_map_.GetNode(node_name);
+  if (node == nullptr || port < 0) {
+    return false;
+  }
+
+  int64 result;
+  if (IsConstant(*node)) {
+    auto attr = node->attr().find("value");
+    Tensor constant;
+    if (attr == node->attr().end() ||
+        !constant.FromProto(attr->second.tensor()) ||
+        constant.NumElements() != 1) {
+      return false;
+    }
+    switch (constant.dtype()) {
+      case DT_INT32:
+        result = constant.flat<int32>()(0);
+        break;
+      case DT_INT64:
+        result = constant.flat<int64>()(0);
+        break;
+      case DT_BOOL:
+        result = constant.flat<bool>()(0);
+        break;
+      default:
+        return false;
+    }
+  } else if (IsMerge(*node)) {
+    auto var = variables_.find(node);
+    if (port != 0 || var == variables_.end()) {
+      return false;
+    }
+    result = var->second;
+  } else if (node->op() == "Enter" || node->op() == "Identity" ||
+             node->op() == "Switch") {
+    if (!Evaluate(node->input(0), &result)) {
+      return false;
+    }
+  } else if (node->op() == "LogicalNot") {
+    if (!Evaluate(node->input(0), &result)) {
+      return false;
+    }
+    result = !result;
+  } else {
+    int64 x;
+    int64 y;
+    if (node->input_size() < 2 || IsControlInput(node->input(1)) ||
+        !Evaluate(node->input(0), &x) || !Evaluate(node->input(1), &y)) {
+      return false;
+    }
+    const string& op = node->op();
+    if (op == "Add") {
+      result = x + y;
+    } else if (op == "Sub") {
+      result = x - y;
+    } else if (op == "Mul") {
+      result = x * y;
+    } else if (op == "Less") {
+      result = x < y;
+    } else if (op == "LessEqual") {
+      result = x <= y;
+    } else if (op == "Greater") {
+      result = x > y;
+    } else if (op == "GreaterEqual") {
+      result = x >= y;
+    } else if (op == "Equal") {
+      result = x == y;
+    } else if (op == "NotEqual") {
+      result = x != y;
+    } else if (op == "LogicalAnd") {
+      result = x && y;
+    } else if (op == "LogicalOr") {
+      result = x || y;
+    } else {
+      return false;
+    }
+  }
+  values_[tensor] = result;
+  *value = result;
+  return true;
+}
+
+// Replaces the innermost while loops that run a few iterations known
+// statically by copies of their body, one per iteration, to save the cost of
+// the frame management and of the control flow ops in the executor. Exits
+// become identities of the final values of the loop variables.
+class LoopUnroller {
+ public:
+  LoopUnroller(const std::unordered_set<string>& nodes_to_preserve,
+               GraphDef* optimized_graph)
+      : nodes_to_preserve_(nodes_to_preserve),
+        optimized_graph_(optimized_graph) {}
+  Status Optimize();
+
+ private:
+  bool AnalyzeLoop(const std::vector<NodeDef*>& frame, WhileLoop* loop) const;
+  bool FindBody(const WhileLoop& loop,
+                std::vector<const NodeDef*>* body) const;
+  string UnrolledInput(
+      const WhileLoop& loop, const string& input,
+      const std::unordered_map<string, string>& clones,
+      const std::unordered_map<const NodeDef*, string>& values) const;
+  void UnrollLoop(const WhileLoop& loop,
+                  const std::vector<const NodeDef*>& body, int trip_count);
+
+  const std::unordered_set<string>& nodes_to_preserve_;
+  GraphDef* optimized_graph_;  // Not owned.
+  std::unique_ptr<NodeMap> node_map_;
+  std::unordered_set<const NodeDef*> nodes_to_delete_;
+};
+
+// Returns true if the frame is a while loop that can be unrolled: all its
+// loop variables are Merges of an Enter and a NextIteration, switched by a
+// single LoopCond, and the rest of its nodes are free of side effects.
+bool LoopUnroller::AnalyzeLoop(const std::vector<NodeDef*>& frame,
+                               WhileLoop* loop) const {
+  loop->nodes.insert(frame.begin(), frame.end());
+  std::vector<const NodeDef*> merges;
+  std::vector<const NodeDef*> switches;
+  for (NodeDef* node : frame) {
+    if (IsExit(*node)) {
+      if (node->op() != "Exit") {
+        return false;
+      }
+      loop->exits.push_back(node);
+      continue;
+    }
+    if (nodes_to_preserve_.find(node->name()) != nodes_to_preserve_.end()) {
+      return false;
+    }
+    // Only the exits can be used outside of the loop.
+    for (const NodeDef* consumer : node_map_->GetOutputs(node->name())) {
+      if (!loop->nodes.count(consumer)) {
+        return false;
+      }
+    }
+    if (IsEnter(*node)) {
+      if (node->op() != "Enter" || node->input_size() != 1) {
+        return false;
+      }
+    } else if (node->op() == "LoopCond") {
+      if (loop->loop_cond != nullptr) {
+        return false;
+      }
+      loop->loop_cond = node;
+    } else if (IsMerge(*node)) {
+      merges.push_back(node);
+    } else if (IsSwitch(*node)) {
+      switches.push_back(node);
+    } else if (!IsNextIteration(*node) &&
+               (node->op() == "ControlTrigger" || !IsFreeOfSideEffect(*node))) {
+      return false;
+    }
+  }
+  if (loop->loop_cond == nullptr) {
+    return false;
+  }
+
+  for (const NodeDef* merge : merges) {
+    if (merge->input_size() != 2) {
+      return false;
+    }
+    const NodeDef* enter = node_map_->GetNode(merge->input(0));
+    const NodeDef* next_iteration = node_map_->GetNode(merge->input(1));
+    if (enter == nullptr || next_iteration == nullptr) {
+      return false;
+    }
+    if (IsNextIteration(*enter)) {
+      std::swap(enter, next_iteration);
+    }
+    if (!IsEnter(*enter) || !IsNextIteration(*next_iteration) ||
+        !loop->nodes.count(enter) || !loop->nodes.count(next_iteration)) {
+      return false;
+    }
+    loop->variables.push_back({merge, enter, next_iteration});
+  }
+  for (const NodeDef* switch_node : switches) {
+    if (switch_node->input_size() != 2 ||
+        NodeName(switch_node->input(1)) != loop->loop_cond->name()) {
+      return false;
+    }
+    const NodeDef* merge = node_map_->GetNode(switch_node->input(0));
+    if (merge == nullptr || !IsMerge(*merge) || !loop->nodes.count(merge)) {
+      return false;
+    }
+    loop->switch_to_merge[switch_node] = merge;
+  }
+  for (const NodeDef* exit : loop->exits) {
+    int port;
+    const NodeDef* switch_node =
+        node_map_->GetNode(ParseNodeName(exit->input(0), &port));
+    if (port != 0 || !loop->switch_to_merge.count(switch_node)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Finds the nodes that compute the next values of the loop variables in
+// topological order. Returns false if they use the loop condition, or the
+// outputs of the control flow ops that are only set at the end of the loop.
+bool LoopUnroller::FindBody(const WhileLoop& loop,
+                            std::vector<const NodeDef*>* body) const {
+  std::unordered_set<const NodeDef*> visited;
+  // Nodes to visit, and whether all their inputs have been visited.
+  std::vector<std::pair<const NodeDef*, bool>> stack;
+  for (const LoopVariable& var : loop.variables) {
+    stack.emplace_back(var.next_iteration, false);
+  }
+  while (!stack.empty()) {
+    const NodeDef* node = stack.back().first;
+    const bool inputs_visited = stack.back().second;
+    stack.pop_back();
+    if (inputs_visited) {
+      if (!IsNextIteration(*node)) {
+        body->push_back(node);
+      }
+      continue;
+    }
+    if (!visited.insert(node).second) {
+      continue;
+    }
+    if (node->op() == "LoopCond" || IsExit(*node)) {
+      return false;
+    }
+    stack.emplace_back(node, true);
+    for (const string& input : node->input()) {
+      int port;
+      const NodeDef* producer =
+          node_map_->GetNode(ParseNodeName(input, &port));
+      if (producer == nullptr) {
+        return false;
+      }
+      if (!loop.nodes.count(producer) || IsEnter(*producer)) {
+        continue;
+      }
+      if (IsMerge(*producer) || IsSwitch(*producer)) {
+        // The value index of merges, and the false output of switches that
+        // only gets a value after the last iteration, have no equivalent.
+        if ((IsMerge(*producer) && port > 0) ||
+            (IsSwitch(*producer) && port == 0)) {
+          return false;
+        }
+        continue;
+      }
+      stack.emplace_back(producer, false);
+    }
+  }
+  return true;
+}
+
+// Returns the input of the copy of a body node in some iteration, given the
+// copies of the body nodes in that iteration and the values of the loop
+// variables.
+string LoopUnroller::UnrolledInput(
+    const WhileLoop& loop, const string& input,
+    const std::unordered_map<string, string>& clones,
+    const std::unordered_map<const NodeDef*, string>& values) const {
+  int port;
+  const string node_name = ParseNodeName(input, &port);
+  const NodeDef* node = node_map_->GetNode(node_name);
+  string tensor;
+  auto clone = clones.find(node_name);
+  if (clone != clones.end()) {
+    tensor = port > 0 ? StrCat(clone->second, ":", port) : clone->second;
+  } else if (!loop.nodes.count(node)) {
+    tensor = port > 0 ? StrCat(node_name, ":", port) : node_name;
+  } else if (IsEnter(*node)) {
+    tensor = node->input(0);
+  } else if (IsMerge(*node)) {
+    tensor = values.at(node);
+  } else {
+    tensor = values.at(loop.switch_to_merge.at(node));
+  }
+  if (port < 0) {
+    return AsControlDependency(NodeName(tensor));
+  }
+  return tensor;
+}
+
+void LoopUnroller::UnrollLoop(const WhileLoop& loop,
+                              const std::vector<const NodeDef*>& body,
+                              int trip_count) {
+  std::unordered_map<const NodeDef*, string> values;
+  for (const LoopVariable& var : loop.variables) {
+    values[var.merge] = var.enter->input(0);
+  }
+  for (int iteration = 0; iteration < trip_count; ++iteration) {
+    std::unordered_map<string, string> clones;
+    for (const NodeDef* node : body) {
+      NodeDef* clone = optimized_graph_->add_node();
+      *clone = *node;
+      clone->set_name(AddPrefixToNodeName(
+          StrCat(node->name(), "/unrolled_", iteration), kLoopOptimizer));
+      for (int i = 0; i < node->input_size(); ++i) {
+        clone->set_input(i,
+                         UnrolledInput(loop, node->input(i), clones, values));
+      }
+      clones[node->name()] = clone->name();
+    }
+    std::unordered_map<const NodeDef*, string> next_values;
+    for (const LoopVariable& var : loop.variables) {
+      next_values[var.merge] =
+          UnrolledInput(loop, var.next_iteration->input(0), clones, values);
+    }
+    values.swap(next_values);
+  }
+
+  for (const NodeDef* node : loop.nodes) {
+    if (!IsExit(*node)) {
+      nodes_to_delete_.insert(node);
+    }
+  }
+  for (NodeDef* exit : loop.exits) {
+    const NodeDef* merge =
+        loop.switch_to_merge.at(node_map_->GetNode(exit->input(0)));
+    exit->set_op("Identity");
+    exit->set_input(0, values.at(merge));
+  }
+}
+
+Status LoopUnroller::Optimize() {
+  node_map_.reset(new NodeMap(optimized_graph_));
+  FrameMap frame_map;
+  int num_frames;
+  TF_RETURN_IF_ERROR(IdentifyFramesWithNodeMap(*optimized_graph_, *node_map_,
+                                               &frame_map, &num_frames));
+  std::vector<std::vector<NodeDef*>> frames(num_frames);
+  std::vector<bool> is_innermost(num_frames, true);
+  for (NodeDef& node : *optimized_graph_->mutable_node()) {
+    auto it = frame_map.find(&node);
+    if (it == frame_map.end() || it->second.empty()) {
+      continue;
+    }
+    const std::vector<int>& frame_ids = it->second;
+    frames[frame_ids.back()].push_back(&node);
+    for (int i = 0; i + 1 < frame_ids.size(); ++i) {
+      is_innermost[frame_ids[i]] = false;
+    }
+  }
+
+  TripCountEvaluator evaluator(*node_map_);
+  for (int frame_id = 0; frame_id < num_frames; ++frame_id) {
+    WhileLoop loop;
+    if (!is_innermost[frame_id] || !AnalyzeLoop(frames[frame_id], &loop)) {
+      continue;
+    }
+    const int trip_count =
+        evaluator.TripCount(loop, kMaxUnrolledIterations);
+    std::vector<const NodeDef*> body;
+    if (trip_count < 0 || !FindBody(loop, &body) ||
+        trip_count * body.size() > kMaxUnrolledNodes) {
+      continue;
+    }
+    VLOG(1) << "Unrolling " << trip_count << " iterations of the loop of "
+            << loop.loop_cond->name();
+    UnrollLoop(loop, body, trip_count);
+  }
+
+  if (nodes_to_delete_.empty()) {
+    return Status::OK();
+  }
+  int last = optimized_graph_->node_size() - 1;
+  for (int i = optimized_graph_->node_size() - 1; i >= 0; --i) {
+    if (nodes_to_delete_.count(&optimized_graph_->node(i))) {
+      optimized_graph_->mutable_node()->SwapElements(i, last);
+      last--;
+    }
+  }
+  optimized_graph_->mutable_node()->DeleteSubrange(last + 1,
+                                                   nodes_to_delete_.size());
+  return Status::OK();
+}
+
 std::vector<int> GetStackPushNodesToConvert(
     const SimpleGraphView& graph_view,
     const std::unordered_set<string>& nodes_to_preserve, int stack_node_idx) {
@@ -652,6 +1177,10 @@ Status LoopOptimizer::Optimize(Cluster* cluster, const GrapplerItem& item,
     LoopInvariantNodeMotionOptimizer linm_optimizer(optimized_graph);
     TF_RETURN_IF_ERROR(linm_optimizer.Optimize());
   }
+  if (options_.enable_loop_unrolling) {
+    LoopUnroller unroller(item.NodesToPreserve(), optimized_graph);
+    TF_RETURN_IF_ERROR(unroller.Optimize());
+  }
   if (options_.enable_stack_push_removal) {
     TF_RETURN_IF_ERROR(RemoveStackOps(item.NodesToPreserve(), optimized_graph));
   }
@@ -35,7 +35,7 @@ class LoopOptimizer : public GraphOptimizer {
         options_(LoopOptimizerOptions::Default(RewriterConfig::ON)) {}
   explicit LoopOptimizer(RewriterConfig::Toggle opt_level)
       : opt_level_(opt_level),
-        options_(LoopOptimizerOptions::Default(RewriterConfig::ON)) {}
+        options_(LoopOptimizerOptions::Default(opt_level)) {}
 
   ~LoopOptimizer() override {}
 
@@ -53,11 +53,18 @@ class LoopOptimizer : public GraphOptimizer {
   // Granular control for loop optimizer stages.
   struct LoopOptimizerOptions {
     bool enable_loop_invariant_node_motion = false;
+    // Fully unrolls the innermost loops that run a small number of iterations
+    // known at graph construction time.
+    bool enable_loop_unrolling = false;
     bool enable_stack_push_removal = true;
     bool enable_dead_branch_removal = true;
 
     static LoopOptimizerOptions Default(RewriterConfig::Toggle opt_level) {
       LoopOptimizerOptions options;
+      if (opt_level == RewriterConfig::AGGRESSIVE) {
+        options.enable_loop_invariant_node_motion = true;
+        options.enable_loop_unrolling = true;
+      }
       return options;
     }
   };
@@ -14,14 +14,22 @@ limitations under the License.
 ==============================================================================*/
 
 #include "tensorflow/core/grappler/optimizers/loop_optimizer.h"
+#include "tensorflow/cc/ops/control_flow_ops_internal.h"
 #include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/cc/ops/while_loop.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
 #include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/graph_constructor.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/inputs/trivial_test_graph_input_yielder.h"
 #include "tensorflow/core/grappler/utils.h"
 #include "tensorflow/core/grappler/utils/grappler_test.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 namespace grappler {
@@ -73,6 +81,11 @@ class LoopOptimizerTest : public GrapplerTest {
     DisableAllStages(optimizer);
     optimizer->options_.enable_stack_push_removal = true;
   }
+
+  void EnableOnlyLoopUnrolling(LoopOptimizer* optimizer) {
+    DisableAllStages(optimizer);
+    optimizer->options_.enable_loop_unrolling = true;
+  }
 };
 
 TEST_F(LoopOptimizerTest, Basic) {
@@ -476,6 +489,90 @@ TEST_F(LoopOptimizerTest, NestedLoopConst2) {
   EXPECT_EQ(frames.at(node_map->GetNode("Const2")).size(), 0);
 }
 
+TEST_F(LoopOptimizerTest, NodesWithSideEffectsOrOrderingStayInLoop) {
+  GraphDef graph;
+  AddSimpleNode("In", "Identity", {}, &graph);
+  AddEnterNode("InvariantEnter", "while/while_context", true, 1, {"In"},
+               &graph);
+  AddSimpleNode("Random", "RandomUniform", {"InvariantEnter"}, &graph);
+  AddSimpleNode("InvariantAdd", "Add", {"InvariantEnter", "InvariantEnter"},
+                &graph);
+  AddSimpleNode("VariantAdd", "Add", {"InvariantAdd", "Identity"}, &graph);
+  AddSimpleNode("OrderedMul", "Mul",
+                {"InvariantEnter", "InvariantEnter", "^VariantAdd"}, &graph);
+  AddSimpleNode("Sum", "AddN", {"VariantAdd", "Random", "OrderedMul"},
+                &graph);
+  AddEnterNode("VariantEnter", "while/while_context", false, 1, {"In"}, &graph);
+  AddSimpleNode("Merge", "Merge", {"VariantEnter", "NextIteration"}, &graph);
+  AddSimpleNode("Less/y", "Const", {"^Identity"}, &graph);
+  AddSimpleNode("Less", "Less", {"Sum", "Less/y"}, &graph);
+  AddSimpleNode("LoopCond", "LoopCond", {"Less"}, &graph);
+  AddSimpleNode("Switch", "Switch", {"Merge", "LoopCond"}, &graph);
+  AddSimpleNode("Identity", "Identity", {"Switch:1"}, &graph);
+  AddSimpleNode("NextIteration", "NextIteration", {"Sum"}, &graph);
+  AddSimpleNode("Exit", "Exit", {"Switch"}, &graph);
+  AddSimpleNode("Out", "Identity", {"Exit"}, &graph);
+
+  GrapplerItem item;
+  item.graph = graph;
+
+  LoopOptimizer optimizer;
+  EnableOnlyLoopInvariantNodeMotion(&optimizer);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  NodeMap node_map(&output);
+  std::unordered_map<const NodeDef*, std::vector<int>> frames;
+  int num_frames;
+  TF_EXPECT_OK(IdentifyFrames(output, &frames, &num_frames));
+  EXPECT_EQ(num_frames, 1);
+  EXPECT_EQ(frames.at(node_map.GetNode("InvariantAdd")).size(), 0);
+  // Random numbers must be drawn in every iteration.
+  EXPECT_EQ(frames.at(node_map.GetNode("Random")).size(), 1);
+  // The control dependency orders OrderedMul within each iteration.
+  EXPECT_EQ(frames.at(node_map.GetNode("OrderedMul")).size(), 1);
+}
+
+TEST_F(LoopOptimizerTest, ConstantComputation) {
+  GraphDef graph;
+  AddSimpleNode("In", "Identity", {}, &graph);
+  AddSimpleNode("Const1", "Const", {"^Identity"}, &graph);
+  AddSimpleNode("Const2", "Const", {"^Identity"}, &graph);
+  AddSimpleNode("ConstAdd", "Add", {"Const1", "Const2"}, &graph);
+  AddSimpleNode("VariantAdd", "Add", {"ConstAdd", "Identity"}, &graph);
+  AddEnterNode("VariantEnter", "while/while_context", false, 1, {"In"}, &graph);
+  AddSimpleNode("Merge", "Merge", {"VariantEnter", "NextIteration"}, &graph);
+  AddSimpleNode("Less/y", "Const", {"^Identity"}, &graph);
+  AddSimpleNode("Less", "Less", {"VariantAdd", "Less/y"}, &graph);
+  AddSimpleNode("LoopCond", "LoopCond", {"Less"}, &graph);
+  AddSimpleNode("Switch", "Switch", {"Merge", "LoopCond"}, &graph);
+  AddSimpleNode("Identity", "Identity", {"Switch:1"}, &graph);
+  AddSimpleNode("NextIteration", "NextIteration", {"VariantAdd"}, &graph);
+  AddSimpleNode("Exit", "Exit", {"Switch"}, &graph);
+  AddSimpleNode("Out", "Identity", {"Exit"}, &graph);
+
+  GrapplerItem item;
+  item.graph = graph;
+
+  LoopOptimizer optimizer;
+  EnableOnlyLoopInvariantNodeMotion(&optimizer);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  NodeMap node_map(&output);
+  std::unordered_map<const NodeDef*, std::vector<int>> frames;
+  int num_frames;
+  TF_EXPECT_OK(IdentifyFrames(output, &frames, &num_frames));
+  EXPECT_EQ(num_frames, 1);
+  // The loop has no invariant Enter, but ConstAdd only depends on constants.
+  EXPECT_EQ(frames.at(node_map.GetNode("ConstAdd")).size(), 0);
+  EXPECT_EQ(frames.at(node_map.GetNode("Const1")).size(), 0);
+  EXPECT_EQ(frames.at(node_map.GetNode("VariantAdd")).size(), 1);
+  // Less/y has no invariant consumer and stays in the loop, as is.
+  EXPECT_EQ(frames.at(node_map.GetNode("Less/y")).size(), 1);
+  EXPECT_EQ(graph.node_size() + 1, output.node_size());
+}
+
 void VerifyGraphsEqual(const GraphDef& original_graph,
                        const GraphDef& optimized_graph, const string& func) {
   EXPECT_EQ(original_graph.node_size(), optimized_graph.node_size()) << func;
@@ -696,5 +793,144 @@ TEST_F(LoopOptimizerTest, RemoveDeadBranches) {
   }
 }
 
+// Builds a decoder running `steps` iterations of an LSTM cell, and returns its
+// final output. As in graphs built from Python, the weights are transposed in
+// the loop, and the forget bias is filled from constants in every iteration.
+Output LstmDecoder(const Scope& s, int steps, int batch, int units) {
+  Output x = ops::Const(s.WithOpName("x"), 0.5f, {batch, units});
+  Output w = ops::Const(s.WithOpName("w"), 0.01f, {4 * units, 2 * units});
+  Output b = ops::Const(s.WithOpName("b"), 0.1f, {4 * units});
+  Output h = ops::Const(s.WithOpName("h"), 0.0f, {batch, units});
+  Output c = ops::Const(s.WithOpName("c"), 0.0f, {batch, units});
+  Output i = ops::Const(s.WithOpName("i"), 0);
+
+  auto cond = [steps](const Scope& cond_scope,
+                      const std::vector<Output>& inputs, Output* output) {
+    *output = ops::Less(cond_scope, inputs[0], steps);
+    return cond_scope.status();
+  };
+  auto body = [&](const Scope& body_scope, const std::vector<Output>& inputs,
+                  std::vector<Output>* outputs) {
+    auto enter = [&s](const Output& input) -> Output {
+      return ops::internal::Enter(s, input, "decoder",
+                                  ops::internal::Enter::IsConstant(true));
+    };
+    Output wt = ops::Transpose(body_scope, enter(w), {1, 0});
+    Output xh = ops::Concat(body_scope, {enter(x), inputs[1]}, 1);
+    Output gates =
+        ops::BiasAdd(body_scope, ops::MatMul(body_scope, xh, wt), enter(b));
+    ops::Split split(body_scope, 1, gates, 4);
+    Output forget_bias = ops::Fill(body_scope, {batch, units}, 1.0f);
+    Output in_gate = ops::Sigmoid(body_scope, split[0]);
+    Output forget_gate =
+        ops::Sigmoid(body_scope, ops::Add(body_scope, split[1], forget_bias));
+    Output out_gate = ops::Sigmoid(body_scope, split[2]);
+    Output next_c = ops::Add(
+        body_scope, ops::Mul(body_scope, forget_gate, inputs[2]),
+        ops::Mul(body_scope, in_gate, ops::Tanh(body_scope, split[3])));
+    Output next_h =
+        ops::Mul(body_scope, out_gate, ops::Tanh(body_scope, next_c));
+    *outputs = {ops::Add(body_scope, inputs[0], 1), next_h, next_c};
+    return body_scope.status();
+  };
+  OutputList outputs;
+  TF_CHECK_OK(
+      ops::BuildWhileLoop(s, {i, h, c}, cond, body, "decoder", &outputs));
+  return ops::Identity(s.WithOpName("out"), outputs[1]);
+}
+
+TEST_F(LoopOptimizerTest, UnrollLstmDecoder) {
+  Scope s = Scope::NewRootScope();
+  LstmDecoder(s, 4, 2, 8);
+  GrapplerItem item;
+  item.fetch = {"out"};
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+
+  LoopOptimizer optimizer(RewriterConfig::AGGRESSIVE);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  std::map<string, int> op_counts;
+  for (const NodeDef& node : output.node()) {
+    ++op_counts[node.op()];
+  }
+  // The loop is gone, and its exits became identities.
+  for (const string& op :
+       {"Enter", "Merge", "Switch", "LoopCond", "NextIteration", "Exit"}) {
+    EXPECT_EQ(0, op_counts[op]) << op;
+  }
+  // The transpose and the fill were hoisted out of the loop, the rest of the
+  // body was copied in each iteration.
+  EXPECT_EQ(1, op_counts["Transpose"]);
+  EXPECT_EQ(1, op_counts["Fill"]);
+  EXPECT_EQ(4, op_counts["MatMul"]);
+  EXPECT_EQ(4, op_counts["Split"]);
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch);
+  auto tensors = EvaluateNodes(output, item.fetch);
+  ASSERT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-6);
+}
+
+TEST_F(LoopOptimizerTest, NoUnrollingOfDynamicOrLongLoops) {
+  for (int steps : {-1, 17}) {
+    Scope s = Scope::NewRootScope();
+    Output limit =
+        steps < 0 ? Output(ops::Placeholder(s.WithOpName("limit"), DT_INT32))
+                  : ops::Const(s.WithOpName("limit"), steps);
+    auto cond = [&s, &limit](const Scope& cond_scope,
+                             const std::vector<Output>& inputs,
+                             Output* output) {
+      Output enter = ops::internal::Enter(
+          s, limit, "loop", ops::internal::Enter::IsConstant(true));
+      *output = ops::Less(cond_scope, inputs[0], enter);
+      return cond_scope.status();
+    };
+    auto body = [](const Scope& body_scope, const std::vector<Output>& inputs,
+                   std::vector<Output>* outputs) {
+      *outputs = {ops::Add(body_scope, inputs[0], 1)};
+      return body_scope.status();
+    };
+    OutputList outputs;
+    TF_CHECK_OK(ops::BuildWhileLoop(s, {ops::Const(s.WithOpName("i"), 0)},
+                                    cond, body, "loop", &outputs));
+    GrapplerItem item;
+    item.fetch = {outputs[0].node()->name()};
+    TF_CHECK_OK(s.ToGraphDef(&item.graph));
+
+    LoopOptimizer optimizer;
+    EnableOnlyLoopUnrolling(&optimizer);
+    GraphDef output;
+    TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+    VerifyGraphsEqual(item.graph, output, __FUNCTION__);
+  }
+}
+
+// Runs the LSTM decoder after the default loop optimizations, or after
+// loop-invariant node motion and unrolling of short loops, e.g.
+//   bazel run -c opt :loop_optimizer_test -- --benchmarks=LstmDecoder
+static void BM_LstmDecoder(int iters, int steps, int aggressive) {
+  testing::StopTiming();
+  Scope s = Scope::NewRootScope();
+  LstmDecoder(s, steps, 16, 256);
+  GrapplerItem item;
+  item.fetch = {"out"};
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  LoopOptimizer optimizer(aggressive ? RewriterConfig::AGGRESSIVE
+                                     : RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+  testing::SetLabel(strings::StrCat("nodes=", output.node_size()));
+
+  Graph* g = new Graph(OpRegistry::Global());
+  TF_CHECK_OK(ConvertGraphDefToGraph(GraphConstructorOptions(), output, g));
+  test::Benchmark("cpu", g).Run(iters);
+}
+BENCHMARK(BM_LstmDecoder)
+    ->ArgPair(8, 0)
+    ->ArgPair(8, 1)
+    ->ArgPair(64, 0)
+    ->ArgPair(64, 1);
+
 }  // namespace grappler
 }  // namespace tensorflow
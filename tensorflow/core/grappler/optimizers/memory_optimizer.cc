@@ -28,6 +28,9 @@ limitations under the License.
 #include "tensorflow/core/grappler/clusters/virtual_cluster.h"
 #include "tensorflow/core/grappler/costs/graph_memory.h"
 #include "tensorflow/core/grappler/costs/graph_properties.h"
+#include "tensorflow/core/grappler/costs/op_context.h"
+#include "tensorflow/core/grappler/costs/op_level_cost_estimator.h"
+#include "tensorflow/core/grappler/costs/utils.h"
 #include "tensorflow/core/grappler/graph_view.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/op_types.h"
@@ -37,6 +40,8 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils/topological_sort.h"
 #include "tensorflow/core/grappler/utils/traversal.h"
 #include "tensorflow/core/lib/math/math_util.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/protobuf/rewriter_config.pb.h"
 
 namespace tensorflow {
@@ -413,6 +418,17 @@ void RecomputeSubgraph(
   }
 }
 
+// Nodes whose inputs we may want to recompute. This matches node names that
+// contain recomputation_targets_name_scope as a name scope, meaning it either
+// begins with or contains the name scope. Defaults to "gradients/" which will
+// match any node names that begins with "gradients/" or contains
+// "/gradients/".
+bool IsRecomputationTarget(const NodeDef& node,
+                           const string& recomputation_targets_name_scope) {
+  return node.name().find(recomputation_targets_name_scope) == 0 ||
+         node.name().find("/" + recomputation_targets_name_scope) != -1;
+}
+
 void RecomputationRewritingPass(RewriterConfig::MemOptType optimization_level,
                                 const string& recomputation_targets_name_scope,
                                 GraphDef* graph, const GrapplerItem& item) {
@@ -440,13 +456,7 @@ void RecomputationRewritingPass(RewriterConfig::MemOptType optimization_level,
   }
   std::function<bool(const NodeDef&)> is_target =
       [&recomputation_targets_name_scope](const NodeDef& node) {
-        // Nodes whose inputs we may want to recompute. This matches node names
-        // that contain recomputation_targets_name_scope as a name scope,
-        // meaning it either begins with or contains the name scope.
-        // Defaults to "gradients/" which will match any node names that begins
-        // with "gradients/" or contains "/gradients/".
-        return node.name().find(recomputation_targets_name_scope) == 0 ||
-               node.name().find("/" + recomputation_targets_name_scope) != -1;
+        return IsRecomputationTarget(node, recomputation_targets_name_scope);
       };
 
   if (optimization_level == RewriterConfig::RECOMPUTATION_HEURISTICS ||
@@ -489,6 +499,281 @@ void RecomputationRewritingPass(RewriterConfig::MemOptType optimization_level,
   }
 }
 
+// Activations smaller than this aren't worth recomputing.
+constexpr int64 kMinRecomputedActivationBytes = 1024;
+// Maximum number of nodes executed again to recompute a single activation.
+constexpr int kMaxRecomputedNodesPerActivation = 8;
+// Bound on the number of automatic recomputation passes, each of which
+// simulates the execution of the graph.
+constexpr int kMaxAutomaticRecomputationPasses = 5;
+
+// An activation that may be recomputed during backprop instead of staying in
+// memory since the forward pass.
+struct RecomputationCandidate {
+  const NodeDef* activation;
+  // The nodes to execute again to recompute the activation, itself included.
+  std::unordered_set<const NodeDef*> recomputed_nodes;
+  // The nodes, outside of recomputed_nodes, whose outputs the recomputation
+  // reads.
+  std::unordered_set<const NodeDef*> inputs;
+  int64 bytes_saved;
+  Costs::Duration cost;
+};
+
+// Picks activations that are live at the peak memory usage of the devices
+// whose peak exceeds `memory_budget` (or their memory size if the budget is
+// 0), and recomputes them during backprop. The activations that free the most
+// memory per unit of recomputation time, as estimated by the op level cost
+// model, are picked first, until the peak is expected to fit. Returns true if
+// the graph was modified.
+bool AutomaticRecomputationPass(const string& recomputation_targets_name_scope,
+                                int64 memory_budget, Cluster* cluster,
+                                GrapplerItem* item) {
+  // This invalidates all NodeDef pointers, so it needs to be done before we
+  // start collecting those.
+  if (!TopologicalSort(&item->graph).ok()) {
+    return false;
+  }
+  const std::unordered_map<string, DeviceProperties>& devices =
+      cluster->GetDevices();
+  GraphMemory memory(*item);
+  Status s = memory.InferStatically(devices);
+  if (!s.ok()) {
+    VLOG(1) << "Failed to infer memory usage: " << s.error_message();
+    return false;
+  }
+  GraphProperties properties(*item);
+  s = properties.InferStatically(false);
+  if (!s.ok()) {
+    VLOG(1) << "Failed to infer shapes: " << s.error_message();
+    return false;
+  }
+
+  GraphDef* graph = &item->graph;
+  NodeMap node_map(graph);
+  std::unordered_map<string, const NodeDef*> name_to_node;
+  for (const NodeDef& node : graph->node()) {
+    name_to_node[node.name()] = &node;
+  }
+  // Fed and fetched tensors stay in memory anyway, and recomputing them would
+  // not produce the fed value.
+  std::unordered_set<string> feeds_and_fetches;
+  for (const auto& feed : item->feed) {
+    feeds_and_fetches.insert(NodeName(feed.first));
+  }
+  for (const string& fetch : item->fetch) {
+    feeds_and_fetches.insert(NodeName(fetch));
+  }
+  auto is_target = [&recomputation_targets_name_scope](const NodeDef& node) {
+    return IsRecomputationTarget(node, recomputation_targets_name_scope);
+  };
+  const string recomputed_prefix = strings::StrCat(kRecomputedNodePrefix, "/");
+  auto is_recomputed_copy = [&recomputed_prefix](const NodeDef& node) {
+    return str_util::StartsWith(node.name(), recomputed_prefix);
+  };
+  // Whether the outputs of `node` stay in memory until backprop regardless of
+  // recomputation, so that recomputed nodes can read them for free.
+  auto is_kept_for_backprop = [&](const NodeDef& node) {
+    if (IsPersistent(node) || feeds_and_fetches.count(node.name()) > 0) {
+      return true;
+    }
+    for (const NodeDef* output : node_map.GetOutputs(node.name())) {
+      if (is_target(*output) || is_recomputed_copy(*output)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  auto is_recomputable = [&](const NodeDef& node) {
+    return !is_target(node) && !is_recomputed_copy(node) &&
+           feeds_and_fetches.count(node.name()) == 0 && !IsPersistent(node) &&
+           IsFreeOfSideEffect(node) && !IsEnter(node) && !IsExit(node) &&
+           !IsSwitch(node) && !IsMerge(node) && !IsNextIteration(node) &&
+           // Skip the nodes already recomputed by a previous pass.
+           node_map.GetNode(AddPrefixToNodeName(
+               node.name(), kRecomputedNodePrefix)) == nullptr;
+  };
+  // Collects the nodes to recompute to regenerate `candidate->activation`,
+  // walking up its inputs until reaching tensors kept for backprop anyway.
+  auto expand_candidate = [&](RecomputationCandidate* candidate) {
+    std::queue<const NodeDef*> to_visit;
+    to_visit.push(candidate->activation);
+    candidate->recomputed_nodes.insert(candidate->activation);
+    while (!to_visit.empty()) {
+      const NodeDef* node = to_visit.front();
+      to_visit.pop();
+      for (const string& input_name : node->input()) {
+        if (IsControlInput(input_name)) {
+          continue;
+        }
+        const NodeDef* input = node_map.GetNode(input_name);
+        if (input == nullptr || is_target(*input)) {
+          return false;
+        }
+        if (candidate->recomputed_nodes.count(input) > 0) {
+          continue;
+        }
+        if (is_kept_for_backprop(*input)) {
+          candidate->inputs.insert(input);
+          continue;
+        }
+        if (!is_recomputable(*input) ||
+            candidate->recomputed_nodes.size() >=
+                kMaxRecomputedNodesPerActivation) {
+          return false;
+        }
+        candidate->recomputed_nodes.insert(input);
+        to_visit.push(input);
+      }
+    }
+    return true;
+  };
+
+  OpLevelCostEstimator cost_estimator;
+  std::vector<RecomputedSubGraph> recomputed_subgraphs;
+  std::unordered_set<const NodeDef*> recomputed_nodes;
+  // Inputs of the recomputed nodes, which must not be recomputed themselves
+  // since they stay in memory for the recomputation.
+  std::unordered_set<const NodeDef*> recomputation_inputs;
+  for (const auto& device : devices) {
+    const int64 budget =
+        memory_budget > 0 ? memory_budget : device.second.memory_size();
+    const GraphMemory::MemoryUsage& mem_usage =
+        memory.GetPeakMemoryUsage(device.first);
+    if (budget <= 0 || mem_usage.used_memory <= budget) {
+      continue;
+    }
+    int64 required_savings = mem_usage.used_memory - budget;
+    VLOG(1) << "Peak memory usage of " << device.first << " is "
+            << mem_usage.used_memory << " bytes, " << required_savings
+            << " over the budget";
+
+    std::unordered_map<const NodeDef*, int64> bytes_at_peak;
+    for (const auto& live_tensor : mem_usage.live_tensors) {
+      const NodeDef* node = node_map.GetNode(live_tensor.node);
+      if (node != nullptr) {
+        bytes_at_peak[node] += live_tensor.memory_used;
+      }
+    }
+    std::vector<RecomputationCandidate> candidates;
+    for (const auto& activation : bytes_at_peak) {
+      const NodeDef* node = activation.first;
+      if (activation.second < kMinRecomputedActivationBytes ||
+          !is_recomputable(*node)) {
+        continue;
+      }
+      // Only activations read during backprop are worth recomputing.
+      bool has_target_output = false;
+      for (const NodeDef* output : node_map.GetOutputs(node->name())) {
+        if (is_target(*output)) {
+          has_target_output = true;
+          break;
+        }
+      }
+      if (!has_target_output) {
+        continue;
+      }
+      RecomputationCandidate candidate;
+      candidate.activation = node;
+      if (!expand_candidate(&candidate)) {
+        continue;
+      }
+      candidate.bytes_saved = activation.second;
+      candidate.cost = 0;
+      for (const NodeDef* recomputed : candidate.recomputed_nodes) {
+        OpContext op_context;
+        op_context.name = recomputed->name();
+        op_context.device_name = device.first;
+        op_context.op_info = BuildOpInfoWithoutDevice(
+            *recomputed, name_to_node,
+            properties.GetInputProperties(recomputed->name()));
+        for (const auto& output :
+             properties.GetOutputProperties(recomputed->name())) {
+          *op_context.op_info.add_outputs() = output;
+        }
+        *op_context.op_info.mutable_device() = device.second;
+        op_context.function_library = &graph->library();
+        candidate.cost +=
+            cost_estimator.PredictCosts(op_context).execution_time;
+      }
+      candidates.push_back(std::move(candidate));
+    }
+
+    // Favor the activations that free the most memory per nanosecond of
+    // recomputation.
+    auto fitness = [](const RecomputationCandidate& candidate) {
+      return candidate.bytes_saved /
+             std::max<double>(1.0, candidate.cost.count());
+    };
+    std::sort(candidates.begin(), candidates.end(),
+              [&fitness](const RecomputationCandidate& first,
+                         const RecomputationCandidate& second) {
+                const double first_fitness = fitness(first);
+                const double second_fitness = fitness(second);
+                return first_fitness > second_fitness ||
+                       (first_fitness == second_fitness &&
+                        first.activation->name() < second.activation->name());
+              });
+    for (const RecomputationCandidate& candidate : candidates) {
+      if (required_savings <= 0) {
+        break;
+      }
+      // Recomputing an activation keeps its inputs in memory: don't recompute
+      // the inputs of other recomputations, nor nodes recomputed already.
+      bool conflicts = false;
+      for (const NodeDef* node : candidate.recomputed_nodes) {
+        if (recomputed_nodes.count(node) > 0 ||
+            recomputation_inputs.count(node) > 0) {
+          conflicts = true;
+          break;
+        }
+      }
+      for (const NodeDef* input : candidate.inputs) {
+        if (recomputed_nodes.count(input) > 0) {
+          conflicts = true;
+          break;
+        }
+      }
+      if (conflicts) {
+        continue;
+      }
+      RecomputedSubGraph subgraph;
+      subgraph.recomputed_source_nodes = candidate.recomputed_nodes;
+      for (NodeDef* output :
+           node_map.GetOutputs(candidate.activation->name())) {
+        if (is_target(*output)) {
+          subgraph.target_nodes.insert(output);
+        }
+      }
+      VLOG(1) << "Will recompute " << candidate.activation->name() << " ("
+              << candidate.recomputed_nodes.size() << " nodes) to save "
+              << candidate.bytes_saved << " bytes for an estimated "
+              << candidate.cost.count() << "ns";
+      recomputed_subgraphs.push_back(std::move(subgraph));
+      recomputed_nodes.insert(candidate.recomputed_nodes.begin(),
+                              candidate.recomputed_nodes.end());
+      recomputation_inputs.insert(candidate.inputs.begin(),
+                                  candidate.inputs.end());
+      required_savings -= candidate.bytes_saved;
+    }
+  }
+  if (recomputed_subgraphs.empty()) {
+    return false;
+  }
+
+  std::unordered_map<const NodeDef*, int> topological_numbering;
+  for (int node_number = 0; node_number < graph->node().size();
+       ++node_number) {
+    topological_numbering[graph->mutable_node(node_number)] =
+        graph->node().size() - node_number - 1;
+  }
+  for (const RecomputedSubGraph& subgraph : recomputed_subgraphs) {
+    RecomputeSubgraph(subgraph.recomputed_source_nodes, subgraph.target_nodes,
+                      node_map, topological_numbering, graph);
+  }
+  return true;
+}
+
 bool SchedulingPass(Cluster* cluster, GrapplerItem* item) {
   // Look for AddN nodes (and equivalent) and record input names.
   GraphView view(&item->graph);
@@ -1305,6 +1590,17 @@ Status MemoryOptimizer::Optimize(Cluster* cluster, const GrapplerItem& item,
                              item);
 
   GrapplerItem optimized_item(item, optimized_graph);
+  if (optimization_level_ == RewriterConfig::AUTOMATIC_RECOMPUTATION &&
+      cluster != nullptr) {
+    // Each pass relieves the current peak, which may move the peak elsewhere.
+    for (int i = 0; i < kMaxAutomaticRecomputationPasses &&
+                    AutomaticRecomputationPass(
+                        recomputation_targets_name_scope_,
+                        memory_budget_bytes_, cluster, &optimized_item);
+         ++i) {
+    }
+  }
+
   std::unordered_set<string> skip_list;
   // Bound the number of rewrite passes to avoid long processing times on graphs
   // that simply won't fit in memory.
@@ -0,0 +1,282 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/memory_optimizer.h"
+
+#include <vector>
+
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/grappler/clusters/virtual_cluster.h"
+#include "tensorflow/core/grappler/costs/graph_memory.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/grappler/utils/grappler_test.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+class RecomputeSubgraphTest : public GrapplerTest {};
+
+TEST_F(RecomputeSubgraphTest, SimpleSubgraph) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  Output a = ops::Variable(s.WithOpName("a"), {2, 3, 4}, DT_FLOAT);
+  Output b = ops::Identity(s.WithOpName("b"), a);  // Recomputed
+  Output c = ops::Identity(s.WithOpName("c"), b);
+  Output d = ops::AddN(s.WithOpName("gradients/d"), {c});
+  Output e = ops::AddN(s.WithOpName("gradients/e"), {d, b});
+  Output f = ops::AddN(s.WithOpName("gradients/f"), {e, a});
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  EXPECT_EQ(6, item.graph.node_size());
+  NodeMap pre_transform_node_map(&item.graph);
+  (*pre_transform_node_map.GetNode("b")->mutable_attr())["_recompute_hint"]
+      .set_i(0);
+
+  MemoryOptimizer optimizer(RewriterConfig::MANUAL);
+  GraphDef output;
+  Status status = optimizer.Optimize(nullptr, item, &output);
+
+  TF_EXPECT_OK(status);
+  NodeMap post_transform_node_map(&output);
+  EXPECT_EQ(8, output.node_size());
+  NodeDef* transformed_e = post_transform_node_map.GetNode(e.name());
+  EXPECT_EQ(2, transformed_e->input_size());
+  EXPECT_EQ("gradients/d", transformed_e->input(0));
+  EXPECT_EQ("Recomputed/b", transformed_e->input(1));
+  NodeDef* recomputed_b = post_transform_node_map.GetNode("Recomputed/b");
+  EXPECT_EQ(2, recomputed_b->input_size());
+  EXPECT_EQ("a", recomputed_b->input(0));
+  EXPECT_EQ("^RecomputeTrigger/b", recomputed_b->input(1));
+  NodeDef* recompute_trigger =
+      post_transform_node_map.GetNode("RecomputeTrigger/b");
+  EXPECT_EQ(1, recompute_trigger->input_size());
+  EXPECT_EQ("^gradients/d", recompute_trigger->input(0));
+}
+
+TEST_F(RecomputeSubgraphTest, NoFeedsRecomputed) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  Output a = ops::Variable(s.WithOpName("a"), {2, 3, 4}, DT_FLOAT);
+  Output b = ops::Identity(s.WithOpName("b"), a);  // Would be recomputed, but
+                                                   // for being fed
+  Output c = ops::Identity(s.WithOpName("c"), b);
+  Output d = ops::AddN(s.WithOpName("gradients/d"), {c});
+  Output e = ops::AddN(s.WithOpName("gradients/e"), {d, b});
+  Output f = ops::AddN(s.WithOpName("gradients/f"), {e, a});
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.feed.emplace_back("b", Tensor());
+  EXPECT_EQ(6, item.graph.node_size());
+  NodeMap pre_transform_node_map(&item.graph);
+  (*pre_transform_node_map.GetNode("b")->mutable_attr())["_recompute_hint"]
+      .set_i(0);
+
+  MemoryOptimizer optimizer(RewriterConfig::MANUAL);
+  GraphDef output;
+  Status status = optimizer.Optimize(nullptr, item, &output);
+
+  TF_EXPECT_OK(status);
+  EXPECT_EQ(6, output.node_size());
+}
+
+TEST_F(RecomputeSubgraphTest, TwoInputSubgraphs) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  Output a = ops::Variable(s.WithOpName("a"), {2, 3, 4}, DT_FLOAT);
+  Output b = ops::Variable(s.WithOpName("b"), {2, 3, 4}, DT_FLOAT);
+  Output d = ops::AddN(
+      s.WithOpName("some_name_scope/gradients/two_subgraph_inputs"), {a, b});
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  EXPECT_EQ(3, item.graph.node_size());
+  NodeMap pre_transform_node_map(&item.graph);
+  (*pre_transform_node_map.GetNode("a")->mutable_attr())["_recompute_hint"]
+      .set_i(0);
+  (*pre_transform_node_map.GetNode("b")->mutable_attr())["_recompute_hint"]
+      .set_i(0);
+
+  MemoryOptimizer optimizer(RewriterConfig::MANUAL,
+                            "some_name_scope/gradients");
+  GraphDef output;
+  Status status = optimizer.Optimize(nullptr, item, &output);
+
+  TF_EXPECT_OK(status);
+  NodeMap post_transform_node_map(&output);
+  // Mostly checking that this case does not crash.
+  EXPECT_EQ(7, output.node_size());
+  EXPECT_NE(post_transform_node_map.GetNode("Recomputed/a"), nullptr);
+  EXPECT_NE(post_transform_node_map.GetNode("Recomputed/b"), nullptr);
+  EXPECT_NE(post_transform_node_map.GetNode("RecomputeTrigger/a"), nullptr);
+  EXPECT_NE(post_transform_node_map.GetNode("RecomputeTrigger/b"), nullptr);
+}
+
+TEST_F(RecomputeSubgraphTest, MultiNode) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  Output a = ops::Variable(s.WithOpName("Conv"), {2, 3, 4}, DT_FLOAT);
+  Output b = ops::Identity(s.WithOpName("BN"), a);    // Recomputed
+  Output c = ops::Identity(s.WithOpName("ReLU"), b);  // Recomputed
+  Output d = ops::Identity(s.WithOpName("Conv1"), c);
+
+  // The "gradients/" prefix means the heuristic will pick these up as
+  // candidates to have their inputs recomputed.
+  Output trigger = ops::AddN(s.WithOpName("gradients/BN1Grad"), {d});
+  Output e = ops::AddN(s.WithOpName("gradients/Conv1Grad"), {trigger, c});
+  Output f = ops::AddN(s.WithOpName("gradients/ReLUGrad"), {e, c});
+  Output g = ops::AddN(s.WithOpName("gradients/BNGrad"), {f, a});
+  Output h = ops::AddN(s.WithOpName("gradients/ConvGrad"), {g});
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  EXPECT_EQ(9, item.graph.node_size());
+  NodeMap pre_transform_node_map(&item.graph);
+  // Set op types so that the heuristic will pick these nodes up to be
+  // recomputed
+  pre_transform_node_map.GetNode("BN")->set_op("FusedBatchNorm");
+  pre_transform_node_map.GetNode("ReLU")->set_op("Relu");
+
+  MemoryOptimizer optimizer(RewriterConfig::RECOMPUTATION_HEURISTICS);
+  GraphDef first_pass_output;
+  Status first_pass_status =
+      optimizer.Optimize(nullptr, item, &first_pass_output);
+  TF_EXPECT_OK(first_pass_status);
+
+  NodeMap post_transform_node_map(&first_pass_output);
+  EXPECT_EQ(13, first_pass_output.node_size());
+  NodeDef* transformed_e = post_transform_node_map.GetNode(e.name());
+  EXPECT_EQ(2, transformed_e->input_size());
+  EXPECT_EQ("gradients/BN1Grad", transformed_e->input(0));
+  EXPECT_EQ("Recomputed/ReLU", transformed_e->input(1));
+  NodeDef* transformed_f = post_transform_node_map.GetNode(f.name());
+  EXPECT_EQ(2, transformed_f->input_size());
+  EXPECT_EQ("gradients/Conv1Grad", transformed_f->input(0));
+  EXPECT_EQ("Recomputed/ReLU", transformed_f->input(1));
+  NodeDef* transformed_g = post_transform_node_map.GetNode(g.name());
+  EXPECT_EQ(2, transformed_g->input_size());
+  EXPECT_EQ("gradients/ReLUGrad", transformed_g->input(0));
+  EXPECT_EQ("Conv", transformed_g->input(1));
+
+  NodeDef* recomputed_b = post_transform_node_map.GetNode("Recomputed/BN");
+  EXPECT_EQ(2, recomputed_b->input_size());
+  EXPECT_EQ("Conv", recomputed_b->input(0));
+  EXPECT_EQ("^RecomputeTrigger/BN", recomputed_b->input(1));
+  NodeDef* recompute_trigger_b =
+      post_transform_node_map.GetNode("RecomputeTrigger/BN");
+  EXPECT_EQ(1, recompute_trigger_b->input_size());
+  EXPECT_EQ("^RecomputeTrigger/ReLU", recompute_trigger_b->input(0));
+
+  NodeDef* recomputed_c = post_transform_node_map.GetNode("Recomputed/ReLU");
+  EXPECT_EQ(2, recomputed_c->input_size());
+  EXPECT_EQ("Recomputed/BN", recomputed_c->input(0));
+  EXPECT_EQ("^RecomputeTrigger/ReLU", recomputed_c->input(1));
+  NodeDef* recompute_trigger_c =
+      post_transform_node_map.GetNode("RecomputeTrigger/ReLU");
+  EXPECT_EQ(1, recompute_trigger_c->input_size());
+  EXPECT_EQ("^gradients/BN1Grad", recompute_trigger_c->input(0));
+}
+
+class AutomaticRecomputationTest : public GrapplerTest {};
+
+TEST_F(AutomaticRecomputationTest, RecomputesActivationsOverBudget) {
+  // A chain of 128KB activations that are all read during backprop: keeping
+  // them in memory until then exceeds the 1MB of memory of the CPU.
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice("/cpu:0");
+  const int kDepth = 8;
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({128, 256}));
+  std::vector<Output> activations = {x};
+  for (int i = 1; i <= kDepth; ++i) {
+    activations.push_back(ops::Sigmoid(
+        s.WithOpName(strings::StrCat("sigmoid", i)), activations.back()));
+  }
+  Output grad =
+      ops::OnesLike(s.WithOpName("gradients/ones"), activations.back());
+  for (int i = kDepth; i > 0; --i) {
+    grad = ops::Mul(s.WithOpName(strings::StrCat("gradients/grad", i)),
+                    activations[i], grad);
+  }
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.feed.emplace_back(
+      "x", GenerateRandomTensor<DT_FLOAT>(TensorShape({128, 256})));
+  item.fetch = {"gradients/grad1"};
+
+  const string cpu = "/job:localhost/replica:0/task:0/cpu:0";
+  DeviceProperties cpu_device;
+  cpu_device.set_type("CPU");
+  cpu_device.set_frequency(1000);
+  cpu_device.set_num_cores(4);
+  cpu_device.set_bandwidth(32);
+  cpu_device.set_memory_size(1024 * 1024);
+  std::unique_ptr<VirtualCluster> cluster(
+      new VirtualCluster({{cpu, cpu_device}}));
+  const int64 memory_size = cluster->GetDevices().at(cpu).memory_size();
+  GraphMemory memory(item);
+  TF_ASSERT_OK(memory.InferStatically(cluster->GetDevices()));
+  EXPECT_GT(memory.GetPeakMemoryUsage(cpu).used_memory, memory_size);
+
+  // Swapping only applies to GPUs.
+  MemoryOptimizer heuristics(RewriterConfig::SWAPPING_HEURISTICS);
+  GraphDef output;
+  TF_EXPECT_OK(heuristics.Optimize(cluster.get(), item, &output));
+  EXPECT_EQ(item.graph.node_size(), output.node_size());
+
+  MemoryOptimizer optimizer(RewriterConfig::AUTOMATIC_RECOMPUTATION);
+  TF_EXPECT_OK(optimizer.Optimize(cluster.get(), item, &output));
+  GrapplerItem optimized(item, std::move(output));
+  GraphMemory optimized_memory(optimized);
+  TF_ASSERT_OK(optimized_memory.InferStatically(cluster->GetDevices()));
+  EXPECT_LE(optimized_memory.GetPeakMemoryUsage(cpu).used_memory,
+            memory_size);
+
+  // The recomputed activations read the original ones they depend on, which
+  // therefore aren't recomputed.
+  NodeMap node_map(&optimized.graph);
+  int num_recomputed = 0;
+  for (int i = 1; i <= kDepth; ++i) {
+    const string name = strings::StrCat("sigmoid", i);
+    const NodeDef* recomputed = node_map.GetNode("Recomputed/" + name);
+    const NodeDef* grad =
+        node_map.GetNode(strings::StrCat("gradients/grad", i));
+    if (recomputed == nullptr) {
+      EXPECT_EQ(name, grad->input(0));
+      continue;
+    }
+    ++num_recomputed;
+    EXPECT_EQ("Recomputed/" + name, grad->input(0));
+    EXPECT_EQ(NodeName(activations[i - 1].name()), recomputed->input(0));
+    EXPECT_EQ(nullptr, node_map.GetNode(
+                           NodeName("Recomputed/" + recomputed->input(0))));
+  }
+  EXPECT_LT(0, num_recomputed);
+
+  auto tensors_expected = EvaluateFetchNodes(item);
+  auto tensors = EvaluateFetchNodes(optimized);
+  test::ExpectTensorEqual<float>(tensors_expected[0], tensors[0]);
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
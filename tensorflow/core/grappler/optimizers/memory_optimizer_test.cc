@@ -30,170 +30,6 @@ namespace tensorflow {
 namespace grappler {
 namespace {
 
-class RecomputeSubgraphTest : public GrapplerTest {};
-
-TEST_F(RecomputeSubgraphTest, SimpleSubgraph) {
-  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
-
-  Output a = ops::Variable(s.WithOpName("a"), {2, 3, 4}, DT_FLOAT);
-  Output b = ops::Identity(s.WithOpName("b"), a);  // Recomputed
-  Output c = ops::Identity(s.WithOpName("c"), b);
-  Output d = ops::AddN(s.WithOpName("gradients/d"), {c});
-  Output e = ops::AddN(s.WithOpName("gradients/e"), {d, b});
-  Output f = ops::AddN(s.WithOpName("gradients/f"), {e, a});
-
-  GrapplerItem item;
-  TF_CHECK_OK(s.ToGraphDef(&item.graph));
-  EXPECT_EQ(6, item.graph.node_size());
-  NodeMap pre_transform_node_map(&item.graph);
-  (*pre_transform_node_map.GetNode("b")->mutable_attr())["_recompute_hint"]
-      .set_i(0);
-
-  MemoryOptimizer optimizer(RewriterConfig::MANUAL);
-  GraphDef output;
-  Status status = optimizer.Optimize(nullptr, item, &output);
-
-  TF_EXPECT_OK(status);
-  NodeMap post_transform_node_map(&output);
-  EXPECT_EQ(8, output.node_size());
-  NodeDef* transformed_e = post_transform_node_map.GetNode(e.name());
-  EXPECT_EQ(2, transformed_e->input_size());
-  EXPECT_EQ("gradients/d", transformed_e->input(0));
-  EXPECT_EQ("Recomputed/b", transformed_e->input(1));
-  NodeDef* recomputed_b = post_transform_node_map.GetNode("Recomputed/b");
-  EXPECT_EQ(2, recomputed_b->input_size());
-  EXPECT_EQ("a", recomputed_b->input(0));
-  EXPECT_EQ("^RecomputeTrigger/b", recomputed_b->input(1));
-  NodeDef* recompute_trigger =
-      post_transform_node_map.GetNode("RecomputeTrigger/b");
-  EXPECT_EQ(1, recompute_trigger->input_size());
-  EXPECT_EQ("^gradients/d", recompute_trigger->input(0));
-}
-
-TEST_F(RecomputeSubgraphTest, NoFeedsRecomputed) {
-  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
-
-  Output a = ops::Variable(s.WithOpName("a"), {2, 3, 4}, DT_FLOAT);
-  Output b = ops::Identity(s.WithOpName("b"), a);  // Would be recomputed, but
-                                                   // for being fed
-  Output c = ops::Identity(s.WithOpName("c"), b);
-  Output d = ops::AddN(s.WithOpName("gradients/d"), {c});
-  Output e = ops::AddN(s.WithOpName("gradients/e"), {d, b});
-  Output f = ops::AddN(s.WithOpName("gradients/f"), {e, a});
-
-  GrapplerItem item;
-  TF_CHECK_OK(s.ToGraphDef(&item.graph));
-  item.feed.emplace_back("b", Tensor());
-  EXPECT_EQ(6, item.graph.node_size());
-  NodeMap pre_transform_node_map(&item.graph);
-  (*pre_transform_node_map.GetNode("b")->mutable_attr())["_recompute_hint"]
-      .set_i(0);
-
-  MemoryOptimizer optimizer(RewriterConfig::MANUAL);
-  GraphDef output;
-  Status status = optimizer.Optimize(nullptr, item, &output);
-
-  TF_EXPECT_OK(status);
-  EXPECT_EQ(6, output.node_size());
-}
-
-TEST_F(RecomputeSubgraphTest, TwoInputSubgraphs) {
-  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
-
-  Output a = ops::Variable(s.WithOpName("a"), {2, 3, 4}, DT_FLOAT);
-  Output b = ops::Variable(s.WithOpName("b"), {2, 3, 4}, DT_FLOAT);
-  Output d = ops::AddN(
-      s.WithOpName("some_name_scope/gradients/two_subgraph_inputs"), {a, b});
-
-  GrapplerItem item;
-  TF_CHECK_OK(s.ToGraphDef(&item.graph));
-  EXPECT_EQ(3, item.graph.node_size());
-  NodeMap pre_transform_node_map(&item.graph);
-  (*pre_transform_node_map.GetNode("a")->mutable_attr())["_recompute_hint"]
-      .set_i(0);
-  (*pre_transform_node_map.GetNode("b")->mutable_attr())["_recompute_hint"]
-      .set_i(0);
-
-  MemoryOptimizer optimizer(RewriterConfig::MANUAL,
-                            "some_name_scope/gradients");
-  GraphDef output;
-  Status status = optimizer.Optimize(nullptr, item, &output);
-
-  TF_EXPECT_OK(status);
-  NodeMap post_transform_node_map(&output);
-  // Mostly checking that this case does not crash.
-  EXPECT_EQ(7, output.node_size());
-  EXPECT_NE(post_transform_node_map.GetNode("Recomputed/a"), nullptr);
-  EXPECT_NE(post_transform_node_map.GetNode("Recomputed/b"), nullptr);
-  EXPECT_NE(post_transform_node_map.GetNode("RecomputeTrigger/a"), nullptr);
-  EXPECT_NE(post_transform_node_map.GetNode("RecomputeTrigger/b"), nullptr);
-}
-
-TEST_F(RecomputeSubgraphTest, MultiNode) {
-  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
-
-  Output a = ops::Variable(s.WithOpName("Conv"), {2, 3, 4}, DT_FLOAT);
-  Output b = ops::Identity(s.WithOpName("BN"), a);    // Recomputed
-  Output c = ops::Identity(s.WithOpName("ReLU"), b);  // Recomputed
-  Output d = ops::Identity(s.WithOpName("Conv1"), c);
-
-  // The "gradients/" prefix means the heuristic will pick these up as
-  // candidates to have their inputs recomputed.
-  Output trigger = ops::AddN(s.WithOpName("gradients/BN1Grad"), {d});
-  Output e = ops::AddN(s.WithOpName("gradients/Conv1Grad"), {trigger, c});
-  Output f = ops::AddN(s.WithOpName("gradients/ReLUGrad"), {e, c});
-  Output g = ops::AddN(s.WithOpName("gradients/BNGrad"), {f, a});
-  Output h = ops::AddN(s.WithOpName("gradients/ConvGrad"), {g});
-
-  GrapplerItem item;
-  TF_CHECK_OK(s.ToGraphDef(&item.graph));
-  EXPECT_EQ(9, item.graph.node_size());
-  NodeMap pre_transform_node_map(&item.graph);
-  // Set op types so that the heuristic will pick these nodes up to be
-  // recomputed
-  pre_transform_node_map.GetNode("BN")->set_op("FusedBatchNorm");
-  pre_transform_node_map.GetNode("ReLU")->set_op("Relu");
-
-  MemoryOptimizer optimizer(RewriterConfig::RECOMPUTATION_HEURISTICS);
-  GraphDef first_pass_output;
-  Status first_pass_status =
-      optimizer.Optimize(nullptr, item, &first_pass_output);
-  TF_EXPECT_OK(first_pass_status);
-
-  NodeMap post_transform_node_map(&first_pass_output);
-  EXPECT_EQ(13, first_pass_output.node_size());
-  NodeDef* transformed_e = post_transform_node_map.GetNode(e.name());
-  EXPECT_EQ(2, transformed_e->input_size());
-  EXPECT_EQ("gradients/BN1Grad", transformed_e->input(0));
-  EXPECT_EQ("Recomputed/ReLU", transformed_e->input(1));
-  NodeDef* transformed_f = post_transform_node_map.GetNode(f.name());
-  EXPECT_EQ(2, transformed_f->input_size());
-  EXPECT_EQ("gradients/Conv1Grad", transformed_f->input(0));
-  EXPECT_EQ("Recomputed/ReLU", transformed_f->input(1));
-  NodeDef* transformed_g = post_transform_node_map.GetNode(g.name());
-  EXPECT_EQ(2, transformed_g->input_size());
-  EXPECT_EQ("gradients/ReLUGrad", transformed_g->input(0));
-  EXPECT_EQ("Conv", transformed_g->input(1));
-
-  NodeDef* recomputed_b = post_transform_node_map.GetNode("Recomputed/BN");
-  EXPECT_EQ(2, recomputed_b->input_size());
-  EXPECT_EQ("Conv", recomputed_b->input(0));
-  EXPECT_EQ("^RecomputeTrigger/BN", recomputed_b->input(1));
-  NodeDef* recompute_trigger_b =
-      post_transform_node_map.GetNode("RecomputeTrigger/BN");
-  EXPECT_EQ(1, recompute_trigger_b->input_size());
-  EXPECT_EQ("^RecomputeTrigger/ReLU", recompute_trigger_b->input(0));
-
-  NodeDef* recomputed_c = post_transform_node_map.GetNode("Recomputed/ReLU");
-  EXPECT_EQ(2, recomputed_c->input_size());
-  EXPECT_EQ("Recomputed/BN", recomputed_c->input(0));
-  EXPECT_EQ("^RecomputeTrigger/ReLU", recomputed_c->input(1));
-  NodeDef* recompute_trigger_c =
-      post_transform_node_map.GetNode("RecomputeTrigger/ReLU");
-  EXPECT_EQ(1, recompute_trigger_c->input_size());
-  EXPECT_EQ("^gradients/BN1Grad", recompute_trigger_c->input(0));
-}
-
 class MemoryOptimizerTest : public GrapplerTest {
  public:
   static std::unique_ptr<VirtualCluster> CreateVirtualCluster() {
@@ -14,12 +14,19 @@ limitations under the License.
 ==============================================================================*/
 
 #include "tensorflow/core/grappler/optimizers/meta_optimizer.h"
+
+#include <algorithm>
+#include <unordered_set>
+
 #include "tensorflow/core/common_runtime/function.h"
 #include "tensorflow/core/framework/function.pb.h"
 #include "tensorflow/core/framework/versions.pb.h"
+#include "tensorflow/core/grappler/costs/op_profile_database.h"
+#include "tensorflow/core/grappler/devices.h"
 #include "tensorflow/core/grappler/optimizers/arithmetic_optimizer.h"
 #include "tensorflow/core/grappler/optimizers/auto_parallel.h"
 #include "tensorflow/core/grappler/optimizers/constant_folding.h"
+#include "tensorflow/core/grappler/optimizers/cpu_layout_optimizer.h"
 #include "tensorflow/core/grappler/optimizers/custom_graph_optimizer_registry.h"
 #include "tensorflow/core/grappler/optimizers/debug_stripper.h"
 #include "tensorflow/core/grappler/optimizers/dependency_optimizer.h"
@@ -34,7 +41,18 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils/colocation.h"
 #include "tensorflow/core/grappler/utils/functions.h"
 #include "tensorflow/core/grappler/utils/topological_sort.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
+#include "tensorflow/core/lib/strings/stringprintf.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/public/version.h"
 
 namespace tensorflow {
 namespace grappler {
@@ -70,6 +88,169 @@ bool IsRunOnceOptimizer(const string& name) {
          name == "loop_optimizer";
 }
 
+// Hit rate and benefit of RewriterConfig::meta_optimizer_cache_dir.
+auto* graph_cache_lookups = monitoring::Counter<1>::New(
+    "/tensorflow/core/grappler/meta_optimizer/graph_cache_lookups",
+    "The number of optimized graph cache lookups, by result (hit, miss or "
+    "invalid).",
+    "result");
+auto* graph_cache_saved_usecs = monitoring::Counter<0>::New(
+    "/tensorflow/core/grappler/meta_optimizer/graph_cache_saved_usecs",
+    "The time in microseconds it took to optimize the graphs that were "
+    "later reused from the optimized graph cache.");
+
+// A cache file holds the magic number, the cache key, the time it took to
+// optimize the graph and the serialized optimized GraphDef.
+constexpr uint32 kGraphCacheMagic = 0x4347464d;
+constexpr size_t kGraphCacheHeaderSize = 4 + 16 + 8;
+
+void AppendToKey(StringPiece s, string* key) {
+  core::PutVarint64(key, s.size());
+  key->append(s.data(), s.size());
+}
+
+void AppendToKey(const protobuf::MessageLite& proto, string* key) {
+  string serialized;
+  SerializeToStringDeterministic(proto, &serialized);
+  AppendToKey(serialized, key);
+}
+
+void AppendToKey(const std::vector<string>& strings, string* key) {
+  core::PutVarint64(key, strings.size());
+  for (const string& s : strings) AppendToKey(s, key);
+}
+
+// Returns the fingerprint of the op profiles that the cost estimates of some
+// optimizers are based on, which don't change during the process.
+const string& OpProfileDatabaseKey() {
+  static const string* key = []() {
+    string* key = new string;
+    const OpProfileDatabase* profiles = OpProfileDatabase::FromEnvironment();
+    if (profiles != nullptr) {
+      string serialized;
+      SerializeToStringDeterministic(profiles->ToProto(), &serialized);
+      const Fprint128 fingerprint = Fingerprint128(serialized);
+      core::PutFixed64(key, fingerprint.low64);
+      core::PutFixed64(key, fingerprint.high64);
+    }
+    return key;
+  }();
+  return *key;
+}
+
+// Returns the fingerprint of everything the result of Optimize() depends on:
+// the TensorFlow build, the item, the RewriterConfig, the devices and the
+// op profiles.
+Fprint128 GraphCacheKey(const GrapplerItem& item, const RewriterConfig& cfg,
+                        const Cluster* cluster) {
+  string key;
+  AppendToKey(TF_VERSION_STRING, &key);
+  AppendToKey(tf_git_version(), &key);
+  AppendToKey(item.graph, &key);
+
+  core::PutVarint64(&key, item.feed.size());
+  for (const auto& feed : item.feed) {
+    AppendToKey(feed.first, &key);
+    AppendToKey(DataTypeString(feed.second.dtype()), &key);
+    AppendToKey(feed.second.shape().DebugString(), &key);
+  }
+  AppendToKey(item.fetch, &key);
+  AppendToKey(item.init_ops, &key);
+  AppendToKey(item.keep_ops, &key);
+  AppendToKey(item.save_op, &key);
+  AppendToKey(item.restore_op, &key);
+  AppendToKey(item.save_restore_loc_tensor, &key);
+
+  RewriterConfig cfg_without_cache = cfg;
+  cfg_without_cache.clear_meta_optimizer_cache_dir();
+  AppendToKey(cfg_without_cache, &key);
+
+  if (cluster == nullptr) {
+    core::PutVarint64(&key, 0);
+  } else {
+    const auto& devices = cluster->GetDevices();
+    std::vector<string> names;
+    names.reserve(devices.size());
+    for (const auto& device : devices) names.push_back(device.first);
+    std::sort(names.begin(), names.end());
+    core::PutVarint64(&key, names.size());
+    for (const string& name : names) {
+      AppendToKey(name, &key);
+      AppendToKey(devices.at(name), &key);
+    }
+  }
+  // Some optimizers only look at the local GPUs, not at the cluster.
+  core::PutVarint64(&key, GetNumAvailableGPUs());
+  AppendToKey(OpProfileDatabaseKey(), &key);
+  return Fingerprint128(key);
+}
+
+string GraphCachePath(const string& cache_dir, const Fprint128& key) {
+  return io::JoinPath(
+      cache_dir, strings::Printf("%016llx%016llx.graph",
+                                 static_cast<unsigned long long>(key.high64),
+                                 static_cast<unsigned long long>(key.low64)));
+}
+
+// Reads the optimized graph cached at `path` for `item`. Returns NotFound if
+// there is no cached graph, and another error if the file is unusable.
+Status ReadCachedGraph(Env* env, const string& path, const Fprint128& key,
+                       const GrapplerItem& item, GraphDef* optimized_graph,
+                       int64* optimize_usecs) {
+  string contents;
+  TF_RETURN_IF_ERROR(ReadFileToString(env, path, &contents));
+  if (contents.size() < kGraphCacheHeaderSize ||
+      core::DecodeFixed32(contents.data()) != kGraphCacheMagic ||
+      core::DecodeFixed64(contents.data() + 4) != key.low64 ||
+      core::DecodeFixed64(contents.data() + 12) != key.high64) {
+    return errors::DataLoss("Bad header in cached graph ", path);
+  }
+  *optimize_usecs = core::DecodeFixed64(contents.data() + 20);
+
+  GraphDef graph;
+  if (!ParseProtoUnlimited(&graph, contents.data() + kGraphCacheHeaderSize,
+                           contents.size() - kGraphCacheHeaderSize)) {
+    return errors::DataLoss("Can't parse cached graph ", path);
+  }
+  if (graph.versions().producer() != item.graph.versions().producer()) {
+    return errors::DataLoss("Cached graph ", path, " has producer version ",
+                            graph.versions().producer(), ", expected ",
+                            item.graph.versions().producer());
+  }
+  std::unordered_set<string> nodes;
+  for (const NodeDef& node : graph.node()) nodes.insert(node.name());
+  for (const string& name : item.NodesToPreserve()) {
+    if (nodes.find(name) == nodes.end()) {
+      return errors::DataLoss("Cached graph ", path, " is missing node ",
+                              name);
+    }
+  }
+  optimized_graph->Swap(&graph);
+  return Status::OK();
+}
+
+// Writes the cache file through a temporary file, so that concurrent readers
+// never see a partially written graph.
+Status WriteCachedGraph(Env* env, const string& path, const Fprint128& key,
+                        int64 optimize_usecs, const GraphDef& optimized_graph) {
+  string contents;
+  core::PutFixed32(&contents, kGraphCacheMagic);
+  core::PutFixed64(&contents, key.low64);
+  core::PutFixed64(&contents, key.high64);
+  core::PutFixed64(&contents, optimize_usecs);
+  if (!optimized_graph.AppendToString(&contents)) {
+    return errors::InvalidArgument("Can't serialize the optimized graph");
+  }
+  TF_RETURN_IF_ERROR(env->RecursivelyCreateDir(io::Dirname(path).ToString()));
+  const string tmp_path =
+      strings::Printf("%s.tmp%016llx", path.c_str(),
+                      static_cast<unsigned long long>(random::New64()));
+  TF_RETURN_IF_ERROR(WriteStringToFile(env, tmp_path, contents));
+  Status status = env->RenameFile(tmp_path, path);
+  if (!status.ok()) env->DeleteFile(tmp_path).IgnoreError();
+  return status;
+}
+
 }  // namespace
 
 #define MK_OPT(NAME, VALUE) \
@@ -83,6 +264,7 @@ std::unique_ptr<GraphOptimizer> MetaOptimizer::MakeNewOptimizer(
   MK_OPT("shape", new ShapeOptimizer());
   MK_OPT("remap", new Remapper(cfg_.remapping()));
   MK_OPT("layout", new LayoutOptimizer());
+  MK_OPT("cpu_layout", new CpuLayoutOptimizer(cfg_.cpu_layout_optimization()));
   MK_OPT("memory", new MemoryOptimizer(RewriterConfig::MANUAL));
   MK_OPT("arithmetic", new ArithmeticOptimizer(cfg_.arithmetic_optimization()));
   MK_OPT("autoparallel", new AutoParallel(cfg_.auto_parallel().num_replicas()));
@@ -130,6 +312,10 @@ Status MetaOptimizer::InitializeOptimizers(
     optimizers->emplace_back(
         new DependencyOptimizer(cfg_.dependency_optimization()));
   }
+  if (cfg_.cpu_layout_optimization() == RewriterConfig::ON) {
+    optimizers->emplace_back(
+        new CpuLayoutOptimizer(cfg_.cpu_layout_optimization()));
+  }
   if (cfg_.layout_optimizer() != RewriterConfig::OFF) {
     optimizers->emplace_back(new LayoutOptimizer());
   }
@@ -137,11 +323,13 @@ Status MetaOptimizer::InitializeOptimizers(
     if (cfg_.memory_optimizer_target_node_name_scope().empty()) {
       optimizers->emplace_back(
           // Use the default target node name prefix "gradients/"
-          new MemoryOptimizer(cfg_.memory_optimization()));
+          new MemoryOptimizer(cfg_.memory_optimization(), "gradients/",
+                              cfg_.memory_optimizer_budget_bytes()));
     } else {
       optimizers->emplace_back(
           new MemoryOptimizer(cfg_.memory_optimization(),
-                              cfg_.memory_optimizer_target_node_name_scope()));
+                              cfg_.memory_optimizer_target_node_name_scope(),
+                              cfg_.memory_optimizer_budget_bytes()));
     }
   }
   if (cfg_.auto_parallel().enable()) {
@@ -289,7 +477,52 @@ Status MetaOptimizer::OptimizeGraph(Cluster* cluster, const GrapplerItem& item,
 Status MetaOptimizer::Optimize(Cluster* cluster, const GrapplerItem& item,
                                GraphDef* optimized_graph) {
   optimization_results_.clear();
+  cache_hit_ = false;
+
+  const string& cache_dir = cfg_.meta_optimizer_cache_dir();
+  if (cache_dir.empty()) {
+    return OptimizeGraphAndLibrary(cluster, item, optimized_graph);
+  }
+
+  Env* env = Env::Default();
+  const Fprint128 key = GraphCacheKey(item, cfg_, cluster);
+  const string path = GraphCachePath(cache_dir, key);
+  int64 optimize_usecs = 0;
+  Status status =
+      ReadCachedGraph(env, path, key, item, optimized_graph, &optimize_usecs);
+  if (status.ok()) {
+    VLOG(1) << "Reusing optimized graph " << path;
+    cache_hit_ = true;
+    graph_cache_lookups->GetCell("hit")->IncrementBy(1);
+    graph_cache_saved_usecs->GetCell()->IncrementBy(optimize_usecs);
+    GraphOptimizationResult optimization_result(item.id);
+    optimization_result.results.push_back(
+        {"meta_optimizer_cache",
+         strings::StrCat("Reused ", path, ", saved ",
+                         optimize_usecs / 1000.0f, "ms.")});
+    optimization_results_.push_back(optimization_result);
+    return Status::OK();
+  }
+  if (errors::IsNotFound(status)) {
+    graph_cache_lookups->GetCell("miss")->IncrementBy(1);
+  } else {
+    LOG(WARNING) << "Ignoring optimized graph cache entry: " << status;
+    graph_cache_lookups->GetCell("invalid")->IncrementBy(1);
+  }
+
+  const uint64 start_us = env->NowMicros();
+  TF_RETURN_IF_ERROR(OptimizeGraphAndLibrary(cluster, item, optimized_graph));
+  status = WriteCachedGraph(env, path, key, env->NowMicros() - start_us,
+                            *optimized_graph);
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to cache the optimized graph: " << status;
+  }
+  return Status::OK();
+}
 
+Status MetaOptimizer::OptimizeGraphAndLibrary(Cluster* cluster,
+                                              const GrapplerItem& item,
+                                              GraphDef* optimized_graph) {
   // 1. Optimize main graph
   TF_RETURN_IF_ERROR(OptimizeGraph(cluster, item, optimized_graph));
 
@@ -389,6 +622,7 @@ bool MetaOptimizerEnabled(const RewriterConfig& cfg) {
          cfg.memory_optimization() != RewriterConfig::NO_MEM_OPT ||
          cfg.debug_stripper() == RewriterConfig::ON ||
          cfg.scoped_allocator_optimization() == RewriterConfig::ON ||
+         cfg.cpu_layout_optimization() == RewriterConfig::ON ||
          !cfg.optimizers().empty() || !cfg.custom_optimizers().empty();
 }
 
@@ -39,6 +39,10 @@ class MetaOptimizer : public GraphOptimizer {
 
   void PrintResult();
 
+  // Returns true if the last Optimize() call returned a cached graph
+  // instead of running the optimizers.
+  bool cache_hit() const { return cache_hit_; }
+
   void Feedback(Cluster* cluster, const GrapplerItem& item,
                 const GraphDef& optimized_graph, double result) override;
 
@@ -53,6 +57,10 @@ class MetaOptimizer : public GraphOptimizer {
   Status InitializeOptimizersByName(
       std::vector<std::unique_ptr<GraphOptimizer>>* optimizers) const;
 
+  // Optimize the main graph and the function library of the item.
+  Status OptimizeGraphAndLibrary(Cluster* cluster, const GrapplerItem& item,
+                                 GraphDef* optimized_graph);
+
   // Run optimization pass over a single GrapplerItem. Meta optimizer might run
   // multiple such passes: 1) for the main graph 2) for the function library
   Status OptimizeGraph(Cluster* cluster, const GrapplerItem& item,
@@ -73,6 +81,9 @@ class MetaOptimizer : public GraphOptimizer {
   };
 
   std::vector<GraphOptimizationResult> optimization_results_;
+  // True if the last Optimize() call reused a graph from
+  // RewriterConfig::meta_optimizer_cache_dir.
+  bool cache_hit_ = false;
 };
 
 bool MetaOptimizerEnabled(const RewriterConfig& cfg);
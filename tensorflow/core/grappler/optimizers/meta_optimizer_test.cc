@@ -25,6 +25,8 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils.h"
 #include "tensorflow/core/grappler/utils/grappler_test.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/test.h"
 
 namespace tensorflow {
@@ -64,7 +66,18 @@ bool TestOptimizer::optimized_;
 
 REGISTER_GRAPH_OPTIMIZER(TestOptimizer);
 
-class MetaOptimizerTest : public GrapplerTest {};
+class MetaOptimizerTest : public GrapplerTest {
+ protected:
+  // Returns an empty directory for the optimized graph cache.
+  string EmptyCacheDir(const string& name) {
+    const string cache_dir = io::JoinPath(testing::TmpDir(), name);
+    int64 undeleted_files, undeleted_dirs;
+    Env::Default()
+        ->DeleteRecursively(cache_dir, &undeleted_files, &undeleted_dirs)
+        .IgnoreError();
+    return cache_dir;
+  }
+};
 
 TEST_F(MetaOptimizerTest, RunsCustomOptimizer) {
   TrivialTestGraphInputYielder fake_input(4, 1, 10, false, {"CPU:0"});
@@ -256,6 +269,85 @@ TEST_F(MetaOptimizerTest, OptimizeFunctionLibrary) {
   test::ExpectTensorEqual<int>(tensors_expected[1], tensors[1]);
 }
 
+TEST_F(MetaOptimizerTest, ReusesCachedGraph) {
+  TrivialTestGraphInputYielder fake_input(4, 1, 10, false, {"CPU:0"});
+  GrapplerItem item;
+  CHECK(fake_input.NextItem(&item));
+
+  const string cache_dir = EmptyCacheDir("meta_optimizer_cache");
+  RewriterConfig rewriter_config;
+  rewriter_config.add_optimizers("TestOptimizer");
+  rewriter_config.set_meta_optimizer_cache_dir(cache_dir);
+
+  // The first run optimizes the graph and fills the cache.
+  GraphDef first;
+  TestOptimizer::SetOptimized(false);
+  MetaOptimizer optimizer(nullptr, rewriter_config);
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &first));
+  EXPECT_TRUE(TestOptimizer::IsOptimized());
+  EXPECT_FALSE(optimizer.cache_hit());
+
+  // A new optimizer for the same item reuses the cached graph.
+  GraphDef second;
+  TestOptimizer::SetOptimized(false);
+  MetaOptimizer cached_optimizer(nullptr, rewriter_config);
+  TF_EXPECT_OK(cached_optimizer.Optimize(nullptr, item, &second));
+  EXPECT_FALSE(TestOptimizer::IsOptimized());
+  EXPECT_TRUE(cached_optimizer.cache_hit());
+  CompareGraphs(first, second);
+
+  // Changing the fetch nodes or the config changes the cache key.
+  GrapplerItem other_item = item;
+  other_item.fetch.push_back(item.graph.node(0).name());
+  TF_EXPECT_OK(cached_optimizer.Optimize(nullptr, other_item, &second));
+  EXPECT_TRUE(TestOptimizer::IsOptimized());
+  EXPECT_FALSE(cached_optimizer.cache_hit());
+
+  TestOptimizer::SetOptimized(false);
+  rewriter_config.set_meta_optimizer_iterations(RewriterConfig::TWO);
+  MetaOptimizer other_optimizer(nullptr, rewriter_config);
+  TF_EXPECT_OK(other_optimizer.Optimize(nullptr, item, &second));
+  EXPECT_TRUE(TestOptimizer::IsOptimized());
+  EXPECT_FALSE(other_optimizer.cache_hit());
+}
+
+TEST_F(MetaOptimizerTest, IgnoresCorruptCachedGraph) {
+  TrivialTestGraphInputYielder fake_input(4, 1, 10, false, {"CPU:0"});
+  GrapplerItem item;
+  CHECK(fake_input.NextItem(&item));
+
+  const string cache_dir = EmptyCacheDir("meta_optimizer_corrupt_cache");
+  RewriterConfig rewriter_config;
+  rewriter_config.add_optimizers("TestOptimizer");
+  rewriter_config.set_meta_optimizer_cache_dir(cache_dir);
+
+  GraphDef output;
+  MetaOptimizer optimizer(nullptr, rewriter_config);
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  std::vector<string> files;
+  TF_ASSERT_OK(Env::Default()->GetChildren(cache_dir, &files));
+  ASSERT_EQ(1, files.size());
+  const string path = io::JoinPath(cache_dir, files[0]);
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), path, &contents));
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), path,
+                                 contents.substr(0, contents.size() / 2)));
+
+  GraphDef reoptimized;
+  TestOptimizer::SetOptimized(false);
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &reoptimized));
+  EXPECT_TRUE(TestOptimizer::IsOptimized());
+  EXPECT_FALSE(optimizer.cache_hit());
+  CompareGraphs(output, reoptimized);
+
+  // The corrupt entry was replaced.
+  TestOptimizer::SetOptimized(false);
+  TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &reoptimized));
+  EXPECT_FALSE(TestOptimizer::IsOptimized());
+  EXPECT_TRUE(optimizer.cache_hit());
+}
+
 }  // namespace
 }  // namespace grappler
 }  // namespace tensorflow
@@ -15,17 +15,435 @@ limitations under the License.
 
 #include "tensorflow/core/grappler/optimizers/remapper.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/grappler/costs/graph_properties.h"
 #include "tensorflow/core/grappler/graph_view.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/op_types.h"
 #include "tensorflow/core/grappler/optimizers/constant_folding.h"
+#include "tensorflow/core/grappler/optimizers/symbolic_shapes.h"
 #include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/grappler/utils/topological_sort.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 
 namespace tensorflow {
 namespace grappler {
 
+namespace {
+
+// A Conv2D or MatMul followed by a BiasAdd and optionally a Relu or Relu6,
+// which a single _FusedConv2D or _FusedMatMul computes in one pass over the
+// output on CPU.
+struct ContractionWithBiasAdd {
+  const NodeDef* contraction = nullptr;
+  const NodeDef* bias_add = nullptr;
+  // The Relu or Relu6, or nullptr if there is no activation.
+  const NodeDef* activation = nullptr;
+
+  const NodeDef& last() const { return activation ? *activation : *bias_add; }
+};
+
+bool HasNhwcDataFormat(const NodeDef& node) {
+  return node.attr().count("data_format") == 0 ||
+         node.attr().at("data_format").s() == "NHWC";
+}
+
+// Returns the node whose output 0 is the input 0 of `node`, or nullptr if
+// the input comes from another output.
+const NodeDef* GetInputNode(const GraphView& graph, const NodeDef& node) {
+  const GraphView::OutputPort input =
+      graph.GetRegularFanin(GraphView::InputPort(&node, 0));
+  return input.port_id == 0 ? input.node : nullptr;
+}
+
+// Returns whether the only use of `node` is as the input 0 of `consumer`, so
+// that nothing else needs the output of `node` once the two are fused.
+bool FeedsOnly(const GraphView& graph,
+               const std::unordered_set<string>& nodes_to_preserve,
+               const NodeDef& node, const NodeDef& consumer) {
+  if (nodes_to_preserve.count(node.name()) > 0) return false;
+  const auto fanout = graph.GetFanoutEdges(node, true);
+  if (fanout.size() != 1) return false;
+  const GraphView::Edge& edge = *fanout.begin();
+  return edge.src.port_id == 0 && edge.tgt.node == &consumer &&
+         edge.tgt.port_id == 0;
+}
+
+// Matches a Conv2D or MatMul + BiasAdd that _FusedConv2D or _FusedMatMul
+// implements, with `bias_add` as the BiasAdd.
+bool FindContractionWithBias(
+    const GraphView& graph, const std::unordered_set<string>& nodes_to_preserve,
+    const NodeDef& bias_add, ContractionWithBiasAdd* pattern) {
+  if (!IsBiasAdd(bias_add) || !HasNhwcDataFormat(bias_add) ||
+      !IsPlacedOnCpu(bias_add)) {
+    return false;
+  }
+  const NodeDef* contraction = GetInputNode(graph, bias_add);
+  if (contraction == nullptr ||
+      (!IsConv2D(*contraction) && contraction->op() != "MatMul") ||
+      !HasNhwcDataFormat(*contraction) ||
+      contraction->device() != bias_add.device() ||
+      !FeedsOnly(graph, nodes_to_preserve, *contraction, bias_add)) {
+    return false;
+  }
+  const DataType dtype = GetDataTypeFromAttr(*contraction, "T");
+  if (dtype != DT_FLOAT && dtype != DT_DOUBLE) return false;
+  pattern->contraction = contraction;
+  pattern->bias_add = &bias_add;
+  pattern->activation = nullptr;
+  return true;
+}
+
+// Matches a Conv2D or MatMul + BiasAdd + Relu or Relu6 that _FusedConv2D or
+// _FusedMatMul implements, with `activation` as the Relu or Relu6.
+bool FindContractionWithBiasAndActivation(
+    const GraphView& graph, const std::unordered_set<string>& nodes_to_preserve,
+    const NodeDef& activation, ContractionWithBiasAdd* pattern) {
+  if (!IsRelu(activation) && !IsRelu6(activation)) return false;
+  const NodeDef* bias_add = GetInputNode(graph, activation);
+  if (bias_add == nullptr || bias_add->device() != activation.device() ||
+      !FeedsOnly(graph, nodes_to_preserve, *bias_add, activation) ||
+      !FindContractionWithBias(graph, nodes_to_preserve, *bias_add, pattern)) {
+    return false;
+  }
+  pattern->activation = &activation;
+  return true;
+}
+
+// Adds to `optimized_graph` a _FusedConv2D or _FusedMatMul that replaces the
+// nodes of `pattern` and takes the name of the last one.
+void AddFusedContractionNode(const GraphView& graph,
+                             const ContractionWithBiasAdd& pattern,
+                             GraphDef* optimized_graph) {
+  const NodeDef& contraction = *pattern.contraction;
+  const bool is_matmul = contraction.op() == "MatMul";
+  const NodeDef& last = pattern.last();
+  NodeDef* fused = optimized_graph->add_node();
+  fused->set_name(last.name());
+  fused->set_op(is_matmul ? "_FusedMatMul" : "_FusedConv2D");
+  fused->set_device(last.device());
+  *fused->add_input() = contraction.input(0);
+  *fused->add_input() = contraction.input(1);
+  *fused->add_input() = pattern.bias_add->input(1);
+
+  // Keep the control dependencies of all the fused nodes.
+  std::unordered_set<string> control_inputs;
+  for (const NodeDef* node :
+       {&contraction, pattern.bias_add, pattern.activation}) {
+    if (node == nullptr) continue;
+    for (const string& input : node->input()) {
+      if (IsControlInput(input) && control_inputs.insert(input).second) {
+        *fused->add_input() = input;
+      }
+    }
+  }
+
+  auto* attr = fused->mutable_attr();
+  for (const char* name :
+       {"T", "strides", "padding", "data_format", "dilations",
+        "use_cudnn_on_gpu", "transpose_a", "transpose_b"}) {
+    if (contraction.attr().count(name) > 0) {
+      (*attr)[name] = contraction.attr().at(name);
+    }
+  }
+  if (is_matmul) {
+    // Constant weights are packed for the multiplication once, instead of at
+    // every step.
+    const NodeDef* weights =
+        graph.GetRegularFanin(GraphView::InputPort(&contraction, 1)).node;
+    (*attr)["b_is_constant"].set_b(weights != nullptr && IsConstant(*weights));
+  }
+  (*attr)["num_args"].set_i(1);
+  auto* fused_ops = (*attr)["fused_ops"].mutable_list();
+  fused_ops->add_s("BiasAdd");
+  if (pattern.activation != nullptr) {
+    fused_ops->add_s(pattern.activation->op());
+  }
+}
+
+// Returns the number of inputs of `node` if it is an elementwise op that
+// _FusedElementwise evaluates, or 0 otherwise. Keep in sync with
+// kernels/cwise_op_fused.cc.
+int NumFusibleElementwiseInputs(const NodeDef& node) {
+  static const std::unordered_map<string, int>* fusible_ops =
+      new std::unordered_map<string, int>({
+          {"Abs", 1},     {"Erf", 1},         {"Exp", 1},
+          {"Inv", 1},     {"Log", 1},         {"Neg", 1},
+          {"Reciprocal", 1}, {"Relu", 1},     {"Relu6", 1},
+          {"Rsqrt", 1},   {"Sigmoid", 1},     {"Sqrt", 1},
+          {"Square", 1},  {"Tanh", 1},        {"Add", 2},
+          {"AddV2", 2},   {"Div", 2},         {"Maximum", 2},
+          {"Minimum", 2}, {"Mul", 2},         {"Pow", 2},
+          {"RealDiv", 2}, {"SquaredDifference", 2}, {"Sub", 2},
+      });
+  auto it = fusible_ops->find(node.op());
+  return it == fusible_ops->end() ? 0 : it->second;
+}
+
+bool IsFusibleElementwise(const NodeDef& node,
+                          const std::unordered_set<string>& nodes_to_preserve) {
+  const int num_inputs = NumFusibleElementwiseInputs(node);
+  if (num_inputs == 0 || NumNonControlInputs(node) != num_inputs ||
+      nodes_to_preserve.count(node.name()) > 0 || !IsPlacedOnCpu(node)) {
+    return false;
+  }
+  const DataType dtype = GetDataTypeFromAttr(node, "T");
+  return dtype == DT_FLOAT || dtype == DT_DOUBLE;
+}
+
+// Returns whether a tensor of shape `input` broadcasts to `shape` along its
+// leading dimensions only, the way _FusedElementwise broadcasts its inputs.
+bool BroadcastsAlongLeadingDims(const TensorShapeProto& input,
+                                const TensorShapeProto& shape) {
+  if (input.unknown_rank() || shape.unknown_rank()) return false;
+  int first = 0;
+  while (first < input.dim_size() && input.dim(first).size() == 1) ++first;
+  const int offset = shape.dim_size() - input.dim_size();
+  if (offset + first < 0) return false;
+  for (int i = first; i < input.dim_size(); ++i) {
+    const TensorShapeProto::Dim& dim = input.dim(i);
+    if ((!IsKnown(dim) && !IsKnownSymbolically(dim)) ||
+        dim.size() != shape.dim(offset + i).size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A fused DAG reads and writes its intermediate values in blocks that must
+// stay in cache, which bounds its size.
+const int kMaxElementwiseClusterSize = 32;
+// The number of nodes visited to prove that fusing nodes doesn't create a
+// cycle, beyond which they are not fused.
+const int kMaxCycleSearch = 1000;
+
+// Groups elementwise nodes into clusters that a _FusedElementwise each can
+// compute: connected nodes that run on the same device, with the same type
+// and the same output shape, and whose other inputs broadcast to it. The
+// nodes are added in topological order, and each one joins the clusters of
+// its inputs unless that would create a cycle through a node outside of the
+// cluster.
+class ElementwiseClustering {
+ public:
+  ElementwiseClustering(
+      const GraphView& graph, const GraphProperties& properties,
+      const std::unordered_map<const NodeDef*, int>& topo_order)
+      : graph_(graph), properties_(properties), topo_order_(topo_order) {}
+
+  void AddNode(const NodeDef& node) {
+    const auto& output_props = properties_.GetOutputProperties(node.name());
+    const auto& input_props = properties_.GetInputProperties(node.name());
+    const int num_inputs = NumNonControlInputs(node);
+    if (output_props.empty() || input_props.size() != num_inputs ||
+        !ShapeIsSymbolicallyDefined(output_props[0])) {
+      return;
+    }
+    const TensorShapeProto& shape = output_props[0].shape();
+    const DataType dtype = GetDataTypeFromAttr(node, "T");
+
+    std::vector<int> input_clusters;
+    bool has_full_input = false;
+    for (int i = 0; i < num_inputs; ++i) {
+      const GraphView::OutputPort fanin =
+          graph_.GetRegularFanin(GraphView::InputPort(&node, i));
+      auto it = cluster_of_.find(fanin.node);
+      if (it != cluster_of_.end() && fanin.port_id == 0 &&
+          fanin.node->device() == node.device() &&
+          GetDataTypeFromAttr(*fanin.node, "T") == dtype &&
+          ShapesSymbolicallyEqual(shapes_[it->second], shape)) {
+        if (std::find(input_clusters.begin(), input_clusters.end(),
+                      it->second) == input_clusters.end()) {
+          input_clusters.push_back(it->second);
+        }
+        has_full_input = true;
+        continue;
+      }
+      if (!BroadcastsAlongLeadingDims(input_props[i].shape(), shape)) return;
+      has_full_input |= ShapesSymbolicallyEqual(input_props[i].shape(), shape);
+    }
+    // _FusedElementwise takes the shape of its largest input, so one of them
+    // must have the output shape.
+    if (!has_full_input) return;
+
+    std::vector<const NodeDef*> nodes = {&node};
+    std::vector<int> merged_clusters;
+    for (int c : input_clusters) {
+      if (nodes.size() + clusters_[c].size() > kMaxElementwiseClusterSize) {
+        continue;
+      }
+      std::vector<const NodeDef*> merged = nodes;
+      merged.insert(merged.end(), clusters_[c].begin(), clusters_[c].end());
+      if (CreatesCycle(merged)) continue;
+      nodes.swap(merged);
+      merged_clusters.push_back(c);
+    }
+    for (int c : merged_clusters) clusters_[c].clear();
+    const int id = clusters_.size();
+    for (const NodeDef* n : nodes) cluster_of_[n] = id;
+    clusters_.push_back(std::move(nodes));
+    shapes_.push_back(shape);
+  }
+
+  // Returns the clusters of two nodes or more, with their nodes in
+  // topological order.
+  std::vector<std::vector<const NodeDef*>> Clusters() const {
+    std::vector<std::vector<const NodeDef*>> clusters;
+    for (const auto& cluster : clusters_) {
+      if (cluster.size() < 2) continue;
+      clusters.push_back(cluster);
+      std::sort(clusters.back().begin(), clusters.back().end(),
+                [this](const NodeDef* a, const NodeDef* b) {
+                  return topo_order_.at(a) < topo_order_.at(b);
+                });
+    }
+    return clusters;
+  }
+
+ private:
+  // Returns whether replacing `nodes` with a single node would create a
+  // cycle, that is whether a node outside of them both depends on one of them
+  // and feeds one of them. Returns true if it can't tell in time.
+  bool CreatesCycle(const std::vector<const NodeDef*>& nodes) const {
+    const std::unordered_set<const NodeDef*> members(nodes.begin(),
+                                                     nodes.end());
+    int min_order = topo_order_.at(nodes.front());
+    std::vector<const NodeDef*> stack;
+    for (const NodeDef* node : nodes) {
+      min_order = std::min(min_order, topo_order_.at(node));
+      for (const auto& fanin : graph_.GetFanins(*node, true)) {
+        if (members.count(fanin.node) == 0) stack.push_back(fanin.node);
+      }
+    }
+    // Walk back from the inputs of the nodes, skipping the nodes that come
+    // before all of them and so can't depend on them.
+    std::unordered_set<const NodeDef*> visited;
+    while (!stack.empty()) {
+      const NodeDef* node = stack.back();
+      stack.pop_back();
+      if (members.count(node) > 0) return true;
+      if (topo_order_.at(node) < min_order || !visited.insert(node).second) {
+        continue;
+      }
+      if (visited.size() > kMaxCycleSearch) return true;
+      for (const auto& fanin : graph_.GetFanins(*node, true)) {
+        stack.push_back(fanin.node);
+      }
+    }
+    return false;
+  }
+
+  const GraphView& graph_;
+  const GraphProperties& properties_;
+  const std::unordered_map<const NodeDef*, int>& topo_order_;
+  // The clusters and their output shape, indexed by cluster id. The clusters
+  // merged into another one are left empty.
+  std::vector<std::vector<const NodeDef*>> clusters_;
+  std::vector<TensorShapeProto> shapes_;
+  std::unordered_map<const NodeDef*, int> cluster_of_;
+};
+
+// Returns the name of the value read by the regular input `input`.
+string ValueName(const string& input) {
+  int port;
+  const string name = ParseNodeName(input, &port);
+  return port == 0 ? name : strings::StrCat(name, ":", port);
+}
+
+// Fills `fused` with a _FusedElementwise that computes the nodes of
+// `cluster`, sorted in topological order, and records in `renamed_inputs` the
+// inputs that the fanouts of the nodes must read from it instead. The fused
+// node takes the name of the last node that is used outside of the cluster,
+// and outputs its value first. Returns false if no node of the cluster is
+// used outside of it.
+bool BuildFusedElementwiseNode(
+    const GraphView& graph, const std::vector<const NodeDef*>& cluster,
+    NodeDef* fused, std::unordered_map<string, string>* renamed_inputs) {
+  const std::unordered_set<const NodeDef*> members(cluster.begin(),
+                                                   cluster.end());
+  std::vector<const NodeDef*> outputs;
+  for (const NodeDef* node : cluster) {
+    for (const auto& fanout : graph.GetFanouts(*node, false)) {
+      if (members.count(fanout.node) == 0) {
+        outputs.push_back(node);
+        break;
+      }
+    }
+  }
+  if (outputs.empty()) return false;
+  const NodeDef& root = *outputs.back();
+  outputs.pop_back();
+  outputs.insert(outputs.begin(), &root);
+
+  // The values are the inputs of the fused node, followed by the values of
+  // the nodes of the cluster.
+  std::unordered_map<string, int> value_ids;
+  std::vector<string> args;
+  std::vector<string> control_inputs;
+  for (const NodeDef* node : cluster) {
+    for (const string& input : node->input()) {
+      const NodeDef* input_node = graph.GetNode(NodeName(input));
+      if (input_node != nullptr && members.count(input_node) > 0) continue;
+      if (IsControlInput(input)) {
+        if (std::find(control_inputs.begin(), control_inputs.end(), input) ==
+            control_inputs.end()) {
+          control_inputs.push_back(input);
+        }
+      } else if (value_ids.emplace(ValueName(input), args.size()).second) {
+        args.push_back(input);
+      }
+    }
+  }
+  for (int j = 0; j < cluster.size(); ++j) {
+    value_ids[cluster[j]->name()] = args.size() + j;
+  }
+
+  fused->set_name(root.name());
+  fused->set_op("_FusedElementwise");
+  fused->set_device(root.device());
+  for (const string& arg : args) *fused->add_input() = arg;
+  for (const string& input : control_inputs) *fused->add_input() = input;
+  auto* attr = fused->mutable_attr();
+  (*attr)["T"] = root.attr().at("T");
+  (*attr)["N"].set_i(args.size());
+  (*attr)["num_outputs"].set_i(outputs.size());
+  auto* fused_ops = (*attr)["fused_ops"].mutable_list();
+  auto* operands = (*attr)["operands"].mutable_list();
+  for (const NodeDef* node : cluster) {
+    fused_ops->add_s(node->op());
+    const int num_inputs = NumNonControlInputs(*node);
+    for (int i = 0; i < 2; ++i) {
+      operands->add_i(i < num_inputs ? value_ids.at(ValueName(node->input(i)))
+                                     : -1);
+    }
+  }
+  auto* output_ids = (*attr)["output_ids"].mutable_list();
+  for (const NodeDef* output : outputs) {
+    output_ids->add_i(value_ids.at(output->name()));
+  }
+
+  for (int k = 1; k < outputs.size(); ++k) {
+    const string fused_output = strings::StrCat(root.name(), ":", k);
+    (*renamed_inputs)[outputs[k]->name()] = fused_output;
+    (*renamed_inputs)[strings::StrCat(outputs[k]->name(), ":0")] =
+        fused_output;
+  }
+  for (const NodeDef* node : cluster) {
+    if (node != &root) {
+      (*renamed_inputs)[AsControlDependency(*node)] =
+          AsControlDependency(root.name());
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
 void AddBatchNormNodes(GraphDef* optimized_graph, const NodeDef& fused_node) {
   const string& x = fused_node.input(0);
   string scale = fused_node.input(1);
@@ -170,9 +588,82 @@ Status Remapper::Optimize(Cluster* /*cluster*/, const GrapplerItem& item,
   TF_RETURN_IF_ERROR(properties.InferStatically(false));
   GraphView graph(const_cast<GraphDef*>(&item.graph));
 
-  // During inference, most of the inputs to FusedBatchNorm are constant, and we
-  // can therefore replace the op with a much cheaper set of primitives.
+  // Conv2D or MatMul + BiasAdd (+ activation) are replaced with a
+  // _FusedConv2D or _FusedMatMul that applies the bias and activation while
+  // the output is still in cache. Patterns with an activation are matched
+  // first so that their BiasAdd is not fused on its own.
+  const std::unordered_set<string> nodes_to_preserve = item.NodesToPreserve();
+  std::unordered_map<string, ContractionWithBiasAdd> fused_contractions;
+  std::unordered_set<const NodeDef*> fused_away;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (const NodeDef& node : item.graph.node()) {
+      if (fused_away.count(&node) > 0) continue;
+      ContractionWithBiasAdd pattern;
+      const bool found =
+          pass == 0
+              ? FindContractionWithBiasAndActivation(graph, nodes_to_preserve,
+                                                     node, &pattern)
+              : FindContractionWithBias(graph, nodes_to_preserve, node,
+                                        &pattern);
+      if (!found) continue;
+      fused_contractions[node.name()] = pattern;
+      fused_away.insert(pattern.contraction);
+      if (pattern.activation != nullptr) fused_away.insert(pattern.bias_add);
+    }
+  }
+
+  // DAGs of elementwise ops are replaced with a _FusedElementwise, which
+  // evaluates them block by block while the intermediate values are in cache,
+  // instead of reading and writing a whole tensor per op. The graph must be
+  // acyclic to find the DAGs that can be fused without creating a cycle.
+  // This is only done in AGGRESSIVE mode, as the fused kernel interprets the
+  // DAG and may be slower than the individual ops when they are compute bound.
+  std::unordered_map<string, NodeDef> fused_elementwise;
+  std::unordered_map<string, string> renamed_inputs;
+  std::unordered_map<const NodeDef*, int> topo_order;
+  if (opt_level_ == RewriterConfig::AGGRESSIVE &&
+      ComputeTopologicalOrder(item.graph, &topo_order, nullptr).ok()) {
+    std::vector<const NodeDef*> sorted_nodes(topo_order.size());
+    for (const auto& entry : topo_order) {
+      sorted_nodes[entry.second] = entry.first;
+    }
+    ElementwiseClustering clustering(graph, properties, topo_order);
+    for (const NodeDef* node : sorted_nodes) {
+      if (fused_away.count(node) == 0 &&
+          fused_contractions.count(node->name()) == 0 &&
+          IsFusibleElementwise(*node, nodes_to_preserve)) {
+        clustering.AddNode(*node);
+      }
+    }
+    for (const auto& cluster : clustering.Clusters()) {
+      NodeDef fused;
+      if (!BuildFusedElementwiseNode(graph, cluster, &fused,
+                                     &renamed_inputs)) {
+        continue;
+      }
+      VLOG(1) << "Fusing " << cluster.size() << " elementwise ops into "
+              << fused.name();
+      fused_away.insert(cluster.begin(), cluster.end());
+      fused_elementwise[fused.name()] = std::move(fused);
+    }
+  }
+
   for (const NodeDef& node : item.graph.node()) {
+    auto fused_cwise = fused_elementwise.find(node.name());
+    if (fused_cwise != fused_elementwise.end()) {
+      *optimized_graph->add_node() = fused_cwise->second;
+      continue;
+    }
+    if (fused_away.count(&node) > 0) continue;
+    auto fused = fused_contractions.find(node.name());
+    if (fused != fused_contractions.end()) {
+      VLOG(1) << "Fusing " << fused->second.contraction->name() << " into "
+              << node.name();
+      AddFusedContractionNode(graph, fused->second, optimized_graph);
+      continue;
+    }
+    // During inference, most of the inputs to FusedBatchNorm are constant, and
+    // we can therefore replace the op with a much cheaper set of primitives.
     if (node.op() == "FusedBatchNorm" || node.op() == "FusedBatchNormV2") {
       bool optimizable = (node.attr().count("T") == 0 ||
                           node.attr().at("T").type() == DT_FLOAT);
@@ -209,6 +700,17 @@ Status Remapper::Optimize(Cluster* /*cluster*/, const GrapplerItem& item,
     *optimized_graph->add_node() = node;
   }
 
+  // Make the fanouts of the fused elementwise nodes read the outputs of the
+  // _FusedElementwise that replaced them.
+  if (!renamed_inputs.empty()) {
+    for (NodeDef& node : *optimized_graph->mutable_node()) {
+      for (int i = 0; i < node.input_size(); ++i) {
+        auto it = renamed_inputs.find(node.input(i));
+        if (it != renamed_inputs.end()) *node.mutable_input(i) = it->second;
+      }
+    }
+  }
+
   *optimized_graph->mutable_library() = item.graph.library();
   *optimized_graph->mutable_versions() = item.graph.versions();
 
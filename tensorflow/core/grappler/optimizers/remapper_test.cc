@@ -91,5 +91,417 @@ TEST_F(RemapperTest, FusedBatchNormNCHW) {
   }
 }
 
+namespace {
+
+// Builds Conv2D + BiasAdd + `activation` on CPU, with the output of the last
+// node named "output".
+void BuildConv2DWithBias(const string& activation, GrapplerItem* item) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice(
+      "/job:localhost/replica:0/task:0/device:CPU:0");
+  auto input = ops::Placeholder(s.WithOpName("input"), DT_FLOAT,
+                                ops::Placeholder::Shape({2, 8, 8, 3}));
+  Tensor filter_value(DT_FLOAT, TensorShape({3, 3, 3, 4}));
+  filter_value.flat<float>().setRandom();
+  auto filter = ops::Const(s.WithOpName("filter"), filter_value);
+  auto bias = ops::Const(s.WithOpName("bias"), {-1.0f, 0.5f, -2.0f, 3.0f},
+                         {4});
+  auto conv = ops::Conv2D(s.WithOpName("conv"), input, filter, {1, 1, 1, 1},
+                          "SAME");
+  const string bias_add_name = activation.empty() ? "output" : "bias_add";
+  Output output = ops::BiasAdd(s.WithOpName(bias_add_name), conv, bias);
+  if (activation == "Relu") {
+    output = ops::Relu(s.WithOpName("output"), output);
+  } else if (activation == "Relu6") {
+    output = ops::Relu6(s.WithOpName("output"), output);
+  }
+  TF_CHECK_OK(s.ToGraphDef(&item->graph));
+  item->fetch = {"output"};
+}
+
+// Builds MatMul + BiasAdd + `activation` on CPU, with the output of the last
+// node named "output". The weights are a Const if `constant_weights` and a
+// Placeholder otherwise.
+void BuildMatMulWithBias(const string& activation, bool constant_weights,
+                         GrapplerItem* item) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice(
+      "/job:localhost/replica:0/task:0/device:CPU:0");
+  auto input = ops::Placeholder(s.WithOpName("input"), DT_FLOAT,
+                                ops::Placeholder::Shape({3, 5}));
+  Output weights =
+      constant_weights
+          ? Output(ops::Const(s.WithOpName("weights"), 0.25f, {5, 4}))
+          : Output(ops::Placeholder(s.WithOpName("weights"), DT_FLOAT,
+                                    ops::Placeholder::Shape({5, 4})));
+  auto bias = ops::Const(s.WithOpName("bias"), {-1.0f, 0.5f, -2.0f, 3.0f},
+                         {4});
+  auto matmul = ops::MatMul(s.WithOpName("matmul"), input, weights);
+  const string bias_add_name = activation.empty() ? "output" : "bias_add";
+  Output output = ops::BiasAdd(s.WithOpName(bias_add_name), matmul, bias);
+  if (activation == "Relu") {
+    output = ops::Relu(s.WithOpName("output"), output);
+  } else if (activation == "Relu6") {
+    output = ops::Relu6(s.WithOpName("output"), output);
+  }
+  TF_CHECK_OK(s.ToGraphDef(&item->graph));
+  item->fetch = {"output"};
+}
+
+Tensor RandomInput() {
+  Tensor input(DT_FLOAT, TensorShape({2, 8, 8, 3}));
+  input.flat<float>().setRandom();
+  return input;
+}
+
+const NodeDef* FindNode(const GraphDef& graph, const string& name) {
+  for (const NodeDef& node : graph.node()) {
+    if (node.name() == name) return &node;
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+TEST_F(RemapperTest, FuseConv2DWithBiasAndActivation) {
+  for (const string activation : {"Relu", "Relu6"}) {
+    GrapplerItem item;
+    BuildConv2DWithBias(activation, &item);
+
+    Remapper optimizer(RewriterConfig::ON);
+    GraphDef output;
+    TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+    EXPECT_EQ(nullptr, FindNode(output, "conv"));
+    EXPECT_EQ(nullptr, FindNode(output, "bias_add"));
+    const NodeDef* fused = FindNode(output, "output");
+    ASSERT_NE(nullptr, fused);
+    EXPECT_EQ("_FusedConv2D", fused->op());
+    ASSERT_EQ(3, fused->input_size());
+    EXPECT_EQ("input", fused->input(0));
+    EXPECT_EQ("filter", fused->input(1));
+    EXPECT_EQ("bias", fused->input(2));
+    EXPECT_EQ(1, fused->attr().at("num_args").i());
+    const auto& fused_ops = fused->attr().at("fused_ops").list();
+    ASSERT_EQ(2, fused_ops.s_size());
+    EXPECT_EQ("BiasAdd", fused_ops.s(0));
+    EXPECT_EQ(activation, fused_ops.s(1));
+
+    const Tensor input = RandomInput();
+    auto tensors_expected =
+        EvaluateNodes(item.graph, item.fetch, {{"input", input}});
+    auto tensors = EvaluateNodes(output, item.fetch, {{"input", input}});
+    EXPECT_EQ(1, tensors.size());
+    test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-5);
+  }
+}
+
+TEST_F(RemapperTest, FuseConv2DWithBias) {
+  GrapplerItem item;
+  BuildConv2DWithBias("", &item);
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_EQ(nullptr, FindNode(output, "conv"));
+  const NodeDef* fused = FindNode(output, "output");
+  ASSERT_NE(nullptr, fused);
+  EXPECT_EQ("_FusedConv2D", fused->op());
+  EXPECT_EQ(1, fused->attr().at("fused_ops").list().s_size());
+
+  const Tensor input = RandomInput();
+  auto tensors_expected =
+      EvaluateNodes(item.graph, item.fetch, {{"input", input}});
+  auto tensors = EvaluateNodes(output, item.fetch, {{"input", input}});
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-5);
+}
+
+TEST_F(RemapperTest, DontFuseFetchedConv2D) {
+  GrapplerItem item;
+  BuildConv2DWithBias("Relu", &item);
+  item.fetch.push_back("conv");
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  // The BiasAdd and Relu can't be fused without the Conv2D either.
+  ASSERT_NE(nullptr, FindNode(output, "conv"));
+  EXPECT_EQ("Conv2D", FindNode(output, "conv")->op());
+  EXPECT_EQ("Relu", FindNode(output, "output")->op());
+}
+
+TEST_F(RemapperTest, FuseConv2DWithBiasWhenBiasAddIsFetched) {
+  GrapplerItem item;
+  BuildConv2DWithBias("Relu", &item);
+  // The BiasAdd has a second use, so only Conv2D + BiasAdd can be fused.
+  item.fetch.push_back("bias_add");
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_EQ(nullptr, FindNode(output, "conv"));
+  EXPECT_EQ("_FusedConv2D", FindNode(output, "bias_add")->op());
+  EXPECT_EQ("Relu", FindNode(output, "output")->op());
+}
+
+TEST_F(RemapperTest, DontFuseConv2DOnGpu) {
+  GrapplerItem item;
+  BuildConv2DWithBias("Relu", &item);
+  for (NodeDef& node : *item.graph.mutable_node()) {
+    node.set_device("/job:localhost/replica:0/task:0/device:GPU:0");
+  }
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_EQ("Conv2D", FindNode(output, "conv")->op());
+  EXPECT_EQ("BiasAdd", FindNode(output, "bias_add")->op());
+}
+
+TEST_F(RemapperTest, DontFuseUnplacedConv2D) {
+  GrapplerItem item;
+  BuildConv2DWithBias("Relu", &item);
+  for (NodeDef& node : *item.graph.mutable_node()) {
+    node.clear_device();
+  }
+
+  // The nodes may still be placed on a GPU.
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_EQ("Conv2D", FindNode(output, "conv")->op());
+  EXPECT_EQ("BiasAdd", FindNode(output, "bias_add")->op());
+}
+
+TEST_F(RemapperTest, FuseMatMulWithBiasAndActivation) {
+  for (const string activation : {"", "Relu", "Relu6"}) {
+    GrapplerItem item;
+    BuildMatMulWithBias(activation, true, &item);
+
+    Remapper optimizer(RewriterConfig::ON);
+    GraphDef output;
+    TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+    EXPECT_EQ(nullptr, FindNode(output, "matmul"));
+    EXPECT_EQ(nullptr, FindNode(output, "bias_add"));
+    const NodeDef* fused = FindNode(output, "output");
+    ASSERT_NE(nullptr, fused);
+    EXPECT_EQ("_FusedMatMul", fused->op());
+    ASSERT_EQ(3, fused->input_size());
+    EXPECT_EQ("input", fused->input(0));
+    EXPECT_EQ("weights", fused->input(1));
+    EXPECT_EQ("bias", fused->input(2));
+    EXPECT_TRUE(fused->attr().at("b_is_constant").b());
+    EXPECT_FALSE(fused->attr().at("transpose_a").b());
+    const auto& fused_ops = fused->attr().at("fused_ops").list();
+    ASSERT_EQ(activation.empty() ? 1 : 2, fused_ops.s_size());
+    EXPECT_EQ("BiasAdd", fused_ops.s(0));
+    if (!activation.empty()) EXPECT_EQ(activation, fused_ops.s(1));
+
+    Tensor input(DT_FLOAT, TensorShape({3, 5}));
+    input.flat<float>().setRandom();
+    auto tensors_expected =
+        EvaluateNodes(item.graph, item.fetch, {{"input", input}});
+    auto tensors = EvaluateNodes(output, item.fetch, {{"input", input}});
+    EXPECT_EQ(1, tensors.size());
+    test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-5);
+  }
+}
+
+TEST_F(RemapperTest, FuseMatMulWithNonConstantWeights) {
+  GrapplerItem item;
+  BuildMatMulWithBias("Relu", false, &item);
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  const NodeDef* fused = FindNode(output, "output");
+  ASSERT_NE(nullptr, fused);
+  EXPECT_EQ("_FusedMatMul", fused->op());
+  EXPECT_FALSE(fused->attr().at("b_is_constant").b());
+
+  Tensor input(DT_FLOAT, TensorShape({3, 5}));
+  input.flat<float>().setRandom();
+  Tensor weights(DT_FLOAT, TensorShape({5, 4}));
+  weights.flat<float>().setRandom();
+  auto tensors_expected = EvaluateNodes(
+      item.graph, item.fetch, {{"input", input}, {"weights", weights}});
+  auto tensors = EvaluateNodes(output, item.fetch,
+                               {{"input", input}, {"weights", weights}});
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-5);
+}
+
+TEST_F(RemapperTest, FuseGeluIntoOneNode) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice(
+      "/job:localhost/replica:0/task:0/device:CPU:0");
+  auto x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                            ops::Placeholder::Shape({4, 16}));
+  // 0.5 * x * (1 + tanh(sqrt(2 / pi) * (x + 0.044715 * x^3)))
+  auto cube = ops::Pow(s.WithOpName("cube"), x, 3.0f);
+  auto inner = ops::Add(s.WithOpName("inner"), x,
+                        ops::Mul(s.WithOpName("scaled_cube"), 0.044715f, cube));
+  auto tanh = ops::Tanh(
+      s.WithOpName("tanh"),
+      ops::Mul(s.WithOpName("scaled_inner"), 0.7978845608f, inner));
+  auto half_x = ops::Mul(s.WithOpName("half_x"), 0.5f, x);
+  ops::Mul(s.WithOpName("output"), half_x,
+           ops::Add(s.WithOpName("one_plus_tanh"), 1.0f, tanh));
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"output"};
+
+  // Elementwise ops are only fused by the aggressive remapper.
+  GraphDef default_output;
+  TF_CHECK_OK(
+      Remapper(RewriterConfig::ON).Optimize(nullptr, item, &default_output));
+  EXPECT_EQ(0, CountOpNodes(default_output, "_FusedElementwise"));
+
+  Remapper optimizer(RewriterConfig::AGGRESSIVE);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  for (const string name : {"cube", "inner", "scaled_cube", "tanh",
+                            "scaled_inner", "half_x", "one_plus_tanh"}) {
+    EXPECT_EQ(nullptr, FindNode(output, name)) << name;
+  }
+  const NodeDef* fused = FindNode(output, "output");
+  ASSERT_NE(nullptr, fused);
+  EXPECT_EQ("_FusedElementwise", fused->op());
+  EXPECT_EQ(1, fused->attr().at("num_outputs").i());
+  EXPECT_EQ(8, fused->attr().at("fused_ops").list().s_size());
+  EXPECT_EQ("Mul", fused->attr().at("fused_ops").list().s(7));
+  // x and the five constants.
+  EXPECT_EQ(6, fused->attr().at("N").i());
+  EXPECT_EQ(6, fused->input_size());
+
+  Tensor x_t(DT_FLOAT, TensorShape({4, 16}));
+  x_t.flat<float>().setRandom();
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-6);
+}
+
+TEST_F(RemapperTest, FuseLstmCellWithTwoOutputs) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice(
+      "/job:localhost/replica:0/task:0/device:CPU:0");
+  auto gates = ops::Placeholder(s.WithOpName("gates"), DT_FLOAT,
+                                ops::Placeholder::Shape({4, 32}));
+  auto c_prev = ops::Placeholder(s.WithOpName("c_prev"), DT_FLOAT,
+                                 ops::Placeholder::Shape({4, 8}));
+  auto split = ops::Split(s.WithOpName("split"), 1, gates, 4);
+  auto forget = ops::Sigmoid(
+      s.WithOpName("forget"),
+      ops::Add(s.WithOpName("forget_bias"), split[2], 1.0f));
+  auto new_c = ops::Add(
+      s.WithOpName("new_c"), ops::Mul(s.WithOpName("keep"), c_prev, forget),
+      ops::Mul(s.WithOpName("write"),
+               ops::Sigmoid(s.WithOpName("input_gate"), split[0]),
+               ops::Tanh(s.WithOpName("candidate"), split[1])));
+  auto new_h = ops::Mul(s.WithOpName("new_h"),
+                        ops::Tanh(s.WithOpName("tanh_c"), new_c),
+                        ops::Sigmoid(s.WithOpName("output_gate"), split[3]));
+  ops::Identity(s.WithOpName("c"), new_c);
+  ops::Identity(s.WithOpName("h"), new_h);
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"c", "h"};
+
+  Remapper optimizer(RewriterConfig::AGGRESSIVE);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_EQ(nullptr, FindNode(output, "new_c"));
+  const NodeDef* fused = FindNode(output, "new_h");
+  ASSERT_NE(nullptr, fused);
+  EXPECT_EQ("_FusedElementwise", fused->op());
+  EXPECT_EQ(10, fused->attr().at("fused_ops").list().s_size());
+  EXPECT_EQ(2, fused->attr().at("num_outputs").i());
+  EXPECT_EQ("new_h", FindNode(output, "h")->input(0));
+  EXPECT_EQ("new_h:1", FindNode(output, "c")->input(0));
+
+  Tensor gates_t(DT_FLOAT, TensorShape({4, 32}));
+  gates_t.flat<float>().setRandom();
+  Tensor c_prev_t(DT_FLOAT, TensorShape({4, 8}));
+  c_prev_t.flat<float>().setRandom();
+  auto tensors_expected = EvaluateNodes(
+      item.graph, item.fetch, {{"gates", gates_t}, {"c_prev", c_prev_t}});
+  auto tensors = EvaluateNodes(output, item.fetch,
+                               {{"gates", gates_t}, {"c_prev", c_prev_t}});
+  EXPECT_EQ(2, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-6);
+  test::ExpectTensorNear<float>(tensors_expected[1], tensors[1], 1e-6);
+}
+
+TEST_F(RemapperTest, FuseElementwiseOnlyWithLeadingDimBroadcasts) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice(
+      "/job:localhost/replica:0/task:0/device:CPU:0");
+  auto x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                            ops::Placeholder::Shape({4, 8}));
+  auto col = ops::Placeholder(s.WithOpName("col"), DT_FLOAT,
+                              ops::Placeholder::Shape({4, 1}));
+  auto bias = ops::Const(s.WithOpName("bias"), 0.5f, {8});
+  // The bias broadcasts along the leading dimension, but the column doesn't.
+  auto biased = ops::Add(s.WithOpName("biased"), x, bias);
+  auto relu = ops::Relu(s.WithOpName("relu"), biased);
+  auto scaled = ops::Mul(s.WithOpName("scaled"), relu, col);
+  ops::Exp(s.WithOpName("output"), scaled);
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"output"};
+
+  Remapper optimizer(RewriterConfig::AGGRESSIVE);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_EQ(nullptr, FindNode(output, "biased"));
+  EXPECT_EQ("_FusedElementwise", FindNode(output, "relu")->op());
+  EXPECT_EQ("Mul", FindNode(output, "scaled")->op());
+  EXPECT_EQ("Exp", FindNode(output, "output")->op());
+
+  Tensor x_t(DT_FLOAT, TensorShape({4, 8}));
+  x_t.flat<float>().setRandom();
+  Tensor col_t(DT_FLOAT, TensorShape({4, 1}));
+  col_t.flat<float>().setRandom();
+  auto tensors_expected =
+      EvaluateNodes(item.graph, item.fetch, {{"x", x_t}, {"col", col_t}});
+  auto tensors =
+      EvaluateNodes(output, item.fetch, {{"x", x_t}, {"col", col_t}});
+  EXPECT_EQ(1, tensors.size());
+  test::ExpectTensorNear<float>(tensors_expected[0], tensors[0], 1e-6);
+}
+
+TEST_F(RemapperTest, DontFuseElementwiseOpsIntoACycle) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope().WithDevice(
+      "/job:localhost/replica:0/task:0/device:CPU:0");
+  auto x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                            ops::Placeholder::Shape({4, 4}));
+  auto relu = ops::Relu(s.WithOpName("relu"), x);
+  // Fusing relu and output would make the fused node feed the MatMul that
+  // feeds it.
+  auto matmul = ops::MatMul(s.WithOpName("matmul"), relu, x);
+  ops::Add(s.WithOpName("output"), relu, matmul);
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"output"};
+
+  Remapper optimizer(RewriterConfig::AGGRESSIVE);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_EQ("Relu", FindNode(output, "relu")->op());
+  EXPECT_EQ("Add", FindNode(output, "output")->op());
+}
+
 }  // namespace grappler
 }  // namespace tensorflow
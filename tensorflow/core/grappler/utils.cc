@@ -26,6 +26,7 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/scanner.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/notification.h"
+#include "tensorflow/core/util/device_name_utils.h"
 
 namespace tensorflow {
 namespace grappler {
@@ -298,6 +299,13 @@ DataType GetDataTypeFromAttr(const NodeDef& node, const string& attr_name) {
   return attr.type();
 }
 
+bool IsPlacedOnCpu(const NodeDef& node) {
+  DeviceNameUtils::ParsedName parsed_name;
+  return !node.device().empty() &&
+         DeviceNameUtils::ParseFullName(node.device(), &parsed_name) &&
+         parsed_name.has_type && parsed_name.type == DEVICE_CPU;
+}
+
 NodeDef* GetTailOfChain(const NodeDef& source, const NodeMap& node_map,
                         bool follow_control_input,
                         const std::function<bool(const NodeDef&)>& pred_fn) {
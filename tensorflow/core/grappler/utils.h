@@ -190,6 +190,10 @@ void DedupControlInputs(NodeDef* node);
 // doesn't exist, returns DT_INVALID.
 DataType GetDataTypeFromAttr(const NodeDef& node, const string& attr_name);
 
+// Returns true iff the node is explicitly placed on a CPU device. Nodes that
+// are not placed yet may still end up on another device.
+bool IsPlacedOnCpu(const NodeDef& node);
+
 // Returns the last node in the simple chain starting at source and traversing
 // through the input(0) edge from each node as long as the next node satisfies
 // the predicate given in pred_fn. If no nodes satisfy the predicate, &source
@@ -37,6 +37,7 @@ GrapplerTest::GrapplerTest() {
   cfg->set_function_optimization(RewriterConfig::OFF);
   cfg->set_layout_optimizer(RewriterConfig::OFF);
   cfg->set_debug_stripper(RewriterConfig::OFF);
+  cfg->set_remapping(RewriterConfig::OFF);
 }
 
 std::vector<Tensor> GrapplerTest::EvaluateNodes(
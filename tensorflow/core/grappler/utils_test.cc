@@ -333,6 +333,19 @@ TEST_F(UtilsTest, NumNonControlOutputs) {
   EXPECT_EQ(1, NumNonControlDataOutputs(*add_node, node_map));
 }
 
+TEST_F(UtilsTest, IsPlacedOnCpu) {
+  NodeDef node;
+  EXPECT_FALSE(IsPlacedOnCpu(node));
+  node.set_device("/job:localhost/replica:0/task:0/device:CPU:0");
+  EXPECT_TRUE(IsPlacedOnCpu(node));
+  node.set_device("/device:CPU:1");
+  EXPECT_TRUE(IsPlacedOnCpu(node));
+  node.set_device("/job:localhost/replica:0/task:0/device:GPU:0");
+  EXPECT_FALSE(IsPlacedOnCpu(node));
+  node.set_device("/job:localhost/replica:0/task:0");
+  EXPECT_FALSE(IsPlacedOnCpu(node));
+}
+
 TEST_F(UtilsTest, DeleteNodes) {}
 
 }  // namespace
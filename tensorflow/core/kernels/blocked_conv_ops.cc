@@ -0,0 +1,882 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Implements the CPU kernels of the ops on channel-blocked tensors (see
+// util/blocked_layout.h), which the grappler CpuLayoutOptimizer substitutes
+// for NHWC convolutions and pooling: _ToBlockedLayout, _FromBlockedLayout,
+// _ToBlockedFilter, _BlockedConv2D, _BlockedMaxPool and _BlockedAvgPool.
+//
+// Blocks of 8 or 16 channels fill whole SIMD registers, so the kernels
+// compute a direct convolution with the channels of a block in the lanes of
+// a register, without materializing the patches of the input.
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "third_party/eigen3/Eigen/Core"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/kernels/fused_bias_activation.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/util/blocked_layout.h"
+#include "tensorflow/core/util/padding.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+namespace {
+
+// The weights of the input blocks that a row of output is accumulated over
+// at a time take at most about this many bytes, to stay in the L1 cache
+// while they are applied to every pixel of the row.
+const int64 kL1WeightBytes = 16 * 1024;
+
+// The SIMD packet holding one block of B values of T, or the largest packet
+// that divides it.
+template <typename T, int B,
+          bool kFits = (Eigen::internal::packet_traits<T>::size <= B)>
+struct BlockPacket {
+  typedef typename Eigen::internal::packet_traits<T>::type type;
+};
+template <typename T, int B>
+struct BlockPacket<T, B, false> {
+  typedef typename Eigen::internal::packet_traits<T>::half type;
+};
+
+// A 2D convolution of a blocked input with a blocked filter.
+struct BlockedConv2DDimensions {
+  int64 batch;
+  int64 input_rows;
+  int64 input_cols;
+  int64 in_blocks;
+  int64 filter_rows;
+  int64 filter_cols;
+  int64 out_blocks;
+  int64 stride_rows;
+  int64 stride_cols;
+  int64 dilation_rows;
+  int64 dilation_cols;
+  int64 out_rows;
+  int64 out_cols;
+  // Padding before the first row and column.
+  int64 pad_rows;
+  int64 pad_cols;
+};
+
+// Number of SIMD registers that the register tiles of the convolution are
+// sized for.
+#ifdef EIGEN_VECTORIZE_AVX512
+const int kNumRegisters = 32;
+#else
+const int kNumRegisters = 16;
+#endif
+
+// Keeps compilers from folding the loads of a packet into each instruction
+// that uses it: the weights are reused for every pixel of a tile, and
+// reloading them would make the loads rather than the multiplications the
+// bottleneck.
+template <typename Packet>
+EIGEN_ALWAYS_INLINE void KeepInRegister(Packet* packet) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __asm__("" : "+v"(*packet));
+#endif
+}
+
+// Calls f(0), ..., f(N - 1) with compile-time constant arguments, so that
+// the arrays of packets that f indexes with them can stay in registers.
+template <int N>
+struct Unroll {
+  template <typename F>
+  static EIGEN_ALWAYS_INLINE void Run(const F& f) {
+    Unroll<N - 1>::Run(f);
+    f(std::integral_constant<int, N - 1>());
+  }
+};
+template <>
+struct Unroll<0> {
+  template <typename F>
+  static EIGEN_ALWAYS_INLINE void Run(const F& f) {}
+};
+
+// Computes rows of the output of a blocked convolution with B channels per
+// block, whose input has been padded with the columns that the windows
+// overlap (pad_cols is 0). A tile of up to kTilePixels output pixels of
+// kTileBlocks blocks of output channels is accumulated in registers over the
+// input channels and the filter window: each input value is broadcast once
+// and multiplied with the weights of all the output channels of the tile.
+template <typename T, int B>
+class BlockedConv2DRows {
+ public:
+  typedef typename BlockPacket<T, B>::type Packet;
+  static const int kPacketSize = Eigen::internal::unpacket_traits<Packet>::size;
+  // Packets per block of channels.
+  static const int kBlockPackets = B / kPacketSize;
+  static const int kTileBlocks =
+      kBlockPackets >= kNumRegisters / 8 ? 1
+                                         : kNumRegisters / 8 / kBlockPackets;
+  static const int kTilePackets = kTileBlocks * kBlockPackets;
+  // Leaves registers for the weights and a broadcast input.
+  static const int kTilePixels =
+      kTilePackets * 2 + 2 >= kNumRegisters
+          ? 1
+          : (kNumRegisters - kTilePackets - 2) / kTilePackets;
+
+  BlockedConv2DRows(const T* input, const T* filter, const T* bias,
+                    const BlockedConv2DDimensions& dims,
+                    FusedActivation activation, T* output)
+      : input_(input),
+        filter_(filter),
+        bias_(bias),
+        dims_(dims),
+        activation_(activation),
+        output_(output) {
+    filter_block_size_ =
+        dims.in_blocks * dims.filter_rows * dims.filter_cols * B * B;
+    const int64 block_weight_bytes =
+        kTileBlocks * dims.filter_rows * dims.filter_cols * B * B * sizeof(T);
+    blocks_per_pass_ = std::max<int64>(1, kL1WeightBytes / block_weight_bytes);
+  }
+
+  // Number of units of work: rows of output of a tile of blocks.
+  int64 num_rows() const {
+    return dims_.batch * num_groups() * dims_.out_rows;
+  }
+
+  // Computes the rows [begin, end) of the flattened [batch, groups of
+  // kTileBlocks output blocks, out_rows] output.
+  void Compute(int64 begin, int64 end) const {
+    for (int64 row = begin; row < end; ++row) {
+      const int64 out_row = row % dims_.out_rows;
+      const int64 group = (row / dims_.out_rows) % num_groups();
+      const int64 batch = row / (dims_.out_rows * num_groups());
+      const int64 out_block = group * kTileBlocks;
+      if (out_block + kTileBlocks <= dims_.out_blocks) {
+        ComputeRow<kTileBlocks>(batch, out_block, out_row);
+      } else {
+        for (int64 b = out_block; b < dims_.out_blocks; ++b) {
+          ComputeRow<1>(batch, b, out_row);
+        }
+      }
+    }
+  }
+
+ private:
+  // A pass over a range of input blocks for one row of output.
+  struct Pass {
+    int64 batch;
+    int64 out_block;
+    int64 out_row;
+    int64 first_in_row;
+    int64 f_row_begin;
+    int64 f_row_end;
+    int64 in_block_begin;
+    int64 in_block_end;
+    // Whether the pass starts from the bias, and applies the activation.
+    bool first;
+    bool last;
+  };
+
+  int64 num_groups() const {
+    return (dims_.out_blocks + kTileBlocks - 1) / kTileBlocks;
+  }
+
+  // Computes a row of kBlocks output blocks.
+  template <int kBlocks>
+  void ComputeRow(int64 batch, int64 out_block, int64 out_row) const {
+    // The filter rows that fall inside the input.
+    const int64 first_in_row = out_row * dims_.stride_rows - dims_.pad_rows;
+    int64 f_row_begin = 0;
+    while (f_row_begin < dims_.filter_rows &&
+           first_in_row + f_row_begin * dims_.dilation_rows < 0) {
+      ++f_row_begin;
+    }
+    int64 f_row_end = dims_.filter_rows;
+    while (f_row_end > f_row_begin &&
+           first_in_row + (f_row_end - 1) * dims_.dilation_rows >=
+               dims_.input_rows) {
+      --f_row_end;
+    }
+
+    for (int64 in_block = 0; in_block < dims_.in_blocks;
+         in_block += blocks_per_pass_) {
+      Pass pass;
+      pass.batch = batch;
+      pass.out_block = out_block;
+      pass.out_row = out_row;
+      pass.first_in_row = first_in_row;
+      pass.f_row_begin = f_row_begin;
+      pass.f_row_end = f_row_end;
+      pass.in_block_begin = in_block;
+      pass.in_block_end =
+          std::min(dims_.in_blocks, in_block + blocks_per_pass_);
+      pass.first = in_block == 0;
+      pass.last = pass.in_block_end == dims_.in_blocks;
+
+      // Splits the row in tiles of as even widths as possible.
+      const int64 num_tiles = (dims_.out_cols + kTilePixels - 1) / kTilePixels;
+      const int64 min_width = dims_.out_cols / num_tiles;
+      const int64 num_wider = dims_.out_cols % num_tiles;
+      int64 col = 0;
+      for (int64 tile = 0; tile < num_tiles; ++tile) {
+        const int width = min_width + (tile < num_wider ? 1 : 0);
+        TileOfWidth<kTilePixels, kBlocks>::Run(*this, pass, col, width);
+        col += width;
+      }
+    }
+  }
+
+  // Calls Tile<width, kBlocks> for a width of at most kMaxPixels.
+  template <int kMaxPixels, int kBlocks>
+  struct TileOfWidth {
+    static void Run(const BlockedConv2DRows& rows, const Pass& pass,
+                    int64 col, int width) {
+      if (width == kMaxPixels) {
+        rows.template Tile<kMaxPixels, kBlocks>(pass, col);
+      } else {
+        TileOfWidth<kMaxPixels - 1, kBlocks>::Run(rows, pass, col, width);
+      }
+    }
+  };
+  template <int kBlocks>
+  struct TileOfWidth<0, kBlocks> {
+    static void Run(const BlockedConv2DRows& rows, const Pass& pass,
+                    int64 col, int width) {}
+  };
+
+  // Functors for Unroll, which calls them with the index of a packet or of a
+  // pixel as a std::integral_constant. Packet j of a pixel holds channels
+  // [j * kPacketSize, ...) of the kBlocks * B channels of a tile, where
+  // consecutive blocks are block_stride values apart.
+  static EIGEN_ALWAYS_INLINE int64 PacketOffset(int j, int64 block_stride) {
+    return j / kBlockPackets * block_stride + j % kBlockPackets * kPacketSize;
+  }
+
+  // Loads the packets of a pixel.
+  struct LoadPackets {
+    Packet* packets;
+    const T* data;
+    int64 block_stride;
+    bool keep_in_register;
+
+    template <int J>
+    EIGEN_ALWAYS_INLINE void operator()(std::integral_constant<int, J>) const {
+      packets[J] = Eigen::internal::ploadu<Packet>(
+          data + PacketOffset(J, block_stride));
+      if (keep_in_register) KeepInRegister(&packets[J]);
+    }
+  };
+
+  // Loads the packets of the pixels of a tile, which are pixel_stride values
+  // apart.
+  template <int kPackets>
+  struct LoadPixels {
+    Packet (*acc)[kPackets];
+    const T* data;
+    int64 pixel_stride;
+    int64 block_stride;
+
+    template <int P>
+    EIGEN_ALWAYS_INLINE void operator()(std::integral_constant<int, P>) const {
+      Unroll<kPackets>::Run(
+          LoadPackets{acc[P], data + P * pixel_stride, block_stride, false});
+    }
+  };
+
+  // Stores the packets of a pixel, after the activation if `activate`.
+  struct StorePackets {
+    const BlockedConv2DRows* rows;
+    const Packet* packets;
+    T* data;
+    int64 block_stride;
+    bool activate;
+
+    template <int J>
+    EIGEN_ALWAYS_INLINE void operator()(std::integral_constant<int, J>) const {
+      Eigen::internal::pstoreu(
+          data + PacketOffset(J, block_stride),
+          activate ? rows->Activate(packets[J]) : packets[J]);
+    }
+  };
+
+  // Stores the packets of the pixels of a tile.
+  template <int kPackets>
+  struct StorePixels {
+    const BlockedConv2DRows* rows;
+    const Packet (*acc)[kPackets];
+    T* data;
+    int64 block_stride;
+    bool activate;
+
+    template <int P>
+    EIGEN_ALWAYS_INLINE void operator()(std::integral_constant<int, P>) const {
+      Unroll<kPackets>::Run(StorePackets{rows, acc[P], data + P * B,
+                                         block_stride, activate});
+    }
+  };
+
+  // Accumulates the products of a broadcast input value with the weights.
+  struct MultiplyPackets {
+    Packet* acc;
+    const Packet* weights;
+    Packet x;
+
+    template <int J>
+    EIGEN_ALWAYS_INLINE void operator()(std::integral_constant<int, J>) const {
+      acc[J] = Eigen::internal::pmadd(x, weights[J], acc[J]);
+    }
+  };
+
+  // Broadcasts an input value of each pixel of a tile, and accumulates its
+  // products with the weights.
+  template <int kPackets>
+  struct MultiplyPixels {
+    Packet (*acc)[kPackets];
+    const Packet* weights;
+    const T* input;
+    int64 pixel_stride;
+
+    template <int P>
+    EIGEN_ALWAYS_INLINE void operator()(std::integral_constant<int, P>) const {
+      const Packet x =
+          Eigen::internal::pload1<Packet>(input + P * pixel_stride);
+      Unroll<kPackets>::Run(MultiplyPackets{acc[P], weights, x});
+    }
+  };
+
+  // Accumulates the output pixels [col, col + kPixels) of kBlocks output
+  // blocks.
+  template <int kPixels, int kBlocks>
+  void Tile(const Pass& pass, int64 col) const {
+    static const int kPackets = kBlocks * kBlockPackets;
+
+    const int64 out_block_size = dims_.out_rows * dims_.out_cols * B;
+    T* output = output_ +
+                (pass.batch * dims_.out_blocks + pass.out_block) *
+                    out_block_size +
+                (pass.out_row * dims_.out_cols + col) * B;
+    Packet acc[kPixels][kPackets];
+    if (pass.first) {
+      Unroll<kPixels>::Run(LoadPixels<kPackets>{
+          acc, bias_ + pass.out_block * B, /*pixel_stride=*/0, B});
+    } else {
+      Unroll<kPixels>::Run(
+          LoadPixels<kPackets>{acc, output, B, out_block_size});
+    }
+
+    const int64 pixel_stride = dims_.stride_cols * B;
+    const int64 first_in_col = col * dims_.stride_cols;
+    const int64 filter_block_size = filter_block_size_;
+    for (int64 in_block = pass.in_block_begin; in_block < pass.in_block_end;
+         ++in_block) {
+      const T* block_filter =
+          filter_ + pass.out_block * filter_block_size +
+          in_block * dims_.filter_rows * dims_.filter_cols * B * B;
+      for (int64 f_row = pass.f_row_begin; f_row < pass.f_row_end; ++f_row) {
+        const int64 in_row = pass.first_in_row + f_row * dims_.dilation_rows;
+        const T* input_row =
+            input_ + ((pass.batch * dims_.in_blocks + in_block) *
+                          dims_.input_rows +
+                      in_row) *
+                         dims_.input_cols * B;
+        for (int64 f_col = 0; f_col < dims_.filter_cols; ++f_col) {
+          const T* weights =
+              block_filter + (f_row * dims_.filter_cols + f_col) * B * B;
+          const T* input =
+              input_row + (first_in_col + f_col * dims_.dilation_cols) * B;
+          for (int i = 0; i < B; ++i, weights += B, ++input) {
+            Packet w[kPackets];
+            Unroll<kPackets>::Run(
+                LoadPackets{w, weights, filter_block_size, true});
+            Unroll<kPixels>::Run(
+                MultiplyPixels<kPackets>{acc, w, input, pixel_stride});
+          }
+        }
+      }
+    }
+
+    Unroll<kPixels>::Run(StorePixels<kPackets>{this, acc, output,
+                                               out_block_size, pass.last});
+  }
+
+  EIGEN_ALWAYS_INLINE Packet Activate(Packet value) const {
+    using Eigen::internal::pmax;
+    using Eigen::internal::pmin;
+    using Eigen::internal::pset1;
+    switch (activation_) {
+      case FusedActivation::kNone:
+        return value;
+      case FusedActivation::kRelu:
+        return pmax(value, pset1<Packet>(static_cast<T>(0)));
+      case FusedActivation::kRelu6:
+        return pmin(pmax(value, pset1<Packet>(static_cast<T>(0))),
+                    pset1<Packet>(static_cast<T>(6)));
+    }
+    return value;
+  }
+
+  const T* input_;
+  const T* filter_;
+  const T* bias_;
+  const BlockedConv2DDimensions dims_;
+  const FusedActivation activation_;
+  T* output_;
+  // Elements of the filter per output block.
+  int64 filter_block_size_;
+  int64 blocks_per_pass_;
+};
+
+// Copies rows [begin, end) of the blocked `input`, seen as [rows, input_cols,
+// block_size], to `padded` with `pad_cols` columns of zeros before each row
+// and zeros after them up to `padded_cols` columns.
+template <typename T>
+void PadBlockedColumns(const T* input, int64 input_cols, int64 block_size,
+                       int64 pad_cols, int64 padded_cols, int64 begin,
+                       int64 end, T* padded) {
+  for (int64 row = begin; row < end; ++row) {
+    const T* src = input + row * input_cols * block_size;
+    T* dst = padded + row * padded_cols * block_size;
+    std::fill(dst, dst + pad_cols * block_size, static_cast<T>(0));
+    std::copy_n(src, input_cols * block_size, dst + pad_cols * block_size);
+    std::fill(dst + (pad_cols + input_cols) * block_size,
+              dst + padded_cols * block_size, static_cast<T>(0));
+  }
+}
+
+template <typename T, int B>
+void BlockedConv2D(const DeviceBase::CpuWorkerThreads& workers, const T* input,
+                   const T* filter, const T* bias,
+                   const BlockedConv2DDimensions& dims,
+                   FusedActivation activation, T* output) {
+  typedef BlockedConv2DRows<T, B> Rows;
+  const Rows rows(input, filter, bias, dims, activation, output);
+  const int64 cost_per_row = 2 * Rows::kTileBlocks * dims.out_cols *
+                             dims.in_blocks * dims.filter_rows *
+                             dims.filter_cols * B * B;
+  Shard(workers.num_threads, workers.workers, rows.num_rows(), cost_per_row,
+        [&rows](int64 begin, int64 end) { rows.Compute(begin, end); });
+}
+
+// Returns OK if the 5D `tensor` is a blocked activation with a block size
+// that the kernels support.
+Status CheckBlockedActivation(const Tensor& tensor, const char* name) {
+  if (tensor.dims() != 5) {
+    return errors::InvalidArgument(name, " must be 5-dimensional: ",
+                                   tensor.shape().DebugString());
+  }
+  const int64 block_size = tensor.dim_size(4);
+  if (block_size != 8 && block_size != 16) {
+    return errors::Unimplemented("Unsupported channel block size ",
+                                 block_size, ", must be 8 or 16");
+  }
+  return Status::OK();
+}
+
+// Parses the strides, dilations or pooling window of a windowed op on
+// blocked tensors, which are given in NHWC order like those of the ops they
+// replace, into their rows and cols.
+Status GetSpatialAttr(OpKernelConstruction* context, const string& name,
+                      int64* rows, int64* cols) {
+  std::vector<int32> values;
+  TF_RETURN_IF_ERROR(context->GetAttr(name, &values));
+  if (values.size() != 4) {
+    return errors::InvalidArgument(name, " must specify 4 dimensions");
+  }
+  if (values[0] != 1 || values[3] != 1) {
+    return errors::Unimplemented(
+        name, " in the batch and depth dimensions are not supported");
+  }
+  if (values[1] <= 0 || values[2] <= 0) {
+    return errors::InvalidArgument(name, " must be positive");
+  }
+  *rows = values[1];
+  *cols = values[2];
+  return Status::OK();
+}
+
+}  // namespace
+
+// Converts an NHWC activation to its blocked layout.
+template <typename T>
+class ToBlockedLayoutOp : public OpKernel {
+ public:
+  explicit ToBlockedLayoutOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("block_size", &block_size_));
+    OP_REQUIRES(context, block_size_ == 8 || block_size_ == 16,
+                errors::Unimplemented("Unsupported channel block size ",
+                                      block_size_, ", must be 8 or 16"));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& input = context->input(0);
+    OP_REQUIRES(context, input.dims() == 4,
+                errors::InvalidArgument("input must be 4-dimensional: ",
+                                        input.shape().DebugString()));
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(
+                                0, BlockedActivationShape(input.shape(),
+                                                          block_size_),
+                                &output));
+    const int64 pixels = input.dim_size(1) * input.dim_size(2);
+    const int64 channels = input.dim_size(3);
+    const T* in = input.flat<T>().data();
+    T* out = output->flat<T>().data();
+    const auto& workers = *context->device()->tensorflow_cpu_worker_threads();
+    Shard(workers.num_threads, workers.workers, input.dim_size(0) * pixels,
+          2 * channels, [&](int64 begin, int64 end) {
+            ToBlockedActivation(in, pixels, channels, block_size_, begin, end,
+                                out);
+          });
+  }
+
+ private:
+  int64 block_size_;
+};
+
+// Converts a blocked activation back to NHWC.
+template <typename T>
+class FromBlockedLayoutOp : public OpKernel {
+ public:
+  explicit FromBlockedLayoutOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("channels", &channels_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& input = context->input(0);
+    OP_REQUIRES_OK(context, CheckBlockedActivation(input, "input"));
+    const int64 block_size = input.dim_size(4);
+    OP_REQUIRES(context,
+                NumChannelBlocks(channels_, block_size) == input.dim_size(1),
+                errors::InvalidArgument("Input of shape ",
+                                        input.shape().DebugString(),
+                                        " doesn't hold ", channels_,
+                                        " channels"));
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(
+                       0, UnblockedActivationShape(input.shape(), channels_),
+                       &output));
+    const int64 pixels = input.dim_size(2) * input.dim_size(3);
+    const T* in = input.flat<T>().data();
+    T* out = output->flat<T>().data();
+    const auto& workers = *context->device()->tensorflow_cpu_worker_threads();
+    Shard(workers.num_threads, workers.workers, input.dim_size(0) * pixels,
+          2 * channels_, [&](int64 begin, int64 end) {
+            FromBlockedActivation(in, pixels, channels_, block_size, begin,
+                                  end, out);
+          });
+  }
+
+ private:
+  int64 channels_;
+};
+
+// Converts an HWIO filter to its blocked layout. The grappler pass applies
+// it to constant filters at optimization time; it only runs as a kernel for
+// filters computed by the graph.
+template <typename T>
+class ToBlockedFilterOp : public OpKernel {
+ public:
+  explicit ToBlockedFilterOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("block_size", &block_size_));
+    OP_REQUIRES(context, block_size_ == 8 || block_size_ == 16,
+                errors::Unimplemented("Unsupported channel block size ",
+                                      block_size_, ", must be 8 or 16"));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    Tensor output;
+    OP_REQUIRES_OK(context,
+                   ToBlockedFilter(context->input(0), block_size_, &output));
+    context->set_output(0, output);
+  }
+
+ private:
+  int64 block_size_;
+};
+
+// Convolves a blocked input with a blocked filter, optionally followed by a
+// bias addition and an activation as in _FusedConv2D.
+template <typename T>
+class BlockedConv2DOp : public OpKernel {
+ public:
+  explicit BlockedConv2DOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, GetSpatialAttr(context, "strides", &stride_rows_,
+                                           &stride_cols_));
+    OP_REQUIRES_OK(context, GetSpatialAttr(context, "dilations",
+                                           &dilation_rows_, &dilation_cols_));
+    OP_REQUIRES_OK(context, context->GetAttr("padding", &padding_));
+    std::vector<string> fused_ops;
+    OP_REQUIRES_OK(context, context->GetAttr("fused_ops", &fused_ops));
+    int num_args;
+    OP_REQUIRES_OK(context, context->GetAttr("num_args", &num_args));
+    has_bias_ = !fused_ops.empty();
+    activation_ = FusedActivation::kNone;
+    if (has_bias_) {
+      OP_REQUIRES_OK(context,
+                     ParseFusedBiasActivation(fused_ops, &activation_));
+    }
+    OP_REQUIRES(context, num_args == (has_bias_ ? 1 : 0),
+                errors::InvalidArgument("Expected ", has_bias_ ? 1 : 0,
+                                        " extra arguments, got ", num_args));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    // [batch, in_blocks, in_rows, in_cols, block_size]
+    const Tensor& input = context->input(0);
+    // [out_blocks, in_blocks, filter_rows, filter_cols, block_size,
+    //  block_size]
+    const Tensor& filter = context->input(1);
+    OP_REQUIRES_OK(context, CheckBlockedActivation(input, "input"));
+    const int64 block_size = input.dim_size(4);
+    OP_REQUIRES(context,
+                filter.dims() == 6 && filter.dim_size(1) == input.dim_size(1) &&
+                    filter.dim_size(4) == block_size &&
+                    filter.dim_size(5) == block_size,
+                errors::InvalidArgument(
+                    "filter of shape ", filter.shape().DebugString(),
+                    " doesn't match the blocked input of shape ",
+                    input.shape().DebugString()));
+
+    BlockedConv2DDimensions dims;
+    dims.batch = input.dim_size(0);
+    dims.in_blocks = input.dim_size(1);
+    dims.input_rows = input.dim_size(2);
+    dims.input_cols = input.dim_size(3);
+    dims.out_blocks = filter.dim_size(0);
+    dims.filter_rows = filter.dim_size(2);
+    dims.filter_cols = filter.dim_size(3);
+    dims.stride_rows = stride_rows_;
+    dims.stride_cols = stride_cols_;
+    dims.dilation_rows = dilation_rows_;
+    dims.dilation_cols = dilation_cols_;
+    OP_REQUIRES_OK(context,
+                   GetWindowedOutputSizeV2(dims.input_rows, dims.filter_rows,
+                                           dims.dilation_rows, dims.stride_rows,
+                                           padding_, &dims.out_rows,
+                                           &dims.pad_rows));
+    OP_REQUIRES_OK(context,
+                   GetWindowedOutputSizeV2(dims.input_cols, dims.filter_cols,
+                                           dims.dilation_cols, dims.stride_cols,
+                                           padding_, &dims.out_cols,
+                                           &dims.pad_cols));
+
+    // The bias may leave out the padding channels of the last block.
+    const int64 out_depth = dims.out_blocks * block_size;
+    std::vector<T> bias(out_depth, static_cast<T>(0));
+    if (has_bias_) {
+      const Tensor& bias_arg = context->input(2);
+      OP_REQUIRES(context,
+                  TensorShapeUtils::IsVector(bias_arg.shape()) &&
+                      bias_arg.dim_size(0) <= out_depth &&
+                      bias_arg.dim_size(0) > out_depth - block_size,
+                  errors::InvalidArgument(
+                      "bias must be a vector of the filter's out depth ",
+                      out_depth, ", got shape ",
+                      bias_arg.shape().DebugString()));
+      std::copy_n(bias_arg.flat<T>().data(), bias_arg.dim_size(0),
+                  bias.begin());
+    }
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(
+                       0,
+                       TensorShape({dims.batch, dims.out_blocks, dims.out_rows,
+                                    dims.out_cols, block_size}),
+                       &output));
+    if (output->NumElements() == 0) return;
+
+    const auto& workers = *context->device()->tensorflow_cpu_worker_threads();
+    const T* in = input.flat<T>().data();
+    // Pads the input columns once, rather than checking the bounds of every
+    // window.
+    const int64 window_cols = (dims.filter_cols - 1) * dims.dilation_cols + 1;
+    const int64 padded_cols =
+        std::max(dims.input_cols + dims.pad_cols,
+                 (dims.out_cols - 1) * dims.stride_cols + window_cols);
+    Tensor padded;
+    if (padded_cols != dims.input_cols) {
+      const int64 rows = dims.batch * dims.in_blocks * dims.input_rows;
+      OP_REQUIRES_OK(context,
+                     context->allocate_temp(
+                         DataTypeToEnum<T>::value,
+                         TensorShape({rows, padded_cols, block_size}),
+                         &padded));
+      T* padded_data = padded.flat<T>().data();
+      Shard(workers.num_threads, workers.workers, rows,
+            2 * padded_cols * block_size, [&](int64 begin, int64 end) {
+              PadBlockedColumns(in, dims.input_cols, block_size,
+                                dims.pad_cols, padded_cols, begin, end,
+                                padded_data);
+            });
+      in = padded_data;
+      dims.input_cols = padded_cols;
+      dims.pad_cols = 0;
+    }
+    const T* f = filter.flat<T>().data();
+    T* out = output->flat<T>().data();
+    if (block_size == 8) {
+      BlockedConv2D<T, 8>(workers, in, f, bias.data(), dims, activation_, out);
+    } else {
+      BlockedConv2D<T, 16>(workers, in, f, bias.data(), dims, activation_,
+                           out);
+    }
+  }
+
+ private:
+  int64 stride_rows_;
+  int64 stride_cols_;
+  int64 dilation_rows_;
+  int64 dilation_cols_;
+  Padding padding_;
+  bool has_bias_;
+  FusedActivation activation_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(BlockedConv2DOp);
+};
+
+// Max or average pooling over the rows and columns of a blocked input. As
+// with AvgPool, averages only count the pixels of the window that are inside
+// the input.
+template <typename T, bool kMax>
+class BlockedPoolOp : public OpKernel {
+ public:
+  explicit BlockedPoolOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, GetSpatialAttr(context, "ksize", &window_rows_,
+                                           &window_cols_));
+    OP_REQUIRES_OK(context, GetSpatialAttr(context, "strides", &stride_rows_,
+                                           &stride_cols_));
+    OP_REQUIRES_OK(context, context->GetAttr("padding", &padding_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& input = context->input(0);
+    OP_REQUIRES_OK(context, CheckBlockedActivation(input, "input"));
+    const int64 block_size = input.dim_size(4);
+    const int64 input_rows = input.dim_size(2);
+    const int64 input_cols = input.dim_size(3);
+    int64 out_rows, out_cols, pad_rows, pad_cols;
+    OP_REQUIRES_OK(context,
+                   GetWindowedOutputSize(input_rows, window_rows_, stride_rows_,
+                                         padding_, &out_rows, &pad_rows));
+    OP_REQUIRES_OK(context,
+                   GetWindowedOutputSize(input_cols, window_cols_, stride_cols_,
+                                         padding_, &out_cols, &pad_cols));
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(
+                                0,
+                                TensorShape({input.dim_size(0),
+                                             input.dim_size(1), out_rows,
+                                             out_cols, block_size}),
+                                &output));
+    if (output->NumElements() == 0) return;
+
+    const T* in = input.flat<T>().data();
+    T* out = output->flat<T>().data();
+    // Each unit of work is a row of output of one block of channels, which
+    // reads from the same block of input.
+    auto pool_rows = [&](int64 begin, int64 end) {
+      std::vector<T> acc(block_size);
+      for (int64 row = begin; row < end; ++row) {
+        const int64 out_row = row % out_rows;
+        const int64 plane = row / out_rows;
+        const T* input_plane =
+            in + plane * input_rows * input_cols * block_size;
+        T* output_row = out + row * out_cols * block_size;
+        const int64 row_begin =
+            std::max<int64>(0, out_row * stride_rows_ - pad_rows);
+        const int64 row_end = std::min(
+            input_rows, out_row * stride_rows_ - pad_rows + window_rows_);
+        for (int64 out_col = 0; out_col < out_cols; ++out_col) {
+          const int64 col_begin =
+              std::max<int64>(0, out_col * stride_cols_ - pad_cols);
+          const int64 col_end = std::min(
+              input_cols, out_col * stride_cols_ - pad_cols + window_cols_);
+          std::fill(acc.begin(), acc.end(),
+                    kMax ? Eigen::NumTraits<T>::lowest() : static_cast<T>(0));
+          for (int64 r = row_begin; r < row_end; ++r) {
+            const T* input_row = input_plane + r * input_cols * block_size;
+            for (int64 c = col_begin; c < col_end; ++c) {
+              const T* pixel = input_row + c * block_size;
+              for (int64 i = 0; i < block_size; ++i) {
+                acc[i] = kMax ? std::max(acc[i], pixel[i]) : acc[i] + pixel[i];
+              }
+            }
+          }
+          T* output_pixel = output_row + out_col * block_size;
+          if (kMax) {
+            std::copy(acc.begin(), acc.end(), output_pixel);
+          } else {
+            const T count = static_cast<T>(
+                std::max<int64>(1, (row_end - row_begin) *
+                                       (col_end - col_begin)));
+            for (int64 i = 0; i < block_size; ++i) {
+              output_pixel[i] = acc[i] / count;
+            }
+          }
+        }
+      }
+    };
+    const auto& workers = *context->device()->tensorflow_cpu_worker_threads();
+    Shard(workers.num_threads, workers.workers,
+          input.dim_size(0) * input.dim_size(1) * out_rows,
+          out_cols * window_rows_ * window_cols_ * block_size, pool_rows);
+  }
+
+ private:
+  int64 window_rows_;
+  int64 window_cols_;
+  int64 stride_rows_;
+  int64 stride_cols_;
+  Padding padding_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(BlockedPoolOp);
+};
+
+#define REGISTER_KERNELS(T)                                                \
+  REGISTER_KERNEL_BUILDER(                                                 \
+      Name("_ToBlockedLayout").Device(DEVICE_CPU).TypeConstraint<T>("T"),  \
+      ToBlockedLayoutOp<T>);                                               \
+  REGISTER_KERNEL_BUILDER(                                                 \
+      Name("_FromBlockedLayout").Device(DEVICE_CPU).TypeConstraint<T>("T"), \
+      FromBlockedLayoutOp<T>);                                             \
+  REGISTER_KERNEL_BUILDER(                                                 \
+      Name("_ToBlockedFilter").Device(DEVICE_CPU).TypeConstraint<T>("T"),  \
+      ToBlockedFilterOp<T>);                                               \
+  REGISTER_KERNEL_BUILDER(                                                 \
+      Name("_BlockedConv2D").Device(DEVICE_CPU).TypeConstraint<T>("T"),    \
+      BlockedConv2DOp<T>);                                                 \
+  REGISTER_KERNEL_BUILDER(                                                 \
+      Name("_BlockedMaxPool").Device(DEVICE_CPU).TypeConstraint<T>("T"),   \
+      BlockedPoolOp<T, true>);                                             \
+  REGISTER_KERNEL_BUILDER(                                                 \
+      Name("_BlockedAvgPool").Device(DEVICE_CPU).TypeConstraint<T>("T"),   \
+      BlockedPoolOp<T, false>);
+
+TF_CALL_float(REGISTER_KERNELS);
+TF_CALL_double(REGISTER_KERNELS);
+#undef REGISTER_KERNELS
+
+}  // namespace tensorflow
@@ -0,0 +1,380 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/cc/ops/const_op.h"
+#include "tensorflow/cc/ops/nn_ops.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/protobuf/rewriter_config.pb.h"
+#include "tensorflow/core/public/session.h"
+#include "tensorflow/core/util/blocked_layout.h"
+
+namespace tensorflow {
+namespace {
+
+Tensor Blocked(const Tensor& nhwc, int block_size) {
+  Tensor blocked(DT_FLOAT, BlockedActivationShape(nhwc.shape(), block_size));
+  const int64 pixels = nhwc.dim_size(1) * nhwc.dim_size(2);
+  ToBlockedActivation(nhwc.flat<float>().data(), pixels, nhwc.dim_size(3),
+                      block_size, 0, nhwc.dim_size(0) * pixels,
+                      blocked.flat<float>().data());
+  return blocked;
+}
+
+Tensor Unblocked(const Tensor& blocked, int channels) {
+  Tensor nhwc(DT_FLOAT, UnblockedActivationShape(blocked.shape(), channels));
+  const int64 pixels = blocked.dim_size(2) * blocked.dim_size(3);
+  FromBlockedActivation(blocked.flat<float>().data(), pixels, channels,
+                        blocked.dim_size(4), 0, blocked.dim_size(0) * pixels,
+                        nhwc.flat<float>().data());
+  return nhwc;
+}
+
+// Runs `output` of `root` in a session that doesn't rewrite the graph.
+Tensor RunReference(const Scope& root, const Output& output) {
+  GraphDef graph;
+  TF_CHECK_OK(root.ToGraphDef(&graph));
+  SessionOptions options;
+  options.config.mutable_graph_options()
+      ->mutable_rewrite_options()
+      ->set_remapping(RewriterConfig::OFF);
+  std::unique_ptr<Session> session(NewSession(options));
+  TF_CHECK_OK(session->Create(graph));
+  std::vector<Tensor> outputs;
+  TF_CHECK_OK(session->Run({}, {output.node()->name()}, {}, &outputs));
+  return outputs[0];
+}
+
+class BlockedLayoutOpsTest : public OpsTestBase {};
+
+TEST_F(BlockedLayoutOpsTest, ToAndFromBlockedLayout) {
+  TF_ASSERT_OK(NodeDefBuilder("to_blocked", "_ToBlockedLayout")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("block_size", 8)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  // [1, 1, 2, 10]: two pixels of 10 channels.
+  AddInputFromArray<float>(TensorShape({1, 1, 2, 10}),
+                           {0, 1, 2, 3, 4, 5, 6, 7, 8, 9,  //
+                            10, 11, 12, 13, 14, 15, 16, 17, 18, 19});
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected(DT_FLOAT, TensorShape({1, 2, 1, 2, 8}));
+  test::FillValues<float>(&expected,
+                          {0, 1, 2, 3, 4, 5, 6, 7,          //
+                           10, 11, 12, 13, 14, 15, 16, 17,  //
+                           8, 9, 0, 0, 0, 0, 0, 0,          //
+                           18, 19, 0, 0, 0, 0, 0, 0});
+  test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+
+  Tensor unblocked = Unblocked(*GetOutput(0), 10);
+  test::ExpectTensorEqual<float>(
+      test::AsTensor<float>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9,  //
+                             10, 11, 12, 13, 14, 15, 16, 17, 18, 19},
+                            TensorShape({1, 1, 2, 10})),
+      unblocked);
+}
+
+TEST_F(BlockedLayoutOpsTest, FromBlockedLayout) {
+  TF_ASSERT_OK(NodeDefBuilder("from_blocked", "_FromBlockedLayout")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("channels", 3)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  Tensor nhwc(DT_FLOAT, TensorShape({2, 3, 4, 3}));
+  nhwc.flat<float>().setRandom();
+  const Tensor blocked = Blocked(nhwc, 16);
+  AddInputFromArray<float>(blocked.shape(), blocked.flat<float>());
+  TF_ASSERT_OK(RunOpKernel());
+  test::ExpectTensorEqual<float>(nhwc, *GetOutput(0));
+}
+
+TEST_F(BlockedLayoutOpsTest, ToBlockedFilter) {
+  TF_ASSERT_OK(NodeDefBuilder("to_blocked_filter", "_ToBlockedFilter")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("block_size", 8)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  // A 1x1 filter from 2 to 9 channels, with filter[0, 0, i, o] = 10 * i + o.
+  Tensor filter(DT_FLOAT, TensorShape({1, 1, 2, 9}));
+  for (int i = 0; i < 2; ++i) {
+    for (int o = 0; o < 9; ++o) {
+      filter.tensor<float, 4>()(0, 0, i, o) = 10 * i + o;
+    }
+  }
+  AddInputFromArray<float>(filter.shape(), filter.flat<float>());
+  TF_ASSERT_OK(RunOpKernel());
+
+  const Tensor& blocked = *GetOutput(0);
+  ASSERT_EQ(TensorShape({2, 1, 1, 1, 8, 8}), blocked.shape());
+  const auto values = blocked.tensor<float, 6>();
+  for (int i = 0; i < 8; ++i) {
+    for (int o = 0; o < 8; ++o) {
+      const float first = i < 2 ? 10 * i + o : 0;
+      const float second = i < 2 && o == 0 ? 10 * i + 8 : 0;
+      EXPECT_EQ(first, values(0, 0, 0, 0, i, o));
+      EXPECT_EQ(second, values(1, 0, 0, 0, i, o));
+    }
+  }
+}
+
+TEST_F(BlockedLayoutOpsTest, UnsupportedBlockSize) {
+  TF_ASSERT_OK(NodeDefBuilder("to_blocked", "_ToBlockedLayout")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("block_size", 4)
+                   .Finalize(node_def()));
+  EXPECT_TRUE(errors::IsUnimplemented(InitOp()));
+}
+
+class BlockedConv2DOpTest : public OpsTestBase {
+ protected:
+  // Compares _BlockedConv2D with Conv2D and the ops listed in `fused_ops` on
+  // random inputs, converted to and from the blocked layout.
+  void VerifyBlockedConv2D(int batch, int input_rows, int input_cols,
+                           int in_depth, int filter_size, int out_depth,
+                           int stride, int dilation, const string& padding,
+                           const std::vector<string>& fused_ops,
+                           int block_size) {
+    Tensor input(DT_FLOAT,
+                 TensorShape({batch, input_rows, input_cols, in_depth}));
+    input.flat<float>().setRandom();
+    Tensor filter(DT_FLOAT, TensorShape({filter_size, filter_size, in_depth,
+                                         out_depth}));
+    filter.flat<float>().setRandom();
+    Tensor bias(DT_FLOAT, TensorShape({out_depth}));
+    bias.flat<float>().setRandom();
+    // Center the output around zero, so that the activation clips part of it.
+    const float mean_conv = 0.25f * filter_size * filter_size * in_depth;
+    bias.flat<float>() = bias.flat<float>() - mean_conv;
+
+    auto root = Scope::NewRootScope();
+    Output expected = ops::Conv2D(
+        root.WithOpName("conv"), ops::Const(root, Input::Initializer(input)),
+        ops::Const(root, Input::Initializer(filter)),
+        {1, stride, stride, 1}, padding,
+        ops::Conv2D::Dilations({1, dilation, dilation, 1}));
+    for (const string& op : fused_ops) {
+      if (op == "BiasAdd") {
+        expected = ops::BiasAdd(root, expected,
+                                ops::Const(root, Input::Initializer(bias)));
+      } else if (op == "Relu") {
+        expected = ops::Relu(root, expected);
+      } else if (op == "Relu6") {
+        expected = ops::Relu6(root, expected);
+      }
+    }
+
+    const int num_args = fused_ops.empty() ? 0 : 1;
+    TF_ASSERT_OK(NodeDefBuilder("blocked_conv", "_BlockedConv2D")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(num_args, DT_FLOAT))
+                     .Attr("num_args", num_args)
+                     .Attr("strides", {1, stride, stride, 1})
+                     .Attr("dilations", {1, dilation, dilation, 1})
+                     .Attr("padding", padding)
+                     .Attr("fused_ops", fused_ops)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    const Tensor blocked_input = Blocked(input, block_size);
+    Tensor blocked_filter;
+    TF_ASSERT_OK(ToBlockedFilter(filter, block_size, &blocked_filter));
+    AddInputFromArray<float>(blocked_input.shape(),
+                             blocked_input.flat<float>());
+    AddInputFromArray<float>(blocked_filter.shape(),
+                             blocked_filter.flat<float>());
+    if (num_args > 0) {
+      AddInputFromArray<float>(bias.shape(), bias.flat<float>());
+    }
+    TF_ASSERT_OK(RunOpKernel());
+
+    test::ExpectTensorNear<float>(RunReference(root, expected),
+                                  Unblocked(*GetOutput(0), out_depth), 1e-3);
+  }
+};
+
+TEST_F(BlockedConv2DOpTest, SameWithRelu) {
+  VerifyBlockedConv2D(2, 9, 9, 3, 3, 8, 1, 1, "SAME", {"BiasAdd", "Relu"}, 8);
+  VerifyBlockedConv2D(2, 9, 9, 3, 3, 8, 1, 1, "SAME", {"BiasAdd", "Relu"}, 16);
+}
+
+TEST_F(BlockedConv2DOpTest, ValidStridedWithRelu6) {
+  VerifyBlockedConv2D(2, 11, 10, 20, 3, 5, 2, 1, "VALID",
+                      {"BiasAdd", "Relu6"}, 8);
+  VerifyBlockedConv2D(2, 11, 10, 20, 3, 5, 2, 1, "VALID",
+                      {"BiasAdd", "Relu6"}, 16);
+}
+
+TEST_F(BlockedConv2DOpTest, Dilated) {
+  VerifyBlockedConv2D(1, 12, 13, 8, 3, 16, 1, 2, "SAME", {"BiasAdd"}, 8);
+  VerifyBlockedConv2D(1, 12, 13, 8, 3, 16, 1, 2, "VALID", {"BiasAdd"}, 16);
+}
+
+TEST_F(BlockedConv2DOpTest, PointwiseWithoutBias) {
+  VerifyBlockedConv2D(3, 8, 8, 17, 1, 33, 1, 1, "SAME", {}, 8);
+  VerifyBlockedConv2D(3, 8, 8, 17, 1, 33, 1, 1, "SAME", {}, 16);
+}
+
+TEST_F(BlockedConv2DOpTest, LargeFilterSameStrided) {
+  VerifyBlockedConv2D(1, 23, 23, 3, 7, 16, 2, 1, "SAME", {"BiasAdd", "Relu"},
+                      16);
+}
+
+// Spans several tiles of output pixels and several passes over the input
+// blocks.
+TEST_F(BlockedConv2DOpTest, WideRowsAndDeepInput) {
+  VerifyBlockedConv2D(1, 5, 70, 16, 3, 32, 1, 1, "SAME", {"BiasAdd", "Relu"},
+                      8);
+  VerifyBlockedConv2D(1, 4, 9, 256, 3, 24, 1, 1, "SAME", {"BiasAdd", "Relu"},
+                      16);
+}
+
+TEST_F(BlockedConv2DOpTest, MismatchedFilter) {
+  TF_ASSERT_OK(NodeDefBuilder("blocked_conv", "_BlockedConv2D")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(0, DT_FLOAT))
+                   .Attr("num_args", 0)
+                   .Attr("strides", {1, 1, 1, 1})
+                   .Attr("padding", "SAME")
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInput<float>(TensorShape({1, 2, 3, 3, 8}), [](int) { return 1.0f; });
+  AddInput<float>(TensorShape({1, 1, 3, 3, 8, 8}), [](int) { return 1.0f; });
+  EXPECT_TRUE(errors::IsInvalidArgument(RunOpKernel()));
+}
+
+class BlockedPoolOpTest : public OpsTestBase {
+ protected:
+  // Compares _BlockedMaxPool or _BlockedAvgPool with MaxPool or AvgPool.
+  void VerifyBlockedPool(bool max, int batch, int input_size, int depth,
+                         int window, int stride, const string& padding,
+                         int block_size) {
+    Tensor input(DT_FLOAT,
+                 TensorShape({batch, input_size, input_size, depth}));
+    input.flat<float>().setRandom();
+
+    auto root = Scope::NewRootScope();
+    const Output input_node = ops::Const(root, Input::Initializer(input));
+    const std::vector<int> ksize = {1, window, window, 1};
+    const std::vector<int> strides = {1, stride, stride, 1};
+    const Output expected =
+        max ? ops::MaxPool(root, input_node, ksize, strides, padding)
+            : ops::AvgPool(root, input_node, ksize, strides, padding);
+
+    const string op = max ? "_BlockedMaxPool" : "_BlockedAvgPool";
+    TF_ASSERT_OK(NodeDefBuilder("blocked_pool", op)
+                     .Input(FakeInput(DT_FLOAT))
+                     .Attr("ksize", ksize)
+                     .Attr("strides", strides)
+                     .Attr("padding", padding)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    const Tensor blocked_input = Blocked(input, block_size);
+    AddInputFromArray<float>(blocked_input.shape(),
+                             blocked_input.flat<float>());
+    TF_ASSERT_OK(RunOpKernel());
+
+    test::ExpectTensorNear<float>(RunReference(root, expected),
+                                  Unblocked(*GetOutput(0), depth), 1e-5);
+  }
+};
+
+TEST_F(BlockedPoolOpTest, MaxPool) {
+  VerifyBlockedPool(true, 2, 9, 5, 3, 2, "SAME", 8);
+  VerifyBlockedPool(true, 1, 8, 20, 2, 2, "VALID", 16);
+}
+
+TEST_F(BlockedPoolOpTest, AvgPool) {
+  VerifyBlockedPool(false, 2, 9, 5, 3, 2, "SAME", 8);
+  VerifyBlockedPool(false, 1, 10, 20, 3, 1, "SAME", 16);
+  VerifyBlockedPool(false, 1, 8, 20, 2, 2, "VALID", 16);
+}
+
+// Conv2D + BiasAdd + Relu on a blocked [batch, input_size, input_size,
+// in_depth] input, without the conversions to and from the blocked layout.
+static Graph* BlockedConvBiasRelu(int batch, int input_size, int in_depth,
+                                  int filter_size, int out_depth, int stride,
+                                  int block_size) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor input(DT_FLOAT,
+               TensorShape({batch, input_size, input_size, in_depth}));
+  input.flat<float>().setRandom();
+  Tensor filter(DT_FLOAT,
+                TensorShape({filter_size, filter_size, in_depth, out_depth}));
+  filter.flat<float>().setRandom();
+  Tensor blocked_filter;
+  TF_CHECK_OK(ToBlockedFilter(filter, block_size, &blocked_filter));
+  Tensor bias(DT_FLOAT, TensorShape({out_depth}));
+  bias.flat<float>().setRandom();
+
+  Node* conv;
+  TF_CHECK_OK(
+      NodeBuilder(g->NewName("blocked_conv"), "_BlockedConv2D")
+          .Input(test::graph::Constant(g, Blocked(input, block_size)))
+          .Input(test::graph::Constant(g, blocked_filter))
+          .Input({NodeBuilder::NodeOut(test::graph::Constant(g, bias))})
+          .Attr("T", DT_FLOAT)
+          .Attr("num_args", 1)
+          .Attr("strides", {1, stride, stride, 1})
+          .Attr("padding", "SAME")
+          .Attr("fused_ops", {"BiasAdd", "Relu"})
+          .Finalize(g, &conv));
+  return g;
+}
+
+#define BM_BlockedConvBiasRelu(B, S, ID, FS, OD, ST, BS, LABEL)             \
+  static void BM_BlockedConvBiasRelu_##LABEL##_##BS(int iters) {           \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B * S * S * OD *   \
+                            FS * FS * ID * 2 / (ST * ST));                 \
+    test::Benchmark("cpu", BlockedConvBiasRelu(B, S, ID, FS, OD, ST, BS))  \
+        .Run(iters);                                                       \
+  }                                                                        \
+  BENCHMARK(BM_BlockedConvBiasRelu_##LABEL##_##BS);
+
+#define BM_BlockedConvBiasReluAllBlockSizes(B, S, ID, FS, OD, ST, LABEL) \
+  BM_BlockedConvBiasRelu(B, S, ID, FS, OD, ST, 8, LABEL);                \
+  BM_BlockedConvBiasRelu(B, S, ID, FS, OD, ST, 16, LABEL);
+
+// The shapes of the BM_FusedConvBiasRelu benchmarks in conv_ops_test.cc.
+// ResNet-50 blocks.
+BM_BlockedConvBiasReluAllBlockSizes(1, 224, 3, 7, 64, 2, resnet_conv1);
+BM_BlockedConvBiasReluAllBlockSizes(1, 56, 64, 3, 64, 1, resnet_56x56x64_3x3);
+BM_BlockedConvBiasReluAllBlockSizes(1, 56, 64, 1, 256, 1, resnet_56x56x64_1x1);
+BM_BlockedConvBiasReluAllBlockSizes(1, 28, 128, 3, 128, 1,
+                                    resnet_28x28x128_3x3);
+BM_BlockedConvBiasReluAllBlockSizes(1, 14, 256, 3, 256, 1,
+                                    resnet_14x14x256_3x3);
+BM_BlockedConvBiasReluAllBlockSizes(1, 7, 512, 3, 512, 1, resnet_7x7x512_3x3);
+BM_BlockedConvBiasReluAllBlockSizes(8, 28, 128, 3, 128, 1,
+                                    resnet_b8_28x28x128_3x3);
+// MobileNet pointwise blocks.
+BM_BlockedConvBiasReluAllBlockSizes(1, 112, 32, 1, 64, 1,
+                                    mobilenet_112x112x32_1x1);
+BM_BlockedConvBiasReluAllBlockSizes(1, 14, 512, 1, 512, 1,
+                                    mobilenet_14x14x512_1x1);
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,357 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Implements _FusedConv2D, a 2D convolution followed by a bias addition and
+// an optional activation, which the grappler Remapper substitutes for
+// Conv2D + BiasAdd (+ Relu or Relu6) on CPU.
+
+#define EIGEN_USE_THREADS
+
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/kernels/bounds_check.h"
+#include "tensorflow/core/kernels/fused_bias_activation.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/util/padding.h"
+#include "tensorflow/core/util/tensor_format.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+typedef Eigen::ThreadPoolDevice CPUDevice;
+
+namespace {
+
+// The convolution is computed as a matrix multiplication of the patches of
+// the input with the filter, a chunk of output pixels at a time. Chunks are
+// sized so that their patches and outputs take about kTargetChunkBytes, which
+// keeps the output of a chunk in cache until the bias and activation are
+// applied to it.
+const int64 kTargetChunkBytes = 512 * 1024;
+// Chunks are not made smaller than this many output pixels to spread them
+// across threads, as the matrix multiplications would lose efficiency.
+const int64 kMinChunkPixels = 64;
+
+// A 2D convolution of an NHWC input with an HWIO filter.
+struct FusedConv2DDimensions {
+  int64 batch;
+  int64 input_rows;
+  int64 input_cols;
+  int64 in_depth;
+  int64 filter_rows;
+  int64 filter_cols;
+  int64 out_depth;
+  int64 stride_rows;
+  int64 stride_cols;
+  int64 dilation_rows;
+  int64 dilation_cols;
+  int64 out_rows;
+  int64 out_cols;
+  // Padding before the first row and column.
+  int64 pad_rows;
+  int64 pad_cols;
+
+  int64 patch_size() const { return filter_rows * filter_cols * in_depth; }
+  int64 num_pixels() const { return batch * out_rows * out_cols; }
+
+  // Whether the input, seen as a [batch * rows * cols, in_depth] matrix, is
+  // already the matrix of patches.
+  bool is_pointwise() const {
+    return filter_rows == 1 && filter_cols == 1 && stride_rows == 1 &&
+           stride_cols == 1;
+  }
+};
+
+// Copies the patches of output pixels [begin, end) to the row-major
+// [end - begin, patch_size] `patches`, with zeros where they overlap the
+// padding.
+template <typename T>
+void Im2Col(const T* input, const FusedConv2DDimensions& dims, int64 begin,
+            int64 end, T* patches) {
+  const int64 row_size = dims.filter_cols * dims.in_depth;
+  for (int64 pixel = begin; pixel < end; ++pixel) {
+    const int64 out_col = pixel % dims.out_cols;
+    const int64 out_row = (pixel / dims.out_cols) % dims.out_rows;
+    const int64 batch = pixel / (dims.out_cols * dims.out_rows);
+    const int64 first_in_col = out_col * dims.stride_cols - dims.pad_cols;
+    const int64 last_in_col =
+        first_in_col + (dims.filter_cols - 1) * dims.dilation_cols;
+    const bool cols_inside = first_in_col >= 0 &&
+                             last_in_col < dims.input_cols &&
+                             dims.dilation_cols == 1;
+    T* patch = patches + (pixel - begin) * dims.patch_size();
+    for (int64 f_row = 0; f_row < dims.filter_rows;
+         ++f_row, patch += row_size) {
+      const int64 in_row = out_row * dims.stride_rows - dims.pad_rows +
+                           f_row * dims.dilation_rows;
+      if (in_row < 0 || in_row >= dims.input_rows) {
+        std::fill(patch, patch + row_size, static_cast<T>(0));
+        continue;
+      }
+      const T* input_row =
+          input + (batch * dims.input_rows + in_row) * dims.input_cols *
+                      dims.in_depth;
+      if (cols_inside) {
+        memcpy(patch, input_row + first_in_col * dims.in_depth,
+               row_size * sizeof(T));
+        continue;
+      }
+      for (int64 f_col = 0; f_col < dims.filter_cols; ++f_col) {
+        const int64 in_col = first_in_col + f_col * dims.dilation_cols;
+        T* patch_col = patch + f_col * dims.in_depth;
+        if (in_col < 0 || in_col >= dims.input_cols) {
+          std::fill(patch_col, patch_col + dims.in_depth, static_cast<T>(0));
+        } else {
+          memcpy(patch_col, input_row + in_col * dims.in_depth,
+                 dims.in_depth * sizeof(T));
+        }
+      }
+    }
+  }
+}
+
+// Computes output pixels [begin, end) on `device`, then adds the bias and
+// applies the activation to them. `patches` must have room for the patches of
+// end - begin pixels unless the convolution is pointwise.
+template <typename Device, typename T>
+void FusedConv2DChunk(const Device& device, const T* input, const T* filter,
+                      const T* bias, const FusedConv2DDimensions& dims,
+                      FusedActivation activation, int64 begin, int64 end,
+                      T* patches, T* output) {
+  const T* lhs = input + begin * dims.in_depth;
+  if (!dims.is_pointwise()) {
+    Im2Col(input, dims, begin, end, patches);
+    lhs = patches;
+  }
+  typename TTypes<T>::UnalignedConstMatrix lhs_matrix(lhs, end - begin,
+                                                      dims.patch_size());
+  typename TTypes<T>::UnalignedConstMatrix filter_matrix(
+      filter, dims.patch_size(), dims.out_depth);
+  T* output_chunk = output + begin * dims.out_depth;
+  typename TTypes<T>::UnalignedMatrix output_matrix(output_chunk, end - begin,
+                                                    dims.out_depth);
+  Eigen::array<Eigen::IndexPair<Eigen::DenseIndex>, 1> dim_pair;
+  dim_pair[0] = Eigen::IndexPair<Eigen::DenseIndex>(1, 0);
+  output_matrix.device(device) = lhs_matrix.contract(filter_matrix, dim_pair);
+  ApplyBiasActivation(bias, dims.out_depth, activation, end - begin,
+                      output_chunk);
+}
+
+// Computes chunks [begin_chunk, end_chunk) of `chunk_pixels` output pixels.
+template <typename Device, typename T>
+void FusedConv2DChunks(const Device& device, const T* input, const T* filter,
+                       const T* bias, const FusedConv2DDimensions& dims,
+                       FusedActivation activation, int64 chunk_pixels,
+                       int64 begin_chunk, int64 end_chunk, T* output) {
+  std::unique_ptr<T[]> patches;
+  if (!dims.is_pointwise()) {
+    patches.reset(new T[chunk_pixels * dims.patch_size()]);
+  }
+  for (int64 chunk = begin_chunk; chunk < end_chunk; ++chunk) {
+    const int64 begin = chunk * chunk_pixels;
+    const int64 end = std::min(dims.num_pixels(), begin + chunk_pixels);
+    FusedConv2DChunk(device, input, filter, bias, dims, activation, begin, end,
+                     patches.get(), output);
+  }
+}
+
+// Computes the convolution with bias and activation into `output`. Chunks are
+// sharded across the worker threads if there are enough of them to keep every
+// thread busy, and otherwise computed one after the other with multithreaded
+// matrix multiplications.
+template <typename T>
+void FusedConv2D(const DeviceBase::CpuWorkerThreads& workers,
+                 const CPUDevice& device, const T* input, const T* filter,
+                 const T* bias, const FusedConv2DDimensions& dims,
+                 FusedActivation activation, T* output) {
+  const int64 num_pixels = dims.num_pixels();
+  const int64 patch_size = dims.is_pointwise() ? 0 : dims.patch_size();
+  const int64 pixel_bytes = (patch_size + dims.out_depth) * sizeof(T);
+  const int64 pixels_per_thread =
+      (num_pixels + workers.num_threads - 1) / workers.num_threads;
+  const int64 chunk_pixels = std::max(
+      kMinChunkPixels,
+      std::min(kTargetChunkBytes / pixel_bytes, pixels_per_thread));
+  const int64 num_chunks = (num_pixels + chunk_pixels - 1) / chunk_pixels;
+
+  if (num_chunks < workers.num_threads) {
+    FusedConv2DChunks(device, input, filter, bias, dims, activation,
+                      chunk_pixels, 0, num_chunks, output);
+    return;
+  }
+  const int64 cost_per_chunk =
+      2 * chunk_pixels * dims.patch_size() * dims.out_depth;
+  Shard(workers.num_threads, workers.workers, num_chunks, cost_per_chunk,
+        [&](int64 begin_chunk, int64 end_chunk) {
+          FusedConv2DChunks(Eigen::DefaultDevice(), input, filter, bias, dims,
+                            activation, chunk_pixels, begin_chunk, end_chunk,
+                            output);
+        });
+}
+
+}  // namespace
+
+template <typename T>
+class FusedConv2DOp : public OpKernel {
+ public:
+  explicit FusedConv2DOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("strides", &strides_));
+    OP_REQUIRES_OK(context, context->GetAttr("dilations", &dilations_));
+    OP_REQUIRES_OK(context, context->GetAttr("padding", &padding_));
+    string data_format;
+    OP_REQUIRES_OK(context, context->GetAttr("data_format", &data_format));
+    OP_REQUIRES(context, data_format == "NHWC",
+                errors::Unimplemented("_FusedConv2D on CPU only supports "
+                                      "NHWC tensor format for now."));
+    OP_REQUIRES(context, strides_.size() == 4,
+                errors::InvalidArgument("Sliding window strides field must "
+                                        "specify 4 dimensions"));
+    OP_REQUIRES(context, dilations_.size() == 4,
+                errors::InvalidArgument("Sliding window dilations field must "
+                                        "specify 4 dimensions"));
+    OP_REQUIRES(
+        context, strides_[0] == 1 && strides_[3] == 1,
+        errors::InvalidArgument("Current implementation does not yet support "
+                                "strides in the batch and depth dimensions."));
+    OP_REQUIRES(context, strides_[1] > 0 && strides_[2] > 0,
+                errors::InvalidArgument(
+                    "Row and column strides should be larger than 0."));
+    OP_REQUIRES(context, dilations_[0] == 1 && dilations_[3] == 1,
+                errors::InvalidArgument(
+                    "Current implementation does not yet support "
+                    "dilations in the batch and depth dimensions."));
+    OP_REQUIRES(
+        context, dilations_[1] > 0 && dilations_[2] > 0,
+        errors::InvalidArgument("Dilated rates should be larger than 0."));
+
+    std::vector<string> fused_ops;
+    OP_REQUIRES_OK(context, context->GetAttr("fused_ops", &fused_ops));
+    OP_REQUIRES_OK(context, ParseFusedBiasActivation(fused_ops, &activation_));
+    int num_args;
+    OP_REQUIRES_OK(context, context->GetAttr("num_args", &num_args));
+    OP_REQUIRES(context, num_args == 1,
+                errors::InvalidArgument(
+                    "_FusedConv2D with BiasAdd must have one extra argument: "
+                    "bias, got ",
+                    num_args));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    // Input tensor is of the following dimensions:
+    // [ batch, in_rows, in_cols, in_depth ]
+    const Tensor& input = context->input(0);
+    // Input filter is of the following dimensions:
+    // [ filter_rows, filter_cols, in_depth, out_depth]
+    const Tensor& filter = context->input(1);
+    const Tensor& bias = context->input(2);
+
+    OP_REQUIRES(context, input.dims() == 4,
+                errors::InvalidArgument("input must be 4-dimensional",
+                                        input.shape().DebugString()));
+    OP_REQUIRES(context, filter.dims() == 4,
+                errors::InvalidArgument("filter must be 4-dimensional: ",
+                                        filter.shape().DebugString()));
+    for (int i = 0; i < 4; i++) {
+      OP_REQUIRES(context,
+                  FastBoundsCheck(input.dim_size(i),
+                                  std::numeric_limits<int>::max()) &&
+                      FastBoundsCheck(filter.dim_size(i),
+                                      std::numeric_limits<int>::max()),
+                  errors::InvalidArgument("input or filter too large"));
+    }
+    OP_REQUIRES(context, input.dim_size(3) == filter.dim_size(2),
+                errors::InvalidArgument(
+                    "input depth must be equal to filter depth: ",
+                    input.dim_size(3), " vs ", filter.dim_size(2)));
+    OP_REQUIRES(context,
+                TensorShapeUtils::IsVector(bias.shape()) &&
+                    bias.dim_size(0) == filter.dim_size(3),
+                errors::InvalidArgument(
+                    "bias must be a vector of the filter's out depth ",
+                    filter.dim_size(3), ", got shape ",
+                    bias.shape().DebugString()));
+
+    FusedConv2DDimensions dims;
+    dims.batch = input.dim_size(0);
+    dims.input_rows = input.dim_size(1);
+    dims.input_cols = input.dim_size(2);
+    dims.in_depth = input.dim_size(3);
+    dims.filter_rows = filter.dim_size(0);
+    dims.filter_cols = filter.dim_size(1);
+    dims.out_depth = filter.dim_size(3);
+    dims.stride_rows = strides_[1];
+    dims.stride_cols = strides_[2];
+    dims.dilation_rows = dilations_[1];
+    dims.dilation_cols = dilations_[2];
+    OP_REQUIRES_OK(context,
+                   GetWindowedOutputSizeV2(dims.input_rows, dims.filter_rows,
+                                           dims.dilation_rows, dims.stride_rows,
+                                           padding_, &dims.out_rows,
+                                           &dims.pad_rows));
+    OP_REQUIRES_OK(context,
+                   GetWindowedOutputSizeV2(dims.input_cols, dims.filter_cols,
+                                           dims.dilation_cols, dims.stride_cols,
+                                           padding_, &dims.out_cols,
+                                           &dims.pad_cols));
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(
+                                0,
+                                TensorShape({dims.batch, dims.out_rows,
+                                             dims.out_cols, dims.out_depth}),
+                                &output));
+    if (output->NumElements() == 0) return;
+    if (dims.patch_size() == 0) {
+      // There is no input to convolve, so only the bias is left.
+      output->flat<T>().setZero();
+      ApplyBiasActivation(bias.flat<T>().data(), dims.out_depth, activation_,
+                          dims.num_pixels(), output->flat<T>().data());
+      return;
+    }
+
+    FusedConv2D(*context->device()->tensorflow_cpu_worker_threads(),
+                context->eigen_device<CPUDevice>(), input.flat<T>().data(),
+                filter.flat<T>().data(), bias.flat<T>().data(), dims,
+                activation_, output->flat<T>().data());
+  }
+
+ private:
+  std::vector<int32> strides_;
+  std::vector<int32> dilations_;
+  Padding padding_;
+  FusedActivation activation_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(FusedConv2DOp);
+};
+
+#define REGISTER_KERNEL(T)                                               \
+  REGISTER_KERNEL_BUILDER(                                               \
+      Name("_FusedConv2D").Device(DEVICE_CPU).TypeConstraint<T>("T"), \
+      FusedConv2DOp<T>);
+
+TF_CALL_float(REGISTER_KERNEL);
+TF_CALL_double(REGISTER_KERNEL);
+#undef REGISTER_KERNEL
+
+}  // namespace tensorflow
@@ -22,11 +22,14 @@ limitations under the License.
 #include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
 #include "tensorflow/core/kernels/conv_ops_gpu.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/protobuf/rewriter_config.pb.h"
 #include "tensorflow/core/public/session.h"
 
 namespace tensorflow {
@@ -474,4 +477,189 @@ TEST_F(ConvOpTest, HandwrittenConv) { HandwrittenConv(); }
 
 TEST_F(ConvOpTest, AnisotropicStride) { AnisotropicStrides(); }
 
+class FusedConv2DWithBiasOpTest : public OpsTestBase {
+ protected:
+  // Runs Conv2D, BiasAdd and `activation` as separate ops, with grappler
+  // prevented from fusing them.
+  void RunUnfused(const Tensor& input, const Tensor& filter,
+                  const Tensor& bias, int stride, const string& padding,
+                  const string& activation, Tensor* output) {
+    auto root = tensorflow::Scope::NewRootScope();
+    using namespace ::tensorflow::ops;  // NOLINT(build/namespaces)
+
+    Output conv = Conv2D(root.WithOpName("conv"),
+                         Const(root.WithOpName("input"),
+                               Input::Initializer(input)),
+                         Const(root.WithOpName("filter"),
+                               Input::Initializer(filter)),
+                         {1, stride, stride, 1}, padding);
+    Output result =
+        BiasAdd(root.WithOpName("bias_add"), conv,
+                Const(root.WithOpName("bias"), Input::Initializer(bias)));
+    if (activation == "Relu") {
+      result = Relu(root.WithOpName("activation"), result);
+    } else if (activation == "Relu6") {
+      result = Relu6(root.WithOpName("activation"), result);
+    }
+
+    tensorflow::GraphDef graph;
+    TF_ASSERT_OK(root.ToGraphDef(&graph));
+
+    SessionOptions options;
+    options.config.mutable_graph_options()
+        ->mutable_rewrite_options()
+        ->set_remapping(RewriterConfig::OFF);
+    std::unique_ptr<tensorflow::Session> session(NewSession(options));
+    TF_ASSERT_OK(session->Create(graph));
+
+    std::vector<Tensor> outputs;
+    TF_ASSERT_OK(session->Run({}, {result.node()->name()}, {}, &outputs));
+    *output = outputs[0];
+  }
+
+  // Compares _FusedConv2D with the ops it fuses on random inputs.
+  void VerifyFusedConv2D(int batch, int input_size, int in_depth,
+                         int filter_size, int out_depth, int stride,
+                         const string& padding, const string& activation) {
+    Tensor input(DT_FLOAT,
+                 TensorShape({batch, input_size, input_size, in_depth}));
+    input.flat<float>().setRandom();
+    Tensor filter(DT_FLOAT, TensorShape({filter_size, filter_size, in_depth,
+                                         out_depth}));
+    filter.flat<float>().setRandom();
+    Tensor bias(DT_FLOAT, TensorShape({out_depth}));
+    bias.flat<float>().setRandom();
+    // Center the output around zero, so that the activation clips part of it.
+    const float mean_conv = 0.25f * filter_size * filter_size * in_depth;
+    bias.flat<float>() = bias.flat<float>() - mean_conv;
+
+    Tensor expected;
+    RunUnfused(input, filter, bias, stride, padding, activation, &expected);
+
+    std::vector<string> fused_ops = {"BiasAdd"};
+    if (!activation.empty()) fused_ops.push_back(activation);
+    TF_ASSERT_OK(NodeDefBuilder("fused_conv", "_FusedConv2D")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(1, DT_FLOAT))
+                     .Attr("num_args", 1)
+                     .Attr("strides", {1, stride, stride, 1})
+                     .Attr("padding", padding)
+                     .Attr("fused_ops", fused_ops)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    AddInputFromArray<float>(input.shape(), input.flat<float>());
+    AddInputFromArray<float>(filter.shape(), filter.flat<float>());
+    AddInputFromArray<float>(bias.shape(), bias.flat<float>());
+    TF_ASSERT_OK(RunOpKernel());
+
+    test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-3);
+  }
+};
+
+TEST_F(FusedConv2DWithBiasOpTest, SameWithRelu) {
+  VerifyFusedConv2D(2, 9, 3, 3, 8, 1, "SAME", "Relu");
+}
+
+TEST_F(FusedConv2DWithBiasOpTest, ValidStridedWithRelu6) {
+  VerifyFusedConv2D(2, 11, 4, 3, 5, 2, "VALID", "Relu6");
+}
+
+TEST_F(FusedConv2DWithBiasOpTest, PointwiseWithoutActivation) {
+  VerifyFusedConv2D(3, 8, 16, 1, 7, 1, "SAME", "");
+}
+
+TEST_F(FusedConv2DWithBiasOpTest, LargeFilterSameStrided) {
+  VerifyFusedConv2D(1, 23, 3, 7, 16, 2, "SAME", "Relu");
+}
+
+// Spans several chunks of output pixels.
+TEST_F(FusedConv2DWithBiasOpTest, ManyPixels) {
+  VerifyFusedConv2D(2, 40, 8, 3, 32, 1, "SAME", "Relu");
+}
+
+TEST_F(FusedConv2DWithBiasOpTest, UnsupportedFusedOps) {
+  TF_ASSERT_OK(NodeDefBuilder("fused_conv", "_FusedConv2D")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(1, DT_FLOAT))
+                   .Attr("num_args", 1)
+                   .Attr("strides", {1, 1, 1, 1})
+                   .Attr("padding", "SAME")
+                   .Attr("fused_ops", {"Relu"})
+                   .Finalize(node_def()));
+  EXPECT_TRUE(errors::IsUnimplemented(InitOp()));
+}
+
+// Conv2D + BiasAdd + Relu on a [batch, input_size, input_size, in_depth]
+// input, as a _FusedConv2D or as separate ops.
+static Graph* ConvBiasRelu(int batch, int input_size, int in_depth,
+                           int filter_size, int out_depth, int stride,
+                           bool fused) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor input(DT_FLOAT,
+               TensorShape({batch, input_size, input_size, in_depth}));
+  input.flat<float>().setRandom();
+  Tensor filter(DT_FLOAT,
+                TensorShape({filter_size, filter_size, in_depth, out_depth}));
+  filter.flat<float>().setRandom();
+  Tensor bias(DT_FLOAT, TensorShape({out_depth}));
+  bias.flat<float>().setRandom();
+  Node* input_node = test::graph::Constant(g, input);
+  Node* filter_node = test::graph::Constant(g, filter);
+  Node* bias_node = test::graph::Constant(g, bias);
+
+  Node* conv;
+  if (fused) {
+    TF_CHECK_OK(NodeBuilder(g->NewName("fused_conv"), "_FusedConv2D")
+                    .Input(input_node)
+                    .Input(filter_node)
+                    .Input({NodeBuilder::NodeOut(bias_node)})
+                    .Attr("T", DT_FLOAT)
+                    .Attr("num_args", 1)
+                    .Attr("strides", {1, stride, stride, 1})
+                    .Attr("padding", "SAME")
+                    .Attr("fused_ops", {"BiasAdd", "Relu"})
+                    .Finalize(g, &conv));
+    return g;
+  }
+  TF_CHECK_OK(NodeBuilder(g->NewName("conv"), "Conv2D")
+                  .Input(input_node)
+                  .Input(filter_node)
+                  .Attr("T", DT_FLOAT)
+                  .Attr("strides", {1, stride, stride, 1})
+                  .Attr("padding", "SAME")
+                  .Finalize(g, &conv));
+  test::graph::Relu(g, test::graph::BiasAdd(g, conv, bias_node));
+  return g;
+}
+
+#define BM_ConvBiasRelu(B, S, ID, FS, OD, ST, LABEL)                         \
+  static void BM_ConvBiasRelu_##LABEL(int iters) {                          \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B * S * S * OD *    \
+                            FS * FS * ID * 2 / (ST * ST));                  \
+    test::Benchmark("cpu", ConvBiasRelu(B, S, ID, FS, OD, ST, false))       \
+        .Run(iters);                                                        \
+  }                                                                         \
+  BENCHMARK(BM_ConvBiasRelu_##LABEL);                                       \
+  static void BM_FusedConvBiasRelu_##LABEL(int iters) {                     \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B * S * S * OD *    \
+                            FS * FS * ID * 2 / (ST * ST));                  \
+    test::Benchmark("cpu", ConvBiasRelu(B, S, ID, FS, OD, ST, true))        \
+        .Run(iters);                                                        \
+  }                                                                         \
+  BENCHMARK(BM_FusedConvBiasRelu_##LABEL);
+
+// ResNet-50 blocks.
+BM_ConvBiasRelu(1, 224, 3, 7, 64, 2, resnet_conv1);
+BM_ConvBiasRelu(1, 56, 64, 3, 64, 1, resnet_56x56x64_3x3);
+BM_ConvBiasRelu(1, 56, 64, 1, 256, 1, resnet_56x56x64_1x1);
+BM_ConvBiasRelu(1, 28, 128, 3, 128, 1, resnet_28x28x128_3x3);
+BM_ConvBiasRelu(1, 14, 256, 3, 256, 1, resnet_14x14x256_3x3);
+BM_ConvBiasRelu(1, 7, 512, 3, 512, 1, resnet_7x7x512_3x3);
+BM_ConvBiasRelu(8, 28, 128, 3, 128, 1, resnet_b8_28x28x128_3x3);
+// MobileNet pointwise blocks.
+BM_ConvBiasRelu(1, 112, 32, 1, 64, 1, mobilenet_112x112x32_1x1);
+BM_ConvBiasRelu(1, 14, 512, 1, 512, 1, mobilenet_14x14x512_1x1);
+
 }  // namespace tensorflow
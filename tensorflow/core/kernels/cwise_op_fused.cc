@@ -0,0 +1,387 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Implements _FusedElementwise, which evaluates a DAG of elementwise ops that
+// the grappler Remapper fuses on CPU, in a single pass over its inputs.
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "third_party/eigen3/Eigen/Core"
+#include "third_party/eigen3/unsupported/Eigen/SpecialFunctions"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/gtl/inlined_vector.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+namespace {
+
+// The ops are evaluated one after the other on blocks of kBlockSize elements,
+// small enough for the intermediate values of a block to stay in cache, and
+// large enough for each op to run as a vectorized loop.
+const int64 kBlockSize = 1024;
+
+enum class FusedOp {
+  kAbs,
+  kErf,
+  kExp,
+  kLog,
+  kNeg,
+  kReciprocal,
+  kRelu,
+  kRelu6,
+  kRsqrt,
+  kSigmoid,
+  kSqrt,
+  kSquare,
+  kTanh,
+  kAdd,
+  kDiv,
+  kMaximum,
+  kMinimum,
+  kMul,
+  kPow,
+  kSquaredDifference,
+  kSub,
+};
+
+struct FusedOpInfo {
+  const char* name;
+  FusedOp op;
+  int num_inputs;
+  // Rough cost of the op per element, in cycles.
+  int cost;
+};
+
+// The ops that _FusedElementwise supports. Keep in sync with the list of
+// fusible ops in grappler/optimizers/remapper.cc.
+const FusedOpInfo kFusedOps[] = {
+    {"Abs", FusedOp::kAbs, 1, 1},
+    {"Erf", FusedOp::kErf, 1, 20},
+    {"Exp", FusedOp::kExp, 1, 10},
+    {"Inv", FusedOp::kReciprocal, 1, 4},
+    {"Log", FusedOp::kLog, 1, 10},
+    {"Neg", FusedOp::kNeg, 1, 1},
+    {"Reciprocal", FusedOp::kReciprocal, 1, 4},
+    {"Relu", FusedOp::kRelu, 1, 1},
+    {"Relu6", FusedOp::kRelu6, 1, 1},
+    {"Rsqrt", FusedOp::kRsqrt, 1, 5},
+    {"Sigmoid", FusedOp::kSigmoid, 1, 15},
+    {"Sqrt", FusedOp::kSqrt, 1, 5},
+    {"Square", FusedOp::kSquare, 1, 1},
+    {"Tanh", FusedOp::kTanh, 1, 15},
+    {"Add", FusedOp::kAdd, 2, 1},
+    {"AddV2", FusedOp::kAdd, 2, 1},
+    {"Div", FusedOp::kDiv, 2, 4},
+    {"Maximum", FusedOp::kMaximum, 2, 1},
+    {"Minimum", FusedOp::kMinimum, 2, 1},
+    {"Mul", FusedOp::kMul, 2, 1},
+    {"Pow", FusedOp::kPow, 2, 40},
+    {"RealDiv", FusedOp::kDiv, 2, 4},
+    {"SquaredDifference", FusedOp::kSquaredDifference, 2, 2},
+    {"Sub", FusedOp::kSub, 2, 1},
+};
+
+const FusedOpInfo* FindFusedOp(const string& name) {
+  for (const FusedOpInfo& info : kFusedOps) {
+    if (name == info.name) return &info;
+  }
+  return nullptr;
+}
+
+// One op of the fused DAG. Its operands are registers: the inputs of the
+// _FusedElementwise come first, followed by the results of the ops in order.
+struct Instruction {
+  FusedOp op;
+  int x;
+  // -1 for unary ops.
+  int y;
+};
+
+// Computes `n` elements of `inst` into `out`, which doesn't alias its
+// operands.
+template <typename T>
+void Evaluate(const Instruction& inst, const T* const* registers, int64 n,
+              T* out) {
+  typedef Eigen::Map<const Eigen::Array<T, Eigen::Dynamic, 1>> ConstArray;
+  Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1>> z(out, n);
+  const ConstArray x(registers[inst.x], n);
+  switch (inst.op) {
+    case FusedOp::kAbs:
+      z = x.abs();
+      return;
+    case FusedOp::kErf:
+      z = x.unaryExpr(Eigen::internal::scalar_erf_op<T>());
+      return;
+    case FusedOp::kExp:
+      z = x.exp();
+      return;
+    case FusedOp::kLog:
+      z = x.log();
+      return;
+    case FusedOp::kNeg:
+      z = -x;
+      return;
+    case FusedOp::kReciprocal:
+      z = x.inverse();
+      return;
+    case FusedOp::kRelu:
+      z = x.max(T(0));
+      return;
+    case FusedOp::kRelu6:
+      z = x.max(T(0)).min(T(6));
+      return;
+    case FusedOp::kRsqrt:
+      z = x.rsqrt();
+      return;
+    case FusedOp::kSigmoid:
+      z = (T(1) + (-x).exp()).inverse();
+      return;
+    case FusedOp::kSqrt:
+      z = x.sqrt();
+      return;
+    case FusedOp::kSquare:
+      z = x.square();
+      return;
+    case FusedOp::kTanh:
+      z = x.tanh();
+      return;
+    default:
+      break;
+  }
+  const ConstArray y(registers[inst.y], n);
+  switch (inst.op) {
+    case FusedOp::kAdd:
+      z = x + y;
+      return;
+    case FusedOp::kDiv:
+      z = x / y;
+      return;
+    case FusedOp::kMaximum:
+      z = x.max(y);
+      return;
+    case FusedOp::kMinimum:
+      z = x.min(y);
+      return;
+    case FusedOp::kMul:
+      z = x * y;
+      return;
+    case FusedOp::kPow:
+      z = x.binaryExpr(y, [](T a, T b) { return std::pow(a, b); });
+      return;
+    case FusedOp::kSquaredDifference:
+      z = (x - y).square();
+      return;
+    case FusedOp::kSub:
+      z = x - y;
+      return;
+    default:
+      LOG(FATAL) << "Unexpected fused op " << static_cast<int>(inst.op);
+  }
+}
+
+// Returns whether `input` broadcasts to `shape` along its leading dimensions
+// only: once its leading dimensions of size 1 are dropped, it must match the
+// trailing dimensions of `shape`. Element i of the broadcast input is then
+// element i % input.num_elements() of the input.
+bool BroadcastsAlongLeadingDims(const TensorShape& input,
+                                const TensorShape& shape) {
+  int first = 0;
+  while (first < input.dims() && input.dim_size(first) == 1) ++first;
+  const int offset = shape.dims() - input.dims();
+  if (offset + first < 0) return false;
+  for (int i = first; i < input.dims(); ++i) {
+    if (input.dim_size(i) != shape.dim_size(offset + i)) return false;
+  }
+  return true;
+}
+
+// Copies elements [start, start + n) of `data`, a tensor of `size` elements
+// repeated as many times as needed, to `out`.
+template <typename T>
+void BroadcastBlock(const T* data, int64 size, int64 start, int64 n, T* out) {
+  if (size == 1) {
+    std::fill(out, out + n, data[0]);
+    return;
+  }
+  int64 offset = start % size;
+  while (n > 0) {
+    const int64 len = std::min(n, size - offset);
+    std::copy(data + offset, data + offset + len, out);
+    out += len;
+    n -= len;
+    offset = 0;
+  }
+}
+
+}  // namespace
+
+template <typename T>
+class FusedElementwiseOp : public OpKernel {
+ public:
+  explicit FusedElementwiseOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    int num_inputs;
+    OP_REQUIRES_OK(context, context->GetAttr("N", &num_inputs));
+    std::vector<string> fused_ops;
+    OP_REQUIRES_OK(context, context->GetAttr("fused_ops", &fused_ops));
+    std::vector<int32> operands;
+    OP_REQUIRES_OK(context, context->GetAttr("operands", &operands));
+    OP_REQUIRES_OK(context, context->GetAttr("output_ids", &output_ids_));
+    OP_REQUIRES(context, !fused_ops.empty(),
+                errors::InvalidArgument("_FusedElementwise has no fused_ops"));
+    OP_REQUIRES(
+        context, operands.size() == 2 * fused_ops.size(),
+        errors::InvalidArgument("_FusedElementwise must have two operands "
+                                "per fused op, got ",
+                                operands.size(), " for ", fused_ops.size(),
+                                " ops"));
+    cost_per_element_ = num_inputs;
+    for (int i = 0; i < fused_ops.size(); ++i) {
+      const FusedOpInfo* info = FindFusedOp(fused_ops[i]);
+      OP_REQUIRES(context, info != nullptr,
+                  errors::Unimplemented("_FusedElementwise doesn't support ",
+                                        fused_ops[i]));
+      const int num_registers = num_inputs + i;
+      Instruction inst = {info->op, operands[2 * i], operands[2 * i + 1]};
+      OP_REQUIRES(
+          context,
+          inst.x >= 0 && inst.x < num_registers &&
+              (info->num_inputs == 1 ? inst.y == -1
+                                     : inst.y >= 0 && inst.y < num_registers),
+          errors::InvalidArgument("Invalid operands ", inst.x, ", ", inst.y,
+                                  " for fused op ", i, ": ", fused_ops[i]));
+      instructions_.push_back(inst);
+      cost_per_element_ += info->cost;
+    }
+    OP_REQUIRES(context, output_ids_.size() == context->num_outputs(),
+                errors::InvalidArgument("_FusedElementwise has ",
+                                        context->num_outputs(),
+                                        " outputs, but ", output_ids_.size(),
+                                        " output_ids"));
+    for (int id : output_ids_) {
+      OP_REQUIRES(context,
+                  id >= num_inputs && id < num_inputs + fused_ops.size(),
+                  errors::InvalidArgument(
+                      "output_ids must be the results of fused ops, got ",
+                      id));
+      OP_REQUIRES(context,
+                  std::count(output_ids_.begin(), output_ids_.end(), id) == 1,
+                  errors::InvalidArgument("Duplicate output id ", id));
+    }
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const int num_inputs = context->num_inputs();
+    // The outputs have the shape of the largest input, which the others
+    // broadcast to.
+    int largest = 0;
+    for (int i = 1; i < num_inputs; ++i) {
+      const Tensor& input = context->input(i);
+      const Tensor& current = context->input(largest);
+      if (input.NumElements() > current.NumElements() ||
+          (input.NumElements() == current.NumElements() &&
+           input.dims() > current.dims())) {
+        largest = i;
+      }
+    }
+    const TensorShape shape = context->input(largest).shape();
+    const int64 num_elements = shape.num_elements();
+
+    gtl::InlinedVector<const T*, 8> input_data(num_inputs);
+    gtl::InlinedVector<int64, 8> input_sizes(num_inputs);
+    for (int i = 0; i < num_inputs; ++i) {
+      const Tensor& input = context->input(i);
+      OP_REQUIRES(context, BroadcastsAlongLeadingDims(input.shape(), shape),
+                  errors::InvalidArgument(
+                      "Input ", i, " of shape ", input.shape().DebugString(),
+                      " doesn't broadcast to ", shape.DebugString(),
+                      " along its leading dimensions"));
+      input_data[i] = input.flat<T>().data();
+      input_sizes[i] = input.NumElements();
+    }
+
+    const int num_registers = num_inputs + instructions_.size();
+    // The register of an op that is an output is written directly to the
+    // output.
+    gtl::InlinedVector<T*, 4> output_data(num_registers, nullptr);
+    for (int k = 0; k < output_ids_.size(); ++k) {
+      Tensor* output = nullptr;
+      OP_REQUIRES_OK(context, context->allocate_output(k, shape, &output));
+      output_data[output_ids_[k]] = output->flat<T>().data();
+    }
+    if (num_elements == 0) return;
+
+    const std::vector<Instruction>& instructions = instructions_;
+    auto compute_blocks = [&instructions, &input_data, &input_sizes,
+                           &output_data, num_inputs, num_registers,
+                           num_elements](int64 begin, int64 end) {
+      // Holds the broadcast inputs and the intermediate results of a block.
+      std::vector<T> scratch(num_registers * kBlockSize);
+      gtl::InlinedVector<const T*, 16> registers(num_registers);
+      for (int64 block = begin; block < end; ++block) {
+        const int64 start = block * kBlockSize;
+        const int64 n = std::min(kBlockSize, num_elements - start);
+        for (int i = 0; i < num_inputs; ++i) {
+          if (input_sizes[i] == num_elements) {
+            registers[i] = input_data[i] + start;
+          } else {
+            T* buffer = scratch.data() + i * kBlockSize;
+            BroadcastBlock(input_data[i], input_sizes[i], start, n, buffer);
+            registers[i] = buffer;
+          }
+        }
+        for (int j = 0; j < instructions.size(); ++j) {
+          const int r = num_inputs + j;
+          T* out = output_data[r] != nullptr ? output_data[r] + start
+                                             : scratch.data() + r * kBlockSize;
+          Evaluate(instructions[j], registers.data(), n, out);
+          registers[r] = out;
+        }
+      }
+    };
+    const DeviceBase::CpuWorkerThreads& workers =
+        *context->device()->tensorflow_cpu_worker_threads();
+    Shard(workers.num_threads, workers.workers,
+          (num_elements + kBlockSize - 1) / kBlockSize,
+          kBlockSize * cost_per_element_, compute_blocks);
+  }
+
+ private:
+  std::vector<Instruction> instructions_;
+  std::vector<int32> output_ids_;
+  int64 cost_per_element_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(FusedElementwiseOp);
+};
+
+#define REGISTER_KERNEL(T)                                                   \
+  REGISTER_KERNEL_BUILDER(                                                   \
+      Name("_FusedElementwise").Device(DEVICE_CPU).TypeConstraint<T>("T"), \
+      FusedElementwiseOp<T>);
+
+TF_CALL_float(REGISTER_KERNEL);
+TF_CALL_double(REGISTER_KERNEL);
+#undef REGISTER_KERNEL
+
+}  // namespace tensorflow
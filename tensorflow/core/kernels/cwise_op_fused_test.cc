@@ -0,0 +1,277 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cmath>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+// The program of the tanh approximation of GELU,
+// 0.5 * x * (1 + tanh(0.79788456 * (x + 0.044715 * x^3))), with inputs x,
+// 3, 0.044715, 0.79788456, 1 and 0.5.
+const std::vector<string> kGeluOps = {"Pow", "Mul", "Add", "Mul",
+                                      "Tanh", "Add", "Mul", "Mul"};
+const std::vector<int32> kGeluOperands = {0, 1, 2, 6, 0,  7,  3,  8,
+                                          9, -1, 4, 10, 5, 0, 11, 12};
+const int32 kGeluOutput = 13;
+
+double Gelu(double x) {
+  return 0.5 * x * (1 + std::tanh(0.79788456 * (x + 0.044715 * x * x * x)));
+}
+
+double Sigmoid(double x) { return 1 / (1 + std::exp(-x)); }
+
+// The program of an LSTM cell, with inputs i, j, f, o, c and the forget bias,
+// and outputs the new h and the new c.
+const std::vector<string> kLstmOps = {"Add",  "Sigmoid", "Mul",  "Sigmoid",
+                                      "Tanh", "Mul",     "Add",  "Tanh",
+                                      "Sigmoid", "Mul"};
+const std::vector<int32> kLstmOperands = {2,  5,  6,  -1, 4,  7,  0,
+                                          -1, 1,  -1, 9,  10, 8,  11,
+                                          12, -1, 3,  -1, 13, 14};
+const std::vector<int32> kLstmOutputs = {15, 12};
+
+class FusedElementwiseOpTest : public OpsTestBase {
+ protected:
+  Status MakeOp(int num_inputs, const std::vector<string>& fused_ops,
+                const std::vector<int32>& operands,
+                const std::vector<int32>& output_ids) {
+    TF_RETURN_IF_ERROR(NodeDefBuilder("fused", "_FusedElementwise")
+                           .Input(FakeInput(num_inputs, DT_FLOAT))
+                           .Attr("num_outputs",
+                                 static_cast<int>(output_ids.size()))
+                           .Attr("fused_ops", fused_ops)
+                           .Attr("operands", operands)
+                           .Attr("output_ids", output_ids)
+                           .Finalize(node_def()));
+    return InitOp();
+  }
+
+  void AddScalar(float value) {
+    AddInputFromArray<float>(TensorShape({}), {value});
+  }
+};
+
+TEST_F(FusedElementwiseOpTest, Gelu) {
+  TF_ASSERT_OK(MakeOp(6, kGeluOps, kGeluOperands, {kGeluOutput}));
+  // Three blocks, the last one partial.
+  Tensor x(DT_FLOAT, TensorShape({3, 700}));
+  x.flat<float>().setRandom();
+  x.flat<float>() = x.flat<float>() * 6.0f - 3.0f;
+  AddInputFromArray<float>(x.shape(), x.flat<float>());
+  for (float value : {3.0f, 0.044715f, 0.79788456f, 1.0f, 0.5f}) {
+    AddScalar(value);
+  }
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected(DT_FLOAT, x.shape());
+  for (int i = 0; i < x.NumElements(); ++i) {
+    expected.flat<float>()(i) = Gelu(x.flat<float>()(i));
+  }
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+}
+
+TEST_F(FusedElementwiseOpTest, LstmCellWithTwoOutputs) {
+  TF_ASSERT_OK(MakeOp(6, kLstmOps, kLstmOperands, kLstmOutputs));
+  std::vector<Tensor> gates;
+  for (int k = 0; k < 5; ++k) {
+    Tensor gate(DT_FLOAT, TensorShape({5, 300}));
+    gate.flat<float>().setRandom();
+    AddInputFromArray<float>(gate.shape(), gate.flat<float>());
+    gates.push_back(gate);
+  }
+  AddScalar(1.0f);
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected_h(DT_FLOAT, gates[0].shape());
+  Tensor expected_c(DT_FLOAT, gates[0].shape());
+  for (int e = 0; e < expected_h.NumElements(); ++e) {
+    const double c = gates[4].flat<float>()(e) *
+                         Sigmoid(gates[2].flat<float>()(e) + 1.0) +
+                     Sigmoid(gates[0].flat<float>()(e)) *
+                         std::tanh(gates[1].flat<float>()(e));
+    expected_c.flat<float>()(e) = c;
+    expected_h.flat<float>()(e) =
+        std::tanh(c) * Sigmoid(gates[3].flat<float>()(e));
+  }
+  test::ExpectTensorNear<float>(expected_h, *GetOutput(0), 1e-5);
+  test::ExpectTensorNear<float>(expected_c, *GetOutput(1), 1e-5);
+}
+
+TEST_F(FusedElementwiseOpTest, BroadcastsAlongLeadingDimensions) {
+  // relu(x * scale + offset) and its square, with a [3] scale and a [1, 3]
+  // offset.
+  TF_ASSERT_OK(MakeOp(3, {"Mul", "Add", "Relu", "Square"},
+                      {0, 1, 3, 2, 4, -1, 5, -1}, {6, 5}));
+  AddInputFromArray<float>(TensorShape({2, 2, 3}),
+                           {1, 2, 3, 4, 5, 6, -1, -2, -3, -4, -5, -6});
+  AddInputFromArray<float>(TensorShape({3}), {1, -1, 2});
+  AddInputFromArray<float>(TensorShape({1, 3}), {0, 1, -2});
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected_relu(DT_FLOAT, TensorShape({2, 2, 3}));
+  test::FillValues<float>(&expected_relu,
+                          {1, 0, 4, 4, 0, 10, 0, 3, 0, 0, 6, 0});
+  Tensor expected_square(DT_FLOAT, TensorShape({2, 2, 3}));
+  test::FillValues<float>(&expected_square,
+                          {1, 0, 16, 16, 0, 100, 0, 9, 0, 0, 36, 0});
+  test::ExpectTensorEqual<float>(expected_square, *GetOutput(0));
+  test::ExpectTensorEqual<float>(expected_relu, *GetOutput(1));
+}
+
+TEST_F(FusedElementwiseOpTest, RejectsTrailingDimensionBroadcast) {
+  TF_ASSERT_OK(MakeOp(2, {"Add"}, {0, 1}, {2}));
+  AddInputFromArray<float>(TensorShape({2, 3}), {1, 2, 3, 4, 5, 6});
+  AddInputFromArray<float>(TensorShape({2, 1}), {1, 2});
+  EXPECT_TRUE(errors::IsInvalidArgument(RunOpKernel()));
+}
+
+TEST_F(FusedElementwiseOpTest, RejectsInvalidPrograms) {
+  // An operand that is computed later.
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      MakeOp(2, {"Add", "Neg"}, {0, 3, 1, -1}, {2})));
+  // A unary op with two operands.
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(MakeOp(2, {"Neg"}, {0, 1}, {2})));
+  // An output that is an input.
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(MakeOp(2, {"Add"}, {0, 1}, {1})));
+  EXPECT_TRUE(errors::IsUnimplemented(MakeOp(2, {"Atan2"}, {0, 1}, {2})));
+}
+
+Node* RandomConstant(Graph* g, const TensorShape& shape) {
+  Tensor t(DT_FLOAT, shape);
+  t.flat<float>().setRandom();
+  return test::graph::Constant(g, t);
+}
+
+Node* ScalarConstant(Graph* g, float value) {
+  Tensor t(DT_FLOAT, TensorShape({}));
+  t.scalar<float>()() = value;
+  return test::graph::Constant(g, t);
+}
+
+Node* FusedElementwise(Graph* g, const std::vector<Node*>& inputs,
+                       const std::vector<string>& fused_ops,
+                       const std::vector<int32>& operands,
+                       const std::vector<int32>& output_ids) {
+  std::vector<NodeBuilder::NodeOut> args;
+  for (Node* input : inputs) args.emplace_back(input);
+  Node* fused;
+  TF_CHECK_OK(NodeBuilder(g->NewName("fused"), "_FusedElementwise")
+                  .Input(args)
+                  .Attr("T", DT_FLOAT)
+                  .Attr("num_outputs", static_cast<int>(output_ids.size()))
+                  .Attr("fused_ops", fused_ops)
+                  .Attr("operands", operands)
+                  .Attr("output_ids", output_ids)
+                  .Finalize(g, &fused));
+  return fused;
+}
+
+// GELU of a [batch, 4096] input, as a _FusedElementwise or as separate ops.
+static Graph* GeluGraph(int batch, bool fused) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Node* x = RandomConstant(g, TensorShape({batch, 4096}));
+  std::vector<Node*> constants;
+  for (float value : {3.0f, 0.044715f, 0.79788456f, 1.0f, 0.5f}) {
+    constants.push_back(ScalarConstant(g, value));
+  }
+  if (fused) {
+    std::vector<Node*> inputs = {x};
+    inputs.insert(inputs.end(), constants.begin(), constants.end());
+    FusedElementwise(g, inputs, kGeluOps, kGeluOperands, {kGeluOutput});
+    return g;
+  }
+  using test::graph::Binary;
+  Node* cube = Binary(g, "Pow", x, constants[0]);
+  Node* inner = Binary(g, "Add", x, Binary(g, "Mul", constants[1], cube));
+  Node* tanh =
+      test::graph::Unary(g, "Tanh", Binary(g, "Mul", constants[2], inner));
+  Binary(g, "Mul", Binary(g, "Mul", constants[4], x),
+         Binary(g, "Add", constants[3], tanh));
+  return g;
+}
+
+// The elementwise part of an LSTM cell of `units` units, as a
+// _FusedElementwise or as separate ops.
+static Graph* LstmCellGraph(int batch, int units, bool fused) {
+  Graph* g = new Graph(OpRegistry::Global());
+  std::vector<Node*> inputs;
+  for (int k = 0; k < 5; ++k) {
+    inputs.push_back(RandomConstant(g, TensorShape({batch, units})));
+  }
+  inputs.push_back(ScalarConstant(g, 1.0f));
+  if (fused) {
+    FusedElementwise(g, inputs, kLstmOps, kLstmOperands, kLstmOutputs);
+    return g;
+  }
+  using test::graph::Binary;
+  using test::graph::Unary;
+  Node* forget =
+      Unary(g, "Sigmoid", Binary(g, "Add", inputs[2], inputs[5]));
+  Node* c = Binary(g, "Add", Binary(g, "Mul", inputs[4], forget),
+                   Binary(g, "Mul", Unary(g, "Sigmoid", inputs[0]),
+                          Unary(g, "Tanh", inputs[1])));
+  Binary(g, "Mul", Unary(g, "Tanh", c), Unary(g, "Sigmoid", inputs[3]));
+  return g;
+}
+
+#define BM_Gelu(B)                                                          \
+  static void BM_Gelu_##B(int iters) {                                      \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B * 4096);          \
+    test::Benchmark("cpu", GeluGraph(B, false)).Run(iters);                 \
+  }                                                                         \
+  BENCHMARK(BM_Gelu_##B);                                                   \
+  static void BM_FusedGelu_##B(int iters) {                                 \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B * 4096);          \
+    test::Benchmark("cpu", GeluGraph(B, true)).Run(iters);                  \
+  }                                                                         \
+  BENCHMARK(BM_FusedGelu_##B);
+
+BM_Gelu(8);
+BM_Gelu(128);
+BM_Gelu(1024);
+
+#define BM_LstmCell(B, U)                                                   \
+  static void BM_LstmCell_##B##_##U(int iters) {                            \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B * U);             \
+    test::Benchmark("cpu", LstmCellGraph(B, U, false)).Run(iters);          \
+  }                                                                         \
+  BENCHMARK(BM_LstmCell_##B##_##U);                                         \
+  static void BM_FusedLstmCell_##B##_##U(int iters) {                       \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B * U);             \
+    test::Benchmark("cpu", LstmCellGraph(B, U, true)).Run(iters);           \
+  }                                                                         \
+  BENCHMARK(BM_FusedLstmCell_##B##_##U);
+
+BM_LstmCell(32, 512);
+BM_LstmCell(128, 1024);
+BM_LstmCell(512, 2048);
+
+}  // namespace
+}  // namespace tensorflow
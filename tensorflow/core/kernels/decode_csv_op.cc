@@ -15,6 +15,7 @@ limitations under the License.
 
 // See docs in ../ops/parsing_ops.cc.
 #include <vector>
+#include "tensorflow/core/framework/compact_string_buffer.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
@@ -78,10 +79,16 @@ class DecodeCSVOp : public OpKernel {
       OP_REQUIRES_OK(ctx, output.allocate(i, records->shape(), &out));
     }
 
+    // The fields of each record are unescaped into one reused buffer, so
+    // that parsing a batch does not allocate a string per field.
+    CompactStringBuffer fields;
+    // NUL-terminated copy of a field for the floating point parsers.
+    string scratch;
     for (int64 i = 0; i < records_size; ++i) {
       const StringPiece record(records_t(i));
-      std::vector<string> fields;
+      fields.Clear();
       ExtractFields(ctx, record, &fields);
+      if (!ctx->status().ok()) return;
       OP_REQUIRES(ctx, fields.size() == out_type_.size(),
                   errors::InvalidArgument("Expect ", out_type_.size(),
                                           " fields but have ", fields.size(),
@@ -90,11 +97,12 @@ class DecodeCSVOp : public OpKernel {
       // Check each field in the record
       for (int f = 0; f < static_cast<int>(out_type_.size()); ++f) {
         const DataType& dtype = out_type_[f];
+        const StringPiece field = fields[f];
         switch (dtype) {
           case DT_INT32: {
             // If this field is empty or NA value, check if default is given:
             // If yes, use default value; Otherwise report error.
-            if (fields[f].empty() || fields[f] == na_value_) {
+            if (field.empty() || field == na_value_) {
               OP_REQUIRES(ctx, record_defaults[f].NumElements() == 1,
                           errors::InvalidArgument(
                               "Field ", f,
@@ -103,10 +111,10 @@ class DecodeCSVOp : public OpKernel {
               output[f]->flat<int32>()(i) = record_defaults[f].flat<int32>()(0);
             } else {
               int32 value;
-              OP_REQUIRES(ctx, strings::safe_strto32(fields[f], &value),
+              OP_REQUIRES(ctx, strings::safe_strto32(field, &value),
                           errors::InvalidArgument(
                               "Field ", f, " in record ", i,
-                              " is not a valid int32: ", fields[f]));
+                              " is not a valid int32: ", field));
               output[f]->flat<int32>()(i) = value;
             }
             break;
@@ -114,7 +122,7 @@ class DecodeCSVOp : public OpKernel {
           case DT_INT64: {
             // If this field is empty or NA value, check if default is given:
             // If yes, use default value; Otherwise report error.
-            if (fields[f].empty() || fields[f] == na_value_) {
+            if (field.empty() || field == na_value_) {
               OP_REQUIRES(ctx, record_defaults[f].NumElements() == 1,
                           errors::InvalidArgument(
                               "Field ", f,
@@ -123,10 +131,10 @@ class DecodeCSVOp : public OpKernel {
               output[f]->flat<int64>()(i) = record_defaults[f].flat<int64>()(0);
             } else {
               int64 value;
-              OP_REQUIRES(ctx, strings::safe_strto64(fields[f], &value),
+              OP_REQUIRES(ctx, strings::safe_strto64(field, &value),
                           errors::InvalidArgument(
                               "Field ", f, " in record ", i,
-                              " is not a valid int64: ", fields[f]));
+                              " is not a valid int64: ", field));
               output[f]->flat<int64>()(i) = value;
             }
             break;
@@ -134,7 +142,7 @@ class DecodeCSVOp : public OpKernel {
           case DT_FLOAT: {
             // If this field is empty or NA value, check if default is given:
             // If yes, use default value; Otherwise report error.
-            if (fields[f].empty() || fields[f] == na_value_) {
+            if (field.empty() || field == na_value_) {
               OP_REQUIRES(ctx, record_defaults[f].NumElements() == 1,
                           errors::InvalidArgument(
                               "Field ", f,
@@ -142,10 +150,11 @@ class DecodeCSVOp : public OpKernel {
               output[f]->flat<float>()(i) = record_defaults[f].flat<float>()(0);
             } else {
               float value;
-              OP_REQUIRES(ctx, strings::safe_strtof(fields[f].c_str(), &value),
+              scratch.assign(field.data(), field.size());
+              OP_REQUIRES(ctx, strings::safe_strtof(scratch.c_str(), &value),
                           errors::InvalidArgument(
                               "Field ", f, " in record ", i,
-                              " is not a valid float: ", fields[f]));
+                              " is not a valid float: ", field));
               output[f]->flat<float>()(i) = value;
             }
             break;
@@ -153,7 +162,7 @@ class DecodeCSVOp : public OpKernel {
           case DT_DOUBLE: {
             // If this field is empty or NA value, check if default is given:
             // If yes, use default value; Otherwise report error.
-            if (fields[f].empty() || fields[f] == na_value_) {
+            if (field.empty() || field == na_value_) {
               OP_REQUIRES(ctx, record_defaults[f].NumElements() == 1,
                           errors::InvalidArgument(
                               "Field ", f,
@@ -162,10 +171,11 @@ class DecodeCSVOp : public OpKernel {
                   record_defaults[f].flat<double>()(0);
             } else {
               double value;
-              OP_REQUIRES(ctx, strings::safe_strtod(fields[f].c_str(), &value),
+              scratch.assign(field.data(), field.size());
+              OP_REQUIRES(ctx, strings::safe_strtod(scratch.c_str(), &value),
                           errors::InvalidArgument(
                               "Field ", f, " in record ", i,
-                              " is not a valid double: ", fields[f]));
+                              " is not a valid double: ", field));
               output[f]->flat<double>()(i) = value;
             }
             break;
@@ -173,7 +183,7 @@ class DecodeCSVOp : public OpKernel {
           case DT_STRING: {
             // If this field is empty or NA value, check if default is given:
             // If yes, use default value; Otherwise report error.
-            if (fields[f].empty() || fields[f] == na_value_) {
+            if (field.empty() || field == na_value_) {
               OP_REQUIRES(ctx, record_defaults[f].NumElements() == 1,
                           errors::InvalidArgument(
                               "Field ", f,
@@ -181,7 +191,7 @@ class DecodeCSVOp : public OpKernel {
               output[f]->flat<string>()(i) =
                   record_defaults[f].flat<string>()(0);
             } else {
-              output[f]->flat<string>()(i) = fields[f];
+              output[f]->flat<string>()(i).assign(field.data(), field.size());
             }
             break;
           }
@@ -203,7 +213,7 @@ class DecodeCSVOp : public OpKernel {
   string na_value_;
 
   void ExtractFields(OpKernelContext* ctx, StringPiece input,
-                     std::vector<string>* result) {
+                     CompactStringBuffer* result) {
     int64 current_idx = 0;
     int64 num_fields_parsed = 0;
     int64 selector_idx = 0;  // Keep track of index into select_cols
@@ -225,9 +235,10 @@ class DecodeCSVOp : public OpKernel {
           current_idx++;
         }
 
-        // This is the body of the field;
-        string field;
+        // This is the body of the field, unescaped into the pending string
+        // of `result`.
         if (!quoted) {
+          const int64 field_start = current_idx;
           while (static_cast<size_t>(current_idx) < input.size() &&
                  input[current_idx] != delim_) {
             OP_REQUIRES(ctx,
@@ -236,9 +247,12 @@ class DecodeCSVOp : public OpKernel {
                             input[current_idx] != '\r',
                         errors::InvalidArgument(
                             "Unquoted fields cannot have quotes/CRLFs inside"));
-            if (include) field += input[current_idx];
             current_idx++;
           }
+          if (include) {
+            result->AppendToPending(
+                input.substr(field_start, current_idx - field_start));
+          }
 
           // Go to next field or the end
           current_idx++;
@@ -248,14 +262,14 @@ class DecodeCSVOp : public OpKernel {
               (static_cast<size_t>(current_idx) < input.size() - 1) &&
               (input[current_idx] != '"' || input[current_idx + 1] != delim_)) {
             if (input[current_idx] != '"') {
-              if (include) field += input[current_idx];
+              if (include) result->AppendToPending(input[current_idx]);
               current_idx++;
             } else {
               OP_REQUIRES(
                   ctx, input[current_idx + 1] == '"',
                   errors::InvalidArgument("Quote inside a string has to be "
                                           "escaped by another quote"));
-              if (include) field += '"';
+              if (include) result->AppendToPending('"');
               current_idx += 2;
             }
           }
@@ -274,7 +288,7 @@ class DecodeCSVOp : public OpKernel {
 
         num_fields_parsed++;
         if (include) {
-          result->push_back(field);
+          result->FinishPending();
           selector_idx++;
           if (selector_idx == select_cols_.size()) return;
         }
@@ -285,7 +299,7 @@ class DecodeCSVOp : public OpKernel {
                                    static_cast<size_t>(num_fields_parsed));
       // Check if the last field is missing
       if (include && input[input.size() - 1] == delim_)
-        result->push_back(string());
+        result->Append(StringPiece());
     }
   }
 };
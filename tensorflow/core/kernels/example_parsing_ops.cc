@@ -27,6 +27,7 @@ limitations under the License.
 #include "tensorflow/core/lib/gtl/array_slice.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/util/example_columns.h"
 #include "tensorflow/core/util/example_proto_fast_parsing.h"
 #include "tensorflow/core/util/example_proto_helper.h"
 #include "tensorflow/core/util/sparse/sparse_tensor.h"
@@ -264,6 +265,108 @@ class ParseSingleExampleOp : public OpKernel {
 REGISTER_KERNEL_BUILDER(Name("ParseSingleExample").Device(DEVICE_CPU),
                         ParseSingleExampleOp);
 
+class ParseExampleColumnsOp : public OpKernel {
+ public:
+  explicit ParseExampleColumnsOp(OpKernelConstruction* ctx) : OpKernel(ctx) {
+    int num_sparse;
+    DataTypeVector sparse_types;
+    DataTypeVector dense_types;
+    std::vector<PartialTensorShape> dense_shapes;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("Nsparse", &num_sparse));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("sparse_types", &sparse_types));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("Tdense", &dense_types));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("dense_shapes", &dense_shapes));
+    OP_REQUIRES(ctx, num_sparse == sparse_types.size(),
+                errors::InvalidArgument("Nsparse (", num_sparse,
+                                        ") != len(sparse_types) (",
+                                        sparse_types.size(), ")"));
+    OP_REQUIRES(ctx, dense_types.size() == dense_shapes.size(),
+                errors::InvalidArgument("len(Tdense) (", dense_types.size(),
+                                        ") != len(dense_shapes) (",
+                                        dense_shapes.size(), ")"));
+    for (size_t d = 0; d < dense_types.size(); ++d) {
+      config_.dense.push_back({dense_types[d], dense_shapes[d]});
+    }
+    for (DataType dtype : sparse_types) {
+      config_.sparse.push_back({dtype});
+    }
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor* serialized;
+    OP_REQUIRES_OK(ctx, ctx->input("serialized", &serialized));
+    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(serialized->shape()),
+                errors::InvalidArgument(
+                    "Expected serialized to be a scalar, got shape: ",
+                    serialized->shape().DebugString()));
+
+    example::Result result;
+    OP_REQUIRES_OK(ctx, example::DecodeExampleColumns(
+                            serialized->scalar<string>()(), config_, &result));
+
+    OpOutputList dense_values;
+    OpOutputList sparse_indices;
+    OpOutputList sparse_values;
+    OpOutputList sparse_shapes;
+    OP_REQUIRES_OK(ctx, ctx->output_list("dense_values", &dense_values));
+    OP_REQUIRES_OK(ctx, ctx->output_list("sparse_indices", &sparse_indices));
+    OP_REQUIRES_OK(ctx, ctx->output_list("sparse_values", &sparse_values));
+    OP_REQUIRES_OK(ctx, ctx->output_list("sparse_shapes", &sparse_shapes));
+    for (size_t d = 0; d < config_.dense.size(); ++d) {
+      dense_values.set(d, result.dense_values[d]);
+    }
+    for (size_t d = 0; d < config_.sparse.size(); ++d) {
+      sparse_indices.set(d, result.sparse_indices[d]);
+      sparse_values.set(d, result.sparse_values[d]);
+      sparse_shapes.set(d, result.sparse_shapes[d]);
+    }
+  }
+
+ private:
+  example::ExampleColumnsConfig config_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("ParseExampleColumns").Device(DEVICE_CPU),
+                        ParseExampleColumnsOp);
+
+class SerializeExampleColumnsOp : public OpKernel {
+ public:
+  explicit SerializeExampleColumnsOp(OpKernelConstruction* ctx)
+      : OpKernel(ctx) {}
+
+  void Compute(OpKernelContext* ctx) override {
+    OpInputList sparse_indices;
+    OpInputList sparse_values;
+    OpInputList sparse_shapes;
+    OpInputList dense_values;
+    OP_REQUIRES_OK(ctx, ctx->input_list("sparse_indices", &sparse_indices));
+    OP_REQUIRES_OK(ctx, ctx->input_list("sparse_values", &sparse_values));
+    OP_REQUIRES_OK(ctx, ctx->input_list("sparse_shapes", &sparse_shapes));
+    OP_REQUIRES_OK(ctx, ctx->input_list("dense_values", &dense_values));
+
+    Tensor* serialized;
+    OP_REQUIRES_OK(ctx,
+                   ctx->allocate_output(0, TensorShape({}), &serialized));
+    OP_REQUIRES_OK(ctx, example::EncodeExampleColumns(
+                            ToVector(sparse_indices), ToVector(sparse_values),
+                            ToVector(sparse_shapes), ToVector(dense_values),
+                            &serialized->scalar<string>()()));
+  }
+
+ private:
+  static std::vector<Tensor> ToVector(const OpInputList& list) {
+    std::vector<Tensor> tensors;
+    tensors.reserve(list.size());
+    for (int i = 0; i < list.size(); ++i) {
+      tensors.push_back(list[i]);
+    }
+    return tensors;
+  }
+};
+
+REGISTER_KERNEL_BUILDER(Name("SerializeExampleColumns").Device(DEVICE_CPU),
+                        SerializeExampleColumnsOp);
+
 class SingleSequenceExampleParserOp : public OpKernel {
  public:
   explicit SingleSequenceExampleParserOp(OpKernelConstruction* ctx)
@@ -31,6 +31,8 @@ limitations under the License.
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/example_columns.h"
+#include "tensorflow/core/util/example_proto_fast_parsing.h"
 
 namespace tensorflow {
 
@@ -97,6 +99,8 @@ struct ExampleStore {
       AddExample(&serialized_example, 10, 512, 1);
       AddExample(&serialized_example, 100, 512, 1);
       AddExample(&serialized_example, 1000, 512, 1);
+      AddExample(&serialized_example, 100, 128, 16);
+      AddExample(&serialized_example, 200, 4096, 1);
       AddExample(&serialized_example, 1, 1, 1000000);
     });
     return serialized_example;
@@ -241,6 +245,68 @@ static Graph* ParseSingleExample(int num_keys, int feature_size) {
   return g;
 }
 
+// Parses the same batch as ParseExample<Options>, but from a column block
+// encoded ahead of time, to compare against the cost of parsing Examples.
+template <typename Options>
+static Graph* ParseExampleColumns(int batch_size, int num_keys,
+                                  int feature_size) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor& serialized_batch =
+      Options::Store::GetSerializedExample()[std::make_tuple(
+          batch_size, num_keys, feature_size)];
+
+  example::FastParseExampleConfig config;
+  std::vector<DataType> sparse_types;
+  std::vector<DataType> dense_types;
+  std::vector<PartialTensorShape> dense_shapes;
+  Options opt;
+  for (int i = 0; i < num_keys; ++i) {
+    string key = strings::Printf("feature_%d", i);
+    switch (opt.benchmark_type) {
+      case kDense:
+        config.dense.push_back({key, opt.filler.dtype,
+                                PartialTensorShape({feature_size}),
+                                opt.filler.make_dense_default(feature_size),
+                                false, static_cast<size_t>(feature_size)});
+        dense_types.push_back(opt.filler.dtype);
+        dense_shapes.push_back(PartialTensorShape({feature_size}));
+        break;
+      case kVarLenDense:
+        config.dense.push_back({key, opt.filler.dtype,
+                                PartialTensorShape({-1}),
+                                opt.filler.make_dense_default(1), true, 1});
+        dense_types.push_back(opt.filler.dtype);
+        dense_shapes.push_back(PartialTensorShape({-1}));
+        break;
+      case kSparse:
+        config.sparse.push_back({key, opt.filler.dtype});
+        sparse_types.push_back(opt.filler.dtype);
+        break;
+    }
+  }
+
+  example::Result result;
+  auto serialized_t = serialized_batch.vec<string>();
+  TF_CHECK_OK(example::FastParseExample(
+      config, gtl::ArraySlice<string>(serialized_t.data(), serialized_t.size()),
+      {}, nullptr, &result));
+  Tensor block(DT_STRING, TensorShape({}));
+  TF_CHECK_OK(example::EncodeExampleColumns(
+      result.sparse_indices, result.sparse_values, result.sparse_shapes,
+      result.dense_values, &block.scalar<string>()()));
+
+  Node* ret;
+  TF_EXPECT_OK(NodeBuilder(g->NewName("n"), "ParseExampleColumns")
+                   .Input(test::graph::Constant(g, block))
+                   .Attr<int64>("Nsparse", sparse_types.size())
+                   .Attr("sparse_types", sparse_types)
+                   .Attr("Tdense", dense_types)
+                   .Attr("dense_shapes", dense_shapes)
+                   .Finalize(g, &ret));
+
+  return g;
+}
+
 // Benchmark settings (Sparse, Dense) X (Bytes, Int64, Float)
 typedef BenchmarkOptions<ExampleStore<BytesFiller>, kSparse> SparseString;
 typedef BenchmarkOptions<ExampleStore<BytesFiller>, kDense> DenseString;
@@ -256,7 +322,7 @@ typedef BenchmarkOptions<ExampleStore<FloatFiller>, kVarLenDense>
     VarLenDenseFloat;
 
 // B == batch_size, K == num_keys. F == feature_size.
-// K must be one of 10, 100, 1000
+// (B, K, F) must be one of the batches added by ExampleStore.
 #define BM_ParseExample(TYPE, B, K, F)                                   \
   static void BM_ParseExample##_##TYPE##_##B##_##K##_##F(int iters) {    \
     int64 items_per_iter = static_cast<int64>(B) * K * F;                \
@@ -266,16 +332,20 @@ typedef BenchmarkOptions<ExampleStore<FloatFiller>, kVarLenDense>
   }                                                                      \
   BENCHMARK(BM_ParseExample##_##TYPE##_##B##_##K##_##F);
 
-#define BM_AllParseExample(Type)       \
-  BM_ParseExample(Type, 1, 10, 1);     \
-  BM_ParseExample(Type, 128, 10, 1);   \
-  BM_ParseExample(Type, 512, 10, 1);   \
-  BM_ParseExample(Type, 1, 100, 1);    \
-  BM_ParseExample(Type, 128, 100, 1);  \
-  BM_ParseExample(Type, 512, 100, 1);  \
-  BM_ParseExample(Type, 1, 1000, 1);   \
-  BM_ParseExample(Type, 128, 1000, 1); \
-  BM_ParseExample(Type, 512, 1000, 1); \
+// The 128 x 100 x 16 batch has multi-valued features; the 4096 x 200 x 1
+// batch is the size of a click-through rate model's training batch.
+#define BM_AllParseExample(Type)        \
+  BM_ParseExample(Type, 1, 10, 1);      \
+  BM_ParseExample(Type, 128, 10, 1);    \
+  BM_ParseExample(Type, 512, 10, 1);    \
+  BM_ParseExample(Type, 1, 100, 1);     \
+  BM_ParseExample(Type, 128, 100, 1);   \
+  BM_ParseExample(Type, 512, 100, 1);   \
+  BM_ParseExample(Type, 1, 1000, 1);    \
+  BM_ParseExample(Type, 128, 1000, 1);  \
+  BM_ParseExample(Type, 512, 1000, 1);  \
+  BM_ParseExample(Type, 128, 100, 16);  \
+  BM_ParseExample(Type, 4096, 200, 1);  \
   BM_ParseExample(Type, 1, 1, 1000000);
 
 BM_AllParseExample(SparseString);
@@ -288,6 +358,31 @@ BM_AllParseExample(SparseFloat);
 BM_AllParseExample(DenseFloat);
 BM_AllParseExample(VarLenDenseFloat);
 
+// Same batches as BM_ParseExample, read from a column block.
+#define BM_ParseExampleColumns(TYPE, B, K, F)                                 \
+  static void BM_ParseExampleColumns##_##TYPE##_##B##_##K##_##F(int iters) {  \
+    int64 items_per_iter = static_cast<int64>(B) * K * F;                     \
+    testing::UseRealTime();                                                   \
+    testing::ItemsProcessed(static_cast<int64>(iters) * items_per_iter);      \
+    test::Benchmark("cpu", ParseExampleColumns<TYPE>(B, K, F)).Run(iters);    \
+  }                                                                           \
+  BENCHMARK(BM_ParseExampleColumns##_##TYPE##_##B##_##K##_##F);
+
+#define BM_AllParseExampleColumns(Type)       \
+  BM_ParseExampleColumns(Type, 128, 10, 1);   \
+  BM_ParseExampleColumns(Type, 512, 100, 1);  \
+  BM_ParseExampleColumns(Type, 128, 1000, 1); \
+  BM_ParseExampleColumns(Type, 128, 100, 16); \
+  BM_ParseExampleColumns(Type, 4096, 200, 1);
+
+BM_AllParseExampleColumns(SparseString);
+BM_AllParseExampleColumns(DenseString);
+BM_AllParseExampleColumns(SparseInt64);
+BM_AllParseExampleColumns(DenseInt64);
+BM_AllParseExampleColumns(SparseFloat);
+BM_AllParseExampleColumns(DenseFloat);
+BM_AllParseExampleColumns(VarLenDenseFloat);
+
 // K == num_keys. F == feature_size.
 // K must be one of 10, 100, 1000
 #define BM_ParseSingleExample(TYPE, K, F)                                \
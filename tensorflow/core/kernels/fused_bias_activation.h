@@ -0,0 +1,99 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Bias and activation stages of kernels that fuse them into the computation
+// of their output, such as _FusedConv2D.
+
+#ifndef TENSORFLOW_CORE_KERNELS_FUSED_BIAS_ACTIVATION_H_
+#define TENSORFLOW_CORE_KERNELS_FUSED_BIAS_ACTIVATION_H_
+
+#include <vector>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/tensor_types.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+
+namespace tensorflow {
+
+enum class FusedActivation { kNone, kRelu, kRelu6 };
+
+// Parses the "fused_ops" attr of a fused kernel, which must be "BiasAdd",
+// optionally followed by "Relu" or "Relu6".
+inline Status ParseFusedBiasActivation(const std::vector<string>& fused_ops,
+                                       FusedActivation* activation) {
+  if (fused_ops.size() == 1 && fused_ops[0] == "BiasAdd") {
+    *activation = FusedActivation::kNone;
+  } else if (fused_ops.size() == 2 && fused_ops[0] == "BiasAdd" &&
+             fused_ops[1] == "Relu") {
+    *activation = FusedActivation::kRelu;
+  } else if (fused_ops.size() == 2 && fused_ops[0] == "BiasAdd" &&
+             fused_ops[1] == "Relu6") {
+    *activation = FusedActivation::kRelu6;
+  } else {
+    return errors::Unimplemented("Unsupported fused ops: [",
+                                 str_util::Join(fused_ops, ", "), "]");
+  }
+  return Status::OK();
+}
+
+// Adds the `depth` values of `bias` to each row of the row-major
+// [num_rows, depth] `block`, then applies `activation`. Kernels call it on
+// blocks of their output right after computing them, while they are still in
+// cache.
+template <typename T>
+void ApplyBiasActivation(const T* bias, int64 depth,
+                         FusedActivation activation, int64 num_rows,
+                         T* block) {
+  typename TTypes<T>::UnalignedConstFlat bias_flat(bias, depth);
+  for (int64 r = 0; r < num_rows; ++r) {
+    typename TTypes<T>::UnalignedFlat row(block + r * depth, depth);
+    switch (activation) {
+      case FusedActivation::kNone:
+        row += bias_flat;
+        break;
+      case FusedActivation::kRelu:
+        row = (row + bias_flat).cwiseMax(static_cast<T>(0));
+        break;
+      case FusedActivation::kRelu6:
+        row = (row + bias_flat)
+                  .cwiseMax(static_cast<T>(0))
+                  .cwiseMin(static_cast<T>(6));
+        break;
+    }
+  }
+}
+
+// Applies `activation` to the `size` values of `data`, for kernels that
+// start from the bias instead of adding it at the end.
+template <typename T>
+void ApplyActivation(FusedActivation activation, int64 size, T* data) {
+  typename TTypes<T>::UnalignedFlat flat(data, size);
+  switch (activation) {
+    case FusedActivation::kNone:
+      break;
+    case FusedActivation::kRelu:
+      flat = flat.cwiseMax(static_cast<T>(0));
+      break;
+    case FusedActivation::kRelu6:
+      flat = flat.cwiseMax(static_cast<T>(0)).cwiseMin(static_cast<T>(6));
+      break;
+  }
+}
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_FUSED_BIAS_ACTIVATION_H_
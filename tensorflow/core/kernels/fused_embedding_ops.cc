@@ -0,0 +1,283 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/math_ops.cc.
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_types.h"
+#include "tensorflow/core/kernels/bounds_check.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+namespace {
+
+enum class Combiner { kSum, kMean, kSqrtN };
+
+Status ParseCombiner(OpKernelConstruction* context, Combiner* combiner) {
+  string name;
+  TF_RETURN_IF_ERROR(context->GetAttr("combiner", &name));
+  if (name == "sum") {
+    *combiner = Combiner::kSum;
+  } else if (name == "mean") {
+    *combiner = Combiner::kMean;
+  } else if (name == "sqrtn") {
+    *combiner = Combiner::kSqrtN;
+  } else {
+    return errors::InvalidArgument("Unknown combiner: ", name);
+  }
+  return Status::OK();
+}
+
+// Checks the weights and the segment ids, which must be sorted and less than
+// `num_segments` if it is not negative, and returns the number of segments in
+// `output_rows`.
+Status ValidateSegments(const Tensor& weights, const Tensor& segment_ids,
+                        int64 num_ids, int64 num_segments,
+                        int64* output_rows) {
+  if (!TensorShapeUtils::IsVector(segment_ids.shape())) {
+    return errors::InvalidArgument("segment_ids should be a vector.");
+  }
+  if (segment_ids.NumElements() != num_ids) {
+    return errors::InvalidArgument("segment_ids has ",
+                                   segment_ids.NumElements(),
+                                   " elements, expected ", num_ids);
+  }
+  if (!TensorShapeUtils::IsVector(weights.shape()) ||
+      (weights.NumElements() != 0 && weights.NumElements() != num_ids)) {
+    return errors::InvalidArgument(
+        "weights should be an empty vector or have one element per id, got "
+        "shape ",
+        weights.shape().DebugString());
+  }
+  const auto segment_vec = segment_ids.vec<int32>();
+  for (int64 i = 0; i < num_ids; ++i) {
+    if (segment_vec(i) < 0) {
+      return errors::InvalidArgument("segment ids must be >= 0");
+    }
+    if (i > 0 && segment_vec(i - 1) > segment_vec(i)) {
+      return errors::InvalidArgument("segment ids are not increasing");
+    }
+  }
+  const int64 last_segment_id_plus_one =
+      num_ids > 0 ? static_cast<int64>(segment_vec(num_ids - 1)) + 1 : 0;
+  if (num_segments >= 0 && last_segment_id_plus_one > num_segments) {
+    return errors::InvalidArgument("Segment id ", last_segment_id_plus_one - 1,
+                                   " out of range [0, ", num_segments, ")");
+  }
+  *output_rows = num_segments >= 0 ? num_segments : last_segment_id_plus_one;
+  return Status::OK();
+}
+
+// Returns the factor that a segment of ids [start, end) is scaled by.
+template <typename T>
+T SegmentScale(Combiner combiner, const T* weights, int64 start, int64 end) {
+  if (combiner == Combiner::kSum) return T(1);
+  if (weights == nullptr) {
+    const T n(end - start);
+    return combiner == Combiner::kMean ? T(1) / n : T(1) / std::sqrt(n);
+  }
+  T sum(0);
+  for (int64 i = start; i < end; ++i) {
+    sum += combiner == Combiner::kMean ? weights[i] : weights[i] * weights[i];
+  }
+  return combiner == Combiner::kMean ? T(1) / sum : T(1) / std::sqrt(sum);
+}
+
+// Calls fn(segment, start, end) for every segment in [segment_start,
+// segment_limit), where [start, end) are its ids.
+template <typename Fn>
+void ForEachSegment(const int32* segment_ids, int64 num_ids,
+                    int64 segment_start, int64 segment_limit, Fn fn) {
+  int64 start =
+      std::lower_bound(segment_ids, segment_ids + num_ids, segment_start) -
+      segment_ids;
+  for (int64 segment = segment_start; segment < segment_limit; ++segment) {
+    int64 end = start;
+    while (end < num_ids && segment_ids[end] == segment) ++end;
+    fn(segment, start, end);
+    start = end;
+  }
+}
+
+}  // namespace
+
+// Gathers rows of an embedding matrix and combines them per segment in a
+// single pass, sharded over the output rows, instead of materializing the
+// gathered and the weighted embeddings.
+template <typename T, typename Tidx>
+class FusedEmbeddingLookupSparseOp : public OpKernel {
+ public:
+  explicit FusedEmbeddingLookupSparseOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, ParseCombiner(context, &combiner_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& params = context->input(0);
+    const Tensor& ids = context->input(1);
+    const Tensor& weights = context->input(2);
+    const Tensor& segment_ids = context->input(3);
+    OP_REQUIRES(
+        context, TensorShapeUtils::IsVectorOrHigher(params.shape()),
+        errors::InvalidArgument("params must be at least 1 dimensional"));
+    OP_REQUIRES(context, TensorShapeUtils::IsVector(ids.shape()),
+                errors::InvalidArgument("ids should be a vector."));
+    const int64 num_ids = ids.NumElements();
+    int64 output_rows;
+    OP_REQUIRES_OK(context, ValidateSegments(weights, segment_ids, num_ids,
+                                             -1, &output_rows));
+
+    auto params_flat = params.flat_outer_dims<T>();
+    const int64 vocab_size = params_flat.dimension(0);
+    const int64 num_col = params_flat.dimension(1);
+    const auto ids_vec = ids.vec<Tidx>();
+    std::vector<Tidx> safe_ids(num_ids);
+    for (int64 i = 0; i < num_ids; ++i) {
+      safe_ids[i] = internal::SubtleMustCopy(ids_vec(i));
+      OP_REQUIRES(context, FastBoundsCheck(safe_ids[i], vocab_size),
+                  errors::InvalidArgument("ids[", i, "] = ", safe_ids[i],
+                                          " is not in [0, ", vocab_size, ")"));
+    }
+
+    TensorShape output_shape = params.shape();
+    output_shape.set_dim(0, output_rows);
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &output));
+    if (output_rows == 0) return;
+    auto output_flat = output->flat_outer_dims<T>();
+
+    const T* weights_ptr =
+        weights.NumElements() > 0 ? weights.flat<T>().data() : nullptr;
+    const int32* segment_ptr = segment_ids.flat<int32>().data();
+    const T* params_ptr = params_flat.data();
+    T* output_ptr = output_flat.data();
+    const Combiner combiner = combiner_;
+    // Accumulates with plain loops over each row: evaluating an Eigen
+    // expression per gathered row costs more than the row itself.
+    auto combine = [&](int64 segment, int64 start, int64 end) {
+      T* out = output_ptr + segment * num_col;
+      std::fill(out, out + num_col, T(0));
+      if (start == end) return;
+      const T scale = SegmentScale(combiner, weights_ptr, start, end);
+      for (int64 i = start; i < end; ++i) {
+        const T* row = params_ptr + safe_ids[i] * num_col;
+        const T w = weights_ptr == nullptr ? scale : weights_ptr[i] * scale;
+        for (int64 j = 0; j < num_col; ++j) out[j] += row[j] * w;
+      }
+    };
+    const DeviceBase::CpuWorkerThreads& workers =
+        *context->device()->tensorflow_cpu_worker_threads();
+    const int64 cost_per_row = (num_ids / output_rows + 1) * num_col * 2;
+    Shard(workers.num_threads, workers.workers, output_rows, cost_per_row,
+          [&](int64 start, int64 limit) {
+            ForEachSegment(segment_ptr, num_ids, start, limit, combine);
+          });
+  }
+
+ private:
+  Combiner combiner_;
+};
+
+// Computes the gradient of FusedEmbeddingLookupSparse with respect to the
+// gathered rows of params: row i is grad[segment_ids[i]] scaled by the weight
+// of id i and the scale of its segment.
+template <typename T>
+class FusedEmbeddingLookupSparseGradOp : public OpKernel {
+ public:
+  explicit FusedEmbeddingLookupSparseGradOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, ParseCombiner(context, &combiner_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& grad = context->input(0);
+    const Tensor& weights = context->input(1);
+    const Tensor& segment_ids = context->input(2);
+    OP_REQUIRES(context, TensorShapeUtils::IsVectorOrHigher(grad.shape()),
+                errors::InvalidArgument("grad must be at least 1 dimensional"));
+    const int64 num_ids = segment_ids.NumElements();
+    const int64 num_segments = grad.dim_size(0);
+    int64 output_rows;
+    OP_REQUIRES_OK(context, ValidateSegments(weights, segment_ids, num_ids,
+                                             num_segments, &output_rows));
+
+    TensorShape output_shape = grad.shape();
+    output_shape.set_dim(0, num_ids);
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &output));
+    if (num_ids == 0) return;
+    auto grad_flat = grad.flat_outer_dims<T>();
+    auto output_flat = output->flat_outer_dims<T>();
+    const int64 num_col = grad_flat.dimension(1);
+
+    const T* weights_ptr =
+        weights.NumElements() > 0 ? weights.flat<T>().data() : nullptr;
+    const int32* segment_ptr = segment_ids.flat<int32>().data();
+    const Combiner combiner = combiner_;
+    auto scatter = [&](int64 segment, int64 start, int64 end) {
+      if (start == end) return;
+      const T scale = SegmentScale(combiner, weights_ptr, start, end);
+      auto g = grad_flat.template chip<0>(segment);
+      for (int64 i = start; i < end; ++i) {
+        const T w = weights_ptr == nullptr ? scale : weights_ptr[i] * scale;
+        output_flat.template chip<0>(i) = g * w;
+      }
+    };
+    const DeviceBase::CpuWorkerThreads& workers =
+        *context->device()->tensorflow_cpu_worker_threads();
+    const int64 cost_per_row = (num_ids / num_segments + 1) * num_col;
+    Shard(workers.num_threads, workers.workers, num_segments, cost_per_row,
+          [&](int64 start, int64 limit) {
+            ForEachSegment(segment_ptr, num_ids, start, limit, scatter);
+          });
+  }
+
+ private:
+  Combiner combiner_;
+};
+
+#define REGISTER_CPU_KERNELS(T)                                          \
+  REGISTER_KERNEL_BUILDER(Name("FusedEmbeddingLookupSparse")             \
+                              .Device(DEVICE_CPU)                        \
+                              .TypeConstraint<T>("T")                    \
+                              .TypeConstraint<int32>("Tidx"),            \
+                          FusedEmbeddingLookupSparseOp<T, int32>);       \
+  REGISTER_KERNEL_BUILDER(Name("FusedEmbeddingLookupSparse")             \
+                              .Device(DEVICE_CPU)                        \
+                              .TypeConstraint<T>("T")                    \
+                              .TypeConstraint<int64>("Tidx"),            \
+                          FusedEmbeddingLookupSparseOp<T, int64>);       \
+  REGISTER_KERNEL_BUILDER(Name("FusedEmbeddingLookupSparseGrad")         \
+                              .Device(DEVICE_CPU)                        \
+                              .TypeConstraint<T>("T"),                   \
+                          FusedEmbeddingLookupSparseGradOp<T>);
+
+REGISTER_CPU_KERNELS(float);
+REGISTER_CPU_KERNELS(double);
+#undef REGISTER_CPU_KERNELS
+
+}  // namespace tensorflow
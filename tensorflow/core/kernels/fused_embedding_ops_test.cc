@@ -0,0 +1,256 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cmath>
+#include <unordered_set>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+class FusedEmbeddingLookupSparseOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(const string& combiner) {
+    TF_ASSERT_OK(NodeDefBuilder("op", "FusedEmbeddingLookupSparse")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT64))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT32))
+                     .Attr("combiner", combiner)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Adds a vocabulary of 4 embeddings of dimension 2, and 4 ids of which 2
+  // are in segment 0 and 2 in segment 2.
+  void AddInputs(bool weighted) {
+    AddInputFromArray<float>(TensorShape({4, 2}),
+                             {1, 2, 3, 4, 5, 6, 7, 8});
+    AddInputFromArray<int64>(TensorShape({4}), {0, 3, 1, 1});
+    if (weighted) {
+      AddInputFromArray<float>(TensorShape({4}), {1, 3, 2, 2});
+    } else {
+      AddInputFromArray<float>(TensorShape({0}), {});
+    }
+    AddInputFromArray<int32>(TensorShape({4}), {0, 0, 2, 2});
+  }
+};
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, Sum) {
+  MakeOp("sum");
+  AddInputs(/*weighted=*/false);
+  TF_ASSERT_OK(RunOpKernel());
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({3, 2}));
+  test::FillValues<float>(&expected, {8, 10, 0, 0, 6, 8});
+  test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+}
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, WeightedMean) {
+  MakeOp("mean");
+  AddInputs(/*weighted=*/true);
+  TF_ASSERT_OK(RunOpKernel());
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({3, 2}));
+  test::FillValues<float>(&expected, {22.0f / 4, 26.0f / 4, 0, 0, 3, 4});
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+}
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, WeightedSqrtN) {
+  MakeOp("sqrtn");
+  AddInputs(/*weighted=*/true);
+  TF_ASSERT_OK(RunOpKernel());
+  const float s0 = std::sqrt(10.0f);
+  const float s2 = std::sqrt(8.0f);
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({3, 2}));
+  test::FillValues<float>(&expected,
+                          {22 / s0, 26 / s0, 0, 0, 12 / s2, 16 / s2});
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+}
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, BadIds) {
+  MakeOp("sum");
+  AddInputFromArray<float>(TensorShape({2, 1}), {1, 2});
+  AddInputFromArray<int64>(TensorShape({2}), {0, 2});
+  AddInputFromArray<float>(TensorShape({0}), {});
+  AddInputFromArray<int32>(TensorShape({2}), {0, 1});
+  EXPECT_TRUE(errors::IsInvalidArgument(RunOpKernel()));
+}
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, UnsortedSegments) {
+  MakeOp("sum");
+  AddInputFromArray<float>(TensorShape({2, 1}), {1, 2});
+  AddInputFromArray<int64>(TensorShape({2}), {0, 1});
+  AddInputFromArray<float>(TensorShape({0}), {});
+  AddInputFromArray<int32>(TensorShape({2}), {1, 0});
+  EXPECT_TRUE(errors::IsInvalidArgument(RunOpKernel()));
+}
+
+class FusedEmbeddingLookupSparseGradOpTest : public OpsTestBase {};
+
+TEST_F(FusedEmbeddingLookupSparseGradOpTest, WeightedMean) {
+  TF_ASSERT_OK(NodeDefBuilder("op", "FusedEmbeddingLookupSparseGrad")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_INT32))
+                   .Attr("combiner", "mean")
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInputFromArray<float>(TensorShape({3, 2}), {4, 8, 100, 100, 1, 2});
+  AddInputFromArray<float>(TensorShape({4}), {1, 3, 2, 2});
+  AddInputFromArray<int32>(TensorShape({4}), {0, 0, 2, 2});
+  TF_ASSERT_OK(RunOpKernel());
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({4, 2}));
+  test::FillValues<float>(&expected, {1, 2, 3, 6, 0.5, 1, 0.5, 1});
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+}
+
+const int kVocabSize = 100000;
+const int kEmbeddingDim = 64;
+
+struct SparseFeature {
+  Tensor ids;
+  Tensor weights;
+  Tensor segment_ids;
+};
+
+// Returns a batch of `batch_size` examples with `ids_per_example` random ids
+// each.
+SparseFeature RandomFeature(int batch_size, int ids_per_example) {
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  const int num_ids = batch_size * ids_per_example;
+  SparseFeature feature{Tensor(DT_INT64, TensorShape({num_ids})),
+                        Tensor(DT_FLOAT, TensorShape({num_ids})),
+                        Tensor(DT_INT32, TensorShape({num_ids}))};
+  for (int i = 0; i < num_ids; ++i) {
+    feature.ids.flat<int64>()(i) = rnd.Uniform(kVocabSize);
+    feature.weights.flat<float>()(i) = rnd.RandFloat();
+    feature.segment_ids.flat<int32>()(i) = i / ids_per_example;
+  }
+  return feature;
+}
+
+Node* Params(Graph* g) {
+  Tensor params(DT_FLOAT, TensorShape({kVocabSize, kEmbeddingDim}));
+  params.flat<float>().setRandom();
+  return test::graph::Constant(g, params);
+}
+
+void BM_FusedEmbeddingLookupSparse(int iters, int batch_size,
+                                   int ids_per_example) {
+  testing::StopTiming();
+  Graph* g = new Graph(OpRegistry::Global());
+  const SparseFeature feature = RandomFeature(batch_size, ids_per_example);
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "FusedEmbeddingLookupSparse")
+                  .Input(Params(g))
+                  .Input(test::graph::Constant(g, feature.ids))
+                  .Input(test::graph::Constant(g, feature.weights))
+                  .Input(test::graph::Constant(g, feature.segment_ids))
+                  .Attr("combiner", "mean")
+                  .Finalize(g, &node));
+  testing::ItemsProcessed(static_cast<int64>(iters) * batch_size *
+                          ids_per_example);
+  testing::UseRealTime();
+  testing::StartTiming();
+  test::Benchmark("cpu", g).Run(iters);
+}
+
+// The graph that tf.nn.embedding_lookup_sparse builds for a weighted sparse
+// feature with the "mean" combiner.
+void BM_UnfusedEmbeddingLookupSparse(int iters, int batch_size,
+                                     int ids_per_example) {
+  testing::StopTiming();
+  Graph* g = new Graph(OpRegistry::Global());
+  const SparseFeature feature = RandomFeature(batch_size, ids_per_example);
+  Node* unique;
+  TF_CHECK_OK(NodeBuilder(g->NewName("unique"), "Unique")
+                  .Input(test::graph::Constant(g, feature.ids))
+                  .Finalize(g, &unique));
+  Node* axis = test::graph::Constant(g, test::AsScalar<int32>(0));
+  Node* embeddings = test::graph::Gather(g, Params(g), unique, axis);
+  NodeBuilder::NodeOut idx(unique, 1);
+  TF_CHECK_OK(NodeBuilder(g->NewName("gather"), "GatherV2")
+                  .Input(embeddings)
+                  .Input(idx)
+                  .Input(axis)
+                  .Finalize(g, &embeddings));
+  Node* column_shape = test::graph::Constant(g, test::AsTensor<int32>({-1, 1}));
+  Node* weights = test::graph::Constant(g, feature.weights);
+  Node* segment_ids = test::graph::Constant(g, feature.segment_ids);
+  Node* column_weights;
+  TF_CHECK_OK(NodeBuilder(g->NewName("reshape"), "Reshape")
+                  .Input(weights)
+                  .Input(column_shape)
+                  .Finalize(g, &column_weights));
+  embeddings = test::graph::Binary(g, "Mul", embeddings, column_weights);
+  Node* sum;
+  TF_CHECK_OK(NodeBuilder(g->NewName("segment_sum"), "SegmentSum")
+                  .Input(embeddings)
+                  .Input(segment_ids)
+                  .Finalize(g, &sum));
+  Node* weight_sum;
+  TF_CHECK_OK(NodeBuilder(g->NewName("segment_sum"), "SegmentSum")
+                  .Input(weights)
+                  .Input(segment_ids)
+                  .Finalize(g, &weight_sum));
+  TF_CHECK_OK(NodeBuilder(g->NewName("reshape"), "Reshape")
+                  .Input(weight_sum)
+                  .Input(column_shape)
+                  .Finalize(g, &weight_sum));
+  test::graph::Binary(g, "RealDiv", sum, weight_sum);
+  // The gathered unique embeddings, their gather by id and the weighted
+  // embeddings, which the fused op doesn't materialize.
+  const int64 num_ids = feature.ids.NumElements();
+  const std::unordered_set<int64> unique_ids(
+      feature.ids.flat<int64>().data(),
+      feature.ids.flat<int64>().data() + num_ids);
+  const int64 intermediate_bytes =
+      (unique_ids.size() + 2 * num_ids) * kEmbeddingDim * sizeof(float);
+  testing::SetLabel(
+      strings::StrCat("intermediates: ", intermediate_bytes >> 10, "KB"));
+  testing::ItemsProcessed(static_cast<int64>(iters) * batch_size *
+                          ids_per_example);
+  testing::UseRealTime();
+  testing::StartTiming();
+  test::Benchmark("cpu", g).Run(iters);
+}
+
+BENCHMARK(BM_UnfusedEmbeddingLookupSparse)
+    ->ArgPair(128, 10)
+    ->ArgPair(128, 100)
+    ->ArgPair(1024, 10)
+    ->ArgPair(1024, 100);
+BENCHMARK(BM_FusedEmbeddingLookupSparse)
+    ->ArgPair(128, 10)
+    ->ArgPair(128, 100)
+    ->ArgPair(1024, 10)
+    ->ArgPair(1024, 100);
+
+}  // namespace
+}  // namespace tensorflow
@@ -24,17 +24,34 @@ limitations under the License.
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/variant.h"
 #include "tensorflow/core/kernels/initializable_lookup_table.h"
-#include "tensorflow/core/lib/gtl/inlined_vector.h"
+#include "tensorflow/core/kernels/memmapped_lookup_table.h"
+#include "tensorflow/core/kernels/sharded_hash_map.h"
 #include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace lookup {
 
-// Lookup table that wraps an unordered_map, where the key and value data type
+namespace {
+
+// Number of independently locked shards of a MutableHashTable.
+constexpr int kNumMutableHashTableShards = 16;
+
+const DeviceBase::CpuWorkerThreads* WorkerThreads(OpKernelContext* ctx) {
+  return ctx == nullptr ? nullptr
+                        : ctx->device()->tensorflow_cpu_worker_threads();
+}
+
+}  // namespace
+
+// Lookup table that wraps a ShardedHashMap, where the key and value data type
 // is specified. Each individual value must be a scalar. If vector values are
 // required, use MutableHashTableOfTensors.
 //
 // This table is mutable and thread safe - Insert can be called at any time.
+// Keys are spread over shards that are locked independently, so concurrent
+// lookups and inserts of different keys rarely contend, and the keys of a
+// large batch are processed in parallel.
 //
 // Sample use case:
 //
@@ -47,72 +64,45 @@ namespace lookup {
 template <class K, class V>
 class MutableHashTableOfScalars final : public LookupInterface {
  public:
-  MutableHashTableOfScalars(OpKernelContext* ctx, OpKernel* kernel) {}
+  MutableHashTableOfScalars(OpKernelContext* ctx, OpKernel* kernel)
+      : table_(kNumMutableHashTableShards, 1) {}
 
-  size_t size() const override {
-    mutex_lock l(mu_);
-    return table_.size();
-  }
+  size_t size() const override { return table_.size(); }
 
   Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
               const Tensor& default_value) override {
-    const V default_val = default_value.flat<V>()(0);
-    const auto key_values = key.flat<K>();
-    auto value_values = value->flat<V>();
-
-    mutex_lock l(mu_);
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      value_values(i) = gtl::FindWithDefault(
-          table_, SubtleMustCopyIfIntegral(key_values(i)), default_val);
-    }
-
-    return Status::OK();
-  }
-
-  Status DoInsert(bool clear, const Tensor& keys, const Tensor& values) {
-    const auto key_values = keys.flat<K>();
-    const auto value_values = values.flat<V>();
-
-    mutex_lock l(mu_);
-    if (clear) {
-      table_.clear();
-    }
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      gtl::InsertOrUpdate(&table_, SubtleMustCopyIfIntegral(key_values(i)),
-                          SubtleMustCopyIfIntegral(value_values(i)));
-    }
+    table_.Find(key.flat<K>().data(), key.NumElements(),
+                default_value.flat<V>().data(), value->flat<V>().data(),
+                WorkerThreads(ctx));
     return Status::OK();
   }
 
   Status Insert(OpKernelContext* ctx, const Tensor& keys,
                 const Tensor& values) override {
-    return DoInsert(false, keys, values);
+    table_.Insert(keys.flat<K>().data(), keys.NumElements(),
+                  values.flat<V>().data(), WorkerThreads(ctx));
+    return Status::OK();
   }
 
   Status ImportValues(OpKernelContext* ctx, const Tensor& keys,
                       const Tensor& values) override {
-    return DoInsert(true, keys, values);
+    table_.Import(keys.flat<K>().data(), keys.NumElements(),
+                  values.flat<V>().data(), WorkerThreads(ctx));
+    return Status::OK();
   }
 
   Status ExportValues(OpKernelContext* ctx) override {
-    mutex_lock l(mu_);
-    int64 size = table_.size();
-
-    Tensor* keys;
-    Tensor* values;
-    TF_RETURN_IF_ERROR(
-        ctx->allocate_output("keys", TensorShape({size}), &keys));
-    TF_RETURN_IF_ERROR(
-        ctx->allocate_output("values", TensorShape({size}), &values));
-
-    auto keys_data = keys->flat<K>();
-    auto values_data = values->flat<V>();
-    int64 i = 0;
-    for (auto it = table_.begin(); it != table_.end(); ++it, ++i) {
-      keys_data(i) = it->first;
-      values_data(i) = it->second;
-    }
-    return Status::OK();
+    return table_.Export([ctx](int64 size, K** keys_data, V** values_data) {
+      Tensor* keys;
+      Tensor* values;
+      TF_RETURN_IF_ERROR(
+          ctx->allocate_output("keys", TensorShape({size}), &keys));
+      TF_RETURN_IF_ERROR(
+          ctx->allocate_output("values", TensorShape({size}), &values));
+      *keys_data = keys->flat<K>().data();
+      *values_data = values->flat<V>().data();
+      return Status::OK();
+    });
   }
 
   DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
@@ -124,26 +114,14 @@ class MutableHashTableOfScalars final : public LookupInterface {
   TensorShape value_shape() const override { return TensorShape(); }
 
   int64 MemoryUsed() const override {
-    int64 ret = 0;
-    mutex_lock l(mu_);
-    for (unsigned i = 0; i < table_.bucket_count(); ++i) {
-      size_t bucket_size = table_.bucket_size(i);
-      if (bucket_size == 0) {
-        ret++;
-      } else {
-        ret += bucket_size;
-      }
-    }
-    return sizeof(MutableHashTableOfScalars) + ret;
+    return sizeof(MutableHashTableOfScalars) + table_.MemoryUsed();
   }
 
  private:
-  // TODO(andreasst): consider using a read/write lock or a concurrent map
-  mutable mutex mu_;
-  std::unordered_map<K, V> table_ GUARDED_BY(mu_);
+  ShardedHashMap<K, V> table_;
 };
 
-// Lookup table that wraps an unordered_map. Behaves identical to
+// Lookup table that wraps a ShardedHashMap. Behaves identical to
 // MutableHashTableOfScalars except that each value must be a vector.
 template <class K, class V>
 class MutableHashTableOfTensors final : public LookupInterface {
@@ -155,93 +133,48 @@ class MutableHashTableOfTensors final : public LookupInterface {
         ctx, TensorShapeUtils::IsVector(value_shape_),
         errors::InvalidArgument("Default value must be a vector, got shape ",
                                 value_shape_.DebugString()));
+    table_.reset(new ShardedHashMap<K, V>(kNumMutableHashTableShards,
+                                          value_shape_.dim_size(0)));
   }
 
-  size_t size() const override {
-    mutex_lock l(mu_);
-    return table_.size();
-  }
+  size_t size() const override { return table_->size(); }
 
   Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
               const Tensor& default_value) override {
-    const auto default_flat = default_value.flat<V>();
-    const auto key_values = key.flat<K>();
-    auto value_values = value->flat_inner_dims<V, 2>();
-    int64 value_dim = value_shape_.dim_size(0);
-
-    mutex_lock l(mu_);
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      ValueArray* value_vec =
-          gtl::FindOrNull(table_, SubtleMustCopyIfIntegral(key_values(i)));
-      if (value_vec != nullptr) {
-        for (int64 j = 0; j < value_dim; j++) {
-          value_values(i, j) = value_vec->at(j);
-        }
-      } else {
-        for (int64 j = 0; j < value_dim; j++) {
-          value_values(i, j) = default_flat(j);
-        }
-      }
-    }
-
-    return Status::OK();
-  }
-
-  Status DoInsert(bool clear, const Tensor& keys, const Tensor& values) {
-    const auto key_values = keys.flat<K>();
-    const auto value_values = values.flat_inner_dims<V, 2>();
-    int64 value_dim = value_shape_.dim_size(0);
-
-    mutex_lock l(mu_);
-    if (clear) {
-      table_.clear();
-    }
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      ValueArray value_vec;
-      for (int64 j = 0; j < value_dim; j++) {
-        V value = value_values(i, j);
-        value_vec.push_back(value);
-      }
-      gtl::InsertOrUpdate(&table_, SubtleMustCopyIfIntegral(key_values(i)),
-                          value_vec);
-    }
+    table_->Find(key.flat<K>().data(), key.NumElements(),
+                 default_value.flat<V>().data(), value->flat<V>().data(),
+                 WorkerThreads(ctx));
     return Status::OK();
   }
 
   Status Insert(OpKernelContext* ctx, const Tensor& keys,
                 const Tensor& values) override {
-    return DoInsert(false, keys, values);
+    table_->Insert(keys.flat<K>().data(), keys.NumElements(),
+                   values.flat<V>().data(), WorkerThreads(ctx));
+    return Status::OK();
   }
 
   Status ImportValues(OpKernelContext* ctx, const Tensor& keys,
                       const Tensor& values) override {
-    return DoInsert(true, keys, values);
+    table_->Import(keys.flat<K>().data(), keys.NumElements(),
+                   values.flat<V>().data(), WorkerThreads(ctx));
+    return Status::OK();
   }
 
   Status ExportValues(OpKernelContext* ctx) override {
-    mutex_lock l(mu_);
-    int64 size = table_.size();
-    int64 value_dim = value_shape_.dim_size(0);
-
-    Tensor* keys;
-    Tensor* values;
-    TF_RETURN_IF_ERROR(
-        ctx->allocate_output("keys", TensorShape({size}), &keys));
-    TF_RETURN_IF_ERROR(ctx->allocate_output(
-        "values", TensorShape({size, value_dim}), &values));
-
-    auto keys_data = keys->flat<K>();
-    auto values_data = values->matrix<V>();
-    int64 i = 0;
-    for (auto it = table_.begin(); it != table_.end(); ++it, ++i) {
-      K key = it->first;
-      ValueArray value = it->second;
-      keys_data(i) = key;
-      for (int64 j = 0; j < value_dim; j++) {
-        values_data(i, j) = value[j];
-      }
-    }
-    return Status::OK();
+    const int64 value_dim = value_shape_.dim_size(0);
+    return table_->Export(
+        [ctx, value_dim](int64 size, K** keys_data, V** values_data) {
+          Tensor* keys;
+          Tensor* values;
+          TF_RETURN_IF_ERROR(
+              ctx->allocate_output("keys", TensorShape({size}), &keys));
+          TF_RETURN_IF_ERROR(ctx->allocate_output(
+              "values", TensorShape({size, value_dim}), &values));
+          *keys_data = keys->flat<K>().data();
+          *values_data = values->flat<V>().data();
+          return Status::OK();
+        });
   }
 
   DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
@@ -253,25 +186,12 @@ class MutableHashTableOfTensors final : public LookupInterface {
   TensorShape value_shape() const override { return value_shape_; }
 
   int64 MemoryUsed() const override {
-    int64 ret = 0;
-    mutex_lock l(mu_);
-    for (unsigned i = 0; i < table_.bucket_count(); ++i) {
-      size_t bucket_size = table_.bucket_size(i);
-      if (bucket_size == 0) {
-        ret++;
-      } else {
-        ret += bucket_size;
-      }
-    }
-    return sizeof(MutableHashTableOfTensors) + ret;
+    return sizeof(MutableHashTableOfTensors) + table_->MemoryUsed();
   }
 
  private:
   TensorShape value_shape_;
-  // TODO(andreasst): consider using a read/write lock or a concurrent map
-  mutable mutex mu_;
-  typedef gtl::InlinedVector<V, 4> ValueArray;
-  std::unordered_map<K, ValueArray> table_ GUARDED_BY(mu_);
+  std::unique_ptr<ShardedHashMap<K, V>> table_;
 };
 
 namespace {
@@ -642,6 +562,101 @@ class MutableDenseHashTable final : public LookupInterface {
   uint64 empty_key_hash_;
 };
 
+// Read-only lookup table that memory maps a file written by
+// MemmappedTableBuilder, e.g. with the build_memmapped_lookup_table tool.
+// Creating it takes constant time however large the table is, and the pages
+// of the file are shared by all tables that map it, including tables of other
+// processes.
+template <class K, class V>
+class MemmappedHashTable final : public LookupInterface {
+ public:
+  MemmappedHashTable(OpKernelContext* ctx, OpKernel* kernel) {
+    const Tensor& filename = ctx->input(0);
+    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(filename.shape()),
+                errors::InvalidArgument("filename must be a scalar, got shape ",
+                                        filename.shape().DebugString()));
+    OP_REQUIRES_OK(ctx, MemmappedTable<K, V>::Open(
+                            ctx->env(), filename.scalar<string>()(),
+                            key_dtype(), value_dtype(), &table_));
+  }
+
+  size_t size() const override { return table_->size(); }
+
+  Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
+              const Tensor& default_value) override {
+    const V default_val = default_value.flat<V>()(0);
+    const auto key_values = key.flat<K>();
+    auto value_values = value->flat<V>();
+
+    mutex mu;
+    Status status;
+    auto work = [&](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        bool found;
+        Status s = table_->Find(key_values(i), &value_values(i), &found);
+        if (!s.ok()) {
+          mutex_lock l(mu);
+          status.Update(s);
+          return;
+        }
+        if (!found) value_values(i) = default_val;
+      }
+    };
+    const auto* workers = ctx->device()->tensorflow_cpu_worker_threads();
+    Shard(workers->num_threads, workers->workers, key_values.size(),
+          kFindCost, work);
+    return status;
+  }
+
+  Status Insert(OpKernelContext* ctx, const Tensor& keys,
+                const Tensor& values) override {
+    return errors::Unimplemented("MemmappedHashTable is read-only");
+  }
+
+  Status ImportValues(OpKernelContext* ctx, const Tensor& keys,
+                      const Tensor& values) override {
+    return errors::Unimplemented("MemmappedHashTable is read-only");
+  }
+
+  Status ExportValues(OpKernelContext* ctx) override {
+    const int64 size = table_->size();
+    Tensor* keys;
+    Tensor* values;
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("keys", TensorShape({size}), &keys));
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("values", TensorShape({size}), &values));
+    auto keys_data = keys->flat<K>();
+    auto values_data = values->flat<V>();
+    int64 i = 0;
+    return table_->ForEach([&](const K& key, const V& value) {
+      keys_data(i) = key;
+      values_data(i) = value;
+      ++i;
+    });
+  }
+
+  DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
+
+  DataType value_dtype() const override { return DataTypeToEnum<V>::v(); }
+
+  TensorShape key_shape() const final { return TensorShape(); }
+
+  TensorShape value_shape() const override { return TensorShape(); }
+
+  // The mapped file is not counted, since it is not allocated by the table.
+  int64 MemoryUsed() const override { return sizeof(MemmappedHashTable); }
+
+ private:
+  // Rough cost of a lookup in cycles, for the work sharder.
+  static constexpr int64 kFindCost = 200;
+
+  std::unique_ptr<MemmappedTable<K, V>> table_;
+};
+
+template <class K, class V>
+constexpr int64 MemmappedHashTable<K, V>::kFindCost;
+
 }  // namespace lookup
 
 // Table lookup op. Perform the lookup operation on the given table.
@@ -875,6 +890,27 @@ REGISTER_KERNEL(string, bool);
 
 #undef REGISTER_KERNEL
 
+// Register the MemmappedHashTable op.
+#define REGISTER_KERNEL(key_dtype, value_dtype)                         \
+  REGISTER_KERNEL_BUILDER(                                              \
+      Name("MemmappedHashTable")                                        \
+          .Device(DEVICE_CPU)                                           \
+          .TypeConstraint<key_dtype>("key_dtype")                       \
+          .TypeConstraint<value_dtype>("value_dtype"),                  \
+      LookupTableOp<lookup::MemmappedHashTable<key_dtype, value_dtype>, \
+                    key_dtype, value_dtype>)
+
+REGISTER_KERNEL(string, int64);
+REGISTER_KERNEL(string, float);
+REGISTER_KERNEL(string, double);
+REGISTER_KERNEL(string, string);
+REGISTER_KERNEL(int64, int64);
+REGISTER_KERNEL(int64, float);
+REGISTER_KERNEL(int64, double);
+REGISTER_KERNEL(int64, string);
+
+#undef REGISTER_KERNEL
+
 // Register the MutableDenseHashTable op.
 #define REGISTER_KERNEL(key_dtype, value_dtype)                            \
   REGISTER_KERNEL_BUILDER(                                                 \
@@ -0,0 +1,143 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+// Number of entries in the tables that are looked up.
+const int kTableSize = 1 << 20;
+
+Tensor RandomKeys(int num_keys, random::SimplePhilox* rnd) {
+  Tensor keys(DT_INT64, TensorShape({num_keys}));
+  auto keys_flat = keys.flat<int64>();
+  for (int i = 0; i < num_keys; ++i) {
+    keys_flat(i) = rnd->Uniform64(2 * kTableSize);
+  }
+  return keys;
+}
+
+// Adds an int64 -> float table to `g`. `table_op` is either
+// "MutableHashTableV2" or "MutableDenseHashTableV2".
+Node* Table(Graph* g, const string& table_op) {
+  Node* table;
+  NodeBuilder builder(g->NewName("table"), table_op);
+  if (table_op == "MutableDenseHashTableV2") {
+    builder.Input(test::graph::Constant(g, test::AsScalar<int64>(-1)));
+  }
+  TF_CHECK_OK(builder.Attr("shared_name", "bm_table")
+                  .Attr("key_dtype", DT_INT64)
+                  .Attr("value_dtype", DT_FLOAT)
+                  .Finalize(g, &table));
+  return table;
+}
+
+Node* Insert(Graph* g, Node* table, const Tensor& keys) {
+  Tensor values(DT_FLOAT, keys.shape());
+  values.flat<float>().setConstant(1.0f);
+  Node* insert;
+  TF_CHECK_OK(NodeBuilder(g->NewName("insert"), "LookupTableInsertV2")
+                  .Input(table)
+                  .Input(test::graph::Constant(g, keys))
+                  .Input(test::graph::Constant(g, values))
+                  .Finalize(g, &insert));
+  return insert;
+}
+
+// Returns a graph that fills a `table_op` table with kTableSize entries.
+Graph* FillTable(const string& table_op, random::SimplePhilox* rnd) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Insert(g, Table(g, table_op), RandomKeys(kTableSize, rnd));
+  return g;
+}
+
+// Looks up `num_keys` keys in a table of kTableSize entries, from each of
+// `num_finds` LookupTableFindV2 ops that run concurrently. About half of the
+// keys are in the table.
+void BM_Find(int iters, const string& table_op, int num_keys, int num_finds) {
+  testing::StopTiming();
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  Graph* init = FillTable(table_op, &rnd);
+  Graph* g = new Graph(OpRegistry::Global());
+  Node* table = Table(g, table_op);
+  Node* default_value = test::graph::Constant(g, test::AsScalar<float>(0.0f));
+  for (int i = 0; i < num_finds; ++i) {
+    Node* find;
+    TF_CHECK_OK(NodeBuilder(g->NewName("find"), "LookupTableFindV2")
+                    .Input(table)
+                    .Input(test::graph::Constant(g, RandomKeys(num_keys, &rnd)))
+                    .Input(default_value)
+                    .Finalize(g, &find));
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_keys * num_finds);
+  testing::UseRealTime();
+  testing::StartTiming();
+  test::Benchmark("cpu", g, nullptr, init).Run(iters);
+}
+
+// Inserts `num_keys` keys into a table of kTableSize entries.
+void BM_Insert(int iters, const string& table_op, int num_keys) {
+  testing::StopTiming();
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  Graph* init = FillTable(table_op, &rnd);
+  Graph* g = new Graph(OpRegistry::Global());
+  Insert(g, Table(g, table_op), RandomKeys(num_keys, &rnd));
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_keys);
+  testing::UseRealTime();
+  testing::StartTiming();
+  test::Benchmark("cpu", g, nullptr, init).Run(iters);
+}
+
+void BM_MutableHashTableFind(int iters, int num_keys, int num_finds) {
+  BM_Find(iters, "MutableHashTableV2", num_keys, num_finds);
+}
+void BM_MutableDenseHashTableFind(int iters, int num_keys, int num_finds) {
+  BM_Find(iters, "MutableDenseHashTableV2", num_keys, num_finds);
+}
+void BM_MutableHashTableInsert(int iters, int num_keys) {
+  BM_Insert(iters, "MutableHashTableV2", num_keys);
+}
+void BM_MutableDenseHashTableInsert(int iters, int num_keys) {
+  BM_Insert(iters, "MutableDenseHashTableV2", num_keys);
+}
+
+BENCHMARK(BM_MutableHashTableFind)
+    ->ArgPair(1024, 1)
+    ->ArgPair(64 * 1024, 1)
+    ->ArgPair(1024 * 1024, 1)
+    ->ArgPair(1024, 16)
+    ->ArgPair(64 * 1024, 16);
+BENCHMARK(BM_MutableDenseHashTableFind)
+    ->ArgPair(1024, 1)
+    ->ArgPair(64 * 1024, 1)
+    ->ArgPair(1024 * 1024, 1)
+    ->ArgPair(1024, 16)
+    ->ArgPair(64 * 1024, 16);
+BENCHMARK(BM_MutableHashTableInsert)->Arg(1024)->Arg(64 * 1024);
+BENCHMARK(BM_MutableDenseHashTableInsert)->Arg(1024)->Arg(64 * 1024);
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,321 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Implements _FusedMatMul, a matrix multiplication followed by a bias
+// addition and an optional activation, which the grappler Remapper
+// substitutes for MatMul + BiasAdd (+ Relu or Relu6) on CPU.
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/kernels/fused_bias_activation.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+typedef Eigen::ThreadPoolDevice CPUDevice;
+
+namespace {
+
+// The product a * b is computed as its transpose b' * a' with Eigen's
+// general block-panel (GEBP) kernel, in tiles of kColBlock columns and
+// kRowBlock rows of the output. b' is the left-hand side of the GEBP kernel,
+// which takes it packed in blocks of kColBlock rows and kDepthBlock columns.
+// Packing is as costly as a pass over b, and _FusedMatMul keeps b packed
+// across calls when b is a constant. The bias is the initial value of each
+// output tile and the activation is applied to the tile right after it is
+// computed, while it is still in cache.
+const int64 kDepthBlock = 256;
+const int64 kColBlock = 128;
+const int64 kRowBlock = 128;
+
+template <typename T>
+struct GebpTypes {
+  typedef Eigen::internal::gebp_traits<T, T> Traits;
+  typedef Eigen::internal::const_blas_data_mapper<T, int64, Eigen::ColMajor>
+      ColMajorMapper;
+  typedef Eigen::internal::const_blas_data_mapper<T, int64, Eigen::RowMajor>
+      RowMajorMapper;
+  typedef Eigen::internal::blas_data_mapper<T, int64, Eigen::ColMajor>
+      OutputMapper;
+};
+
+// The [depth, cols] right-hand side of a matrix multiplication, transposed
+// and packed for the GEBP kernel.
+template <typename T>
+class PackedMatMulWeights {
+ public:
+  // Packs `b`, which is [depth, cols], or [cols, depth] if `transpose_b`.
+  PackedMatMulWeights(const DeviceBase::CpuWorkerThreads& workers,
+                      const Tensor& b, bool transpose_b)
+      : source_(b),
+        depth_(b.dim_size(transpose_b ? 1 : 0)),
+        cols_(b.dim_size(transpose_b ? 0 : 1)),
+        num_depth_blocks_((depth_ + kDepthBlock - 1) / kDepthBlock),
+        num_col_blocks_((cols_ + kColBlock - 1) / kColBlock),
+        packed_(DataTypeToEnum<T>::value,
+                TensorShape({num_col_blocks_ * num_depth_blocks_ *
+                             kDepthBlock * kColBlock})) {
+    typedef typename GebpTypes<T>::ColMajorMapper ColMajorMapper;
+    typedef typename GebpTypes<T>::RowMajorMapper RowMajorMapper;
+    const T* data = b.flat<T>().data();
+    auto pack = [this, data, transpose_b](int64 begin, int64 end) {
+      if (transpose_b) {
+        PackColBlocks<RowMajorMapper, Eigen::RowMajor>(
+            RowMajorMapper(data, depth_), begin, end);
+      } else {
+        PackColBlocks<ColMajorMapper, Eigen::ColMajor>(
+            ColMajorMapper(data, cols_), begin, end);
+      }
+    };
+    Shard(workers.num_threads, workers.workers, num_col_blocks_,
+          2 * kColBlock * depth_, pack);
+  }
+
+  // Returns whether these are the weights of `b`, that is whether `b` is the
+  // same constant that was packed.
+  bool IsPackingOf(const Tensor& b) const {
+    return b.SharesBufferWith(source_) && b.shape() == source_.shape();
+  }
+
+  int64 depth() const { return depth_; }
+  int64 cols() const { return cols_; }
+  int64 num_depth_blocks() const { return num_depth_blocks_; }
+  int64 num_col_blocks() const { return num_col_blocks_; }
+
+  // Returns the packed block of depth block `d` of column block `c`.
+  const T* block(int64 c, int64 d) const {
+    return packed_.flat<T>().data() +
+           (c * num_depth_blocks_ + d) * kDepthBlock * kColBlock;
+  }
+
+ private:
+  template <typename Mapper, int StorageOrder>
+  void PackColBlocks(const Mapper& mapper, int64 begin, int64 end) {
+    typedef typename GebpTypes<T>::Traits Traits;
+    Eigen::internal::gemm_pack_lhs<T, int64, Mapper, Traits::mr,
+                                   Traits::LhsProgress, StorageOrder>
+        pack_lhs;
+    for (int64 c = begin; c < end; ++c) {
+      const int64 col = c * kColBlock;
+      const int64 num_cols = std::min(kColBlock, cols_ - col);
+      for (int64 d = 0; d < num_depth_blocks_; ++d) {
+        const int64 depth = d * kDepthBlock;
+        pack_lhs(const_cast<T*>(block(c, d)), mapper.getSubMapper(col, depth),
+                 std::min(kDepthBlock, depth_ - depth), num_cols);
+      }
+    }
+  }
+
+  // Holds on to the packed tensor, so that its buffer can't be reused for
+  // another one that IsPackingOf() would mistake for it.
+  const Tensor source_;
+  const int64 depth_;
+  const int64 cols_;
+  const int64 num_depth_blocks_;
+  const int64 num_col_blocks_;
+  Tensor packed_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(PackedMatMulWeights);
+};
+
+// Computes output tiles [begin, end) of the [rows, weights.cols()] `output`,
+// each kRowBlock x kColBlock, with row-major tile numbering.
+template <typename T, typename Mapper, int StorageOrder>
+void FusedMatMulTiles(const Mapper& a, int64 rows,
+                      const PackedMatMulWeights<T>& weights, const T* bias,
+                      FusedActivation activation, int64 begin, int64 end,
+                      T* output) {
+  typedef typename GebpTypes<T>::Traits Traits;
+  typedef typename GebpTypes<T>::OutputMapper OutputMapper;
+  Eigen::internal::gemm_pack_rhs<T, int64, Mapper, Traits::nr, StorageOrder>
+      pack_rhs;
+  Eigen::internal::gebp_kernel<T, T, int64, OutputMapper, Traits::mr,
+                               Traits::nr, false, false>
+      gebp;
+
+  const int64 cols = weights.cols();
+  const OutputMapper output_mapper(output, cols);
+  Tensor packed_a(DataTypeToEnum<T>::value,
+                  TensorShape({kDepthBlock * std::min(rows, kRowBlock)}));
+  T* packed_a_data = packed_a.flat<T>().data();
+  for (int64 tile = begin; tile < end; ++tile) {
+    const int64 row = tile / weights.num_col_blocks() * kRowBlock;
+    const int64 num_rows = std::min(kRowBlock, rows - row);
+    const int64 c = tile % weights.num_col_blocks();
+    const int64 col = c * kColBlock;
+    const int64 num_cols = std::min(kColBlock, cols - col);
+
+    for (int64 r = row; r < row + num_rows; ++r) {
+      std::copy(bias + col, bias + col + num_cols, output + r * cols + col);
+    }
+    for (int64 d = 0; d < weights.num_depth_blocks(); ++d) {
+      const int64 depth = d * kDepthBlock;
+      const int64 num_depth = std::min(kDepthBlock, weights.depth() - depth);
+      pack_rhs(packed_a_data, a.getSubMapper(depth, row), num_depth,
+               num_rows);
+      gebp(output_mapper.getSubMapper(col, row), weights.block(c, d),
+           packed_a_data, num_cols, num_depth, num_rows, static_cast<T>(1));
+    }
+    if (activation != FusedActivation::kNone) {
+      for (int64 r = row; r < row + num_rows; ++r) {
+        ApplyActivation(activation, num_cols, output + r * cols + col);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+template <typename T>
+class FusedMatMulOp : public OpKernel {
+ public:
+  explicit FusedMatMulOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("transpose_a", &transpose_a_));
+    OP_REQUIRES_OK(context, context->GetAttr("transpose_b", &transpose_b_));
+    OP_REQUIRES_OK(context,
+                   context->GetAttr("b_is_constant", &b_is_constant_));
+    std::vector<string> fused_ops;
+    OP_REQUIRES_OK(context, context->GetAttr("fused_ops", &fused_ops));
+    OP_REQUIRES_OK(context, ParseFusedBiasActivation(fused_ops, &activation_));
+    int num_args;
+    OP_REQUIRES_OK(context, context->GetAttr("num_args", &num_args));
+    OP_REQUIRES(context, num_args == 1,
+                errors::InvalidArgument(
+                    "_FusedMatMul with BiasAdd must have one extra argument: "
+                    "bias, got ",
+                    num_args));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& a = context->input(0);
+    const Tensor& b = context->input(1);
+    const Tensor& bias = context->input(2);
+
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(a.shape()),
+                errors::InvalidArgument("In[0] is not a matrix"));
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(b.shape()),
+                errors::InvalidArgument("In[1] is not a matrix"));
+    const int64 rows = a.dim_size(transpose_a_ ? 1 : 0);
+    const int64 depth = a.dim_size(transpose_a_ ? 0 : 1);
+    const int64 cols = b.dim_size(transpose_b_ ? 0 : 1);
+    OP_REQUIRES(
+        context, depth == b.dim_size(transpose_b_ ? 1 : 0),
+        errors::InvalidArgument(
+            "Matrix size-incompatible: In[0]: ", a.shape().DebugString(),
+            ", In[1]: ", b.shape().DebugString()));
+    OP_REQUIRES(context,
+                TensorShapeUtils::IsVector(bias.shape()) &&
+                    bias.dim_size(0) == cols,
+                errors::InvalidArgument(
+                    "bias must be a vector of the product's ", cols,
+                    " columns, got shape ", bias.shape().DebugString()));
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(
+                                0, TensorShape({rows, cols}), &output));
+    if (output->NumElements() == 0) return;
+    T* output_data = output->flat<T>().data();
+    const T* bias_data = bias.flat<T>().data();
+
+    if (depth == 0 || rows == 1) {
+      // A vector-matrix product gains nothing from packing b, which it reads
+      // only once, and Eigen's contraction has a fast path for it.
+      auto out = output->matrix<T>();
+      if (depth == 0) {
+        out.setZero();
+      } else {
+        Eigen::array<Eigen::IndexPair<Eigen::DenseIndex>, 1> dim_pair;
+        dim_pair[0].first = transpose_a_ ? 0 : 1;
+        dim_pair[0].second = transpose_b_ ? 1 : 0;
+        out.device(context->eigen_device<CPUDevice>()) =
+            a.matrix<T>().contract(b.matrix<T>(), dim_pair);
+      }
+      ApplyBiasActivation(bias_data, cols, activation_, rows, output_data);
+      return;
+    }
+
+    const DeviceBase::CpuWorkerThreads& workers =
+        *context->device()->tensorflow_cpu_worker_threads();
+    std::shared_ptr<const PackedMatMulWeights<T>> weights;
+    if (b_is_constant_) {
+      mutex_lock l(mu_);
+      if (weights_ == nullptr || !weights_->IsPackingOf(b)) {
+        weights_.reset(new PackedMatMulWeights<T>(workers, b, transpose_b_));
+      }
+      weights = weights_;
+    } else {
+      weights.reset(new PackedMatMulWeights<T>(workers, b, transpose_b_));
+    }
+
+    const int64 num_tiles =
+        (rows + kRowBlock - 1) / kRowBlock * weights->num_col_blocks();
+    const T* a_data = a.flat<T>().data();
+    const bool transpose_a = transpose_a_;
+    const FusedActivation activation = activation_;
+    auto compute_tiles = [a_data, rows, depth, transpose_a, &weights,
+                          bias_data, activation,
+                          output_data](int64 begin, int64 end) {
+      typedef typename GebpTypes<T>::ColMajorMapper ColMajorMapper;
+      typedef typename GebpTypes<T>::RowMajorMapper RowMajorMapper;
+      // a' is [depth, rows], which is a col-major view of a and a row-major
+      // view of a transposed.
+      if (transpose_a) {
+        FusedMatMulTiles<T, RowMajorMapper, Eigen::RowMajor>(
+            RowMajorMapper(a_data, rows), rows, *weights, bias_data,
+            activation, begin, end, output_data);
+      } else {
+        FusedMatMulTiles<T, ColMajorMapper, Eigen::ColMajor>(
+            ColMajorMapper(a_data, depth), rows, *weights, bias_data,
+            activation, begin, end, output_data);
+      }
+    };
+    Shard(workers.num_threads, workers.workers, num_tiles,
+          2 * kRowBlock * kColBlock * depth, compute_tiles);
+  }
+
+ private:
+  bool transpose_a_;
+  bool transpose_b_;
+  bool b_is_constant_;
+  FusedActivation activation_;
+
+  mutex mu_;
+  // The packed weights of the last constant b.
+  std::shared_ptr<const PackedMatMulWeights<T>> weights_ GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(FusedMatMulOp);
+};
+
+#define REGISTER_KERNEL(T)                                               \
+  REGISTER_KERNEL_BUILDER(                                               \
+      Name("_FusedMatMul").Device(DEVICE_CPU).TypeConstraint<T>("T"),  \
+      FusedMatMulOp<T>);
+
+TF_CALL_float(REGISTER_KERNEL);
+TF_CALL_double(REGISTER_KERNEL);
+#undef REGISTER_KERNEL
+
+}  // namespace tensorflow
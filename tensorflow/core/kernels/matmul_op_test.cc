@@ -13,10 +13,21 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include "tensorflow/cc/ops/const_op.h"
+#include "tensorflow/cc/ops/standard_ops.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/protobuf/rewriter_config.pb.h"
+#include "tensorflow/core/public/session.h"
 
 namespace tensorflow {
 
@@ -127,4 +138,204 @@ BM_Matmul(2000, 1, 2000, true, false);
 BM_Matmul(2000, 1, 2000, false, true);
 BM_Matmul(2000, 1, 2000, true, true);
 
+class FusedMatMulWithBiasOpTest : public OpsTestBase {
+ protected:
+  // Runs MatMul, BiasAdd and `activation` as separate ops, with grappler
+  // prevented from fusing them.
+  void RunUnfused(const Tensor& a, const Tensor& b, const Tensor& bias,
+                  bool transpose_a, bool transpose_b,
+                  const string& activation, Tensor* output) {
+    auto root = tensorflow::Scope::NewRootScope();
+    using namespace ::tensorflow::ops;  // NOLINT(build/namespaces)
+
+    Output matmul =
+        MatMul(root.WithOpName("matmul"),
+               Const(root.WithOpName("a"), Input::Initializer(a)),
+               Const(root.WithOpName("b"), Input::Initializer(b)),
+               MatMul::TransposeA(transpose_a).TransposeB(transpose_b));
+    Output result =
+        BiasAdd(root.WithOpName("bias_add"), matmul,
+                Const(root.WithOpName("bias"), Input::Initializer(bias)));
+    if (activation == "Relu") {
+      result = Relu(root.WithOpName("activation"), result);
+    } else if (activation == "Relu6") {
+      result = Relu6(root.WithOpName("activation"), result);
+    }
+
+    tensorflow::GraphDef graph;
+    TF_ASSERT_OK(root.ToGraphDef(&graph));
+
+    SessionOptions options;
+    options.config.mutable_graph_options()
+        ->mutable_rewrite_options()
+        ->set_remapping(RewriterConfig::OFF);
+    std::unique_ptr<tensorflow::Session> session(NewSession(options));
+    TF_ASSERT_OK(session->Create(graph));
+
+    std::vector<Tensor> outputs;
+    TF_ASSERT_OK(session->Run({}, {result.node()->name()}, {}, &outputs));
+    *output = outputs[0];
+  }
+
+  // Compares _FusedMatMul of a [rows, depth] and a [depth, cols] matrix with
+  // the ops it fuses on random inputs, on two runs with different `a`.
+  void VerifyFusedMatMul(int rows, int depth, int cols, bool transpose_a,
+                         bool transpose_b, bool b_is_constant,
+                         const string& activation) {
+    Tensor a(DT_FLOAT, transpose_a ? TensorShape({depth, rows})
+                                   : TensorShape({rows, depth}));
+    a.flat<float>().setRandom();
+    Tensor b(DT_FLOAT, transpose_b ? TensorShape({cols, depth})
+                                   : TensorShape({depth, cols}));
+    b.flat<float>().setRandom();
+    Tensor bias(DT_FLOAT, TensorShape({cols}));
+    bias.flat<float>().setRandom();
+    // Center the output around zero, so that the activation clips part of it.
+    bias.flat<float>() = bias.flat<float>() - 0.25f * depth;
+
+    std::vector<string> fused_ops = {"BiasAdd"};
+    if (!activation.empty()) fused_ops.push_back(activation);
+    TF_ASSERT_OK(NodeDefBuilder("fused_matmul", "_FusedMatMul")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(1, DT_FLOAT))
+                     .Attr("num_args", 1)
+                     .Attr("transpose_a", transpose_a)
+                     .Attr("transpose_b", transpose_b)
+                     .Attr("b_is_constant", b_is_constant)
+                     .Attr("fused_ops", fused_ops)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    AddInputFromArray<float>(a.shape(), a.flat<float>());
+    AddInputFromArray<float>(b.shape(), b.flat<float>());
+    AddInputFromArray<float>(bias.shape(), bias.flat<float>());
+
+    // The second run multiplies by the weights packed by the first one when
+    // b is constant.
+    for (int run = 0; run < 2; ++run) {
+      Tensor* a_input = mutable_input(0).tensor;
+      a_input->flat<float>().setRandom();
+      Tensor expected;
+      RunUnfused(*a_input, b, bias, transpose_a, transpose_b, activation,
+                 &expected);
+      TF_ASSERT_OK(RunOpKernel());
+      test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-3);
+    }
+  }
+};
+
+TEST_F(FusedMatMulWithBiasOpTest, SmallWithRelu) {
+  VerifyFusedMatMul(3, 5, 7, false, false, true, "Relu");
+}
+
+TEST_F(FusedMatMulWithBiasOpTest, TransposeAWithRelu6) {
+  VerifyFusedMatMul(5, 9, 33, true, false, true, "Relu6");
+}
+
+TEST_F(FusedMatMulWithBiasOpTest, TransposeBWithoutActivation) {
+  VerifyFusedMatMul(6, 17, 20, false, true, true, "");
+}
+
+TEST_F(FusedMatMulWithBiasOpTest, TransposeBothNotConstant) {
+  VerifyFusedMatMul(9, 4, 16, true, true, false, "Relu");
+}
+
+TEST_F(FusedMatMulWithBiasOpTest, SingleRow) {
+  VerifyFusedMatMul(1, 64, 48, false, false, true, "Relu");
+}
+
+// Spans several blocks of rows, columns and depth.
+TEST_F(FusedMatMulWithBiasOpTest, ManyBlocks) {
+  VerifyFusedMatMul(200, 300, 260, false, false, true, "Relu");
+}
+
+TEST_F(FusedMatMulWithBiasOpTest, ManyBlocksTransposed) {
+  VerifyFusedMatMul(130, 520, 150, true, true, false, "Relu6");
+}
+
+TEST_F(FusedMatMulWithBiasOpTest, IncompatibleShapes) {
+  TF_ASSERT_OK(NodeDefBuilder("fused_matmul", "_FusedMatMul")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(1, DT_FLOAT))
+                   .Attr("num_args", 1)
+                   .Attr("fused_ops", {"BiasAdd"})
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInputFromArray<float>(TensorShape({2, 3}), {1, 2, 3, 4, 5, 6});
+  AddInputFromArray<float>(TensorShape({2, 2}), {1, 2, 3, 4});
+  AddInputFromArray<float>(TensorShape({2}), {1, 2});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(errors::IsInvalidArgument(s));
+  EXPECT_TRUE(str_util::StrContains(s.ToString(), "Matrix size-incompatible"))
+      << s;
+}
+
+TEST_F(FusedMatMulWithBiasOpTest, UnsupportedFusedOps) {
+  TF_ASSERT_OK(NodeDefBuilder("fused_matmul", "_FusedMatMul")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(1, DT_FLOAT))
+                   .Attr("num_args", 1)
+                   .Attr("fused_ops", {"Relu"})
+                   .Finalize(node_def()));
+  EXPECT_TRUE(errors::IsUnimplemented(InitOp()));
+}
+
+// MatMul + BiasAdd + Relu of a [batch, depth] input and constant
+// [depth, cols] weights, as a _FusedMatMul or as separate ops.
+static Graph* MatMulBiasRelu(int batch, int depth, int cols, bool fused) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor input(DT_FLOAT, TensorShape({batch, depth}));
+  input.flat<float>().setRandom();
+  Tensor weights(DT_FLOAT, TensorShape({depth, cols}));
+  weights.flat<float>().setRandom();
+  Tensor bias(DT_FLOAT, TensorShape({cols}));
+  bias.flat<float>().setRandom();
+  Node* input_node = test::graph::Constant(g, input);
+  Node* weights_node = test::graph::Constant(g, weights);
+  Node* bias_node = test::graph::Constant(g, bias);
+
+  if (fused) {
+    Node* matmul;
+    TF_CHECK_OK(NodeBuilder(g->NewName("fused_matmul"), "_FusedMatMul")
+                    .Input(input_node)
+                    .Input(weights_node)
+                    .Input({NodeBuilder::NodeOut(bias_node)})
+                    .Attr("T", DT_FLOAT)
+                    .Attr("num_args", 1)
+                    .Attr("b_is_constant", true)
+                    .Attr("fused_ops", {"BiasAdd", "Relu"})
+                    .Finalize(g, &matmul));
+    return g;
+  }
+  Node* matmul = test::graph::Matmul(g, input_node, weights_node, false, false);
+  test::graph::Relu(g, test::graph::BiasAdd(g, matmul, bias_node));
+  return g;
+}
+
+#define BM_MatMulBiasRelu(B, K, N)                                          \
+  static void BM_MatMulBiasRelu_##B##_##K##_##N(int iters) {                \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B * K * N * 2);     \
+    test::Benchmark("cpu", MatMulBiasRelu(B, K, N, false)).Run(iters);      \
+  }                                                                         \
+  BENCHMARK(BM_MatMulBiasRelu_##B##_##K##_##N);                             \
+  static void BM_FusedMatMulBiasRelu_##B##_##K##_##N(int iters) {           \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B * K * N * 2);     \
+    test::Benchmark("cpu", MatMulBiasRelu(B, K, N, true)).Run(iters);       \
+  }                                                                         \
+  BENCHMARK(BM_FusedMatMulBiasRelu_##B##_##K##_##N);
+
+// Fully connected layers at inference and training batch sizes.
+BM_MatMulBiasRelu(1, 1024, 1024);
+BM_MatMulBiasRelu(8, 1024, 1024);
+BM_MatMulBiasRelu(32, 1024, 1024);
+BM_MatMulBiasRelu(128, 1024, 1024);
+BM_MatMulBiasRelu(512, 1024, 1024);
+BM_MatMulBiasRelu(1, 2048, 512);
+BM_MatMulBiasRelu(8, 2048, 512);
+BM_MatMulBiasRelu(32, 2048, 512);
+BM_MatMulBiasRelu(128, 2048, 512);
+BM_MatMulBiasRelu(512, 2048, 512);
+
 }  // end namespace tensorflow
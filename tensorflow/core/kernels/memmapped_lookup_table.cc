@@ -0,0 +1,117 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/memmapped_lookup_table.h"
+
+#include <cstring>
+
+namespace tensorflow {
+namespace lookup {
+namespace memmapped_table {
+
+namespace {
+
+const char kMagic[8] = {'T', 'F', 'M', 'M', 'T', 'B', 'L', '\0'};
+const uint32 kByteOrder = 0x01020304;
+const uint32 kVersion = 1;
+
+uint64 Padded(uint64 bytes) { return (bytes + 7) & ~uint64{7}; }
+
+}  // namespace
+
+Status CheckHeader(const void* data, uint64 length, DataType key_dtype,
+                   DataType value_dtype, const MemmappedTableHeader** header) {
+  if (length < sizeof(MemmappedTableHeader)) {
+    return errors::DataLoss("Memmapped table file is too short: ", length,
+                            " bytes");
+  }
+  const MemmappedTableHeader* h =
+      static_cast<const MemmappedTableHeader*>(data);
+  if (memcmp(h->magic, kMagic, sizeof(kMagic)) != 0) {
+    return errors::DataLoss("Not a memmapped table file");
+  }
+  if (h->byte_order != kByteOrder) {
+    return errors::FailedPrecondition(
+        "Memmapped table file was built on a machine of different byte order");
+  }
+  if (h->version != kVersion) {
+    return errors::FailedPrecondition("Unsupported memmapped table version ",
+                                      h->version, ", expected ", kVersion);
+  }
+  if (h->key_dtype != key_dtype || h->value_dtype != value_dtype) {
+    return errors::InvalidArgument(
+        "Memmapped table file maps ",
+        DataTypeString(static_cast<DataType>(h->key_dtype)), " to ",
+        DataTypeString(static_cast<DataType>(h->value_dtype)),
+        ", but the table maps ", DataTypeString(key_dtype), " to ",
+        DataTypeString(value_dtype));
+  }
+  if (h->index_bits >= 48 || h->file_size != length ||
+      h->index_offset != sizeof(MemmappedTableHeader) ||
+      h->keys_offset < h->index_offset ||
+      (h->keys_offset - h->index_offset) / sizeof(uint64) <=
+          (uint64{1} << h->index_bits) ||
+      h->values_offset < h->keys_offset || h->file_size < h->values_offset ||
+      h->keys_offset % 8 != 0 || h->values_offset % 8 != 0) {
+    return errors::DataLoss("Corrupt memmapped table header");
+  }
+  *header = h;
+  return Status::OK();
+}
+
+Status WriteHeaderAndIndex(DataType key_dtype, DataType value_dtype,
+                           uint32 index_bits,
+                           const std::vector<uint64>& bucket_sizes,
+                           uint64 keys_bytes, uint64 values_bytes,
+                           WritableFile* file) {
+  std::vector<uint64> index;
+  index.reserve(bucket_sizes.size() + 1);
+  uint64 num_entries = 0;
+  index.push_back(num_entries);
+  for (const uint64 bucket_size : bucket_sizes) {
+    num_entries += bucket_size;
+    index.push_back(num_entries);
+  }
+
+  MemmappedTableHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.byte_order = kByteOrder;
+  header.version = kVersion;
+  header.key_dtype = key_dtype;
+  header.value_dtype = value_dtype;
+  header.index_bits = index_bits;
+  header.num_entries = num_entries;
+  header.index_offset = sizeof(header);
+  header.keys_offset = header.index_offset + index.size() * sizeof(uint64);
+  header.values_offset = header.keys_offset + Padded(keys_bytes);
+  header.file_size = header.values_offset + Padded(values_bytes);
+
+  TF_RETURN_IF_ERROR(file->Append(
+      StringPiece(reinterpret_cast<const char*>(&header), sizeof(header))));
+  return file->Append(StringPiece(reinterpret_cast<const char*>(index.data()),
+                                  index.size() * sizeof(uint64)));
+}
+
+Status Pad(uint64* bytes, WritableFile* file) {
+  static const char kZeros[8] = {0};
+  const uint64 padding = Padded(*bytes) - *bytes;
+  *bytes += padding;
+  return file->Append(StringPiece(kZeros, padding));
+}
+
+}  // namespace memmapped_table
+}  // namespace lookup
+}  // namespace tensorflow
@@ -0,0 +1,423 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_KERNELS_MEMMAPPED_LOOKUP_TABLE_H_
+#define TENSORFLOW_KERNELS_MEMMAPPED_LOOKUP_TABLE_H_
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace lookup {
+
+// Immutable hash tables that are memory mapped from a file, rather than
+// parsed and inserted entry by entry. Opening one only validates the header
+// of the file, in constant time, and processes that map the same file share
+// its pages. The index and string offsets are checked as lookups read them.
+//
+// A table file starts with a MemmappedTableHeader, followed by three
+// sections, each aligned to 8 bytes:
+//   index:  (1 << index_bits) + 1 uint64s. The entries whose keys hash to
+//           bucket b (the top index_bits bits of the hash) are the entries
+//           [index[b], index[b + 1]).
+//   keys:   The key of each entry.
+//   values: The value of each entry.
+// A section of numbers holds one number per entry. A section of strings holds
+// num_entries + 1 uint64 offsets, followed by the string data: string i is
+// data[offset[i], offset[i + 1]).
+//
+// Files are written in the byte order of the machine that builds them, and
+// are rejected by machines of the other byte order.
+struct MemmappedTableHeader {
+  char magic[8];
+  uint32 byte_order;
+  uint32 version;
+  uint32 key_dtype;
+  uint32 value_dtype;
+  uint32 index_bits;
+  uint32 reserved;
+  uint64 num_entries;
+  uint64 index_offset;
+  uint64 keys_offset;
+  uint64 values_offset;
+  uint64 file_size;
+};
+
+namespace memmapped_table {
+
+// Hash of a key, which is part of the file format.
+inline uint64 HashKey(const string& key) { return Hash64(key); }
+inline uint64 HashKey(StringPiece key) {
+  return Hash64(key.data(), key.size());
+}
+inline uint64 HashKey(int64 key) {
+  uint64 h = static_cast<uint64>(key);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+inline uint64 Bucket(uint64 hash, uint32 index_bits) {
+  return index_bits == 0 ? 0 : hash >> (64 - index_bits);
+}
+
+// Validates the header of a table file of `length` bytes at `data`, holding
+// `key_dtype` keys and `value_dtype` values.
+Status CheckHeader(const void* data, uint64 length, DataType key_dtype,
+                   DataType value_dtype, const MemmappedTableHeader** header);
+
+// Writes the header and index of a table to `file`. `bucket_sizes` holds the
+// number of entries of each bucket. The sections of keys and values are
+// `keys_bytes` and `values_bytes` long, without padding.
+Status WriteHeaderAndIndex(DataType key_dtype, DataType value_dtype,
+                           uint32 index_bits,
+                           const std::vector<uint64>& bucket_sizes,
+                           uint64 keys_bytes, uint64 values_bytes,
+                           WritableFile* file);
+
+// Pads `file`, which holds `*bytes` bytes so far, to 8 bytes.
+Status Pad(uint64* bytes, WritableFile* file);
+
+// Read-only view of a section of keys or values of type T.
+template <typename T>
+class Column {
+ public:
+  Column() {}
+  Column(const char* section, uint64 section_bytes, uint64 num_entries)
+      : data_(reinterpret_cast<const T*>(section)) {}
+
+  static uint64 Bytes(const std::vector<T>& elements,
+                      const std::vector<uint64>& order) {
+    return order.size() * sizeof(T);
+  }
+
+  static bool Valid(uint64 section_bytes, uint64 num_entries) {
+    return num_entries <= section_bytes / sizeof(T);
+  }
+
+  bool Get(uint64 i, T* element) const {
+    *element = data_[i];
+    return true;
+  }
+
+  // Sets `*equal` to whether element i is `element`. Returns false if
+  // element i is corrupt.
+  bool Equals(uint64 i, const T& element, bool* equal) const {
+    *equal = data_[i] == element;
+    return true;
+  }
+
+  // Writes `elements[order[i]]` for each i.
+  static Status Write(const std::vector<T>& elements,
+                      const std::vector<uint64>& order, WritableFile* file) {
+    std::vector<T> buffer;
+    buffer.reserve(order.size());
+    for (const uint64 i : order) buffer.push_back(elements[i]);
+    return file->Append(
+        StringPiece(reinterpret_cast<const char*>(buffer.data()),
+                    buffer.size() * sizeof(T)));
+  }
+
+ private:
+  const T* data_ = nullptr;
+};
+
+template <>
+class Column<string> {
+ public:
+  Column() {}
+  Column(const char* section, uint64 section_bytes, uint64 num_entries)
+      : offsets_(reinterpret_cast<const uint64*>(section)),
+        data_(section + (num_entries + 1) * sizeof(uint64)),
+        data_bytes_(section_bytes - (num_entries + 1) * sizeof(uint64)) {}
+
+  static uint64 Bytes(const std::vector<string>& elements,
+                      const std::vector<uint64>& order) {
+    uint64 bytes = (order.size() + 1) * sizeof(uint64);
+    for (const uint64 i : order) bytes += elements[i].size();
+    return bytes;
+  }
+
+  static bool Valid(uint64 section_bytes, uint64 num_entries) {
+    return num_entries < section_bytes / sizeof(uint64);
+  }
+
+  // Returns false if the offsets of string i are corrupt.
+  bool Get(uint64 i, StringPiece* element) const {
+    const uint64 begin = offsets_[i];
+    const uint64 end = offsets_[i + 1];
+    if (begin > end || end > data_bytes_) return false;
+    *element = StringPiece(data_ + begin, end - begin);
+    return true;
+  }
+
+  bool Get(uint64 i, string* element) const {
+    StringPiece piece;
+    if (!Get(i, &piece)) return false;
+    *element = piece.ToString();
+    return true;
+  }
+
+  bool Equals(uint64 i, StringPiece element, bool* equal) const {
+    StringPiece piece;
+    if (!Get(i, &piece)) return false;
+    *equal = piece == element;
+    return true;
+  }
+
+  static Status Write(const std::vector<string>& elements,
+                      const std::vector<uint64>& order, WritableFile* file) {
+    std::vector<uint64> offsets;
+    offsets.reserve(order.size() + 1);
+    uint64 offset = 0;
+    offsets.push_back(offset);
+    for (const uint64 i : order) {
+      offset += elements[i].size();
+      offsets.push_back(offset);
+    }
+    TF_RETURN_IF_ERROR(file->Append(
+        StringPiece(reinterpret_cast<const char*>(offsets.data()),
+                    offsets.size() * sizeof(uint64))));
+    for (const uint64 i : order) {
+      TF_RETURN_IF_ERROR(file->Append(elements[i]));
+    }
+    return Status::OK();
+  }
+
+ private:
+  const uint64* offsets_ = nullptr;
+  const char* data_ = nullptr;
+  uint64 data_bytes_ = 0;
+};
+
+}  // namespace memmapped_table
+
+// Builds the file of a MemmappedTable from keys of type K (int64 or string)
+// and values of type V (int64, float, double or string).
+//
+// Sample use case:
+//
+// MemmappedTableBuilder<string, int64> builder;
+// builder.Add("hello", 0);
+// builder.Add("world", 1);
+// TF_RETURN_IF_ERROR(builder.Write(Env::Default(), "/tmp/vocab.table"));
+//
+template <class K, class V>
+class MemmappedTableBuilder {
+ public:
+  MemmappedTableBuilder() {}
+
+  // Adds an entry. A key can be added more than once, but always with the
+  // same value.
+  void Add(const K& key, const V& value) {
+    keys_.push_back(key);
+    values_.push_back(value);
+  }
+
+  // Returns the number of entries added, counting repeated keys.
+  int64 size() const { return keys_.size(); }
+
+  // Writes a table with the entries added so far to `filename`.
+  Status Write(Env* env, const string& filename) const {
+    // About two entries per bucket.
+    uint32 index_bits = 0;
+    while ((uint64{4} << index_bits) <= keys_.size()) ++index_bits;
+
+    // Groups entries by bucket, and then drops the repeated ones.
+    const uint64 num_buckets = uint64{1} << index_bits;
+    std::vector<uint64> buckets(keys_.size());
+    std::vector<uint64> bucket_starts(num_buckets + 1, 0);
+    for (uint64 i = 0; i < keys_.size(); ++i) {
+      buckets[i] =
+          memmapped_table::Bucket(memmapped_table::HashKey(keys_[i]),
+                                  index_bits);
+      ++bucket_starts[buckets[i] + 1];
+    }
+    for (uint64 b = 0; b < num_buckets; ++b) {
+      bucket_starts[b + 1] += bucket_starts[b];
+    }
+    std::vector<uint64> grouped(keys_.size());
+    {
+      std::vector<uint64> next(bucket_starts.begin(), bucket_starts.end() - 1);
+      for (uint64 i = 0; i < keys_.size(); ++i) {
+        grouped[next[buckets[i]]++] = i;
+      }
+    }
+    std::vector<uint64> order;
+    order.reserve(keys_.size());
+    std::vector<uint64> bucket_sizes(num_buckets, 0);
+    for (uint64 b = 0; b < num_buckets; ++b) {
+      const uint64 bucket_begin = order.size();
+      for (uint64 g = bucket_starts[b]; g < bucket_starts[b + 1]; ++g) {
+        const uint64 i = grouped[g];
+        bool repeated = false;
+        for (uint64 o = bucket_begin; o < order.size(); ++o) {
+          if (keys_[order[o]] != keys_[i]) continue;
+          if (values_[order[o]] != values_[i]) {
+            return errors::FailedPrecondition(
+                "Table has different value for same key. Key ", keys_[i],
+                " has ", values_[order[o]], " and trying to add value ",
+                values_[i]);
+          }
+          repeated = true;
+          break;
+        }
+        if (!repeated) order.push_back(i);
+      }
+      bucket_sizes[b] = order.size() - bucket_begin;
+    }
+
+    std::unique_ptr<WritableFile> file;
+    TF_RETURN_IF_ERROR(env->NewWritableFile(filename, &file));
+    const uint64 keys_bytes = memmapped_table::Column<K>::Bytes(keys_, order);
+    const uint64 values_bytes =
+        memmapped_table::Column<V>::Bytes(values_, order);
+    TF_RETURN_IF_ERROR(memmapped_table::WriteHeaderAndIndex(
+        DataTypeToEnum<K>::v(), DataTypeToEnum<V>::v(), index_bits,
+        bucket_sizes, keys_bytes, values_bytes, file.get()));
+    uint64 bytes = keys_bytes;
+    TF_RETURN_IF_ERROR(
+        memmapped_table::Column<K>::Write(keys_, order, file.get()));
+    TF_RETURN_IF_ERROR(memmapped_table::Pad(&bytes, file.get()));
+    TF_RETURN_IF_ERROR(
+        memmapped_table::Column<V>::Write(values_, order, file.get()));
+    bytes = values_bytes;
+    TF_RETURN_IF_ERROR(memmapped_table::Pad(&bytes, file.get()));
+    return file->Close();
+  }
+
+ private:
+  std::vector<K> keys_;
+  std::vector<V> values_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(MemmappedTableBuilder);
+};
+
+// Read-only hash table that maps a file written by MemmappedTableBuilder.
+// Thread safe.
+template <class K, class V>
+class MemmappedTable {
+ public:
+  // Maps `filename`, which must hold `key_dtype` keys and `value_dtype`
+  // values.
+  static Status Open(Env* env, const string& filename, DataType key_dtype,
+                     DataType value_dtype,
+                     std::unique_ptr<MemmappedTable>* table) {
+    std::unique_ptr<ReadOnlyMemoryRegion> region;
+    TF_RETURN_IF_ERROR(env->NewReadOnlyMemoryRegionFromFile(filename, &region));
+    const MemmappedTableHeader* header;
+    TF_RETURN_IF_ERROR(memmapped_table::CheckHeader(
+        region->data(), region->length(), key_dtype, value_dtype, &header));
+    const char* data = static_cast<const char*>(region->data());
+    const uint64 n = header->num_entries;
+    const uint64 keys_bytes = header->values_offset - header->keys_offset;
+    const uint64 values_bytes = header->file_size - header->values_offset;
+    if (!memmapped_table::Column<K>::Valid(keys_bytes, n) ||
+        !memmapped_table::Column<V>::Valid(values_bytes, n)) {
+      return errors::DataLoss("Table file ", filename,
+                              " is too short for its entries");
+    }
+    table->reset(new MemmappedTable(std::move(region), header));
+    (*table)->keys_ = memmapped_table::Column<K>(
+        data + header->keys_offset, keys_bytes, n);
+    (*table)->values_ = memmapped_table::Column<V>(
+        data + header->values_offset, values_bytes, n);
+    return Status::OK();
+  }
+
+  int64 size() const { return num_entries_; }
+
+  // Returns the number of bytes mapped.
+  uint64 bytes() const { return region_->length(); }
+
+  // Sets `*value` to the value of `key` and `*found` to true, or `*found` to
+  // false if `key` is not in the table.
+  template <typename Key, typename Value>
+  Status Find(const Key& key, Value* value, bool* found) const {
+    const uint64 b =
+        memmapped_table::Bucket(memmapped_table::HashKey(key), index_bits_);
+    const uint64 begin = index_[b];
+    const uint64 end = index_[b + 1];
+    if (begin > end || end > num_entries_) {
+      return errors::DataLoss("Corrupt index in memmapped table");
+    }
+    for (uint64 i = begin; i < end; ++i) {
+      bool equal;
+      if (!keys_.Equals(i, key, &equal)) {
+        return errors::DataLoss("Corrupt key in memmapped table");
+      }
+      if (equal) {
+        *found = true;
+        if (!values_.Get(i, value)) {
+          return errors::DataLoss("Corrupt value in memmapped table");
+        }
+        return Status::OK();
+      }
+    }
+    *found = false;
+    return Status::OK();
+  }
+
+  // Calls `fn(key, value)` for each entry, in no particular order.
+  template <typename Fn>
+  Status ForEach(Fn fn) const {
+    K key;
+    V value;
+    for (uint64 i = 0; i < num_entries_; ++i) {
+      if (!keys_.Get(i, &key) || !values_.Get(i, &value)) {
+        return errors::DataLoss("Corrupt entry in memmapped table");
+      }
+      fn(key, value);
+    }
+    return Status::OK();
+  }
+
+ private:
+  MemmappedTable(std::unique_ptr<ReadOnlyMemoryRegion> region,
+                 const MemmappedTableHeader* header)
+      : region_(std::move(region)),
+        num_entries_(header->num_entries),
+        index_bits_(header->index_bits),
+        index_(reinterpret_cast<const uint64*>(
+            static_cast<const char*>(region_->data()) +
+            header->index_offset)) {}
+
+  const std::unique_ptr<ReadOnlyMemoryRegion> region_;
+  const uint64 num_entries_;
+  const uint32 index_bits_;
+  const uint64* const index_;
+  memmapped_table::Column<K> keys_;
+  memmapped_table::Column<V> values_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(MemmappedTable);
+};
+
+}  // namespace lookup
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_KERNELS_MEMMAPPED_LOOKUP_TABLE_H_
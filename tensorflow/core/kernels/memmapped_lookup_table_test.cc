@@ -0,0 +1,278 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/memmapped_lookup_table.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <unordered_map>
+
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace lookup {
+namespace {
+
+string TablePath(const string& name) {
+  return io::JoinPath(testing::TmpDir(), name);
+}
+
+TEST(MemmappedTableTest, StringToInt64) {
+  MemmappedTableBuilder<string, int64> builder;
+  for (int i = 0; i < 1000; ++i) {
+    builder.Add(strings::StrCat("word", i), i);
+  }
+  // Repeating an entry is fine.
+  builder.Add("word7", 7);
+  const string path = TablePath("string_to_int64");
+  TF_ASSERT_OK(builder.Write(Env::Default(), path));
+
+  std::unique_ptr<MemmappedTable<string, int64>> table;
+  TF_ASSERT_OK((MemmappedTable<string, int64>::Open(
+      Env::Default(), path, DT_STRING, DT_INT64, &table)));
+  EXPECT_EQ(1000, table->size());
+  for (int i = 0; i < 1000; ++i) {
+    int64 value;
+    bool found;
+    TF_ASSERT_OK(table->Find(strings::StrCat("word", i), &value, &found));
+    EXPECT_TRUE(found);
+    EXPECT_EQ(i, value);
+  }
+  int64 value;
+  bool found;
+  TF_ASSERT_OK(table->Find(string("word1000"), &value, &found));
+  EXPECT_FALSE(found);
+  TF_ASSERT_OK(table->Find(string(""), &value, &found));
+  EXPECT_FALSE(found);
+
+  std::map<string, int64> entries;
+  TF_ASSERT_OK(table->ForEach(
+      [&entries](const string& key, int64 value) { entries[key] = value; }));
+  EXPECT_EQ(1000, entries.size());
+  EXPECT_EQ(123, entries["word123"]);
+}
+
+TEST(MemmappedTableTest, Int64ToString) {
+  MemmappedTableBuilder<int64, string> builder;
+  builder.Add(-5, "minus five");
+  builder.Add(42, "");
+  builder.Add(1LL << 40, "big");
+  const string path = TablePath("int64_to_string");
+  TF_ASSERT_OK(builder.Write(Env::Default(), path));
+
+  std::unique_ptr<MemmappedTable<int64, string>> table;
+  TF_ASSERT_OK((MemmappedTable<int64, string>::Open(
+      Env::Default(), path, DT_INT64, DT_STRING, &table)));
+  EXPECT_EQ(3, table->size());
+  StringPiece value;
+  bool found;
+  TF_ASSERT_OK(table->Find(int64{-5}, &value, &found));
+  EXPECT_TRUE(found);
+  EXPECT_EQ("minus five", value);
+  TF_ASSERT_OK(table->Find(int64{42}, &value, &found));
+  EXPECT_TRUE(found);
+  EXPECT_EQ("", value);
+  TF_ASSERT_OK(table->Find(int64{1LL << 40}, &value, &found));
+  EXPECT_TRUE(found);
+  EXPECT_EQ("big", value);
+  TF_ASSERT_OK(table->Find(int64{5}, &value, &found));
+  EXPECT_FALSE(found);
+}
+
+TEST(MemmappedTableTest, EmptyTable) {
+  MemmappedTableBuilder<int64, float> builder;
+  const string path = TablePath("empty");
+  TF_ASSERT_OK(builder.Write(Env::Default(), path));
+  std::unique_ptr<MemmappedTable<int64, float>> table;
+  TF_ASSERT_OK((MemmappedTable<int64, float>::Open(Env::Default(), path,
+                                                    DT_INT64, DT_FLOAT,
+                                                    &table)));
+  EXPECT_EQ(0, table->size());
+  float value;
+  bool found;
+  TF_ASSERT_OK(table->Find(int64{0}, &value, &found));
+  EXPECT_FALSE(found);
+}
+
+TEST(MemmappedTableTest, ConflictingValues) {
+  MemmappedTableBuilder<string, int64> builder;
+  builder.Add("a", 1);
+  builder.Add("a", 2);
+  EXPECT_TRUE(errors::IsFailedPrecondition(
+      builder.Write(Env::Default(), TablePath("conflicting"))));
+}
+
+TEST(MemmappedTableTest, RejectsBadFiles) {
+  MemmappedTableBuilder<string, int64> builder;
+  builder.Add("a", 1);
+  const string path = TablePath("bad");
+  TF_ASSERT_OK(builder.Write(Env::Default(), path));
+  std::unique_ptr<MemmappedTable<string, string>> wrong_types;
+  EXPECT_TRUE(errors::IsInvalidArgument(MemmappedTable<string, string>::Open(
+      Env::Default(), path, DT_STRING, DT_STRING, &wrong_types)));
+
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), path, &contents));
+  std::unique_ptr<MemmappedTable<string, int64>> table;
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), path,
+                                 contents.substr(0, contents.size() - 8)));
+  EXPECT_TRUE(errors::IsDataLoss(MemmappedTable<string, int64>::Open(
+      Env::Default(), path, DT_STRING, DT_INT64, &table)));
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), path, "not a table"));
+  EXPECT_TRUE(errors::IsDataLoss(MemmappedTable<string, int64>::Open(
+      Env::Default(), path, DT_STRING, DT_INT64, &table)));
+}
+
+TEST(MemmappedTableTest, RejectsCorruptCountsAndOffsets) {
+  MemmappedTableBuilder<string, int64> builder;
+  builder.Add("a", 1);
+  builder.Add("bc", 2);
+  const string path = TablePath("corrupt");
+  TF_ASSERT_OK(builder.Write(Env::Default(), path));
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), path, &contents));
+  MemmappedTableHeader header;
+  memcpy(&header, contents.data(), sizeof(header));
+  std::unique_ptr<MemmappedTable<string, int64>> table;
+
+  // So many entries that their size overflows.
+  string corrupt = contents;
+  const uint64 num_entries = uint64{1} << 61;
+  memcpy(&corrupt[offsetof(MemmappedTableHeader, num_entries)], &num_entries,
+         sizeof(num_entries));
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), path, corrupt));
+  EXPECT_TRUE(errors::IsDataLoss(MemmappedTable<string, int64>::Open(
+      Env::Default(), path, DT_STRING, DT_INT64, &table)));
+
+  // Decreasing string offsets, and offsets past the string data. Opening the
+  // table doesn't read the offsets, but looking up the corrupt key fails.
+  const std::vector<std::pair<int, uint64>> corrupt_offsets = {
+      {1, 4}, {2, uint64{1} << 40}};
+  for (const auto& offset : corrupt_offsets) {
+    corrupt = contents;
+    memcpy(&corrupt[header.keys_offset + offset.first * sizeof(uint64)],
+           &offset.second, sizeof(offset.second));
+    TF_ASSERT_OK(WriteStringToFile(Env::Default(), path, corrupt));
+    TF_ASSERT_OK((MemmappedTable<string, int64>::Open(
+        Env::Default(), path, DT_STRING, DT_INT64, &table)));
+    int64 value;
+    bool found;
+    EXPECT_TRUE(errors::IsDataLoss(table->Find(string("bc"), &value, &found)));
+    EXPECT_TRUE(errors::IsDataLoss(
+        table->ForEach([](const string& key, int64 value) {})));
+  }
+}
+
+// Writes a table of `num_entries` words, and returns its path.
+string WriteVocabulary(int num_entries) {
+  const string path = TablePath(strings::StrCat("vocab_", num_entries));
+  if (Env::Default()->FileExists(path).ok()) return path;
+  MemmappedTableBuilder<string, int64> builder;
+  for (int i = 0; i < num_entries; ++i) {
+    builder.Add(strings::StrCat("word", i), i);
+  }
+  TF_CHECK_OK(builder.Write(Env::Default(), path));
+  return path;
+}
+
+// What loading a vocabulary into a HashTable costs, without parsing it.
+void BM_UnorderedMapLoad(int iters, int num_entries) {
+  testing::StopTiming();
+  std::vector<string> words;
+  for (int i = 0; i < num_entries; ++i) {
+    words.push_back(strings::StrCat("word", i));
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_entries);
+  testing::StartTiming();
+  for (int i = 0; i < iters; ++i) {
+    std::unordered_map<string, int64> table;
+    for (int j = 0; j < num_entries; ++j) {
+      table.emplace(words[j], j);
+    }
+  }
+}
+
+void BM_MemmappedTableOpen(int iters, int num_entries) {
+  testing::StopTiming();
+  const string path = WriteVocabulary(num_entries);
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_entries);
+  testing::StartTiming();
+  for (int i = 0; i < iters; ++i) {
+    std::unique_ptr<MemmappedTable<string, int64>> table;
+    TF_CHECK_OK((MemmappedTable<string, int64>::Open(
+        Env::Default(), path, DT_STRING, DT_INT64, &table)));
+  }
+}
+
+BENCHMARK(BM_UnorderedMapLoad)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK(BM_MemmappedTableOpen)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+// Looks up keys of which about half are in the table.
+void BM_UnorderedMapFind(int iters, int num_entries) {
+  testing::StopTiming();
+  std::unordered_map<string, int64> table;
+  std::vector<string> keys;
+  for (int i = 0; i < num_entries; ++i) {
+    table.emplace(strings::StrCat("word", i), i);
+    keys.push_back(strings::StrCat("word", 2 * i));
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_entries);
+  testing::StartTiming();
+  int64 sum = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (const string& key : keys) {
+      auto it = table.find(key);
+      sum += it == table.end() ? -1 : it->second;
+    }
+  }
+  VLOG(1) << sum;
+}
+
+void BM_MemmappedTableFind(int iters, int num_entries) {
+  testing::StopTiming();
+  std::unique_ptr<MemmappedTable<string, int64>> table;
+  TF_CHECK_OK((MemmappedTable<string, int64>::Open(
+      Env::Default(), WriteVocabulary(num_entries), DT_STRING, DT_INT64,
+      &table)));
+  std::vector<string> keys;
+  for (int i = 0; i < num_entries; ++i) {
+    keys.push_back(strings::StrCat("word", 2 * i));
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_entries);
+  testing::StartTiming();
+  int64 sum = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (const string& key : keys) {
+      int64 value;
+      bool found;
+      TF_CHECK_OK(table->Find(key, &value, &found));
+      sum += found ? value : -1;
+    }
+  }
+  VLOG(1) << sum;
+}
+
+BENCHMARK(BM_UnorderedMapFind)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK(BM_MemmappedTableFind)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+}  // namespace
+}  // namespace lookup
+}  // namespace tensorflow
@@ -1392,4 +1392,14 @@ BM_TopKCPU(128, 70000, 70000, 16, "topk_nmt_r_128_c_70000_k_70000_th_16");
 BM_TopKCPU(128, 175000, 175000, 16, "topk_nmt_r_128_c_175000_k_175000_th_16");
 BM_TopKCPU(128, 350000, 350000, 16, "topk_nmt_r_128_c_350000_k_350000_th_16");
 
+// Retrieval: the top scoring of up to a million candidates.
+BM_TopKCPU(1, 1000000, 10, 16, "topk_r_1_c_1000000_k_10_th_16");
+BM_TopKCPU(1, 1000000, 1000, 16, "topk_r_1_c_1000000_k_1000_th_16");
+BM_TopKCPU(1, 1000000, 100000, 16, "topk_r_1_c_1000000_k_100000_th_16");
+BM_TopKCPU(32, 100000, 10, 16, "topk_r_32_c_100000_k_10_th_16");
+BM_TopKCPU(32, 100000, 1000, 16, "topk_r_32_c_100000_k_1000_th_16");
+BM_TopKCPU(32, 100000, 10000, 16, "topk_r_32_c_100000_k_10000_th_16");
+BM_TopKCPU(32, 1000000, 1000, 16, "topk_r_32_c_1000000_k_1000_th_16");
+BM_TopKCPU(32, 1000000, 1000, 1, "topk_r_32_c_1000000_k_1000_th_1");
+
 }  // namespace tensorflow
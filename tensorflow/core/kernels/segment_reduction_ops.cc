@@ -23,6 +23,7 @@ limitations under the License.
 #include "third_party/eigen3/Eigen/Core"
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 #include "tensorflow/core/kernels/segment_reduction_ops.h"
+#include <algorithm>
 #include <vector>
 #include "tensorflow/core/framework/numeric_op.h"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -32,8 +33,10 @@ limitations under the License.
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/kernels/bounds_check.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/util/util.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 #if GOOGLE_CUDA
 #include "tensorflow/core/common_runtime/gpu/gpu_event_mgr.h"
@@ -111,85 +114,116 @@ class SegmentReductionOp : public OpKernel {
                 errors::InvalidArgument("segment ids must be >= 0"));
     auto output_flat = output->flat_outer_dims<T>();
 
-#if !defined(EIGEN_HAS_INDEX_LIST)
-    Eigen::DSizes<Eigen::DenseIndex, 1> dims_to_reduce;
-    dims_to_reduce[0] = 0;
-#else
-    Eigen::IndexList<Eigen::type2index<0> > dims_to_reduce;
-#endif
-    Index start = 0, end = 1;
-
-    Index uninitialized_index = 0;  // Index from which the output is not set.
-    Index out_index = internal::SubtleMustCopy(segment_vec(start));
+    // Validate the segment ids up front, so that the reduction can be
+    // sharded on segment boundaries.
+    const Index first_index = internal::SubtleMustCopy(segment_vec(0));
+    OP_REQUIRES(
+        context, FastBoundsCheck(first_index, output_rows),
+        errors::InvalidArgument(
+            "Segment id ", first_index, " out of range [0, ", output_rows,
+            "), possibly because 'segment_ids' input is not sorted."));
+    for (int64 i = 1; i < num_indices; ++i) {
+      OP_REQUIRES(context, segment_vec(i - 1) <= segment_vec(i),
+                  errors::InvalidArgument("segment ids are not increasing"));
+    }
 
-    // TODO(agarwal): if this loop becomes a bottleneck, consider sharding it
-    // across threads.
-    Eigen::DSizes<Eigen::DenseIndex, 1> out_slice_shape(num_col);
-    while (end <= num_indices) {
-      // We initialize next_index to 0 to avoid "warning: 'next_index' may be
-      // used uninitialized in this function" in the Mac build (since the
-      // compiler isn't smart enough to realize the code is safe).
-      Index next_index = 0;
-      if (end < num_indices) {
-        next_index = internal::SubtleMustCopy(segment_vec(end));
-        if (out_index == next_index) {
-          ++end;
-          continue;
+    // The input rows are split into about equal chunks whose boundaries are
+    // moved to the start of the next segment. Chunk c reduces input rows
+    // [boundaries[c], boundaries[c + 1]) into the output rows from the id of
+    // its first row up to the id of the first row of chunk c + 1, so that it
+    // also fills the gaps between its segments with the default value.
+    const DeviceBase::CpuWorkerThreads& workers =
+        *context->device()->tensorflow_cpu_worker_threads();
+    const int64 num_chunks =
+        std::min<int64>(num_indices, 4 * workers.num_threads);
+    const Index* segment_ptr = segment_vec.data();
+    std::vector<int64> boundaries(num_chunks + 1, num_indices);
+    boundaries[0] = 0;
+    for (int64 c = 1; c < num_chunks; ++c) {
+      const int64 b = std::max(boundaries[c - 1], c * num_indices / num_chunks);
+      boundaries[c] = b == 0 ? 0
+                             : std::upper_bound(segment_ptr + b - 1,
+                                                segment_ptr + num_indices,
+                                                segment_ptr[b - 1]) -
+                                   segment_ptr;
+    }
+    // The ids are read from the input buffer again while reducing, so each
+    // one is copied once before use and the output rows it selects are
+    // checked again in case the buffer changed concurrently.
+    auto chunk_output_start = [&](int64 c) -> Index {
+      if (c == 0) return 0;
+      return boundaries[c] < num_indices
+                 ? internal::SubtleMustCopy(segment_ptr[boundaries[c]])
+                 : output_rows;
+    };
+    mutex mu;
+    Status status;
+    auto reduce_chunks = [&](int64 begin_chunk, int64 end_chunk) {
+      for (int64 c = begin_chunk; c < end_chunk; ++c) {
+        int64 start = boundaries[c];
+        const int64 chunk_end = boundaries[c + 1];
+        const Index out_begin = chunk_output_start(c);
+        const Index out_limit = chunk_output_start(c + 1);
+        for (Index out_index = out_begin; out_index < out_limit; ++out_index) {
+          if (!FastBoundsCheck(out_index, output_rows)) {
+            mutex_lock l(mu);
+            status = errors::InvalidArgument(
+                "Segment id ", out_index, " out of range [0, ", output_rows,
+                "), possibly because 'segment_ids' input is not sorted.");
+            return;
+          }
+          int64 end = start;
+          while (end < chunk_end &&
+                 internal::SubtleMustCopy(segment_ptr[end]) == out_index) {
+            ++end;
+          }
+          ReduceSegment(input_flat, start, end, &output_flat, out_index);
+          start = end;
         }
-        // We have a new segment here.  Verify that the segment ids are growing.
-        OP_REQUIRES(context, out_index < next_index,
-                    errors::InvalidArgument("segment ids are not increasing"));
       }
+    };
+    const int64 cost_per_chunk = num_indices / num_chunks * num_col;
+    Shard(workers.num_threads, workers.workers, num_chunks, cost_per_chunk,
+          reduce_chunks);
+    OP_REQUIRES_OK(context, status);
+  }
 
-      // Process segment [start, end)
-      const T* in_slice_ptr = &input_flat(start, 0);
-      typedef Eigen::TensorMap<Eigen::Tensor<T, 1, Eigen::RowMajor>,
+ private:
+  // Reduces input rows [start, end) into output row out_index, or sets it to
+  // the default value if the segment is empty.
+  static void ReduceSegment(typename TTypes<T, 2>::ConstTensor input_flat,
+                            int64 start, int64 end,
+                            typename TTypes<T, 2>::Tensor* output_flat,
+                            Index out_index) {
+    const int64 num_col = input_flat.dimension(1);
+    Eigen::DSizes<Eigen::DenseIndex, 1> out_slice_shape(num_col);
+    typedef Eigen::TensorMap<Eigen::Tensor<T, 1, Eigen::RowMajor>,
+                             Eigen::Unaligned>
+        OutT;
+    OutT out_slice(&(*output_flat)(out_index, 0), out_slice_shape);
+    // We don't use out_slice.device(context->eigen_device<Device>) because
+    // the chunks are already reduced in parallel.
+    if (start == end) {
+      out_slice.setConstant(T(default_value));
+    } else if (start == end - 1) {
+      typedef Eigen::TensorMap<Eigen::Tensor<const T, 1, Eigen::RowMajor>,
                                Eigen::Unaligned>
-          OutT;
-
-      OP_REQUIRES(
-          context, FastBoundsCheck(out_index, output_rows),
-          errors::InvalidArgument(
-              "Segment id ", out_index, " out of range [0, ", output_rows,
-              "), possibly because 'segment_ids' input is not sorted."));
-
-      // If there is a gap between two indices, we need to set that gap to the
-      // default value.
-      if (out_index > uninitialized_index) {
-        Eigen::DSizes<Eigen::DenseIndex, 2> gap_slice_shape(
-            out_index - uninitialized_index, num_col);
-        Eigen::TensorMap<Eigen::Tensor<T, 2, Eigen::RowMajor>, Eigen::Unaligned>
-            gap_slice(&output_flat(uninitialized_index, 0), gap_slice_shape);
-        gap_slice.setConstant(T(default_value));
-      }
-
-      T* out_slice_ptr = &output_flat(out_index, 0);
-      OutT out_slice(out_slice_ptr, out_slice_shape);
-      // We don't use out_slice.device(context->eigen_device<Device>)
-      // because these pieces of work are likely to be very small and
-      // the context switching overhead dwarfs any benefit we get from
-      // using another thread to do this work.
-      if (start == end - 1) {
-        typedef Eigen::TensorMap<Eigen::Tensor<const T, 1, Eigen::RowMajor>,
-                                 Eigen::Unaligned>
-            InT;
-        InT in_slice(in_slice_ptr, out_slice_shape);
-        out_slice = in_slice;
-      } else {
-        Eigen::DSizes<Eigen::DenseIndex, 2> in_slice_shape(end - start,
-                                                           num_col);
-        typedef Eigen::TensorMap<Eigen::Tensor<const T, 2, Eigen::RowMajor>,
-                                 Eigen::Unaligned>
-            InT;
-        InT in_slice(in_slice_ptr, in_slice_shape);
-
-        out_slice = in_slice.reduce(dims_to_reduce, Reducer());
-      }
-      if (end >= num_indices) break;
-      start = end;
-      ++end;
-      uninitialized_index = out_index + 1;
-      out_index = next_index;
+          InT;
+      InT in_slice(&input_flat(start, 0), out_slice_shape);
+      out_slice = in_slice;
+    } else {
+#if !defined(EIGEN_HAS_INDEX_LIST)
+      Eigen::DSizes<Eigen::DenseIndex, 1> dims_to_reduce;
+      dims_to_reduce[0] = 0;
+#else
+      Eigen::IndexList<Eigen::type2index<0> > dims_to_reduce;
+#endif
+      Eigen::DSizes<Eigen::DenseIndex, 2> in_slice_shape(end - start, num_col);
+      typedef Eigen::TensorMap<Eigen::Tensor<const T, 2, Eigen::RowMajor>,
+                               Eigen::Unaligned>
+          InT;
+      InT in_slice(&input_flat(start, 0), in_slice_shape);
+      out_slice = in_slice.reduce(dims_to_reduce, Reducer());
     }
   }
 };
@@ -364,6 +398,11 @@ TF_CALL_GPU_NUMBER_TYPES(REGISTER_GPU_SORTED_KERNELS_ALL);
 namespace functor {
 
 // The ReductionFunctor implementation for CPU.
+//
+// Large reductions are sharded in one of two ways. If there are many rows
+// per segment, every thread reduces a range of the rows into its own partial
+// output, and the partial outputs are merged into the output. Otherwise every
+// thread scans all segment ids, and reduces the rows of a range of segments.
 template <typename T, typename Index, typename InitialValueF,
           typename ReductionF>
 struct UnsortedSegmentFunctor<CPUDevice, T, Index, InitialValueF, ReductionF> {
@@ -377,17 +416,83 @@ struct UnsortedSegmentFunctor<CPUDevice, T, Index, InitialValueF, ReductionF> {
       return;
     }
     const int64 N = segment_ids.dimension(0);
-    ReductionF reduction;
-    auto data_flat = typename TTypes<T, 2>::ConstTensor(data, N, data_size / N);
     for (int64 i = 0; i < N; ++i) {
       Index j = internal::SubtleMustCopy(segment_ids(i));
-      if (j < 0) {
-        continue;
-      }
-      OP_REQUIRES(ctx, FastBoundsCheck(j, num_segments),
+      OP_REQUIRES(ctx, j < 0 || FastBoundsCheck(j, num_segments),
                   errors::InvalidArgument(
                       "segment_ids", SliceDebugString(segment_ids_shape, i),
                       " = ", j, " is out of range [0, ", num_segments, ")"));
+    }
+    auto data_flat = typename TTypes<T, 2>::ConstTensor(data, N, data_size / N);
+    const int64 num_cols = data_flat.dimension(1);
+    const DeviceBase::CpuWorkerThreads& workers =
+        *ctx->device()->tensorflow_cpu_worker_threads();
+    if (workers.num_threads <= 1 || data_size < kMinParallelReductionSize) {
+      ReduceRows(data_flat, segment_ids, 0, N, 0, num_segments, output);
+      return;
+    }
+
+    if (static_cast<int64>(num_segments) * workers.num_threads <= N) {
+      // Partial output 0 is the output itself.
+      const int64 num_partials = workers.num_threads;
+      Tensor partials;
+      OP_REQUIRES_OK(
+          ctx, ctx->allocate_temp(
+                   DataTypeToEnum<T>::value,
+                   TensorShape({num_partials - 1, num_segments, num_cols}),
+                   &partials));
+      auto partials_flat = partials.flat_outer_dims<T>();
+      partials_flat.setConstant(InitialValueF()());
+      auto partial = [&](int64 p) {
+        if (p == 0) return output;
+        return typename TTypes<T, 2>::Tensor(
+            &partials_flat((p - 1) * num_segments, 0), num_segments,
+            num_cols);
+      };
+      Shard(workers.num_threads, workers.workers, num_partials,
+            N / num_partials * num_cols, [&](int64 start, int64 limit) {
+              for (int64 p = start; p < limit; ++p) {
+                ReduceRows(data_flat, segment_ids, p * N / num_partials,
+                           (p + 1) * N / num_partials, 0, num_segments,
+                           partial(p));
+              }
+            });
+      ReductionF reduction;
+      Shard(workers.num_threads, workers.workers, num_segments,
+            num_partials * num_cols, [&](int64 start, int64 limit) {
+              for (int64 p = 1; p < num_partials; ++p) {
+                const typename TTypes<T, 2>::ConstTensor partial_p(
+                    partial(p).data(), num_segments, num_cols);
+                for (int64 j = start; j < limit; ++j) {
+                  reduction(partial_p.template chip<0>(j),
+                            output.template chip<0>(j));
+                }
+              }
+            });
+    } else {
+      Shard(workers.num_threads, workers.workers, num_segments,
+            (N / num_segments + 1) * num_cols, [&](int64 start, int64 limit) {
+              ReduceRows(data_flat, segment_ids, 0, N, start, limit, output);
+            });
+    }
+  }
+
+ private:
+  // Inputs with fewer elements are reduced on the calling thread.
+  static const int64 kMinParallelReductionSize = 32 * 1024;
+
+  // Reduces the rows in [row_start, row_limit) whose segment ids are in
+  // [segment_start, segment_limit) into `output`.
+  static void ReduceRows(typename TTypes<T, 2>::ConstTensor data_flat,
+                         typename TTypes<Index>::ConstFlat segment_ids,
+                         int64 row_start, int64 row_limit,
+                         int64 segment_start, int64 segment_limit,
+                         typename TTypes<T, 2>::Tensor output) {
+    ReductionF reduction;
+    for (int64 i = row_start; i < row_limit; ++i) {
+      // The ids were validated, but may have changed since.
+      const Index j = internal::SubtleMustCopy(segment_ids(i));
+      if (j < segment_start || j >= segment_limit) continue;
       reduction(data_flat.template chip<0>(i), output.template chip<0>(j));
     }
   }
@@ -31,6 +31,7 @@ limitations under the License.
 #include "tensorflow/core/graph/testlib.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 #include "tensorflow/core/public/session_options.h"
@@ -113,6 +114,58 @@ BM_Reduce_Arg(64, 32, 2);
 BM_Reduce_Arg(4096, 32, 2);
 BM_Reduce_Arg(4096, 128, 2);
 
+BM_Reduce_Arg(1048576, 1, 16);
+BM_Reduce_Arg(1048576, 64, 16);
+BM_Reduce_Arg(65536, 64, 1024);
+
+// Reduces `num_rows` rows of `num_cols` floats into `num_segments` segments
+// with randomly drawn ids.
+static void BM_UnsortedSegmentReduction(int iters, const string& reduction,
+                                        int num_rows, int num_segments,
+                                        int num_cols) {
+  testing::StopTiming();
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor data(DT_FLOAT, TensorShape({num_rows, num_cols}));
+  data.flat<float>().setRandom();
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  Tensor segment_ids(DT_INT32, TensorShape({num_rows}));
+  test::FillFn<int32>(&segment_ids, [&rnd, num_segments](int) -> int32 {
+    return rnd.Uniform(num_segments);
+  });
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), reduction)
+                  .Input(test::graph::Constant(g, data))
+                  .Input(test::graph::Constant(g, segment_ids))
+                  .Input(test::graph::Constant(
+                      g, test::AsScalar<int32>(num_segments)))
+                  .Finalize(g, &node));
+  testing::BytesProcessed(static_cast<int64>(iters) * num_rows * num_cols *
+                          sizeof(float));
+  testing::UseRealTime();
+  testing::StartTiming();
+  test::Benchmark("cpu", g).Run(iters);
+}
+
+#define BM_UnsortedReduce(O, R, S, C)                \
+  static void BM_##O##_##R##_##S##_##C(int iters) {  \
+    BM_UnsortedSegmentReduction(iters, #O, R, S, C); \
+  }                                                  \
+  BENCHMARK(BM_##O##_##R##_##S##_##C);
+
+#define BM_UnsortedReduce_Arg(R, S, C)            \
+  BM_UnsortedReduce(UnsortedSegmentSum, R, S, C); \
+  BM_UnsortedReduce(UnsortedSegmentMax, R, S, C);
+
+// Few rows per segment.
+BM_UnsortedReduce_Arg(4096, 4096, 128);
+BM_UnsortedReduce_Arg(65536, 1048576, 1);
+BM_UnsortedReduce_Arg(65536, 1048576, 64);
+// Many rows per segment, like embedding gradients of a small vocabulary.
+BM_UnsortedReduce_Arg(1048576, 1024, 1);
+BM_UnsortedReduce_Arg(1048576, 1024, 64);
+BM_UnsortedReduce_Arg(1048576, 65536, 16);
+
 static void SparseSegmentMeanGradHelper(int iters, float uniqueness, int size) {
   testing::StopTiming();
   Graph* g = new Graph(OpRegistry::Global());
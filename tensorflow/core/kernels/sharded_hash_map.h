@@ -0,0 +1,413 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_KERNELS_SHARDED_HASH_MAP_H_
+#define TENSORFLOW_KERNELS_SHARDED_HASH_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/framework/device_base.h"
+#include "tensorflow/core/kernels/bounds_check.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace lookup {
+
+// Open addressing hash map from keys of type K to arrays of `value_size`
+// values of type V, with linear probing. Keys are stored next to their hash,
+// so that probes mostly compare hashes and growing never rehashes keys.
+// Entries cannot be removed. Not thread safe.
+template <class K, class V>
+class FlatHashShard {
+ public:
+  explicit FlatHashShard(int64 value_size) : value_size_(value_size) {}
+
+  size_t size() const { return size_; }
+
+  size_t bucket_count() const { return tags_.size(); }
+
+  // Bytes of memory used by the buckets, and by the contents of string keys.
+  int64 MemoryUsed() const {
+    return tags_.size() *
+               (sizeof(uint64) + sizeof(K) + value_size_ * sizeof(V)) +
+           key_bytes_;
+  }
+
+  // Returns the values of `key`, or nullptr if it is not in the map. `hash`
+  // must be the hash of `key`.
+  const V* Find(const K& key, uint64 hash) const {
+    if (size_ == 0) return nullptr;
+    const uint64 tag = Tag(hash);
+    const size_t mask = tags_.size() - 1;
+    for (size_t i = tag & mask;; i = (i + 1) & mask) {
+      if (tags_[i] == tag && keys_[i] == key) {
+        return &values_[i * value_size_];
+      }
+      if (tags_[i] == kEmpty) return nullptr;
+    }
+  }
+
+  // Sets the values of `key` to the `value_size` values at `values`.
+  void InsertOrUpdate(const K& key, uint64 hash, const V* values) {
+    if ((size_ + 1) * 4 > tags_.size() * 3) {
+      Grow();
+    }
+    const uint64 tag = Tag(hash);
+    const size_t mask = tags_.size() - 1;
+    size_t i = tag & mask;
+    for (; tags_[i] != kEmpty; i = (i + 1) & mask) {
+      if (tags_[i] == tag && keys_[i] == key) break;
+    }
+    if (tags_[i] == kEmpty) {
+      tags_[i] = tag;
+      keys_[i] = key;
+      key_bytes_ += KeyBytes(key);
+      ++size_;
+    }
+    std::copy_n(values, value_size_, &values_[i * value_size_]);
+  }
+
+  // Removes all entries, and releases their memory.
+  void Clear() {
+    std::vector<uint64>().swap(tags_);
+    std::vector<K>().swap(keys_);
+    values_.reset();
+    size_ = 0;
+    key_bytes_ = 0;
+  }
+
+  // Calls `fn(key, values)` for each entry, in no particular order.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (size_t i = 0; i < tags_.size(); ++i) {
+      if (tags_[i] != kEmpty) {
+        fn(keys_[i], &values_[i * value_size_]);
+      }
+    }
+  }
+
+ private:
+  static constexpr uint64 kEmpty = 0;
+
+  // The tag of a full bucket is never kEmpty. Buckets are chosen from the
+  // tag, so that Grow() can place entries from their tag alone.
+  static uint64 Tag(uint64 hash) { return hash | 1; }
+
+  static int64 KeyBytes(const string& key) { return key.size(); }
+
+  template <typename T>
+  static int64 KeyBytes(const T& key) {
+    return 0;
+  }
+
+  void Grow() {
+    const size_t num_buckets = std::max<size_t>(16, tags_.size() * 2);
+    std::vector<uint64> tags(num_buckets, kEmpty);
+    std::vector<K> keys(num_buckets);
+    std::unique_ptr<V[]> values(new V[num_buckets * value_size_]);
+    const size_t mask = num_buckets - 1;
+    for (size_t i = 0; i < tags_.size(); ++i) {
+      if (tags_[i] == kEmpty) continue;
+      size_t j = tags_[i] & mask;
+      while (tags[j] != kEmpty) j = (j + 1) & mask;
+      tags[j] = tags_[i];
+      keys[j] = std::move(keys_[i]);
+      std::move(&values_[i * value_size_], &values_[(i + 1) * value_size_],
+                &values[j * value_size_]);
+    }
+    tags_.swap(tags);
+    keys_.swap(keys);
+    values_ = std::move(values);
+  }
+
+  const int64 value_size_;
+  size_t size_ = 0;
+  // The bytes held by the keys outside of keys_.
+  int64 key_bytes_ = 0;
+  std::vector<uint64> tags_;
+  std::vector<K> keys_;
+  // The `value_size_` values of bucket i start at values_[i * value_size_].
+  std::unique_ptr<V[]> values_;
+};
+
+template <class K, class V>
+constexpr uint64 FlatHashShard<K, V>::kEmpty;
+
+// Hash map from keys of type K to arrays of `value_size` values of type V,
+// split into shards that are locked independently. Operations on keys in
+// different shards do not contend, and the keys of a batch are looked up or
+// inserted one shard per thread. Thread safe.
+template <class K, class V>
+class ShardedHashMap {
+ public:
+  ShardedHashMap(int num_shards, int64 value_size)
+      : num_shards_(num_shards),
+        value_size_(value_size),
+        shards_(new LockedShard[num_shards]) {
+    CHECK_GT(num_shards, 0);
+    for (int i = 0; i < num_shards_; ++i) {
+      shards_[i].map.reset(new FlatHashShard<K, V>(value_size));
+    }
+  }
+
+  int64 value_size() const { return value_size_; }
+
+  size_t size() const {
+    size_t size = 0;
+    for (int i = 0; i < num_shards_; ++i) {
+      tf_shared_lock l(shards_[i].mu);
+      size += shards_[i].map->size();
+    }
+    return size;
+  }
+
+  size_t bucket_count() const {
+    size_t bucket_count = 0;
+    for (int i = 0; i < num_shards_; ++i) {
+      tf_shared_lock l(shards_[i].mu);
+      bucket_count += shards_[i].map->bucket_count();
+    }
+    return bucket_count;
+  }
+
+  // Bytes of memory used by the entries of all shards.
+  int64 MemoryUsed() const {
+    int64 bytes = 0;
+    for (int i = 0; i < num_shards_; ++i) {
+      tf_shared_lock l(shards_[i].mu);
+      bytes += shards_[i].map->MemoryUsed();
+    }
+    return bytes;
+  }
+
+  // Writes the values of `keys[i]`, or the ones at `default_values` if it is
+  // not in the map, to `values + i * value_size()`, for each i < `num_keys`.
+  // Uses `workers` to look up keys in different shards in parallel, unless it
+  // is null.
+  void Find(const K* keys, int64 num_keys, const V* default_values, V* values,
+            const DeviceBase::CpuWorkerThreads* workers) const {
+    Batch batch;
+    Partition(keys, num_keys, workers, &batch);
+    ForEachShard(batch, workers, [&](int s) {
+      const LockedShard& shard = shards_[s];
+      tf_shared_lock l(shard.mu);
+      for (const int64 i : batch.indices[s]) {
+        const HashedKey& key = batch.keys[i];
+        const V* found = shard.map->Find(KeyOf(key), key.hash);
+        std::copy_n(found == nullptr ? default_values : found, value_size_,
+                    values + i * value_size_);
+      }
+    });
+  }
+
+  // Sets the values of `keys[i]` to the ones at `values + i * value_size()`,
+  // for each i < `num_keys`. If a key appears more than once, its last
+  // values win. Uses `workers` like Find().
+  void Insert(const K* keys, int64 num_keys, const V* values,
+              const DeviceBase::CpuWorkerThreads* workers) {
+    Batch batch;
+    Partition(keys, num_keys, workers, &batch);
+    ForEachShard(batch, workers, [&](int s) {
+      LockedShard& shard = shards_[s];
+      mutex_lock l(shard.mu);
+      InsertLocked(values, batch, s);
+    });
+  }
+
+  // Like Insert(), but atomically removes all entries first.
+  void Import(const K* keys, int64 num_keys, const V* values,
+              const DeviceBase::CpuWorkerThreads* workers) {
+    Batch batch;
+    Partition(keys, num_keys, workers, &batch);
+    LockAll();
+    for (int s = 0; s < num_shards_; ++s) {
+      shards_[s].map->Clear();
+    }
+    ForEachShard(batch, workers,
+                 [&](int s) { InsertLocked(values, batch, s); });
+    UnlockAll();
+  }
+
+  // Calls `allocate(size, &keys, &values)` to get room for all `size`
+  // entries, with `size * value_size()` values, and copies them there.
+  // Returns the error of `allocate`, if any.
+  Status Export(
+      const std::function<Status(int64 size, K** keys, V** values)>& allocate)
+      const {
+    LockAll();
+    int64 size = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      size += shards_[s].map->size();
+    }
+    K* keys = nullptr;
+    V* values = nullptr;
+    Status status = allocate(size, &keys, &values);
+    if (status.ok()) {
+      for (int s = 0; s < num_shards_; ++s) {
+        shards_[s].map->ForEach([&](const K& key, const V* key_values) {
+          *keys++ = key;
+          values = std::copy_n(key_values, value_size_, values);
+        });
+      }
+    }
+    UnlockAll();
+    return status;
+  }
+
+ private:
+  struct LockedShard {
+    mutable mutex mu;
+    std::unique_ptr<FlatHashShard<K, V>> map GUARDED_BY(mu);
+  };
+
+  // A key of a batch and its hash. Integer keys are copied once (see
+  // SubtleMustCopy), so that a concurrent write to the input cannot make the
+  // key that is looked up differ from the one that picked its shard. Other
+  // keys are referenced in place.
+  static constexpr bool kCopyKeys = std::is_integral<K>::value;
+  struct HashedKey {
+    uint64 hash;
+    typename std::conditional<kCopyKeys, K, const K*>::type key;
+  };
+
+  // The keys of a batch, grouped by shard.
+  struct Batch {
+    std::vector<HashedKey> keys;
+    std::vector<std::vector<int64>> indices;
+  };
+
+  // Rough costs in cycles, for the work sharder.
+  static constexpr int64 kHashCost = 50;
+  static constexpr int64 kProbeCost = 200;
+
+  static uint64 HashKey(const string& key) { return Hash64(key); }
+
+  template <typename T>
+  static uint64 HashKey(const T& key) {
+    // Integer keys are often dense, so mix their bits: the shard is chosen
+    // from the high bits of the hash.
+    uint64 h = static_cast<uint64>(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  int ShardOf(uint64 hash) const { return (hash >> 32) % num_shards_; }
+
+  static void CopyKey(const K& key, K* copy) {
+    *copy = internal::SubtleMustCopy(key);
+  }
+  static void CopyKey(const K& key, const K** copy) { *copy = &key; }
+
+  static const K& KeyOf(const K& key) { return key; }
+  static const K& KeyOf(const K* key) { return *key; }
+  static const K& KeyOf(const HashedKey& key) { return KeyOf(key.key); }
+
+  void Partition(const K* keys, int64 num_keys,
+                 const DeviceBase::CpuWorkerThreads* workers,
+                 Batch* batch) const {
+    batch->keys.resize(num_keys);
+    auto hash_keys = [keys, batch](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        HashedKey* key = &batch->keys[i];
+        CopyKey(keys[i], &key->key);
+        key->hash = HashKey(KeyOf(*key));
+      }
+    };
+    if (workers == nullptr) {
+      hash_keys(0, num_keys);
+    } else {
+      ::tensorflow::Shard(workers->num_threads, workers->workers, num_keys,
+                          kHashCost, hash_keys);
+    }
+    batch->indices.resize(num_shards_);
+    for (int64 i = 0; i < num_keys; ++i) {
+      batch->indices[ShardOf(batch->keys[i].hash)].push_back(i);
+    }
+  }
+
+  // Calls `fn(s)` for each shard s that has keys in `batch`.
+  void ForEachShard(const Batch& batch,
+                    const DeviceBase::CpuWorkerThreads* workers,
+                    const std::function<void(int)>& fn) const {
+    auto run = [&batch, &fn](int64 begin, int64 end) {
+      for (int64 s = begin; s < end; ++s) {
+        if (!batch.indices[s].empty()) fn(s);
+      }
+    };
+    if (workers == nullptr) {
+      run(0, num_shards_);
+    } else {
+      const int64 keys_per_shard = batch.keys.size() / num_shards_ + 1;
+      ::tensorflow::Shard(workers->num_threads, workers->workers, num_shards_,
+                          keys_per_shard * kProbeCost, run);
+    }
+  }
+
+  void InsertLocked(const V* values, const Batch& batch,
+                    int s) NO_THREAD_SAFETY_ANALYSIS {
+    FlatHashShard<K, V>* map = shards_[s].map.get();
+    for (const int64 i : batch.indices[s]) {
+      const HashedKey& key = batch.keys[i];
+      map->InsertOrUpdate(KeyOf(key), key.hash, values + i * value_size_);
+    }
+  }
+
+  // Locks all shards, in order.
+  void LockAll() const NO_THREAD_SAFETY_ANALYSIS {
+    for (int s = 0; s < num_shards_; ++s) {
+      shards_[s].mu.lock();
+    }
+  }
+
+  void UnlockAll() const NO_THREAD_SAFETY_ANALYSIS {
+    for (int s = num_shards_ - 1; s >= 0; --s) {
+      shards_[s].mu.unlock();
+    }
+  }
+
+  const int num_shards_;
+  const int64 value_size_;
+  std::unique_ptr<LockedShard[]> shards_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ShardedHashMap);
+};
+
+template <class K, class V>
+constexpr bool ShardedHashMap<K, V>::kCopyKeys;
+template <class K, class V>
+constexpr int64 ShardedHashMap<K, V>::kHashCost;
+template <class K, class V>
+constexpr int64 ShardedHashMap<K, V>::kProbeCost;
+
+}  // namespace lookup
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_KERNELS_SHARDED_HASH_MAP_H_
@@ -0,0 +1,180 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/sharded_hash_map.h"
+
+#include <map>
+#include <vector>
+
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace lookup {
+namespace {
+
+TEST(FlatHashShardTest, InsertFindAndGrow) {
+  FlatHashShard<int64, float> map(2);
+  EXPECT_EQ(nullptr, map.Find(1, 1));
+  for (int64 i = 0; i < 1000; ++i) {
+    const float values[] = {static_cast<float>(i), -1.0f};
+    // Colliding hashes only cost probes.
+    map.InsertOrUpdate(i, i % 7, values);
+  }
+  EXPECT_EQ(1000, map.size());
+  EXPECT_GE(map.bucket_count(), 1000 * 4 / 3);
+  EXPECT_EQ(map.bucket_count() *
+                (sizeof(uint64) + sizeof(int64) + 2 * sizeof(float)),
+            map.MemoryUsed());
+  for (int64 i = 0; i < 1000; ++i) {
+    const float* values = map.Find(i, i % 7);
+    ASSERT_NE(nullptr, values);
+    EXPECT_EQ(i, values[0]);
+    EXPECT_EQ(-1.0f, values[1]);
+  }
+  EXPECT_EQ(nullptr, map.Find(1000, 1000 % 7));
+
+  const float update[] = {7.0f, 8.0f};
+  map.InsertOrUpdate(3, 3, update);
+  EXPECT_EQ(1000, map.size());
+  EXPECT_EQ(8.0f, map.Find(3, 3)[1]);
+
+  map.Clear();
+  EXPECT_EQ(0, map.size());
+  EXPECT_EQ(0, map.bucket_count());
+  EXPECT_EQ(0, map.MemoryUsed());
+  EXPECT_EQ(nullptr, map.Find(3, 3));
+}
+
+class ShardedHashMapTest : public ::testing::Test {
+ protected:
+  ShardedHashMapTest() : pool_(Env::Default(), "test", 4) {
+    workers_.num_threads = 4;
+    workers_.workers = &pool_;
+  }
+
+  thread::ThreadPool pool_;
+  DeviceBase::CpuWorkerThreads workers_;
+};
+
+TEST_F(ShardedHashMapTest, FindAndInsert) {
+  ShardedHashMap<string, int64> map(16, 1);
+  const int kNumKeys = 10000;
+  std::vector<string> keys;
+  std::vector<int64> values;
+  int64 key_bytes = 0;
+  for (int i = 0; i < kNumKeys; ++i) {
+    keys.push_back(strings::StrCat("key", i));
+    values.push_back(i);
+    key_bytes += keys.back().size();
+  }
+  for (const auto* workers : {&workers_, static_cast<decltype(&workers_)>(
+                                             nullptr)}) {
+    map.Insert(keys.data(), kNumKeys, values.data(), workers);
+    EXPECT_EQ(kNumKeys, map.size());
+    // The buckets, and the characters of the keys.
+    EXPECT_EQ(map.bucket_count() *
+                      (sizeof(uint64) + sizeof(string) + sizeof(int64)) +
+                  key_bytes,
+              map.MemoryUsed());
+
+    std::vector<string> find_keys = {"key5", "missing", "key9999", "key5"};
+    std::vector<int64> found(find_keys.size());
+    const int64 default_value = -1;
+    map.Find(find_keys.data(), find_keys.size(), &default_value, found.data(),
+             workers);
+    EXPECT_EQ(std::vector<int64>({5, -1, 9999, 5}), found);
+  }
+}
+
+TEST_F(ShardedHashMapTest, LastDuplicateWins) {
+  ShardedHashMap<int64, float> map(4, 1);
+  const std::vector<int64> keys = {1, 2, 1};
+  const std::vector<float> values = {1.0f, 2.0f, 3.0f};
+  map.Insert(keys.data(), keys.size(), values.data(), &workers_);
+  EXPECT_EQ(2, map.size());
+  float found;
+  const float default_value = 0.0f;
+  map.Find(keys.data(), 1, &default_value, &found, &workers_);
+  EXPECT_EQ(3.0f, found);
+}
+
+TEST_F(ShardedHashMapTest, ImportAndExport) {
+  ShardedHashMap<int64, int64> map(8, 2);
+  std::vector<int64> keys, values;
+  for (int64 i = 0; i < 100; ++i) {
+    keys.push_back(i);
+    values.push_back(i);
+    values.push_back(-i);
+  }
+  map.Insert(keys.data(), keys.size(), values.data(), &workers_);
+  // Importing replaces all entries.
+  map.Import(keys.data(), 50, values.data(), &workers_);
+  EXPECT_EQ(50, map.size());
+
+  std::vector<int64> exported_keys, exported_values;
+  TF_ASSERT_OK(map.Export([&](int64 size, int64** keys, int64** values) {
+    exported_keys.resize(size);
+    exported_values.resize(size * 2);
+    *keys = exported_keys.data();
+    *values = exported_values.data();
+    return Status::OK();
+  }));
+  std::map<int64, std::pair<int64, int64>> exported;
+  for (int i = 0; i < exported_keys.size(); ++i) {
+    exported[exported_keys[i]] = {exported_values[2 * i],
+                                  exported_values[2 * i + 1]};
+  }
+  ASSERT_EQ(50, exported.size());
+  for (int64 i = 0; i < 50; ++i) {
+    EXPECT_EQ(std::make_pair(i, -i), exported[i]);
+  }
+
+  EXPECT_FALSE(map.Export([](int64, int64**, int64**) {
+                    return errors::ResourceExhausted("no room");
+                  }).ok());
+}
+
+TEST_F(ShardedHashMapTest, ConcurrentFindsAndInserts) {
+  ShardedHashMap<int64, int64> map(16, 1);
+  {
+    thread::ThreadPool clients(Env::Default(), "clients", 8);
+    for (int c = 0; c < 8; ++c) {
+      clients.Schedule([this, &map, c]() {
+        std::vector<int64> keys(1000);
+        std::vector<int64> values(1000);
+        for (int i = 0; i < 1000; ++i) {
+          keys[i] = c * 1000 + i;
+          values[i] = keys[i] * 2;
+        }
+        map.Insert(keys.data(), keys.size(), values.data(), &workers_);
+        const int64 default_value = -1;
+        map.Find(keys.data(), keys.size(), &default_value, values.data(),
+                 &workers_);
+        for (int i = 0; i < 1000; ++i) {
+          EXPECT_EQ(keys[i] * 2, values[i]);
+        }
+      });
+    }
+  }
+  EXPECT_EQ(8000, map.size());
+}
+
+}  // namespace
+}  // namespace lookup
+}  // namespace tensorflow
@@ -15,6 +15,7 @@ limitations under the License.
 
 // See docs in ../ops/string_ops.cc.
 
+#include <cstring>
 #include <string>
 
 #include "tensorflow/core/framework/kernel_def_builder.h"
@@ -22,7 +23,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
-#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
@@ -62,13 +63,36 @@ class StringJoinOp : public OpKernel {
                                                      &output_tensor));
     auto output_flat = output_tensor->flat<string>();
 
-    std::vector<StringPiece> strings(input_list.size());
-    for (size_t i = 0; i < input_shape.num_elements(); ++i) {
-      for (int j = 0; j < input_list.size(); ++j) {
-        strings[j] = (is_scalar[j]) ? inputs[j](0) : inputs[j](i);
+    // Each output is sized up front and filled with memcpy, so that joining
+    // allocates exactly once per element.
+    const int num_inputs = input_list.size();
+    auto join = [&](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        size_t size = num_inputs > 0 ? separator_.size() * (num_inputs - 1) : 0;
+        for (int j = 0; j < num_inputs; ++j) {
+          size += (is_scalar[j] ? inputs[j](0) : inputs[j](i)).size();
+        }
+        string& output = output_flat(i);
+        output.resize(size);
+        char* dst = &output[0];
+        for (int j = 0; j < num_inputs; ++j) {
+          if (j > 0) {
+            std::memcpy(dst, separator_.data(), separator_.size());
+            dst += separator_.size();
+          }
+          const string& s = is_scalar[j] ? inputs[j](0) : inputs[j](i);
+          std::memcpy(dst, s.data(), s.size());
+          dst += s.size();
+        }
       }
-      output_flat(i) = str_util::Join(strings, separator_.c_str());
+    };
+    int64 cost_per_element = 10;
+    for (int j = 0; j < num_inputs; ++j) {
+      cost_per_element += 2 * (inputs[j].size() > 0 ? inputs[j](0).size() : 0);
     }
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers,
+          input_shape.num_elements(), cost_per_element, join);
   }
 
  private:
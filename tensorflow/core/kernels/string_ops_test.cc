@@ -0,0 +1,209 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+class StringSplitOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(bool skip_empty) {
+    TF_ASSERT_OK(NodeDefBuilder("string_split_op", "StringSplit")
+                     .Input(FakeInput(DT_STRING))
+                     .Input(FakeInput(DT_STRING))
+                     .Attr("skip_empty", skip_empty)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+};
+
+TEST_F(StringSplitOpTest, SkipEmpty) {
+  MakeOp(true);
+  AddInputFromArray<string>(TensorShape({4}),
+                            {"a b", "", "  c,d  ", "e f g h"});
+  AddInputFromArray<string>(TensorShape({}), {" ,"});
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorEqual<int64>(
+      *GetOutput(0), test::AsTensor<int64>({0, 0, 0, 1, 2, 0, 2, 1, 3, 0, 3, 1,
+                                            3, 2, 3, 3},
+                                           {8, 2}));
+  test::ExpectTensorEqual<string>(
+      *GetOutput(1),
+      test::AsTensor<string>({"a", "b", "c", "d", "e", "f", "g", "h"}));
+  test::ExpectTensorEqual<int64>(*GetOutput(2),
+                                 test::AsTensor<int64>({4, 4}));
+}
+
+TEST_F(StringSplitOpTest, KeepEmpty) {
+  MakeOp(false);
+  AddInputFromArray<string>(TensorShape({3}), {",a,", "", "b"});
+  AddInputFromArray<string>(TensorShape({}), {","});
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorEqual<int64>(
+      *GetOutput(0), test::AsTensor<int64>({0, 0, 0, 1, 0, 2, 2, 0}, {4, 2}));
+  test::ExpectTensorEqual<string>(*GetOutput(1),
+                                  test::AsTensor<string>({"", "a", "", "b"}));
+  test::ExpectTensorEqual<int64>(*GetOutput(2),
+                                 test::AsTensor<int64>({3, 3}));
+}
+
+TEST_F(StringSplitOpTest, EmptyDelimiterSplitsCharacters) {
+  MakeOp(true);
+  AddInputFromArray<string>(TensorShape({2}), {"ab", "c"});
+  AddInputFromArray<string>(TensorShape({}), {""});
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorEqual<int64>(
+      *GetOutput(0), test::AsTensor<int64>({0, 0, 0, 1, 1, 0}, {3, 2}));
+  test::ExpectTensorEqual<string>(*GetOutput(1),
+                                  test::AsTensor<string>({"a", "b", "c"}));
+  test::ExpectTensorEqual<int64>(*GetOutput(2),
+                                 test::AsTensor<int64>({2, 2}));
+}
+
+class StringJoinOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(int num_inputs, const string& separator) {
+    TF_ASSERT_OK(NodeDefBuilder("string_join_op", "StringJoin")
+                     .Input(FakeInput(num_inputs, DT_STRING))
+                     .Attr("separator", separator)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+};
+
+TEST_F(StringJoinOpTest, BroadcastsScalars) {
+  MakeOp(3, "--");
+  AddInputFromArray<string>(TensorShape({3}), {"a", "", "ccc"});
+  AddInputFromArray<string>(TensorShape({}), {"x"});
+  AddInputFromArray<string>(TensorShape({3}), {"1", "22", ""});
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorEqual<string>(
+      *GetOutput(0),
+      test::AsTensor<string>({"a--x--1", "--x--22", "ccc--x--"}));
+}
+
+class StringToHashBucketOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(int64 num_buckets) {
+    TF_ASSERT_OK(NodeDefBuilder("hash_op", "StringToHashBucketFast")
+                     .Input(FakeInput(DT_STRING))
+                     .Attr("num_buckets", num_buckets)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+};
+
+TEST_F(StringToHashBucketOpTest, MatchesFingerprint) {
+  MakeOp(1000);
+  std::vector<string> inputs;
+  std::vector<int64> expected;
+  for (int i = 0; i < 10000; ++i) {
+    inputs.push_back(strings::StrCat("feature_", i));
+    expected.push_back(Fingerprint64(inputs.back()) % 1000);
+  }
+  AddInputFromArray<string>(TensorShape({100, 100}), inputs);
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorEqual<int64>(
+      *GetOutput(0), test::AsTensor<int64>(expected, {100, 100}));
+}
+
+// Returns a batch of `batch_size` sentences of `words` random words each.
+Tensor Sentences(int batch_size, int words) {
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  Tensor t(DT_STRING, TensorShape({batch_size}));
+  auto sentences = t.vec<string>();
+  for (int i = 0; i < batch_size; ++i) {
+    for (int w = 0; w < words; ++w) {
+      if (w > 0) sentences(i).push_back(' ');
+      sentences(i).append(1 + rnd.Uniform(10), 'a' + rnd.Uniform(26));
+    }
+  }
+  return t;
+}
+
+static Graph* StringSplit(int batch_size, int words) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor delimiter(DT_STRING, TensorShape({}));
+  delimiter.scalar<string>()() = " ";
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "StringSplit")
+                  .Input(test::graph::Constant(g, Sentences(batch_size, words)))
+                  .Input(test::graph::Constant(g, delimiter))
+                  .Finalize(g, nullptr));
+  return g;
+}
+
+static Graph* StringJoin(int batch_size, int words) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Node* input = test::graph::Constant(g, Sentences(batch_size, words));
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "StringJoin")
+                  .Input({input, input, input})
+                  .Attr("separator", ",")
+                  .Finalize(g, nullptr));
+  return g;
+}
+
+static Graph* StringToHashBucket(int batch_size, int words) {
+  Graph* g = new Graph(OpRegistry::Global());
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "StringToHashBucketFast")
+                  .Input(test::graph::Constant(g, Sentences(batch_size, words)))
+                  .Attr("num_buckets", 1 << 20)
+                  .Finalize(g, nullptr));
+  return g;
+}
+
+// B == batch_size, W == words per element.
+#define BM_StringOp(OP, B, W)                               \
+  static void BM_##OP##_##B##_##W(int iters) {              \
+    testing::UseRealTime();                                 \
+    testing::ItemsProcessed(static_cast<int64>(iters) * B); \
+    test::Benchmark("cpu", OP(B, W)).Run(iters);            \
+  }                                                         \
+  BENCHMARK(BM_##OP##_##B##_##W);
+
+#define BM_AllStringOp(OP)   \
+  BM_StringOp(OP, 1, 1);     \
+  BM_StringOp(OP, 128, 1);   \
+  BM_StringOp(OP, 128, 32);  \
+  BM_StringOp(OP, 4096, 1);  \
+  BM_StringOp(OP, 4096, 32); \
+  BM_StringOp(OP, 65536, 8);
+
+BM_AllStringOp(StringSplit);
+BM_AllStringOp(StringJoin);
+BM_AllStringOp(StringToHashBucket);
+
+}  // namespace
+}  // namespace tensorflow
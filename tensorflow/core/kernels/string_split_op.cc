@@ -15,6 +15,8 @@ limitations under the License.
 
 // See docs in ../ops/string_ops.cc.
 
+#include <algorithm>
+#include <cstring>
 #include <string>
 
 #include "tensorflow/core/framework/kernel_def_builder.h"
@@ -22,25 +24,50 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
-#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
 namespace {
 
-std::vector<string> Split(const string& str, const string& delimiter,
-                          const bool skipEmpty) {
-  if (!delimiter.empty()) {
-    if (skipEmpty) {
-      return str_util::Split(str, delimiter, str_util::SkipEmpty());
-    }
-    return str_util::Split(str, delimiter);
+// The set of delimiter characters to split on, looked up in a table instead
+// of searching the delimiter string for every input character. This is also
+// faster than memchr for a single delimiter since tokens are usually short.
+class Delimiters {
+ public:
+  explicit Delimiters(const string& delimiter) {
+    std::memset(table_, 0, sizeof(table_));
+    for (char c : delimiter) table_[static_cast<uint8>(c)] = true;
   }
-  std::vector<string> char_vector(str.size());
-  for (size_t i = 0; i < str.size(); ++i) {
-    char_vector[i] = str[i];
+
+  // Returns the first delimiter in [begin, end), or end if there is none.
+  const char* Find(const char* begin, const char* end) const {
+    while (begin != end && !table_[static_cast<uint8>(*begin)]) ++begin;
+    return begin;
+  }
+
+ private:
+  bool table_[256];
+};
+
+// Calls fn(token) for every token of `text`, with the same semantics as
+// str_util::Split: an empty text has no tokens, and empty tokens are only
+// reported if skip_empty is false.
+template <typename Fn>
+void ForEachToken(StringPiece text, const Delimiters& delimiters,
+                  bool skip_empty, Fn fn) {
+  if (text.empty()) return;
+  const char* begin = text.data();
+  const char* const end = text.data() + text.size();
+  while (true) {
+    const char* token_end = delimiters.Find(begin, end);
+    if (!skip_empty || token_end != begin) {
+      fn(StringPiece(begin, token_end - begin));
+    }
+    if (token_end == end) break;
+    begin = token_end + 1;
   }
-  return char_vector;
 }
 
 }  // namespace
@@ -76,22 +103,42 @@ class StringSplitOp : public OpKernel {
     const auto delimiter_vec = delimiter_tensor->flat<string>();
     const string& delimiter = delimiter_vec(0);
     // Empty delimiter means split the input character by character.
-    std::vector<string> tokens;
-    // Guess that we'll be unpacking a handful of tokens per example.
-    static constexpr int kReserveSize = 4;
-    tokens.reserve(batch_size * kReserveSize);
+    const Delimiters delimiters(delimiter);
+    const bool split_chars = delimiter.empty();
+    const bool skip_empty = skip_empty_;
 
-    int64 output_size = 0;
+    int64 total_bytes = 0;
+    for (int64 i = 0; i < batch_size; ++i) {
+      total_bytes += input_vec(i).size();
+    }
+    // Tokenizing is a linear scan; copying the tokens out dominates.
+    const int64 cost_per_row =
+        10 + 4 * total_bytes / std::max<int64>(batch_size, 1);
+    auto worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
+
+    // First pass: count the tokens of every row, so that all outputs can be
+    // allocated once and filled in place by the second pass.
+    std::vector<int64> row_starts(batch_size + 1, 0);
+    Shard(worker_threads->num_threads, worker_threads->workers, batch_size,
+          cost_per_row, [&](int64 begin, int64 end) {
+            for (int64 i = begin; i < end; ++i) {
+              const string& text = input_vec(i);
+              if (split_chars) {
+                row_starts[i + 1] = text.size();
+                continue;
+              }
+              int64 n_entries = 0;
+              ForEachToken(text, delimiters, skip_empty,
+                           [&n_entries](StringPiece) { ++n_entries; });
+              row_starts[i + 1] = n_entries;
+            }
+          });
     int64 max_num_entries = 0;
-    std::vector<int64> num_indices(batch_size);
     for (int64 i = 0; i < batch_size; ++i) {
-      std::vector<string> parts = Split(input_vec(i), delimiter, skip_empty_);
-      int64 n_entries = parts.size();
-      num_indices[i] = n_entries;
-      output_size += n_entries;
-      max_num_entries = std::max(max_num_entries, n_entries);
-      tokens.insert(tokens.end(), parts.begin(), parts.end());
+      max_num_entries = std::max(max_num_entries, row_starts[i + 1]);
+      row_starts[i + 1] += row_starts[i];
     }
+    const int64 output_size = row_starts[batch_size];
 
     Tensor* sp_indices_t;
     OP_REQUIRES_OK(ctx, ctx->allocate_output(0, TensorShape({output_size, 2}),
@@ -107,15 +154,28 @@ class StringSplitOp : public OpKernel {
     auto sp_shape = sp_shape_t->vec<int64>();
     sp_shape(0) = batch_size;
     sp_shape(1) = max_num_entries;
-    size_t c = 0;
-    for (size_t i = 0; i < batch_size; ++i) {
-      for (size_t j = 0; j < num_indices[i]; ++j) {
-        sp_indices(c, 0) = i;
-        sp_indices(c, 1) = j;
-        sp_tokens(c) = tokens[c];
-        ++c;
-      }
-    }
+
+    // Second pass: write every token straight into its output slot.
+    Shard(worker_threads->num_threads, worker_threads->workers, batch_size,
+          cost_per_row, [&](int64 begin, int64 end) {
+            for (int64 i = begin; i < end; ++i) {
+              const string& text = input_vec(i);
+              int64 c = row_starts[i];
+              int64 j = 0;
+              auto emit = [&](StringPiece token) {
+                sp_indices(c, 0) = i;
+                sp_indices(c, 1) = j++;
+                sp_tokens(c++).assign(token.data(), token.size());
+              };
+              if (split_chars) {
+                for (size_t k = 0; k < text.size(); ++k) {
+                  emit(StringPiece(text.data() + k, 1));
+                }
+              } else {
+                ForEachToken(text, delimiters, skip_empty, emit);
+              }
+            }
+          });
   }
 
  private:
@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_STRING_TO_HASH_BUCKET_OP_H_
 #define TENSORFLOW_CORE_KERNELS_STRING_TO_HASH_BUCKET_OP_H_
 
+#include <algorithm>
 #include <string>
 
 #include "tensorflow/core/framework/op_kernel.h"
@@ -23,9 +24,21 @@ limitations under the License.
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
+// Estimated cost of hashing one element of `input` and taking its bucket,
+// used to decide how many threads to shard a batch over.
+template <typename Flat>
+int64 HashCostPerElement(const Flat& input) {
+  // Sample a prefix of the batch rather than reading every length.
+  const int64 n = std::min<int64>(input.size(), 64);
+  int64 bytes = 0;
+  for (int64 i = 0; i < n; ++i) bytes += input(i).size();
+  return 50 + bytes / std::max<int64>(n, 1);
+}
+
 template <uint64 hash(StringPiece)>
 class StringToHashBucketOp : public OpKernel {
  public:
@@ -44,15 +57,19 @@ class StringToHashBucketOp : public OpKernel {
                                             &output_tensor));
     auto output_flat = output_tensor->flat<int64>();
 
-    typedef decltype(input_flat.size()) Index;
-    for (Index i = 0; i < input_flat.size(); ++i) {
-      const uint64 input_hash = hash(input_flat(i));
-      const uint64 bucket_id = input_hash % num_buckets_;
-      // The number of buckets is always in the positive range of int64 so is
-      // the resulting bucket_id. Casting the bucket_id from uint64 to int64 is
-      // safe.
-      output_flat(i) = static_cast<int64>(bucket_id);
-    }
+    auto work = [this, &input_flat, &output_flat](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        const uint64 input_hash = hash(input_flat(i));
+        const uint64 bucket_id = input_hash % num_buckets_;
+        // The number of buckets is always in the positive range of int64 so
+        // is the resulting bucket_id. Casting the bucket_id from uint64 to
+        // int64 is safe.
+        output_flat(i) = static_cast<int64>(bucket_id);
+      }
+    };
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers,
+          input_flat.size(), HashCostPerElement(input_flat), work);
   }
 
  private:
@@ -86,15 +103,20 @@ class StringToKeyedHashBucketOp : public OpKernel {
                                             &output_tensor));
     auto output_flat = output_tensor->flat<int64>();
 
-    typedef decltype(input_flat.size()) Index;
-    for (Index i = 0; i < input_flat.size(); ++i) {
-      const uint64 input_hash = hash(key_, input_flat(i));
-      const uint64 bucket_id = input_hash % num_buckets_;
-      // The number of buckets is always in the positive range of int64 so is
-      // the resulting bucket_id. Casting the bucket_id from uint64 to int64 is
-      // safe.
-      output_flat(i) = static_cast<int64>(bucket_id);
-    }
+    auto work = [this, &input_flat, &output_flat](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        const uint64 input_hash = hash(key_, input_flat(i));
+        const uint64 bucket_id = input_hash % num_buckets_;
+        // The number of buckets is always in the positive range of int64 so
+        // is the resulting bucket_id. Casting the bucket_id from uint64 to
+        // int64 is safe.
+        output_flat(i) = static_cast<int64>(bucket_id);
+      }
+    };
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    // The keyed hash is several times slower per byte than the fast one.
+    Shard(worker_threads->num_threads, worker_threads->workers,
+          input_flat.size(), 4 * HashCostPerElement(input_flat), work);
   }
 
  private:
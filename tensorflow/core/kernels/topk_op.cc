@@ -20,6 +20,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/topk_op.h"
 
 #include <algorithm>
+#include <cmath>
 #include <numeric>
 #include <vector>
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
@@ -97,6 +98,110 @@ class TopK : public OpKernel {
   bool sorted_;
 };
 
+namespace {
+
+// TopK of a row prefilters the candidates for selection with a threshold
+// estimated from at most kMaxThresholdSamples evenly strided values of the
+// row, one every kColsPerThresholdSample columns or more. Rows too short to
+// give kMinThresholdSamples samples are not prefiltered.
+const int64 kMaxThresholdSamples = 1024;
+const int64 kMinThresholdSamples = 64;
+const int64 kColsPerThresholdSample = 16;
+
+// Orders column indices of a row by decreasing value, breaking ties by
+// increasing index. This is the order in which TopK returns them.
+template <typename T>
+struct StableGreater {
+  bool operator()(const int32 a, const int32 b) const {
+    if (data[b] < data[a]) return true;
+    if (data[b] > data[a]) return false;
+    return a < b;
+  }
+  const T* data;
+};
+
+// Orders values decreasingly with NaNs last, which unlike std::greater is a
+// strict weak order even if there are NaNs.
+template <typename T>
+bool GreaterNanLast(const T a, const T b) {
+  return b < a || (a == a && b != b);
+}
+
+// Estimates a threshold that at least k, but typically not many more, of the
+// num_cols values of `data` are greater than or equal to. Returns false if
+// the row is too short for sampling, or k is so large that the threshold
+// would not filter out most of the row.
+template <typename T>
+bool EstimateThreshold(const T* data, int64 num_cols, int k,
+                       std::vector<T>* sample, T* threshold) {
+  const int64 num_samples =
+      std::min(kMaxThresholdSamples, num_cols / kColsPerThresholdSample);
+  if (num_samples < kMinThresholdSamples) return false;
+  // Take the sample at three standard deviations, plus a few, above the
+  // expected rank of the k-th largest value, so that fewer than k values
+  // pass the threshold only rarely.
+  const double expected_rank =
+      static_cast<double>(k) * num_samples / num_cols;
+  const int64 rank =
+      static_cast<int64>(expected_rank + 3 * std::sqrt(expected_rank)) + 3;
+  if (4 * rank > num_samples) return false;
+  sample->resize(num_samples);
+  for (int64 i = 0; i < num_samples; ++i) {
+    (*sample)[i] = data[i * num_cols / num_samples];
+  }
+  std::nth_element(sample->begin(), sample->begin() + rank - 1, sample->end(),
+                   GreaterNanLast<T>);
+  *threshold = (*sample)[rank - 1];
+  return true;
+}
+
+// Writes the indices of the k largest of the num_cols values of `data` to
+// `indices`, in decreasing order of value if `sorted` and in increasing
+// order of index otherwise. Selects them with nth_element, among the columns
+// that pass an estimated threshold if possible and among all columns
+// otherwise. Returns false, without writing any index, if the row contains
+// NaNs, for which there is no strict weak order to select with.
+template <typename T>
+bool SelectTopK(const T* data, int64 num_cols, int k, bool sorted,
+                std::vector<T>* sample, std::vector<int32>* candidates,
+                int32* indices) {
+  candidates->resize(num_cols);
+  int32* begin = candidates->data();
+  int64 num_candidates = 0;
+  bool has_nan = false;
+  T threshold;
+  if (EstimateThreshold(data, num_cols, k, sample, &threshold)) {
+    // Branch-free, so that its speed does not depend on how predictably
+    // values pass the threshold.
+    for (int32 c = 0; c < num_cols; ++c) {
+      const T value = data[c];
+      has_nan |= value != value;
+      begin[num_candidates] = c;
+      num_candidates += value >= threshold;
+    }
+  }
+  if (num_candidates < k) {
+    for (int32 c = 0; c < num_cols; ++c) {
+      has_nan |= data[c] != data[c];
+      begin[c] = c;
+    }
+    num_candidates = num_cols;
+  }
+  if (has_nan) return false;
+
+  const StableGreater<T> greater{data};
+  std::nth_element(begin, begin + k - 1, begin + num_candidates, greater);
+  if (sorted) {
+    std::sort(begin, begin + k, greater);
+  } else {
+    std::sort(begin, begin + k);
+  }
+  std::copy(begin, begin + k, indices);
+  return true;
+}
+
+}  // namespace
+
 namespace functor {
 
 template <typename T>
@@ -135,6 +240,8 @@ struct TopKFunctor<CPUDevice, T> {
     }
 
     auto SortIndices = [&, context](int start_batch, int limit_batch) {
+      std::vector<T> sample;
+      std::vector<int32> candidates;
       for (int32 b = start_batch; b < limit_batch; ++b) {
         const T* input_data = &input(b, 0);
         const auto stable_comp = [input_data](const int32 a, const int32 b) {
@@ -149,11 +256,6 @@ struct TopKFunctor<CPUDevice, T> {
         const auto comp = [input_data](const int32 a, const int32 b) {
           return input_data[b] < input_data[a];
         };
-        // TODO(ebrevdo): For large k < num_cols, instead of using
-        // TopN, it may be faster to create a temporary vector of
-        // values 0..num_cols - 1 and then use std::partial_sort_copy
-        // of this into indices. Choosing the appropriate minimum k or
-        // ratio of k/num_cols will require some experimentation.
         if (k == num_cols) {
           auto* begin = &indices(b, 0);
           auto* end = &indices(b, k);
@@ -176,8 +278,9 @@ struct TopKFunctor<CPUDevice, T> {
             }
             run_begin = run_end;
           }
-        } else {
-          // Use the TopN heap object to sort.
+        } else if (!SelectTopK(input_data, num_cols, k, sorted, &sample,
+                               &candidates, &indices(b, 0))) {
+          // The row has NaNs, which the TopN heap tolerates.
           gtl::TopN<int32, decltype(stable_comp)> filter(k, stable_comp);
           filter.reserve(num_cols);
           for (int32 c = 0; c < num_cols; ++c) {
@@ -205,15 +308,15 @@ struct TopKFunctor<CPUDevice, T> {
       }  // for (int32 b = ...
     };
 
-    // Guesstimate of cost; 4*N*log(K) where N == num_cols.
-    // If K == N, assume the cost is N*log(K + 1).
+    // Guesstimate of cost; if K == N, assume the cost is N*log(K + 1) for the
+    // sort. Otherwise assume 2*N for the selection and K*log(K + 1) for
+    // sorting the selected values.
     const double cmp_cost = 3 * Eigen::TensorOpCost::AddCost<int32>() +
                             Eigen::TensorOpCost::AddCost<T>();
-    const double base_cost =
-        cmp_cost *
-        static_cast<double>(num_cols *
-                            Eigen::numext::log2(static_cast<float>(k + 1)));
-    const double sort_cost = (k == num_cols) ? base_cost : 4 * base_cost;
+    const double log_k = Eigen::numext::log2(static_cast<float>(k + 1));
+    const double sort_cost =
+        (k == num_cols) ? cmp_cost * num_cols * log_k
+                        : cmp_cost * (2 * num_cols + k * log_k);
     const double copy_cost = 2 * k * Eigen::TensorOpCost::AddCost<T>();
     const double total_cost = sort_cost + copy_cost;
     const int64 final_cost = (total_cost >= static_cast<double>(kint64max))
@@ -13,9 +13,12 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
 #include <functional>
+#include <memory>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/register_types.h"
@@ -24,11 +27,189 @@ limitations under the License.
 #include "tensorflow/core/kernels/bounds_check.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
 typedef Eigen::ThreadPoolDevice CPUDevice;
 
+namespace {
+
+// Inputs with fewer elements are deduplicated on the calling thread.
+const int64 kMinParallelUniqueSize = 64 * 1024;
+// Minimum number of elements in a partition of a parallel Unique.
+const int64 kMinUniquePartitionSize = 16 * 1024;
+
+// Number of blocks of a vector of `size` elements that are processed in
+// parallel.
+int64 NumUniqueBlocks(int64 size,
+                      const DeviceBase::CpuWorkerThreads& workers) {
+  if (size < kMinParallelUniqueSize || workers.num_threads <= 1) return 1;
+  return std::max<int64>(1, std::min<int64>(4 * workers.num_threads,
+                                            size / kMinUniquePartitionSize));
+}
+
+// Calls fn(b, start, limit) in parallel for every block b of `num_blocks`
+// equal blocks of [0, size), where `cost` is the cost of an element.
+void ForEachUniqueBlock(const DeviceBase::CpuWorkerThreads& workers,
+                        int64 size, int64 num_blocks, int64 cost,
+                        const std::function<void(int64, int64, int64)>& fn) {
+  const int64 block_size = (size + num_blocks - 1) / num_blocks;
+  Shard(workers.num_threads, workers.workers, num_blocks, cost * block_size,
+        [&fn, size, block_size](int64 start, int64 limit) {
+          for (int64 b = start; b < limit; ++b) {
+            fn(b, std::min(size, b * block_size),
+               std::min(size, (b + 1) * block_size));
+          }
+        });
+}
+
+template <typename T>
+uint64 UniqueHash(const T& value) {
+  // std::hash is the identity for integers, so mix its bits: partitions are
+  // picked by the high bits and buckets by the low bits of the hash.
+  uint64 h = std::hash<T>()(value);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+uint64 UniqueHash(const string& value) { return Hash64(value); }
+
+// Set of elements of an input vector, stored as their positions in a flat
+// open-addressing table with linear probing.
+template <typename T>
+class UniqueTable {
+ public:
+  explicit UniqueTable(const T* input) : input_(input) { Resize(1024); }
+
+  // Returns the position of the first occurrence of input[position], where
+  // positions must be inserted in increasing order.
+  int32 Insert(int32 position, uint64 hash) {
+    if (2 * (size_ + 1) > slots_.size()) Resize(2 * slots_.size());
+    const uint32 tag = static_cast<uint32>(hash);
+    for (uint32 b = tag & mask_;; b = (b + 1) & mask_) {
+      Slot& slot = slots_[b];
+      if (slot.position < 0) {
+        slot.tag = tag;
+        slot.position = position;
+        ++size_;
+        return position;
+      }
+      if (slot.tag == tag && input_[slot.position] == input_[position]) {
+        return slot.position;
+      }
+    }
+  }
+
+ private:
+  struct Slot {
+    uint32 tag;
+    int32 position;  // -1 if the slot is empty.
+  };
+
+  void Resize(size_t num_slots) {
+    std::vector<Slot> old_slots(num_slots, Slot{0, -1});
+    old_slots.swap(slots_);
+    mask_ = num_slots - 1;
+    for (const Slot& slot : old_slots) {
+      if (slot.position < 0) continue;
+      uint32 b = slot.tag & mask_;
+      while (slots_[b].position >= 0) b = (b + 1) & mask_;
+      slots_[b] = slot;
+    }
+  }
+
+  const T* const input_;
+  std::vector<Slot> slots_;
+  uint32 mask_ = 0;
+  size_t size_ = 0;
+};
+
+// Sets first[i] to the position of the first occurrence of input[i] for every
+// i < size, and if `counts` is not null, counts[first[i]] to its number of
+// occurrences.
+//
+// Large inputs are hash partitioned with a parallel counting sort that keeps
+// the positions of each partition in increasing order, and the partitions are
+// deduplicated in parallel.
+template <typename T>
+void FindFirstOccurrences(const T* input, int64 size,
+                          const DeviceBase::CpuWorkerThreads& workers,
+                          int32* first, int32* counts) {
+  const int64 num_partitions = NumUniqueBlocks(size, workers);
+  auto dedupe = [input, first, counts](UniqueTable<T>* table, int32 position,
+                                       uint64 hash) {
+    const int32 f = table->Insert(position, hash);
+    first[position] = f;
+    if (counts == nullptr) return;
+    if (f == position) {
+      counts[f] = 1;
+    } else {
+      ++counts[f];
+    }
+  };
+  if (num_partitions <= 1) {
+    UniqueTable<T> table(input);
+    for (int64 i = 0; i < size; ++i) {
+      dedupe(&table, i, UniqueHash(input[i]));
+    }
+    return;
+  }
+
+  auto partition_of = [num_partitions](uint64 hash) {
+    return static_cast<int64>(((hash >> 32) * num_partitions) >> 32);
+  };
+  // The input is split into num_partitions blocks, and
+  // offsets[b * num_partitions + p] is where block b scatters the positions
+  // of partition p.
+  const int64 num_blocks = num_partitions;
+  std::unique_ptr<uint64[]> hashes(new uint64[size]);
+  std::vector<int64> offsets(num_blocks * num_partitions, 0);
+  ForEachUniqueBlock(workers, size, num_blocks, 50,
+                     [&](int64 b, int64 start, int64 limit) {
+                       int64* block_counts = &offsets[b * num_partitions];
+                       for (int64 i = start; i < limit; ++i) {
+                         hashes[i] = UniqueHash(input[i]);
+                         ++block_counts[partition_of(hashes[i])];
+                       }
+                     });
+  std::vector<int64> partition_starts(num_partitions + 1);
+  int64 total = 0;
+  for (int64 p = 0; p < num_partitions; ++p) {
+    partition_starts[p] = total;
+    for (int64 b = 0; b < num_blocks; ++b) {
+      const int64 count = offsets[b * num_partitions + p];
+      offsets[b * num_partitions + p] = total;
+      total += count;
+    }
+  }
+  partition_starts[num_partitions] = total;
+
+  std::unique_ptr<int32[]> positions(new int32[size]);
+  ForEachUniqueBlock(workers, size, num_blocks, 10,
+                     [&](int64 b, int64 start, int64 limit) {
+                       int64* block_offsets = &offsets[b * num_partitions];
+                       for (int64 i = start; i < limit; ++i) {
+                         positions[block_offsets[partition_of(hashes[i])]++] =
+                             i;
+                       }
+                     });
+  ForEachUniqueBlock(
+      workers, size, num_partitions, 100,
+      [&](int64 p, int64 unused_start, int64 unused_limit) {
+        UniqueTable<T> table(input);
+        for (int64 k = partition_starts[p]; k < partition_starts[p + 1]; ++k) {
+          dedupe(&table, positions[k], hashes[positions[k]]);
+        }
+      });
+}
+
+}  // namespace
+
 template <typename T, typename TIndex>
 class UniqueOp : public OpKernel {
  public:
@@ -101,32 +282,9 @@ class UniqueOp : public OpKernel {
     int64 uniq_size;
     if (new_sizes[0] == 1 && new_sizes[2] == 1) {
       // Specialized and faster implementation when unique is run over single
-      // elements. Here we put T directly into the map rather than ints pointing
-      // to them as in the general case.
-      auto Tin = input.flat<T>();
-      const int64 N = static_cast<int64>(Tin.size());
-
-      std::unordered_map<T, TIndex> uniq;
-      uniq.reserve(2 * N);
-      for (int64 i = 0, j = 0; i < N; ++i) {
-        auto it = uniq.insert(std::make_pair(Tin(i), j));
-        idx_vec(i) = it.first->second;
-        if (it.second) {
-          ++j;
-        }
-      }
-
-      uniq_size = static_cast<int64>(uniq.size());
-      TensorShape output_shape(input.shape());
-      output_shape.set_dim(axis, uniq_size);
-      Tensor* output = nullptr;
-      OP_REQUIRES_OK(context,
-                     context->allocate_output(0, output_shape, &output));
-      auto Tout = output->flat<T>();
-
-      for (auto it : uniq) {
-        Tout(it.second) = it.first;
-      }
+      // elements.
+      OP_REQUIRES_OK(context, UniqueVector(context, input, axis, &idx_vec));
+      return;
     } else {
       // General implementation when unique is run over multiple elements.
       auto Tin = input.shaped<T, 3>(new_sizes);
@@ -191,6 +349,71 @@ class UniqueOp : public OpKernel {
       }
     }
   }
+
+ private:
+  // Computes the outputs for a vector input with flat hash tables, in
+  // parallel for large inputs.
+  Status UniqueVector(OpKernelContext* context, const Tensor& input,
+                      int64 axis, typename TTypes<TIndex>::Vec* idx_vec) {
+    auto Tin = input.flat<T>();
+    const int64 N = static_cast<int64>(Tin.size());
+    const bool with_counts = num_outputs() > 2;
+    std::unique_ptr<int32[]> first(new int32[N]);
+    std::unique_ptr<int32[]> counts(with_counts ? new int32[N] : nullptr);
+    const DeviceBase::CpuWorkerThreads& workers =
+        *context->device()->tensorflow_cpu_worker_threads();
+    FindFirstOccurrences(Tin.data(), N, workers, first.get(), counts.get());
+
+    // Ids are assigned in order of first occurrence: block b numbers its first
+    // occurrences from block_ids[b] on.
+    const int64 num_blocks = NumUniqueBlocks(N, workers);
+    std::vector<int64> block_ids(num_blocks + 1, 0);
+    ForEachUniqueBlock(workers, N, num_blocks, 2,
+                       [&block_ids, &first](int64 b, int64 start,
+                                            int64 limit) {
+                         for (int64 i = start; i < limit; ++i) {
+                           block_ids[b + 1] += first[i] == i;
+                         }
+                       });
+    for (int64 b = 0; b < num_blocks; ++b) {
+      block_ids[b + 1] += block_ids[b];
+    }
+
+    const int64 uniq_size = block_ids[num_blocks];
+    TensorShape output_shape(input.shape());
+    output_shape.set_dim(axis, uniq_size);
+    Tensor* output = nullptr;
+    TF_RETURN_IF_ERROR(context->allocate_output(0, output_shape, &output));
+    auto Tout = output->flat<T>();
+    Tensor* count_output = nullptr;
+    if (with_counts) {
+      TF_RETURN_IF_ERROR(context->allocate_output(
+          2, TensorShape({uniq_size}), &count_output));
+    }
+
+    ForEachUniqueBlock(
+        workers, N, num_blocks, 5, [&](int64 b, int64 start, int64 limit) {
+          TIndex id = block_ids[b];
+          for (int64 i = start; i < limit; ++i) {
+            if (first[i] != i) continue;
+            (*idx_vec)(i) = id;
+            Tout(id) = Tin(i);
+            if (with_counts) count_output->vec<TIndex>()(id) = counts[i];
+            ++id;
+          }
+        });
+    ForEachUniqueBlock(workers, N, num_blocks, 2,
+                       [idx_vec, &first](int64 b, int64 start, int64 limit) {
+                         // The first occurrences are only read, as other
+                         // blocks may be reading them concurrently.
+                         for (int64 i = start; i < limit; ++i) {
+                           if (first[i] != i) {
+                             (*idx_vec)(i) = (*idx_vec)(first[i]);
+                           }
+                         }
+                       });
+    return Status::OK();
+  }
 };
 
 #define REGISTER_UNIQUE(type)                                    \
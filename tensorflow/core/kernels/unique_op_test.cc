@@ -15,10 +15,15 @@ limitations under the License.
 
 #include <functional>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/graph/node_builder.h"
@@ -26,6 +31,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 
@@ -35,6 +41,62 @@ namespace {
 
 const int kMaxStrLen = 40;
 
+class UniqueWithCountsOpTest : public OpsTestBase {
+ protected:
+  // Checks the outputs for an input of `size` elements in [0, cardinality).
+  void CheckRandomInput(int size, int cardinality) {
+    TF_ASSERT_OK(NodeDefBuilder("unique", "UniqueWithCounts")
+                     .Input(FakeInput(DT_INT64))
+                     .Attr("out_idx", DT_INT32)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    random::PhiloxRandom philox(301, 17);
+    random::SimplePhilox rnd(&philox);
+    std::vector<int64> input(size);
+    for (int64& x : input) {
+      x = rnd.Uniform64(cardinality);
+    }
+    AddInputFromArray<int64>(TensorShape({size}), input);
+    TF_ASSERT_OK(RunOpKernel());
+
+    // Unique elements are output in order of first occurrence.
+    std::unordered_map<int64, int32> ids;
+    std::vector<int64> expected_y;
+    std::vector<int32> expected_idx;
+    std::vector<int32> expected_count;
+    for (const int64 x : input) {
+      const int32 next_id = expected_y.size();
+      auto it = ids.emplace(x, next_id).first;
+      if (it->second == next_id) {
+        expected_y.push_back(x);
+        expected_count.push_back(0);
+      }
+      expected_idx.push_back(it->second);
+      ++expected_count[it->second];
+    }
+    test::ExpectTensorEqual<int64>(
+        test::AsTensor<int64>(expected_y, {int64(expected_y.size())}),
+        *GetOutput(0));
+    test::ExpectTensorEqual<int32>(test::AsTensor<int32>(expected_idx, {size}),
+                                   *GetOutput(1));
+    test::ExpectTensorEqual<int32>(
+        test::AsTensor<int32>(expected_count,
+                              {int64(expected_count.size())}),
+        *GetOutput(2));
+  }
+};
+
+TEST_F(UniqueWithCountsOpTest, Small) { CheckRandomInput(1000, 100); }
+
+// Large enough to be deduplicated in parallel.
+TEST_F(UniqueWithCountsOpTest, LargeFewUnique) {
+  CheckRandomInput(1 << 20, 100);
+}
+
+TEST_F(UniqueWithCountsOpTest, LargeManyUnique) {
+  CheckRandomInput(1 << 20, 1 << 22);
+}
+
 TensorProto GetRandomInt32TensorProto(int dim, int max_int) {
   TensorProto tensor_proto;
   tensor_proto.set_dtype(DT_INT32);
@@ -180,6 +242,42 @@ BENCHMARK(BM_Unique_INT32_Repeat)
     ->ArgPair(64 * 1024, 64 * 1024 * 1024)
     ->ArgPair(1024 * 1024, 64 * 1024 * 1024);
 
+// Unique over `dim` int64 ids drawn from `cardinality` values, which is what
+// deduplicating embedding ids costs.
+static void BM_Unique_INT64_Cardinality(int iters, int dim, int cardinality) {
+  testing::StopTiming();
+  Graph* g = new Graph(OpRegistry::Global());
+
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  Tensor input(DT_INT64, TensorShape({dim}));
+  auto input_flat = input.flat<int64>();
+  for (int i = 0; i < dim; ++i) {
+    input_flat(i) = rnd.Uniform64(cardinality);
+  }
+
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "UniqueWithCounts")
+                  .Input(test::graph::Constant(g, input))
+                  .Attr("T", DT_INT64)
+                  .Finalize(g, &node));
+
+  testing::ItemsProcessed(static_cast<int64>(iters) * dim);
+  testing::UseRealTime();
+  testing::StartTiming();
+  test::Benchmark("cpu", g).Run(iters);
+}
+
+BENCHMARK(BM_Unique_INT64_Cardinality)
+    ->ArgPair(64 * 1024, 1024)
+    ->ArgPair(64 * 1024, 1024 * 1024)
+    ->ArgPair(1024 * 1024, 1024)
+    ->ArgPair(1024 * 1024, 64 * 1024)
+    ->ArgPair(1024 * 1024, 16 * 1024 * 1024)
+    ->ArgPair(10 * 1024 * 1024, 1024)
+    ->ArgPair(10 * 1024 * 1024, 1024 * 1024)
+    ->ArgPair(10 * 1024 * 1024, 1024 * 1024 * 1024);
+
 BENCHMARK(BM_Unique_STRING)
     ->Arg(32)
     ->Arg(256)
@@ -304,6 +304,21 @@ REGISTER_OP("MutableDenseHashTableV2")
     .SetIsStateful()
     .SetShapeFn(ScalarOutput);
 
+REGISTER_OP("MemmappedHashTable")
+    .Input("filename: string")
+    .Output("table_handle: resource")
+    .Attr("container: string = ''")
+    .Attr("shared_name: string = ''")
+    .Attr("use_node_name_sharing: bool = false")
+    .Attr("key_dtype: type")
+    .Attr("value_dtype: type")
+    .SetIsStateful()
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &unused));
+      return ScalarOutput(c);
+    });
+
 REGISTER_OP("InitializeTable")
     .Input("table_handle: Ref(string)")
     .Input("keys: Tkey")
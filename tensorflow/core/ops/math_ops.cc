@@ -716,6 +716,112 @@ REGISTER_OP("MatMul")
     .Attr("T: {bfloat16, half, float, double, int32, complex64, complex128}")
     .SetShapeFn(shape_inference::MatMulShape);
 
+REGISTER_OP("_FusedMatMul")
+    .Input("a: T")
+    .Input("b: T")
+    .Input("args: num_args * T")
+    .Output("product: T")
+    .Attr("transpose_a: bool = false")
+    .Attr("transpose_b: bool = false")
+    .Attr("b_is_constant: bool = false")
+    .Attr("T: {float, double}")
+    .Attr("num_args: int >= 0")
+    .Attr("fused_ops: list(string) = []")
+    .SetShapeFn(shape_inference::MatMulShape)
+    .Doc(R"doc(
+Performs a MatMul followed by the ops listed in `fused_ops`, which are
+"BiasAdd", optionally followed by "Relu" or "Relu6". `args` holds the extra
+inputs of the fused ops: the bias. If `b_is_constant`, `b` is packed for the
+multiplication once and reused for as long as it is the same tensor.
+
+NOTE Do not invoke this operator directly in Python. Grappler's Remapper is
+expected to substitute it for the ops it fuses.
+)doc");
+
+namespace {
+
+// Sets `out` to the shape that `x` and `y` broadcast to, for _FusedElementwise
+// whose args only broadcast along their leading dimensions. Unknown dimensions
+// are assumed to broadcast to the other dimension, as in
+// BroadcastBinaryOpOutputShapeFn.
+Status FusedElementwiseBroadcastShape(InferenceContext* c, ShapeHandle x,
+                                      ShapeHandle y, ShapeHandle* out) {
+  if (!c->RankKnown(x) || !c->RankKnown(y)) {
+    *out = c->UnknownShape();
+    return Status::OK();
+  }
+  const int32 rank_x = c->Rank(x);
+  const int32 rank_y = c->Rank(y);
+  const int32 rank = std::max(rank_x, rank_y);
+  std::vector<DimensionHandle> dims;
+  for (int i = 0; i < rank; ++i) {
+    // Missing leading dimensions broadcast.
+    if (i < rank - rank_x) {
+      dims.push_back(c->Dim(y, i - (rank - rank_y)));
+      continue;
+    }
+    if (i < rank - rank_y) {
+      dims.push_back(c->Dim(x, i - (rank - rank_x)));
+      continue;
+    }
+    const DimensionHandle dim_x = c->Dim(x, i - (rank - rank_x));
+    const DimensionHandle dim_y = c->Dim(y, i - (rank - rank_y));
+    if (c->Value(dim_x) == 1) {
+      dims.push_back(dim_y);
+    } else if (c->Value(dim_y) == 1) {
+      dims.push_back(dim_x);
+    } else if (!c->ValueKnown(dim_x) || !c->ValueKnown(dim_y)) {
+      if (c->ValueKnown(dim_x)) {
+        dims.push_back(dim_x);
+      } else if (c->ValueKnown(dim_y) || dim_x.SameHandle(dim_y)) {
+        dims.push_back(dim_y);
+      } else {
+        dims.push_back(c->UnknownDim());
+      }
+    } else {
+      DimensionHandle dim;
+      TF_RETURN_IF_ERROR(c->Merge(dim_x, dim_y, &dim));
+      dims.push_back(dim);
+    }
+  }
+  *out = c->MakeShape(dims);
+  return Status::OK();
+}
+
+}  // namespace
+
+REGISTER_OP("_FusedElementwise")
+    .Input("args: N * T")
+    .Output("outputs: num_outputs * T")
+    .Attr("T: {float, double}")
+    .Attr("N: int >= 1")
+    .Attr("num_outputs: int >= 1")
+    .Attr("fused_ops: list(string)")
+    .Attr("operands: list(int)")
+    .Attr("output_ids: list(int)")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle out = c->input(0);
+      for (int i = 1; i < c->num_inputs(); ++i) {
+        TF_RETURN_IF_ERROR(
+            FusedElementwiseBroadcastShape(c, out, c->input(i), &out));
+      }
+      for (int i = 0; i < c->num_outputs(); ++i) {
+        c->set_output(i, out);
+      }
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Evaluates a DAG of elementwise ops in a single pass over `args`. Op i of the
+DAG is `fused_ops[i]`, applied to the values `operands[2 * i]` and
+`operands[2 * i + 1]` (-1 for unary ops), where values 0 to N - 1 are `args`
+and value N + j is the result of op j. `outputs` are the values listed in
+`output_ids`. All the args must broadcast to the shape of the largest one
+along their leading dimensions only, as a scalar or a bias does.
+
+NOTE Do not invoke this operator directly in Python. Grappler's Remapper is
+expected to substitute it for the ops it fuses.
+)doc");
+
 REGISTER_OP("SparseMatMul")
     .Input("a: Ta")
     .Input("b: Tb")
@@ -973,6 +1079,49 @@ Status SparseSegmentReductionWithNumSegmentsShapeFn(InferenceContext* c) {
   return Status::OK();
 }
 
+Status FusedEmbeddingLookupSparseShapeFn(InferenceContext* c) {
+  ShapeHandle params_shape;
+  TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(0), 1, &params_shape));
+
+  ShapeHandle ids_shape;
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &ids_shape));
+
+  // weights is either empty or has one element per id.
+  ShapeHandle unused;
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 1, &unused));
+
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 1, &unused));
+  TF_RETURN_IF_ERROR(c->Merge(ids_shape, c->input(3), &unused));
+
+  ShapeHandle subshape;
+  TF_RETURN_IF_ERROR(c->Subshape(params_shape, 1, &subshape));
+
+  ShapeHandle out;
+  TF_RETURN_IF_ERROR(
+      c->Concatenate(c->Vector(InferenceContext::kUnknownDim), subshape, &out));
+  c->set_output(0, out);
+  return Status::OK();
+}
+
+Status FusedEmbeddingLookupSparseGradShapeFn(InferenceContext* c) {
+  ShapeHandle grad_shape;
+  TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(0), 1, &grad_shape));
+
+  ShapeHandle unused;
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &unused));
+
+  ShapeHandle segment_ids_shape;
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 1, &segment_ids_shape));
+
+  ShapeHandle subshape;
+  TF_RETURN_IF_ERROR(c->Subshape(grad_shape, 1, &subshape));
+
+  ShapeHandle out;
+  TF_RETURN_IF_ERROR(c->Concatenate(segment_ids_shape, subshape, &out));
+  c->set_output(0, out);
+  return Status::OK();
+}
+
 Status UnsortedSegmentReductionShapeFn(InferenceContext* c) {
   ShapeHandle s_data = c->input(0);
   ShapeHandle s_segment_ids = c->input(1);
@@ -1165,6 +1314,26 @@ REGISTER_OP("SparseSegmentSqrtNGrad")
     .Attr("Tidx: {int32, int64} = DT_INT32")
     .SetShapeFn(SparseSegmentReductionGradShapeFn);
 
+REGISTER_OP("FusedEmbeddingLookupSparse")
+    .Input("params: T")
+    .Input("ids: Tidx")
+    .Input("weights: T")
+    .Input("segment_ids: int32")
+    .Output("output: T")
+    .Attr("T: {float, double}")
+    .Attr("Tidx: {int32, int64} = DT_INT32")
+    .Attr("combiner: {'sum', 'mean', 'sqrtn'} = 'mean'")
+    .SetShapeFn(FusedEmbeddingLookupSparseShapeFn);
+
+REGISTER_OP("FusedEmbeddingLookupSparseGrad")
+    .Input("grad: T")
+    .Input("weights: T")
+    .Input("segment_ids: int32")
+    .Output("output: T")
+    .Attr("T: {float, double}")
+    .Attr("combiner: {'sum', 'mean', 'sqrtn'} = 'mean'")
+    .SetShapeFn(FusedEmbeddingLookupSparseGradShapeFn);
+
 REGISTER_OP("All")
     .Input("input: bool")
     .Input("reduction_indices: Tidx")
@@ -528,4 +528,25 @@ TEST(MathOpsTest, Cross_ShapeFn) {
   INFER_OK(op, "[?];[?]", "in0");
   INFER_OK(op, "[1,?,3];[?,?,?]", "in0");
 }
+
+TEST(MathOpsTest, FusedElementwise_ShapeFn) {
+  ShapeInferenceTestOp op("_FusedElementwise");
+  TF_ASSERT_OK(NodeDefBuilder("test", "_FusedElementwise")
+                   .Input({{"a", 0, DT_FLOAT},
+                           {"b", 0, DT_FLOAT},
+                           {"c", 0, DT_FLOAT}})
+                   .Attr("num_outputs", 2)
+                   .Attr("fused_ops", {"Mul", "Add"})
+                   .Attr("operands", {0, 1, 3, 2})
+                   .Attr("output_ids", {3, 4})
+                   .Finalize(&op.node_def));
+
+  // All the outputs have the shape the args broadcast to.
+  INFER_OK(op, "[2,3];[3];[]", "[d0_0,d0_1|d1_0];[d0_0,d0_1|d1_0]");
+  INFER_OK(op, "[1,3];[2,3];[]", "[d1_0,d0_1|d1_1];[d1_0,d0_1|d1_1]");
+  INFER_OK(op, "[?,3];[5,3];[3]",
+           "[d1_0,d0_1|d1_1|d2_0];[d1_0,d0_1|d1_1|d2_0]");
+  INFER_OK(op, "?;[3];[]", "?;?");
+  INFER_ERROR("Dimensions must be equal", op, "[2,3];[4];[]");
+}
 }  // end namespace tensorflow
@@ -274,6 +274,236 @@ REGISTER_OP("Conv2D")
     .Attr("dilations: list(int) = [1, 1, 1, 1]")
     .SetShapeFn(shape_inference::Conv2DShape);
 
+REGISTER_OP("_FusedConv2D")
+    .Input("input: T")
+    .Input("filter: T")
+    .Input("args: num_args * T")
+    .Output("output: T")
+    .Attr("T: {float, double}")
+    .Attr("num_args: int >= 0")
+    .Attr("strides: list(int)")
+    .Attr("use_cudnn_on_gpu: bool = true")
+    .Attr(GetPaddingAttrString())
+    .Attr(GetConvnetDataFormatAttrString())
+    .Attr("dilations: list(int) = [1, 1, 1, 1]")
+    .Attr("fused_ops: list(string) = []")
+    .SetShapeFn(shape_inference::Conv2DShape)
+    .Doc(R"doc(
+Performs a Conv2D followed by the ops listed in `fused_ops`, which are
+"BiasAdd", optionally followed by "Relu" or "Relu6". `args` holds the extra
+inputs of the fused ops: the bias.
+
+NOTE Do not invoke this operator directly in Python. Grappler's Remapper is
+expected to substitute it for the ops it fuses.
+)doc");
+
+// --------------------------------------------------------------------------
+// Ops on channel-blocked tensors, see util/blocked_layout.h.
+
+namespace {
+
+// Returns the number of blocks of `block_size` channels holding `channels`.
+DimensionHandle NumChannelBlocksDim(InferenceContext* c,
+                                    DimensionHandle channels,
+                                    int64 block_size) {
+  if (!c->ValueKnown(channels)) return c->UnknownDim();
+  return c->MakeDim((c->Value(channels) + block_size - 1) / block_size);
+}
+
+// Reads the rows and cols of a list attr given in NHWC order.
+Status GetSpatialAttr(InferenceContext* c, const string& name, int32* rows,
+                      int32* cols) {
+  std::vector<int32> values;
+  TF_RETURN_IF_ERROR(c->GetAttr(name, &values));
+  if (values.size() != 4) {
+    return errors::InvalidArgument(name, " must specify 4 dimensions, got ",
+                                   values.size());
+  }
+  *rows = values[1];
+  *cols = values[2];
+  return Status::OK();
+}
+
+Status BlockedConv2DShape(InferenceContext* c) {
+  ShapeHandle input;
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 5, &input));
+  ShapeHandle filter;
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 6, &filter));
+  DimensionHandle unused;
+  TF_RETURN_IF_ERROR(
+      c->Merge(c->Dim(input, 1), c->Dim(filter, 1), &unused));
+  DimensionHandle block_size;
+  TF_RETURN_IF_ERROR(
+      c->Merge(c->Dim(input, 4), c->Dim(filter, 4), &block_size));
+  TF_RETURN_IF_ERROR(c->Merge(block_size, c->Dim(filter, 5), &block_size));
+
+  int32 stride_rows, stride_cols, dilation_rows, dilation_cols;
+  TF_RETURN_IF_ERROR(GetSpatialAttr(c, "strides", &stride_rows, &stride_cols));
+  TF_RETURN_IF_ERROR(
+      GetSpatialAttr(c, "dilations", &dilation_rows, &dilation_cols));
+  Padding padding;
+  TF_RETURN_IF_ERROR(c->GetAttr("padding", &padding));
+  DimensionHandle out_rows, out_cols;
+  TF_RETURN_IF_ERROR(GetWindowedOutputSizeFromDimsV2(
+      c, c->Dim(input, 2), c->Dim(filter, 2), dilation_rows, stride_rows,
+      padding, &out_rows));
+  TF_RETURN_IF_ERROR(GetWindowedOutputSizeFromDimsV2(
+      c, c->Dim(input, 3), c->Dim(filter, 3), dilation_cols, stride_cols,
+      padding, &out_cols));
+  c->set_output(0, c->MakeShape({c->Dim(input, 0), c->Dim(filter, 0),
+                                 out_rows, out_cols, block_size}));
+  return Status::OK();
+}
+
+Status BlockedPoolShape(InferenceContext* c) {
+  ShapeHandle input;
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 5, &input));
+  int32 window_rows, window_cols, stride_rows, stride_cols;
+  TF_RETURN_IF_ERROR(GetSpatialAttr(c, "ksize", &window_rows, &window_cols));
+  TF_RETURN_IF_ERROR(GetSpatialAttr(c, "strides", &stride_rows, &stride_cols));
+  Padding padding;
+  TF_RETURN_IF_ERROR(c->GetAttr("padding", &padding));
+  DimensionHandle out_rows, out_cols;
+  TF_RETURN_IF_ERROR(GetWindowedOutputSizeFromDims(
+      c, c->Dim(input, 2), window_rows, stride_rows, padding, &out_rows));
+  TF_RETURN_IF_ERROR(GetWindowedOutputSizeFromDims(
+      c, c->Dim(input, 3), window_cols, stride_cols, padding, &out_cols));
+  c->set_output(0, c->MakeShape({c->Dim(input, 0), c->Dim(input, 1), out_rows,
+                                 out_cols, c->Dim(input, 4)}));
+  return Status::OK();
+}
+
+}  // namespace
+
+REGISTER_OP("_ToBlockedLayout")
+    .Input("input: T")
+    .Output("output: T")
+    .Attr("T: {float, double}")
+    .Attr("block_size: int")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle input;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 4, &input));
+      int64 block_size;
+      TF_RETURN_IF_ERROR(c->GetAttr("block_size", &block_size));
+      c->set_output(
+          0, c->MakeShape({c->Dim(input, 0),
+                           NumChannelBlocksDim(c, c->Dim(input, 3), block_size),
+                           c->Dim(input, 1), c->Dim(input, 2), block_size}));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Converts an NHWC tensor to its channel-blocked layout
+[N, ceil(C / block_size), H, W, block_size], with zeros in the channels that
+pad the last block.
+
+NOTE Do not invoke this operator directly in Python. Grappler's
+CpuLayoutOptimizer inserts it at the inputs of the ops it converts to the
+blocked layout.
+)doc");
+
+REGISTER_OP("_FromBlockedLayout")
+    .Input("input: T")
+    .Output("output: T")
+    .Attr("T: {float, double}")
+    .Attr("channels: int >= 0")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle input;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 5, &input));
+      int64 channels;
+      TF_RETURN_IF_ERROR(c->GetAttr("channels", &channels));
+      c->set_output(0, c->MakeShape({c->Dim(input, 0), c->Dim(input, 2),
+                                     c->Dim(input, 3), channels}));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Converts a channel-blocked tensor back to the NHWC tensor of `channels`
+channels it holds.
+
+NOTE Do not invoke this operator directly in Python. Grappler's
+CpuLayoutOptimizer inserts it at the outputs of the ops it converts to the
+blocked layout.
+)doc");
+
+REGISTER_OP("_ToBlockedFilter")
+    .Input("filter: T")
+    .Output("output: T")
+    .Attr("T: {float, double}")
+    .Attr("block_size: int")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle filter;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 4, &filter));
+      int64 block_size;
+      TF_RETURN_IF_ERROR(c->GetAttr("block_size", &block_size));
+      c->set_output(
+          0,
+          c->MakeShape({NumChannelBlocksDim(c, c->Dim(filter, 3), block_size),
+                        NumChannelBlocksDim(c, c->Dim(filter, 2), block_size),
+                        c->Dim(filter, 0), c->Dim(filter, 1), block_size,
+                        block_size}));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Converts an HWIO convolution filter to its blocked layout
+[ceil(O / block_size), ceil(I / block_size), H, W, block_size, block_size].
+
+NOTE Do not invoke this operator directly in Python. Grappler's
+CpuLayoutOptimizer converts constant filters itself, and only inserts this op
+for filters computed by the graph.
+)doc");
+
+REGISTER_OP("_BlockedConv2D")
+    .Input("input: T")
+    .Input("filter: T")
+    .Input("args: num_args * T")
+    .Output("output: T")
+    .Attr("T: {float, double}")
+    .Attr("num_args: int >= 0")
+    .Attr("strides: list(int)")
+    .Attr(GetPaddingAttrString())
+    .Attr("dilations: list(int) = [1, 1, 1, 1]")
+    .Attr("fused_ops: list(string) = []")
+    .SetShapeFn(BlockedConv2DShape)
+    .Doc(R"doc(
+Performs a Conv2D on channel-blocked tensors, optionally followed by the ops
+listed in `fused_ops` as in _FusedConv2D. `strides` and `dilations` are given
+in NHWC order.
+
+NOTE Do not invoke this operator directly in Python. Grappler's
+CpuLayoutOptimizer is expected to substitute it for Conv2D and _FusedConv2D.
+)doc");
+
+REGISTER_OP("_BlockedMaxPool")
+    .Input("input: T")
+    .Output("output: T")
+    .Attr("T: {float, double}")
+    .Attr("ksize: list(int) >= 4")
+    .Attr("strides: list(int) >= 4")
+    .Attr(GetPaddingAttrString())
+    .SetShapeFn(BlockedPoolShape)
+    .Doc(R"doc(
+Performs a MaxPool on a channel-blocked tensor. `ksize` and `strides` are
+given in NHWC order.
+
+NOTE Do not invoke this operator directly in Python. Grappler's
+CpuLayoutOptimizer is expected to substitute it for MaxPool.
+)doc");
+
+REGISTER_OP("_BlockedAvgPool")
+    .Input("input: T")
+    .Output("output: T")
+    .Attr("T: {float, double}")
+    .Attr("ksize: list(int) >= 4")
+    .Attr("strides: list(int) >= 4")
+    .Attr(GetPaddingAttrString())
+    .SetShapeFn(BlockedPoolShape)
+    .Doc(R"doc(
+Performs an AvgPool on a channel-blocked tensor. `ksize` and `strides` are
+given in NHWC order.
+
+NOTE Do not invoke this operator directly in Python. Grappler's
+CpuLayoutOptimizer is expected to substitute it for AvgPool.
+)doc");
+
 REGISTER_OP("Conv2DBackpropInput")
     .Input("input_sizes: int32")
     .Input("filter: T")
@@ -132,6 +132,69 @@ REGISTER_OP("ParseSingleExample")
       return Status::OK();
     });
 
+REGISTER_OP("ParseExampleColumns")
+    .Input("serialized: string")
+    .Output("sparse_indices: Nsparse * int64")
+    .Output("sparse_values: sparse_types")
+    .Output("sparse_shapes: Nsparse * int64")
+    .Output("dense_values: Tdense")
+    .Attr("Nsparse: int >= 0")
+    .Attr("sparse_types: list({float,int64,string}) >= 0")
+    .Attr("Tdense: list({float,int64,string}) >= 0")
+    .Attr("dense_shapes: list(shape) >= 0")
+    .SetShapeFn([](InferenceContext* c) {
+      int num_sparse;
+      DataTypeVector sparse_types;
+      DataTypeVector dense_types;
+      std::vector<PartialTensorShape> dense_shapes;
+      TF_RETURN_IF_ERROR(c->GetAttr("Nsparse", &num_sparse));
+      TF_RETURN_IF_ERROR(c->GetAttr("sparse_types", &sparse_types));
+      TF_RETURN_IF_ERROR(c->GetAttr("Tdense", &dense_types));
+      TF_RETURN_IF_ERROR(c->GetAttr("dense_shapes", &dense_shapes));
+      if (sparse_types.size() != num_sparse) {
+        return errors::InvalidArgument("Nsparse != len(sparse_types)");
+      }
+      if (dense_shapes.size() != dense_types.size()) {
+        return errors::InvalidArgument("len(dense_shapes) != len(Tdense)");
+      }
+
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &unused));
+
+      // Output sparse_indices, sparse_values, and sparse_shapes.
+      int output_idx = 0;
+      for (int i = 0; i < num_sparse; ++i) {
+        c->set_output(output_idx++, c->Matrix(c->UnknownDim(), 2));
+      }
+      for (int i = 0; i < num_sparse; ++i) {
+        c->set_output(output_idx++, c->Vector(c->UnknownDim()));
+      }
+      for (int i = 0; i < num_sparse; ++i) {
+        c->set_output(output_idx++, c->Vector(2));
+      }
+
+      // Output dense_values, batched along an unknown first dimension.
+      for (const PartialTensorShape& shape : dense_shapes) {
+        ShapeHandle dense;
+        TF_RETURN_IF_ERROR(c->MakeShapeFromPartialTensorShape(shape, &dense));
+        TF_RETURN_IF_ERROR(
+            c->Concatenate(c->Vector(c->UnknownDim()), dense, &dense));
+        c->set_output(output_idx++, dense);
+      }
+      return Status::OK();
+    });
+
+REGISTER_OP("SerializeExampleColumns")
+    .Input("sparse_indices: Nsparse * int64")
+    .Input("sparse_values: sparse_types")
+    .Input("sparse_shapes: Nsparse * int64")
+    .Input("dense_values: Tdense")
+    .Output("serialized: string")
+    .Attr("Nsparse: int >= 0")
+    .Attr("sparse_types: list({float,int64,string}) >= 0")
+    .Attr("Tdense: list({float,int64,string}) >= 0")
+    .SetShapeFn(shape_inference::ScalarShape);
+
 REGISTER_OP("ParseSingleSequenceExample")
     .Input("serialized: string")
     .Input("feature_list_dense_missing_assumed_empty: string")
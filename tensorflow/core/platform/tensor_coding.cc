@@ -29,6 +29,12 @@ void AssignRefCounted(StringPiece src, core::RefCounted* obj, string* out) {
 
 void EncodeStringList(const string* strings, int64 n, string* out) {
   out->clear();
+  // Size the output once instead of growing it string by string.
+  int64 total = 0;
+  for (int i = 0; i < n; ++i) {
+    total += core::VarintLength(strings[i].size()) + strings[i].size();
+  }
+  out->reserve(total);
   for (int i = 0; i < n; ++i) {
     core::PutVarint32(out, strings[i].size());
   }
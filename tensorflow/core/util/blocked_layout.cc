@@ -0,0 +1,96 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/util/blocked_layout.h"
+
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/errors.h"
+
+namespace tensorflow {
+
+TensorShape BlockedActivationShape(const TensorShape& nhwc, int64 block_size) {
+  return TensorShape({nhwc.dim_size(0),
+                      NumChannelBlocks(nhwc.dim_size(3), block_size),
+                      nhwc.dim_size(1), nhwc.dim_size(2), block_size});
+}
+
+TensorShape UnblockedActivationShape(const TensorShape& blocked,
+                                     int64 channels) {
+  return TensorShape({blocked.dim_size(0), blocked.dim_size(2),
+                      blocked.dim_size(3), channels});
+}
+
+TensorShape BlockedFilterShape(const TensorShape& hwio, int64 block_size) {
+  return TensorShape({NumChannelBlocks(hwio.dim_size(3), block_size),
+                      NumChannelBlocks(hwio.dim_size(2), block_size),
+                      hwio.dim_size(0), hwio.dim_size(1), block_size,
+                      block_size});
+}
+
+Status ToBlockedActivation(const Tensor& nhwc, int64 block_size,
+                           Tensor* blocked) {
+  if (nhwc.dims() != 4) {
+    return errors::InvalidArgument("activation must be 4-dimensional: ",
+                                   nhwc.shape().DebugString());
+  }
+  if (block_size <= 0) {
+    return errors::InvalidArgument("Invalid block size ", block_size);
+  }
+  *blocked =
+      Tensor(nhwc.dtype(), BlockedActivationShape(nhwc.shape(), block_size));
+  const int64 pixels = nhwc.dim_size(1) * nhwc.dim_size(2);
+  switch (nhwc.dtype()) {
+#define REORDER(T)                                                          \
+  case DataTypeToEnum<T>::value:                                            \
+    ToBlockedActivation(nhwc.flat<T>().data(), pixels, nhwc.dim_size(3),    \
+                        block_size, 0, nhwc.dim_size(0) * pixels,           \
+                        blocked->flat<T>().data());                         \
+    return Status::OK();
+    REORDER(float);
+    REORDER(double);
+#undef REORDER
+    default:
+      return errors::InvalidArgument("Unsupported activation type ",
+                                     DataTypeString(nhwc.dtype()));
+  }
+}
+
+Status ToBlockedFilter(const Tensor& hwio, int64 block_size, Tensor* blocked) {
+  if (hwio.dims() != 4) {
+    return errors::InvalidArgument("filter must be 4-dimensional: ",
+                                   hwio.shape().DebugString());
+  }
+  if (block_size <= 0) {
+    return errors::InvalidArgument("Invalid block size ", block_size);
+  }
+  *blocked =
+      Tensor(hwio.dtype(), BlockedFilterShape(hwio.shape(), block_size));
+  switch (hwio.dtype()) {
+#define REORDER(T)                                                          \
+  case DataTypeToEnum<T>::value:                                            \
+    ToBlockedFilter(hwio.flat<T>().data(), hwio.dim_size(0),                \
+                    hwio.dim_size(1), hwio.dim_size(2), hwio.dim_size(3),   \
+                    block_size, blocked->flat<T>().data());                 \
+    return Status::OK();
+    REORDER(float);
+    REORDER(double);
+#undef REORDER
+    default:
+      return errors::InvalidArgument("Unsupported filter type ",
+                                     DataTypeString(hwio.dtype()));
+  }
+}
+
+}  // namespace tensorflow
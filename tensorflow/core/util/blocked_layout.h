@@ -0,0 +1,134 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Channel-blocked tensor layouts of the CPU _Blocked* kernels, such as
+// NCHW8c, in which the innermost dimension is a block of channels that fills
+// SIMD registers.
+//
+// An NHWC activation of C channels is stored as [N, ceil(C / b), H, W, b]:
+// the channels are split in blocks of b, the last one padded. The padding
+// channels hold unspecified (but finite) values, which the kernels never let
+// influence the other channels.
+//
+// An HWIO filter is stored as [ceil(O / b), ceil(I / b), H, W, b, b], where
+// the two innermost dimensions are the input and the output channels of a
+// pair of blocks. Its padding is zero.
+
+#ifndef TENSORFLOW_CORE_UTIL_BLOCKED_LAYOUT_H_
+#define TENSORFLOW_CORE_UTIL_BLOCKED_LAYOUT_H_
+
+#include <string.h>
+#include <algorithm>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// Number of blocks of `block_size` channels holding `channels` channels.
+inline int64 NumChannelBlocks(int64 channels, int64 block_size) {
+  return (channels + block_size - 1) / block_size;
+}
+
+// Shape of the blocked layout of an NHWC activation of shape `nhwc`, or of
+// the NHWC activation of the blocked layout of `blocked` with `channels`.
+TensorShape BlockedActivationShape(const TensorShape& nhwc, int64 block_size);
+TensorShape UnblockedActivationShape(const TensorShape& blocked,
+                                     int64 channels);
+// Shape of the blocked layout of an HWIO filter of shape `hwio`.
+TensorShape BlockedFilterShape(const TensorShape& hwio, int64 block_size);
+
+// Copies the row-major [batch, pixels, channels] `nhwc` to the row-major
+// [batch, ceil(channels / block_size), pixels, block_size] `blocked`, with
+// zeros in the padding channels. Copies pixels [begin, end) of the flattened
+// [batch, pixels] range.
+template <typename T>
+void ToBlockedActivation(const T* nhwc, int64 pixels, int64 channels,
+                         int64 block_size, int64 begin, int64 end,
+                         T* blocked) {
+  const int64 num_blocks = NumChannelBlocks(channels, block_size);
+  for (int64 p = begin; p < end; ++p) {
+    const int64 batch = p / pixels;
+    const int64 pixel = p % pixels;
+    const T* src = nhwc + p * channels;
+    T* dst = blocked + (batch * num_blocks * pixels + pixel) * block_size;
+    for (int64 c = 0; c < channels; c += block_size) {
+      const int64 n = std::min(block_size, channels - c);
+      memcpy(dst, src + c, n * sizeof(T));
+      std::fill(dst + n, dst + block_size, static_cast<T>(0));
+      dst += pixels * block_size;
+    }
+  }
+}
+
+// Inverse of ToBlockedActivation: copies pixels [begin, end) of `blocked` to
+// `nhwc`, dropping the padding channels.
+template <typename T>
+void FromBlockedActivation(const T* blocked, int64 pixels, int64 channels,
+                           int64 block_size, int64 begin, int64 end, T* nhwc) {
+  const int64 num_blocks = NumChannelBlocks(channels, block_size);
+  for (int64 p = begin; p < end; ++p) {
+    const int64 batch = p / pixels;
+    const int64 pixel = p % pixels;
+    const T* src = blocked + (batch * num_blocks * pixels + pixel) * block_size;
+    T* dst = nhwc + p * channels;
+    for (int64 c = 0; c < channels; c += block_size) {
+      memcpy(dst + c, src, std::min(block_size, channels - c) * sizeof(T));
+      src += pixels * block_size;
+    }
+  }
+}
+
+// Copies the row-major [rows, cols, in_depth, out_depth] `hwio` to its
+// blocked layout `blocked`, with zeros in the padding.
+template <typename T>
+void ToBlockedFilter(const T* hwio, int64 rows, int64 cols, int64 in_depth,
+                     int64 out_depth, int64 block_size, T* blocked) {
+  const int64 in_blocks = NumChannelBlocks(in_depth, block_size);
+  const int64 out_blocks = NumChannelBlocks(out_depth, block_size);
+  for (int64 ob = 0; ob < out_blocks; ++ob) {
+    for (int64 ib = 0; ib < in_blocks; ++ib) {
+      for (int64 r = 0; r < rows; ++r) {
+        for (int64 c = 0; c < cols; ++c) {
+          for (int64 i = 0; i < block_size; ++i) {
+            const int64 in = ib * block_size + i;
+            for (int64 o = 0; o < block_size; ++o) {
+              const int64 out = ob * block_size + o;
+              *blocked++ =
+                  in < in_depth && out < out_depth
+                      ? hwio[((r * cols + c) * in_depth + in) * out_depth + out]
+                      : static_cast<T>(0);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Copies the 4D NHWC activation `nhwc` (float or double) to its blocked
+// layout `blocked`, e.g. to store a constant input in that layout.
+Status ToBlockedActivation(const Tensor& nhwc, int64 block_size,
+                           Tensor* blocked);
+
+// Reorders the 4D HWIO filter `hwio` (float or double) into `blocked`, e.g.
+// to store a constant filter in its blocked layout once and for all.
+Status ToBlockedFilter(const Tensor& hwio, int64 block_size, Tensor* blocked);
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_UTIL_BLOCKED_LAYOUT_H_
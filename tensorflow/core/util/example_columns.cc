@@ -0,0 +1,434 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/util/example_columns.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/raw_coding.h"
+#include "tensorflow/core/platform/byte_order.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/overflow.h"
+
+namespace tensorflow {
+namespace example {
+
+namespace {
+
+// "TFXC" in little-endian byte order.
+constexpr uint32 kExampleColumnsMagic = 0x43584654;
+
+bool IsSupportedType(DataType dtype) {
+  return dtype == DT_FLOAT || dtype == DT_INT64 || dtype == DT_STRING;
+}
+
+// Appends the num_values values of `t` (of any shape) to `out`.
+void PutValues(const Tensor& t, string* out) {
+  switch (t.dtype()) {
+    case DT_FLOAT: {
+      auto values = t.flat<float>();
+      if (port::kLittleEndian) {
+        out->append(reinterpret_cast<const char*>(values.data()),
+                    values.size() * sizeof(float));
+      } else {
+        for (int64 i = 0; i < values.size(); ++i) {
+          uint32 bits;
+          std::memcpy(&bits, &values(i), sizeof(bits));
+          core::PutFixed32(out, bits);
+        }
+      }
+      break;
+    }
+    case DT_INT64: {
+      auto values = t.flat<int64>();
+      if (port::kLittleEndian) {
+        out->append(reinterpret_cast<const char*>(values.data()),
+                    values.size() * sizeof(int64));
+      } else {
+        for (int64 i = 0; i < values.size(); ++i) {
+          core::PutFixed64(out, static_cast<uint64>(values(i)));
+        }
+      }
+      break;
+    }
+    case DT_STRING: {
+      auto values = t.flat<string>();
+      for (int64 i = 0; i < values.size(); ++i) {
+        core::PutVarint64(out, values(i).size());
+      }
+      for (int64 i = 0; i < values.size(); ++i) {
+        out->append(values(i));
+      }
+      break;
+    }
+    default:
+      LOG(FATAL) << "Unsupported type " << DataTypeString(t.dtype());
+  }
+}
+
+// Reads all values of the preallocated tensor `t` from the front of `input`.
+Status GetValues(StringPiece* input, Tensor* t) {
+  const int64 n = t->NumElements();
+  if (n == 0) return Status::OK();
+  switch (t->dtype()) {
+    case DT_FLOAT: {
+      if (input->size() / sizeof(float) < static_cast<size_t>(n)) {
+        return errors::InvalidArgument("Truncated float column");
+      }
+      float* values = t->flat<float>().data();
+      if (port::kLittleEndian) {
+        std::memcpy(values, input->data(), n * sizeof(float));
+      } else {
+        for (int64 i = 0; i < n; ++i) {
+          const uint32 bits =
+              core::DecodeFixed32(input->data() + i * sizeof(float));
+          std::memcpy(&values[i], &bits, sizeof(bits));
+        }
+      }
+      input->remove_prefix(n * sizeof(float));
+      return Status::OK();
+    }
+    case DT_INT64: {
+      if (input->size() / sizeof(int64) < static_cast<size_t>(n)) {
+        return errors::InvalidArgument("Truncated int64 column");
+      }
+      int64* values = t->flat<int64>().data();
+      if (port::kLittleEndian) {
+        std::memcpy(values, input->data(), n * sizeof(int64));
+      } else {
+        for (int64 i = 0; i < n; ++i) {
+          values[i] = static_cast<int64>(
+              core::DecodeFixed64(input->data() + i * sizeof(int64)));
+        }
+      }
+      input->remove_prefix(n * sizeof(int64));
+      return Status::OK();
+    }
+    case DT_STRING: {
+      // Every length takes at least one byte, so this also bounds the
+      // length loop below by the size of the block.
+      if (input->size() < static_cast<size_t>(n)) {
+        return errors::InvalidArgument("Truncated string column");
+      }
+      string* values = t->flat<string>().data();
+      std::vector<uint64> lengths(n);
+      uint64 total = 0;
+      for (int64 i = 0; i < n; ++i) {
+        if (!core::GetVarint64(input, &lengths[i]) ||
+            lengths[i] > input->size() ||
+            (total += lengths[i]) > input->size()) {
+          return errors::InvalidArgument("Truncated string column");
+        }
+      }
+      const char* data = input->data();
+      for (int64 i = 0; i < n; ++i) {
+        values[i].assign(data, lengths[i]);
+        data += lengths[i];
+      }
+      input->remove_prefix(total);
+      return Status::OK();
+    }
+    default:
+      return errors::InvalidArgument("Unsupported column type ",
+                                     DataTypeString(t->dtype()));
+  }
+}
+
+// Smallest number of bytes a single value of `dtype` occupies in a block.
+size_t MinValueBytes(DataType dtype) {
+  switch (dtype) {
+    case DT_FLOAT:
+      return sizeof(float);
+    case DT_INT64:
+      return sizeof(int64);
+    default:
+      return 1;
+  }
+}
+
+Status GetDataType(StringPiece* input, DataType expected) {
+  uint32 dtype;
+  if (!core::GetVarint32(input, &dtype)) {
+    return errors::InvalidArgument("Truncated column header");
+  }
+  if (dtype != static_cast<uint32>(expected)) {
+    return errors::InvalidArgument("Column has type enum ", dtype, " but ",
+                                   DataTypeString(expected), " was expected");
+  }
+  return Status::OK();
+}
+
+}  // namespace
+
+Status EncodeExampleColumns(gtl::ArraySlice<Tensor> sparse_indices,
+                            gtl::ArraySlice<Tensor> sparse_values,
+                            gtl::ArraySlice<Tensor> sparse_shapes,
+                            gtl::ArraySlice<Tensor> dense_values,
+                            string* block) {
+  if (sparse_indices.size() != sparse_values.size() ||
+      sparse_indices.size() != sparse_shapes.size()) {
+    return errors::InvalidArgument(
+        "Expected the same number of sparse indices, values and shapes, got ",
+        sparse_indices.size(), ", ", sparse_values.size(), " and ",
+        sparse_shapes.size());
+  }
+
+  int64 num_rows = -1;
+  for (size_t d = 0; d < dense_values.size(); ++d) {
+    const Tensor& values = dense_values[d];
+    if (!IsSupportedType(values.dtype())) {
+      return errors::InvalidArgument("Unsupported type for dense column ", d,
+                                     ": ", DataTypeString(values.dtype()));
+    }
+    if (values.dims() < 1) {
+      return errors::InvalidArgument("Dense column ", d,
+                                     " must have a batch dimension, got shape ",
+                                     values.shape().DebugString());
+    }
+    if (num_rows < 0) num_rows = values.dim_size(0);
+    if (values.dim_size(0) != num_rows) {
+      return errors::InvalidArgument("Dense column ", d, " has ",
+                                     values.dim_size(0), " rows, expected ",
+                                     num_rows);
+    }
+  }
+  for (size_t d = 0; d < sparse_shapes.size(); ++d) {
+    const Tensor& shape = sparse_shapes[d];
+    if (shape.dtype() != DT_INT64 || shape.shape() != TensorShape({2})) {
+      return errors::InvalidArgument(
+          "Sparse column ", d, " must have an int64 shape of length 2, got ",
+          shape.shape().DebugString());
+    }
+    const int64 rows = shape.vec<int64>()(0);
+    if (rows < 0) {
+      return errors::InvalidArgument("Sparse column ", d,
+                                     " has a negative number of rows");
+    }
+    if (num_rows < 0) num_rows = rows;
+    if (rows != num_rows) {
+      return errors::InvalidArgument("Sparse column ", d, " has ", rows,
+                                     " rows, expected ", num_rows);
+    }
+  }
+  if (num_rows < 0) num_rows = 0;
+
+  block->clear();
+  core::PutFixed32(block, kExampleColumnsMagic);
+  core::PutVarint64(block, num_rows);
+  core::PutVarint32(block, dense_values.size());
+  core::PutVarint32(block, sparse_values.size());
+
+  for (const Tensor& values : dense_values) {
+    core::PutVarint32(block, values.dtype());
+    core::PutVarint32(block, values.dims() - 1);
+    for (int i = 1; i < values.dims(); ++i) {
+      core::PutVarint64(block, values.dim_size(i));
+    }
+    PutValues(values, block);
+  }
+
+  std::vector<int64> row_offsets;
+  for (size_t d = 0; d < sparse_values.size(); ++d) {
+    const Tensor& indices = sparse_indices[d];
+    const Tensor& values = sparse_values[d];
+    if (!IsSupportedType(values.dtype())) {
+      return errors::InvalidArgument("Unsupported type for sparse column ", d,
+                                     ": ", DataTypeString(values.dtype()));
+    }
+    if (values.dims() != 1 || indices.dtype() != DT_INT64 ||
+        indices.dims() != 2 || indices.dim_size(0) != values.dim_size(0) ||
+        indices.dim_size(1) != 2) {
+      return errors::InvalidArgument(
+          "Sparse column ", d, " has indices of shape ",
+          indices.shape().DebugString(), " and values of shape ",
+          values.shape().DebugString(), ", expected [N, 2] and [N]");
+    }
+    // Turn the (row, position) indices into row offsets, checking that they
+    // describe a variable length feature so that decoding can rebuild them.
+    auto ix = indices.matrix<int64>();
+    row_offsets.assign(num_rows + 1, 0);
+    int64 row = 0;
+    int64 position = 0;
+    for (int64 i = 0; i < ix.dimension(0); ++i) {
+      if (ix(i, 0) < row || ix(i, 0) >= num_rows) {
+        return errors::InvalidArgument(
+            "Sparse column ", d, " has out of order or out of bounds row ",
+            ix(i, 0), " at index ", i);
+      }
+      if (ix(i, 0) != row) {
+        for (++row; row <= ix(i, 0); ++row) row_offsets[row] = i;
+        row = ix(i, 0);
+        position = 0;
+      }
+      if (ix(i, 1) != position) {
+        return errors::InvalidArgument(
+            "Sparse column ", d, " is not a variable length feature: index ",
+            i, " is (", ix(i, 0), ", ", ix(i, 1), "), expected (", row, ", ",
+            position, ")");
+      }
+      ++position;
+    }
+    for (++row; row <= num_rows; ++row) row_offsets[row] = ix.dimension(0);
+
+    core::PutVarint32(block, values.dtype());
+    core::PutVarint64(block, values.NumElements());
+    for (int64 offset : row_offsets) {
+      core::PutFixed64(block, static_cast<uint64>(offset));
+    }
+    PutValues(values, block);
+  }
+  return Status::OK();
+}
+
+Status DecodeExampleColumns(StringPiece block,
+                            const ExampleColumnsConfig& config,
+                            Result* result) {
+  StringPiece input = block;
+  uint64 num_rows;
+  uint32 num_dense;
+  uint32 num_sparse;
+  if (input.size() < sizeof(uint32) ||
+      core::DecodeFixed32(input.data()) != kExampleColumnsMagic) {
+    return errors::InvalidArgument("Not an example column block");
+  }
+  input.remove_prefix(sizeof(uint32));
+  if (!core::GetVarint64(&input, &num_rows) ||
+      !core::GetVarint32(&input, &num_dense) ||
+      !core::GetVarint32(&input, &num_sparse)) {
+    return errors::InvalidArgument("Truncated example column block header");
+  }
+  if (num_rows > static_cast<uint64>(kint64max) - 1) {
+    return errors::InvalidArgument("Invalid number of rows: ", num_rows);
+  }
+  if (num_dense != config.dense.size() || num_sparse != config.sparse.size()) {
+    return errors::InvalidArgument(
+        "Example column block has ", num_dense, " dense and ", num_sparse,
+        " sparse columns, expected ", config.dense.size(), " and ",
+        config.sparse.size());
+  }
+  const int64 rows = static_cast<int64>(num_rows);
+
+  result->dense_values.clear();
+  result->sparse_indices.clear();
+  result->sparse_values.clear();
+  result->sparse_shapes.clear();
+  result->dense_values.reserve(num_dense);
+  result->sparse_indices.reserve(num_sparse);
+  result->sparse_values.reserve(num_sparse);
+  result->sparse_shapes.reserve(num_sparse);
+
+  for (size_t d = 0; d < config.dense.size(); ++d) {
+    const DataType dtype = config.dense[d].dtype;
+    TF_RETURN_IF_ERROR(GetDataType(&input, dtype));
+    uint32 rank;
+    if (!core::GetVarint32(&input, &rank) ||
+        rank >= TensorShape::MaxDimensions()) {
+      return errors::InvalidArgument("Invalid rank for dense column ", d);
+    }
+    TensorShape row_shape;
+    int64 num_elements = rows;
+    for (uint32 i = 0; i < rank; ++i) {
+      uint64 dim;
+      if (!core::GetVarint64(&input, &dim) ||
+          dim > static_cast<uint64>(kint64max)) {
+        return errors::InvalidArgument("Invalid shape for dense column ", d);
+      }
+      num_elements = MultiplyWithoutOverflow(num_elements, dim);
+      if (num_elements < 0 ||
+          MultiplyWithoutOverflow(row_shape.num_elements(), dim) < 0) {
+        return errors::InvalidArgument("Dense column ", d, " is too large");
+      }
+      row_shape.AddDim(dim);
+    }
+    if (!config.dense[d].shape.IsCompatibleWith(row_shape)) {
+      return errors::InvalidArgument(
+          "Dense column ", d, " has shape ", row_shape.DebugString(),
+          " which is incompatible with ", config.dense[d].shape.DebugString());
+    }
+    // Reject oversized shapes before allocating the output.
+    if (input.size() / MinValueBytes(dtype) <
+        static_cast<uint64>(num_elements)) {
+      return errors::InvalidArgument("Truncated dense column ", d);
+    }
+    TensorShape shape({rows});
+    shape.AppendShape(row_shape);
+    result->dense_values.emplace_back(dtype, shape);
+    TF_RETURN_IF_ERROR(GetValues(&input, &result->dense_values.back()));
+  }
+
+  for (size_t d = 0; d < config.sparse.size(); ++d) {
+    const DataType dtype = config.sparse[d].dtype;
+    TF_RETURN_IF_ERROR(GetDataType(&input, dtype));
+    uint64 num_values;
+    if (!core::GetVarint64(&input, &num_values) ||
+        input.size() / sizeof(uint64) < num_rows + 1 ||
+        (input.size() - (num_rows + 1) * sizeof(uint64)) /
+                MinValueBytes(dtype) <
+            num_values) {
+      return errors::InvalidArgument("Truncated sparse column ", d);
+    }
+    const int64 n = static_cast<int64>(num_values);
+    Tensor indices(DT_INT64, TensorShape({n, 2}));
+    auto ix = indices.matrix<int64>();
+    const char* offsets = input.data();
+    int64 begin = 0;
+    int64 max_length = 0;
+    if (core::DecodeFixed64(offsets) != 0) {
+      return errors::InvalidArgument("Sparse column ", d,
+                                     " does not start at offset 0");
+    }
+    for (int64 r = 0; r < rows; ++r) {
+      const uint64 end =
+          core::DecodeFixed64(offsets + (r + 1) * sizeof(uint64));
+      if (end < static_cast<uint64>(begin) || end > num_values) {
+        return errors::InvalidArgument("Invalid row offset ", end,
+                                       " in sparse column ", d);
+      }
+      for (int64 i = begin; i < static_cast<int64>(end); ++i) {
+        ix(i, 0) = r;
+        ix(i, 1) = i - begin;
+      }
+      max_length = std::max(max_length, static_cast<int64>(end) - begin);
+      begin = static_cast<int64>(end);
+    }
+    if (begin != n) {
+      return errors::InvalidArgument("Sparse column ", d, " has ", n,
+                                     " values but its rows cover ", begin);
+    }
+    input.remove_prefix((num_rows + 1) * sizeof(uint64));
+
+    Tensor values(dtype, TensorShape({n}));
+    TF_RETURN_IF_ERROR(GetValues(&input, &values));
+    Tensor shape(DT_INT64, TensorShape({2}));
+    shape.vec<int64>()(0) = rows;
+    shape.vec<int64>()(1) = max_length;
+
+    result->sparse_indices.push_back(std::move(indices));
+    result->sparse_values.push_back(std::move(values));
+    result->sparse_shapes.push_back(std::move(shape));
+  }
+
+  if (!input.empty()) {
+    return errors::InvalidArgument("Example column block has ", input.size(),
+                                   " trailing bytes");
+  }
+  return Status::OK();
+}
+
+}  // namespace example
+}  // namespace tensorflow
@@ -0,0 +1,89 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_UTIL_EXAMPLE_COLUMNS_H_
+#define TENSORFLOW_CORE_UTIL_EXAMPLE_COLUMNS_H_
+
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/lib/gtl/array_slice.h"
+#include "tensorflow/core/util/example_proto_fast_parsing.h"
+
+namespace tensorflow {
+namespace example {
+
+// A column block is a pre-parsed alternative to a batch of serialized Example
+// protos. It stores the output of ParseExample for one batch column by column,
+// so that reading it back only requires validating offsets and copying whole
+// arrays instead of parsing every Example:
+//
+//   block        := magic:fixed32 num_rows:varint64
+//                   num_dense:varint32 num_sparse:varint32
+//                   dense_column* sparse_column*
+//   dense_column := dtype:varint32 rank:varint32 dim:varint64*
+//                   values(num_rows * prod(dim))
+//   sparse_column:= dtype:varint32 num_values:varint64
+//                   row_offsets:fixed64[num_rows + 1] values(num_values)
+//
+// Float and int64 values are stored as little-endian fixed-width arrays;
+// strings as all their lengths (varint64) followed by all their bytes.
+// Sparse columns hold variable length features, i.e. the value at index
+// (row, i) of the SparseTensor is the i-th value of row `row`, and the
+// values of row r are [row_offsets[r], row_offsets[r + 1]).
+//
+// Columns are positional: feature names are not stored in the block.
+struct ExampleColumnsConfig {
+  struct Dense {
+    DataType dtype;
+    // Shape of a single row; must be compatible with the shape stored in the
+    // block.
+    PartialTensorShape shape;
+  };
+
+  struct Sparse {
+    DataType dtype;
+  };
+
+  std::vector<Dense> dense;
+  std::vector<Sparse> sparse;
+};
+
+// Encodes a batch in the format returned by ParseExample into a column block.
+// Every dense value must have shape [num_rows, ...]; every sparse column must
+// be a [num_rows, max_length] SparseTensor whose indices are sorted by row and
+// numbered 0, 1, ... within each row, as produced for a VarLenFeature.
+Status EncodeExampleColumns(gtl::ArraySlice<Tensor> sparse_indices,
+                            gtl::ArraySlice<Tensor> sparse_values,
+                            gtl::ArraySlice<Tensor> sparse_shapes,
+                            gtl::ArraySlice<Tensor> dense_values,
+                            string* block);
+
+// Decodes a column block into the same outputs ParseExample would produce for
+// the batch it was encoded from. Returns InvalidArgument if the block is
+// malformed or does not match `config`.
+Status DecodeExampleColumns(StringPiece block,
+                            const ExampleColumnsConfig& config,
+                            Result* result);
+
+}  // namespace example
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_UTIL_EXAMPLE_COLUMNS_H_
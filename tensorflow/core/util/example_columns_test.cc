@@ -0,0 +1,160 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/util/example_columns.h"
+
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace example {
+namespace {
+
+class ExampleColumnsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // A batch of three rows with two dense and two variable length columns.
+    dense_.push_back(test::AsTensor<float>({1, 2, 3, 4, 5, 6}, {3, 2}));
+    dense_.push_back(test::AsTensor<string>({"a", "", "ccc"}, {3}));
+    config_.dense.push_back({DT_FLOAT, PartialTensorShape({2})});
+    config_.dense.push_back({DT_STRING, PartialTensorShape({})});
+
+    // Rows of length 2, 0 and 3.
+    sparse_indices_.push_back(test::AsTensor<int64>(
+        {0, 0, 0, 1, 2, 0, 2, 1, 2, 2}, {5, 2}));
+    sparse_values_.push_back(test::AsTensor<int64>({7, -8, 9, 1LL << 40, 0}));
+    sparse_shapes_.push_back(test::AsTensor<int64>({3, 3}));
+    config_.sparse.push_back({DT_INT64});
+
+    // A column with only its last row set.
+    sparse_indices_.push_back(test::AsTensor<int64>({2, 0}, {1, 2}));
+    sparse_values_.push_back(test::AsTensor<string>({"xyz"}));
+    sparse_shapes_.push_back(test::AsTensor<int64>({3, 1}));
+    config_.sparse.push_back({DT_STRING});
+  }
+
+  Status Encode(string* block) {
+    return EncodeExampleColumns(sparse_indices_, sparse_values_,
+                                sparse_shapes_, dense_, block);
+  }
+
+  std::vector<Tensor> sparse_indices_;
+  std::vector<Tensor> sparse_values_;
+  std::vector<Tensor> sparse_shapes_;
+  std::vector<Tensor> dense_;
+  ExampleColumnsConfig config_;
+};
+
+TEST_F(ExampleColumnsTest, RoundTrip) {
+  string block;
+  TF_ASSERT_OK(Encode(&block));
+
+  Result result;
+  TF_ASSERT_OK(DecodeExampleColumns(block, config_, &result));
+  ASSERT_EQ(2, result.dense_values.size());
+  ASSERT_EQ(2, result.sparse_values.size());
+  test::ExpectTensorEqual<float>(dense_[0], result.dense_values[0]);
+  test::ExpectTensorEqual<string>(dense_[1], result.dense_values[1]);
+  test::ExpectTensorEqual<int64>(sparse_indices_[0], result.sparse_indices[0]);
+  test::ExpectTensorEqual<int64>(sparse_values_[0], result.sparse_values[0]);
+  test::ExpectTensorEqual<int64>(sparse_shapes_[0], result.sparse_shapes[0]);
+  test::ExpectTensorEqual<int64>(sparse_indices_[1], result.sparse_indices[1]);
+  test::ExpectTensorEqual<string>(sparse_values_[1], result.sparse_values[1]);
+  test::ExpectTensorEqual<int64>(sparse_shapes_[1], result.sparse_shapes[1]);
+}
+
+TEST_F(ExampleColumnsTest, EmptyBatch) {
+  std::vector<Tensor> dense = {Tensor(DT_FLOAT, TensorShape({0, 2}))};
+  std::vector<Tensor> sparse_indices = {Tensor(DT_INT64, TensorShape({0, 2}))};
+  std::vector<Tensor> sparse_values = {Tensor(DT_STRING, TensorShape({0}))};
+  std::vector<Tensor> sparse_shapes = {test::AsTensor<int64>({0, 0})};
+  string block;
+  TF_ASSERT_OK(EncodeExampleColumns(sparse_indices, sparse_values,
+                                    sparse_shapes, dense, &block));
+
+  ExampleColumnsConfig config;
+  config.dense.push_back({DT_FLOAT, PartialTensorShape({-1})});
+  config.sparse.push_back({DT_STRING});
+  Result result;
+  TF_ASSERT_OK(DecodeExampleColumns(block, config, &result));
+  EXPECT_EQ(TensorShape({0, 2}), result.dense_values[0].shape());
+  EXPECT_EQ(TensorShape({0, 2}), result.sparse_indices[0].shape());
+  EXPECT_EQ(TensorShape({0}), result.sparse_values[0].shape());
+  test::ExpectTensorEqual<int64>(sparse_shapes[0], result.sparse_shapes[0]);
+}
+
+TEST_F(ExampleColumnsTest, RejectsSparseColumnThatIsNotVarLen) {
+  string block;
+  sparse_indices_[0] =
+      test::AsTensor<int64>({0, 0, 0, 2, 2, 0, 2, 1, 2, 2}, {5, 2});
+  EXPECT_EQ(error::INVALID_ARGUMENT, Encode(&block).code());
+
+  sparse_indices_[0] =
+      test::AsTensor<int64>({2, 0, 0, 0, 0, 1, 2, 1, 2, 2}, {5, 2});
+  EXPECT_EQ(error::INVALID_ARGUMENT, Encode(&block).code());
+}
+
+TEST_F(ExampleColumnsTest, RejectsMismatchedRows) {
+  string block;
+  sparse_shapes_[1] = test::AsTensor<int64>({4, 1});
+  EXPECT_EQ(error::INVALID_ARGUMENT, Encode(&block).code());
+}
+
+TEST_F(ExampleColumnsTest, RejectsMismatchedConfig) {
+  string block;
+  TF_ASSERT_OK(Encode(&block));
+  Result result;
+
+  ExampleColumnsConfig config = config_;
+  config.dense[0].shape = PartialTensorShape({3});
+  EXPECT_EQ(error::INVALID_ARGUMENT,
+            DecodeExampleColumns(block, config, &result).code());
+
+  config = config_;
+  config.sparse[1].dtype = DT_FLOAT;
+  EXPECT_EQ(error::INVALID_ARGUMENT,
+            DecodeExampleColumns(block, config, &result).code());
+
+  config = config_;
+  config.sparse.pop_back();
+  EXPECT_EQ(error::INVALID_ARGUMENT,
+            DecodeExampleColumns(block, config, &result).code());
+}
+
+TEST_F(ExampleColumnsTest, RejectsCorruptBlocks) {
+  string block;
+  TF_ASSERT_OK(Encode(&block));
+  Result result;
+  for (size_t size = 0; size < block.size(); ++size) {
+    EXPECT_EQ(error::INVALID_ARGUMENT,
+              DecodeExampleColumns(StringPiece(block.data(), size), config_,
+                                   &result)
+                  .code())
+        << "Prefix of size " << size;
+  }
+  EXPECT_EQ(error::INVALID_ARGUMENT,
+            DecodeExampleColumns(block + "x", config_, &result).code());
+
+  // Flipping any single byte must never make decoding read out of bounds.
+  for (size_t i = 0; i < block.size(); ++i) {
+    string corrupt = block;
+    corrupt[i] ^= 0xff;
+    DecodeExampleColumns(corrupt, config_, &result).IgnoreError();
+  }
+}
+
+}  // namespace
+}  // namespace example
+}  // namespace tensorflow
@@ -14,6 +14,9 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/util/example_proto_fast_parsing.h"
 
+#include <algorithm>
+#include <cstring>
+#include <numeric>
 #include <vector>
 
 #include "tensorflow/core/example/example.pb.h"
@@ -21,15 +24,18 @@ limitations under the License.
 #include "tensorflow/core/framework/numeric_op.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/lib/core/bits.h"
 #include "tensorflow/core/lib/core/blocking_counter.h"
 #include "tensorflow/core/lib/core/casts.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/raw_coding.h"
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
+#include "tensorflow/core/lib/hash/hash.h"
 #include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/platform/byte_order.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/protobuf.h"
-#include "tensorflow/core/util/presized_cuckoo_map.h"
 #include "tensorflow/core/util/sparse/sparse_tensor.h"
 
 namespace tensorflow {
@@ -60,6 +66,131 @@ constexpr uint8 kVarintTag(uint32 tag) { return (tag << 3) | 0; }
 constexpr uint8 kDelimitedTag(uint32 tag) { return (tag << 3) | 2; }
 constexpr uint8 kFixed32Tag(uint32 tag) { return (tag << 3) | 5; }
 
+template <typename T>
+class LimitedArraySlice {
+ public:
+  LimitedArraySlice(T* begin, size_t num_elements)
+      : current_(begin), end_(begin + num_elements) {}
+
+  // May return negative if there were push_back calls after slice was filled.
+  int64 EndDistance() const { return end_ - current_; }
+
+  // Attempts to push value to the back of this. If the slice has
+  // already been filled, this method has no effect on the underlying data, but
+  // it changes the number returned by EndDistance into negative values.
+  void push_back(T&& value) {
+    if (EndDistance() > 0) *current_ = std::move(value);
+    ++current_;
+  }
+
+  // Extends this by `num_elements` and returns where to write them, or
+  // returns nullptr and only changes EndDistance if they don't fit.
+  T* Append(size_t num_elements) {
+    T* begin = current_;
+    current_ += num_elements;
+    return EndDistance() >= 0 ? begin : nullptr;
+  }
+
+ private:
+  T* current_;
+  T* end_;
+};
+
+// Extends `list` by `num_elements` and returns where to write them, or
+// nullptr if they don't fit.
+template <typename T>
+T* AppendElements(size_t num_elements, SmallVector<T>* list) {
+  const size_t size = list->size();
+  list->resize(size + num_elements);
+  return list->data() + size;
+}
+
+template <typename T>
+T* AppendElements(size_t num_elements, LimitedArraySlice<T>* slice) {
+  return slice->Append(num_elements);
+}
+
+// Appends the `size` bytes of little-endian floats of a packed FloatList to
+// `float_list`, with one copy on little-endian hosts.
+template <typename Result>
+bool ParsePackedFloats(const char* packed, size_t size, Result* float_list) {
+  if (size % sizeof(float) != 0) return false;
+  const size_t num_elements = size / sizeof(float);
+  float* out = AppendElements(num_elements, float_list);
+  if (out == nullptr) return true;
+  if (port::kLittleEndian) {
+    std::memcpy(out, packed, size);
+  } else {
+    for (size_t i = 0; i < num_elements; ++i) {
+      out[i] = bit_cast<float>(core::DecodeFixed32(packed + i * sizeof(float)));
+    }
+  }
+  return true;
+}
+
+// The continuation bits of 8 bytes of varints loaded as a uint64.
+constexpr uint64 kVarintContinuationBits = 0x8080808080808080ULL;
+
+// Returns the number of varints in the `size` bytes of a packed Int64List,
+// which is the number of bytes without a continuation bit, or -1 if the last
+// varint is truncated.
+int64 CountPackedVarints(const uint8* packed, size_t size) {
+  if (size > 0 && (packed[size - 1] & 0x80) != 0) return -1;
+  size_t num_continuation_bytes = 0;
+  size_t i = 0;
+  for (; i + sizeof(uint64) <= size; i += sizeof(uint64)) {
+    uint64 word;
+    std::memcpy(&word, packed + i, sizeof(word));
+    // Sums the continuation bits, shifted to the low bit of their byte, into
+    // the top byte.
+    num_continuation_bytes +=
+        (((word & kVarintContinuationBits) >> 7) * 0x0101010101010101ULL) >>
+        56;
+  }
+  for (; i < size; ++i) num_continuation_bytes += packed[i] >> 7;
+  return size - num_continuation_bytes;
+}
+
+// Decodes the varints of [packed, end) into `out`. Eight bytes without
+// continuation bits are eight one-byte varints, such as small ids and
+// counts, and are widened together; other varints are decoded one by one.
+bool DecodePackedVarints(const uint8* packed, const uint8* end, int64* out) {
+  while (packed < end) {
+    if (end - packed >= static_cast<int64>(sizeof(uint64))) {
+      uint64 word;
+      std::memcpy(&word, packed, sizeof(word));
+      if ((word & kVarintContinuationBits) == 0) {
+        for (size_t i = 0; i < sizeof(uint64); ++i) out[i] = packed[i];
+        out += sizeof(uint64);
+        packed += sizeof(uint64);
+        continue;
+      }
+    }
+    uint64 value = 0;
+    for (int shift = 0;; shift += 7) {
+      // A varint has at most 10 bytes.
+      if (packed == end || shift >= 64) return false;
+      const uint8 byte = *packed++;
+      value |= static_cast<uint64>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) break;
+    }
+    *out++ = static_cast<int64>(value);
+  }
+  return true;
+}
+
+// Appends the varints in the `size` bytes of a packed Int64List to
+// `int64_list`.
+template <typename Result>
+bool ParsePackedVarints(const uint8* packed, size_t size,
+                        Result* int64_list) {
+  const int64 num_elements = CountPackedVarints(packed, size);
+  if (num_elements < 0) return false;
+  int64* out = AppendElements(num_elements, int64_list);
+  if (out == nullptr) return true;
+  return DecodePackedVarints(packed, packed + size, out);
+}
+
 namespace parsed {
 
 // ParseDataType has to be called first, then appropriate ParseZzzzList.
@@ -159,15 +290,11 @@ class Feature {
         if (!stream.ExpectTag(kDelimitedTag(1))) return false;  // packed tag
         uint32 packed_length;
         if (!stream.ReadVarint32(&packed_length)) return false;
-        auto packed_limit = stream.PushLimit(packed_length);
-
-        while (!stream.ExpectAtEnd()) {
-          uint32 buffer32;
-          if (!stream.ReadLittleEndian32(&buffer32)) return false;
-          float_list->push_back(bit_cast<float>(buffer32));
+        const char* packed = serialized_.data() + stream.CurrentPosition();
+        if (!stream.Skip(packed_length)) return false;
+        if (!ParsePackedFloats(packed, packed_length, float_list)) {
+          return false;
         }
-
-        stream.PopLimit(packed_limit);
       } else {  // non-packed
         while (!stream.ExpectAtEnd()) {
           if (!stream.ExpectTag(kFixed32Tag(1))) return false;
@@ -201,15 +328,13 @@ class Feature {
         if (!stream.ExpectTag(kDelimitedTag(1))) return false;  // packed tag
         uint32 packed_length;
         if (!stream.ReadVarint32(&packed_length)) return false;
-        auto packed_limit = stream.PushLimit(packed_length);
-
-        while (!stream.ExpectAtEnd()) {
-          protobuf_uint64 n;  // There is no API for int64
-          if (!stream.ReadVarint64(&n)) return false;
-          int64_list->push_back(static_cast<int64>(n));
+        const uint8* packed = reinterpret_cast<const uint8*>(
+                                  serialized_.data()) +
+                              stream.CurrentPosition();
+        if (!stream.Skip(packed_length)) return false;
+        if (!ParsePackedVarints(packed, packed_length, int64_list)) {
+          return false;
         }
-
-        stream.PopLimit(packed_limit);
       } else {  // non-packed
         while (!stream.ExpectAtEnd()) {
           if (!stream.ExpectTag(kVarintTag(1))) return false;
@@ -438,33 +563,125 @@ struct SparseBuffer {
   std::vector<size_t> example_end_indices;
 };
 
-struct SeededHasher {
-  uint64 operator()(StringPiece s) const {
-    return Hash64(s.data(), s.size(), seed);
+// Maps the feature names of a config to their index in config.dense or
+// config.sparse with a perfect hash, built by hash and displace: names are
+// grouped in buckets by hash, and each bucket gets a displacement that sends
+// its names to distinct free slots. A lookup is one hash, two array reads and
+// one comparison with the only name that can match.
+class FeatureNameIndex {
+ public:
+  // Returns an error if no perfect hash was found, which only happens if
+  // config has duplicate feature names.
+  Status Build(const Config& config) {
+    std::vector<std::pair<StringPiece, std::pair<size_t, Type>>> entries;
+    for (size_t d = 0; d < config.dense.size(); ++d) {
+      entries.push_back({config.dense[d].feature_name, {d, Type::Dense}});
+    }
+    for (size_t d = 0; d < config.sparse.size(); ++d) {
+      entries.push_back({config.sparse[d].feature_name, {d, Type::Sparse}});
+    }
+    // Half-full slots and buckets of two names on average make displacements
+    // quick to find.
+    slot_mask_ = NextPowerOfTwo64(std::max<uint64>(2 * entries.size(), 1)) - 1;
+    bucket_mask_ =
+        NextPowerOfTwo64(std::max<uint64>(entries.size() / 2, 1)) - 1;
+    for (size_t i = 0; i < 100; ++i) {
+      if (TryBuild(entries)) return Status::OK();
+      seed_++;
+    }
+    return errors::Internal(
+        "Could not build the feature name index. Feature names must be "
+        "unique.");
   }
-  uint64 seed{0xDECAFCAFFE};
-};
 
-template <typename T>
-class LimitedArraySlice {
- public:
-  LimitedArraySlice(T* begin, size_t num_elements)
-      : current_(begin), end_(begin + num_elements) {}
+  // Returns whether `name` is in the config, and if so its index and type.
+  bool Find(StringPiece name, std::pair<size_t, Type>* d_and_type) const {
+    const Slot& slot = slots_[SlotOf(Hash(name))];
+    if (!slot.used || slot.name != name) return false;
+    *d_and_type = slot.d_and_type;
+    return true;
+  }
 
-  // May return negative if there were push_back calls after slice was filled.
-  int64 EndDistance() const { return end_ - current_; }
+ private:
+  struct Slot {
+    bool used = false;
+    StringPiece name;
+    std::pair<size_t, Type> d_and_type;
+  };
 
-  // Attempts to push value to the back of this. If the slice has
-  // already been filled, this method has no effect on the underlying data, but
-  // it changes the number returned by EndDistance into negative values.
-  void push_back(T&& value) {
-    if (EndDistance() > 0) *current_ = std::move(value);
-    ++current_;
+  uint64 Hash(StringPiece name) const {
+    return Hash64(name.data(), name.size(), seed_);
   }
 
- private:
-  T* current_;
-  T* end_;
+  uint64 BucketOf(uint64 hash) const { return (hash >> 32) & bucket_mask_; }
+
+  // The step is odd, so that the displacements of a bucket go through all
+  // the slots.
+  uint64 SlotOf(uint64 hash, uint64 displacement) const {
+    return (static_cast<uint32>(hash) + displacement * ((hash >> 16) | 1)) &
+           slot_mask_;
+  }
+
+  uint64 SlotOf(uint64 hash) const {
+    return SlotOf(hash, displacements_[BucketOf(hash)]);
+  }
+
+  bool TryBuild(const std::vector<std::pair<StringPiece,
+                                            std::pair<size_t, Type>>>&
+                    entries) {
+    std::vector<std::vector<size_t>> buckets(bucket_mask_ + 1);
+    std::vector<uint64> hashes(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      hashes[i] = Hash(entries[i].first);
+      buckets[BucketOf(hashes[i])].push_back(i);
+    }
+    // Larger buckets are harder to place, so they go first.
+    std::vector<size_t> order(buckets.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&buckets](size_t a,
+                                                            size_t b) {
+      return buckets[a].size() > buckets[b].size();
+    });
+
+    displacements_.assign(buckets.size(), 0);
+    slots_.assign(slot_mask_ + 1, Slot());
+    std::vector<uint64> bucket_slots;
+    for (size_t b : order) {
+      const std::vector<size_t>& bucket = buckets[b];
+      if (bucket.empty()) break;
+      bool placed = false;
+      for (uint64 displacement = 0; !placed && displacement <= 2 * slot_mask_;
+           ++displacement) {
+        bucket_slots.clear();
+        placed = true;
+        for (size_t i : bucket) {
+          const uint64 slot = SlotOf(hashes[i], displacement);
+          if (slots_[slot].used ||
+              std::find(bucket_slots.begin(), bucket_slots.end(), slot) !=
+                  bucket_slots.end()) {
+            placed = false;
+            break;
+          }
+          bucket_slots.push_back(slot);
+        }
+        if (placed) displacements_[b] = displacement;
+      }
+      if (!placed) return false;
+      for (size_t j = 0; j < bucket.size(); ++j) {
+        Slot& slot = slots_[bucket_slots[j]];
+        slot.used = true;
+        slot.name = entries[bucket[j]].first;
+        slot.d_and_type = entries[bucket[j]].second;
+      }
+    }
+    return true;
+  }
+
+  uint64 seed_ = 0xDECAFCAFFE;
+  uint64 slot_mask_ = 0;
+  uint64 bucket_mask_ = 0;
+  std::vector<uint64> displacements_;
+  std::vector<Slot> slots_;
 };
 
 void LogDenseFeatureDataLoss(StringPiece feature_name) {
@@ -492,8 +709,7 @@ void LogSparseFeatureDataLoss(StringPiece feature_name) {
 Status FastParseSerializedExample(
     const string& serialized_example, const string& example_name,
     const size_t example_index, const Config& config,
-    const PresizedCuckooMap<std::pair<size_t, Type>>& config_index,
-    SeededHasher hasher, std::vector<Tensor>* output_dense,
+    const FeatureNameIndex& config_index, std::vector<Tensor>* output_dense,
     std::vector<SparseBuffer>* output_varlen_dense,
     std::vector<SparseBuffer>* output_sparse) {
   DCHECK(output_dense != nullptr);
@@ -518,21 +734,11 @@ Status FastParseSerializedExample(
     parsed::Feature& feature = name_and_feature.second;
 
     std::pair<size_t, Type> d_and_type;
-    uint64 h = hasher(feature_name);
-    if (!config_index.Find(h, &d_and_type)) continue;
+    if (!config_index.Find(feature_name, &d_and_type)) continue;
 
     size_t d = d_and_type.first;
     bool is_dense = d_and_type.second == Type::Dense;
 
-    {
-      // Testing for PresizedCuckooMap collision.
-      // TODO(lew): Use dense_hash_map and avoid this and hasher creation.
-      const string& config_feature_name = is_dense
-                                              ? config.dense[d].feature_name
-                                              : config.sparse[d].feature_name;
-      if (feature_name != config_feature_name) continue;
-    }
-
     auto example_error = [&](StringPiece suffix) {
       return errors::InvalidArgument("Name: ", example_name,
                                      ", Key: ", feature_name,
@@ -877,30 +1083,9 @@ Status FastParseExample(const Config& config,
     TF_RETURN_IF_ERROR(CheckConfigDataType(c.dtype));
   }
 
-  size_t config_size = config.dense.size() + config.sparse.size();
-  SeededHasher hasher;
   // Build config index.
-  PresizedCuckooMap<std::pair<size_t, Type>> config_index(config_size);
-  bool ok = true;
-  for (size_t i = 0; i < 1000; ++i) {
-    for (size_t d = 0; d < config.dense.size(); ++d) {
-      ok &= config_index.InsertUnique(hasher(config.dense[d].feature_name),
-                                      {d, Type::Dense});
-    }
-    for (size_t d = 0; d < config.sparse.size(); ++d) {
-      ok &= config_index.InsertUnique(hasher(config.sparse[d].feature_name),
-                                      {d, Type::Sparse});
-    }
-    if (ok) break;
-    LOG(WARNING) << "Collision found. This should happen only if you have "
-                    "around 2^32 entries in your config.";
-    hasher.seed++;
-    config_index.Clear(config_size);
-  }
-  if (!ok) {
-    return errors::Internal(
-        "Could not avoid collision. This should not happen.");
-  }
+  FeatureNameIndex config_index;
+  TF_RETURN_IF_ERROR(config_index.Build(config));
 
   // Allocate dense output for fixed length dense values
   // (variable-length dense and sparse have to be buffered).
@@ -965,7 +1150,7 @@ Status FastParseExample(const Config& config,
       status_of_minibatch[minibatch] = FastParseSerializedExample(
           serialized[e],
           (!example_names.empty() ? example_names[e] : "<unknown>"), e, config,
-          config_index, hasher, &fixed_dense_values,
+          config_index, &fixed_dense_values,
           &varlen_dense_buffers[minibatch], &sparse_buffers[minibatch]);
       if (!status_of_minibatch[minibatch].ok()) break;
     }
@@ -1139,30 +1324,9 @@ Status FastParseSingleExample(const Config& config, const string& serialized,
   }
 
   // TODO(mrry): Cache the construction of this map at Op construction time.
-  size_t config_size = config.dense.size() + config.sparse.size();
-  SeededHasher hasher;
   // Build config index.
-  PresizedCuckooMap<std::pair<size_t, Type>> config_index(config_size);
-  bool ok = true;
-  for (size_t i = 0; i < 1000; ++i) {
-    for (size_t d = 0; d < config.dense.size(); ++d) {
-      ok &= config_index.InsertUnique(hasher(config.dense[d].feature_name),
-                                      {d, Type::Dense});
-    }
-    for (size_t d = 0; d < config.sparse.size(); ++d) {
-      ok &= config_index.InsertUnique(hasher(config.sparse[d].feature_name),
-                                      {d, Type::Sparse});
-    }
-    if (ok) break;
-    LOG(WARNING) << "Collision found. This should happen only if you have "
-                    "around 2^32 entries in your config.";
-    hasher.seed++;
-    config_index.Clear(config_size);
-  }
-  if (!ok) {
-    return errors::Internal(
-        "Could not avoid collision. This should not happen.");
-  }
+  FeatureNameIndex config_index;
+  TF_RETURN_IF_ERROR(config_index.Build(config));
 
   // Allocate dense output tensors.
   for (size_t d = 0; d < config.dense.size(); ++d) {
@@ -1208,21 +1372,11 @@ Status FastParseSingleExample(const Config& config, const string& serialized,
     parsed::Feature& feature = name_and_feature.second;
 
     std::pair<size_t, Type> d_and_type;
-    uint64 h = hasher(feature_name);
-    if (!config_index.Find(h, &d_and_type)) continue;
+    if (!config_index.Find(feature_name, &d_and_type)) continue;
 
     size_t d = d_and_type.first;
     bool is_dense = d_and_type.second == Type::Dense;
 
-    {
-      // Testing for PresizedCuckooMap collision.
-      // TODO(lew): Use dense_hash_map and avoid this and hasher creation.
-      const string& config_feature_name = is_dense
-                                              ? config.dense[d].feature_name
-                                              : config.sparse[d].feature_name;
-      if (feature_name != config_feature_name) continue;
-    }
-
     auto example_error = [feature_name](StringPiece suffix) {
       return errors::InvalidArgument("Key: ", feature_name, ".  ", suffix);
     };
@@ -17,6 +17,8 @@ limitations under the License.
 
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature.pb.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/platform/protobuf.h"
@@ -168,6 +170,38 @@ TEST(FastParse, Packed) {
       "\x0a\x0d\x0a\x0b\x0a\x03\x61\x67\x65\x12\x04\x1a\x02\x08\x0d");
 }
 
+TEST(FastParse, PackedInt64OfAllSizes) {
+  Example example;
+  Int64List* int64_list =
+      (*example.mutable_features()->mutable_feature())["int64_list"]
+          .mutable_int64_list();
+  // Runs of one-byte varints, then varints of every length up to 10 bytes.
+  for (int i = 0; i < 37; ++i) int64_list->add_value(i);
+  for (int shift = 0; shift < 64; shift += 3) {
+    int64_list->add_value(1LL << shift);
+    int64_list->add_value(-(1LL << shift));
+    int64_list->add_value(shift);
+  }
+  TestCorrectness(Serialize(example));
+}
+
+TEST(FastParse, PackedFloats) {
+  Example example;
+  FloatList* float_list =
+      (*example.mutable_features()->mutable_feature())["float_list"]
+          .mutable_float_list();
+  for (int i = 0; i < 100; ++i) float_list->add_value(i * 0.37f - 10.0f);
+  TestCorrectness(Serialize(example));
+}
+
+TEST(FastParse, TruncatedPackedInt64) {
+  // The packed varint 0x80 of "age" lacks its last byte.
+  Example example;
+  EXPECT_FALSE(TestFastParse(
+      "\x0a\x0e\x0a\x0c\x0a\x03\x61\x67\x65\x12\x05\x1a\x03\x0a\x01\x80",
+      &example));
+}
+
 TEST(FastParse, EmptyFeatures) {
   Example example;
   example.mutable_features();
@@ -346,6 +380,67 @@ TEST(TestFastParseExample, Empty) {
   EXPECT_TRUE(status.ok()) << status;
 }
 
+TEST(TestFastParseExample, ManyDenseFeatures) {
+  // Enough features for the feature name index to have buckets of several
+  // names, some of which are not in the config.
+  const int kNumFeatures = 300;
+  const int kBatchSize = 3;
+  FastParseExampleConfig config;
+  for (int i = 0; i < kNumFeatures; i += 2) {
+    config.dense.push_back({strings::StrCat("int64_", i), DT_INT64,
+                            PartialTensorShape({2}), Tensor(), false, 2});
+    config.dense.push_back({strings::StrCat("float_", i), DT_FLOAT,
+                            PartialTensorShape({3}), Tensor(), false, 3});
+  }
+  std::vector<string> serialized;
+  for (int b = 0; b < kBatchSize; ++b) {
+    Example example;
+    auto& features = *example.mutable_features()->mutable_feature();
+    for (int i = 0; i < kNumFeatures; ++i) {
+      auto& int64_list = *features[strings::StrCat("int64_", i)]
+                              .mutable_int64_list();
+      int64_list.add_value(b * 1000 + i);
+      int64_list.add_value(-i);
+      auto& float_list = *features[strings::StrCat("float_", i)]
+                              .mutable_float_list();
+      for (int j = 0; j < 3; ++j) float_list.add_value(b + i * 0.5f + j);
+    }
+    serialized.push_back(Serialize(example));
+  }
+
+  Result result;
+  TF_ASSERT_OK(FastParseExample(config, serialized, gtl::ArraySlice<string>(),
+                                nullptr, &result));
+  ASSERT_EQ(kNumFeatures, result.dense_values.size());
+  for (int i = 0; i < kNumFeatures; i += 2) {
+    auto int64_values = result.dense_values[i].matrix<int64>();
+    auto float_values = result.dense_values[i + 1].matrix<float>();
+    for (int b = 0; b < kBatchSize; ++b) {
+      EXPECT_EQ(b * 1000 + i, int64_values(b, 0));
+      EXPECT_EQ(-i, int64_values(b, 1));
+      for (int j = 0; j < 3; ++j) {
+        EXPECT_EQ(b + i * 0.5f + j, float_values(b, j));
+      }
+    }
+  }
+}
+
+TEST(TestFastParseExample, DenseFeatureOfWrongSize) {
+  FastParseExampleConfig config;
+  config.dense.push_back(
+      {"age", DT_INT64, PartialTensorShape({2}), Tensor(), false, 2});
+  Example example;
+  auto& int64_list = *(*example.mutable_features()->mutable_feature())["age"]
+                          .mutable_int64_list();
+  for (int i = 0; i < 3; ++i) int64_list.add_value(i);
+
+  const std::vector<string> serialized = {Serialize(example)};
+  Result result;
+  Status status = FastParseExample(config, serialized,
+                                   gtl::ArraySlice<string>(), nullptr, &result);
+  EXPECT_TRUE(errors::IsInvalidArgument(status)) << status;
+}
+
 }  // namespace
 }  // namespace example
 }  // namespace tensorflow
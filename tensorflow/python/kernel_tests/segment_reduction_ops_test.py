@@ -126,6 +126,22 @@ class SegmentReductionOpTest(SegmentReductionHelper):
             # and may therefore vary dynamically.
             self.assertAllEqual(np_ans.shape[1:], tf_ans.shape[1:])
 
+  def testLargeValues(self):
+    # Large enough for the reduction to be sharded on segment boundaries,
+    # with both long segments and gaps.
+    np.random.seed(0)
+    indices = np.sort(np.random.randint(0, 5000, size=20000))
+    np_x = np.random.rand(20000, 8).astype(np.float32)
+    np_sum = np.zeros((indices[-1] + 1, 8), dtype=np.float32)
+    np.add.at(np_sum, indices, np_x)
+    np_max = np.full((indices[-1] + 1, 8), 0, dtype=np.float32)
+    np_max[np.unique(indices)] = -np.inf
+    np.maximum.at(np_max, indices, np_x)
+    with self.test_session(use_gpu=False):
+      self.assertAllClose(
+          np_sum, math_ops.segment_sum(np_x, indices).eval(), rtol=1e-5)
+      self.assertAllClose(np_max, math_ops.segment_max(np_x, indices).eval())
+
   def testSegmentIdsShape(self):
     shape = [4, 4]
     tf_x, _ = self._input(shape)
@@ -301,6 +317,28 @@ class UnsortedSegmentTest(SegmentReductionHelper):
               self.assertAllClose(np_ans, tf_ans)
               self.assertShapeEqual(np_ans, s)
 
+  def testLargeValues(self):
+    # Large enough for the reduction to be sharded, with many rows per
+    # segment (reduced into partial outputs) and few rows per segment
+    # (sharded by segment).
+    np.random.seed(0)
+    for num_rows, num_segments in (20000, 10), (20000, 50000):
+      indices = np.random.randint(-1, num_segments, size=num_rows)
+      np_x = np.random.rand(num_rows, 8).astype(np.float32)
+      np_sum = np.zeros((num_segments, 8), dtype=np.float32)
+      np.add.at(np_sum, indices[indices >= 0], np_x[indices >= 0])
+      np_min = np.full((num_segments, 8), np.finfo(np.float32).max,
+                       dtype=np.float32)
+      np.minimum.at(np_min, indices[indices >= 0], np_x[indices >= 0])
+      with self.test_session(use_gpu=False):
+        self.assertAllClose(
+            np_sum,
+            math_ops.unsorted_segment_sum(np_x, indices, num_segments).eval(),
+            rtol=1e-5)
+        self.assertAllClose(
+            np_min,
+            math_ops.unsorted_segment_min(np_x, indices, num_segments).eval())
+
   def testNumSegmentsTypes(self):
     dtypes = [dtypes_lib.int32, dtypes_lib.int64]
     indices_flat = np.array([0, 4, 0, 8, 3, 8, 4, 7, 7, 3])
@@ -160,6 +160,38 @@ class TopKTest(test.TestCase):
       values = -np.sort(-inputs, axis=1)[:, :k]
       self._validateTopK(inputs, k, values, indices)
 
+  def _testLongRowTopK(self, dtype, sorted_output):
+    b = 3
+    n = 100000
+    for k in [10, 1000, 40000]:
+      inputs = np.random.permutation(
+          np.linspace(0, 100, b * n, dtype=dtype)).reshape(b, n)
+      indices = np.argsort(-inputs, axis=1)[:, :k]
+      values = -np.sort(-inputs, axis=1)[:, :k]
+      self._validateTopK(inputs, k, values, indices, sorted=sorted_output)
+
+  def testLongRowTopK(self):
+    self._testLongRowTopK(np.float32, sorted_output=True)
+    self._testLongRowTopK(np.float64, sorted_output=False)
+
+  def testLongRowStableSort(self):
+    b = 2
+    n = 20000
+    for k in [5, 500]:
+      # Lots of repeated integers taking values in [0, 3]
+      inputs = np.random.permutation(
+          np.linspace(0, 3, b * n, dtype=np.int32)).reshape(b, n)
+      indices = np.argsort(-inputs, axis=1, kind="mergesort")[:, :k]
+      values = -np.sort(-inputs, axis=1)[:, :k]
+      self._validateTopK(inputs, k, values, indices)
+
+  def testLongRowDescending(self):
+    # The largest values come first, so sampled thresholds start out high.
+    n = 50000
+    inputs = np.linspace(100, 0, n, dtype=np.float32).reshape(1, n)
+    k = 20
+    self._validateTopK(inputs, k, inputs[:, :k], [list(range(k))])
+
   def testTopAll(self):
     inputs = [[0.1, 0.3, 0.2, 0.4], [0.1, 0.3, 0.3, 0.2]]
     self._validateTopK(inputs, 4, [[0.4, 0.3, 0.2, 0.1], [0.3, 0.3, 0.2, 0.1]],
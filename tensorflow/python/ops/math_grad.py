@@ -388,6 +388,24 @@ def _UnsortedSegmentProdGrad(op, grad):
   return gathered_grad * partial_derivative, None, None
 
 
+@ops.RegisterGradient("FusedEmbeddingLookupSparse")
+def _FusedEmbeddingLookupSparseGrad(op, grad):
+  """Gradient for FusedEmbeddingLookupSparse.
+
+  Only `params` gets a gradient: a row per id, like the gradient of gather.
+  """
+  params = op.inputs[0]
+  # params can be large, so colocate the shape calculation with it, as
+  # _GatherGrad does.
+  with ops.colocate_with(params):
+    params_shape = array_ops.shape(params, out_type=ops.dtypes.int64)
+    params_shape = math_ops.to_int32(params_shape)
+  values = gen_math_ops.fused_embedding_lookup_sparse_grad(
+      grad, op.inputs[2], op.inputs[3], combiner=op.get_attr("combiner"))
+  return [ops.IndexedSlices(values, op.inputs[1], params_shape), None, None,
+          None]
+
+
 @ops.RegisterGradient("Abs")
 def _AbsGrad(op, grad):
   x = op.inputs[0]